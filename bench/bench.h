@@ -0,0 +1,86 @@
+//
+// bench.h
+// Timing and reporting for the benchmarks of the plain C cores
+//
+// Each bench_*.c file is a separate program. Throughput is measured around a whole loop with bench_now and
+// reported with bench_report; per-call latency is collected into a bench_latency and reported as p50/p99.
+// Iteration counts should be multiplied by bench_scale(), which reads BENCH_SCALE from the environment.
+
+#pragma once
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static inline uint64_t bench_now(void) {
+    struct timespec ts ;
+    clock_gettime(CLOCK_MONOTONIC, &ts) ;
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec ;
+}
+
+static inline uint64_t bench_scale(void) {
+    const char *value = getenv("BENCH_SCALE") ;
+    long long  scale  = value ? atoll(value) : 1 ;
+    return (scale > 0) ? (uint64_t)scale : 1 ;
+}
+
+// keeps the compiler from discarding a result which is otherwise unused
+static inline void bench_use(const void *value) {
+    __asm__ __volatile__("" : : "r"(value) : "memory") ;
+}
+
+// ops/s and ns/op, plus MB/s when bytes is non-zero
+static inline void bench_report(const char *name, uint64_t ops, uint64_t elapsedNs, uint64_t bytes) {
+    double seconds = (double)elapsedNs / 1e9 ;
+    printf("  %-44s %12.0f ops/s %10.1f ns/op", name, (double)ops / seconds, (double)elapsedNs / (double)ops) ;
+    if (bytes) printf(" %9.1f MB/s", (double)bytes / seconds / (1024.0 * 1024.0)) ;
+    printf("\n") ;
+}
+
+typedef struct {
+    uint64_t *samples ;
+    size_t   count ;
+    size_t   capacity ;
+} bench_latency ;
+
+static inline void bench_latency_init(bench_latency *latency, size_t capacity) {
+    latency->samples  = malloc(capacity * sizeof(uint64_t)) ;
+    latency->count    = 0 ;
+    latency->capacity = latency->samples ? capacity : 0 ;
+}
+
+static inline void bench_latency_add(bench_latency *latency, uint64_t ns) {
+    if (latency->count < latency->capacity) latency->samples[latency->count++] = ns ;
+}
+
+static int bench_compareSamples(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b ;
+    return (x > y) - (x < y) ;
+}
+
+static inline uint64_t bench_latency_quantile(bench_latency *latency, double quantile) {
+    if (latency->count == 0) return 0 ;
+    size_t index = (size_t)(quantile * (double)(latency->count - 1) + 0.5) ;
+    return latency->samples[index] ;
+}
+
+// sorts the samples, prints calls/s, p50 and p99, and empties the collection for reuse
+static inline void bench_latency_report(const char *name, bench_latency *latency) {
+    if (latency->count == 0) return ;
+    uint64_t total = 0 ;
+    for (size_t i = 0 ; i < latency->count ; i++) total += latency->samples[i] ;
+    qsort(latency->samples, latency->count, sizeof(uint64_t), bench_compareSamples) ;
+    printf("  %-44s %12.0f calls/s  p50 %8" PRIu64 " ns  p99 %8" PRIu64 " ns\n", name,
+           (double)latency->count * 1e9 / (double)(total ? total : 1),
+           bench_latency_quantile(latency, 0.50), bench_latency_quantile(latency, 0.99)) ;
+    latency->count = 0 ;
+}
+
+static inline void bench_latency_free(bench_latency *latency) {
+    free(latency->samples) ;
+    latency->samples  = NULL ;
+    latency->capacity = 0 ;
+}
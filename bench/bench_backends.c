@@ -0,0 +1,126 @@
+//
+// bench_backends.c
+// What the coredock, cgsdebug and bluetooth modules pay for a call through their mock backends, made the way
+// each module makes it: through its backend table and wrapped in the HSASM_SPI instrumentation. For each
+// module there are the single calls, with and without injected failures, and the request a Lua call turns
+// into -- coredock_applyRequest, cgsdebug_applyPlan, and a bluetooth set followed by bt_state_wait. The
+// cursor module's backends are in bench_cursor_backend.c.
+//
+// The bluetooth controller's sleep does nothing, since the mock's sets land immediately; the wait is the
+// getter calls and the clock reads, not the poll interval.
+
+#include "bench.h"
+#include "hsasm_spi.h"
+#include "bluetooth/bt_state.h"
+#include "cgsdebug/cgsdebug_plan.h"
+#include "coredock/coredock_settings.h"
+
+static const coredock_backend *dock    = &coredock_mockBackend ;
+static const cgsdebug_backend *backend = &cgsdebug_mockBackend ;
+
+typedef void (*bench_step)(uint64_t i) ;
+
+static void bench_run(const char *name, uint64_t iterations, bench_step step) {
+    bench_latency latency ;
+    bench_latency_init(&latency, (size_t)iterations) ;
+    uint64_t start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        uint64_t callStart = bench_now() ;
+        step(i) ;
+        bench_latency_add(&latency, bench_now() - callStart) ;
+    }
+    bench_report(name, iterations, bench_now() - start, 0) ;
+    bench_latency_report(name, &latency) ;
+    bench_latency_free(&latency) ;
+}
+
+// coredock: a getter and a setter in turn, as tileSize() and tileSize(value) make them
+static void coredock_call(uint64_t i) {
+    if (i & 1) {
+        HSASM_SPI_VOID("CoreDockSetTileSize", dock->setTileSize((float)(i & 0xFF) / 256.0f)) ;
+    } else {
+        float size = HSASM_SPI("CoreDockGetTileSize", dock->getTileSize()) ;
+        bench_use(&size) ;
+    }
+}
+
+// coredock: apply(table) changing two of the fields
+static void coredock_apply(uint64_t i) {
+    coredock_settings requested = coredock_mockState, current ;
+    requested.tileSize = (float)(i & 0xFF) / 256.0f ;
+    requested.autoHide = (Boolean)(i & 1) ;
+    bench_use((void *)(uintptr_t)coredock_applyRequest(dock, &requested, kCoreDockFieldTileSize | kCoreDockFieldAutoHide, &current)) ;
+}
+
+// cgsdebug: getting and setting the options mask
+static void cgsdebug_call(uint64_t i) {
+    CGSDebugOption options = kCGSDebugOptionNone ;
+    if (i & 1) {
+        bench_use((void *)(intptr_t)HSASM_SPI_ERROR("CGSSetDebugOptions", backend->setDebugOptions((CGSDebugOption)(i & 0xF0)))) ;
+    } else {
+        bench_use((void *)(intptr_t)HSASM_SPI_ERROR("CGSGetDebugOptions", backend->getDebugOptions(&options))) ;
+    }
+}
+
+// cgsdebug: one flag toggled with a verifying read, as set(option, state) does
+static void cgsdebug_apply(uint64_t i) {
+    cgsdebug_plan plan = { 0 } ;
+    uint32_t      mask = 0 ;
+    bool          verified ;
+    cgsdebug_plan_add(&plan, 0x10, (i & 1) != 0) ;
+    bench_use((void *)(intptr_t)cgsdebug_applyPlan(backend, &plan, 1, &mask, &verified)) ;
+}
+
+// bluetooth: the power getter and setter in turn
+static void bluetooth_call(uint64_t i) {
+    if (i & 1) {
+        HSASM_SPI_VOID("IOBluetoothPreferenceSetControllerPowerState", bt_mockSetPower((int)(i >> 1) & 1)) ;
+    } else {
+        int state = HSASM_SPI("IOBluetoothPreferenceGetControllerPowerState", bt_mockGetPower()) ;
+        bench_use(&state) ;
+    }
+}
+
+static int bench_btGet(__attribute__((unused)) void *context) {
+    return HSASM_SPI("IOBluetoothPreferenceGetControllerPowerState", bt_mockGetPower()) ? 1 : 0 ;
+}
+
+static double bench_btNow(__attribute__((unused)) void *context) {
+    return (double)bench_now() / 1e9 ;
+}
+
+static void bench_btSleep(__attribute__((unused)) void *context, __attribute__((unused)) double seconds) {
+}
+
+static const bt_controller bench_btController = { bench_btGet, bench_btNow, bench_btSleep, NULL } ;
+
+// bluetooth: power(state) waiting for the change, as the synchronous form does
+static void bluetooth_apply(uint64_t i) {
+    int state = (int)(i & 1) ;
+    HSASM_SPI_VOID("IOBluetoothPreferenceSetControllerPowerState", bt_mockSetPower(state)) ;
+    bench_use((void *)(intptr_t)bt_state_wait(&bench_btController, state, BT_SYNC_TIMEOUT)) ;
+}
+
+static void bench_module(const char *module, hsasm_mock *mock, bench_step call, bench_step apply, const char *applyName) {
+    char     name[96] ;
+    uint64_t iterations = 2000000 * bench_scale() ;
+
+    snprintf(name, sizeof(name), "%s calls", module) ;
+    bench_run(name, iterations, call) ;
+    mock->failureRate = 0.1 ;
+    snprintf(name, sizeof(name), "%s calls, failureRate 0.1", module) ;
+    bench_run(name, iterations, call) ;
+    mock->failureRate = 0.0 ;
+    snprintf(name, sizeof(name), "%s %s", module, applyName) ;
+    bench_run(name, iterations / 4, apply) ;
+    printf("    %" PRIu64 " mock calls, %" PRIu64 " failed\n", atomic_load(&mock->calls), atomic_load(&mock->failures)) ;
+    hsasm_mock_reset(mock) ;
+}
+
+int main(void) {
+    printf("mock backends\n") ;
+    bench_module("coredock", &coredock_mock, coredock_call, coredock_apply, "apply, two fields") ;
+    bench_module("cgsdebug", &cgsdebug_mock, cgsdebug_call, cgsdebug_apply, "set, one flag, verified") ;
+    bench_module("bluetooth", &bluetoothMock, bluetooth_call, bluetooth_apply, "power set and wait") ;
+    return 0 ;
+}
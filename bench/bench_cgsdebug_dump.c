@@ -0,0 +1,137 @@
+//
+// bench_cgsdebug_dump.c
+// Throughput of indexing and parsing WindowServer dump files, using the window list fixture repeated until
+// the file is about the size of a dump from a machine with tens of thousands of windows, and of comparing
+// two generated window lists of 10k and more windows which differ in a handful of them
+
+#include "bench.h"
+#include "test.h"
+#include "cgsdebug/cgsdebug_dump.h"
+
+// parses every line of a record the way dumpFile:record does, without building the Lua table
+static size_t parse_record(const char *bytes, dump_record record) {
+    dump_cursor cursor = dump_cursor_make(bytes + record.offset, record.length) ;
+    dump_line   line ;
+    size_t      values = 0 ;
+    while (dump_cursor_next(&cursor, &line)) {
+        if (line.kind != kDumpLineField) continue ;
+        long long integer ;
+        double    number ;
+        values += (dump_parseValue(line.value, line.valueLength, &integer, &number) != kDumpValueString) ;
+    }
+    return values ;
+}
+
+static void noteChange(void *context, __attribute__((unused)) dump_change change, __attribute__((unused)) uint64_t windowID) {
+    (*(size_t *)context)++ ;
+}
+
+// a window list of `windows` entries shaped like the fixture's; every `changeEvery`th window gets a different
+// title, and the last window is left out when `dropLast` is set
+static char *generate_windowList(size_t windows, size_t changeEvery, int dropLast, size_t *length) {
+    char   *text = malloc(windows * 320 + 64) ;
+    size_t used  = (size_t)sprintf(text, "Window List\n    count: %zu\n\n", windows) ;
+    for (size_t w = 0 ; w < windows - (dropLast ? 1 : 0) ; w++) {
+        used += (size_t)sprintf(text + used,
+            "Window 0x%zx (%zu)\n    wid: %zu\n    cid: 0x1a3ac\n    pid: 940\n    owner: Hammerspoon\n"
+            "    title: window %zu%s\n    level: 0\n    bounds = {{241, 609}, {831, 673}}\n    alpha: 1.000000\n"
+            "    onscreen: yes\n    tags: 0x5c882\n    backing store: 0xbfab66a5ec\n\n",
+            w + 100, w + 100, w + 100, w, (changeEvery && w % changeEvery == 0) ? " - changed" : "") ;
+    }
+    *length = used ;
+    return text ;
+}
+
+// times building the index of a window list and then diffing it against lists with different numbers of
+// changed windows; changes lists the change intervals, with 0 for a list which only lost its last window
+static void bench_diff(size_t windows, const size_t *changes, size_t changesCount) {
+    size_t     beforeLength ;
+    char       *beforeText = generate_windowList(windows, 0, 0, &beforeLength) ;
+    dump_index beforeIndex = { NULL, 0, 0 } ;
+    dump_index_build(&beforeIndex, beforeText, beforeLength) ;
+
+    char         name[64] ;
+    size_t       rounds  = 20 * bench_scale() ;
+    uint64_t     buildNs = 0 ;
+    dump_windows before  = { .slots = NULL } ;
+    for (size_t r = 0 ; r < rounds ; r++) {
+        uint64_t start = bench_now() ;
+        dump_windows_build(&before, beforeText, &beforeIndex) ;
+        buildNs += bench_now() - start ;
+        if (r + 1 < rounds) dump_windows_free(&before) ;
+    }
+    snprintf(name, sizeof(name), "window index, %zu windows", windows) ;
+    bench_report(name, rounds * windows, buildNs, rounds * beforeLength) ;
+
+    for (size_t c = 0 ; c < changesCount ; c++) {
+        size_t       afterLength ;
+        char         *afterText  = generate_windowList(windows, changes[c], 1, &afterLength) ;
+        dump_index   afterIndex  = { NULL, 0, 0 } ;
+        dump_windows after       = { .slots = NULL } ;
+        size_t       differences = 0 ;
+        dump_index_build(&afterIndex, afterText, afterLength) ;
+        dump_windows_build(&after, afterText, &afterIndex) ;
+        dump_windows_diff(&before, &after, noteChange, &differences) ;
+
+        // about the same total work for each, so the few change runs are long enough to time
+        size_t   diffRounds = bench_scale() * (20 + 2000000 / differences) ;
+        uint64_t start      = bench_now() ;
+        for (size_t r = 0 ; r < diffRounds ; r++) dump_windows_diff(&before, &after, noteChange, &differences) ;
+        uint64_t elapsed = bench_now() - start ;
+        snprintf(name, sizeof(name), "diff, %zu windows, %zu differ", windows, differences / (diffRounds + 1)) ;
+        bench_report(name, diffRounds, elapsed, 0) ;
+
+        dump_windows_free(&after) ;
+        dump_index_free(&afterIndex) ;
+        free(afterText) ;
+    }
+
+    dump_windows_free(&before) ;
+    dump_index_free(&beforeIndex) ;
+    free(beforeText) ;
+}
+
+int main(void) {
+    size_t fixtureLength ;
+    char   *fixture = test_readFixture("WindowServer.winfo.out", &fixtureLength) ;
+    if (!fixture) return 1 ;
+
+    size_t copies = 2500 * bench_scale() ;
+    size_t length = fixtureLength * copies ;
+    char   *bytes = malloc(length) ;
+    for (size_t i = 0 ; i < copies ; i++) memcpy(bytes + i * fixtureLength, fixture, fixtureLength) ;
+    printf("cgsdebug dump (%.1f MB)\n", (double)length / (1024.0 * 1024.0)) ;
+
+    dump_index index = { NULL, 0, 0 } ;
+    uint64_t   start = bench_now() ;
+    dump_index_build(&index, bytes, length) ;
+    uint64_t   elapsed = bench_now() - start ;
+    bench_report("index (records)", index.count, elapsed, length) ;
+
+    size_t values = 0 ;
+    start = bench_now() ;
+    for (size_t i = 0 ; i < index.count ; i++) values += parse_record(bytes, index.records[i]) ;
+    elapsed = bench_now() - start ;
+    bench_report("parse every record", index.count, elapsed, length) ;
+    bench_use(&values) ;
+
+    // what a Lua loop which only looks at a few entries pays: one record parsed per lookup
+    size_t lookups = 100000 ;
+    test_seed(7007) ;
+    start = bench_now() ;
+    for (size_t i = 0 ; i < lookups ; i++) values += parse_record(bytes, index.records[test_random() % index.count]) ;
+    elapsed = bench_now() - start ;
+    bench_report("random record lookup", lookups, elapsed, 0) ;
+    bench_use(&values) ;
+
+    dump_index_free(&index) ;
+    free(bytes) ;
+    free(fixture) ;
+
+    // building a window index is an op per window; a diff is one op, and its cost should follow the
+    // number of windows which differ rather than the number in the lists
+    static const size_t changes[] = { 0, 10000, 1000, 100, 10, 1 } ;
+    bench_diff(10000, changes, 3) ;
+    bench_diff(100000, changes, sizeof(changes) / sizeof(changes[0])) ;
+    return 0 ;
+}
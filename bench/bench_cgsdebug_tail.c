@@ -0,0 +1,153 @@
+//
+// bench_cgsdebug_tail.c
+// Throughput of the tailer's line framing, and the latency from a line being written to a log file to it being
+// consumed, with the reader woken by inotify or by polling every 5ms as in cgsdebug_tailWatch.h
+
+#include "bench.h"
+#include "cgsdebug/cgsdebug_tail.h"
+#include "cgsdebug/cgsdebug_tailWatch.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+static void bench_framing(size_t lineLength, size_t readSize) {
+    char   name[64] ;
+    size_t total = (size_t)(64 << 20) * bench_scale() ;
+    char   *text = malloc(readSize) ;
+    for (size_t i = 0 ; i < readSize ; i++) text[i] = ((i + 1) % lineLength == 0) ? '\n' : 'x' ;
+
+    tail_ring ring ;
+    tail_ring_init(&ring, 1 << 20, 8192) ;
+    tail_ring_reset(&ring, 0) ;
+    uint64_t start = bench_now() ;
+    for (size_t done = 0 ; done < total ; ) {
+        size_t index ;
+        size_t span = tail_ring_reserve(&ring, &index) ;
+        if (span > readSize) span = readSize ;
+        memcpy(ring.bytes + index, text, span) ;
+        tail_ring_commit(&ring, span) ;
+        done += span ;
+        tail_ring_consume(&ring, tail_ring_pending(&ring)) ;
+    }
+    uint64_t elapsed = bench_now() - start ;
+    snprintf(name, sizeof(name), "frame %zu byte lines, %zuk reads", lineLength, readSize / 1024) ;
+    bench_report(name, ring.linesRead, elapsed, ring.bytesRead) ;
+    tail_ring_free(&ring) ;
+    free(text) ;
+}
+
+typedef struct {
+    const char       *path ;
+    bool             useInotify ;
+    unsigned         lines ;
+    pthread_mutex_t  mutex ;
+    tail_ring        ring ;
+    tail_file        file ;
+    _Atomic bool     writerDone ;
+    _Atomic bool     readerDone ;
+} latency_test ;
+
+static void latency_lock(void *context) {
+    pthread_mutex_lock(context) ;
+}
+
+static void latency_unlock(void *context) {
+    pthread_mutex_unlock(context) ;
+}
+
+// one line every 100us, each carrying the time it was written
+static void *latency_writer(void *context) {
+    latency_test *test = context ;
+    int          fd    = open(test->path, O_WRONLY | O_APPEND | O_CREAT, 0644) ;
+    for (unsigned i = 0 ; i < test->lines ; i++) {
+        char line[64] ;
+        int  length = snprintf(line, sizeof(line), "%" PRIu64 " CGXLog line\n", bench_now()) ;
+        if (write(fd, line, (size_t)length) != length) abort() ;
+        usleep(100) ;
+    }
+    close(fd) ;
+    atomic_store(&test->writerDone, true) ;
+    return NULL ;
+}
+
+static void *latency_reader(void *context) {
+    latency_test *test = context ;
+    tail_watch   watch ;
+    tail_watch_open(&watch, test->path, 5, test->useInotify) ;
+    bool finished = false ;
+    while (!finished) {
+        finished = atomic_load(&test->writerDone) ;
+        if (tail_watch_wait(&watch, finished ? 0 : 20)) tail_file_check(&test->file) ;
+    }
+    tail_file_check(&test->file) ;
+    tail_watch_close(&watch) ;
+    atomic_store(&test->readerDone, true) ;
+    return NULL ;
+}
+
+static void bench_writeToConsume(const char *path, bool useInotify) {
+    latency_test test = { .path = path, .useInotify = useInotify, .lines = (unsigned)(5000 * bench_scale()) } ;
+    pthread_mutex_init(&test.mutex, NULL) ;
+    tail_ring_init(&test.ring, 1 << 20, 8192) ;
+    tail_file_init(&test.file, path, 0, &test.ring) ;
+    test.file.lock        = latency_lock ;
+    test.file.unlock      = latency_unlock ;
+    test.file.lockContext = &test.mutex ;
+    unlink(path) ;
+
+    bench_latency latency ;
+    bench_latency_init(&latency, test.lines) ;
+    pthread_t writer, reader ;
+    pthread_create(&reader, NULL, latency_reader, &test) ;
+    pthread_create(&writer, NULL, latency_writer, &test) ;
+
+    // the consumer spins, so what's measured is how long the reader takes to notice and frame the line
+    while (true) {
+        bool done = atomic_load(&test.readerDone) ;
+        pthread_mutex_lock(&test.mutex) ;
+        uint64_t now   = bench_now() ;
+        size_t   count = tail_ring_pending(&test.ring) ;
+        for (size_t i = 0 ; i < count ; i++) {
+            tail_line  line = tail_ring_line(&test.ring, i) ;
+            const char *first ;
+            char       text[64] ;
+            size_t     firstLength = tail_ring_lineBytes(&test.ring, line, &first) ;
+            size_t     length      = (line.length < sizeof(text)) ? line.length : sizeof(text) - 1 ;
+            if (firstLength > length) firstLength = length ;
+            memcpy(text, first, firstLength) ;
+            memcpy(text + firstLength, test.ring.bytes, length - firstLength) ;
+            text[length] = 0 ;
+            bench_latency_add(&latency, now - strtoull(text, NULL, 10)) ;
+        }
+        tail_ring_consume(&test.ring, count) ;
+        pthread_mutex_unlock(&test.mutex) ;
+        if (count == 0 && done) break ;
+    }
+    pthread_join(writer, NULL) ;
+    pthread_join(reader, NULL) ;
+
+    char name[64] ;
+    snprintf(name, sizeof(name), "write to consume (%s, %zu lines)", useInotify ? "inotify" : "poll 5ms", latency.count) ;
+    bench_latency_report(name, &latency) ;
+    bench_latency_free(&latency) ;
+    tail_file_close(&test.file) ;
+    tail_ring_free(&test.ring) ;
+    pthread_mutex_destroy(&test.mutex) ;
+    unlink(path) ;
+}
+
+int main(void) {
+    printf("cgsdebug tail\n") ;
+    bench_framing(80, 64 * 1024) ;
+    bench_framing(200, 64 * 1024) ;
+    bench_framing(80, 4 * 1024) ;
+
+    char directory[] = "/tmp/hsasm_tail_bench_XXXXXX" ;
+    if (!mkdtemp(directory)) return 1 ;
+    char path[64] ;
+    snprintf(path, sizeof(path), "%s/CGLog_bench", directory) ;
+    bench_writeToConsume(path, true) ;
+    bench_writeToConsume(path, false) ;
+    rmdir(directory) ;
+    return 0 ;
+}
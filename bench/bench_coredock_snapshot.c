@@ -0,0 +1,57 @@
+//
+// bench_coredock_snapshot.c
+// Getter cost with and without the coredock snapshot, against the mock Dock with and without simulated IPC
+// latency. The uncached numbers are what every getter paid before the snapshot; the apply numbers include
+// the fresh read of the requested fields which keeps the diff honest when the snapshot is stale.
+
+#include "bench.h"
+#include "coredock/coredock_settings.h"
+
+static void bench_getters(const char *label, uint64_t iterations) {
+    char              name[64] ;
+    coredock_snapshot snapshot = { .valid = false } ;
+    float             sum      = 0 ;
+
+    uint64_t start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        CoreDockOrientation orientation ;
+        CoreDockPinning     pinning ;
+        coredock_mockBackend.getOrientationAndPinning(&orientation, &pinning) ;
+        sum += coredock_mockBackend.getTileSize() + (float)orientation ;
+    }
+    snprintf(name, sizeof(name), "uncached getters (%s)", label) ;
+    bench_report(name, iterations, bench_now() - start, 0) ;
+
+    start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        const coredock_settings *settings = coredock_snapshot_settings(&snapshot, &coredock_mockBackend) ;
+        sum += settings->tileSize + (float)settings->orientation ;
+        bench_use(settings) ;
+    }
+    snprintf(name, sizeof(name), "cached getters (%s)", label) ;
+    bench_report(name, iterations, bench_now() - start, 0) ;
+
+    coredock_settings requested = coredock_mockState, updated ;
+    start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        requested.tileSize = (i & 1) ? 0.25f : 0.5f ;
+        coredock_applyRequest(&coredock_mockBackend, &requested, kCoreDockFieldTileSize | kCoreDockFieldAutoHide, &updated) ;
+        coredock_snapshot_update(&snapshot, &updated, kCoreDockFieldTileSize | kCoreDockFieldAutoHide) ;
+    }
+    snprintf(name, sizeof(name), "apply, fresh read (%s)", label) ;
+    bench_report(name, iterations, bench_now() - start, 0) ;
+    bench_use(&sum) ;
+}
+
+int main(void) {
+    uint64_t scale = bench_scale() ;
+    printf("coredock snapshot\n") ;
+
+    hsasm_mock_reset(&coredock_mock) ;
+    bench_getters("no latency", 2000000 * scale) ;
+
+    hsasm_mock_reset(&coredock_mock) ;
+    coredock_mock.latency = 0.00005 ;
+    bench_getters("50us latency", 500 * scale) ;
+    return 0 ;
+}
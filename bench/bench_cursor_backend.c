@@ -0,0 +1,106 @@
+//
+// bench_cursor_backend.c
+// What a call through the cursor module's mock backends costs: the cursor state calls, a full capture of
+// the generated image into a pooled buffer, and the connection lookups the tracker makes, each with and
+// without injected failures. The state calls and lookups are wrapped in HSASM_SPI as internal.m and
+// connections.m wrap them, so these are the floor under the Lua bindings when a module is mocked, and the
+// overhead a test pays for running against the mock rather than the WindowServer. The other modules' mock
+// backends are in bench_backends.c.
+
+#include "bench.h"
+#include "hsasm_spi.h"
+#include "cursor/cursor_backend.h"
+#include "cursor/cursor_pixels.h"
+
+static const cursor_backend           *cgs     = &cursor_mockBackend ;
+static const cursor_captureBackend    *capture = &cursor_mockCaptureBackend ;
+static const cursor_connectionBackend *conns   = &cursor_mockConnectionBackend ;
+
+static void bench_state(const char *name, double failureRate) {
+    cursorMock.failureRate = failureRate ;
+    uint64_t      iterations = 2000000 * bench_scale() ;
+    bench_latency latency ;
+    bench_latency_init(&latency, (size_t)iterations) ;
+    uint64_t start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        uint64_t callStart = bench_now() ;
+        CGPoint  location ;
+        switch (i & 3) {
+            case 0: bench_use((void *)(intptr_t)HSASM_SPI_ERROR("CGSWarpCursorPosition", cgs->warpCursorPosition(1, (CGFloat)i, 0))) ; break ;
+            case 1: bench_use((void *)(intptr_t)HSASM_SPI_ERROR("CGSGetCurrentCursorLocation", cgs->getCurrentCursorLocation(1, &location))) ; break ;
+            case 2: bench_use((void *)(intptr_t)HSASM_SPI_ERROR("CGSHideCursor", cgs->hideCursor(1))) ; break ;
+            case 3: bench_use((void *)(intptr_t)HSASM_SPI("CGSCurrentCursorSeed", cgs->currentCursorSeed())) ; break ;
+        }
+        bench_latency_add(&latency, bench_now() - callStart) ;
+    }
+    bench_report(name, iterations, bench_now() - start, 0) ;
+    bench_latency_report(name, &latency) ;
+    bench_latency_free(&latency) ;
+    cursorMock.failureRate = 0.0 ;
+}
+
+// the steps of cursor_captureCurrent in capture.m, without the image object
+static void bench_capture(void) {
+    cursor_buildUnpremultiplyTable() ;
+    cursor_pool pool ;
+    cursor_pool_init(&pool, CURSOR_POOL_MAX_BUFFERS) ;
+    uint64_t      iterations = 100000 * bench_scale() ;
+    bench_latency latency ;
+    bench_latency_init(&latency, (size_t)iterations) ;
+    uint64_t start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        uint64_t callStart = bench_now() ;
+        size_t   size      = 0 ;
+        (void)capture->getGlobalCursorDataSize(1, &size) ;
+        cursor_buffer *buffer = cursor_pool_acquire(&pool, size) ;
+        if (!buffer) break ;
+        int     dataSize = (int)size, rowBytes = 0, depth = 0, components = 0, bitsPerComponent = 0 ;
+        CGRect  rect ;
+        CGPoint hotSpot ;
+        if (capture->getGlobalCursorData(1, buffer->bytes, &dataSize, &rowBytes, &rect, &hotSpot, &depth, &components, &bitsPerComponent) == kCGErrorSuccess) {
+            cursor_unpremultiplyImage(buffer->bytes, (size_t)rowBytes, (size_t)rowBytes / 4, size / (size_t)rowBytes) ;
+        }
+        bench_use(buffer->bytes) ;
+        cursor_pool_release(&pool, buffer) ;
+        bench_latency_add(&latency, bench_now() - callStart) ;
+    }
+    bench_report("capture current cursor", iterations, bench_now() - start, iterations * CURSOR_MOCK_DATA_SIZE) ;
+    bench_latency_report("capture current cursor", &latency) ;
+    bench_latency_free(&latency) ;
+    cursor_pool_drain(&pool) ;
+}
+
+// what start does for each running application, then the lookup pidForConnection falls back to, over a
+// few hundred processes
+static void bench_connections(const char *name, double failureRate) {
+    enum { processes = 400 } ;
+    cursorMock.failureRate = failureRate ;
+    uint64_t      iterations = 1000000 * bench_scale() ;
+    bench_latency latency ;
+    bench_latency_init(&latency, (size_t)iterations) ;
+    uint64_t start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        uint64_t        callStart = bench_now() ;
+        CGSConnectionID cid       = 0 ;
+        pid_t           pid       = 0 ;
+        if (HSASM_SPI_ERROR("CGSGetConnectionIDForPSN", conns->connectionForPID((pid_t)(1000 + i % processes), &cid)) == kCGErrorSuccess) {
+            (void)HSASM_SPI_ERROR("CGSConnectionGetPID", conns->connectionGetPID(cid, &pid)) ;
+        }
+        bench_use((void *)(intptr_t)pid) ;
+        bench_latency_add(&latency, bench_now() - callStart) ;
+    }
+    bench_report(name, iterations, bench_now() - start, 0) ;
+    bench_latency_report(name, &latency) ;
+    bench_latency_free(&latency) ;
+    cursorMock.failureRate = 0.0 ;
+}
+
+int main(void) {
+    printf("cursor backend\n") ;
+    bench_state("cursor state calls", 0.0) ;
+    bench_state("cursor state calls, failureRate 0.1", 0.1) ;
+    bench_capture() ;
+    bench_connections("connection lookup", 0.0) ;
+    bench_connections("connection lookup, failureRate 0.1", 0.1) ;
+    return 0 ;
+}
@@ -0,0 +1,52 @@
+//
+// bench_cursor_cache.c
+// Lookups in the seed-keyed capture cache while the cursor is unchanged, and the churn of a cursor which
+// changes on every capture, each with a cache of a few images and one of thousands
+
+#include "bench.h"
+#include "cursor/cursor_cache.h"
+
+static void bench_hits(size_t entries) {
+    char         name[64] ;
+    uint64_t     iterations = 10000000 * bench_scale() ;
+    cursor_cache cache ;
+    cursor_cache_init(&cache, entries * 4096, NULL, NULL) ;
+    for (size_t i = 0 ; i < entries ; i++) cursor_cache_store(&cache, (int)i, "current", (void *)(i + 1), 4096) ;
+
+    uint64_t start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        bench_use(cursor_cache_lookup(&cache, (int)(i % entries), "current")) ;
+    }
+    uint64_t elapsed = bench_now() - start ;
+    snprintf(name, sizeof(name), "hit, %zu entries", entries) ;
+    bench_report(name, iterations, elapsed, 0) ;
+    cursor_cache_free(&cache) ;
+}
+
+// every capture misses, is stored and evicts the oldest image
+static void bench_churn(size_t entries) {
+    char         name[64] ;
+    uint64_t     iterations = 2000000 * bench_scale() ;
+    cursor_cache cache ;
+    cursor_cache_init(&cache, entries * 4096, NULL, NULL) ;
+
+    uint64_t start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        if (!cursor_cache_lookup(&cache, (int)i, "current")) {
+            cursor_cache_store(&cache, (int)i, "current", (void *)(uintptr_t)(i + 1), 4096) ;
+        }
+    }
+    uint64_t elapsed = bench_now() - start ;
+    snprintf(name, sizeof(name), "miss, store and evict, %zu entries", entries) ;
+    bench_report(name, iterations, elapsed, 0) ;
+    cursor_cache_free(&cache) ;
+}
+
+int main(void) {
+    printf("cursor cache\n") ;
+    bench_hits(16) ;
+    bench_hits(10000) ;
+    bench_churn(16) ;
+    bench_churn(10000) ;
+    return 0 ;
+}
@@ -0,0 +1,89 @@
+//
+// bench_cursor_connections.c
+// Applying millions of connection events to the tracker's tables and looking connections up in them, with a
+// few hundred and with tens of thousands of live connections
+
+#include "bench.h"
+#include "cursor/cursor_connections.h"
+
+static uint32_t bench_random(uint64_t *state) {
+    *state ^= *state << 13 ;
+    *state ^= *state >> 7 ;
+    *state ^= *state << 17 ;
+    return (uint32_t)(*state >> 32) ;
+}
+
+// each event kills a random live connection and creates a new one for a random process, so the number of
+// live connections stays the same while the tables churn
+static void bench_events(size_t live, size_t pids) {
+    char         name[64] ;
+    uint64_t     events  = 5000000 * bench_scale() ;
+    uint64_t     state   = 0x9E3779B97F4A7C15ULL ;
+    int32_t      *alive  = malloc(live * sizeof(int32_t)) ;
+    int32_t      nextCID = 1 ;
+    conn_tracker tracker = { 0 } ;
+    conn_tracker_init(&tracker) ;
+    for (size_t i = 0 ; i < live ; i++) {
+        alive[i] = nextCID++ ;
+        conn_tracker_created(&tracker, alive[i], (int32_t)(1 + bench_random(&state) % pids)) ;
+    }
+
+    uint64_t start = bench_now() ;
+    for (uint64_t i = 0 ; i < events ; i += 2) {
+        size_t victim = bench_random(&state) % live ;
+        conn_tracker_died(&tracker, alive[victim]) ;
+        alive[victim] = nextCID++ ;
+        conn_tracker_created(&tracker, alive[victim], (int32_t)(1 + bench_random(&state) % pids)) ;
+    }
+    uint64_t elapsed = bench_now() - start ;
+    snprintf(name, sizeof(name), "created/died, %zu live", live) ;
+    bench_report(name, events, elapsed, 0) ;
+
+    uint64_t lookups = 10000000 * bench_scale() ;
+    start = bench_now() ;
+    for (uint64_t i = 0 ; i < lookups ; i++) {
+        bench_use((void *)(intptr_t)conn_tracker_pidForConnection(&tracker, alive[bench_random(&state) % live])) ;
+    }
+    elapsed = bench_now() - start ;
+    snprintf(name, sizeof(name), "pidForConnection, %zu live", live) ;
+    bench_report(name, lookups, elapsed, 0) ;
+
+    int32_t cids[256] ;
+    start = bench_now() ;
+    for (uint64_t i = 0 ; i < lookups ; i++) {
+        bench_use((void *)conn_tracker_connectionsForPID(&tracker, (int32_t)(1 + bench_random(&state) % pids), cids, 256)) ;
+    }
+    elapsed = bench_now() - start ;
+    snprintf(name, sizeof(name), "connectionsForPID, %zu live / %zu pids", live, pids) ;
+    bench_report(name, lookups, elapsed, 0) ;
+
+    conn_tracker_free(&tracker) ;
+    free(alive) ;
+}
+
+// launching and terminating applications with a handful of connections each
+static void bench_terminations(void) {
+    uint64_t     launches = 1000000 * bench_scale() ;
+    int32_t      nextCID  = 1 ;
+    int32_t      removed[64] ;
+    conn_tracker tracker  = { 0 } ;
+    conn_tracker_init(&tracker) ;
+
+    uint64_t start = bench_now() ;
+    for (uint64_t i = 0 ; i < launches ; i++) {
+        int32_t pid = (int32_t)(1 + i % 512) ;
+        if (i >= 512) while (conn_tracker_terminated(&tracker, pid, removed, 64) > 0) ;
+        for (int c = 0 ; c < 4 ; c++) conn_tracker_created(&tracker, nextCID++, pid) ;
+    }
+    uint64_t elapsed = bench_now() - start ;
+    bench_report("launch and terminate, 4 connections each", launches, elapsed, 0) ;
+    conn_tracker_free(&tracker) ;
+}
+
+int main(void) {
+    printf("cursor connections\n") ;
+    bench_events(300, 60) ;
+    bench_events(50000, 2000) ;
+    bench_terminations() ;
+    return 0 ;
+}
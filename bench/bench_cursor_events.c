@@ -0,0 +1,104 @@
+//
+// bench_cursor_events.c
+// The change watcher's queue: checking and draining on one thread, as the notifications do, and a producer
+// thread feeding a consumer on another, as the polling fallback does -- flat out, where the drops show what
+// a full queue costs, and paced, where the time from a check to its drain is the latency a callback sees
+
+#include "bench.h"
+#include "cursor/cursor_events.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+static cursor_event batch[CURSOR_EVENT_QUEUE_SIZE] ;
+
+// bursts of changes, each drained as one batch
+static void bench_sameThread(size_t burst) {
+    static cursor_watcher watcher ;
+    char     name[64] ;
+    uint64_t bursts = 20000000 * bench_scale() / burst ;
+    int      seed   = 0 ;
+    size_t   total  = 0 ;
+    cursor_watcher_start(&watcher, seed) ;
+
+    uint64_t start = bench_now() ;
+    for (uint64_t b = 0 ; b < bursts ; b++) {
+        for (size_t i = 0 ; i < burst ; i++) (void)cursor_watcher_check(&watcher, ++seed, 0, 0.0) ;
+        total += cursor_watcher_drain(&watcher, batch, CURSOR_EVENT_QUEUE_SIZE) ;
+    }
+    uint64_t elapsed = bench_now() - start ;
+    bench_use(&total) ;
+    snprintf(name, sizeof(name), "check and drain, one thread, bursts of %zu", burst) ;
+    bench_report(name, bursts * burst, elapsed, 0) ;
+}
+
+typedef struct {
+    cursor_watcher *watcher ;
+    uint64_t       changes ;
+    uint64_t       spacing ; // ns between changes, 0 for flat out
+    _Atomic bool   scheduled ;
+    _Atomic bool   done ;
+} bench_producer ;
+
+static void *bench_produce(void *context) {
+    bench_producer *producer = context ;
+    uint64_t       next      = bench_now() ;
+    for (uint64_t seed = 1 ; seed <= producer->changes ; seed++) {
+        if (producer->spacing) {
+            next += producer->spacing ;
+            while (bench_now() < next) sched_yield() ;
+        }
+        if (cursor_watcher_check(producer->watcher, (int)seed, 0, (double)bench_now())) atomic_store(&producer->scheduled, true) ;
+    }
+    atomic_store(&producer->done, true) ;
+    return NULL ;
+}
+
+static void bench_crossThread(uint64_t changes, uint64_t spacing) {
+    static cursor_watcher watcher ;
+    char           name[96] ;
+    bench_latency  latency ;
+    bench_producer producer = { .watcher = &watcher, .changes = changes, .spacing = spacing } ;
+    cursor_watcher_start(&watcher, 0) ;
+    cursor_watcher_resetCounters(&watcher) ;
+    bench_latency_init(&latency, (size_t)changes) ;
+
+    pthread_t thread ;
+    uint64_t  start = bench_now() ;
+    pthread_create(&thread, NULL, bench_produce, &producer) ;
+    for (bool finished = false ; !finished ; ) {
+        finished = atomic_load(&producer.done) ;
+        if (!finished && !atomic_exchange(&producer.scheduled, false)) {
+            sched_yield() ;
+            continue ;
+        }
+        size_t count ;
+        while ((count = cursor_watcher_drain(&watcher, batch, CURSOR_EVENT_QUEUE_SIZE)) > 0) {
+            uint64_t now = bench_now() ;
+            for (size_t i = 0 ; i < count ; i++) bench_latency_add(&latency, now - (uint64_t)batch[i].timestamp) ;
+        }
+    }
+    pthread_join(thread, NULL) ;
+    uint64_t elapsed = bench_now() - start ;
+
+    uint64_t delivered = atomic_load(&watcher.delivered), dropped = atomic_load(&watcher.dropped) ;
+    uint64_t batches   = atomic_load(&watcher.batches) ;
+    if (spacing) snprintf(name, sizeof(name), "two threads, a change every %" PRIu64 " ns", spacing) ;
+    else         snprintf(name, sizeof(name), "two threads, flat out") ;
+    bench_report(name, changes, elapsed, 0) ;
+    printf("    %" PRIu64 " delivered in %" PRIu64 " batches (%.1f per batch), %" PRIu64 " dropped (%.2f%%)\n",
+           delivered, batches, batches ? (double)delivered / (double)batches : 0.0, dropped, 100.0 * (double)dropped / (double)changes) ;
+    bench_latency_report("    check to drain", &latency) ;
+    bench_latency_free(&latency) ;
+}
+
+int main(void) {
+    printf("cursor events\n") ;
+    bench_sameThread(1) ;
+    bench_sameThread(16) ;
+    bench_sameThread(CURSOR_EVENT_QUEUE_SIZE) ;
+    bench_crossThread(5000000 * bench_scale(), 0) ;
+    bench_crossThread(200000 * bench_scale(), 1000) ;
+    bench_crossThread(20000 * bench_scale(), 50000) ;
+    return 0 ;
+}
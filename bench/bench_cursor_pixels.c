@@ -0,0 +1,96 @@
+//
+// bench_cursor_pixels.c
+// Converting captured cursor images from premultiplied ARGB to straight RGBA with the vector path against the
+// scalar one, and taking capture buffers from the pool against allocating a new one for each capture
+
+#include "bench.h"
+#include "cursor/cursor_pixels.h"
+
+// an arrow-like cursor: an opaque body with a one pixel antialiased edge on a transparent background
+static void fill_cursor(uint8_t *pixels, size_t side) {
+    for (size_t y = 0 ; y < side ; y++) {
+        for (size_t x = 0 ; x < side ; x++) {
+            uint8_t *pixel = pixels + (y * side + x) * 4 ;
+            uint8_t alpha  = (x < y / 2) ? 255 : (x == y / 2) ? 128 : 0 ;
+            pixel[0] = alpha ;
+            pixel[1] = pixel[2] = pixel[3] = (uint8_t)(alpha / 2) ;
+        }
+    }
+}
+
+static void bench_convert(size_t side) {
+    char     name[64] ;
+    size_t   pixels     = side * side ;
+    uint64_t iterations = (uint64_t)(20000000 / pixels) * bench_scale() ;
+    uint8_t  *src = malloc(pixels * 4), *dst = malloc(pixels * 4) ;
+    fill_cursor(src, side) ;
+
+    uint64_t start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        cursor_convertScalar(src, dst, pixels) ;
+        bench_use(dst) ;
+    }
+    uint64_t elapsed = bench_now() - start ;
+    snprintf(name, sizeof(name), "%zux%zu cursor, scalar", side, side) ;
+    bench_report(name, iterations, elapsed, iterations * pixels * 4) ;
+
+    start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        cursor_unpremultiply(src, dst, pixels) ;
+        bench_use(dst) ;
+    }
+    elapsed = bench_now() - start ;
+#if defined(__SSSE3__)
+    snprintf(name, sizeof(name), "%zux%zu cursor, ssse3", side, side) ;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    snprintf(name, sizeof(name), "%zux%zu cursor, neon", side, side) ;
+#else
+    snprintf(name, sizeof(name), "%zux%zu cursor, no vector path", side, side) ;
+#endif
+    bench_report(name, iterations, elapsed, iterations * pixels * 4) ;
+    free(src) ;
+    free(dst) ;
+}
+
+// each capture writes into its buffer, as the WindowServer does, so the cost of faulting in new pages counts
+static void bench_buffers(size_t length) {
+    char     name[64] ;
+    uint64_t iterations = 200000 * bench_scale() ;
+
+    uint64_t start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        uint8_t *bytes = malloc(length) ;
+        memset(bytes, (int)i, length) ;
+        bench_use(bytes) ;
+        free(bytes) ;
+    }
+    uint64_t elapsed = bench_now() - start ;
+    snprintf(name, sizeof(name), "%zuk capture, malloc each time", length / 1024) ;
+    bench_report(name, iterations, elapsed, 0) ;
+
+    cursor_pool pool ;
+    cursor_pool_init(&pool, CURSOR_POOL_MAX_BUFFERS) ;
+    start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        cursor_buffer *buffer = cursor_pool_acquire(&pool, length) ;
+        if (!buffer) abort() ;
+        memset(buffer->bytes, (int)i, length) ;
+        bench_use(buffer) ;
+        cursor_pool_release(&pool, buffer) ;
+    }
+    elapsed = bench_now() - start ;
+    snprintf(name, sizeof(name), "%zuk capture, pooled", length / 1024) ;
+    bench_report(name, iterations, elapsed, 0) ;
+    cursor_pool_drain(&pool) ;
+}
+
+int main(void) {
+    printf("cursor pixels\n") ;
+    cursor_buildUnpremultiplyTable() ;
+    bench_convert(32) ;
+    bench_convert(64) ;
+    bench_convert(256) ;
+    bench_buffers(16 * 1024) ;
+    bench_buffers(256 * 1024) ;
+    return 0 ;
+}
@@ -0,0 +1,124 @@
+//
+// bench_cursor_sets.c
+// Switching between animated cursors: to a set registered once, as setCursorSet does, against rebuilding
+// and registering the set on every switch, and what registerCursorSet costs when the set is unchanged and
+// the digest lets it skip the registration.
+//
+// The backend is the mock's with a stub in front of its registration which copies every frame, standing in
+// for the pixels being sent to the WindowServer; the frames are rebuilt with cursor_mockImage, standing in
+// for turning hs.image objects into bitmaps. Building the frames dominates both the rebuild and the skipped
+// registration here, and the stub's registration is only a copy, so the skip saves little in this bench;
+// natively what it saves is the WindowServer round trip with the whole set, which the stub doesn't model.
+
+#include "bench.h"
+#include "cursor/cursor_backend.h"
+#include "cursor/cursor_sets.h"
+
+enum { kFrames = 8, kSets = 2 } ;
+
+static const cursor_backend *cgs = &cursor_mockBackend ;
+static uint8_t              frames[kSets][kFrames][CURSOR_MOCK_DATA_SIZE] ;
+static uint8_t              server[kSets][kFrames][CURSOR_MOCK_DATA_SIZE] ;
+static const char           *names[kSets] = { "bench.spinner", "bench.busy" } ;
+
+static void bench_buildSet(int set) {
+    for (int f = 0 ; f < kFrames ; f++) cursor_mockImage(100 * (uint32_t)set + (uint32_t)f, frames[set][f]) ;
+}
+
+static cursor_setOptions bench_options(void) {
+    return (cursor_setOptions){
+        .global        = true,
+        .frameDuration = 0.1,
+        .hotSpot       = { 4, 4 },
+        .size          = { CURSOR_MOCK_PIXELS / 2, CURSOR_MOCK_PIXELS / 2 },
+        .frameCount    = kFrames,
+    } ;
+}
+
+static uint64_t bench_digest(int set) {
+    cursor_setOptions options = bench_options() ;
+    uint64_t          digest  = cursor_setDigest_begin(&options) ;
+    for (int f = 0 ; f < kFrames ; f++) {
+        digest = cursor_setDigest_addFrame(digest, frames[set][f], CURSOR_MOCK_PIXELS, CURSOR_MOCK_PIXELS, CURSOR_MOCK_ROW_BYTES, 4) ;
+    }
+    return cursor_setDigest_end(digest) ;
+}
+
+// the stub registration: the frames are copied to the "WindowServer" before the mock records the set
+static int bench_register(int set) {
+    cursor_setOptions options = bench_options() ;
+    int               seed    = 0 ;
+    memcpy(server[set], frames[set], sizeof(frames[set])) ;
+    (void)cgs->registerCursorWithImages(1, names[set], options.global, true, kFrames, (CFArrayRef)server[set], options.size,
+                                        options.hotSpot, &seed, (CGRect){ { 0, 0 }, options.size }, options.frameDuration,
+                                        options.repeatCount) ;
+    return seed ;
+}
+
+static void bench_run(const char *name, uint64_t switches, int (*step)(int set)) {
+    bench_latency latency ;
+    bench_latency_init(&latency, (size_t)switches) ;
+    uint64_t start = bench_now() ;
+    for (uint64_t i = 0 ; i < switches ; i++) {
+        uint64_t callStart = bench_now() ;
+        int      seed      = step((int)(i % kSets)) ;
+        bench_use((void *)(intptr_t)seed) ;
+        bench_latency_add(&latency, bench_now() - callStart) ;
+    }
+    bench_report(name, switches, bench_now() - start, 0) ;
+    bench_latency_report(name, &latency) ;
+    bench_latency_free(&latency) ;
+}
+
+// setCursorSet: one call
+static int bench_switchRegistered(int set) {
+    int seed = 0 ;
+    (void)cgs->setRegisteredCursor(1, names[set], &seed) ;
+    return seed ;
+}
+
+// what setCursorSet would have to do without registered sets
+static int bench_rebuildAndRegister(int set) {
+    bench_buildSet(set) ;
+    return bench_register(set) ;
+}
+
+// registerCursorSet called again with the same frames: they are still turned into bitmaps and hashed, and
+// the WindowServer is asked whether it still has the set, but nothing is registered
+static uint64_t registeredDigests[kSets] ;
+
+static int bench_reregisterUnchanged(int set) {
+    bench_buildSet(set) ;
+    size_t size = 0 ;
+    if (bench_digest(set) == registeredDigests[set] &&
+        cgs->getRegisteredCursorDataSize(1, names[set], &size) == kCGErrorSuccess && size > 0) return 0 ;
+    registeredDigests[set] = bench_digest(set) ;
+    return bench_register(set) ;
+}
+
+// the parts of the two, on their own
+static int bench_build(int set) {
+    bench_buildSet(set) ;
+    return 0 ;
+}
+
+static int bench_hash(int set) {
+    return (int)bench_digest(set) ;
+}
+
+int main(void) {
+    printf("cursor sets\n") ;
+    for (int set = 0 ; set < kSets ; set++) {
+        bench_buildSet(set) ;
+        registeredDigests[set] = bench_digest(set) ;
+        (void)bench_register(set) ;
+    }
+    bench_run("switch to a registered set", 2000000 * bench_scale(), bench_switchRegistered) ;
+    bench_run("rebuild and register on every switch", 20000 * bench_scale(), bench_rebuildAndRegister) ;
+    bench_run("register an unchanged set again (skipped)", 20000 * bench_scale(), bench_reregisterUnchanged) ;
+    bench_run("  build the frames", 20000 * bench_scale(), bench_build) ;
+    bench_run("  hash the frames and options", 200000 * bench_scale(), bench_hash) ;
+    bench_run("  register (stub)", 200000 * bench_scale(), bench_register) ;
+    printf("    %d frames of %dx%d, %zu bytes a set\n", kFrames, CURSOR_MOCK_PIXELS, CURSOR_MOCK_PIXELS, sizeof(frames[0])) ;
+    return 0 ;
+}
@@ -0,0 +1,136 @@
+//
+// bench_hsasm_checkargs.c
+// What an argument check costs with HSASM_CHECKARGS' fast path and with a walk of the same masks through
+// varargs, as LuaSkin's checkArgs does, for the signatures of the hot cursor and coredock getters and
+// setters. The Lua stack is the stand-in in test/stubs/lua.h, with its accessors out of line like calls into
+// the Lua library.
+//
+// The plain varargs walk leaves out everything LuaSkin does around it, so the difference from it is the
+// least a call saves. The modelled checkArgs adds stand-ins for what a valid call to LuaSkin pays on top of
+// the walk: sharedWithState: loading the singleton and checking the thread and the lua_State, and each of
+// the two message sends as a lookup in a small method cache followed by an indirect call, which is the
+// shape of objc_msgSend's fast path. It is a model, not LuaSkin: the real message sends, LuaSkin's own
+// checks and the real Lua library's lua_type can only be timed on macOS, so the saving against the model is
+// an estimate, and the saving against the plain walk is the figure that holds everywhere.
+
+#include "bench.h"
+#include "stubs/lua.h"
+#include "hsasm_checkargs.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+// a class's method cache: selectors hashed into a power of 2 sized table of selector/implementation pairs
+typedef struct {
+    const char *selector ;
+    void       *implementation ;
+} bench_cacheEntry ;
+
+typedef struct {
+    bench_cacheEntry cache[16] ;
+} bench_class ;
+
+typedef struct {
+    bench_class *isa ;
+    lua_State   *L ;
+    pthread_t   thread ;
+} bench_skin ;
+
+static const char          *kSharedWithState = "sharedWithState:" ;
+static const char          *kCheckArgs       = "checkArgs:" ;
+static bench_class         skinClass ;
+static bench_skin          skinInstance ;
+static _Atomic(bench_skin *) sharedSkin ;
+
+__attribute__((noinline)) static void *bench_lookup(const bench_class *class, const char *selector) {
+    size_t mask = sizeof(class->cache) / sizeof(class->cache[0]) - 1 ;
+    for (size_t i = ((uintptr_t)selector >> 3) & mask ; ; i = (i + 1) & mask) {
+        if (class->cache[i].selector == selector) return class->cache[i].implementation ;
+    }
+}
+
+static void bench_cache(bench_class *class, const char *selector, void *implementation) {
+    size_t mask = sizeof(class->cache) / sizeof(class->cache[0]) - 1 ;
+    size_t i    = ((uintptr_t)selector >> 3) & mask ;
+    while (class->cache[i].selector) i = (i + 1) & mask ;
+    class->cache[i] = (bench_cacheEntry){ selector, implementation } ;
+}
+
+// [LuaSkin sharedWithState:L]: the singleton, which must be used on its own thread, taking the state it is
+// called with
+__attribute__((noinline)) static bench_skin *bench_sharedWithState(lua_State *L) {
+    bench_skin *skin = atomic_load_explicit(&sharedSkin, memory_order_acquire) ;
+    if (!skin || !pthread_equal(skin->thread, pthread_self())) abort() ;
+    if (skin->L != L) skin->L = L ;
+    return skin ;
+}
+
+__attribute__((noinline)) static bool bench_checkArgs(bench_skin *skin, ...) {
+    va_list masks ;
+    va_start(masks, skin) ;
+    bool ok = lua_stub_checkArgsList(skin->L, masks) ;
+    va_end(masks) ;
+    return ok ;
+}
+
+// the two message sends of [[LuaSkin sharedWithState:L] checkArgs:...]
+#define SKIN_CHECK(L, ...) do {                                                                        \
+    bench_skin *(*shared)(lua_State *) = bench_lookup(&skinClass, kSharedWithState) ;                  \
+    bench_skin *skin                   = shared((L)) ;                                                 \
+    bool (*check)(bench_skin *, ...)   = bench_lookup(skin->isa, kCheckArgs) ;                         \
+    bench_use((void *)(intptr_t)check(skin, __VA_ARGS__)) ;                                            \
+} while (0)
+
+#define FAST_CHECK(L, ...) do {                                                                        \
+    static const int signature[] = { __VA_ARGS__ } ;                                                    \
+    if (!hsasm_checkargs_match((L), signature, sizeof(signature) / sizeof(int))) {                     \
+        bench_use((void *)(intptr_t)lua_stub_checkArgs((L), __VA_ARGS__)) ;                             \
+    }                                                                                                  \
+} while (0)
+
+#define FULL_CHECK(L, ...) bench_use((void *)(intptr_t)lua_stub_checkArgs((L), __VA_ARGS__))
+
+// e.g. cursor.seed(), coredock.tileSize(size), cursor.scale([scale]) and cursor.warp(x, y)
+#define BENCH_SIGNATURES(CHECK) do {                                                                  \
+    CHECK(&none, LS_TBREAK) ;                                                                          \
+    CHECK(&number, LS_TNUMBER, LS_TBREAK) ;                                                            \
+    CHECK(&number, LS_TNUMBER | LS_TOPTIONAL, LS_TBREAK) ;                                             \
+    CHECK(&integers, LS_TNUMBER | LS_TINTEGER, LS_TNUMBER | LS_TINTEGER, LS_TBOOLEAN | LS_TOPTIONAL, LS_TBREAK) ; \
+} while (0)
+
+int main(void) {
+    printf("hsasm checkargs\n") ;
+    lua_State none     = { .top = 0 } ;
+    lua_State number   = { .top = 0 } ;
+    lua_State integers = { .top = 0 } ;
+    lua_stub_push(&number, LUA_TNUMBER, false) ;
+    lua_stub_push(&integers, LUA_TNUMBER, true) ;
+    lua_stub_push(&integers, LUA_TNUMBER, true) ;
+
+    skinInstance = (bench_skin){ .isa = &skinClass, .L = &none, .thread = pthread_self() } ;
+    bench_cache(&skinClass, kSharedWithState, (void *)bench_sharedWithState) ;
+    bench_cache(&skinClass, kCheckArgs, (void *)bench_checkArgs) ;
+    atomic_store(&sharedSkin, &skinInstance) ;
+
+    uint64_t iterations = 20000000 * bench_scale() ;
+    uint64_t start      = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) BENCH_SIGNATURES(FULL_CHECK) ;
+    bench_report("varargs walk, 4 signatures", iterations * 4, bench_now() - start, 0) ;
+
+    start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) BENCH_SIGNATURES(SKIN_CHECK) ;
+    bench_report("modelled LuaSkin checkArgs, 4 signatures", iterations * 4, bench_now() - start, 0) ;
+
+    start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) BENCH_SIGNATURES(FAST_CHECK) ;
+    bench_report("HSASM_CHECKARGS fast path, 4 signatures", iterations * 4, bench_now() - start, 0) ;
+
+    // a wrong argument takes the fast check and then the full one
+    lua_State string = { .top = 0 } ;
+    lua_stub_push(&string, LUA_TSTRING, false) ;
+    iterations = 5000000 * bench_scale() ;
+    start      = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) FAST_CHECK(&string, LS_TNUMBER, LS_TBREAK) ;
+    bench_report("HSASM_CHECKARGS with a wrong argument", iterations, bench_now() - start, 0) ;
+    return 0 ;
+}
@@ -0,0 +1,186 @@
+//
+// bench_hsasm_constants.c
+// Lookups in a constants table the size of cgsdebug.options, by name and by value, and its rendering,
+// against what the Lua metatable it replaced did: a linear scan of every pair to find the name for a value,
+// and sorting the names again every time the table was converted to a string
+//
+// The old approach is the same work written in C, so what made the Lua version slow -- running the scan and
+// the sort in the interpreter -- isn't measured here; bench_hsasm_constants.lua times the old metatable under
+// a plain Lua interpreter. What this shows is how much the cached rendering saves over sorting and formatting
+// on every tostring, and where a scan of the value index stops beating a binary search over it: for 17
+// entries the scan is the faster of the two, which is why tables of up to HSASM_CONSTANTS_LINEAR entries
+// scan. Name lookups always search, since each step is a strcmp and a scan makes more of them.
+
+#include "bench.h"
+#include "hsasm_constants.h"
+
+// cgsdebug.options, with the values from cgsdebug.h
+static const hsasm_constant optionNames[] = {
+    { "flashScreenUpdates",       0x4 },
+    { "colorByAcceleration",      0x20 },
+    { "noShadows",                0x4000 },
+    { "noDelayAfterFlash",        0x20000 },
+    { "autoFlushDrawing",         0x40000 },
+    { "showMouseTrackingAreas",   0x100000 },
+    { "flashIdenticalUpdates",    0x4000000 },
+    { "dumpWindowListToFile",     0x80000001 },
+    { "dumpConnectionListToFile", 0x80000002 },
+    { "verboseLogging",           0x80000006 },
+    { "verboseLoggingAllApps",    0x80000007 },
+    { "dumpHotKeyListToFile",     0x8000000E },
+    { "dumpSurfaceInfo",          0x80000010 },
+    { "dumpOpenGLInfoToFile",     0x80000013 },
+    { "dumpShadowListToFile",     0x80000014 },
+    { "dumpWindowListToPlist",    0x80000017 },
+    { "dumpResourceUsageToFiles", 0x80000020 },
+} ;
+enum { optionCount = sizeof(optionNames) / sizeof(optionNames[0]) } ;
+
+static hsasm_constants options = HSASM_CONSTANTS("options", optionNames) ;
+
+// the __index fallback: `for k,v in pairs(t) do if v == key then return k end end`
+static const char *linear_nameForValue(int64_t value) {
+    for (size_t i = 0 ; i < optionCount ; i++) {
+        if (optionNames[i].value == value) return optionNames[i].name ;
+    }
+    return NULL ;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp((*(const hsasm_constant * const *)a)->name, (*(const hsasm_constant * const *)b)->name) ;
+}
+
+// the __tostring: measure the names, sort them and format every line, on every call
+static size_t sorted_render(char *buffer, size_t size) {
+    const hsasm_constant *sorted[optionCount] ;
+    int                  width = 0 ;
+    for (size_t i = 0 ; i < optionCount ; i++) {
+        sorted[i] = &optionNames[i] ;
+        int length = (int)strlen(optionNames[i].name) ;
+        if (length > width) width = length ;
+    }
+    qsort(sorted, optionCount, sizeof(sorted[0]), compare_names) ;
+    size_t length = 0 ;
+    for (size_t i = 0 ; i < optionCount && length < size ; i++) {
+        length += (size_t)snprintf(buffer + length, size - length, "%-*s %lld\n", width, sorted[i]->name, (long long)sorted[i]->value) ;
+    }
+    return length ;
+}
+
+static void bench_lookups(void) {
+    uint64_t iterations = 20000000 * bench_scale() ;
+
+    uint64_t start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        bench_use((void *)(intptr_t)hsasm_constants_indexOfName(&options, optionNames[i % optionCount].name)) ;
+    }
+    bench_report("name to value", iterations, bench_now() - start, 0) ;
+
+    start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        bench_use((void *)(intptr_t)hsasm_constants_indexOfValue(&options, optionNames[i % optionCount].value)) ;
+    }
+    bench_report("value to name", iterations, bench_now() - start, 0) ;
+
+    start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        bench_use(linear_nameForValue(optionNames[i % optionCount].value)) ;
+    }
+    bench_report("value to name, linear scan (old __index)", iterations, bench_now() - start, 0) ;
+
+    // a value which isn't in the table, e.g. a mask with two options set, scans every pair
+    start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) bench_use((void *)(intptr_t)hsasm_constants_indexOfValue(&options, 0x24 + (int64_t)(i & 1))) ;
+    bench_report("missing value", iterations, bench_now() - start, 0) ;
+
+    start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) bench_use(linear_nameForValue(0x24 + (int64_t)(i & 1))) ;
+    bench_report("missing value, linear scan (old __index)", iterations, bench_now() - start, 0) ;
+}
+
+// the two ways of finding a value in the value index, whatever the table's size
+static int scan_indexOfValue(const hsasm_constants *constants, int64_t value) {
+    for (size_t i = 0 ; i < constants->count ; i++) {
+        if (constants->entries[constants->byValue[i]].value == value) return constants->byValue[i] ;
+    }
+    return -1 ;
+}
+
+static int search_indexOfValue(const hsasm_constants *constants, int64_t value) {
+    size_t low = 0, high = constants->count ;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2 ;
+        if (constants->entries[constants->byValue[mid]].value < value) {
+            low = mid + 1 ;
+        } else {
+            high = mid ;
+        }
+    }
+    return (low < constants->count && constants->entries[constants->byValue[low]].value == value) ? constants->byValue[low] : -1 ;
+}
+
+// tables of scattered values, looked up in an order the branch predictor can't learn
+static void bench_crossover(void) {
+    static const size_t sizes[] = { 4, 8, 12, 17, 20, 24, 32, 48, HSASM_CONSTANTS_MAX } ;
+    static char           names[HSASM_CONSTANTS_MAX][16] ;
+    static hsasm_constant entries[HSASM_CONSTANTS_MAX] ;
+    uint64_t              iterations = 10000000 * bench_scale() ;
+
+    printf("  value to name by table size, ns per lookup (tables up to %d entries scan)\n", HSASM_CONSTANTS_LINEAR) ;
+    for (size_t s = 0 ; s < sizeof(sizes) / sizeof(sizes[0]) ; s++) {
+        size_t count = sizes[s] ;
+        for (size_t i = 0 ; i < count ; i++) {
+            snprintf(names[i], sizeof(names[i]), "option%zu", i) ;
+            entries[i] = (hsasm_constant){ names[i], (int64_t)((i * 2654435761U) % 100000) } ;
+        }
+        hsasm_constants constants = { .name = "sized", .entries = entries, .count = count } ;
+        hsasm_constants_sort(&constants) ;
+
+        uint64_t start = bench_now() ;
+        for (uint64_t i = 0 ; i < iterations ; i++) bench_use((void *)(intptr_t)scan_indexOfValue(&constants, entries[(i * 13) % count].value)) ;
+        double scan = (double)(bench_now() - start) / (double)iterations ;
+        start = bench_now() ;
+        for (uint64_t i = 0 ; i < iterations ; i++) bench_use((void *)(intptr_t)search_indexOfValue(&constants, entries[(i * 13) % count].value)) ;
+        double search = (double)(bench_now() - start) / (double)iterations ;
+        printf("    %2zu entries: scan %5.1f, binary search %5.1f\n", count, scan, search) ;
+    }
+}
+
+static void bench_rendering(void) {
+    uint64_t iterations = 500000 * bench_scale() ;
+    char     buffer[1024] ;
+
+    uint64_t start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        bench_use((void *)sorted_render(buffer, sizeof(buffer))) ;
+        bench_use(buffer) ;
+    }
+    bench_report("tostring, sorted every call (old __tostring)", iterations, bench_now() - start, 0) ;
+
+    // the userdata keeps the first rendering, so later calls return it without rendering again
+    const char *cached = NULL ;
+    start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        if (!cached) {
+            hsasm_constants_render(&options, buffer, sizeof(buffer)) ;
+            cached = buffer ;
+        }
+        bench_use(cached) ;
+    }
+    bench_report("tostring, rendered once and cached", iterations, bench_now() - start, 0) ;
+
+    start = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        bench_use((void *)hsasm_constants_render(&options, buffer, sizeof(buffer))) ;
+        bench_use(buffer) ;
+    }
+    bench_report("tostring, first rendering", iterations, bench_now() - start, 0) ;
+}
+
+int main(void) {
+    printf("hsasm constants (%d entries)\n", optionCount) ;
+    bench_lookups() ;
+    bench_crossover() ;
+    bench_rendering() ;
+    return 0 ;
+}
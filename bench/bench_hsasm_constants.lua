@@ -0,0 +1,122 @@
+-- bench_hsasm_constants.lua
+-- The constants metatable the modules used before hsasm_constants.h, timed in the interpreter it ran in.
+--
+-- bench_hsasm_constants.c can only time the old lookups rewritten in C; this runs the old __index and
+-- __tostring themselves under a plain Lua interpreter (5.1 to 5.4), with hs.fnutils.sortByKeys replaced by
+-- the same sort written here. A reverse table built once is timed alongside as the cheapest fix which stays
+-- in Lua. When run inside Hammerspoon, where the cgsdebug module can be loaded, its native options table is
+-- timed too.
+--
+--     lua bench/bench_hsasm_constants.lua
+--     BENCH_SCALE=10 lua bench/bench_hsasm_constants.lua
+
+local scale = tonumber(os.getenv("BENCH_SCALE") or "") or 1
+
+-- cgsdebug.options, with the values from cgsdebug.h
+local optionValues = {
+    flashScreenUpdates       = 0x4,
+    colorByAcceleration      = 0x20,
+    noShadows                = 0x4000,
+    noDelayAfterFlash        = 0x20000,
+    autoFlushDrawing         = 0x40000,
+    showMouseTrackingAreas   = 0x100000,
+    flashIdenticalUpdates    = 0x4000000,
+    dumpWindowListToFile     = 0x80000001,
+    dumpConnectionListToFile = 0x80000002,
+    verboseLogging           = 0x80000006,
+    verboseLoggingAllApps    = 0x80000007,
+    dumpHotKeyListToFile     = 0x8000000E,
+    dumpSurfaceInfo          = 0x80000010,
+    dumpOpenGLInfoToFile     = 0x80000013,
+    dumpShadowListToFile     = 0x80000014,
+    dumpWindowListToPlist    = 0x80000017,
+    dumpResourceUsageToFiles = 0x80000020,
+}
+
+local names, values = {}, {}
+for k, v in pairs(optionValues) do
+    names[#names + 1]   = k
+    values[#values + 1] = v
+end
+table.sort(names)
+table.sort(values)
+
+-- hs.fnutils.sortByKeys
+local sortByKeys = function(t)
+    local keys = {}
+    for k in pairs(t) do keys[#keys + 1] = k end
+    table.sort(keys)
+    local i = 0
+    return function()
+        i = i + 1
+        if keys[i] then return keys[i], t[keys[i]] end
+    end
+end
+
+-- the metatable from cgsdebug/init.lua before the constants moved into hsasm_constants.h
+local _kMetaTable = {}
+_kMetaTable._k = {}
+_kMetaTable.__index = function(obj, key)
+        if _kMetaTable._k[obj] then
+            if _kMetaTable._k[obj][key] then
+                return _kMetaTable._k[obj][key]
+            else
+                for k,v in pairs(_kMetaTable._k[obj]) do
+                    if v == key then return k end
+                end
+            end
+        end
+        return nil
+    end
+_kMetaTable.__tostring = function(obj)
+        local result = ""
+        if _kMetaTable._k[obj] then
+            local width = 0
+            for k,v in pairs(_kMetaTable._k[obj]) do width = width < #k and #k or width end
+            for k,v in sortByKeys(_kMetaTable._k[obj]) do
+                result = result..string.format("%-"..tostring(width).."s %s\n", k, tostring(v))
+            end
+        else
+            result = "constants table missing"
+        end
+        return result
+    end
+
+local old = setmetatable({}, _kMetaTable)
+_kMetaTable._k[old] = optionValues
+
+local reverse = {}
+for k, v in pairs(optionValues) do reverse[v] = k end
+
+local report = function(name, ops, seconds)
+    print(string.format("  %-45s %12.0f ops/s %10.1f ns/op", name, ops / seconds, seconds * 1e9 / ops))
+end
+
+local time = function(name, iterations, keys, lookup)
+    local count, sink = #keys, nil
+    local start = os.clock()
+    for i = 1, iterations do sink = lookup(keys[(i % count) + 1]) end
+    report(name, iterations, os.clock() - start)
+    return sink
+end
+
+local lookups = 2000000 * scale
+local missing = { 0x24, 0x25 }
+
+print(string.format("hsasm constants in Lua (%d entries, %s)", #names, _VERSION))
+time("name to value, old __index",          lookups, names,   function(k) return old[k] end)
+time("value to name, old __index",          lookups, values,  function(k) return old[k] end)
+time("missing value, old __index",          lookups, missing, function(k) return old[k] end)
+time("value to name, reverse table",        lookups, values,  function(k) return reverse[k] end)
+time("tostring, old __tostring",            20000 * scale, { old }, tostring)
+
+local ok, cgsdebug = pcall(require, "hs._asm.undocumented.cgsdebug.internal")
+if ok and type(cgsdebug) == "table" and cgsdebug.options then
+    local native = cgsdebug.options
+    time("name to value, hsasm_constants",  lookups, names,   function(k) return native[k] end)
+    time("value to name, hsasm_constants",  lookups, values,  function(k) return native[k] end)
+    time("missing value, hsasm_constants",  lookups, missing, function(k) return native[k] end)
+    time("tostring, hsasm_constants",       20000 * scale, { native }, tostring)
+else
+    print("  (the cgsdebug module isn't available, so only the Lua side is timed)")
+end
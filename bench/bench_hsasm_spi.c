@@ -0,0 +1,119 @@
+//
+// bench_hsasm_spi.c
+// What wrapping a call in HSASM_SPI costs over calling it directly, from one thread and from eight
+// recording to the same site, and how long a snapshot of a busy site's histogram takes. The wrapped
+// figures include two clock reads, so the clock and hsasm_spi_record are also timed on their own, along
+// with the shared atomic counters a site falls back to, which is what every call used to record to.
+
+#include "bench.h"
+#include "hsasm_spi.h"
+
+#include <pthread.h>
+
+static volatile int32_t sink ;
+
+__attribute__((noinline)) static int32_t bench_call(int32_t value) {
+    sink = value ;
+    return value ;
+}
+
+static void bench_direct(void) {
+    uint64_t iterations = 20000000 * bench_scale() ;
+    uint64_t start      = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) bench_use((void *)(intptr_t)bench_call((int32_t)i)) ;
+    bench_report("direct call", iterations, bench_now() - start, 0) ;
+}
+
+static void bench_wrapped(void) {
+    uint64_t iterations = 20000000 * bench_scale() ;
+    uint64_t start      = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        bench_use((void *)(intptr_t)HSASM_SPI_ERROR("bench.wrapped", bench_call((int32_t)(i & 1)))) ;
+    }
+    bench_report("HSASM_SPI_ERROR wrapped call", iterations, bench_now() - start, 0) ;
+}
+
+static void bench_clock(void) {
+    uint64_t iterations = 20000000 * bench_scale() ;
+    uint64_t start      = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) bench_use((void *)(uintptr_t)hsasm_spi_now()) ;
+    bench_report("hsasm_spi_now", iterations, bench_now() - start, 0) ;
+}
+
+enum { threads = 8 } ;
+
+typedef struct {
+    uint64_t       iterations ;
+    hsasm_spi_site *site ;
+    bool           shared ;
+} bench_recordJob ;
+
+static void *bench_recordOnly(void *context) {
+    bench_recordJob *job = context ;
+    for (uint64_t i = 0 ; i < job->iterations ; i++) {
+        if (job->shared) hsasm_spi_recordToSharedShard(&job->site->shared, i & 1023) ;
+        else             hsasm_spi_record(job->site, i & 1023, 0) ;
+    }
+    return NULL ;
+}
+
+static void bench_recording(const char *name, int count, bool shared) {
+    static hsasm_spi_site site = HSASM_SPI_SITE("bench.record") ;
+    bench_recordJob job = { 20000000 * bench_scale() / (uint64_t)count, &site, shared } ;
+    pthread_t       thread[threads] ;
+    uint64_t        start = bench_now() ;
+    for (int i = 0 ; i < count ; i++) pthread_create(&thread[i], NULL, bench_recordOnly, &job) ;
+    for (int i = 0 ; i < count ; i++) pthread_join(thread[i], NULL) ;
+    bench_report(name, job.iterations * (uint64_t)count, bench_now() - start, 0) ;
+}
+
+static void *bench_record(void *context) {
+    uint64_t iterations = *(uint64_t *)context ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        bench_use((void *)(intptr_t)HSASM_SPI_ERROR("bench.shared", bench_call((int32_t)(i % 64 == 0)))) ;
+    }
+    return NULL ;
+}
+
+static void bench_threads(void) {
+    uint64_t  iterations = 5000000 * bench_scale() ;
+    pthread_t thread[threads] ;
+    uint64_t  start = bench_now() ;
+    for (int i = 0 ; i < threads ; i++) pthread_create(&thread[i], NULL, bench_record, &iterations) ;
+    for (int i = 0 ; i < threads ; i++) pthread_join(thread[i], NULL) ;
+    bench_report("HSASM_SPI_ERROR wrapped call, 8 threads, one site", iterations * threads, bench_now() - start, 0) ;
+}
+
+// collecting the shards and walking the buckets for the four quantiles, as a snapshot does per site
+static void bench_quantiles(void) {
+    static hsasm_spi_site site = HSASM_SPI_SITE("bench.quantiles") ;
+    uint64_t state = 0x9E3779B97F4A7C15ULL ;
+    for (int i = 0 ; i < 1000000 ; i++) {
+        state ^= state << 13 ; state ^= state >> 7 ; state ^= state << 17 ;
+        hsasm_spi_record(&site, (state >> 40) >> (state & 15), 0) ;
+    }
+
+    uint64_t iterations = 200000 * bench_scale() ;
+    uint64_t start      = bench_now() ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        uint64_t counts[HSASM_SPI_BUCKETS] = { 0 }, calls = 0, totalTicks = 0, minTicks = UINT64_MAX, maxTicks = 0 ;
+        hsasm_spi_collect(&site, counts, &calls, &totalTicks, &minTicks, &maxTicks) ;
+        bench_use((void *)(uintptr_t)(hsasm_spi_quantile(counts, calls, 0.5) + hsasm_spi_quantile(counts, calls, 0.9) +
+                                      hsasm_spi_quantile(counts, calls, 0.99) + hsasm_spi_quantile(counts, calls, 0.999))) ;
+    }
+    bench_report("collect and p50/p90/p99/p999", iterations, bench_now() - start, 0) ;
+}
+
+int main(void) {
+    printf("hsasm spi\n") ;
+    bench_direct() ;
+    bench_wrapped() ;
+    bench_threads() ;
+    bench_clock() ;
+    bench_recording("hsasm_spi_record, 1 thread", 1, false) ;
+    bench_recording("hsasm_spi_record, 8 threads, one site", threads, false) ;
+    bench_recording("shared atomic counters, 1 thread", 1, true) ;
+    bench_recording("shared atomic counters, 8 threads, one site", threads, true) ;
+    bench_quantiles() ;
+    return 0 ;
+}
@@ -0,0 +1,99 @@
+//
+// bench_startup.c
+// Loading the modules the way a config reload does, with one library per module (the per-directory
+// Makefiles) and with the single combined library (the Makefile at the top of the repository)
+//
+// The libraries are the stand-ins built from bench/startup/module.c, with about as many registered functions
+// as each real module, since the real ones need macOS and Hammerspoon. This measures what the two layouts
+// change: how many libraries the dynamic loader opens, and whether every module's functions are registered
+// up front or only when a module is first required. Each iteration opens the libraries, requires modules
+// and closes them again, so every load pays the loader's full cost, as the first load after launch does.
+
+#define _GNU_SOURCE
+#include "bench.h"
+#include "startup/startup.h"
+
+#include <dlfcn.h>
+
+#define STARTUP_LIBRARIES "build/startup"
+
+static const char *modules[] = {
+    "bluetooth_internal", "cgsdebug_internal", "cgsdebug_dumpFile", "cgsdebug_tailer",
+    "coredock_internal",  "cursor_internal",   "cursor_capture",    "cursor_connections",
+} ;
+enum { moduleCount = sizeof(modules) / sizeof(modules[0]) } ;
+
+static void *open_library(const char *name) {
+    char path[256] ;
+    snprintf(path, sizeof(path), STARTUP_LIBRARIES "/%s.so", name) ;
+    void *library = dlopen(path, RTLD_NOW | RTLD_LOCAL) ;
+    if (!library) {
+        fprintf(stderr, "%s\n", dlerror()) ;
+        exit(1) ;
+    }
+    return library ;
+}
+
+static startup_luaopen find_luaopen(void *library, const char *module) {
+    char symbol[128] ;
+    snprintf(symbol, sizeof(symbol), "%s_luaopen", module) ;
+    startup_luaopen luaopen = (startup_luaopen)dlsym(library, symbol) ;
+    if (!luaopen) {
+        fprintf(stderr, "%s\n", dlerror()) ;
+        exit(1) ;
+    }
+    return luaopen ;
+}
+
+// each library is opened and registers its functions as its module is required
+static uint64_t load_split(startup_registry *registry, size_t required) {
+    void     *libraries[moduleCount] ;
+    uint64_t start = bench_now() ;
+    for (size_t i = 0 ; i < required ; i++) {
+        libraries[i] = open_library(modules[i]) ;
+        find_luaopen(libraries[i], modules[i])(registry) ;
+    }
+    uint64_t elapsed = bench_now() - start ;
+    for (size_t i = 0 ; i < required ; i++) dlclose(libraries[i]) ;
+    return elapsed ;
+}
+
+// the combined library is opened once and fills the preload table; only required modules register anything
+static uint64_t load_combined(startup_registry *registry, size_t required) {
+    uint64_t start   = bench_now() ;
+    void     *library = open_library("combined") ;
+    find_luaopen(library, "combined")(registry) ;
+    for (size_t i = 0 ; i < required ; i++) startup_require(registry, modules[i]) ;
+    uint64_t elapsed = bench_now() - start ;
+    dlclose(library) ;
+    return elapsed ;
+}
+
+static void bench_layout(const char *layout, uint64_t (*load)(startup_registry *, size_t), size_t required) {
+    char             name[64] ;
+    uint64_t         iterations = 2000 * bench_scale() ;
+    startup_registry registry   = { .functionCount = 0 } ;
+    bench_latency    latency ;
+    bench_latency_init(&latency, iterations) ;
+    load(&registry, required) ; // warm the page cache
+    startup_reset(&registry) ;
+    size_t functions = 0 ;
+    for (uint64_t i = 0 ; i < iterations ; i++) {
+        bench_latency_add(&latency, load(&registry, required)) ;
+        functions = registry.functionCount ;
+        startup_reset(&registry) ;
+    }
+    snprintf(name, sizeof(name), "%s, %zu of %d modules (%zu functions)", layout, required, moduleCount, functions) ;
+    bench_latency_report(name, &latency) ;
+    bench_latency_free(&latency) ;
+}
+
+int main(void) {
+    printf("startup\n") ;
+    bench_layout("split", load_split, moduleCount) ;
+    bench_layout("combined", load_combined, moduleCount) ;
+    // a config which only uses one of the submodules, e.g. bluetooth
+    bench_layout("split", load_split, 1) ;
+    bench_layout("combined", load_combined, 1) ;
+    return 0 ;
+}
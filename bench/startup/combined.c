@@ -0,0 +1,20 @@
+//
+// combined.c
+// The stand-in for combined.m, for bench_startup.c: linked with every module.c object into one library, it
+// only adds each module's luaopen to the preload table, so nothing is registered until a module is required
+
+#include "startup.h"
+
+#define MODULE_LIST(X)                                                      \
+    X(bluetooth_internal)  X(cgsdebug_internal)  X(cgsdebug_dumpFile)       \
+    X(cgsdebug_tailer)     X(coredock_internal)  X(cursor_internal)         \
+    X(cursor_capture)      X(cursor_connections)
+
+#define DECLARE(module) extern int module ## _luaopen(startup_registry *registry) ;
+MODULE_LIST(DECLARE)
+
+int combined_luaopen(startup_registry *registry) {
+#define PRELOAD(module) startup_preload(registry, #module, module ## _luaopen) ;
+    MODULE_LIST(PRELOAD)
+    return (int)registry->preloadCount ;
+}
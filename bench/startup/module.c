@@ -0,0 +1,37 @@
+//
+// module.c
+// A stand-in for one of the submodule libraries, for bench_startup.c
+//
+// Built once per module with -DMODULE=<name> -DFUNCTIONS=<count>, into its own shared library for the split
+// layout and, with the others, into one library for the combined layout. Each has about as many functions in its
+// registration table as the real module does, so the loader has a similar number of symbols and
+// relocations to process; luaopen copies the table into the caller's registry, as luaL_newlib would.
+
+#include "startup.h"
+
+#define PASTE(a, b)  a ## b
+#define EXPAND(a, b) PASTE(a, b)
+#define NAME(suffix) EXPAND(MODULE, suffix)
+#define STRING(a)    #a
+#define QUOTE(a)     STRING(a)
+
+#define FUNCTION(i) static int NAME(_function ## i)(void *state) { return (int)(((uintptr_t)state >> 4) * (i + 1)) ; }
+FUNCTION(0)  FUNCTION(1)  FUNCTION(2)  FUNCTION(3)  FUNCTION(4)  FUNCTION(5)  FUNCTION(6)  FUNCTION(7)
+FUNCTION(8)  FUNCTION(9)  FUNCTION(10) FUNCTION(11) FUNCTION(12) FUNCTION(13) FUNCTION(14) FUNCTION(15)
+FUNCTION(16) FUNCTION(17) FUNCTION(18) FUNCTION(19) FUNCTION(20) FUNCTION(21) FUNCTION(22) FUNCTION(23)
+FUNCTION(24) FUNCTION(25) FUNCTION(26) FUNCTION(27) FUNCTION(28) FUNCTION(29) FUNCTION(30) FUNCTION(31)
+
+#define ENTRY(i) { QUOTE(MODULE) "." STRING(i), NAME(_function ## i) }
+static const startup_reg functions[] = {
+    ENTRY(0),  ENTRY(1),  ENTRY(2),  ENTRY(3),  ENTRY(4),  ENTRY(5),  ENTRY(6),  ENTRY(7),
+    ENTRY(8),  ENTRY(9),  ENTRY(10), ENTRY(11), ENTRY(12), ENTRY(13), ENTRY(14), ENTRY(15),
+    ENTRY(16), ENTRY(17), ENTRY(18), ENTRY(19), ENTRY(20), ENTRY(21), ENTRY(22), ENTRY(23),
+    ENTRY(24), ENTRY(25), ENTRY(26), ENTRY(27), ENTRY(28), ENTRY(29), ENTRY(30), ENTRY(31),
+} ;
+
+_Static_assert(FUNCTIONS <= sizeof(functions) / sizeof(functions[0]), "FUNCTIONS is larger than the table") ;
+
+int NAME(_luaopen)(startup_registry *registry) {
+    for (size_t i = 0 ; i < FUNCTIONS ; i++) startup_register(registry, &functions[i]) ;
+    return FUNCTIONS ;
+}
@@ -0,0 +1,56 @@
+//
+// startup.h
+// What the stand-in module libraries built for bench_startup.c share with it
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const char *name ;
+    int        (*func)(void *state) ;
+} startup_reg ;
+
+typedef struct startup_registry startup_registry ;
+typedef int (*startup_luaopen)(startup_registry *registry) ;
+
+typedef struct {
+    const char      *name ;
+    startup_luaopen luaopen ;
+} startup_preloadEntry ;
+
+// stands in for the tables a Lua state would hold: the registered functions, with their names copied as
+// Lua would intern them, and package.preload
+struct startup_registry {
+    startup_reg          functions[512] ;
+    size_t               functionCount ;
+    startup_preloadEntry preload[16] ;
+    size_t               preloadCount ;
+} ;
+
+static inline void startup_register(startup_registry *registry, const startup_reg *entry) {
+    if (registry->functionCount >= sizeof(registry->functions) / sizeof(registry->functions[0])) return ;
+    registry->functions[registry->functionCount++] = (startup_reg){ strdup(entry->name), entry->func } ;
+}
+
+static inline void startup_preload(startup_registry *registry, const char *name, startup_luaopen luaopen) {
+    if (registry->preloadCount >= sizeof(registry->preload) / sizeof(registry->preload[0])) return ;
+    registry->preload[registry->preloadCount++] = (startup_preloadEntry){ name, luaopen } ;
+}
+
+// what require does when the module is in package.preload
+static inline int startup_require(startup_registry *registry, const char *name) {
+    for (size_t i = 0 ; i < registry->preloadCount ; i++) {
+        if (strcmp(registry->preload[i].name, name) == 0) return registry->preload[i].luaopen(registry) ;
+    }
+    return -1 ;
+}
+
+static inline void startup_reset(startup_registry *registry) {
+    for (size_t i = 0 ; i < registry->functionCount ; i++) free((void *)registry->functions[i].name) ;
+    registry->functionCount = 0 ;
+    registry->preloadCount  = 0 ;
+}
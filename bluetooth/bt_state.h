@@ -0,0 +1,187 @@
+//
+// bt_state.h
+// Waiting for a bluetooth controller state change, independent of IOBluetooth
+//
+// IOBluetooth doesn't report a state change immediately after a set, so the matching getter is polled with
+// an increasing delay between queries until it reports the requested state or the change times out. The
+// getter, the clock and the sleep are reached through a bt_controller, so the same code runs against the
+// private functions in internal.m and against the fake controllers in test/test_bluetooth_poll.c and
+// test/test_bluetooth_queue.c, which simulate the settle delay on a virtual clock.
+//
+// bt_queue is the state machine behind the asynchronous requests: it decides when to set, when to poll
+// again and when the callbacks waiting on a change can be resolved. The caller owns the timer and the
+// callbacks and makes the set itself, possibly on another thread.
+//
+// The in-memory controller at the end stands in for the private functions after _mockBackend(true), and
+// is driven directly by bench/bench_backends.c.
+
+#pragma once
+
+#include "hsasm_mock.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#define BT_POLL_INITIAL_INTERVAL 0.05
+#define BT_POLL_MAX_INTERVAL     0.5
+#define BT_POLL_BACKOFF          1.5
+#define BT_SYNC_TIMEOUT          1.0
+#define BT_ASYNC_TIMEOUT         10.0
+
+typedef struct {
+    int    (*get)(void *context) ;                  // the current state, 0 or 1
+    double (*now)(void *context) ;                  // a monotonic clock, in seconds
+    void   (*sleep)(void *context, double seconds) ;
+    void   *context ;
+} bt_controller ;
+
+// the delay before the next query and the time at which the change is abandoned
+typedef struct {
+    double interval ;
+    double deadline ;
+} bt_poll ;
+
+static inline void bt_poll_start(bt_poll *poll, double now, double timeout) {
+    poll->interval = BT_POLL_INITIAL_INTERVAL ;
+    poll->deadline = now + timeout ;
+}
+
+// returns the delay to wait before the next query and backs off the one after it
+static inline double bt_poll_next(bt_poll *poll) {
+    double interval = poll->interval ;
+    poll->interval = fmin(poll->interval * BT_POLL_BACKOFF, BT_POLL_MAX_INTERVAL) ;
+    return interval ;
+}
+
+static inline bool bt_poll_expired(const bt_poll *poll, double now) {
+    return now >= poll->deadline ;
+}
+
+// blocks the calling thread until the controller reports target or timeout seconds have passed, and returns
+// the last state reported
+static inline int bt_state_wait(const bt_controller *controller, int target, double timeout) {
+    bt_poll poll ;
+    int     state ;
+
+    bt_poll_start(&poll, controller->now(controller->context), timeout) ;
+    do {
+        controller->sleep(controller->context, bt_poll_next(&poll)) ;
+        state = controller->get(controller->context) ;
+    } while (state != target && !bt_poll_expired(&poll, controller->now(controller->context))) ;
+    return state ;
+}
+
+// Only one set is ever outstanding. Requests which arrive while a change settles just replace the desired
+// state, so a burst like on/off/on results in at most one more set once the first has been observed. A set
+// is in flight until the getter reports the state it asked for; until then nothing is resolved or applied,
+// since the getter may still be reporting the state from before the set.
+typedef enum {
+    BT_QUEUE_COALESCED, // merged with the change already settling; the next poll is already scheduled
+    BT_QUEUE_APPLY,     // call the setter with inFlight, then poll after bt_poll_next(&queue->poll)
+    BT_QUEUE_WAIT,      // poll again after bt_poll_next(&queue->poll)
+    BT_QUEUE_SETTLED,   // resolve every waiting callback with observed; the requested state was reached
+    BT_QUEUE_TIMEDOUT,  // resolve every waiting callback with observed; the change was abandoned
+} bt_queue_action ;
+
+typedef struct {
+    int      desired ;   // the most recently requested state, or -1
+    int      inFlight ;  // the state of the last set, until the getter reports it; otherwise -1
+    int      observed ;  // the state the getter reported most recently
+    bool     busy ;      // a change is settling and a poll is scheduled
+    bt_poll  poll ;
+    uint64_t received ;
+    uint64_t coalesced ;
+    uint64_t applied ;
+} bt_queue ;
+
+#define BT_QUEUE_INIT { .desired = -1, .inFlight = -1, .observed = -1, .busy = false }
+
+// a request with a callback
+static inline bt_queue_action bt_queue_request(bt_queue *queue, const bt_controller *controller, int state) {
+    queue->received++ ;
+    queue->desired = state ;
+    if (queue->busy) {
+        queue->coalesced++ ;
+        return BT_QUEUE_COALESCED ;
+    }
+
+    queue->busy = true ;
+    bt_poll_start(&queue->poll, controller->now(controller->context), BT_ASYNC_TIMEOUT) ;
+    queue->observed = controller->get(controller->context) ;
+    if (queue->observed == state) {
+        // already there; the first poll resolves the callback rather than the request itself
+        queue->coalesced++ ;
+        return BT_QUEUE_WAIT ;
+    }
+    queue->inFlight = state ;
+    queue->applied++ ;
+    return BT_QUEUE_APPLY ;
+}
+
+// a request which is going to wait for the state itself; returns true if the caller should set the state
+// (after any set still queued elsewhere) and wait for it. If a change is settling, the set becomes the one in
+// flight so the pending callbacks are resolved with its result.
+static inline bool bt_queue_requestNow(bt_queue *queue, const bt_controller *controller, int state) {
+    queue->received++ ;
+    queue->desired = state ;
+    if (!queue->busy && controller->get(controller->context) == state) {
+        queue->coalesced++ ;
+        return false ;
+    }
+    if (queue->busy) {
+        queue->inFlight = state ;
+        bt_poll_start(&queue->poll, controller->now(controller->context), BT_ASYNC_TIMEOUT) ;
+    }
+    queue->applied++ ;
+    return true ;
+}
+
+// called when the scheduled poll fires
+static inline bt_queue_action bt_queue_poll(bt_queue *queue, const bt_controller *controller) {
+    queue->observed = controller->get(controller->context) ;
+    double now      = controller->now(controller->context) ;
+
+    if (queue->inFlight >= 0 && queue->observed == queue->inFlight) queue->inFlight = -1 ;
+    if (queue->inFlight < 0) {
+        if (queue->observed == queue->desired) {
+            queue->busy = false ;
+            return BT_QUEUE_SETTLED ;
+        }
+        if (!bt_poll_expired(&queue->poll, now)) {
+            // the set landed but the desired state changed while it settled
+            queue->inFlight = queue->desired ;
+            queue->applied++ ;
+            bt_poll_start(&queue->poll, now, BT_ASYNC_TIMEOUT) ;
+            return BT_QUEUE_APPLY ;
+        }
+    }
+    if (bt_poll_expired(&queue->poll, now)) {
+        queue->busy     = false ;
+        queue->inFlight = -1 ;
+        return BT_QUEUE_TIMEDOUT ;
+    }
+    return BT_QUEUE_WAIT ;
+}
+
+// an in-memory controller with the signatures of the private functions; see hsasm_mock.h. Sets land
+// immediately. Failed getters report 0 and failed setters do nothing.
+static hsasm_mock  bluetoothMock             = HSASM_MOCK(0) ;
+static _Atomic int bluetoothMockPower        = 1 ;
+static _Atomic int bluetoothMockDiscoverable = 0 ;
+
+static inline int bt_mockGetPower(void) {
+    return hsasm_mock_call(&bluetoothMock) ? 0 : atomic_load(&bluetoothMockPower) ;
+}
+
+static inline void bt_mockSetPower(int state) {
+    if (!hsasm_mock_call(&bluetoothMock)) atomic_store(&bluetoothMockPower, state) ;
+}
+
+static inline int bt_mockGetDiscoverable(void) {
+    return hsasm_mock_call(&bluetoothMock) ? 0 : atomic_load(&bluetoothMockDiscoverable) ;
+}
+
+static inline void bt_mockSetDiscoverable(int state) {
+    if (!hsasm_mock_call(&bluetoothMock)) atomic_store(&bluetoothMockDiscoverable, state) ;
+}
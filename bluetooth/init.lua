@@ -7,6 +7,13 @@
 ---I make no promises that these will work for you or work at all with any, past, current, or future versions of OS X.  I can confirm only that they didn't crash my machine during testing under 10.10. You have been warned.
 
 local USERDATA_TAG = "hs._asm.undocumented.bluetooth"
+
+-- when the combined library built by the Makefile at the top of this repository is installed, it provides the
+-- internal modules through package.preload
+if not package.preload["hs._asm.undocumented.bluetooth.internal"] and package.searchpath("hs._asm.undocumented.combined", package.cpath) then
+    require("hs._asm.undocumented.combined")
+end
+
 local module       = require(USERDATA_TAG..".internal")
 
 local basePath = package.searchpath(USERDATA_TAG, package.path)
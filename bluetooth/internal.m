@@ -1,9 +1,17 @@
 @import Cocoa ;
 @import LuaSkin ;
 @import IOBluetooth ;
+#import "hsasm_spi.h"
+#import "hsasm_executor.h"
+#import "hsasm_mock.h"
+#import "bt_state.h"
 
 static LSRefTable refTable = LUA_NOREF ;
 
+// the setters can block for a noticeable time while the controller changes state, so changes made with a
+// callback are issued on this lane instead of the main thread
+static hsasm_lane bluetoothLane = HSASM_LANE("hs._asm.undocumented.bluetooth", 8) ;
+
 // private methods
 extern int IOBluetoothPreferencesAvailable(void) __attribute__((weak_import));
 
@@ -13,6 +21,9 @@ extern void IOBluetoothPreferenceSetControllerPowerState(int state) __attribute_
 extern int IOBluetoothPreferenceGetDiscoverableState(void) __attribute__((weak_import));
 extern void IOBluetoothPreferenceSetDiscoverableState(int state) __attribute__((weak_import));
 
+// the in-memory controller in bt_state.h is used in place of the private functions after _mockBackend(true)
+static BOOL bluetoothMocked = NO ;
+
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wtautological-pointer-compare"
 
@@ -29,8 +40,10 @@ static int bt_available(lua_State* L) {
     LuaSkin *skin = [LuaSkin sharedWithState:L] ;
     [skin checkArgs:LS_TBREAK] ;
 
-    if (IOBluetoothPreferencesAvailable != NULL) {
-        if (IOBluetoothPreferencesAvailable()) {
+    if (bluetoothMocked) {
+        lua_pushboolean(L, YES) ;
+    } else if (IOBluetoothPreferencesAvailable != NULL) {
+        if (HSASM_SPI("IOBluetoothPreferencesAvailable", IOBluetoothPreferencesAvailable())) {
             lua_pushboolean(L, YES) ;
         } else {
             lua_pushboolean(L, NO) ;
@@ -43,42 +56,223 @@ static int bt_available(lua_State* L) {
 }
 
 
-/// hs._asm.undocumented.bluetooth.power([state]) -> bool
+// IOBluetooth doesn't report a state change immediately after a set; see bt_state.h for how we wait for it.
+typedef struct {
+    const char     *name ;
+    int            (*get)(void) ;
+    void           (*set)(int state) ;
+    hsasm_spi_site getSite ;
+    hsasm_spi_site setSite ;
+} bt_stateBackend ;
+
+static bt_stateBackend powerBackend = {
+    "power",
+    IOBluetoothPreferenceGetControllerPowerState,
+    IOBluetoothPreferenceSetControllerPowerState,
+    HSASM_SPI_SITE("IOBluetoothPreferenceGetControllerPowerState"),
+    HSASM_SPI_SITE("IOBluetoothPreferenceSetControllerPowerState")
+} ;
+
+static bt_stateBackend discoverableBackend = {
+    "discoverable",
+    IOBluetoothPreferenceGetDiscoverableState,
+    IOBluetoothPreferenceSetDiscoverableState,
+    HSASM_SPI_SITE("IOBluetoothPreferenceGetDiscoverableState"),
+    HSASM_SPI_SITE("IOBluetoothPreferenceSetDiscoverableState")
+} ;
+
+static BOOL bt_backendAvailable(bt_stateBackend *backend) {
+    return (backend->get != NULL && backend->set != NULL) ;
+}
+
+static int bt_currentState(bt_stateBackend *backend) {
+    return HSASM_SPI_AT(&backend->getSite, backend->get()) ? 1 : 0 ;
+}
+
+static int bt_controllerGet(void *context) {
+    return bt_currentState((bt_stateBackend *)context) ;
+}
+
+static double bt_controllerNow(__unused void *context) {
+    return [NSProcessInfo processInfo].systemUptime ;
+}
+
+static void bt_controllerSleep(__unused void *context, double seconds) {
+    usleep((useconds_t)(seconds * 1000000)) ;
+}
+
+// Serializes the change requests for one controller state; the decisions about when to set, poll and
+// resolve are made by the bt_queue state machine in bt_state.h. Sets made for requests with a callback are
+// issued on bluetoothLane and every queued callback is resolved with the final state the controller reports.
+@interface HSASMBluetoothStateQueue : NSObject
+@property (readonly) bt_stateBackend *backend ;
+@property (readonly) NSMutableArray  *callbackRefs ;
+@property            NSTimer         *timer ;
+@end
+
+@implementation HSASMBluetoothStateQueue {
+    bt_queue      _queue ;
+    bt_controller _controller ;
+}
+
+- (instancetype)initWithBackend:(bt_stateBackend *)backend {
+    self = [super init] ;
+    if (self) {
+        _backend      = backend ;
+        _callbackRefs = [NSMutableArray array] ;
+        _timer        = nil ;
+        _queue        = (bt_queue)BT_QUEUE_INIT ;
+        _controller   = (bt_controller){ bt_controllerGet, bt_controllerNow, bt_controllerSleep, backend } ;
+    }
+    return self ;
+}
+
+- (void)setInBackground:(int)state {
+    bt_stateBackend *backend = _backend ;
+    if (!hsasm_lane_async(&bluetoothLane, ^{ HSASM_SPI_VOID_AT(&backend->setSite, backend->set(state)) ; }, nil, nil)) {
+        hsasm_lane_barrier(&bluetoothLane) ;
+        HSASM_SPI_VOID_AT(&backend->setSite, backend->set(state)) ;
+    }
+}
+
+- (void)perform:(bt_queue_action)action {
+    switch (action) {
+        case BT_QUEUE_COALESCED:
+            break ;
+        case BT_QUEUE_APPLY:
+            [self setInBackground:_queue.inFlight] ;
+            [self scheduleNextPoll] ;
+            break ;
+        case BT_QUEUE_WAIT:
+            [self scheduleNextPoll] ;
+            break ;
+        case BT_QUEUE_SETTLED:
+        case BT_QUEUE_TIMEDOUT:
+            [self resolveCallbacksWithState:_queue.observed settled:(action == BT_QUEUE_SETTLED)] ;
+            break ;
+    }
+}
+
+- (void)enqueueState:(int)state callbackRef:(int)callbackRef {
+    if (callbackRef != LUA_NOREF) [_callbackRefs addObject:@(callbackRef)] ;
+    [self perform:bt_queue_request(&_queue, &_controller, state)] ;
+}
+
+- (int)applyStateAndWait:(int)state {
+    // anything still queued on the lane is set first, so this is the last set made
+    hsasm_lane_barrier(&bluetoothLane) ;
+    if (!bt_queue_requestNow(&_queue, &_controller, state)) return state ;
+    HSASM_SPI_VOID_AT(&_backend->setSite, _backend->set(state)) ;
+    // this is never longer than the fixed one second delay we used to use and usually much shorter
+    return bt_state_wait(&_controller, state, BT_SYNC_TIMEOUT) ;
+}
+
+- (void)scheduleNextPoll {
+    _timer = [NSTimer scheduledTimerWithTimeInterval:bt_poll_next(&_queue.poll)
+                                              target:self
+                                            selector:@selector(poll:)
+                                            userInfo:nil
+                                             repeats:NO] ;
+}
+
+- (void)poll:(__unused NSTimer *)timer {
+    _timer = nil ;
+    [self perform:bt_queue_poll(&_queue, &_controller)] ;
+}
+
+- (void)resolveCallbacksWithState:(int)state settled:(BOOL)settled {
+    NSArray *callbackRefs = [_callbackRefs copy] ;
+    [_callbackRefs removeAllObjects] ;
+    if (callbackRefs.count == 0) return ;
+
+    LuaSkin   *skin = [LuaSkin sharedWithState:NULL] ;
+    lua_State *L    = skin.L ;
+    _lua_stackguard_entry(L) ;
+    NSString *label = [NSString stringWithFormat:@"hs._asm.undocumented.bluetooth.%s callback", _backend->name] ;
+    for (NSNumber *ref in callbackRefs) {
+        int callbackRef = ref.intValue ;
+        [skin pushLuaRef:refTable ref:callbackRef] ;
+        lua_pushboolean(L, state) ;
+        lua_pushboolean(L, settled) ;
+        [skin protectedCallAndError:label nargs:2 nresults:0] ;
+        [skin luaUnref:refTable ref:callbackRef] ;
+    }
+    _lua_stackguard_exit(L) ;
+}
+
+- (void)pushStats:(lua_State *)L {
+    lua_newtable(L) ;
+    lua_pushinteger(L, (lua_Integer)_queue.received) ;  lua_setfield(L, -2, "received") ;
+    lua_pushinteger(L, (lua_Integer)_queue.coalesced) ; lua_setfield(L, -2, "coalesced") ;
+    lua_pushinteger(L, (lua_Integer)_queue.applied) ;   lua_setfield(L, -2, "applied") ;
+    lua_pushinteger(L, (lua_Integer)_callbackRefs.count) ; lua_setfield(L, -2, "pending") ;
+}
+
+- (void)cancel {
+    [_timer invalidate] ;
+    _timer = nil ;
+    _queue = (bt_queue)BT_QUEUE_INIT ;
+    LuaSkin *skin = [LuaSkin sharedWithState:NULL] ;
+    for (NSNumber *ref in _callbackRefs) [skin luaUnref:refTable ref:ref.intValue] ;
+    [_callbackRefs removeAllObjects] ;
+}
+
+@end
+
+static HSASMBluetoothStateQueue *powerQueue ;
+static HSASMBluetoothStateQueue *discoverableQueue ;
+
+// common implementation for bt_power and bt_discoverable
+static int bt_stateFunction(lua_State *L, HSASMBluetoothStateQueue *queue) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TBOOLEAN | LS_TOPTIONAL, LS_TFUNCTION | LS_TOPTIONAL, LS_TBREAK] ;
+
+    if (!bt_backendAvailable(queue.backend)) {
+        lua_pushnil(L) ;
+        return 1 ;
+    }
+
+    if (lua_isboolean(L, 1)) {
+        int targetState = lua_toboolean(L, 1) ? 1 : 0 ;
+        if (lua_type(L, 2) == LUA_TFUNCTION) {
+            lua_pushvalue(L, 2) ;
+            [queue enqueueState:targetState callbackRef:[skin luaRef:refTable]] ;
+            lua_pushboolean(L, bt_currentState(queue.backend)) ;
+        } else {
+            lua_pushboolean(L, [queue applyStateAndWait:targetState]) ;
+        }
+    } else {
+        lua_pushboolean(L, bt_currentState(queue.backend)) ;
+    }
+    return 1 ;
+}
+
+/// hs._asm.undocumented.bluetooth.power([state], [fn]) -> bool
 /// Function
 /// Get or set bluetooth power state.
 ///
 /// Parameters:
 ///  * state - an optional boolean value indicating whether bluetooth power should be turned on (true) or off (false)
+///  * fn    - an optional callback function to be invoked when the power state change has completed. The function should expect two arguments: a boolean indicating the current power state, and a boolean indicating whether or not the requested state was reached before the change timed out.
 ///
 /// Returns:
 ///  * the (possibly changed) current value; returns nil if bluetooth framework unavailable (this has been observed in some virtual machines)
+///
+/// Notes:
+///  * if `fn` is not provided, this function waits for the controller to report the new state for up to one second before returning.
+///  * if `fn` is provided, this function returns immediately with the state reported at the time of the call; the controller is then polled in the background and `fn` is invoked once the controller reports the requested state or ten seconds have passed.
+///  * requests made while a previous change is still settling are coalesced -- only the most recently requested state is applied and every pending callback receives the final state reported by the controller. See [hs._asm.undocumented.bluetooth.queueStats](#queueStats).
 static int bt_power(lua_State* L) {
-    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
-    [skin checkArgs:LS_TBOOLEAN | LS_TOPTIONAL, LS_TBREAK] ;
-
-    if (IOBluetoothPreferenceGetControllerPowerState != NULL && IOBluetoothPreferenceSetControllerPowerState != NULL) {
-        if (!lua_isnone(L, 1)) {
-            IOBluetoothPreferenceSetControllerPowerState((Boolean) lua_toboolean(L, -1));
-            usleep(1000000); // Apparently it doesn't like being re-queried too quickly
-        }
-
-        if (IOBluetoothPreferenceGetControllerPowerState()) {
-            lua_pushboolean(L, YES) ;
-        } else {
-            lua_pushboolean(L, NO) ;
-        }
-    } else {
-        lua_pushnil(L) ;
-    }
-    return 1;
+    return bt_stateFunction(L, powerQueue) ;
 }
 
-/// hs._asm.undocumented.bluetooth.discoverable([state]) -> bool
+/// hs._asm.undocumented.bluetooth.discoverable([state], [fn]) -> bool
 /// Function
 /// Get or set bluetooth discoverable state.
 ///
 /// Parameters:
 ///  * state - an optional boolean value indicating whether bluetooth the machine should be discoverable (true) or not (false)
+///  * fn    - an optional callback function to be invoked when the discoverable state change has completed. The function should expect two arguments: a boolean indicating the current discoverable state, and a boolean indicating whether or not the requested state was reached before the change timed out.
 ///
 /// Returns:
 ///  * the (possibly changed) current value; returns nil if bluetooth framework unavailable (this has been observed in some virtual machines)
@@ -86,25 +280,107 @@ static int bt_power(lua_State* L) {
 /// Notes:
 ///  * use of this method to change discoverability has been observed to cause connected devices to disconnect in rare cases; use at your own risk.
 ///  * Opening the Bluetooth preference pane always turns on discoverability if bluetooth power is on or if it is switched on when preference pane is open; this change of discoverability is *not* reported by the API function used by this function.
+///  * if `fn` is not provided, this function waits for the controller to report the new state for up to one second before returning.
+///  * if `fn` is provided, this function returns immediately with the state reported at the time of the call; the controller is then polled in the background and `fn` is invoked once the controller reports the requested state or ten seconds have passed.
+///  * requests made while a previous change is still settling are coalesced -- only the most recently requested state is applied and every pending callback receives the final state reported by the controller. See [hs._asm.undocumented.bluetooth.queueStats](#queueStats).
 static int bt_discoverable(lua_State* L) {
+    return bt_stateFunction(L, discoverableQueue) ;
+}
+
+/// hs._asm.undocumented.bluetooth.queueStats() -> table
+/// Function
+/// Returns statistics about the requests made to change the bluetooth power and discoverable states.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * a table with the keys `power` and `discoverable`, each of which is a table containing the following keys:
+///    * received  - the number of requests to change the state made with this module
+///    * coalesced - the number of requests which did not require an additional call to the private API, either because the requested state was already current or because it was merged with a change already in progress
+///    * applied   - the number of times the private API was actually invoked to change the state
+///    * pending   - the number of callback functions waiting for the current change to settle
+static int bt_queueStats(lua_State* L) {
     LuaSkin *skin = [LuaSkin sharedWithState:L] ;
-    [skin checkArgs:LS_TBOOLEAN | LS_TOPTIONAL, LS_TBREAK] ;
+    [skin checkArgs:LS_TBREAK] ;
 
-    if (IOBluetoothPreferenceSetDiscoverableState != NULL && IOBluetoothPreferenceGetDiscoverableState != NULL) {
-        if (!lua_isnone(L, 1)) {
-            IOBluetoothPreferenceSetDiscoverableState((Boolean) lua_toboolean(L, -1));
-            usleep(1000000);  // Apparently it doesn't like being re-queried too quickly
-        }
+    lua_newtable(L) ;
+    [powerQueue pushStats:L] ;        lua_setfield(L, -2, "power") ;
+    [discoverableQueue pushStats:L] ; lua_setfield(L, -2, "discoverable") ;
+    return 1 ;
+}
 
-        if (IOBluetoothPreferenceGetDiscoverableState()) {
-            lua_pushboolean(L, YES) ;
-        } else {
-            lua_pushboolean(L, NO) ;
-        }
-    } else {
-        lua_pushnil(L) ;
+/// hs._asm.undocumented.bluetooth.stats([json]) -> table | string
+/// Function
+/// Returns call counts and timing for the private IOBluetooth functions used by this module.
+///
+/// Parameters:
+///  * json - an optional boolean, default false, specifying whether the statistics should be returned as a JSON string instead of a table.
+///
+/// Returns:
+///  * a table keyed by function name (e.g. `IOBluetoothPreferenceSetControllerPowerState`), each entry containing the following keys:
+///    * calls      - the number of times the function has been called
+///    * errors     - the number of calls which reported an error; none of the IOBluetoothPreference functions return a status, so this will always be 0
+///    * errorCodes - a table of error code -> count
+///    * totalNs, meanNs, minNs, maxNs - the total, mean, shortest and longest time spent in the function in nanoseconds
+///    * p50, p90, p99, p999 - latency percentiles in nanoseconds, accurate to within 25%
+///
+/// Notes:
+///  * the state getters are called repeatedly while a change settles, so their call counts include the polling described in [hs._asm.undocumented.bluetooth.power](#power).
+static int bt_stats(lua_State* L) {
+    return hsasm_spi_pushStats(L) ;
+}
+
+/// hs._asm.undocumented.bluetooth.resetStats() -> None
+/// Function
+/// Clears the statistics returned by [hs._asm.undocumented.bluetooth.stats](#stats).
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * None
+static int bt_resetStats(lua_State* L) {
+    return hsasm_spi_resetStats(L) ;
+}
+
+/// hs._asm.undocumented.bluetooth.executorStats() -> table
+/// Function
+/// Returns information about the background queue used to change the bluetooth state when a callback is provided to [hs._asm.undocumented.bluetooth.power](#power) or [hs._asm.undocumented.bluetooth.discoverable](#discoverable).
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * a table containing the keys `name`, `limit`, `depth`, `peakDepth`, `submitted`, `completed`, `rejected`, `barriers`, `meanWait` and `meanRun`; see [hs._asm.undocumented.coredock.executorStats](../coredock/#executorStats) for a description of each.
+///
+/// Notes:
+///  * if the queue is full, the change is made on the main thread instead and counted in `rejected`.
+static int bt_executorStats(lua_State* L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TBREAK] ;
+    hsasm_lane_pushStats(L, &bluetoothLane) ;
+    return 1 ;
+}
+
+// _mockBackend([enable], [options]) -> table
+// switches between the private IOBluetooth functions and an in-memory controller (see hsasm_mock.h) and
+// returns a table describing the backend in use and the mock's configuration and call counts
+static int bt_selectBackend(lua_State* L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TBOOLEAN | LS_TOPTIONAL, LS_TTABLE | LS_TOPTIONAL, LS_TBREAK] ;
+
+    if (lua_isboolean(L, 1)) {
+        hsasm_lane_barrier(&bluetoothLane) ;
+        bluetoothMocked         = (BOOL)lua_toboolean(L, 1) ;
+        powerBackend.get        = bluetoothMocked ? bt_mockGetPower : IOBluetoothPreferenceGetControllerPowerState ;
+        powerBackend.set        = bluetoothMocked ? bt_mockSetPower : IOBluetoothPreferenceSetControllerPowerState ;
+        discoverableBackend.get = bluetoothMocked ? bt_mockGetDiscoverable : IOBluetoothPreferenceGetDiscoverableState ;
+        discoverableBackend.set = bluetoothMocked ? bt_mockSetDiscoverable : IOBluetoothPreferenceSetDiscoverableState ;
+        hsasm_mock_configure(L, 2, &bluetoothMock) ;
     }
-    return 1;
+    hsasm_mock_pushStats(L, bluetoothMocked ? "mock" : "native", &bluetoothMock) ;
+    return 1 ;
 }
 
 #pragma clang diagnostic pop
@@ -113,12 +389,34 @@ static const luaL_Reg moduleLib[] = {
     {"available",           bt_available},
     {"power",               bt_power},
     {"discoverable",        bt_discoverable},
+    {"queueStats",          bt_queueStats},
+    {"stats",               bt_stats},
+    {"resetStats",          bt_resetStats},
+    {"executorStats",       bt_executorStats},
+    {"_mockBackend",        bt_selectBackend},
     {NULL, NULL}
 };
 
+static int meta_gc(lua_State* __unused L) {
+    [powerQueue cancel] ;
+    [discoverableQueue cancel] ;
+    hsasm_lane_abandon(&bluetoothLane) ;
+    powerQueue        = nil ;
+    discoverableQueue = nil ;
+    return 0 ;
+}
+
+static const luaL_Reg module_metaLib[] = {
+    {"__gc", meta_gc},
+    {NULL,   NULL}
+};
+
 int luaopen_hs__asm_undocumented_bluetooth_internal(lua_State* L) {
     LuaSkin *skin = [LuaSkin sharedWithState:L] ;
-    refTable = [skin registerLibrary:"hs._asm.undocumented.bluetooth" functions:moduleLib metaFunctions:nil] ;
+    refTable = [skin registerLibrary:"hs._asm.undocumented.bluetooth" functions:moduleLib metaFunctions:module_metaLib] ;
+
+    powerQueue        = [[HSASMBluetoothStateQueue alloc] initWithBackend:&powerBackend] ;
+    discoverableQueue = [[HSASMBluetoothStateQueue alloc] initWithBackend:&discoverableBackend] ;
 
     return 1;
 }
@@ -0,0 +1,476 @@
+//
+// cgsdebug_dump.h
+// Indexing and parsing the text files written by the WindowServer dump options
+//
+// The WindowServer dump files are plain text: each entry starts with an unindented line and continues
+// with indented "key: value" or "key = value" lines, with blank lines between some entries. Rather than
+// turning the whole file into Lua tables up front, the file is scanned once to record where each entry
+// starts and how long it is; entries are only parsed when they are asked for. None of this needs
+// Foundation or Lua, so the fixtures in test/fixtures can be parsed and timed anywhere (see
+// test/test_cgsdebug_dump.c and bench/bench_cgsdebug_dump.c).
+
+#pragma once
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// entries are addressed with 32 bit offsets, which is far more than any dump the WindowServer writes
+#define DUMP_MAX_SIZE UINT32_MAX
+
+typedef struct {
+    uint32_t offset ;
+    uint32_t length ;
+} dump_record ;
+
+typedef struct {
+    dump_record *records ;
+    size_t      count ;
+    size_t      capacity ;
+} dump_index ;
+
+static inline bool dump_index_add(dump_index *index, size_t start, size_t end) {
+    if (index->count == index->capacity) {
+        size_t      capacity = index->capacity ? index->capacity * 2 : 256 ;
+        dump_record *records = realloc(index->records, capacity * sizeof(dump_record)) ;
+        if (!records) return false ;
+        index->records  = records ;
+        index->capacity = capacity ;
+    }
+    index->records[index->count++] = (dump_record){ (uint32_t)start, (uint32_t)(end - start) } ;
+    return true ;
+}
+
+// Records where each entry in bytes starts and ends. An entry begins with a line which isn't indented and
+// includes all of the indented lines which follow it; a blank line also ends an entry. Returns false if
+// the file is too large or memory runs out, leaving whatever was indexed so far.
+static inline bool dump_index_build(dump_index *index, const char *bytes, size_t length) {
+    if (length > DUMP_MAX_SIZE) return false ;
+
+    size_t pos         = 0 ;
+    bool   inRecord    = false ;
+    size_t recordStart = 0 ;
+    size_t lastLineEnd = 0 ;
+
+    while (pos < length) {
+        const char *newline = memchr(bytes + pos, '\n', length - pos) ;
+        size_t     lineEnd  = newline ? (size_t)(newline - bytes) : length ;
+
+        size_t firstNonSpace = pos ;
+        while (firstNonSpace < lineEnd && isspace((unsigned char)bytes[firstNonSpace])) firstNonSpace++ ;
+        bool blank    = (firstNonSpace == lineEnd) ;
+        bool indented = !blank && (firstNonSpace != pos) ;
+
+        if (blank || !indented) {
+            if (inRecord && !dump_index_add(index, recordStart, lastLineEnd)) return false ;
+            inRecord = false ;
+        }
+        if (!blank) {
+            if (!inRecord) {
+                inRecord    = true ;
+                recordStart = pos ;
+            }
+            lastLineEnd = lineEnd ;
+        }
+        pos = lineEnd + 1 ;
+    }
+    if (inRecord && !dump_index_add(index, recordStart, lastLineEnd)) return false ;
+    return true ;
+}
+
+static inline void dump_index_free(dump_index *index) {
+    free(index->records) ;
+    *index = (dump_index){ NULL, 0, 0 } ;
+}
+
+static inline const char *dump_trimStart(const char *start, const char *end) {
+    while (start < end && isspace((unsigned char)*start)) start++ ;
+    return start ;
+}
+
+static inline const char *dump_trimEnd(const char *start, const char *end) {
+    while (end > start && isspace((unsigned char)*(end - 1))) end-- ;
+    return end ;
+}
+
+// The lines of one entry. The first is the header; after that a line with a ':' or '=' separating a
+// non-empty key from its value is a field, and anything else that isn't blank is kept as plain text.
+typedef enum {
+    kDumpLineHeader = 0,
+    kDumpLineField,
+    kDumpLineText,
+} dump_lineKind ;
+
+typedef struct {
+    dump_lineKind kind ;
+    const char    *key ;      // fields only
+    size_t        keyLength ;
+    const char    *value ;    // the field's value, or the whole trimmed line for headers and text
+    size_t        valueLength ;
+} dump_line ;
+
+typedef struct {
+    const char *p ;
+    const char *end ;
+    bool       first ;
+} dump_cursor ;
+
+static inline dump_cursor dump_cursor_make(const char *bytes, size_t length) {
+    return (dump_cursor){ bytes, bytes + length, true } ;
+}
+
+// steps to the next line of the entry, returning false at the end
+static inline bool dump_cursor_next(dump_cursor *cursor, dump_line *line) {
+    while (cursor->p < cursor->end) {
+        const char *newline = memchr(cursor->p, '\n', (size_t)(cursor->end - cursor->p)) ;
+        const char *lineEnd = newline ? newline : cursor->end ;
+        const char *start   = dump_trimStart(cursor->p, lineEnd) ;
+        const char *stop    = dump_trimEnd(start, lineEnd) ;
+        cursor->p = lineEnd + 1 ;
+
+        if (cursor->first) {
+            cursor->first = false ;
+            *line = (dump_line){ kDumpLineHeader, NULL, 0, start, (size_t)(stop - start) } ;
+            return true ;
+        }
+        if (start == stop) continue ;
+
+        const char *separator = start ;
+        while (separator < stop && *separator != ':' && *separator != '=') separator++ ;
+        const char *keyEnd = dump_trimEnd(start, separator) ;
+        if (separator < stop && keyEnd > start) {
+            const char *value = dump_trimStart(separator + 1, stop) ;
+            *line = (dump_line){ kDumpLineField, start, (size_t)(keyEnd - start), value, (size_t)(stop - value) } ;
+        } else {
+            *line = (dump_line){ kDumpLineText, NULL, 0, start, (size_t)(stop - start) } ;
+        }
+        return true ;
+    }
+    return false ;
+}
+
+typedef enum {
+    kDumpValueString = 0,
+    kDumpValueInteger,
+    kDumpValueNumber,
+} dump_valueKind ;
+
+// the end of the run of base 10 or base 16 digits at p
+static inline const char *dump_skipDigits(const char *p, const char *end, int base) {
+    while (p < end && (base == 16 ? isxdigit((unsigned char)*p) : isdigit((unsigned char)*p))) p++ ;
+    return p ;
+}
+
+// Classifies a field value: an integer if the whole value is decimal digits with an optional sign, or hex
+// digits after 0x; a number if it is decimal with a fraction or an exponent, or an integer too large for
+// a long long; otherwise a string. The base is never guessed, so leading zeros are still decimal, and
+// nan, inf and hex floats, which strtod would accept, are left as strings. Hex values above LLONG_MAX keep
+// their bits.
+static inline dump_valueKind dump_parseValue(const char *start, size_t length, long long *integer, double *number) {
+    if (length == 0 || length >= 64) return kDumpValueString ;
+    char buffer[64] ;
+    memcpy(buffer, start, length) ;
+    buffer[length] = 0 ;
+    const char *end = buffer + length ;
+
+    if (buffer[0] == '0' && (buffer[1] == 'x' || buffer[1] == 'X')) {
+        const char *stop = dump_skipDigits(buffer + 2, end, 16) ;
+        if (stop == buffer + 2 || stop != end) return kDumpValueString ;
+        errno = 0 ;
+        unsigned long long value = strtoull(buffer + 2, NULL, 16) ;
+        if (errno == ERANGE) return kDumpValueString ;
+        *integer = (long long)value ;
+        return kDumpValueInteger ;
+    }
+
+    const char *digits = buffer + (buffer[0] == '-' || buffer[0] == '+') ;
+    const char *stop   = dump_skipDigits(digits, end, 10) ;
+    if (stop == end && stop > digits) {
+        errno    = 0 ;
+        *integer = strtoll(buffer, NULL, 10) ;
+        if (errno != ERANGE) return kDumpValueInteger ;
+    } else {
+        bool mantissa = (stop > digits) ;
+        if (stop < end && *stop == '.') {
+            const char *fraction = stop + 1 ;
+            stop      = dump_skipDigits(fraction, end, 10) ;
+            mantissa |= (stop > fraction) ;
+        }
+        if (!mantissa) return kDumpValueString ;
+        if (stop < end && (*stop == 'e' || *stop == 'E')) {
+            const char *exponent = stop + 1 ;
+            if (exponent < end && (*exponent == '-' || *exponent == '+')) exponent++ ;
+            stop = dump_skipDigits(exponent, end, 10) ;
+            if (stop == exponent) return kDumpValueString ;
+        }
+        if (stop != end) return kDumpValueString ;
+    }
+    *number = strtod(buffer, NULL) ;
+    return kDumpValueNumber ;
+}
+
+// For window list dumps, a second index maps each window id to its entry and a hash of the entry's text.
+// It's an open addressing table built the first time it's needed, so comparing two dumps never requires
+// parsing the entries which are the same in both.
+//
+// The same entries are also kept ordered by dump_windowKey, a scramble of the window id, with a tree of
+// digests over the leading bits of the key: each leaf sums the digests of the windows whose keys start
+// with its bits, and each node above sums its two children. Two dumps agree on a node exactly when the
+// windows under it are the same (barring a 64 bit collision), so a diff only descends where they differ.
+typedef struct {
+    uint64_t windowID ;
+    uint64_t contentHash ;
+    uint32_t record ;
+    uint32_t used ;
+} dump_windowSlot ;
+
+#define DUMP_WINDOWS_LEAF_SIZE 4  // windows per leaf the depth of the digest tree aims for
+#define DUMP_WINDOWS_MAX_DEPTH 16
+
+typedef struct {
+    dump_windowSlot *slots ;
+    size_t          capacity ;  // a power of 2, at least twice the number of entries
+    size_t          count ;     // distinct window ids
+    dump_windowSlot *ordered ;  // the count used slots, by key
+    uint32_t        *leafStart ; // where each leaf's windows start in ordered, plus the end of the last
+    uint64_t        *digests ;  // the nodes of the digest tree, the root first and then level by level
+    unsigned        depth ;     // the tree has 2^depth leaves
+} dump_windows ;
+
+static inline uint64_t dump_hashBytes(const char *bytes, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL ; // FNV-1a
+    for (size_t i = 0 ; i < length ; i++) {
+        hash ^= (uint8_t)bytes[i] ;
+        hash *= 0x100000001b3ULL ;
+    }
+    return hash ;
+}
+
+// multiplying by an odd constant is a bijection, so distinct window ids always have distinct keys
+static inline uint64_t dump_windowKey(uint64_t windowID) {
+    return windowID * 0x9E3779B97F4A7C15ULL ;
+}
+
+static inline size_t dump_slotForWindowID(uint64_t windowID, size_t capacity) {
+    return (size_t)(dump_windowKey(windowID) >> 32) & (capacity - 1) ;
+}
+
+// the node of the given level of the digest tree that a key falls under
+static inline uint64_t dump_keyPrefix(uint64_t key, unsigned level) {
+    return level ? key >> (64 - level) : 0 ;
+}
+
+static inline uint64_t dump_windowDigest(const dump_windowSlot *slot) {
+    uint64_t x = dump_windowKey(slot->windowID) ^ (slot->contentHash * 0xbf58476d1ce4e5b9ULL + 0x632be59bd9b4e019ULL) ;
+    x ^= x >> 31 ; x *= 0x94d049bb133111ebULL ; x ^= x >> 29 ; // splitmix64's finalizer
+    return x ;
+}
+
+// parses the integer (decimal, or hex after 0x) at p, returning false if there isn't one
+static inline bool dump_parseNumberAt(const char *p, const char *end, uint64_t *value) {
+    char   buffer[32] ;
+    size_t length = 0 ;
+    while (p + length < end && length < sizeof(buffer) - 1 && isalnum((unsigned char)p[length])) length++ ;
+    if (length == 0 || !isdigit((unsigned char)p[0])) return false ;
+    memcpy(buffer, p, length) ;
+    buffer[length] = 0 ;
+
+    bool       hex    = (length > 2 && buffer[0] == '0' && (buffer[1] == 'x' || buffer[1] == 'X')) ;
+    const char *first = hex ? buffer + 2 : buffer ;
+    if (dump_skipDigits(first, buffer + length, hex ? 16 : 10) != buffer + length) return false ;
+    errno  = 0 ;
+    *value = strtoull(first, NULL, hex ? 16 : 10) ;
+    return (errno != ERANGE) ;
+}
+
+// Looks for a "wid" key anywhere in the entry first, and if there isn't one, uses the first number in
+// the entry's header line.
+static inline bool dump_windowIDForRecord(const char *bytes, size_t length, uint64_t *windowID) {
+    const char *end = bytes + length ;
+    const char *p   = bytes ;
+    while (p + 3 <= end && (p = memchr(p, 'w', (size_t)(end - p - 2)))) {
+        if (p[1] != 'i' || p[2] != 'd') {
+            p++ ;
+            continue ;
+        }
+        if (p == bytes || !isalnum((unsigned char)*(p - 1))) {
+            const char *value = p + 3 ;
+            while (value < end && (*value == ' ' || *value == '\t' || *value == ':' || *value == '=')) value++ ;
+            if (dump_parseNumberAt(value, end, windowID)) return true ;
+        }
+        p += 3 ;
+    }
+
+    const char *headerEnd = memchr(bytes, '\n', length) ;
+    if (!headerEnd) headerEnd = end ;
+    for (p = bytes ; p < headerEnd ; p++) {
+        if (isdigit((unsigned char)*p) && (p == bytes || !isalnum((unsigned char)*(p - 1)))) {
+            if (dump_parseNumberAt(p, headerEnd, windowID)) return true ;
+        }
+    }
+    return false ;
+}
+
+static inline void dump_windows_free(dump_windows *windows) {
+    free(windows->slots) ;
+    free(windows->ordered) ;
+    free(windows->leafStart) ;
+    free(windows->digests) ;
+    *windows = (dump_windows){ .slots = NULL } ;
+}
+
+// Orders the used slots by key and sums the digest tree. The windows are bucketed by leaf and each leaf,
+// a handful of windows, is insertion sorted, so this is linear in the number of windows.
+static inline bool dump_windows_buildTree(dump_windows *windows) {
+    unsigned depth = 0 ;
+    while (depth < DUMP_WINDOWS_MAX_DEPTH && ((size_t)DUMP_WINDOWS_LEAF_SIZE << depth) < windows->count) depth++ ;
+    size_t leaves = (size_t)1 << depth ;
+
+    windows->depth     = depth ;
+    windows->ordered   = malloc((windows->count + 1) * sizeof(dump_windowSlot)) ;
+    windows->leafStart = calloc(leaves + 1, sizeof(uint32_t)) ;
+    windows->digests   = calloc(2 * leaves - 1, sizeof(uint64_t)) ;
+    if (!windows->ordered || !windows->leafStart || !windows->digests) return false ;
+
+    uint32_t *start = windows->leafStart ;
+    for (size_t i = 0 ; i < windows->capacity ; i++) {
+        if (windows->slots[i].used) start[dump_keyPrefix(dump_windowKey(windows->slots[i].windowID), depth) + 1]++ ;
+    }
+    for (size_t leaf = 1 ; leaf <= leaves ; leaf++) start[leaf] += start[leaf - 1] ;
+    // filling advances each start to the next leaf's, so shift them back afterwards
+    for (size_t i = 0 ; i < windows->capacity ; i++) {
+        const dump_windowSlot *slot = &windows->slots[i] ;
+        if (!slot->used) continue ;
+        uint64_t leaf = dump_keyPrefix(dump_windowKey(slot->windowID), depth) ;
+        windows->ordered[start[leaf]++] = *slot ;
+        windows->digests[leaves - 1 + leaf] += dump_windowDigest(slot) ;
+    }
+    memmove(start + 1, start, leaves * sizeof(uint32_t)) ;
+    start[0] = 0 ;
+
+    for (size_t leaf = 0 ; leaf < leaves ; leaf++) {
+        for (uint32_t i = start[leaf] + 1 ; i < start[leaf + 1] ; i++) {
+            dump_windowSlot slot = windows->ordered[i] ;
+            uint64_t        key  = dump_windowKey(slot.windowID) ;
+            uint32_t        j    = i ;
+            for ( ; j > start[leaf] && dump_windowKey(windows->ordered[j - 1].windowID) > key ; j--) {
+                windows->ordered[j] = windows->ordered[j - 1] ;
+            }
+            windows->ordered[j] = slot ;
+        }
+    }
+    for (size_t node = leaves - 1 ; node-- > 0 ; ) {
+        windows->digests[node] = windows->digests[2 * node + 1] + windows->digests[2 * node + 2] ;
+    }
+    return true ;
+}
+
+// builds the window index for the entries of bytes; returns false, leaving windows empty, if memory runs out
+static inline bool dump_windows_build(dump_windows *windows, const char *bytes, const dump_index *index) {
+    *windows = (dump_windows){ .slots = NULL } ;
+    size_t capacity = 16 ;
+    while (capacity < index->count * 2) capacity <<= 1 ;
+
+    dump_windowSlot *slots = calloc(capacity, sizeof(dump_windowSlot)) ;
+    if (!slots) return false ;
+    size_t count = 0 ;
+
+    for (size_t i = 0 ; i < index->count ; i++) {
+        dump_record record = index->records[i] ;
+        const char  *text  = bytes + record.offset ;
+        uint64_t    windowID ;
+        if (!dump_windowIDForRecord(text, record.length, &windowID)) continue ;
+
+        size_t slot = dump_slotForWindowID(windowID, capacity) ;
+        while (slots[slot].used && slots[slot].windowID != windowID) slot = (slot + 1) & (capacity - 1) ;
+        if (!slots[slot].used) count++ ;
+        // if a window id appears more than once, the last entry wins
+        slots[slot] = (dump_windowSlot){ windowID, dump_hashBytes(text, record.length), (uint32_t)i, 1 } ;
+    }
+
+    *windows = (dump_windows){ .slots = slots, .capacity = capacity, .count = count } ;
+    if (!dump_windows_buildTree(windows)) {
+        dump_windows_free(windows) ;
+        return false ;
+    }
+    return true ;
+}
+
+static inline const dump_windowSlot *dump_windows_find(const dump_windows *windows, uint64_t windowID) {
+    if (!windows->slots) return NULL ;
+    size_t slot = dump_slotForWindowID(windowID, windows->capacity) ;
+    while (windows->slots[slot].used) {
+        if (windows->slots[slot].windowID == windowID) return &windows->slots[slot] ;
+        slot = (slot + 1) & (windows->capacity - 1) ;
+    }
+    return NULL ;
+}
+
+typedef enum {
+    kDumpWindowAdded = 0,
+    kDumpWindowRemoved,
+    kDumpWindowChanged,
+} dump_change ;
+
+typedef void (*dump_diffCallback)(void *context, dump_change change, uint64_t windowID) ;
+
+// an index which failed to build, or was never built, has no windows and a digest of 0 everywhere
+static inline uint64_t dump_windows_digest(const dump_windows *windows, unsigned level, uint64_t node) {
+    return windows->digests ? windows->digests[((uint64_t)1 << level) - 1 + node] : 0 ;
+}
+
+static inline const dump_windowSlot *dump_windows_range(const dump_windows *windows, unsigned level, uint64_t node, size_t *count) {
+    *count = 0 ;
+    if (!windows->leafStart) return NULL ;
+    unsigned shift = windows->depth - level ;
+    uint32_t first = windows->leafStart[node << shift] ;
+    *count = windows->leafStart[(node + 1) << shift] - first ;
+    return windows->ordered + first ;
+}
+
+static inline size_t dump_windows_diffNode(const dump_windows *before, const dump_windows *after, unsigned level, unsigned depth,
+                                           uint64_t node, dump_diffCallback report, void *context) {
+    if (dump_windows_digest(before, level, node) == dump_windows_digest(after, level, node)) return 0 ;
+    if (level < depth) {
+        return dump_windows_diffNode(before, after, level + 1, depth, 2 * node, report, context) +
+               dump_windows_diffNode(before, after, level + 1, depth, 2 * node + 1, report, context) ;
+    }
+
+    // both ranges are ordered by key, so merge them
+    size_t                beforeCount, afterCount, i = 0, j = 0, differences = 0 ;
+    const dump_windowSlot *a = dump_windows_range(before, level, node, &beforeCount) ;
+    const dump_windowSlot *b = dump_windows_range(after, level, node, &afterCount) ;
+    while (i < beforeCount || j < afterCount) {
+        uint64_t keyA = (i < beforeCount) ? dump_windowKey(a[i].windowID) : 0 ;
+        uint64_t keyB = (j < afterCount)  ? dump_windowKey(b[j].windowID) : 0 ;
+        if (j == afterCount || (i < beforeCount && keyA < keyB)) {
+            report(context, kDumpWindowRemoved, a[i++].windowID) ;
+            differences++ ;
+        } else if (i == beforeCount || keyB < keyA) {
+            report(context, kDumpWindowAdded, b[j++].windowID) ;
+            differences++ ;
+        } else {
+            if (a[i].contentHash != b[j].contentHash) {
+                report(context, kDumpWindowChanged, a[i].windowID) ;
+                differences++ ;
+            }
+            i++ ;
+            j++ ;
+        }
+    }
+    return differences ;
+}
+
+// Compares two window indexes, reporting each window which was added, removed or changed in key order.
+// The digest trees are compared from the root down to the depth of the shallower one, skipping every
+// subtree whose digests agree, and only the leaves which disagree are merged. The cost follows the number
+// of differences -- about (depth + windows per leaf) for each -- rather than the number of windows, and
+// no entry is parsed. Returns the number of differences.
+static inline size_t dump_windows_diff(const dump_windows *before, const dump_windows *after, dump_diffCallback report, void *context) {
+    unsigned depth = (before->depth < after->depth) ? before->depth : after->depth ;
+    return dump_windows_diffNode(before, after, 0, depth, 0, report, context) ;
+}
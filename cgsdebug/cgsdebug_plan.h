@@ -0,0 +1,166 @@
+//
+// cgsdebug_plan.h
+// Planning and applying changes to the WindowServer debug options through a table of functions
+//
+// setMask and update turn their arguments into a cgsdebug_plan -- the flags to set, the flags to clear and
+// the commands to issue -- and apply it with one read and one write of the options, no matter how many
+// flags change. The options with the high bit set aren't flags; they are commands which tell the
+// WindowServer to perform a one time action (usually dumping something to /tmp), so they are issued on
+// their own rather than being merged into the mask. Everything goes through a cgsdebug_backend, either the
+// CGS functions or the in-memory mock below, so the planning can be tested without a WindowServer (see
+// test/test_cgsdebug_plan.c).
+
+#pragma once
+
+#include "hsasm_portable.h"
+#include "hsasm_spi.h"
+#include "hsasm_mock.h"
+#include "cgsdebug.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CGSDEBUG_COMMAND_BIT 0x80000000U
+
+// the number of distinct commands in cgsdebug.h; a plan never needs to hold more than this
+#define CGSDEBUG_MAX_COMMANDS 10
+
+static inline bool cgsdebug_isCommand(uint32_t option) {
+    return (option & CGSDEBUG_COMMAND_BIT) != 0 ;
+}
+
+// the WindowServer functions used by this module, so they can be replaced with an in-memory mock; see hsasm_mock.h
+typedef struct {
+    const char *name ;
+    CGError    (*getDebugOptions)(CGSDebugOption *outCurrentOptions) ;
+    CGError    (*setDebugOptions)(CGSDebugOption options) ;
+} cgsdebug_backend ;
+
+static hsasm_mock       cgsdebug_mock        = HSASM_MOCK(kCGErrorFailure) ;
+static _Atomic uint32_t cgsdebug_mockOptions = 0 ;
+
+static CGError cgsdebug_mockGetDebugOptions(CGSDebugOption *outCurrentOptions) {
+    if (hsasm_mock_call(&cgsdebug_mock)) return (CGError)cgsdebug_mock.failureCode ;
+    *outCurrentOptions = (CGSDebugOption)atomic_load(&cgsdebug_mockOptions) ;
+    return kCGErrorSuccess ;
+}
+
+// like the WindowServer, a command is acted on but not remembered, and the flags which were set are lost
+static CGError cgsdebug_mockSetDebugOptions(CGSDebugOption options) {
+    if (hsasm_mock_call(&cgsdebug_mock)) return (CGError)cgsdebug_mock.failureCode ;
+    atomic_store(&cgsdebug_mockOptions, cgsdebug_isCommand((uint32_t)options) ? kCGSDebugOptionNone : (uint32_t)options) ;
+    return kCGErrorSuccess ;
+}
+
+static const cgsdebug_backend cgsdebug_mockBackend = { "mock", cgsdebug_mockGetDebugOptions, cgsdebug_mockSetDebugOptions } ;
+
+// describes the changes to make with a single get/set pair
+typedef struct {
+    uint32_t setBits ;
+    uint32_t clearBits ;
+    uint32_t commands[CGSDEBUG_MAX_COMMANDS] ;
+    size_t   commandCount ;
+} cgsdebug_plan ;
+
+// adds one option to the plan; a later value for a flag replaces an earlier one, and a command is only
+// issued when turned on, once no matter how many times it is given
+static inline void cgsdebug_plan_add(cgsdebug_plan *plan, uint32_t option, bool on) {
+    if (cgsdebug_isCommand(option)) {
+        if (!on) return ;
+        for (size_t i = 0 ; i < plan->commandCount ; i++) if (plan->commands[i] == option) return ;
+        if (plan->commandCount < CGSDEBUG_MAX_COMMANDS) plan->commands[plan->commandCount++] = option ;
+    } else if (on) {
+        plan->setBits   |= option ;
+        plan->clearBits &= ~option ;
+    } else {
+        plan->clearBits |= option ;
+        plan->setBits   &= ~option ;
+    }
+}
+
+static inline uint32_t cgsdebug_plan_target(const cgsdebug_plan *plan, uint32_t current) {
+    return (current | plan->setBits) & ~plan->clearBits ;
+}
+
+// Applies a plan: the mask is read first, then any commands are issued, then the mask computed from that
+// read is written. Setting a command replaces the options in the WindowServer, so the mask is always
+// written after commands, even if none of the flags changed; otherwise it is only written if it differs.
+//
+// If retries is greater than 0, the mask is read again before the write and, if another process changed
+// it since the value our target was computed from, the target is recomputed from the new value, up to
+// retries times. Without commands this read is immediately before the write; with commands it comes just
+// before them, since once they are issued the options no longer reflect anyone's flags. *verified is set
+// when the last such read matched, so nothing else wrote the options between it and our write.
+//
+// Nothing is written if the mask can't be read, since the target would clobber every flag already set.
+// Returns kCGErrorSuccess or the first error which stopped the mask being applied; *mask is the final mask.
+static inline CGError cgsdebug_applyPlan(const cgsdebug_backend *backend, const cgsdebug_plan *plan, int retries, uint32_t *mask, bool *verified) {
+    *verified = false ;
+
+    CGSDebugOption current = kCGSDebugOptionNone ;
+    CGError        err     = HSASM_SPI_ERROR("CGSGetDebugOptions", backend->getDebugOptions(&current)) ;
+    *mask = (uint32_t)current ;
+    if (err != kCGErrorSuccess) return err ;
+
+    uint32_t base   = (uint32_t)current ;
+    uint32_t target = cgsdebug_plan_target(plan, base) ;
+    for (int attempt = 0 ; attempt < retries ; attempt++) {
+        err = HSASM_SPI_ERROR("CGSGetDebugOptions", backend->getDebugOptions(&current)) ;
+        if (err != kCGErrorSuccess) return err ;
+        if ((uint32_t)current == base) {
+            *verified = true ;
+            break ;
+        }
+        base   = (uint32_t)current ;
+        target = cgsdebug_plan_target(plan, base) ;
+        *mask  = base ;
+    }
+
+    for (size_t i = 0 ; i < plan->commandCount ; i++) (void)HSASM_SPI_ERROR("CGSSetDebugOptions", backend->setDebugOptions((CGSDebugOption)plan->commands[i])) ;
+
+    if (target != base || plan->commandCount > 0) {
+        err = HSASM_SPI_ERROR("CGSSetDebugOptions", backend->setDebugOptions((CGSDebugOption)target)) ;
+        if (err != kCGErrorSuccess) {
+            *verified = false ;
+            return err ;
+        }
+    }
+    *mask = target ;
+    return kCGErrorSuccess ;
+}
+
+#ifdef __OBJC__
+
+#import <LuaSkin/LuaSkin.h>
+
+// The dumpFile and tailer submodules are built as separate libraries, so they can't see the backend and lane in
+// internal.m. internal.m publishes this table in the Lua registry instead, and they issue their commands through it
+// so the commands go through the same backend (real or mock) and are ordered with everything else on the lane.
+#define CGSDEBUG_SERVICE_KEY "hs._asm.undocumented.cgsdebug.service"
+
+typedef struct {
+    // waits for the lane and applies the plan on the calling thread, returning as cgsdebug_applyPlan does
+    CGError (*applyPlan)(const cgsdebug_plan *plan, uint32_t *mask) ;
+    // queues the plan on the lane and calls completion on the main thread with the result, on a turn of the run loop
+    // of its own rather than inside a barrier; returns NO if the lane is full, in which case completion is never called
+    BOOL    (*queuePlan)(const cgsdebug_plan *plan, void (^completion)(CGError err, uint32_t mask)) ;
+} cgsdebug_service ;
+
+// returns the service published by internal.m, loading it first if necessary; raises a Lua error if it can't be loaded
+static inline const cgsdebug_service *cgsdebug_serviceForState(lua_State *L) {
+    if (lua_getfield(L, LUA_REGISTRYINDEX, CGSDEBUG_SERVICE_KEY) != LUA_TLIGHTUSERDATA) {
+        lua_pop(L, 1) ;
+        lua_getglobal(L, "require") ;
+        lua_pushstring(L, "hs._asm.undocumented.cgsdebug.internal") ;
+        lua_call(L, 1, 0) ;
+        if (lua_getfield(L, LUA_REGISTRYINDEX, CGSDEBUG_SERVICE_KEY) != LUA_TLIGHTUSERDATA) {
+            luaL_error(L, "hs._asm.undocumented.cgsdebug.internal did not provide its service table") ;
+        }
+    }
+    const cgsdebug_service *service = lua_touserdata(L, -1) ;
+    lua_pop(L, 1) ;
+    return service ;
+}
+
+#endif
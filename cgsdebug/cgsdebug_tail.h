@@ -0,0 +1,311 @@
+//
+// cgsdebug_tail.h
+// The byte ring, line framing and file following behind hs._asm.undocumented.cgsdebug.tailer
+//
+// The verbose logging options write to /tmp/CGLog_* files which can grow by thousands of lines a second.
+// A tailer follows one of these files from a saved offset: new data is read straight into a fixed size
+// byte ring and each complete line is recorded as a (start, length) descriptor in a second, bounded ring.
+// Lines are only copied once, when they are handed to the consumer. If the consumer falls behind, the
+// oldest undelivered lines are dropped (and counted) so memory use never grows beyond the size of the rings.
+//
+// None of this knows how the tailer learns that the file changed; tailer.m drives it from dispatch sources
+// and cgsdebug_tailWatch.h from inotify or polling, which is how it's tested and timed on Linux (see
+// test/test_cgsdebug_tail.c and bench/bench_cgsdebug_tail.c).
+
+#pragma once
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the smallest read worth making room for by dropping pending lines
+#define TAIL_MIN_READ (16 * 1024)
+
+typedef struct {
+    uint64_t start ;   // absolute position of the first byte of the line within the byte ring
+    uint64_t fileEnd ; // file offset just past the line's newline
+    uint32_t length ;  // length of the line, not including the newline
+} tail_line ;
+
+// Positions in the byte ring only ever grow; the index into bytes is the position modulo capacity. The
+// ring functions don't lock anything: the reader and the consumer each take the caller's lock around them.
+typedef struct {
+    char      *bytes ;
+    size_t    capacity ;
+    uint64_t  head ;            // bytes written into the byte ring
+    uint64_t  tail ;            // bytes no longer needed by any pending line
+    uint64_t  scanned ;         // bytes searched for newlines
+    uint64_t  lineStart ;       // start of the line currently being read
+    bool      discardingLine ;  // the current line didn't fit in the byte ring
+
+    tail_line *lines ;
+    size_t    maxLines ;
+    uint64_t  lineHead ;
+    uint64_t  lineTail ;
+
+    uint64_t  fileOffset ;      // file offset corresponding to head
+    uint64_t  deliveredOffset ; // file offset just past the last line consumed
+
+    uint64_t  bytesRead ;
+    uint64_t  linesRead ;
+    uint64_t  linesDelivered ;
+    uint64_t  linesDropped ;
+} tail_ring ;
+
+static inline bool tail_ring_init(tail_ring *ring, size_t bufferSize, size_t maxLines) {
+    memset(ring, 0, sizeof(tail_ring)) ;
+    ring->capacity = bufferSize ;
+    ring->maxLines = maxLines ;
+    ring->bytes    = malloc(bufferSize) ;
+    ring->lines    = calloc(maxLines, sizeof(tail_line)) ;
+    if (ring->bytes && ring->lines) return true ;
+    free(ring->bytes) ;
+    free(ring->lines) ;
+    ring->bytes = NULL ;
+    ring->lines = NULL ;
+    return false ;
+}
+
+static inline void tail_ring_free(tail_ring *ring) {
+    free(ring->bytes) ;
+    free(ring->lines) ;
+    ring->bytes = NULL ;
+    ring->lines = NULL ;
+}
+
+static inline size_t tail_ring_pending(const tail_ring *ring) {
+    return (size_t)(ring->lineHead - ring->lineTail) ;
+}
+
+static inline void tail_ring_updateTail(tail_ring *ring) {
+    ring->tail = (ring->lineTail < ring->lineHead) ? ring->lines[ring->lineTail % ring->maxLines].start : ring->lineStart ;
+}
+
+// starts reading at offset, discarding the partial line being read, if any; complete lines waiting to be
+// consumed are kept
+static inline void tail_ring_reset(tail_ring *ring, uint64_t offset) {
+    ring->fileOffset      = offset ;
+    ring->deliveredOffset = (ring->lineTail < ring->lineHead) ? ring->deliveredOffset : offset ;
+    ring->scanned         = ring->head ;
+    ring->lineStart       = ring->head ;
+    ring->discardingLine  = false ;
+    tail_ring_updateTail(ring) ;
+}
+
+// drops the oldest pending lines until a reasonably sized read will fit; if the line currently being read
+// fills the whole ring by itself, it's discarded up to its newline
+static inline void tail_ring_makeRoom(tail_ring *ring) {
+    size_t wanted = (ring->capacity / 4 < TAIL_MIN_READ) ? ring->capacity / 4 : TAIL_MIN_READ ;
+    while ((ring->capacity - (size_t)(ring->head - ring->tail)) < wanted && ring->lineTail < ring->lineHead) {
+        ring->lineTail++ ;
+        ring->linesDropped++ ;
+        tail_ring_updateTail(ring) ;
+    }
+    if (ring->head - ring->tail == ring->capacity) {
+        if (!ring->discardingLine) ring->linesDropped++ ;
+        ring->discardingLine = true ;
+        ring->lineStart      = ring->head ;
+        ring->scanned        = ring->head ;
+        tail_ring_updateTail(ring) ;
+    }
+}
+
+// makes room and returns the largest contiguous free span at the head of the ring, storing where it starts
+// in *index. The free span is only ever touched by the reader, so it can be filled without the lock.
+static inline size_t tail_ring_reserve(tail_ring *ring, size_t *index) {
+    tail_ring_makeRoom(ring) ;
+    *index = (size_t)(ring->head % ring->capacity) ;
+    size_t free = ring->capacity - (size_t)(ring->head - ring->tail) ;
+    size_t span = ring->capacity - *index ;
+    return (free < span) ? free : span ;
+}
+
+// records the complete lines in the bytes between scanned and head
+static inline void tail_ring_frame(tail_ring *ring) {
+    while (ring->scanned < ring->head) {
+        size_t     index  = (size_t)(ring->scanned % ring->capacity) ;
+        size_t     span   = (size_t)(ring->head - ring->scanned) ;
+        if (span > ring->capacity - index) span = ring->capacity - index ;
+        const char *found = memchr(ring->bytes + index, '\n', span) ;
+        if (!found) {
+            ring->scanned += span ;
+            continue ;
+        }
+        uint64_t newline = ring->scanned + (uint64_t)(found - (ring->bytes + index)) ;
+        if (ring->discardingLine) {
+            ring->discardingLine = false ;
+        } else {
+            if (ring->lineHead - ring->lineTail == ring->maxLines) {
+                ring->lineTail++ ;
+                ring->linesDropped++ ;
+            }
+            ring->lines[ring->lineHead % ring->maxLines] = (tail_line){
+                .start   = ring->lineStart,
+                .fileEnd = ring->fileOffset - (ring->head - newline - 1),
+                .length  = (uint32_t)(newline - ring->lineStart)
+            } ;
+            ring->lineHead++ ;
+            ring->linesRead++ ;
+        }
+        ring->scanned   = newline + 1 ;
+        ring->lineStart = ring->scanned ;
+    }
+    tail_ring_updateTail(ring) ;
+}
+
+// accounts for count bytes read into the span returned by tail_ring_reserve and frames any new lines
+static inline void tail_ring_commit(tail_ring *ring, size_t count) {
+    ring->head       += count ;
+    ring->fileOffset += count ;
+    ring->bytesRead  += count ;
+    tail_ring_frame(ring) ;
+}
+
+// the i'th pending line, oldest first
+static inline tail_line tail_ring_line(const tail_ring *ring, size_t i) {
+    return ring->lines[(ring->lineTail + i) % ring->maxLines] ;
+}
+
+// the bytes of a pending line; a line which wraps around the end of the ring comes in two parts, the second
+// of which always starts at ring->bytes. Returns the length of the first part.
+static inline size_t tail_ring_lineBytes(const tail_ring *ring, tail_line line, const char **first) {
+    size_t index = (size_t)(line.start % ring->capacity) ;
+    *first = ring->bytes + index ;
+    return (index + line.length <= ring->capacity) ? line.length : ring->capacity - index ;
+}
+
+// releases the oldest count pending lines once they have been handed to the consumer
+static inline void tail_ring_consume(tail_ring *ring, size_t count) {
+    if (count == 0) return ;
+    ring->deliveredOffset = tail_ring_line(ring, count - 1).fileEnd ;
+    ring->lineTail       += count ;
+    ring->linesDelivered += count ;
+    tail_ring_updateTail(ring) ;
+}
+
+// Follows a file by path into a ring, reopening it when it's replaced and starting again when it's truncated.
+// The reader owns the file descriptor; the lock hooks, if set, are held around every change to the ring so the
+// consumer can take lines from another thread.
+typedef struct {
+    const char *path ;
+    int        fd ;
+    int64_t    startOffset ; // where to start when the file is next opened; -1 for the end of the file
+    uint64_t   truncations ;
+    uint64_t   rotations ;
+    tail_ring  *ring ;
+    void       (*lock)(void *context) ;
+    void       (*unlock)(void *context) ;
+    void       *lockContext ;
+} tail_file ;
+
+static inline void tail_file_lock(tail_file *file) {
+    if (file->lock) file->lock(file->lockContext) ;
+}
+
+static inline void tail_file_unlock(tail_file *file) {
+    if (file->unlock) file->unlock(file->lockContext) ;
+}
+
+static inline void tail_file_init(tail_file *file, const char *path, int64_t startOffset, tail_ring *ring) {
+    *file = (tail_file){ .path = path, .fd = -1, .startOffset = startOffset, .ring = ring } ;
+}
+
+// opens the file; the first time, the offset is the one requested, after a rotation it's the beginning
+static inline bool tail_file_open(tail_file *file) {
+    file->fd = open(file->path, O_RDONLY | O_CLOEXEC) ;
+    if (file->fd < 0) return false ;
+
+    uint64_t offset = 0 ;
+    if (file->startOffset < 0) {
+        struct stat info ;
+        if (fstat(file->fd, &info) == 0) offset = (uint64_t)info.st_size ;
+    } else {
+        offset = (uint64_t)file->startOffset ;
+    }
+    file->startOffset = 0 ;
+    tail_file_lock(file) ;
+    tail_ring_reset(file->ring, offset) ;
+    tail_file_unlock(file) ;
+    return true ;
+}
+
+static inline void tail_file_close(tail_file *file) {
+    if (file->fd >= 0) close(file->fd) ;
+    file->fd = -1 ;
+}
+
+// closes the file, remembering the position so reading continues from there when it's opened again
+static inline void tail_file_suspend(tail_file *file) {
+    if (file->fd < 0) return ;
+    file->startOffset = (int64_t)file->ring->fileOffset ;
+    tail_file_close(file) ;
+}
+
+// reads everything available into the ring
+static inline void tail_file_read(tail_file *file) {
+    bool more = (file->fd >= 0) ;
+    while (more) {
+        size_t index ;
+        tail_file_lock(file) ;
+        size_t   span   = tail_ring_reserve(file->ring, &index) ;
+        uint64_t offset = file->ring->fileOffset ;
+        tail_file_unlock(file) ;
+        if (span == 0) break ;
+
+        ssize_t count = pread(file->fd, file->ring->bytes + index, span, (off_t)offset) ;
+        if (count <= 0) break ;
+
+        tail_file_lock(file) ;
+        tail_ring_commit(file->ring, (size_t)count) ;
+        tail_file_unlock(file) ;
+        more = ((size_t)count == span) ;
+    }
+}
+
+typedef enum {
+    kTailFileMissing = 0, // there's no file to read; only polling will notice it appearing
+    kTailFileOpened,      // the file was opened, or reopened after being replaced, so a new descriptor is in use
+    kTailFileRead,        // the same file was read again
+} tail_fileEvent ;
+
+// Called whenever the file may have changed: opens it if necessary, notices if it was replaced or truncated,
+// and reads whatever is new. Anything written to a file before it was replaced still gets read, and a file
+// which appears after the tailer found it missing is read from its beginning.
+static inline tail_fileEvent tail_file_check(tail_file *file) {
+    tail_fileEvent event = kTailFileRead ;
+    if (file->fd < 0) {
+        if (!tail_file_open(file)) {
+            if (file->startOffset < 0) file->startOffset = 0 ;
+            return kTailFileMissing ;
+        }
+        event = kTailFileOpened ;
+    }
+
+    struct stat current, named ;
+    bool replaced = (fstat(file->fd, &current) != 0) || (stat(file->path, &named) != 0) ||
+                    (current.st_ino != named.st_ino) || (current.st_dev != named.st_dev) ;
+    if (replaced) {
+        tail_file_read(file) ;
+        tail_file_close(file) ;
+        tail_file_lock(file) ;
+        file->rotations++ ;
+        tail_file_unlock(file) ;
+        if (!tail_file_open(file)) return kTailFileMissing ;
+        tail_file_read(file) ;
+        return kTailFileOpened ;
+    }
+
+    if ((uint64_t)current.st_size < file->ring->fileOffset) {
+        tail_file_lock(file) ;
+        file->truncations++ ;
+        tail_ring_reset(file->ring, 0) ;
+        tail_file_unlock(file) ;
+    }
+    tail_file_read(file) ;
+    return event ;
+}
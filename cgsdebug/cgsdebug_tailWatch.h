@@ -0,0 +1,104 @@
+//
+// cgsdebug_tailWatch.h
+// Waiting for a followed file to change without dispatch sources
+//
+// tailer.m learns about changes from a kqueue vnode source or a timer. Where those aren't available this
+// does the same job for a tail_file (see cgsdebug_tail.h): on Linux the file's directory is watched with
+// inotify, which reports writes, truncation and the file being created, deleted or renamed without needing
+// the file to exist; elsewhere, or if inotify can't be used, it falls back to checking on a fixed interval
+// like the tailer's "poll" notifier.
+
+#pragma once
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+typedef struct {
+    const char *name ;       // "inotify" or "poll"
+    int        fd ;          // the inotify descriptor, or -1 when polling
+    int        intervalMs ;  // how often to check when polling
+    char       file[NAME_MAX + 1] ;
+} tail_watch ;
+
+// watches path, using inotify if useInotify is set and it's available
+static inline void tail_watch_open(tail_watch *watch, const char *path, int intervalMs, bool useInotify) {
+    watch->name       = "poll" ;
+    watch->fd         = -1 ;
+    watch->intervalMs = intervalMs ;
+
+    const char *slash = strrchr(path, '/') ;
+    const char *base  = slash ? slash + 1 : path ;
+    strncpy(watch->file, base, sizeof(watch->file) - 1) ;
+    watch->file[sizeof(watch->file) - 1] = 0 ;
+
+#ifdef __linux__
+    if (!useInotify) return ;
+    char directory[PATH_MAX] = "." ;
+    if (slash) {
+        size_t length = (size_t)(slash - path) ;
+        if (length == 0) {
+            strcpy(directory, "/") ;
+        } else if (length < sizeof(directory)) {
+            memcpy(directory, path, length) ;
+            directory[length] = 0 ;
+        }
+    }
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC) ;
+    if (fd < 0) return ;
+    if (inotify_add_watch(fd, directory, IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                                         IN_MOVED_FROM | IN_MOVED_TO) < 0) {
+        close(fd) ;
+        return ;
+    }
+    watch->fd   = fd ;
+    watch->name = "inotify" ;
+#else
+    (void)useInotify ;
+#endif
+}
+
+static inline void tail_watch_close(tail_watch *watch) {
+    if (watch->fd >= 0) close(watch->fd) ;
+    watch->fd = -1 ;
+}
+
+// Waits up to timeoutMs for the file to change. Returns true if it may have, in which case the caller should
+// call tail_file_check; events for other files in the same directory are skipped. When polling, this sleeps
+// for the polling interval (or the timeout, if shorter) and always returns true.
+static inline bool tail_watch_wait(tail_watch *watch, int timeoutMs) {
+    if (watch->fd < 0) {
+        int sleepMs = (timeoutMs < watch->intervalMs) ? timeoutMs : watch->intervalMs ;
+        struct timespec delay = { sleepMs / 1000, (long)(sleepMs % 1000) * 1000000L } ;
+        while (nanosleep(&delay, &delay) != 0 && errno == EINTR) ;
+        return true ;
+    }
+
+#ifdef __linux__
+    struct pollfd ready = { .fd = watch->fd, .events = POLLIN } ;
+    if (poll(&ready, 1, timeoutMs) <= 0) return false ;
+
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event)))) ;
+    bool changed = false ;
+    ssize_t count ;
+    while ((count = read(watch->fd, buffer, sizeof(buffer))) > 0) {
+        for (char *p = buffer ; p < buffer + count ; ) {
+            const struct inotify_event *event = (const struct inotify_event *)p ;
+            if (event->mask & IN_Q_OVERFLOW) changed = true ;
+            if (event->len && strcmp(event->name, watch->file) == 0) changed = true ;
+            p += sizeof(struct inotify_event) + event->len ;
+        }
+    }
+    return changed ;
+#else
+    return true ;
+#endif
+}
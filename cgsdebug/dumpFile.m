@@ -0,0 +1,733 @@
+@import Cocoa ;
+@import LuaSkin ;
+#import "cgsdebug.h"
+#import "cgsdebug_dump.h"
+#import "cgsdebug_plan.h"
+
+#include <sys/clonefile.h>
+
+static const char * const USERDATA_TAG = "hs._asm.undocumented.cgsdebug.dumpFile" ;
+static LSRefTable refTable = LUA_NOREF;
+
+#define get_objectFromUserdata(objType, L, idx, tag) (objType*)*((void**)luaL_checkudata(L, idx, tag))
+
+#define DUMP_WINDOWLIST_PATH        "/tmp/WindowServer.winfo.out"
+#define DUMP_SNAPSHOT_TIMEOUT       2.0
+#define DUMP_SNAPSHOT_POLL_INTERVAL 0.01
+
+#pragma mark - Support Functions and Classes
+
+@interface HSASMCGSDumpFile : NSObject
+@property            int            selfRefCount ;
+@property (readonly) NSString       *path ;
+@property (readonly) NSData         *data ;
+@property (readonly) NSTimeInterval indexTime ;
+@property (readonly) BOOL           windowsIndexed ;
+@property (readonly) NSUInteger     windowCount ;
+@property (readonly) const dump_windows *windows ;
+@end
+
+// The WindowServer rewrites its dump files in place each time a dump is requested, so mapping one directly would let
+// the next dump change the entries underneath the index, or raise SIGBUS if the file shrinks. Instead the file is
+// cloned to a private path which is unlinked as soon as it's mapped, leaving the mapping as the only reference to it;
+// a clone shares the original's blocks until one of them is written, so this is cheap even for large dumps. If the
+// file can't be cloned (e.g. it's on a volume which doesn't support clones), it is read into memory instead.
+static NSData *dump_readPrivateCopy(NSString *path, NSError **error) {
+    NSString *name     = [NSString stringWithFormat:@"hs._asm.undocumented.cgsdebug.dump.%@", [NSUUID UUID].UUIDString] ;
+    NSString *copyPath = [NSTemporaryDirectory() stringByAppendingPathComponent:name] ;
+    if (clonefile(path.fileSystemRepresentation, copyPath.fileSystemRepresentation, 0) == 0) {
+        NSData *data = [NSData dataWithContentsOfFile:copyPath options:NSDataReadingMappedAlways error:nil] ;
+        unlink(copyPath.fileSystemRepresentation) ;
+        if (data) return data ;
+    }
+    return [NSData dataWithContentsOfFile:path options:NSDataReadingUncached error:error] ;
+}
+
+@implementation HSASMCGSDumpFile {
+    dump_index   _index ;
+    dump_windows _windows ;
+}
+
+- (instancetype)initWithPath:(NSString *)path error:(NSError **)error {
+    self = [super init] ;
+    if (self) {
+        _selfRefCount = 0 ;
+        _path         = path ;
+        _data         = dump_readPrivateCopy(path, error) ;
+        if (!_data) return nil ;
+        if (_data.length > UINT32_MAX) {
+            if (error) *error = [NSError errorWithDomain:NSPOSIXErrorDomain
+                                                    code:EFBIG
+                                                userInfo:@{ NSLocalizedDescriptionKey : @"dump file is larger than 4GB" }] ;
+            return nil ;
+        }
+        NSTimeInterval startTime = [NSProcessInfo processInfo].systemUptime ;
+        BOOL           indexed   = dump_index_build(&_index, _data.bytes, _data.length) ;
+        _indexTime = [NSProcessInfo processInfo].systemUptime - startTime ;
+        if (!indexed) {
+            if (error) *error = [NSError errorWithDomain:NSPOSIXErrorDomain
+                                                    code:ENOMEM
+                                                userInfo:@{ NSLocalizedDescriptionKey : @"unable to index dump file" }] ;
+            return nil ;
+        }
+    }
+    return self ;
+}
+
+- (void)dealloc {
+    dump_windows_free(&_windows) ;
+    dump_index_free(&_index) ;
+}
+
+- (NSUInteger)count {
+    return _index.count ;
+}
+
+- (dump_record)recordAtIndex:(NSUInteger)idx {
+    return _index.records[idx] ;
+}
+
+- (const char *)bytesForRecord:(dump_record)record {
+    return (const char *)_data.bytes + record.offset ;
+}
+
+// builds the window index the first time it's needed; returns NO if memory runs out
+- (BOOL)indexWindows {
+    if (!_windowsIndexed) _windowsIndexed = dump_windows_build(&_windows, _data.bytes, &_index) ;
+    return _windowsIndexed ;
+}
+
+- (const dump_windows *)windows {
+    return &_windows ;
+}
+
+- (NSUInteger)windowCount {
+    return _windows.count ;
+}
+
+- (const dump_windowSlot *)slotForWindowID:(uint64_t)windowID {
+    return [self indexWindows] ? dump_windows_find(&_windows, windowID) : NULL ;
+}
+
+@end
+
+// pushes an integer or number if the whole value is decimal or 0x prefixed hex (see dump_parseValue), otherwise the string
+static void dump_pushValue(lua_State *L, const char *start, size_t length) {
+    long long integer ;
+    double    number ;
+    switch(dump_parseValue(start, length, &integer, &number)) {
+        case kDumpValueInteger: lua_pushinteger(L, (lua_Integer)integer) ; break ;
+        case kDumpValueNumber:  lua_pushnumber(L, number) ;                break ;
+        case kDumpValueString:  lua_pushlstring(L, start, length) ;        break ;
+    }
+}
+
+// parses a single record into a table with the keys header, fields, lines, and offset
+static void dump_pushRecord(lua_State *L, HSASMCGSDumpFile *dump, NSUInteger idx) {
+    dump_record record = [dump recordAtIndex:idx] ;
+    dump_cursor cursor = dump_cursor_make([dump bytesForRecord:record], record.length) ;
+    dump_line   line ;
+    lua_Integer extra  = 0 ;
+
+    lua_newtable(L) ;
+    lua_newtable(L) ; // fields
+    lua_newtable(L) ; // lines
+
+    while (dump_cursor_next(&cursor, &line)) {
+        switch(line.kind) {
+            case kDumpLineHeader:
+                lua_pushlstring(L, line.value, line.valueLength) ; lua_setfield(L, -4, "header") ;
+                break ;
+            case kDumpLineField:
+                lua_pushlstring(L, line.key, line.keyLength) ;
+                dump_pushValue(L, line.value, line.valueLength) ;
+                lua_rawset(L, -4) ;
+                break ;
+            case kDumpLineText:
+                lua_pushlstring(L, line.value, line.valueLength) ;
+                lua_rawseti(L, -2, ++extra) ;
+                break ;
+        }
+    }
+
+    lua_setfield(L, -3, "lines") ;
+    lua_setfield(L, -2, "fields") ;
+    lua_pushinteger(L, record.offset) ; lua_setfield(L, -2, "offset") ;
+}
+
+#pragma mark - Module Functions
+
+/// hs._asm.undocumented.cgsdebug.dumpFile.open(path) -> dumpFileObject | nil, errorMessage
+/// Constructor
+/// Opens a file created by one of the CGSDebug dump options and indexes the entries it contains.
+///
+/// Parameters:
+///  * path - the path to the dump file, e.g. one of the values in [hs._asm.undocumented.cgsdebug.dumpFile.paths](#paths)
+///
+/// Returns:
+///  * a dumpFileObject, or nil and an error message if the file could not be opened
+///
+/// Notes:
+///  * the file is copied (with a copy-on-write clone where possible) and the copy is memory mapped, so later dumps to the same path don't affect an open dumpFileObject. The copy is scanned once to locate the start of each entry; entries are not converted into Lua tables until they are requested with [hs._asm.undocumented.cgsdebug.dumpFile:record](#record) or [hs._asm.undocumented.cgsdebug.dumpFile:records](#records), so even very large dumps use very little memory within Lua.
+///  * an entry begins with a line that is not indented and includes all of the indented lines which follow it; a blank line also ends an entry.
+static int dump_open(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TSTRING, LS_TBREAK] ;
+
+    NSString *path  = [[skin toNSObjectAtIndex:1] stringByExpandingTildeInPath] ;
+    NSError  *error = nil ;
+    HSASMCGSDumpFile *dump = [[HSASMCGSDumpFile alloc] initWithPath:path error:&error] ;
+    if (dump) {
+        [skin pushNSObject:dump] ;
+        return 1 ;
+    } else {
+        lua_pushnil(L) ;
+        [skin pushNSObject:(error ? error.localizedDescription : @"unable to open dump file")] ;
+        return 2 ;
+    }
+}
+
+// returns the modification time of the file at path, or 0 if it doesn't exist
+static NSTimeInterval dump_modificationTime(const char *path, off_t *size) {
+    struct stat info ;
+    if (stat(path, &info) != 0) {
+        *size = -1 ;
+        return 0 ;
+    }
+    *size = info.st_size ;
+    return (NSTimeInterval)info.st_mtimespec.tv_sec + (NSTimeInterval)info.st_mtimespec.tv_nsec / 1e9 ;
+}
+
+// the WindowServer writes the dump asynchronously; it is considered complete once it has been replaced and
+// its size has stopped changing between two polls
+@interface HSASMCGSDumpSnapshot : NSObject
+@property (readonly) NSTimeInterval previousModification ;
+@property (readonly) NSDate         *deadline ;
+@property            off_t          lastSize ;
+@property            int            callbackRef ;
+@property            NSTimer        *timer ;
+@end
+
+@implementation HSASMCGSDumpSnapshot
+
+- (instancetype)initWithTimeout:(NSTimeInterval)timeout {
+    self = [super init] ;
+    if (self) {
+        off_t size ;
+        _previousModification = dump_modificationTime(DUMP_WINDOWLIST_PATH, &size) ;
+        _deadline             = [NSDate dateWithTimeIntervalSinceNow:timeout] ;
+        _lastSize             = -1 ;
+        _callbackRef          = LUA_NOREF ;
+        _timer                = nil ;
+    }
+    return self ;
+}
+
+// returns YES once the dump is complete
+- (BOOL)checkDump {
+    off_t          size ;
+    NSTimeInterval modified = dump_modificationTime(DUMP_WINDOWLIST_PATH, &size) ;
+    if (size < 0 || modified <= _previousModification) return NO ;
+    BOOL stable = (size == _lastSize) ;
+    _lastSize = size ;
+    return stable ;
+}
+
+- (BOOL)timedOut {
+    return [_deadline timeIntervalSinceNow] <= 0 ;
+}
+
+@end
+
+static NSMutableSet *pendingSnapshots ;
+
+// pushes the dumpFileObject and nil, or nil and an error message
+static void dump_pushSnapshotResult(lua_State *L, BOOL complete) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    if (!complete) {
+        lua_pushnil(L) ;
+        lua_pushstring(L, "timed out waiting for the WindowServer to write the window list") ;
+        return ;
+    }
+    NSError          *error = nil ;
+    HSASMCGSDumpFile *dump  = [[HSASMCGSDumpFile alloc] initWithPath:@(DUMP_WINDOWLIST_PATH) error:&error] ;
+    if (dump) {
+        [skin pushNSObject:dump] ;
+        lua_pushnil(L) ;
+    } else {
+        lua_pushnil(L) ;
+        [skin pushNSObject:(error ? error.localizedDescription : @"unable to open dump file")] ;
+    }
+}
+
+static void dump_pushRequestError(lua_State *L, CGError err) {
+    lua_pushnil(L) ;
+    lua_pushfstring(L, "unable to request the window list dump (CGError %d)", (int)err) ;
+}
+
+// invokes the snapshot's callback with its result and forgets the snapshot; an err other than kCGErrorSuccess
+// means the dump was never requested
+static void dump_finishSnapshot(HSASMCGSDumpSnapshot *snapshot, CGError err, BOOL complete) {
+    [snapshot.timer invalidate] ;
+    snapshot.timer = nil ;
+    if (![pendingSnapshots containsObject:snapshot]) return ; // the module was unloaded while it was waiting
+
+    LuaSkin   *skin = [LuaSkin sharedWithState:NULL] ;
+    lua_State *L    = skin.L ;
+    _lua_stackguard_entry(L) ;
+    [skin pushLuaRef:refTable ref:snapshot.callbackRef] ;
+    if (err != kCGErrorSuccess) {
+        dump_pushRequestError(L, err) ;
+    } else {
+        dump_pushSnapshotResult(L, complete) ;
+    }
+    [skin protectedCallAndError:@"hs._asm.undocumented.cgsdebug.dumpFile.snapshot callback" nargs:2 nresults:0] ;
+    snapshot.callbackRef = [skin luaUnref:refTable ref:snapshot.callbackRef] ;
+    _lua_stackguard_exit(L) ;
+    [pendingSnapshots removeObject:snapshot] ;
+}
+
+/// hs._asm.undocumented.cgsdebug.dumpFile.snapshot([timeout], [fn]) -> dumpFileObject | nil, errorMessage
+/// Constructor
+/// Asks the WindowServer to dump its window list and opens the resulting file once it has been written.
+///
+/// Parameters:
+///  * timeout - an optional number, default 2.0, specifying the maximum number of seconds to wait for the dump to be written.
+///  * fn      - an optional callback function. If provided, this function returns immediately and `fn` is invoked with the dumpFileObject, or nil and an error message, once the dump is complete.
+///
+/// Returns:
+///  * if `fn` is not provided, a dumpFileObject, or nil and an error message if the dump could not be obtained; otherwise a boolean indicating whether the request was queued (true) or refused because too many changes to the debug options are already waiting (false)
+///
+/// Notes:
+///  * this triggers the `dumpWindowListToFile` debug option and waits for `/tmp/WindowServer.winfo.out` to be replaced and stop growing. The option is set through `hs._asm.undocumented.cgsdebug`, so it is issued after any changes queued with [hs._asm.undocumented.cgsdebug.setMask](#setMask) and the debug options are restored afterwards.
+///  * this function is also available as `hs._asm.undocumented.cgsdebug.snapshot`.
+static int dump_snapshot(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TNUMBER | LS_TFUNCTION | LS_TOPTIONAL, LS_TFUNCTION | LS_TOPTIONAL, LS_TBREAK] ;
+
+    NSTimeInterval timeout = DUMP_SNAPSHOT_TIMEOUT ;
+    int            fnIdx   = 1 ;
+    if (lua_type(L, 1) == LUA_TNUMBER) {
+        timeout = lua_tonumber(L, 1) ;
+        fnIdx   = 2 ;
+    }
+
+    // the dump is requested through internal.m so it goes through the same backend and is ordered with any
+    // changes to the debug options still queued on its lane
+    const cgsdebug_service *service = cgsdebug_serviceForState(L) ;
+    cgsdebug_plan          plan     = { 0 } ;
+    cgsdebug_plan_add(&plan, (uint32_t)kCGSDebugOptionDumpWindowListToFile, true) ;
+
+    HSASMCGSDumpSnapshot *snapshot = [[HSASMCGSDumpSnapshot alloc] initWithTimeout:timeout] ;
+
+    if (lua_type(L, fnIdx) == LUA_TFUNCTION) {
+        lua_pushvalue(L, fnIdx) ;
+        snapshot.callbackRef = [skin luaRef:refTable] ;
+        [pendingSnapshots addObject:snapshot] ;
+        BOOL queued = service->queuePlan(&plan, ^(CGError err, __unused uint32_t mask) {
+            if (err != kCGErrorSuccess || ![pendingSnapshots containsObject:snapshot]) {
+                dump_finishSnapshot(snapshot, err, NO) ;
+                return ;
+            }
+            snapshot.timer = [NSTimer scheduledTimerWithTimeInterval:DUMP_SNAPSHOT_POLL_INTERVAL repeats:YES block:^(__unused NSTimer *timer) {
+                BOOL complete = [snapshot checkDump] ;
+                if (complete || [snapshot timedOut]) dump_finishSnapshot(snapshot, kCGErrorSuccess, complete) ;
+            }] ;
+        }) ;
+        if (!queued) {
+            snapshot.callbackRef = [skin luaUnref:refTable ref:snapshot.callbackRef] ;
+            [pendingSnapshots removeObject:snapshot] ;
+        }
+        lua_pushboolean(L, queued) ;
+        return 1 ;
+    }
+
+    uint32_t mask = 0 ;
+    CGError  err  = service->applyPlan(&plan, &mask) ;
+    if (err != kCGErrorSuccess) {
+        dump_pushRequestError(L, err) ;
+        return 2 ;
+    }
+
+    BOOL complete = NO ;
+    while (!(complete = [snapshot checkDump]) && ![snapshot timedOut]) {
+        usleep((useconds_t)(DUMP_SNAPSHOT_POLL_INTERVAL * 1000000)) ;
+    }
+    dump_pushSnapshotResult(L, complete) ;
+    if (lua_isnil(L, -2)) return 2 ;
+    lua_pop(L, 1) ;
+    return 1 ;
+}
+
+// the stack positions of the added, removed, and changed tables, indexed by dump_change
+typedef struct {
+    lua_State *L ;
+    int       indexes[3] ;
+} dump_diffTables ;
+
+static void dump_appendWindowID(void *context, dump_change change, uint64_t windowID) {
+    dump_diffTables *tables = context ;
+    int             idx     = tables->indexes[change] ;
+    lua_pushinteger(tables->L, (lua_Integer)windowID) ;
+    lua_rawseti(tables->L, idx, luaL_len(tables->L, idx) + 1) ;
+}
+
+/// hs._asm.undocumented.cgsdebug.dumpFile.diff(before, after) -> table
+/// Function
+/// Compares two window list dumps and identifies the windows which have been added, removed, or changed.
+///
+/// Parameters:
+///  * before - a dumpFileObject for the earlier window list
+///  * after  - a dumpFileObject for the later window list
+///
+/// Returns:
+///  * a table containing the following keys, each of which is an array of window ids:
+///    * added   - windows which are in `after` but not in `before`
+///    * removed - windows which are in `before` but not in `after`
+///    * changed - windows which are in both, but whose entries differ
+///
+/// Notes:
+///  * the window id of an entry is taken from a `wid` field if one is present, otherwise from the first number in the entry's first line. Entries without a window id are ignored.
+///  * each dump builds an index of window ids and entry content hashes the first time it is compared, along with a tree of digests over those hashes, so no entries are parsed into Lua tables and only the parts of the two lists which differ are visited: the time taken follows the number of windows which differ rather than the number of windows. Use [hs._asm.undocumented.cgsdebug.dumpFile:recordForWindow](#recordForWindow) to examine the entries which differ.
+///  * this function is also available as `hs._asm.undocumented.cgsdebug.diff`.
+static int dump_diff(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TUSERDATA, USERDATA_TAG, LS_TBREAK] ;
+    HSASMCGSDumpFile *before = [skin toNSObjectAtIndex:1] ;
+    HSASMCGSDumpFile *after  = [skin toNSObjectAtIndex:2] ;
+
+    if (![before indexWindows] || ![after indexWindows]) return luaL_error(L, "unable to index the window lists") ;
+
+    lua_newtable(L) ;
+    dump_diffTables tables ;
+    tables.L = L ;
+    lua_newtable(L) ; tables.indexes[kDumpWindowAdded]   = lua_gettop(L) ;
+    lua_newtable(L) ; tables.indexes[kDumpWindowRemoved] = lua_gettop(L) ;
+    lua_newtable(L) ; tables.indexes[kDumpWindowChanged] = lua_gettop(L) ;
+
+    dump_windows_diff(before.windows, after.windows, dump_appendWindowID, &tables) ;
+
+    lua_setfield(L, -4, "changed") ;
+    lua_setfield(L, -3, "removed") ;
+    lua_setfield(L, -2, "added") ;
+    return 1 ;
+}
+
+#pragma mark - Module Methods
+
+/// hs._asm.undocumented.cgsdebug.dumpFile:count() -> integer
+/// Method
+/// Returns the number of entries in the dump file.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * the number of entries in the dump file
+///
+/// Notes:
+///  * the length operator (`#`) may also be used on a dumpFileObject
+static int dump_count(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TBREAK] ;
+    HSASMCGSDumpFile *dump = [skin toNSObjectAtIndex:1] ;
+
+    lua_pushinteger(L, (lua_Integer)dump.count) ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cgsdebug.dumpFile:record(index) -> table | nil
+/// Method
+/// Returns the specified entry from the dump file as a table.
+///
+/// Parameters:
+///  * index - the index of the entry, from 1 to [hs._asm.undocumented.cgsdebug.dumpFile:count](#count)
+///
+/// Returns:
+///  * a table containing the following keys, or nil if the index is out of range:
+///    * header - the first line of the entry with leading and trailing whitespace removed
+///    * fields - a table of the key-value pairs found on the remaining lines of the entry; values which are entirely numeric are converted to numbers
+///    * lines  - an array of the remaining lines which are not key-value pairs
+///    * offset - the byte offset of the entry within the file
+///
+/// Notes:
+///  * the entry is parsed each time this method is invoked; if you need to refer to it repeatedly, save the result.
+static int dump_record(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TNUMBER | LS_TINTEGER, LS_TBREAK] ;
+    HSASMCGSDumpFile *dump = [skin toNSObjectAtIndex:1] ;
+
+    lua_Integer idx = lua_tointeger(L, 2) ;
+    if (idx < 1 || idx > (lua_Integer)dump.count) {
+        lua_pushnil(L) ;
+    } else {
+        dump_pushRecord(L, dump, (NSUInteger)(idx - 1)) ;
+    }
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cgsdebug.dumpFile:raw(index) -> string | nil
+/// Method
+/// Returns the unparsed text of the specified entry from the dump file.
+///
+/// Parameters:
+///  * index - the index of the entry, from 1 to [hs._asm.undocumented.cgsdebug.dumpFile:count](#count)
+///
+/// Returns:
+///  * the text of the entry, or nil if the index is out of range
+static int dump_raw(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TNUMBER | LS_TINTEGER, LS_TBREAK] ;
+    HSASMCGSDumpFile *dump = [skin toNSObjectAtIndex:1] ;
+
+    lua_Integer idx = lua_tointeger(L, 2) ;
+    if (idx < 1 || idx > (lua_Integer)dump.count) {
+        lua_pushnil(L) ;
+    } else {
+        dump_record record = [dump recordAtIndex:(NSUInteger)(idx - 1)] ;
+        lua_pushlstring(L, [dump bytesForRecord:record], record.length) ;
+    }
+    return 1 ;
+}
+
+static int dump_recordsIterator(lua_State *L) {
+    HSASMCGSDumpFile *dump = get_objectFromUserdata(__bridge HSASMCGSDumpFile, L, lua_upvalueindex(1), USERDATA_TAG) ;
+    lua_Integer      idx   = lua_tointeger(L, lua_upvalueindex(2)) + 1 ;
+
+    if (idx > (lua_Integer)dump.count) return 0 ;
+
+    lua_pushinteger(L, idx) ;
+    lua_pushvalue(L, -1) ; lua_replace(L, lua_upvalueindex(2)) ;
+    dump_pushRecord(L, dump, (NSUInteger)(idx - 1)) ;
+    return 2 ;
+}
+
+/// hs._asm.undocumented.cgsdebug.dumpFile:records() -> iteratorFunction
+/// Method
+/// Returns an iterator function which can be used with `for ... in` to step through the entries of the dump file.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * an iterator function which returns the index and the parsed entry (see [hs._asm.undocumented.cgsdebug.dumpFile:record](#record)) each time it is called
+///
+/// Notes:
+///  * each entry is parsed only when the iterator reaches it, so breaking out of the loop early avoids parsing the rest of the file.
+static int dump_records(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TBREAK] ;
+
+    lua_pushvalue(L, 1) ;
+    lua_pushinteger(L, 0) ;
+    lua_pushcclosure(L, dump_recordsIterator, 2) ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cgsdebug.dumpFile:recordForWindow(id) -> table | nil
+/// Method
+/// Returns the entry for the specified window from a window list dump.
+///
+/// Parameters:
+///  * id - the window id
+///
+/// Returns:
+///  * the parsed entry, as described in [hs._asm.undocumented.cgsdebug.dumpFile:record](#record), with an additional `index` key, or nil if the window is not in the dump
+static int dump_recordForWindow(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TNUMBER | LS_TINTEGER, LS_TBREAK] ;
+    HSASMCGSDumpFile *dump = [skin toNSObjectAtIndex:1] ;
+
+    const dump_windowSlot *slot = [dump slotForWindowID:(uint64_t)lua_tointeger(L, 2)] ;
+    if (slot) {
+        dump_pushRecord(L, dump, slot->record) ;
+        lua_pushinteger(L, slot->record + 1) ; lua_setfield(L, -2, "index") ;
+    } else {
+        lua_pushnil(L) ;
+    }
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cgsdebug.dumpFile:info() -> table
+/// Method
+/// Returns information about the dump file.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * a table containing the following keys:
+///    * path      - the path of the dump file
+///    * size      - the size of the file in bytes
+///    * count     - the number of entries in the file
+///    * indexTime - the number of seconds it took to locate the entries in the file when it was opened
+///    * windows   - the number of distinct window ids found in the file; this is only present once the file has been used with [hs._asm.undocumented.cgsdebug.dumpFile.diff](#diff) or [hs._asm.undocumented.cgsdebug.dumpFile:recordForWindow](#recordForWindow)
+static int dump_info(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TBREAK] ;
+    HSASMCGSDumpFile *dump = [skin toNSObjectAtIndex:1] ;
+
+    lua_newtable(L) ;
+    [skin pushNSObject:dump.path] ;                   lua_setfield(L, -2, "path") ;
+    lua_pushinteger(L, (lua_Integer)dump.data.length) ; lua_setfield(L, -2, "size") ;
+    lua_pushinteger(L, (lua_Integer)dump.count) ;       lua_setfield(L, -2, "count") ;
+    lua_pushnumber(L, dump.indexTime) ;                 lua_setfield(L, -2, "indexTime") ;
+    if (dump.windowsIndexed) {
+        lua_pushinteger(L, (lua_Integer)dump.windowCount) ; lua_setfield(L, -2, "windows") ;
+    }
+    return 1 ;
+}
+
+#pragma mark - Module Constants
+
+/// hs._asm.undocumented.cgsdebug.dumpFile.paths[]
+/// Constant
+/// A table containing the paths the WindowServer writes its dump files to.
+///
+///  * windowList     - written by the `dumpWindowListToFile` option
+///  * connectionList - written by the `dumpConnectionListToFile` option
+///  * shadowList     - written by the `dumpShadowListToFile` option
+///  * surfaceInfo    - written by the `dumpSurfaceInfo` option
+///  * hotKeyList     - written by the `dumpHotKeyListToFile` option
+///  * openGLInfo     - written by the `dumpOpenGLInfoToFile` option
+static int dump_paths(lua_State *L) {
+    lua_newtable(L) ;
+    lua_pushstring(L, DUMP_WINDOWLIST_PATH) ;            lua_setfield(L, -2, "windowList") ;
+    lua_pushstring(L, "/tmp/WindowServer.cinfo.out") ;   lua_setfield(L, -2, "connectionList") ;
+    lua_pushstring(L, "/tmp/WindowServer.shinfo.out") ;  lua_setfield(L, -2, "shadowList") ;
+    lua_pushstring(L, "/tmp/WindowServer.sinfo.out") ;   lua_setfield(L, -2, "surfaceInfo") ;
+    lua_pushstring(L, "/tmp/WindowServer.keyinfo.out") ; lua_setfield(L, -2, "hotKeyList") ;
+    lua_pushstring(L, "/tmp/WindowServer.glinfo.out") ;  lua_setfield(L, -2, "openGLInfo") ;
+    return 1 ;
+}
+
+#pragma mark - Lua<->NSObject Conversion Functions
+// These must not throw a lua error to ensure LuaSkin can safely be used from Objective-C
+// delegates and blocks.
+
+static int pushHSASMCGSDumpFile(lua_State *L, id obj) {
+    HSASMCGSDumpFile *value = obj;
+    value.selfRefCount++ ;
+    void** valuePtr = lua_newuserdata(L, sizeof(HSASMCGSDumpFile *));
+    *valuePtr = (__bridge_retained void *)value;
+    luaL_getmetatable(L, USERDATA_TAG);
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+static id toHSASMCGSDumpFileFromLua(lua_State *L, int idx) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    HSASMCGSDumpFile *value ;
+    if (luaL_testudata(L, idx, USERDATA_TAG)) {
+        value = get_objectFromUserdata(__bridge HSASMCGSDumpFile, L, idx, USERDATA_TAG) ;
+    } else {
+        [skin logError:[NSString stringWithFormat:@"expected %s object, found %s", USERDATA_TAG,
+                                                   lua_typename(L, lua_type(L, idx))]] ;
+    }
+    return value ;
+}
+
+#pragma mark - Hammerspoon/Lua Infrastructure
+
+static int userdata_tostring(lua_State* L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    HSASMCGSDumpFile *obj = [skin luaObjectAtIndex:1 toClass:"HSASMCGSDumpFile"] ;
+    NSString *title = [NSString stringWithFormat:@"%@, %lu entries", obj.path.lastPathComponent, obj.count] ;
+    [skin pushNSObject:[NSString stringWithFormat:@"%s: %@ (%p)", USERDATA_TAG, title, lua_topointer(L, 1)]] ;
+    return 1 ;
+}
+
+static int userdata_len(lua_State* L) {
+    HSASMCGSDumpFile *obj = get_objectFromUserdata(__bridge HSASMCGSDumpFile, L, 1, USERDATA_TAG) ;
+    lua_pushinteger(L, (lua_Integer)obj.count) ;
+    return 1 ;
+}
+
+static int userdata_eq(lua_State* L) {
+// can't get here if at least one of us isn't a userdata type, and we only care if both types are ours,
+// so use luaL_testudata before the macro causes a lua error
+    if (luaL_testudata(L, 1, USERDATA_TAG) && luaL_testudata(L, 2, USERDATA_TAG)) {
+        LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+        HSASMCGSDumpFile *obj1 = [skin luaObjectAtIndex:1 toClass:"HSASMCGSDumpFile"] ;
+        HSASMCGSDumpFile *obj2 = [skin luaObjectAtIndex:2 toClass:"HSASMCGSDumpFile"] ;
+        lua_pushboolean(L, [obj1 isEqualTo:obj2]) ;
+    } else {
+        lua_pushboolean(L, NO) ;
+    }
+    return 1 ;
+}
+
+static int userdata_gc(lua_State* L) {
+    HSASMCGSDumpFile *obj = get_objectFromUserdata(__bridge_transfer HSASMCGSDumpFile, L, 1, USERDATA_TAG) ;
+    if (obj) {
+        obj.selfRefCount-- ;
+        if (obj.selfRefCount == 0) {
+            obj = nil ;
+        }
+    }
+
+    // Remove the Metatable so future use of the variable in Lua won't think its valid
+    lua_pushnil(L) ;
+    lua_setmetatable(L, 1) ;
+    return 0 ;
+}
+
+// Metatable for userdata objects
+static const luaL_Reg userdata_metaLib[] = {
+    {"count",      dump_count},
+    {"record",     dump_record},
+    {"raw",        dump_raw},
+    {"records",    dump_records},
+    {"info",       dump_info},
+    {"recordForWindow", dump_recordForWindow},
+
+    {"__tostring", userdata_tostring},
+    {"__len",      userdata_len},
+    {"__eq",       userdata_eq},
+    {"__gc",       userdata_gc},
+    {NULL,         NULL}
+};
+
+// Functions for returned object when module loads
+static luaL_Reg moduleLib[] = {
+    {"open",     dump_open},
+    {"snapshot", dump_snapshot},
+    {"diff",     dump_diff},
+    {NULL,       NULL}
+};
+
+static int meta_gc(lua_State* __unused L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:NULL] ;
+    for (HSASMCGSDumpSnapshot *snapshot in pendingSnapshots) {
+        [snapshot.timer invalidate] ;
+        snapshot.timer       = nil ;
+        snapshot.callbackRef = [skin luaUnref:refTable ref:snapshot.callbackRef] ;
+    }
+    [pendingSnapshots removeAllObjects] ;
+    pendingSnapshots = nil ;
+    return 0 ;
+}
+
+// Metatable for module, if needed
+static const luaL_Reg module_metaLib[] = {
+    {"__gc", meta_gc},
+    {NULL,   NULL}
+};
+
+int luaopen_hs__asm_undocumented_cgsdebug_dumpFile(lua_State* L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    refTable = [skin registerLibraryWithObject:USERDATA_TAG
+                                     functions:moduleLib
+                                 metaFunctions:module_metaLib
+                               objectFunctions:userdata_metaLib] ;
+
+    pendingSnapshots = [NSMutableSet set] ;
+
+    dump_paths(L) ; lua_setfield(L, -2, "paths") ;
+
+    [skin registerPushNSHelper:pushHSASMCGSDumpFile         forClass:"HSASMCGSDumpFile"];
+    [skin registerLuaObjectHelper:toHSASMCGSDumpFileFromLua forClass:"HSASMCGSDumpFile"
+                                                 withUserdataMapping:USERDATA_TAG];
+
+    return 1;
+}
@@ -8,53 +8,35 @@
 --- I make no promises that these will work for you or work at all with any, past, current, or future versions of OS X.  I can confirm only that they didn't crash my machine during testing under 10.10. You have been warned.
 
 
+-- when the combined library built by the Makefile at the top of this repository is installed, it provides the
+-- internal modules through package.preload
+if not package.preload["hs._asm.undocumented.cgsdebug.internal"] and package.searchpath("hs._asm.undocumented.combined", package.cpath) then
+    require("hs._asm.undocumented.combined")
+end
+
 local module = require("hs._asm.undocumented.cgsdebug.internal")
 
 -- private variables and methods -----------------------------------------
 
-local _kMetaTable = {}
-_kMetaTable._k = {}
-_kMetaTable.__index = function(obj, key)
-        if _kMetaTable._k[obj] then
-            if _kMetaTable._k[obj][key] then
-                return _kMetaTable._k[obj][key]
-            else
-                for k,v in pairs(_kMetaTable._k[obj]) do
-                    if v == key then return k end
-                end
-            end
-        end
-        return nil
-    end
-_kMetaTable.__newindex = function(obj, key, value)
-        error("attempt to modify a table of constants",2)
-        return nil
-    end
-_kMetaTable.__pairs = function(obj) return pairs(_kMetaTable._k[obj]) end
-_kMetaTable.__tostring = function(obj)
-        local result = ""
-        if _kMetaTable._k[obj] then
-            local width = 0
-            for k,v in pairs(_kMetaTable._k[obj]) do width = width < #k and #k or width end
-            for k,v in require("hs.fnutils").sortByKeys(_kMetaTable._k[obj]) do
-                result = result..string.format("%-"..tostring(width).."s %s\n", k, tostring(v))
-            end
-        else
-            result = "constants table missing"
-        end
-        return result
-    end
-_kMetaTable.__metatable = _kMetaTable -- go ahead and look, but don't unset this
-
-local _makeConstantsTable = function(theTable)
-    local results = setmetatable({}, _kMetaTable)
-    _kMetaTable._k[results] = theTable
-    return results
-end
-
 -- Public interface ------------------------------------------------------
 
-module.options = _makeConstantsTable(module.options)
+-- fields which are built or loaded the first time they are used rather than when this module is loaded
+local _lazyFields = {
+    options  = function() return module._options() end,
+    dumpFile = function() return require("hs._asm.undocumented.cgsdebug.dumpFile") end,
+    snapshot = function() return module.dumpFile.snapshot end,
+    diff     = function() return module.dumpFile.diff end,
+    tailer   = function() return require("hs._asm.undocumented.cgsdebug.tailer") end,
+}
+
+getmetatable(module).__index = function(self, key)
+    local builder = _lazyFields[key]
+    if builder then
+        local value = builder()
+        rawset(self, key, value)
+        return value
+    end
+end
 
 -- Return Module Object --------------------------------------------------
 
@@ -1,9 +1,43 @@
 #import <Cocoa/Cocoa.h>
 // #import <Carbon/Carbon.h>
 #import <LuaSkin/LuaSkin.h>
-#import "cgsdebug.h"
+#import "cgsdebug_plan.h"
+#import "hsasm_executor.h"
+#import "hsasm_constants.h"
+#import "hsasm_mock.h"
 
-int refTable ;
+static int refTable = LUA_NOREF ;
+
+static const hsasm_constant cgsdebug_optionNames[] = {
+//  { "none",                     kCGSDebugOptionNone },
+    { "flashScreenUpdates",       kCGSDebugOptionFlashScreenUpdates },
+    { "colorByAcceleration",      kCGSDebugOptionColorByAccelleration },
+    { "noShadows",                kCGSDebugOptionNoShadows },
+    { "noDelayAfterFlash",        kCGSDebugOptionNoDelayAfterFlash },
+    { "autoFlushDrawing",         kCGSDebugOptionAutoflushDrawing },
+    { "showMouseTrackingAreas",   kCGSDebugOptionShowMouseTrackingAreas },
+    { "flashIdenticalUpdates",    kCGSDebugOptionFlashIdenticalUpdates },
+    { "dumpWindowListToFile",     kCGSDebugOptionDumpWindowListToFile },
+    { "dumpConnectionListToFile", kCGSDebugOptionDumpConnectionListToFile },
+    { "verboseLogging",           kCGSDebugOptionVerboseLogging },
+    { "verboseLoggingAllApps",    kCGSDebugOptionVerboseLoggingAllApps },
+    { "dumpHotKeyListToFile",     kCGSDebugOptionDumpHotKeyListToFile },
+    { "dumpSurfaceInfo",          kCGSDebugOptionDumpSurfaceInfo },
+    { "dumpOpenGLInfoToFile",     kCGSDebugOptionDumpOpenGLInfoToFile },
+    { "dumpShadowListToFile",     kCGSDebugOptionDumpShadowListToFile },
+    { "dumpWindowListToPlist",    kCGSDebugOptionDumpWindowListToPlist },
+    { "dumpResourceUsageToFiles", kCGSDebugOptionDumpResourceUsageToFiles },
+} ;
+
+static hsasm_constants cgsdebugOptions = HSASM_CONSTANTS("options", cgsdebug_optionNames) ;
+
+// setMask and update can make their changes on this lane when given a callback; the other functions
+// wait for it so that the WindowServer sees the changes in the order they were made
+static hsasm_lane debugLane = HSASM_LANE("hs._asm.undocumented.cgsdebug", 16) ;
+
+static const cgsdebug_backend cgsdebug_nativeBackend = { "native", CGSGetDebugOptions, CGSSetDebugOptions } ;
+
+static const cgsdebug_backend *backend = &cgsdebug_nativeBackend ;
 
 /// hs._asm.undocumented.cgsdebug.cgsdebug.get(option) -> boolean
 /// Function
@@ -16,10 +50,11 @@ int refTable ;
 ///  * the current state as a boolean
 static int cgsdebug_get(lua_State* L) {
     [[LuaSkin shared] checkArgs:LS_TNUMBER, LS_TBREAK] ;
+    hsasm_lane_barrier(&debugLane) ;
 
     CGSDebugOption the_option = (CGSDebugOption)luaL_checkinteger(L, 1);
-    CGSDebugOption actual_options;
-    CGSGetDebugOptions(&actual_options) ;
+    CGSDebugOption actual_options = kCGSDebugOptionNone ;
+    (void)HSASM_SPI_ERROR("CGSGetDebugOptions", backend->getDebugOptions(&actual_options)) ;
 
     if (actual_options & the_option)
         lua_pushboolean(L, YES);
@@ -40,14 +75,15 @@ static int cgsdebug_get(lua_State* L) {
 ///  * None
 static int cgsdebug_set(lua_State* L) {
     [[LuaSkin shared] checkArgs:LS_TNUMBER, LS_TBOOLEAN, LS_TBREAK] ;
+    hsasm_lane_barrier(&debugLane) ;
 
     CGSDebugOption the_option = (CGSDebugOption)luaL_checkinteger(L, 1);
     BOOL on = (BOOL)lua_toboolean(L, 2);
 
-    CGSDebugOption actual_options;
-    CGSGetDebugOptions(&actual_options) ;
+    CGSDebugOption actual_options = kCGSDebugOptionNone ;
+    (void)HSASM_SPI_ERROR("CGSGetDebugOptions", backend->getDebugOptions(&actual_options)) ;
     actual_options = on ? (actual_options | the_option) : (actual_options & ~the_option);
-    CGSSetDebugOptions(actual_options);
+    (void)HSASM_SPI_ERROR("CGSSetDebugOptions", backend->setDebugOptions(actual_options));
     return 0;
 }
 
@@ -62,8 +98,9 @@ static int cgsdebug_set(lua_State* L) {
 ///  * None
 static int cgsdebug_clear(lua_State* __unused L) {
     [[LuaSkin shared] checkArgs:LS_TBREAK] ;
+    hsasm_lane_barrier(&debugLane) ;
 
-    CGSSetDebugOptions(kCGSDebugOptionNone);
+    (void)HSASM_SPI_ERROR("CGSSetDebugOptions", backend->setDebugOptions(kCGSDebugOptionNone));
     return 0;
 }
 
@@ -78,9 +115,10 @@ static int cgsdebug_clear(lua_State* __unused L) {
 ///  * the integer value representing the bitmask of all currently enabled CGSDebug options
 static int cgsdebug_mask(lua_State* L) {
     [[LuaSkin shared] checkArgs:LS_TBREAK] ;
+    hsasm_lane_barrier(&debugLane) ;
 
-    CGSDebugOption options;
-    CGSGetDebugOptions(&options) ;
+    CGSDebugOption options = kCGSDebugOptionNone ;
+    (void)HSASM_SPI_ERROR("CGSGetDebugOptions", backend->getDebugOptions(&options)) ;
 
     lua_pushinteger(L, options) ;
     return 1;
@@ -97,20 +135,235 @@ static int cgsdebug_mask(lua_State* L) {
 ///  * None
 static int cgsdebug_shadow(lua_State* L) {
    [[LuaSkin shared] checkArgs:LS_TBOOLEAN, LS_TBREAK] ;
+   hsasm_lane_barrier(&debugLane) ;
 
    BOOL on = (BOOL)lua_toboolean(L, 1);
 
-    CGSDebugOption options;
-    CGSGetDebugOptions(&options);
+    CGSDebugOption options = kCGSDebugOptionNone ;
+    (void)HSASM_SPI_ERROR("CGSGetDebugOptions", backend->getDebugOptions(&options));
     options = on ? (options & ~(unsigned int)kCGSDebugOptionNoShadows) : (options | kCGSDebugOptionNoShadows);
-    CGSSetDebugOptions(options);
+    (void)HSASM_SPI_ERROR("CGSSetDebugOptions", backend->setDebugOptions(options));
     return 0;
 }
 
+// pushes the result of cgsdebug_applyPlan: the mask and verified flag, or nil and the error code
+static int cgsdebug_pushResult(lua_State *L, CGError err, uint32_t mask, bool verified) {
+    if (err == kCGErrorSuccess) {
+        lua_pushinteger(L, mask) ;
+        lua_pushboolean(L, verified) ;
+    } else {
+        lua_pushnil(L) ;
+        lua_pushinteger(L, err) ;
+    }
+    return 2 ;
+}
+
+// applies the plan and returns the bitmask and verified flag, or, if there is a callback at fnIdx, queues it on
+// debugLane and returns whether it was accepted
+static int cgsdebug_runPlan(lua_State *L, const cgsdebug_plan *plan, int retries, int fnIdx) {
+    if (lua_type(L, fnIdx) == LUA_TFUNCTION) {
+        lua_pushvalue(L, fnIdx) ;
+        int           callbackRef = [[LuaSkin shared] luaRef:refTable] ;
+        cgsdebug_plan queuedPlan  = *plan ;
+        __block CGError  err      = kCGErrorSuccess ;
+        __block uint32_t mask     = 0 ;
+        __block bool     verified = false ;
+        BOOL queued = hsasm_lane_async(&debugLane, ^{
+            uint32_t finalMask = 0 ;
+            bool     confirmed = false ;
+            err      = cgsdebug_applyPlan(backend, &queuedPlan, retries, &finalMask, &confirmed) ;
+            mask     = finalMask ;
+            verified = confirmed ;
+        }, nil, ^{
+            hsasm_lane_callback(refTable, callbackRef, @"hs._asm.undocumented.cgsdebug callback", ^(lua_State *cbL) {
+                return cgsdebug_pushResult(cbL, err, mask, verified) ;
+            }) ;
+        }) ;
+        if (!queued) [[LuaSkin shared] luaUnref:refTable ref:callbackRef] ;
+        lua_pushboolean(L, queued) ;
+        return 1 ;
+    }
+
+    uint32_t mask     = 0 ;
+    bool     verified = false ;
+    hsasm_lane_barrier(&debugLane) ;
+    CGError  err      = cgsdebug_applyPlan(backend, plan, retries, &mask, &verified) ;
+    return cgsdebug_pushResult(L, err, mask, verified) ;
+}
+
+static CGError cgsdebug_serviceApplyPlan(const cgsdebug_plan *plan, uint32_t *mask) {
+    bool verified = false ;
+    hsasm_lane_barrier(&debugLane) ;
+    return cgsdebug_applyPlan(backend, plan, 0, mask, &verified) ;
+}
+
+static BOOL cgsdebug_serviceQueuePlan(const cgsdebug_plan *plan, void (^completion)(CGError err, uint32_t mask)) {
+    cgsdebug_plan    queuedPlan = *plan ;
+    __block CGError  err        = kCGErrorSuccess ;
+    __block uint32_t mask       = 0 ;
+    return hsasm_lane_async(&debugLane, ^{
+        uint32_t finalMask = 0 ;
+        bool     verified  = false ;
+        err  = cgsdebug_applyPlan(backend, &queuedPlan, 0, &finalMask, &verified) ;
+        mask = finalMask ;
+    }, nil, ^{
+        completion(err, mask) ;
+    }) ;
+}
+
+static cgsdebug_service cgsdebugService = { cgsdebug_serviceApplyPlan, cgsdebug_serviceQueuePlan } ;
+
+/// hs._asm.undocumented.cgsdebug.cgsdebug.setMask(options, [retries], [fn]) -> bitmask, verified | boolean
+/// Function
+/// Enable or disable multiple CGSDebug options at once.
+///
+/// Parameters:
+///  * options - a table whose keys are labels defined in `hs._asm.undocumented.cgsdebug.cgsdebug.options[]` and whose values are booleans indicating whether the option should be enabled (true) or disabled (false)
+///  * retries - an optional integer, default 0, specifying how many times the change should be re-applied if another process changes the debug options while this function is making its changes.
+///  * fn      - an optional function which, if provided, causes the changes to be made in the background. It will be invoked with the final bitmask and the verified flag described below once the changes have been applied.
+///
+/// Returns:
+///  * the integer value representing the bitmask of CGSDebug options after the changes have been applied
+///  * a boolean indicating whether the options were read again immediately before the write and found unchanged by any other process; this will always be false if `retries` is 0.
+///  * if the current options could not be read or the new bitmask could not be written, nil and the CGError code are returned instead.
+///  * if `fn` is provided, a single boolean is returned instead, indicating whether the change was queued (true) or refused because too many changes are already waiting (false). The callback receives the values described above.
+///
+/// Notes:
+///  * the new bitmask is computed from a single read of the current options and applied with a single write, unlike multiple calls to [hs._asm.undocumented.cgsdebug.set](#set). Any commands are issued after the read and before the write.
+///  * if the options are changed by another process after they are read, the read made before the write sees it and the bitmask is recomputed from the new value, up to `retries` times.
+///  * the `dump...` and `verboseLogging...` options are commands to the WindowServer rather than persistent flags; setting one of these to true issues the command once, and setting it to false does nothing.
+///  * changes made in the background are applied in the order they were requested, and the other functions in this module wait for them before talking to the WindowServer.
+static int cgsdebug_setMask(lua_State* L) {
+    [[LuaSkin shared] checkArgs:LS_TTABLE, LS_TNUMBER | LS_TINTEGER | LS_TFUNCTION | LS_TOPTIONAL, LS_TFUNCTION | LS_TOPTIONAL, LS_TBREAK] ;
+
+    cgsdebug_plan plan = { 0, 0, { 0 }, 0 } ;
+
+    lua_pushnil(L) ;
+    while (lua_next(L, 1) != 0) {
+        const char *key = (lua_type(L, -2) == LUA_TSTRING) ? lua_tostring(L, -2) : NULL ;
+        int        idx  = key ? hsasm_constants_indexOfName(&cgsdebugOptions, key) : -1 ;
+        if (idx < 0) {
+            lua_pushvalue(L, -2) ; // don't let luaL_tolstring change the key lua_next is using
+            return luaL_error(L, "unrecognized option %s", luaL_tolstring(L, -1, NULL)) ;
+        }
+        if (lua_type(L, -1) != LUA_TBOOLEAN) return luaL_error(L, "value for %s must be a boolean", key) ;
+
+        cgsdebug_plan_add(&plan, (uint32_t)cgsdebug_optionNames[idx].value, lua_toboolean(L, -1)) ;
+        lua_pop(L, 1) ;
+    }
+
+    int retries = (lua_type(L, 2) == LUA_TNUMBER) ? (int)lua_tointeger(L, 2) : 0 ;
+    if (retries < 0) return luaL_argerror(L, 2, "retries cannot be negative") ;
+
+    return cgsdebug_runPlan(L, &plan, retries, (lua_type(L, 2) == LUA_TFUNCTION) ? 2 : 3) ;
+}
+
+/// hs._asm.undocumented.cgsdebug.cgsdebug.update(setBits, clearBits, [retries], [fn]) -> bitmask, verified | boolean
+/// Function
+/// Set and clear CGSDebug option flags specified as bitmasks with a single read and write of the current options.
+///
+/// Parameters:
+///  * setBits   - an integer bitmask of the flags to enable
+///  * clearBits - an integer bitmask of the flags to disable
+///  * retries   - an optional integer, default 0, specifying how many times the change should be re-applied if another process changes the debug options while this function is making its changes.
+///  * fn        - an optional function which, if provided, causes the changes to be made in the background as described for [hs._asm.undocumented.cgsdebug.setMask](#setMask).
+///
+/// Returns:
+///  * the integer value representing the bitmask of CGSDebug options after the changes have been applied
+///  * a boolean indicating whether the options were read again immediately before the write and found unchanged by any other process; this will always be false if `retries` is 0.
+///  * if the current options could not be read or the new bitmask could not be written, nil and the CGError code are returned instead.
+///  * if `fn` is provided, a single boolean is returned instead, indicating whether the change was queued.
+///
+/// Notes:
+///  * if a bit is specified in both `setBits` and `clearBits`, it will be cleared.
+///  * the `dump...` and `verboseLogging...` options are commands rather than flags and cannot be combined into a bitmask; use [hs._asm.undocumented.cgsdebug.setMask](#setMask) or [hs._asm.undocumented.cgsdebug.set](#set) for these.
+static int cgsdebug_update(lua_State* L) {
+    [[LuaSkin shared] checkArgs:LS_TNUMBER | LS_TINTEGER, LS_TNUMBER | LS_TINTEGER, LS_TNUMBER | LS_TINTEGER | LS_TFUNCTION | LS_TOPTIONAL, LS_TFUNCTION | LS_TOPTIONAL, LS_TBREAK] ;
+
+    lua_Integer setBits   = lua_tointeger(L, 1) ;
+    lua_Integer clearBits = lua_tointeger(L, 2) ;
+    if (setBits < 0 || setBits > UINT32_MAX || cgsdebug_isCommand((uint32_t)setBits))
+        return luaL_argerror(L, 1, "bitmask must be a positive 32 bit integer without the command bit set") ;
+    if (clearBits < 0 || clearBits > UINT32_MAX || cgsdebug_isCommand((uint32_t)clearBits))
+        return luaL_argerror(L, 2, "bitmask must be a positive 32 bit integer without the command bit set") ;
+
+    int retries = (lua_type(L, 3) == LUA_TNUMBER) ? (int)lua_tointeger(L, 3) : 0 ;
+    if (retries < 0) return luaL_argerror(L, 3, "retries cannot be negative") ;
+
+    cgsdebug_plan plan = { (uint32_t)setBits & ~(uint32_t)clearBits, (uint32_t)clearBits, { 0 }, 0 } ;
+    return cgsdebug_runPlan(L, &plan, retries, (lua_type(L, 3) == LUA_TFUNCTION) ? 3 : 4) ;
+}
+
+/// hs._asm.undocumented.cgsdebug.cgsdebug.stats([json]) -> table | string
+/// Function
+/// Returns call counts, timing and error codes for the CGSGetDebugOptions and CGSSetDebugOptions calls made by this module.
+///
+/// Parameters:
+///  * json - an optional boolean, default false, specifying whether the statistics should be returned as a JSON string instead of a table.
+///
+/// Returns:
+///  * a table keyed by function name, each entry containing the following keys:
+///    * calls      - the number of times the function has been called
+///    * errors     - the number of calls which returned a CGError other than kCGErrorSuccess
+///    * errorCodes - a table of CGError code -> count
+///    * totalNs, meanNs, minNs, maxNs - the total, mean, shortest and longest time spent in the function in nanoseconds
+///    * p50, p90, p99, p999 - latency percentiles in nanoseconds, accurate to within 25%
+///
+/// Notes:
+///  * the functions in this module have always ignored the CGError returned by the WindowServer; this is the only place these errors are reported.
+///  * the calls made by `hs._asm.undocumented.cgsdebug.dumpFile` are built into a separate library and are not included.
+static int cgsdebug_stats(lua_State* L) {
+    return hsasm_spi_pushStats(L) ;
+}
+
+/// hs._asm.undocumented.cgsdebug.cgsdebug.resetStats() -> None
+/// Function
+/// Clears the statistics returned by [hs._asm.undocumented.cgsdebug.stats](#stats).
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * None
+static int cgsdebug_resetStats(lua_State* L) {
+    return hsasm_spi_resetStats(L) ;
+}
+
+/// hs._asm.undocumented.cgsdebug.cgsdebug.executorStats() -> table
+/// Function
+/// Returns information about the background queue used by [hs._asm.undocumented.cgsdebug.setMask](#setMask) and [hs._asm.undocumented.cgsdebug.update](#update) when a callback is provided.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * a table containing the keys `name`, `limit`, `depth`, `peakDepth`, `submitted`, `completed`, `rejected`, `barriers`, `meanWait` and `meanRun`; see [hs._asm.undocumented.coredock.executorStats](../coredock/#executorStats) for a description of each.
+static int cgsdebug_executorStats(lua_State* L) {
+    [[LuaSkin shared] checkArgs:LS_TBREAK] ;
+    hsasm_lane_pushStats(L, &debugLane) ;
+    return 1 ;
+}
+
+// _mockBackend([enable], [options]) -> table
+// switches between the WindowServer and an in-memory mock of the debug options (see hsasm_mock.h) and returns
+// a table describing the backend in use and the mock's configuration and call counts
+static int cgsdebug_selectBackend(lua_State* L) {
+    [[LuaSkin shared] checkArgs:LS_TBOOLEAN | LS_TOPTIONAL, LS_TTABLE | LS_TOPTIONAL, LS_TBREAK] ;
+    if (lua_isboolean(L, 1)) {
+        hsasm_lane_barrier(&debugLane) ;
+        backend = lua_toboolean(L, 1) ? &cgsdebug_mockBackend : &cgsdebug_nativeBackend ;
+        hsasm_mock_configure(L, 2, &cgsdebug_mock) ;
+    }
+    hsasm_mock_pushStats(L, backend->name, &cgsdebug_mock) ;
+    return 1 ;
+}
+
 /// hs._asm.undocumented.cgsdebug.cgsdebug.options[]
 /// Variable
 /// Connivence array of all currently known debug options.
 ///
+/// This is a read-only table of constants: indexing it with an option name returns its value, and indexing it with a value returns the option name.
+///
 ///  * flashScreenUpdates       - All screen updates are flashed in yellow. Regions under a DisableUpdate are flashed in orange. Regions that are hardware accellerated are painted green.
 ///  * colorByAcceleration      - Colors windows green if they are accellerated, otherwise red. Doesn't cause things to refresh properly - leaves excess rects cluttering the screen.
 ///  * noShadows                - Disables shadows on all windows.
@@ -128,40 +381,43 @@ static int cgsdebug_shadow(lua_State* L) {
 ///  * dumpShadowListToFile     - Dumps a list of shadows to /tmp/WindowServer.shinfo.out.
 ///  * dumpWindowListToPlist    - Dumps a list of windows to `/tmp/WindowServer.winfo.plist`. This is what Quartz Debug on 10.5 uses to get the window list.
 ///  * dumpResourceUsageToFiles - Dumps information about an application's resource usage to `/tmp/CGResources_NAME_PID`.
-static void cgsdebug_options (lua_State *L) {
-    lua_newtable(L) ;
-//    lua_pushinteger(L, kCGSDebugOptionNone);                        lua_setfield(L, -2, "none") ;
-    lua_pushinteger(L, kCGSDebugOptionFlashScreenUpdates);          lua_setfield(L, -2, "flashScreenUpdates") ;
-    lua_pushinteger(L, kCGSDebugOptionColorByAccelleration);        lua_setfield(L, -2, "colorByAcceleration") ;
-    lua_pushinteger(L, kCGSDebugOptionNoShadows);                   lua_setfield(L, -2, "noShadows") ;
-    lua_pushinteger(L, kCGSDebugOptionNoDelayAfterFlash);           lua_setfield(L, -2, "noDelayAfterFlash") ;
-    lua_pushinteger(L, kCGSDebugOptionAutoflushDrawing);            lua_setfield(L, -2, "autoFlushDrawing") ;
-    lua_pushinteger(L, kCGSDebugOptionShowMouseTrackingAreas);      lua_setfield(L, -2, "showMouseTrackingAreas") ;
-    lua_pushinteger(L, kCGSDebugOptionFlashIdenticalUpdates);       lua_setfield(L, -2, "flashIdenticalUpdates") ;
-    lua_pushinteger(L, kCGSDebugOptionDumpWindowListToFile);        lua_setfield(L, -2, "dumpWindowListToFile") ;
-    lua_pushinteger(L, kCGSDebugOptionDumpConnectionListToFile);    lua_setfield(L, -2, "dumpConnectionListToFile") ;
-    lua_pushinteger(L, kCGSDebugOptionVerboseLogging);              lua_setfield(L, -2, "verboseLogging") ;
-    lua_pushinteger(L, kCGSDebugOptionVerboseLoggingAllApps);       lua_setfield(L, -2, "verboseLoggingAllApps") ;
-    lua_pushinteger(L, kCGSDebugOptionDumpHotKeyListToFile);        lua_setfield(L, -2, "dumpHotKeyListToFile") ;
-    lua_pushinteger(L, kCGSDebugOptionDumpSurfaceInfo);             lua_setfield(L, -2, "dumpSurfaceInfo") ;
-    lua_pushinteger(L, kCGSDebugOptionDumpOpenGLInfoToFile);        lua_setfield(L, -2, "dumpOpenGLInfoToFile") ;
-    lua_pushinteger(L, kCGSDebugOptionDumpShadowListToFile);        lua_setfield(L, -2, "dumpShadowListToFile") ;
-    lua_pushinteger(L, kCGSDebugOptionDumpWindowListToPlist);       lua_setfield(L, -2, "dumpWindowListToPlist") ;
-    lua_pushinteger(L, kCGSDebugOptionDumpResourceUsageToFiles);    lua_setfield(L, -2, "dumpResourceUsageToFiles") ;
+static int cgsdebug_options (lua_State *L) {
+    hsasm_constants_push(L, &cgsdebugOptions, "hs._asm.undocumented.cgsdebug.constants") ;
+    return 1 ;
 }
 
 static const luaL_Reg moduleLib[] = {
-    {"get",     cgsdebug_get},
-    {"set",     cgsdebug_set},
-    {"clear",   cgsdebug_clear},
-    {"getMask", cgsdebug_mask},
-    {"shadow",  cgsdebug_shadow},
+    {"get",           cgsdebug_get},
+    {"set",           cgsdebug_set},
+    {"clear",         cgsdebug_clear},
+    {"getMask",       cgsdebug_mask},
+    {"shadow",        cgsdebug_shadow},
+    {"setMask",       cgsdebug_setMask},
+    {"update",        cgsdebug_update},
+    {"stats",         cgsdebug_stats},
+    {"resetStats",    cgsdebug_resetStats},
+    {"executorStats", cgsdebug_executorStats},
+    {"_options",      cgsdebug_options},
+    {"_mockBackend",  cgsdebug_selectBackend},
     {NULL, NULL}
 };
 
+static int meta_gc(lua_State* L) {
+    lua_pushnil(L) ;
+    lua_setfield(L, LUA_REGISTRYINDEX, CGSDEBUG_SERVICE_KEY) ;
+    hsasm_lane_abandon(&debugLane) ;
+    return 0 ;
+}
+
+static const luaL_Reg module_metaLib[] = {
+    {"__gc", meta_gc},
+    {NULL,   NULL}
+};
+
 int luaopen_hs__asm_undocumented_cgsdebug_internal(lua_State* L) {
-    refTable = [[LuaSkin shared] registerLibrary:moduleLib metaFunctions:nil] ;
+    refTable = [[LuaSkin shared] registerLibrary:moduleLib metaFunctions:module_metaLib] ;
 
-    cgsdebug_options(L) ; lua_setfield(L, -2, "options") ;
+    lua_pushlightuserdata(L, &cgsdebugService) ;
+    lua_setfield(L, LUA_REGISTRYINDEX, CGSDEBUG_SERVICE_KEY) ;
     return 1;
 }
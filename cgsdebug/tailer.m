@@ -0,0 +1,663 @@
+@import Cocoa ;
+@import LuaSkin ;
+#import <os/lock.h>
+#import <glob.h>
+#import "cgsdebug_tail.h"
+
+static const char * const USERDATA_TAG = "hs._asm.undocumented.cgsdebug.tailer" ;
+static LSRefTable refTable = LUA_NOREF;
+
+#define get_objectFromUserdata(objType, L, idx, tag) (objType*)*((void**)luaL_checkudata(L, idx, tag))
+
+// The ring, the line framing and the handling of truncated and replaced files are in cgsdebug_tail.h; this
+// file adds the dispatch sources which tell it when to look at the file and the delivery of lines to Lua.
+
+#define TAILER_BUFFER_SIZE   (1024 * 1024)
+#define TAILER_MAX_LINES     8192
+#define TAILER_BATCH_SIZE    512
+#define TAILER_POLL_INTERVAL 0.25
+#define TAILER_LOG_PATTERN   "/tmp/CGLog_*"
+
+#pragma mark - Support Functions and Classes
+
+@class HSASMCGSTailer ;
+
+// How the tailer learns that the file has changed. kqueue requires an open file descriptor, so while the
+// file doesn't exist (or between a rotation and the new file appearing) the tailer falls back to polling.
+// The kqueue source watches its own duplicate of the descriptor, which is only closed by the source's cancel
+// handler; the source may still be using it after dispatch_source_cancel returns.
+typedef struct {
+    const char *name ;
+    BOOL       (*start)(HSASMCGSTailer *tailer) ;
+    void       (*stop)(HSASMCGSTailer *tailer) ;
+} hsasm_tailNotifier ;
+
+static BOOL tail_kqueueStart(HSASMCGSTailer *tailer) ;
+static BOOL tail_pollStart(HSASMCGSTailer *tailer) ;
+static void tail_sourceStop(HSASMCGSTailer *tailer) ;
+
+static const hsasm_tailNotifier kqueueNotifier = { "kqueue", tail_kqueueStart, tail_sourceStop } ;
+static const hsasm_tailNotifier pollNotifier   = { "poll",   tail_pollStart,   tail_sourceStop } ;
+
+@interface HSASMCGSTailer : NSObject
+@property            int                      selfRefCount ;
+@property            int                      callbackRef ;
+@property (readonly) NSString                 *path ;
+@property (readonly) dispatch_queue_t         queue ;
+@property            dispatch_source_t        source ;
+@property (readonly) int                      fd ;
+@property (readonly) NSTimeInterval           interval ;
+@property (readonly) const hsasm_tailNotifier *notifier ;
+@property (readonly) const hsasm_tailNotifier *activeNotifier ;
+@property (readonly) BOOL                     running ;
+@end
+
+static void tail_lock(void *context) {
+    os_unfair_lock_lock((os_unfair_lock *)context) ;
+}
+
+static void tail_unlock(void *context) {
+    os_unfair_lock_unlock((os_unfair_lock *)context) ;
+}
+
+@implementation HSASMCGSTailer {
+    os_unfair_lock _lock ;
+    tail_ring      _ring ;      // shared with the main thread; only touched with _lock held
+    tail_file      _file ;      // on _queue
+    char           *_filePath ; // _file.path; fileSystemRepresentation is only valid until the pool drains
+    NSUInteger     _batchSize ;
+    BOOL           _deliveryScheduled ;
+    uint64_t       _batches ;
+    NSTimeInterval _statsStart ;
+}
+
+- (instancetype)initWithPath:(NSString *)path
+                    notifier:(const hsasm_tailNotifier *)notifier
+                    interval:(NSTimeInterval)interval
+                  bufferSize:(size_t)bufferSize
+                    maxLines:(NSUInteger)maxLines
+                   batchSize:(NSUInteger)batchSize
+                      offset:(int64_t)offset {
+    self = [super init] ;
+    if (self) {
+        _selfRefCount   = 0 ;
+        _callbackRef    = LUA_NOREF ;
+        _path           = path ;
+        _queue          = dispatch_queue_create(USERDATA_TAG, DISPATCH_QUEUE_SERIAL) ;
+        _source         = nil ;
+        _interval       = interval ;
+        _notifier       = notifier ;
+        _activeNotifier = NULL ;
+        _running        = NO ;
+
+        _lock           = OS_UNFAIR_LOCK_INIT ;
+        _batchSize      = batchSize ;
+        _statsStart     = [NSProcessInfo processInfo].systemUptime ;
+
+        tail_file_init(&_file, NULL, offset, &_ring) ;
+        _filePath       = strdup(_path.fileSystemRepresentation) ;
+        if (!_filePath || !tail_ring_init(&_ring, bufferSize, maxLines)) return nil ;
+        _file.path        = _filePath ;
+        _file.lock        = tail_lock ;
+        _file.unlock      = tail_unlock ;
+        _file.lockContext = &_lock ;
+    }
+    return self ;
+}
+
+- (void)dealloc {
+    if (_source) dispatch_source_cancel(_source) ;
+    tail_file_close(&_file) ;
+    tail_ring_free(&_ring) ;
+    free(_filePath) ;
+}
+
+#pragma mark File handling (on _queue)
+
+- (int)fd {
+    return _file.fd ;
+}
+
+- (void)stopNotifier {
+    if (_activeNotifier) _activeNotifier->stop(self) ;
+    _activeNotifier = NULL ;
+}
+
+- (void)useNotifier:(const hsasm_tailNotifier *)notifier {
+    if (_activeNotifier == notifier) return ;
+    [self stopNotifier] ;
+    _activeNotifier = notifier ;
+    if (!notifier->start(self)) {
+        _activeNotifier = &pollNotifier ;
+        pollNotifier.start(self) ;
+    }
+}
+
+- (void)fileChanged {
+    switch(tail_file_check(&_file)) {
+        case kTailFileOpened:
+            // a kqueue source is tied to the descriptor it was started with, so it's replaced as well
+            [self stopNotifier] ;
+            [self useNotifier:_notifier] ;
+            break ;
+        case kTailFileMissing:
+            [self useNotifier:&pollNotifier] ;
+            break ;
+        case kTailFileRead:
+            break ;
+    }
+    [self scheduleDelivery] ;
+}
+
+#pragma mark Delivery
+
+- (void)scheduleDelivery {
+    os_unfair_lock_lock(&_lock) ;
+    BOOL schedule = !_deliveryScheduled && (tail_ring_pending(&_ring) > 0) ;
+    if (schedule) _deliveryScheduled = YES ;
+    os_unfair_lock_unlock(&_lock) ;
+
+    if (schedule) {
+        __weak HSASMCGSTailer *weakSelf = self ;
+        dispatch_async(dispatch_get_main_queue(), ^{ [weakSelf deliver] ; }) ;
+    }
+}
+
+// pushes a line directly from the byte ring; a line which wraps around the end of the ring is pushed in
+// two parts and joined by Lua
+- (void)pushLineLocked:(tail_line)line L:(lua_State *)L {
+    const char *first ;
+    size_t     firstLength = tail_ring_lineBytes(&_ring, line, &first) ;
+    lua_pushlstring(L, first, firstLength) ;
+    if (firstLength < line.length) {
+        lua_pushlstring(L, _ring.bytes, line.length - firstLength) ;
+        lua_concat(L, 2) ;
+    }
+}
+
+// on the main thread
+- (void)deliver {
+    os_unfair_lock_lock(&_lock) ;
+    _deliveryScheduled = NO ;
+    os_unfair_lock_unlock(&_lock) ;
+
+    LuaSkin   *skin = [LuaSkin sharedWithState:NULL] ;
+    lua_State *L    = skin.L ;
+    while (_running && _callbackRef != LUA_NOREF) {
+        _lua_stackguard_entry(L) ;
+        [skin pushLuaRef:refTable ref:_callbackRef] ;
+        [skin pushNSObject:self] ;
+
+        os_unfair_lock_lock(&_lock) ;
+        NSUInteger count = MIN(tail_ring_pending(&_ring), _batchSize) ;
+        if (count > 0) {
+            lua_createtable(L, (int)count, 0) ;
+            for (NSUInteger i = 0 ; i < count ; i++) {
+                [self pushLineLocked:tail_ring_line(&_ring, i) L:L] ;
+                lua_rawseti(L, -2, (lua_Integer)(i + 1)) ;
+            }
+            tail_ring_consume(&_ring, count) ;
+            _batches++ ;
+        }
+        os_unfair_lock_unlock(&_lock) ;
+
+        if (count == 0) {
+            lua_pop(L, 2) ;
+            _lua_stackguard_exit(L) ;
+            break ;
+        }
+        [skin protectedCallAndError:@"hs._asm.undocumented.cgsdebug.tailer callback" nargs:2 nresults:0] ;
+        _lua_stackguard_exit(L) ;
+    }
+}
+
+#pragma mark Control (on the main thread)
+
+- (void)start {
+    if (_running) return ;
+    _running = YES ;
+    dispatch_async(_queue, ^{ [self fileChanged] ; }) ;
+}
+
+- (void)stop {
+    if (!_running) return ;
+    _running = NO ;
+    // the position is kept, so a stopped tailer picks up where it left off when it's started again
+    dispatch_sync(_queue, ^{
+        [self stopNotifier] ;
+        tail_file_suspend(&self->_file) ;
+    }) ;
+}
+
+- (uint64_t)deliveredOffset {
+    os_unfair_lock_lock(&_lock) ;
+    uint64_t offset = _ring.deliveredOffset ;
+    os_unfair_lock_unlock(&_lock) ;
+    return offset ;
+}
+
+- (void)pushStats:(lua_State *)L reset:(BOOL)reset {
+    NSTimeInterval now = [NSProcessInfo processInfo].systemUptime ;
+
+    os_unfair_lock_lock(&_lock) ;
+    NSTimeInterval elapsed = now - _statsStart ;
+    lua_newtable(L) ;
+    lua_pushinteger(L, (lua_Integer)_ring.bytesRead) ;                lua_setfield(L, -2, "bytesRead") ;
+    lua_pushinteger(L, (lua_Integer)_ring.linesRead) ;                lua_setfield(L, -2, "linesRead") ;
+    lua_pushinteger(L, (lua_Integer)_ring.linesDelivered) ;           lua_setfield(L, -2, "linesDelivered") ;
+    lua_pushinteger(L, (lua_Integer)_ring.linesDropped) ;             lua_setfield(L, -2, "linesDropped") ;
+    lua_pushinteger(L, (lua_Integer)_batches) ;                       lua_setfield(L, -2, "batches") ;
+    lua_pushinteger(L, (lua_Integer)_file.truncations) ;              lua_setfield(L, -2, "truncations") ;
+    lua_pushinteger(L, (lua_Integer)_file.rotations) ;                lua_setfield(L, -2, "rotations") ;
+    lua_pushinteger(L, (lua_Integer)tail_ring_pending(&_ring)) ;      lua_setfield(L, -2, "pending") ;
+    lua_pushinteger(L, (lua_Integer)(_ring.head - _ring.tail)) ;      lua_setfield(L, -2, "bufferUsed") ;
+    lua_pushnumber(L, elapsed) ;                                      lua_setfield(L, -2, "elapsed") ;
+    lua_pushnumber(L, (elapsed > 0) ? (double)_ring.linesRead / elapsed : 0.0) ; lua_setfield(L, -2, "linesPerSecond") ;
+    if (reset) {
+        _ring.bytesRead      = 0 ;
+        _ring.linesRead      = 0 ;
+        _ring.linesDelivered = 0 ;
+        _ring.linesDropped   = 0 ;
+        _batches             = 0 ;
+        _file.truncations    = 0 ;
+        _file.rotations      = 0 ;
+        _statsStart          = now ;
+    }
+    os_unfair_lock_unlock(&_lock) ;
+
+    lua_pushstring(L, _activeNotifier ? _activeNotifier->name : "none") ; lua_setfield(L, -2, "notifier") ;
+}
+
+@end
+
+static BOOL tail_kqueueStart(HSASMCGSTailer *tailer) {
+    if (tailer.fd < 0) return NO ;
+    int watched = dup(tailer.fd) ;
+    if (watched < 0) return NO ;
+    dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_VNODE, (uintptr_t)watched,
+                                                      DISPATCH_VNODE_WRITE  | DISPATCH_VNODE_EXTEND |
+                                                      DISPATCH_VNODE_ATTRIB | DISPATCH_VNODE_DELETE |
+                                                      DISPATCH_VNODE_RENAME | DISPATCH_VNODE_REVOKE,
+                                                      tailer.queue) ;
+    if (!source) {
+        close(watched) ;
+        return NO ;
+    }
+    __weak HSASMCGSTailer *weakTailer = tailer ;
+    dispatch_source_set_event_handler(source, ^{ [weakTailer fileChanged] ; }) ;
+    dispatch_source_set_cancel_handler(source, ^{ close(watched) ; }) ;
+    tailer.source = source ;
+    dispatch_resume(source) ;
+    return YES ;
+}
+
+static BOOL tail_pollStart(HSASMCGSTailer *tailer) {
+    dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, tailer.queue) ;
+    if (!source) return NO ;
+    uint64_t interval = (uint64_t)(tailer.interval * NSEC_PER_SEC) ;
+    dispatch_source_set_timer(source, dispatch_time(DISPATCH_TIME_NOW, (int64_t)interval), interval, interval / 10) ;
+    __weak HSASMCGSTailer *weakTailer = tailer ;
+    dispatch_source_set_event_handler(source, ^{ [weakTailer fileChanged] ; }) ;
+    tailer.source = source ;
+    dispatch_resume(source) ;
+    return YES ;
+}
+
+static void tail_sourceStop(HSASMCGSTailer *tailer) {
+    if (tailer.source) dispatch_source_cancel(tailer.source) ;
+    tailer.source = nil ;
+}
+
+static NSInteger tail_integerOption(lua_State *L, int idx, const char *key, NSInteger defaultValue, NSInteger minimum) {
+    NSInteger value = defaultValue ;
+    if (lua_getfield(L, idx, key) != LUA_TNIL) {
+        if (!lua_isinteger(L, -1)) luaL_error(L, "%s must be an integer", key) ;
+        value = (NSInteger)lua_tointeger(L, -1) ;
+        if (value < minimum) luaL_error(L, "%s must be at least %d", key, (int)minimum) ;
+    }
+    lua_pop(L, 1) ;
+    return value ;
+}
+
+#pragma mark - Module Functions
+
+/// hs._asm.undocumented.cgsdebug.tailer.new(path, fn, [options]) -> tailerObject
+/// Constructor
+/// Creates a new tailer which follows a log file and passes each new line to a callback function.
+///
+/// Parameters:
+///  * path    - the path of the file to follow, usually one of the files returned by [hs._asm.undocumented.cgsdebug.tailer.logFiles](#logFiles). The file does not need to exist yet.
+///  * fn      - the callback function, which should expect two arguments: the tailerObject and an array of the lines (without their newlines) which have been added to the file since the last callback.
+///  * options - an optional table which may contain the following keys:
+///    * offset     - the offset in the file to start reading from. Defaults to the current end of the file; to resume where a previous tailer left off, use the value from its [hs._asm.undocumented.cgsdebug.tailer:offset](#offset) method.
+///    * notifier   - "kqueue" (the default) to be notified by the kernel when the file changes, or "poll" to check the file periodically.
+///    * interval   - the number of seconds between checks when polling, default 0.25. Polling is also used while the file does not exist.
+///    * bufferSize - the size in bytes of the buffer used to hold lines which have not been passed to the callback yet, default 1048576.
+///    * maxLines   - the maximum number of lines which may be waiting to be passed to the callback, default 8192.
+///    * batchSize  - the maximum number of lines passed to the callback at once, default 512.
+///
+/// Returns:
+///  * the tailerObject
+///
+/// Notes:
+///  * the tailer is not started until [hs._asm.undocumented.cgsdebug.tailer:start](#start) is invoked.
+///  * the file is read on a background queue; if the callback cannot keep up with the file, the oldest lines which have not been delivered are dropped so memory use stays bounded. A single line longer than `bufferSize` is also dropped. See [hs._asm.undocumented.cgsdebug.tailer:stats](#stats).
+///  * if the file is truncated the tailer starts again from the beginning of the file, and if it is deleted or replaced, whatever was written to the old file is delivered before the tailer starts reading the new file from its beginning.
+static int tail_new(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TSTRING, LS_TFUNCTION, LS_TTABLE | LS_TOPTIONAL, LS_TBREAK] ;
+
+    NSString                 *path       = [[skin toNSObjectAtIndex:1] stringByExpandingTildeInPath] ;
+    const hsasm_tailNotifier *notifier   = &kqueueNotifier ;
+    NSTimeInterval           interval    = TAILER_POLL_INTERVAL ;
+    NSInteger                bufferSize  = TAILER_BUFFER_SIZE ;
+    NSInteger                maxLines    = TAILER_MAX_LINES ;
+    NSInteger                batchSize   = TAILER_BATCH_SIZE ;
+    int64_t                  offset      = -1 ;
+
+    if (lua_type(L, 3) == LUA_TTABLE) {
+        if (lua_getfield(L, 3, "notifier") != LUA_TNIL) {
+            if (lua_type(L, -1) != LUA_TSTRING) return luaL_error(L, "notifier must be \"kqueue\" or \"poll\"") ;
+            const char *name = lua_tostring(L, -1) ;
+            if (!strcmp(name, kqueueNotifier.name)) {
+                notifier = &kqueueNotifier ;
+            } else if (!strcmp(name, pollNotifier.name)) {
+                notifier = &pollNotifier ;
+            } else {
+                return luaL_error(L, "notifier must be \"kqueue\" or \"poll\"") ;
+            }
+        }
+        lua_pop(L, 1) ;
+        if (lua_getfield(L, 3, "interval") != LUA_TNIL) {
+            if (lua_type(L, -1) != LUA_TNUMBER) return luaL_error(L, "interval must be a number") ;
+            interval = lua_tonumber(L, -1) ;
+            if (interval <= 0) return luaL_error(L, "interval must be greater than 0") ;
+        }
+        lua_pop(L, 1) ;
+        if (lua_getfield(L, 3, "offset") != LUA_TNIL) {
+            if (!lua_isinteger(L, -1)) return luaL_error(L, "offset must be an integer") ;
+            offset = (int64_t)lua_tointeger(L, -1) ;
+        }
+        lua_pop(L, 1) ;
+        bufferSize = tail_integerOption(L, 3, "bufferSize", bufferSize, 4096) ;
+        if ((uint64_t)bufferSize > UINT32_MAX) return luaL_error(L, "bufferSize must be less than 4GB") ;
+        maxLines   = tail_integerOption(L, 3, "maxLines",   maxLines,   1) ;
+        batchSize  = tail_integerOption(L, 3, "batchSize",  batchSize,  1) ;
+    }
+
+    HSASMCGSTailer *tailer = [[HSASMCGSTailer alloc] initWithPath:path
+                                                         notifier:notifier
+                                                         interval:interval
+                                                       bufferSize:(size_t)bufferSize
+                                                         maxLines:(NSUInteger)maxLines
+                                                        batchSize:(NSUInteger)batchSize
+                                                           offset:offset] ;
+    if (!tailer) return luaL_error(L, "unable to allocate a %d byte buffer", (int)bufferSize) ;
+
+    lua_pushvalue(L, 2) ;
+    tailer.callbackRef = [skin luaRef:refTable] ;
+    [skin pushNSObject:tailer] ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cgsdebug.tailer.logFiles() -> table
+/// Function
+/// Returns the paths of the log files written by the `verboseLogging` and `verboseLoggingAllApps` options.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * an array of the paths matching `/tmp/CGLog_*`, most recently modified first
+static int tail_logFiles(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TBREAK] ;
+
+    NSMutableArray *files = [NSMutableArray array] ;
+    glob_t         found ;
+    if (glob(TAILER_LOG_PATTERN, 0, NULL, &found) == 0) {
+        for (size_t i = 0 ; i < found.gl_pathc ; i++) [files addObject:@(found.gl_pathv[i])] ;
+    }
+    globfree(&found) ;
+
+    NSFileManager *fm = [NSFileManager defaultManager] ;
+    [files sortUsingComparator:^NSComparisonResult(NSString *a, NSString *b) {
+        NSDate *aDate = [fm attributesOfItemAtPath:a error:NULL].fileModificationDate ?: [NSDate distantPast] ;
+        NSDate *bDate = [fm attributesOfItemAtPath:b error:NULL].fileModificationDate ?: [NSDate distantPast] ;
+        return [bDate compare:aDate] ;
+    }] ;
+    [skin pushNSObject:files] ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cgsdebug.tailer:start() -> tailerObject
+/// Method
+/// Starts following the file.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * the tailerObject
+static int tail_start(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TBREAK] ;
+    HSASMCGSTailer *tailer = [skin toNSObjectAtIndex:1] ;
+    [tailer start] ;
+    lua_pushvalue(L, 1) ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cgsdebug.tailer:stop() -> tailerObject
+/// Method
+/// Stops following the file.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * the tailerObject
+///
+/// Notes:
+///  * the tailer's position in the file is kept; if it is started again, it continues from where it stopped.
+static int tail_stop(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TBREAK] ;
+    HSASMCGSTailer *tailer = [skin toNSObjectAtIndex:1] ;
+    [tailer stop] ;
+    lua_pushvalue(L, 1) ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cgsdebug.tailer:isRunning() -> boolean
+/// Method
+/// Returns whether or not the tailer is currently following its file.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * true if the tailer is running, otherwise false
+static int tail_isRunning(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TBREAK] ;
+    HSASMCGSTailer *tailer = [skin toNSObjectAtIndex:1] ;
+    lua_pushboolean(L, tailer.running) ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cgsdebug.tailer:path() -> string
+/// Method
+/// Returns the path of the file the tailer follows.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * the path as a string
+static int tail_path(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TBREAK] ;
+    HSASMCGSTailer *tailer = [skin toNSObjectAtIndex:1] ;
+    [skin pushNSObject:tailer.path] ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cgsdebug.tailer:offset() -> integer
+/// Method
+/// Returns the offset in the file just past the last line which has been passed to the callback.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * the offset as an integer
+///
+/// Notes:
+///  * save this value and provide it as the `offset` option to [hs._asm.undocumented.cgsdebug.tailer.new](#new) to resume following the file later without missing or repeating lines.
+static int tail_offset(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TBREAK] ;
+    HSASMCGSTailer *tailer = [skin toNSObjectAtIndex:1] ;
+    lua_pushinteger(L, (lua_Integer)[tailer deliveredOffset]) ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cgsdebug.tailer:stats([reset]) -> table
+/// Method
+/// Returns statistics about the lines the tailer has read and delivered.
+///
+/// Parameters:
+///  * reset - an optional boolean, default false, specifying whether the counters should be reset to 0 after they are returned.
+///
+/// Returns:
+///  * a table containing the following keys:
+///    * bytesRead      - the number of bytes read from the file
+///    * linesRead      - the number of complete lines read from the file
+///    * linesDelivered - the number of lines passed to the callback
+///    * linesDropped   - the number of lines discarded because the callback could not keep up or they were longer than the buffer
+///    * batches        - the number of times the callback has been invoked
+///    * truncations    - the number of times the file has been truncated
+///    * rotations      - the number of times the file has been deleted or replaced
+///    * pending        - the number of lines currently waiting to be passed to the callback
+///    * bufferUsed     - the number of bytes of the buffer currently in use
+///    * elapsed        - the number of seconds the counters cover
+///    * linesPerSecond - `linesRead` divided by `elapsed`
+///    * notifier       - "kqueue" or "poll", the method currently being used to detect changes to the file, or "none" if the tailer is stopped
+static int tail_stats(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TBOOLEAN | LS_TOPTIONAL, LS_TBREAK] ;
+    HSASMCGSTailer *tailer = [skin toNSObjectAtIndex:1] ;
+    [tailer pushStats:L reset:(lua_gettop(L) > 1 && lua_toboolean(L, 2))] ;
+    return 1 ;
+}
+
+#pragma mark - Lua<->NSObject Conversion Functions
+// These must not throw a lua error to ensure LuaSkin can safely be used from Objective-C
+// delegates and blocks.
+
+static int pushHSASMCGSTailer(lua_State *L, id obj) {
+    HSASMCGSTailer *value = obj;
+    value.selfRefCount++ ;
+    void** valuePtr = lua_newuserdata(L, sizeof(HSASMCGSTailer *));
+    *valuePtr = (__bridge_retained void *)value;
+    luaL_getmetatable(L, USERDATA_TAG);
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+static id toHSASMCGSTailerFromLua(lua_State *L, int idx) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    HSASMCGSTailer *value ;
+    if (luaL_testudata(L, idx, USERDATA_TAG)) {
+        value = get_objectFromUserdata(__bridge HSASMCGSTailer, L, idx, USERDATA_TAG) ;
+    } else {
+        [skin logError:[NSString stringWithFormat:@"expected %s object, found %s", USERDATA_TAG,
+                                                   lua_typename(L, lua_type(L, idx))]] ;
+    }
+    return value ;
+}
+
+#pragma mark - Hammerspoon/Lua Infrastructure
+
+static int userdata_tostring(lua_State* L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    HSASMCGSTailer *obj = [skin luaObjectAtIndex:1 toClass:"HSASMCGSTailer"] ;
+    NSString *title = [NSString stringWithFormat:@"%@%@", obj.path.lastPathComponent, (obj.running ? @"" : @", stopped")] ;
+    [skin pushNSObject:[NSString stringWithFormat:@"%s: %@ (%p)", USERDATA_TAG, title, lua_topointer(L, 1)]] ;
+    return 1 ;
+}
+
+static int userdata_eq(lua_State* L) {
+// can't get here if at least one of us isn't a userdata type, and we only care if both types are ours,
+// so use luaL_testudata before the macro causes a lua error
+    if (luaL_testudata(L, 1, USERDATA_TAG) && luaL_testudata(L, 2, USERDATA_TAG)) {
+        LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+        HSASMCGSTailer *obj1 = [skin luaObjectAtIndex:1 toClass:"HSASMCGSTailer"] ;
+        HSASMCGSTailer *obj2 = [skin luaObjectAtIndex:2 toClass:"HSASMCGSTailer"] ;
+        lua_pushboolean(L, [obj1 isEqualTo:obj2]) ;
+    } else {
+        lua_pushboolean(L, NO) ;
+    }
+    return 1 ;
+}
+
+static int userdata_gc(lua_State* L) {
+    HSASMCGSTailer *obj = get_objectFromUserdata(__bridge_transfer HSASMCGSTailer, L, 1, USERDATA_TAG) ;
+    if (obj) {
+        obj.selfRefCount-- ;
+        if (obj.selfRefCount == 0) {
+            LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+            [obj stop] ;
+            obj.callbackRef = [skin luaUnref:refTable ref:obj.callbackRef] ;
+            obj = nil ;
+        }
+    }
+
+    // Remove the Metatable so future use of the variable in Lua won't think its valid
+    lua_pushnil(L) ;
+    lua_setmetatable(L, 1) ;
+    return 0 ;
+}
+
+// Metatable for userdata objects
+static const luaL_Reg userdata_metaLib[] = {
+    {"start",      tail_start},
+    {"stop",       tail_stop},
+    {"isRunning",  tail_isRunning},
+    {"path",       tail_path},
+    {"offset",     tail_offset},
+    {"stats",      tail_stats},
+
+    {"__tostring", userdata_tostring},
+    {"__eq",       userdata_eq},
+    {"__gc",       userdata_gc},
+    {NULL,         NULL}
+};
+
+// Functions for returned object when module loads
+static luaL_Reg moduleLib[] = {
+    {"new",      tail_new},
+    {"logFiles", tail_logFiles},
+    {NULL,       NULL}
+};
+
+// // Metatable for module, if needed
+// static const luaL_Reg module_metaLib[] = {
+//     {"__gc", meta_gc},
+//     {NULL,   NULL}
+// };
+
+int luaopen_hs__asm_undocumented_cgsdebug_tailer(lua_State* L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    refTable = [skin registerLibraryWithObject:USERDATA_TAG
+                                     functions:moduleLib
+                                 metaFunctions:nil    // or module_metaLib
+                               objectFunctions:userdata_metaLib] ;
+
+    [skin registerPushNSHelper:pushHSASMCGSTailer         forClass:"HSASMCGSTailer"];
+    [skin registerLuaObjectHelper:toHSASMCGSTailerFromLua forClass:"HSASMCGSTailer"
+                                               withUserdataMapping:USERDATA_TAG];
+
+    return 1;
+}
@@ -0,0 +1,34 @@
+@import Cocoa ;
+@import LuaSkin ;
+
+// Loader for the combined build of the submodules in this repository (see the Makefile in this directory).
+//
+// Every submodule's source is linked into this one library, but none of them are registered when it is
+// loaded; instead each module's luaopen function is added to package.preload, so its functions, metatables
+// and constants are only set up the first time it is required. The init.lua file of each submodule loads
+// this library, when it is installed, before requiring its internal modules.
+
+// combined_modules.h is generated by the Makefile from the luaopen functions in the submodules' sources
+#define COMBINED_MODULE(name, luaopen) extern int luaopen(lua_State* L) ;
+#include "combined_modules.h"
+#undef COMBINED_MODULE
+
+static const luaL_Reg combinedModules[] = {
+#define COMBINED_MODULE(name, luaopen) {name, luaopen},
+#include "combined_modules.h"
+#undef COMBINED_MODULE
+    {NULL, NULL}
+} ;
+
+// returns an array of the module names added to package.preload
+int luaopen_hs__asm_undocumented_combined(lua_State* L) {
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_PRELOAD_TABLE) ;
+    lua_newtable(L) ;
+    lua_Integer count = 0 ;
+    for (const luaL_Reg *entry = combinedModules ; entry->name ; entry++) {
+        lua_pushcfunction(L, entry->func) ; lua_setfield(L, -3, entry->name) ;
+        lua_pushstring(L, entry->name) ;    lua_rawseti(L, -2, ++count) ;
+    }
+    lua_remove(L, -2) ;
+    return 1 ;
+}
@@ -0,0 +1,89 @@
+//
+// hsasm_checkargs.h
+// Argument checks which only ask LuaSkin when the arguments are wrong
+//
+// HSASM_CHECKARGS takes the same type masks as LuaSkin's checkArgs:
+//
+//     HSASM_CHECKARGS(L, LS_TNUMBER | LS_TOPTIONAL, LS_TBREAK) ;
+//
+// The masks are stored in a static array at each call site and compared against lua_type for each argument,
+// so a valid call costs a few integer tests and no message sends. When an argument doesn't match, or the
+// signature uses a mask this check doesn't understand, the same masks are passed to checkArgs, which raises
+// the usual error with its full description of the expected and actual arguments.
+//
+// Only the basic types, LS_TINTEGER (with LS_TNUMBER), LS_TANY, LS_TNONE and LS_TOPTIONAL are checked here.
+// LS_TUSERDATA and the other masks which take an extra argument can't be stored in the array, so signatures
+// that use them should keep calling checkArgs directly.
+//
+// The matcher itself is plain C over lua_gettop, lua_type and lua_isinteger, so test/test_hsasm_checkargs.c
+// and bench/bench_hsasm_checkargs.c run it on Linux against the stand-in Lua stack in test/stubs/lua.h,
+// which must be included first; only the macro needs LuaSkin.
+//
+// Define HSASM_CHECKARGS_DEBUG (e.g. `make DEBUG_CFLAGS="-g -DHSASM_CHECKARGS_DEBUG"`) to skip the fast
+// check and always call checkArgs.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __OBJC__
+#import <LuaSkin/LuaSkin.h>
+#endif
+
+// the masks this check understands; anything else is left to checkArgs
+#define HSASM_CHECKARGS_KNOWN (LS_TBREAK | LS_TOPTIONAL | LS_TNIL | LS_TBOOLEAN | LS_TNUMBER | LS_TINTEGER | \
+                               LS_TSTRING | LS_TTABLE | LS_TFUNCTION | LS_TNONE | LS_TANY)
+
+// returns true if the arguments certainly match the signature; false means checkArgs should decide
+static inline bool hsasm_checkargs_match(lua_State *L, const int *signature, size_t count) {
+    int top = lua_gettop(L) ;
+    for (size_t i = 0 ; i < count ; i++) {
+        int mask = signature[i] ;
+        int idx  = (int)i + 1 ;
+        if ((mask & ~HSASM_CHECKARGS_KNOWN) != 0) return false ;
+        if (mask & LS_TBREAK) return (idx > top) ;
+
+        int type = lua_type(L, idx) ;
+        if (type == LUA_TNONE) {
+            if (mask & (LS_TOPTIONAL | LS_TNONE)) continue ;
+            return false ;
+        }
+        if (mask & LS_TANY) continue ;
+
+        switch (type) {
+            case LUA_TNIL:      if (!(mask & LS_TNIL))      return false ; break ;
+            case LUA_TBOOLEAN:  if (!(mask & LS_TBOOLEAN))  return false ; break ;
+            case LUA_TSTRING:   if (!(mask & LS_TSTRING))   return false ; break ;
+            case LUA_TTABLE:    if (!(mask & LS_TTABLE))    return false ; break ;
+            case LUA_TFUNCTION: if (!(mask & LS_TFUNCTION)) return false ; break ;
+            case LUA_TNUMBER:
+                if (!(mask & LS_TNUMBER)) return false ;
+                if ((mask & LS_TINTEGER) && !lua_isinteger(L, idx)) return false ;
+                break ;
+            default:
+                return false ;
+        }
+    }
+    // every signature should end with LS_TBREAK
+    return false ;
+}
+
+#ifdef __OBJC__
+
+#ifdef HSASM_CHECKARGS_DEBUG
+
+#define HSASM_CHECKARGS(L, ...) [[LuaSkin sharedWithState:(L)] checkArgs:__VA_ARGS__]
+
+#else
+
+#define HSASM_CHECKARGS(L, ...) do {                                                                   \
+    static const int hsasm_signature[] = { __VA_ARGS__ } ;                                            \
+    if (!hsasm_checkargs_match((L), hsasm_signature, sizeof(hsasm_signature) / sizeof(int))) {         \
+        [[LuaSkin sharedWithState:(L)] checkArgs:__VA_ARGS__] ;                                        \
+    }                                                                                                  \
+} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,312 @@
+//
+// hsasm_constants.h
+// Read-only constant tables backed by compile-time arrays
+//
+// A constants table is declared from a static array of name/value pairs and pushed into Lua as a userdata.
+// Indexing it with a name returns the value, and indexing it with a value returns the name, using index
+// arrays which are sorted the first time the table is used. Names are found by binary search. Values are
+// found by a plain scan of the value index in tables of up to HSASM_CONSTANTS_LINEAR entries, where
+// comparing integers in order beats the search's unpredictable branches, and by binary search above that;
+// bench/bench_hsasm_constants.c measures where the two cross. Lookups allocate nothing:
+// the name strings are created once, when the userdata is pushed, and kept in its user value along with
+// the rendering returned by tostring, which is built on first use.
+//
+//     static const hsasm_constant exampleValues[] = {
+//         { "first",  1 },
+//         { "second", 2 },
+//     } ;
+//     static hsasm_constants exampleConstants = HSASM_CONSTANTS("example", exampleValues) ;
+//     ...
+//     hsasm_constants_push(L, &exampleConstants, USERDATA_TAG ".constants") ;
+//
+// The metatable is registered under the name passed to hsasm_constants_push, so each module should use its
+// own. If more than one name has the same value, looking up the value returns the first name in sorted order.
+//
+// The lookups, the iteration order and the rendering are plain C, tested by test/test_hsasm_constants.c and
+// compared with the linear scans they replaced by bench/bench_hsasm_constants.c; the Lua side is only built
+// for the modules themselves.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define HSASM_CONSTANTS_MAX    64
+#define HSASM_CONSTANTS_LINEAR 20 // value lookups in tables up to this size scan rather than search
+
+typedef struct {
+    const char *name ;
+    int64_t    value ;
+} hsasm_constant ;
+
+typedef struct {
+    const char           *name ;
+    const hsasm_constant *entries ;
+    size_t               count ;
+    bool                 sorted ;
+    bool                 distinctValues ;               // no two entries share a value
+    uint8_t              byName[HSASM_CONSTANTS_MAX] ;  // indices into entries, sorted by name
+    uint8_t              byValue[HSASM_CONSTANTS_MAX] ; // indices into entries, sorted by value then name
+} hsasm_constants ;
+
+#define HSASM_CONSTANTS(label, array) { .name = (label), .entries = (array), .count = sizeof(array) / sizeof((array)[0]) }
+
+static inline int hsasm_constants_compareValues(const hsasm_constant *a, const hsasm_constant *b) {
+    if (a->value != b->value) return (a->value < b->value) ? -1 : 1 ;
+    return strcmp(a->name, b->name) ;
+}
+
+// tables with more than HSASM_CONSTANTS_MAX entries are left unsorted; hsasm_constants_push refuses them
+static inline void hsasm_constants_sort(hsasm_constants *constants) {
+    if (constants->sorted || constants->count > HSASM_CONSTANTS_MAX) return ;
+    const hsasm_constant *entries = constants->entries ;
+    // the tables are small and sorted once, so insertion sort is enough
+    for (size_t i = 0 ; i < constants->count ; i++) {
+        size_t j ;
+        for (j = i ; j > 0 && strcmp(entries[constants->byName[j - 1]].name, entries[i].name) > 0 ; j--) {
+            constants->byName[j] = constants->byName[j - 1] ;
+        }
+        constants->byName[j] = (uint8_t)i ;
+        for (j = i ; j > 0 && hsasm_constants_compareValues(&entries[constants->byValue[j - 1]], &entries[i]) > 0 ; j--) {
+            constants->byValue[j] = constants->byValue[j - 1] ;
+        }
+        constants->byValue[j] = (uint8_t)i ;
+    }
+    constants->distinctValues = true ;
+    for (size_t i = 1 ; i < constants->count ; i++) {
+        if (entries[constants->byValue[i - 1]].value == entries[constants->byValue[i]].value) constants->distinctValues = false ;
+    }
+    constants->sorted = true ;
+}
+
+// returns the position in name order of the named constant, or -1
+static inline int hsasm_constants_positionOfName(hsasm_constants *constants, const char *name) {
+    hsasm_constants_sort(constants) ;
+    if (!constants->sorted) return -1 ;
+    size_t low = 0, high = constants->count ;
+    while (low < high) {
+        size_t mid   = low + (high - low) / 2 ;
+        int    order = strcmp(constants->entries[constants->byName[mid]].name, name) ;
+        if (order == 0) return (int)mid ;
+        if (order < 0) {
+            low = mid + 1 ;
+        } else {
+            high = mid ;
+        }
+    }
+    return -1 ;
+}
+
+// returns the index into entries of the named constant, or -1
+static inline int hsasm_constants_indexOfName(hsasm_constants *constants, const char *name) {
+    int position = hsasm_constants_positionOfName(constants, name) ;
+    return (position < 0) ? -1 : constants->byName[position] ;
+}
+
+// returns the index into entries of the first constant with the value, or -1
+static inline int hsasm_constants_indexOfValue(hsasm_constants *constants, int64_t value) {
+    hsasm_constants_sort(constants) ;
+    if (!constants->sorted) return -1 ;
+    if (constants->count <= HSASM_CONSTANTS_LINEAR) {
+        // with distinct values any match is the only one, so the entries are scanned as they are; otherwise the
+        // value index is, which is in name order within a value, so the first match is the one the search finds
+        if (constants->distinctValues) {
+            for (size_t i = 0 ; i < constants->count ; i++) {
+                if (constants->entries[i].value == value) return (int)i ;
+            }
+        } else {
+            for (size_t i = 0 ; i < constants->count ; i++) {
+                if (constants->entries[constants->byValue[i]].value == value) return constants->byValue[i] ;
+            }
+        }
+        return -1 ;
+    }
+    size_t low = 0, high = constants->count ;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2 ;
+        if (constants->entries[constants->byValue[mid]].value < value) {
+            low = mid + 1 ;
+        } else {
+            high = mid ;
+        }
+    }
+    return (low < constants->count && constants->entries[constants->byValue[low]].value == value) ? constants->byValue[low] : -1 ;
+}
+
+// for iterating in name order: returns the index into entries of the constant after the named one, or of the
+// first constant if name is NULL; -1 after the last, and -2 if name isn't in the table
+static inline int hsasm_constants_following(hsasm_constants *constants, const char *name) {
+    hsasm_constants_sort(constants) ;
+    int position = -1 ;
+    if (name) {
+        position = hsasm_constants_positionOfName(constants, name) ;
+        if (position < 0) return -2 ;
+    }
+    return ((size_t)(position + 1) < constants->count && constants->sorted) ? constants->byName[position + 1] : -1 ;
+}
+
+// Writes one line per constant, in name order with the values aligned, as snprintf would: at most size bytes
+// including the terminator, returning the length of the whole rendering.
+static inline size_t hsasm_constants_render(hsasm_constants *constants, char *buffer, size_t size) {
+    hsasm_constants_sort(constants) ;
+    if (!constants->sorted) return 0 ;
+    int width = 0 ;
+    for (size_t i = 0 ; i < constants->count ; i++) {
+        int length = (int)strlen(constants->entries[i].name) ;
+        if (length > width) width = length ;
+    }
+    size_t length = 0 ;
+    if (size > 0) buffer[0] = '\0' ;
+    for (size_t i = 0 ; i < constants->count ; i++) {
+        const hsasm_constant *entry = &constants->entries[constants->byName[i]] ;
+        size_t               room   = (length < size) ? size - length : 0 ;
+        int                  added  = snprintf(room ? buffer + length : NULL, room, "%-*s %lld\n", width, entry->name, (long long)entry->value) ;
+        if (added > 0) length += (size_t)added ;
+    }
+    return length ;
+}
+
+#ifdef __OBJC__
+
+#import <LuaSkin/LuaSkin.h>
+
+// the user value of a constants userdata holds the name strings at 1..count and the tostring rendering at 0
+#define HSASM_CONSTANTS_RENDERING 0
+
+static inline int hsasm_constants_index(lua_State *L) ;
+
+// the metatable name differs between modules, so a constants userdata is recognized by its __index
+static inline hsasm_constants *hsasm_constants_check(lua_State *L, int idx) {
+    if (lua_type(L, idx) == LUA_TUSERDATA && lua_getmetatable(L, idx)) {
+        lua_getfield(L, -1, "__index") ;
+        bool isConstants = (lua_tocfunction(L, -1) == hsasm_constants_index) ;
+        lua_pop(L, 2) ;
+        if (isConstants) return *(hsasm_constants **)lua_touserdata(L, idx) ;
+    }
+    luaL_argerror(L, idx, "expected a table of constants") ;
+    return NULL ;
+}
+
+static inline int hsasm_constants_index(lua_State *L) {
+    hsasm_constants *constants = hsasm_constants_check(L, 1) ;
+    int             idx        = -1 ;
+    if (lua_type(L, 2) == LUA_TSTRING) {
+        idx = hsasm_constants_indexOfName(constants, lua_tostring(L, 2)) ;
+        if (idx >= 0) {
+            lua_pushinteger(L, (lua_Integer)constants->entries[idx].value) ;
+            return 1 ;
+        }
+    } else if (lua_isinteger(L, 2)) {
+        idx = hsasm_constants_indexOfValue(constants, lua_tointeger(L, 2)) ;
+        if (idx >= 0) {
+            lua_getuservalue(L, 1) ;
+            lua_rawgeti(L, -1, idx + 1) ;
+            return 1 ;
+        }
+    }
+    lua_pushnil(L) ;
+    return 1 ;
+}
+
+static inline int hsasm_constants_newindex(lua_State *L) {
+    return luaL_error(L, "attempt to modify a table of constants") ;
+}
+
+// iterates in name order; the control variable is the previous name
+static inline int hsasm_constants_next(lua_State *L) {
+    hsasm_constants *constants = hsasm_constants_check(L, 1) ;
+    int             idx        = hsasm_constants_following(constants, lua_isnoneornil(L, 2) ? NULL : luaL_checkstring(L, 2)) ;
+    if (idx == -2) return luaL_argerror(L, 2, "not a name in this table of constants") ;
+    if (idx < 0) return 0 ;
+
+    lua_getuservalue(L, 1) ;
+    lua_rawgeti(L, -1, idx + 1) ;
+    lua_pushinteger(L, (lua_Integer)constants->entries[idx].value) ;
+    return 2 ;
+}
+
+static inline int hsasm_constants_pairs(lua_State *L) {
+    hsasm_constants_check(L, 1) ;
+    lua_pushcfunction(L, hsasm_constants_next) ;
+    lua_pushvalue(L, 1) ;
+    lua_pushnil(L) ;
+    return 3 ;
+}
+
+static inline int hsasm_constants_len(lua_State *L) {
+    lua_pushinteger(L, (lua_Integer)hsasm_constants_check(L, 1)->count) ;
+    return 1 ;
+}
+
+// one line per constant, in name order, with the values aligned
+static inline int hsasm_constants_tostring(lua_State *L) {
+    hsasm_constants *constants = hsasm_constants_check(L, 1) ;
+    lua_getuservalue(L, 1) ;
+    if (lua_rawgeti(L, -1, HSASM_CONSTANTS_RENDERING) == LUA_TSTRING) return 1 ;
+    lua_pop(L, 1) ;
+
+    size_t      length = hsasm_constants_render(constants, NULL, 0) ;
+    luaL_Buffer buffer ;
+    char        *rendering = luaL_buffinitsize(L, &buffer, length + 1) ;
+    hsasm_constants_render(constants, rendering, length + 1) ;
+    luaL_pushresultsize(&buffer, length) ;
+    lua_pushvalue(L, -1) ;
+    lua_rawseti(L, -3, HSASM_CONSTANTS_RENDERING) ;
+    return 1 ;
+}
+
+static const luaL_Reg hsasm_constants_metaLib[] = {
+    {"__index",    hsasm_constants_index},
+    {"__newindex", hsasm_constants_newindex},
+    {"__pairs",    hsasm_constants_pairs},
+    {"__len",      hsasm_constants_len},
+    {"__tostring", hsasm_constants_tostring},
+    {NULL,         NULL}
+} ;
+
+static inline int hsasm_constants_groupPairs(lua_State *L) {
+    lua_getglobal(L, "next") ;
+    lua_getmetatable(L, 1) ;
+    lua_getfield(L, -1, "__index") ;
+    lua_remove(L, -2) ;
+    lua_pushnil(L) ;
+    return 3 ;
+}
+
+// replaces the table on the top of the stack, e.g. one holding several constants userdata, with a read-only proxy
+static inline void hsasm_constants_freeze(lua_State *L) {
+    lua_newtable(L) ;
+    lua_createtable(L, 0, 4) ;
+    lua_pushvalue(L, -3) ;                                lua_setfield(L, -2, "__index") ;
+    lua_pushcfunction(L, hsasm_constants_newindex) ;      lua_setfield(L, -2, "__newindex") ;
+    lua_pushcfunction(L, hsasm_constants_groupPairs) ;    lua_setfield(L, -2, "__pairs") ;
+    lua_pushboolean(L, 0) ;                               lua_setfield(L, -2, "__metatable") ;
+    lua_setmetatable(L, -2) ;
+    lua_remove(L, -2) ;
+}
+
+// pushes a userdata for the constants table; `tag` names the metatable, creating it if necessary
+static inline void hsasm_constants_push(lua_State *L, hsasm_constants *constants, const char *tag) {
+    if (constants->count > HSASM_CONSTANTS_MAX) {
+        luaL_error(L, "%s has more than %d constants", constants->name, HSASM_CONSTANTS_MAX) ;
+        return ;
+    }
+    hsasm_constants_sort(constants) ;
+
+    hsasm_constants **userdata = (hsasm_constants **)lua_newuserdata(L, sizeof(hsasm_constants *)) ;
+    *userdata = constants ;
+    if (luaL_newmetatable(L, tag)) luaL_setfuncs(L, hsasm_constants_metaLib, 0) ;
+    lua_setmetatable(L, -2) ;
+
+    lua_createtable(L, (int)constants->count, 1) ;
+    for (size_t i = 0 ; i < constants->count ; i++) {
+        lua_pushstring(L, constants->entries[i].name) ;
+        lua_rawseti(L, -2, (lua_Integer)i + 1) ;
+    }
+    lua_setuservalue(L, -2) ;
+}
+
+#endif
@@ -0,0 +1,308 @@
+//
+// hsasm_executor.h
+// Serial background lanes for private API calls which may block
+//
+// A lane is a serial dispatch queue for one subsystem (the Dock, the WindowServer debug options, the
+// bluetooth controller), so calls to that subsystem still happen in the order they were made but no
+// longer block the main thread while the other process responds. Every lane targets the same utility
+// QoS queue, so the number of threads used is bounded by the number of lanes which are busy.
+//
+// Work is submitted with hsasm_lane_async, which runs the work block on the lane and then, on the main
+// thread, the completion block followed by the notification block. A lane accepts at most `limit`
+// outstanding submissions; beyond that hsasm_lane_async returns NO so the caller can tell Lua the request
+// was refused instead of letting the queue grow without bound.
+//
+// Functions which still call a subsystem synchronously should call hsasm_lane_barrier first so their
+// call isn't reordered ahead of work already queued on the lane. The barrier also runs the completions of
+// that work before returning, so state they update on the main thread is current for the caller. It never
+// runs notifications: those call back into Lua, and a getter which waits on the lane must not run user
+// code in the middle of its own call, so they are left for the next turn of the run loop. Completions
+// should therefore only update module state, and anything which calls Lua belongs in the notification.
+//
+// The bookkeeping -- the depth limit, the list of finished work, the barrier and the generation which
+// hsasm_lane_abandon uses to discard what is still queued -- is plain C and pthreads, and is exercised with
+// a pthread standing in for the dispatch queue by test/test_hsasm_executor.c. The dispatch queue, the
+// blocks and the Lua side are only built for the modules themselves.
+
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    HSASM_LANE_COMPLETE, // the work has run; update module state
+    HSASM_LANE_NOTIFY,   // a later turn of the run loop; call back into Lua
+    HSASM_LANE_RELEASE,  // the item is finished with, whether or not it completed
+} hsasm_lanePhase ;
+
+// One submission. The caller embeds it at the start of its own allocation; run is called on the main
+// thread with each phase in turn, and with HSASM_LANE_RELEASE alone if the lane was abandoned first.
+typedef struct hsasm_laneItem {
+    struct hsasm_laneItem *next ;
+    uint32_t              generation ;
+    bool                  notifies ;
+    void                  (*run)(struct hsasm_laneItem *item, hsasm_lanePhase phase) ;
+} hsasm_laneItem ;
+
+typedef struct {
+    const char       *name ;
+    uint32_t         limit ;
+    void             *queue ;     // a retained dispatch_queue_t, created on first use
+    _Atomic uint32_t depth ;      // submitted but not yet completed
+    _Atomic uint32_t peakDepth ;
+    _Atomic uint64_t submitted ;
+    _Atomic uint64_t completed ;
+    _Atomic uint64_t rejected ;
+    _Atomic uint64_t barriers ;   // synchronous callers which had to wait for the lane
+    _Atomic uint64_t waitTicks ;  // time between submission and the work starting
+    _Atomic uint64_t runTicks ;   // time spent running work blocks
+    uint32_t         generation ; // items submitted before hsasm_lane_abandon are only released
+
+    pthread_mutex_t  lock ;       // guards workDone and the finished list
+    pthread_cond_t   ran ;        // signalled as each work item finishes
+    uint64_t         workDone ;
+    hsasm_laneItem   *finished ;  // work which has run, oldest first, waiting to complete
+    hsasm_laneItem   *finishedTail ;
+    hsasm_laneItem   *pending ;   // completed items waiting to notify; only touched on the main thread
+    hsasm_laneItem   *pendingTail ;
+} hsasm_lane ;
+
+#define HSASM_LANE(label, maxDepth) {                                                                  \
+    .name = (label), .limit = (maxDepth), .lock = PTHREAD_MUTEX_INITIALIZER, .ran = PTHREAD_COND_INITIALIZER \
+}
+
+// Claims a place on the lane for item, or counts a rejection and returns false when `limit` submissions
+// are already outstanding. Called on the main thread before the work is queued.
+static inline bool hsasm_lane_reserve(hsasm_lane *lane, hsasm_laneItem *item) {
+    uint32_t depth = atomic_load_explicit(&lane->depth, memory_order_relaxed) ;
+    do {
+        if (depth >= lane->limit) {
+            atomic_fetch_add_explicit(&lane->rejected, 1, memory_order_relaxed) ;
+            return false ;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&lane->depth, &depth, depth + 1, memory_order_relaxed, memory_order_relaxed)) ;
+
+    uint32_t peak = atomic_load_explicit(&lane->peakDepth, memory_order_relaxed) ;
+    while (depth + 1 > peak &&
+           !atomic_compare_exchange_weak_explicit(&lane->peakDepth, &peak, depth + 1, memory_order_relaxed, memory_order_relaxed)) ;
+    atomic_fetch_add_explicit(&lane->submitted, 1, memory_order_relaxed) ;
+    item->next       = NULL ;
+    item->generation = lane->generation ;
+    return true ;
+}
+
+// called on the lane once the item's work has run
+static inline void hsasm_lane_finish(hsasm_lane *lane, hsasm_laneItem *item) {
+    item->next = NULL ;
+    pthread_mutex_lock(&lane->lock) ;
+    if (lane->finishedTail) {
+        lane->finishedTail->next = item ;
+    } else {
+        lane->finished = item ;
+    }
+    lane->finishedTail = item ;
+    lane->workDone++ ;
+    pthread_cond_broadcast(&lane->ran) ;
+    pthread_mutex_unlock(&lane->lock) ;
+}
+
+// Completes, on the main thread, the items whose work has finished, in the order they were submitted.
+// They are removed one at a time so a completion which calls back into the lane can complete the rest.
+// Returns true if notifications are left pending for hsasm_lane_notify.
+static inline bool hsasm_lane_drain(hsasm_lane *lane) {
+    while (true) {
+        pthread_mutex_lock(&lane->lock) ;
+        hsasm_laneItem *item = lane->finished ;
+        if (item) {
+            lane->finished = item->next ;
+            if (!lane->finished) lane->finishedTail = NULL ;
+        }
+        pthread_mutex_unlock(&lane->lock) ;
+        if (!item) break ;
+
+        atomic_fetch_sub_explicit(&lane->depth, 1, memory_order_relaxed) ;
+        atomic_fetch_add_explicit(&lane->completed, 1, memory_order_relaxed) ;
+        if (item->generation != lane->generation) {
+            item->run(item, HSASM_LANE_RELEASE) ;
+            continue ;
+        }
+        if (!item->notifies) {
+            item->run(item, HSASM_LANE_COMPLETE) ;
+            item->run(item, HSASM_LANE_RELEASE) ;
+            continue ;
+        }
+        // queued before it completes, so a completion which drains the rest doesn't notify them first
+        item->next = NULL ;
+        if (lane->pendingTail) {
+            lane->pendingTail->next = item ;
+        } else {
+            lane->pending = item ;
+        }
+        lane->pendingTail = item ;
+        item->run(item, HSASM_LANE_COMPLETE) ;
+    }
+    return lane->pending != NULL ;
+}
+
+// Runs the pending notifications, oldest first, on the main thread. Like the completions, they are
+// removed one at a time, so a notification may wait on the lane or submit more work.
+static inline void hsasm_lane_notify(hsasm_lane *lane) {
+    hsasm_laneItem *item ;
+    while ((item = lane->pending)) {
+        lane->pending = item->next ;
+        if (!lane->pending) lane->pendingTail = NULL ;
+        if (item->generation == lane->generation) item->run(item, HSASM_LANE_NOTIFY) ;
+        item->run(item, HSASM_LANE_RELEASE) ;
+    }
+}
+
+// Blocks until the work submitted so far has run; returns false without waiting if nothing is outstanding.
+// Must be called on the main thread, and not from the lane. The depth isn't decremented until an item has
+// completed, so an idle lane costs a single load here.
+static inline bool hsasm_lane_wait(hsasm_lane *lane) {
+    if (atomic_load_explicit(&lane->depth, memory_order_relaxed) == 0) return false ;
+    atomic_fetch_add_explicit(&lane->barriers, 1, memory_order_relaxed) ;
+    uint64_t submitted = atomic_load_explicit(&lane->submitted, memory_order_relaxed) ;
+    pthread_mutex_lock(&lane->lock) ;
+    while (lane->workDone < submitted) pthread_cond_wait(&lane->ran, &lane->lock) ;
+    pthread_mutex_unlock(&lane->lock) ;
+    return true ;
+}
+
+// Waits for the submitted work and completes it, leaving its notifications pending; returns true if there
+// are notifications for the caller to schedule on a later turn.
+static inline bool hsasm_lane_settle(hsasm_lane *lane) {
+    return hsasm_lane_wait(lane) && hsasm_lane_drain(lane) ;
+}
+
+// Waits for the submitted work and releases everything which hasn't completed or notified yet; used when
+// the module is garbage collected, since completions and notifications would refer to the Lua state being
+// torn down. Not to be called from a completion or a notification.
+static inline void hsasm_lane_abandon(hsasm_lane *lane) {
+    (void)hsasm_lane_wait(lane) ;
+    lane->generation++ ;
+    (void)hsasm_lane_drain(lane) ;
+    hsasm_lane_notify(lane) ;
+}
+
+#ifdef __OBJC__
+
+#import <Foundation/Foundation.h>
+#import <LuaSkin/LuaSkin.h>
+#include <mach/mach_time.h>
+
+typedef struct {
+    hsasm_laneItem item ;
+    void           *completion ;   // retained dispatch_block_t, or NULL
+    void           *notification ; // retained dispatch_block_t, or NULL
+} hsasm_laneBlocks ;
+
+static inline void hsasm_lane_runBlocks(hsasm_laneItem *item, hsasm_lanePhase phase) {
+    hsasm_laneBlocks *blocks = (hsasm_laneBlocks *)item ;
+    switch (phase) {
+        case HSASM_LANE_COMPLETE:
+            if (blocks->completion) ((__bridge dispatch_block_t)blocks->completion)() ;
+            break ;
+        case HSASM_LANE_NOTIFY:
+            if (blocks->notification) ((__bridge dispatch_block_t)blocks->notification)() ;
+            break ;
+        case HSASM_LANE_RELEASE:
+            if (blocks->completion) (void)(__bridge_transfer dispatch_block_t)blocks->completion ;
+            if (blocks->notification) (void)(__bridge_transfer dispatch_block_t)blocks->notification ;
+            free(blocks) ;
+            break ;
+    }
+}
+
+static inline dispatch_queue_t hsasm_lane_queue(hsasm_lane *lane) {
+    // lanes are only submitted to from the main thread, so creating the queue lazily here doesn't race
+    if (!lane->queue) {
+        dispatch_queue_attr_t attributes = dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0) ;
+        lane->queue = (__bridge_retained void *)dispatch_queue_create(lane->name, attributes) ;
+    }
+    return (__bridge dispatch_queue_t)lane->queue ;
+}
+
+// a turn of the main run loop which completes whatever has finished and then runs every notification
+static inline void hsasm_lane_deliver(hsasm_lane *lane) {
+    (void)hsasm_lane_drain(lane) ;
+    hsasm_lane_notify(lane) ;
+}
+
+// Runs work on the lane, then completion and, on a turn of the run loop which isn't inside a barrier,
+// notification; either may be nil. Returns NO, without running anything, if the lane is full.
+static inline BOOL hsasm_lane_async(hsasm_lane *lane, dispatch_block_t work, dispatch_block_t completion, dispatch_block_t notification) {
+    hsasm_laneBlocks *blocks = calloc(1, sizeof(hsasm_laneBlocks)) ;
+    if (!blocks) return NO ;
+    if (!hsasm_lane_reserve(lane, &blocks->item)) {
+        free(blocks) ;
+        return NO ;
+    }
+    blocks->item.run      = hsasm_lane_runBlocks ;
+    blocks->item.notifies = (notification != nil) ;
+    if (completion) blocks->completion = (__bridge_retained void *)[completion copy] ;
+    if (notification) blocks->notification = (__bridge_retained void *)[notification copy] ;
+
+    uint64_t queuedAt = mach_absolute_time() ;
+    dispatch_async(hsasm_lane_queue(lane), ^{
+        uint64_t startedAt = mach_absolute_time() ;
+        work() ;
+        atomic_fetch_add_explicit(&lane->waitTicks, startedAt - queuedAt, memory_order_relaxed) ;
+        atomic_fetch_add_explicit(&lane->runTicks, mach_absolute_time() - startedAt, memory_order_relaxed) ;
+        hsasm_lane_finish(lane, &blocks->item) ;
+        // a barrier may already have completed it by the time this is delivered, in which case only its
+        // notification, if any, is left
+        dispatch_async(dispatch_get_main_queue(), ^{ hsasm_lane_deliver(lane) ; }) ;
+    }) ;
+    return YES ;
+}
+
+// Blocks until the work queued on the lane has run, then runs its completions. Its notifications are
+// scheduled for the next turn of the run loop, so no Lua callback runs inside the caller. Must be called
+// on the main thread, and not from a work block.
+static inline void hsasm_lane_barrier(hsasm_lane *lane) {
+    if (hsasm_lane_settle(lane)) dispatch_async(dispatch_get_main_queue(), ^{ hsasm_lane_notify(lane) ; }) ;
+}
+
+static inline double hsasm_lane_ticksToSeconds(uint64_t ticks) {
+    static mach_timebase_info_data_t timebase = { 0, 0 } ;
+    if (timebase.denom == 0) mach_timebase_info(&timebase) ;
+    return (double)ticks * timebase.numer / timebase.denom / 1e9 ;
+}
+
+// pushes a table describing the lane onto the Lua stack
+static inline void hsasm_lane_pushStats(lua_State *L, hsasm_lane *lane) {
+    uint64_t completed = atomic_load_explicit(&lane->completed, memory_order_relaxed) ;
+    double   wait      = hsasm_lane_ticksToSeconds(atomic_load_explicit(&lane->waitTicks, memory_order_relaxed)) ;
+    double   run       = hsasm_lane_ticksToSeconds(atomic_load_explicit(&lane->runTicks, memory_order_relaxed)) ;
+
+    lua_newtable(L) ;
+    lua_pushstring(L, lane->name) ;                                                                        lua_setfield(L, -2, "name") ;
+    lua_pushinteger(L, lane->limit) ;                                                                      lua_setfield(L, -2, "limit") ;
+    lua_pushinteger(L, atomic_load_explicit(&lane->depth, memory_order_relaxed)) ;                         lua_setfield(L, -2, "depth") ;
+    lua_pushinteger(L, atomic_load_explicit(&lane->peakDepth, memory_order_relaxed)) ;                     lua_setfield(L, -2, "peakDepth") ;
+    lua_pushinteger(L, (lua_Integer)atomic_load_explicit(&lane->submitted, memory_order_relaxed)) ;        lua_setfield(L, -2, "submitted") ;
+    lua_pushinteger(L, (lua_Integer)completed) ;                                                           lua_setfield(L, -2, "completed") ;
+    lua_pushinteger(L, (lua_Integer)atomic_load_explicit(&lane->rejected, memory_order_relaxed)) ;         lua_setfield(L, -2, "rejected") ;
+    lua_pushinteger(L, (lua_Integer)atomic_load_explicit(&lane->barriers, memory_order_relaxed)) ;         lua_setfield(L, -2, "barriers") ;
+    lua_pushnumber(L, (completed > 0) ? wait / (double)completed : 0.0) ;                                  lua_setfield(L, -2, "meanWait") ;
+    lua_pushnumber(L, (completed > 0) ? run / (double)completed : 0.0) ;                                   lua_setfield(L, -2, "meanRun") ;
+}
+
+// invokes the function referenced by callbackRef with the values pushed by `push`, then releases the reference
+static inline void hsasm_lane_callback(LSRefTable refTable, int callbackRef, NSString *label, int (^push)(lua_State *L)) {
+    if (callbackRef == LUA_NOREF) return ;
+    LuaSkin   *skin = [LuaSkin sharedWithState:NULL] ;
+    lua_State *L    = skin.L ;
+    _lua_stackguard_entry(L) ;
+    [skin pushLuaRef:refTable ref:callbackRef] ;
+    int nargs = push ? push(L) : 0 ;
+    [skin protectedCallAndError:label nargs:nargs nresults:0] ;
+    [skin luaUnref:refTable ref:callbackRef] ;
+    _lua_stackguard_exit(L) ;
+}
+
+#endif
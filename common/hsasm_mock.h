@@ -0,0 +1,91 @@
+//
+// hsasm_mock.h
+// Shared configuration for the in-memory mock backends
+//
+// Each module reaches its private API through a table of function pointers, and also provides a mock
+// table which keeps the state in memory instead. The mock functions call hsasm_mock_call first, which
+// sleeps for the configured latency and decides whether this call should fail, so the Lua bindings, the
+// instrumentation in hsasm_spi.h and the background lanes in hsasm_executor.h can be exercised and timed
+// without changing anything on the machine.
+//
+// A module selects its mock from Lua with `_mockBackend(true, [options])` and returns to the private API
+// with `_mockBackend(false)`; options is a table which may contain `latency` (seconds per call),
+// `failureRate` (0.0 - 1.0) and `failureCode` (the error returned by failed calls which report one).
+//
+// The mock itself is plain C, so the tests and benchmarks in test/ and bench/ drive the same mock tables
+// the modules use; the Lua functions at the end are only available when compiled as Objective-C.
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+    double           latency ;
+    double           failureRate ;
+    int32_t          failureCode ;
+    _Atomic uint64_t calls ;
+    _Atomic uint64_t failures ;
+} hsasm_mock ;
+
+#define HSASM_MOCK(code) { .latency = 0.0, .failureRate = 0.0, .failureCode = (code) }
+
+static inline double hsasm_mock_random(void) {
+#ifdef __APPLE__
+    return (double)arc4random() / (double)UINT32_MAX ;
+#else
+    static _Atomic uint64_t state = 0x9E3779B97F4A7C15ULL ;
+    uint64_t x = atomic_fetch_add_explicit(&state, 0x9E3779B97F4A7C15ULL, memory_order_relaxed) ;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL ;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL ;
+    return (double)((x ^ (x >> 31)) >> 11) / 9007199254740992.0 ;
+#endif
+}
+
+// returns true if the call should fail; mock functions which fail leave their state unchanged
+static inline bool hsasm_mock_call(hsasm_mock *mock) {
+    atomic_fetch_add_explicit(&mock->calls, 1, memory_order_relaxed) ;
+    if (mock->latency > 0) usleep((useconds_t)(mock->latency * 1000000)) ;
+    if (mock->failureRate > 0 && hsasm_mock_random() < mock->failureRate) {
+        atomic_fetch_add_explicit(&mock->failures, 1, memory_order_relaxed) ;
+        return true ;
+    }
+    return false ;
+}
+
+static inline void hsasm_mock_reset(hsasm_mock *mock) {
+    atomic_store_explicit(&mock->calls, 0, memory_order_relaxed) ;
+    atomic_store_explicit(&mock->failures, 0, memory_order_relaxed) ;
+}
+
+#ifdef __OBJC__
+
+#import <LuaSkin/LuaSkin.h>
+
+// applies the options table at idx, if there is one, and resets the counters
+static inline void hsasm_mock_configure(lua_State *L, int idx, hsasm_mock *mock) {
+    if (lua_type(L, idx) == LUA_TTABLE) {
+        if (lua_getfield(L, idx, "latency") == LUA_TNUMBER)     mock->latency     = fmax(lua_tonumber(L, -1), 0.0) ;
+        if (lua_getfield(L, idx, "failureRate") == LUA_TNUMBER) mock->failureRate = fmin(fmax(lua_tonumber(L, -1), 0.0), 1.0) ;
+        if (lua_getfield(L, idx, "failureCode") == LUA_TNUMBER) mock->failureCode = (int32_t)lua_tointeger(L, -1) ;
+        lua_pop(L, 3) ;
+    }
+    hsasm_mock_reset(mock) ;
+}
+
+// pushes a table describing the backend in use and the mock configuration and counters
+static inline void hsasm_mock_pushStats(lua_State *L, const char *backend, hsasm_mock *mock) {
+    lua_newtable(L) ;
+    lua_pushstring(L, backend) ;                                                                     lua_setfield(L, -2, "backend") ;
+    lua_pushnumber(L, mock->latency) ;                                                               lua_setfield(L, -2, "latency") ;
+    lua_pushnumber(L, mock->failureRate) ;                                                           lua_setfield(L, -2, "failureRate") ;
+    lua_pushinteger(L, mock->failureCode) ;                                                          lua_setfield(L, -2, "failureCode") ;
+    lua_pushinteger(L, (lua_Integer)atomic_load_explicit(&mock->calls, memory_order_relaxed)) ;     lua_setfield(L, -2, "calls") ;
+    lua_pushinteger(L, (lua_Integer)atomic_load_explicit(&mock->failures, memory_order_relaxed)) ;  lua_setfield(L, -2, "failures") ;
+}
+
+#endif
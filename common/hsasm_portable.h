@@ -0,0 +1,56 @@
+//
+// hsasm_portable.h
+// Stand-ins for the framework types used by the private API headers
+//
+// The plain C cores include the private API headers (coredock.h, cgsdebug.h, ...) for their types and
+// enums. On macOS those headers get their types from the system frameworks; elsewhere -- when the cores are
+// built for test/ and bench/ -- this header provides just enough of them for the declarations to compile.
+// Nothing declared in the private headers is ever called on those systems.
+
+#pragma once
+
+#ifdef __APPLE__
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <CoreGraphics/CoreGraphics.h>
+
+#else
+
+#include <stdint.h>
+
+typedef unsigned char Boolean ;
+typedef double        CGFloat ;
+typedef int32_t       CGError ;
+typedef long          NSInteger ;
+typedef unsigned long NSUInteger ;
+typedef const void    *CFArrayRef ;
+
+typedef struct {
+    CGFloat x ;
+    CGFloat y ;
+} CGPoint ;
+
+typedef struct {
+    CGFloat width ;
+    CGFloat height ;
+} CGSize ;
+
+typedef struct {
+    CGPoint origin ;
+    CGSize  size ;
+} CGRect ;
+
+enum {
+    kCGErrorSuccess           = 0,
+    kCGErrorFailure           = 1000,
+    kCGErrorIllegalArgument   = 1001,
+    kCGErrorInvalidConnection = 1002,
+    kCGErrorCannotComplete    = 1004,
+    kCGErrorNotImplemented    = 1006,
+    kCGErrorRangeCheck        = 1007,
+} ;
+
+// the private headers mark functions which may be missing on older systems as weak imports
+#define weak_import weak
+
+#endif
@@ -0,0 +1,447 @@
+//
+// hsasm_spi.h
+// Call counts, latency histograms and error code counts for private API calls
+//
+// Wrap a private API call with one of the macros below and every call site is recorded in a static site
+// structure which registers itself the first time it is used:
+//
+//     CGError err = HSASM_SPI_ERROR("CGSShowCursor", CGSShowCursor(cid)) ; // non-zero results are errors
+//     float size  = HSASM_SPI("CoreDockGetTileSize", CoreDockGetTileSize()) ;
+//     HSASM_SPI_VOID("CoreDockSetTileSize", CoreDockSetTileSize(size)) ;
+//
+// HSASM_SPI and HSASM_SPI_ERROR evaluate to the result of the call; cast them to void where the result
+// is ignored.
+//
+// Calls made through a function pointer can record to a site declared with HSASM_SPI_SITE instead, using
+// the HSASM_SPI_AT, HSASM_SPI_ERROR_AT and HSASM_SPI_VOID_AT forms.
+//
+// Recording takes two clock reads and a handful of plain loads and stores, with no locks and no atomic
+// read-modify-writes. Each thread which records to a site gets its own shard of the site's counters --
+// histogram, total, shortest and longest -- which only that thread writes, and the shards are only merged
+// when the statistics are read. A thread's shards are kept when it exits and handed to the next thread
+// which starts recording, so short lived threads don't grow the set without bound. The latency histogram
+// is log-linear in the style of HdrHistogram: values below 8 ticks have their own bucket and every power of
+// 2 above that is split into 4 buckets, so any recorded value is within 25% of its bucket's lower bound.
+// Error codes are rarer and still counted with atomic adds shared by every thread.
+//
+// Each module is built as its own library, so each has its own set of sites. The C core only depends on
+// C11 atomics; the Lua functions at the end are only available when compiled as Objective-C.
+
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+// The recording macros are statement expressions so they can wrap a call wherever its result is used. Each
+// one silences clang's warning about them for its own expansion only, leaving it on for the code around it.
+#ifdef __clang__
+#define HSASM_SPI_BEGIN_EXPRESSION _Pragma("clang diagnostic push")                                  \
+                                   _Pragma("clang diagnostic ignored \"-Wgnu-statement-expression\"")
+#define HSASM_SPI_END_EXPRESSION   _Pragma("clang diagnostic pop")
+#else
+#define HSASM_SPI_BEGIN_EXPRESSION
+#define HSASM_SPI_END_EXPRESSION
+#endif
+
+#define HSASM_SPI_MAX_SITES    128 // sites per module with per-thread shards; any more share one set of atomic counters
+#define HSASM_SPI_LINEAR       8  // values below this each have their own bucket
+#define HSASM_SPI_SUB_BITS     2  // each power of 2 above that is split into 1 << HSASM_SPI_SUB_BITS buckets
+#define HSASM_SPI_MAX_EXPONENT 42 // values of 2^43 ticks and up are counted in the last bucket
+#define HSASM_SPI_BUCKETS      (HSASM_SPI_LINEAR + (HSASM_SPI_MAX_EXPONENT - 2) * (1 << HSASM_SPI_SUB_BITS))
+#define HSASM_SPI_ERROR_CODES  8  // distinct error codes counted per site; others are only counted as errors
+
+// The counters are atomics so they can be read while they're written, but a thread's own shard is only
+// ever updated with a relaxed load and store.
+typedef struct {
+    _Atomic uint32_t buckets[HSASM_SPI_BUCKETS] ;
+    _Atomic uint64_t totalTicks ;
+    _Atomic uint64_t minTicks ; // stored as ~min so that 0 means "nothing recorded yet"
+    _Atomic uint64_t maxTicks ;
+} hsasm_spi_shard ;
+
+typedef struct {
+    _Atomic int32_t  code ;  // 0 marks an unused slot
+    _Atomic uint32_t count ;
+} hsasm_spi_errorCount ;
+
+enum { kHSASMSPIUnregistered = 0, kHSASMSPIRegistering, kHSASMSPIRegistered } ;
+
+typedef struct hsasm_spi_site {
+    const char                      *name ;
+    struct hsasm_spi_site           *next ;
+    _Atomic int                     registered ;
+    uint32_t                        index ;   // the site's shard in each thread, set before it's registered
+    _Atomic uint64_t                errors ;
+    hsasm_spi_errorCount            errorCodes[HSASM_SPI_ERROR_CODES] ;
+    hsasm_spi_shard                 shared ;  // calls made while registering, past HSASM_SPI_MAX_SITES, or when out of memory
+} hsasm_spi_site ;
+
+// the shards of one thread, indexed by site; only the thread which holds the block adds shards to it
+typedef struct hsasm_spi_thread {
+    struct hsasm_spi_thread      *next ;
+    _Atomic bool                 inUse ;
+    _Atomic(hsasm_spi_shard *)   shards[HSASM_SPI_MAX_SITES] ;
+} hsasm_spi_thread ;
+
+static _Atomic(hsasm_spi_site *)   hsasm_spi_sites         = NULL ;
+static _Atomic uint32_t            hsasm_spi_siteCount     = 0 ;
+static _Atomic(hsasm_spi_thread *) hsasm_spi_threads       = NULL ;
+static _Thread_local hsasm_spi_thread *hsasm_spi_threadBlock = NULL ;
+static pthread_key_t               hsasm_spi_threadKey ;
+static pthread_once_t              hsasm_spi_threadKeyOnce = PTHREAD_ONCE_INIT ;
+
+static inline uint64_t hsasm_spi_now(void) {
+#ifdef __APPLE__
+    return mach_absolute_time() ;
+#else
+    struct timespec ts ;
+    clock_gettime(CLOCK_MONOTONIC, &ts) ;
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec ;
+#endif
+}
+
+// converts a tick count into nanoseconds
+static inline double hsasm_spi_ticksToNanoseconds(uint64_t ticks) {
+#ifdef __APPLE__
+    static mach_timebase_info_data_t timebase = { 0, 0 } ;
+    if (timebase.denom == 0) mach_timebase_info(&timebase) ;
+    return (double)ticks * timebase.numer / timebase.denom ;
+#else
+    return (double)ticks ;
+#endif
+}
+
+static inline size_t hsasm_spi_bucketForTicks(uint64_t ticks) {
+    if (ticks < HSASM_SPI_LINEAR) return (size_t)ticks ;
+    unsigned exponent = 63U - (unsigned)__builtin_clzll(ticks) ;
+    if (exponent > HSASM_SPI_MAX_EXPONENT) return HSASM_SPI_BUCKETS - 1 ;
+    size_t subBucket = (size_t)(ticks >> (exponent - HSASM_SPI_SUB_BITS)) & ((1U << HSASM_SPI_SUB_BITS) - 1) ;
+    return HSASM_SPI_LINEAR + ((exponent - 3) << HSASM_SPI_SUB_BITS) + subBucket ;
+}
+
+// the smallest tick count which is counted in the bucket
+static inline uint64_t hsasm_spi_bucketLowerBound(size_t bucket) {
+    if (bucket < HSASM_SPI_LINEAR) return bucket ;
+    size_t   offset    = bucket - HSASM_SPI_LINEAR ;
+    unsigned exponent  = 3U + (unsigned)(offset >> HSASM_SPI_SUB_BITS) ;
+    uint64_t subBucket = offset & ((1U << HSASM_SPI_SUB_BITS) - 1) ;
+    return ((1ULL << HSASM_SPI_SUB_BITS) + subBucket) << (exponent - HSASM_SPI_SUB_BITS) ;
+}
+
+static inline void hsasm_spi_register(hsasm_spi_site *site) {
+    int expected = kHSASMSPIUnregistered ;
+    if (!atomic_compare_exchange_strong(&site->registered, &expected, kHSASMSPIRegistering)) return ;
+    site->index = atomic_fetch_add_explicit(&hsasm_spi_siteCount, 1, memory_order_relaxed) ;
+    hsasm_spi_site *head = atomic_load_explicit(&hsasm_spi_sites, memory_order_relaxed) ;
+    do {
+        site->next = head ;
+    } while (!atomic_compare_exchange_weak_explicit(&hsasm_spi_sites, &head, site,
+                                                    memory_order_release, memory_order_relaxed)) ;
+    atomic_store_explicit(&site->registered, kHSASMSPIRegistered, memory_order_release) ;
+}
+
+// when a thread exits, its block is left on the list, counters and all, for the next thread to take up
+static inline void hsasm_spi_releaseThread(void *block) {
+    atomic_store_explicit(&((hsasm_spi_thread *)block)->inUse, false, memory_order_release) ;
+}
+
+static inline void hsasm_spi_createThreadKey(void) {
+    pthread_key_create(&hsasm_spi_threadKey, hsasm_spi_releaseThread) ;
+}
+
+static inline hsasm_spi_thread *hsasm_spi_attachThread(void) {
+    pthread_once(&hsasm_spi_threadKeyOnce, hsasm_spi_createThreadKey) ;
+    hsasm_spi_thread *block = atomic_load_explicit(&hsasm_spi_threads, memory_order_acquire) ;
+    for ( ; block ; block = block->next) {
+        bool expected = false ;
+        if (atomic_compare_exchange_strong(&block->inUse, &expected, true)) break ;
+    }
+    if (!block) {
+        block = calloc(1, sizeof(hsasm_spi_thread)) ;
+        if (!block) return NULL ;
+        atomic_init(&block->inUse, true) ;
+        hsasm_spi_thread *head = atomic_load_explicit(&hsasm_spi_threads, memory_order_relaxed) ;
+        do {
+            block->next = head ;
+        } while (!atomic_compare_exchange_weak_explicit(&hsasm_spi_threads, &head, block,
+                                                        memory_order_release, memory_order_relaxed)) ;
+    }
+    pthread_setspecific(hsasm_spi_threadKey, block) ;
+    hsasm_spi_threadBlock = block ;
+    return block ;
+}
+
+// the calling thread's shard for the site, or NULL when the call should go to the site's shared counters
+static inline hsasm_spi_shard *hsasm_spi_threadShard(hsasm_spi_site *site) {
+    if (atomic_load_explicit(&site->registered, memory_order_acquire) != kHSASMSPIRegistered) {
+        hsasm_spi_register(site) ;
+        if (atomic_load_explicit(&site->registered, memory_order_acquire) != kHSASMSPIRegistered) return NULL ;
+    }
+    if (site->index >= HSASM_SPI_MAX_SITES) return NULL ;
+
+    hsasm_spi_thread *block = hsasm_spi_threadBlock ;
+    if (!block && !(block = hsasm_spi_attachThread())) return NULL ;
+    hsasm_spi_shard *shard = atomic_load_explicit(&block->shards[site->index], memory_order_relaxed) ;
+    if (!shard) {
+        shard = calloc(1, sizeof(hsasm_spi_shard)) ;
+        if (!shard) return NULL ;
+        atomic_store_explicit(&block->shards[site->index], shard, memory_order_release) ;
+    }
+    return shard ;
+}
+
+// a single writer doesn't need a read-modify-write, only a store a reader can't see half of
+#define HSASM_SPI_ADD(counter, value) \
+    atomic_store_explicit((counter), atomic_load_explicit((counter), memory_order_relaxed) + (value), memory_order_relaxed)
+
+static inline void hsasm_spi_recordToThreadShard(hsasm_spi_shard *shard, uint64_t ticks) {
+    HSASM_SPI_ADD(&shard->buckets[hsasm_spi_bucketForTicks(ticks)], 1) ;
+    HSASM_SPI_ADD(&shard->totalTicks, ticks) ;
+    if (~ticks > atomic_load_explicit(&shard->minTicks, memory_order_relaxed)) atomic_store_explicit(&shard->minTicks, ~ticks, memory_order_relaxed) ;
+    if (ticks > atomic_load_explicit(&shard->maxTicks, memory_order_relaxed)) atomic_store_explicit(&shard->maxTicks, ticks, memory_order_relaxed) ;
+}
+
+static inline void hsasm_spi_recordToSharedShard(hsasm_spi_shard *shard, uint64_t ticks) {
+    atomic_fetch_add_explicit(&shard->buckets[hsasm_spi_bucketForTicks(ticks)], 1, memory_order_relaxed) ;
+    atomic_fetch_add_explicit(&shard->totalTicks, ticks, memory_order_relaxed) ;
+    uint64_t inverted = ~ticks ;
+    uint64_t current  = atomic_load_explicit(&shard->minTicks, memory_order_relaxed) ;
+    while (inverted > current &&
+           !atomic_compare_exchange_weak_explicit(&shard->minTicks, &current, inverted, memory_order_relaxed, memory_order_relaxed)) ;
+    current = atomic_load_explicit(&shard->maxTicks, memory_order_relaxed) ;
+    while (ticks > current &&
+           !atomic_compare_exchange_weak_explicit(&shard->maxTicks, &current, ticks, memory_order_relaxed, memory_order_relaxed)) ;
+}
+
+static inline void hsasm_spi_recordError(hsasm_spi_site *site, int32_t errorCode) {
+    atomic_fetch_add_explicit(&site->errors, 1, memory_order_relaxed) ;
+    for (size_t i = 0 ; i < HSASM_SPI_ERROR_CODES ; i++) {
+        int32_t code = atomic_load_explicit(&site->errorCodes[i].code, memory_order_relaxed) ;
+        if (code == 0) {
+            int32_t expected = 0 ;
+            if (atomic_compare_exchange_strong(&site->errorCodes[i].code, &expected, errorCode)) code = errorCode ;
+            else code = expected ;
+        }
+        if (code == errorCode) {
+            atomic_fetch_add_explicit(&site->errorCodes[i].count, 1, memory_order_relaxed) ;
+            return ;
+        }
+    }
+}
+
+static inline void hsasm_spi_record(hsasm_spi_site *site, uint64_t ticks, int32_t errorCode) {
+    hsasm_spi_shard *shard = hsasm_spi_threadShard(site) ;
+    if (shard) hsasm_spi_recordToThreadShard(shard, ticks) ;
+    else       hsasm_spi_recordToSharedShard(&site->shared, ticks) ;
+    if (errorCode != 0) hsasm_spi_recordError(site, errorCode) ;
+}
+
+static inline void hsasm_spi_clearShard(hsasm_spi_shard *shard) {
+    for (size_t b = 0 ; b < HSASM_SPI_BUCKETS ; b++) atomic_store_explicit(&shard->buckets[b], 0, memory_order_relaxed) ;
+    atomic_store_explicit(&shard->totalTicks, 0, memory_order_relaxed) ;
+    atomic_store_explicit(&shard->minTicks, 0, memory_order_relaxed) ;
+    atomic_store_explicit(&shard->maxTicks, 0, memory_order_relaxed) ;
+}
+
+// Clears the counters of every registered site. Calls recorded while this runs may be partially kept, and
+// as a thread adds to its own counters with a load and a store, one it was in the middle of may survive.
+static inline void hsasm_spi_reset(void) {
+    for (hsasm_spi_site *site = atomic_load_explicit(&hsasm_spi_sites, memory_order_acquire) ; site ; site = site->next) {
+        hsasm_spi_clearShard(&site->shared) ;
+        if (site->index < HSASM_SPI_MAX_SITES) {
+            for (hsasm_spi_thread *block = atomic_load_explicit(&hsasm_spi_threads, memory_order_acquire) ; block ; block = block->next) {
+                hsasm_spi_shard *shard = atomic_load_explicit(&block->shards[site->index], memory_order_acquire) ;
+                if (shard) hsasm_spi_clearShard(shard) ;
+            }
+        }
+        for (size_t i = 0 ; i < HSASM_SPI_ERROR_CODES ; i++) {
+            atomic_store_explicit(&site->errorCodes[i].count, 0, memory_order_relaxed) ;
+            atomic_store_explicit(&site->errorCodes[i].code, 0, memory_order_relaxed) ;
+        }
+        atomic_store_explicit(&site->errors, 0, memory_order_relaxed) ;
+    }
+}
+
+static inline void hsasm_spi_collectShard(hsasm_spi_shard *shard, uint64_t *counts, uint64_t *calls, uint64_t *totalTicks,
+                                          uint64_t *minTicks, uint64_t *maxTicks) {
+    for (size_t b = 0 ; b < HSASM_SPI_BUCKETS ; b++) {
+        uint32_t count = atomic_load_explicit(&shard->buckets[b], memory_order_relaxed) ;
+        counts[b] += count ;
+        *calls    += count ;
+    }
+    *totalTicks += atomic_load_explicit(&shard->totalTicks, memory_order_relaxed) ;
+    uint64_t inverted = atomic_load_explicit(&shard->minTicks, memory_order_relaxed) ;
+    if (inverted != 0 && ~inverted < *minTicks) *minTicks = ~inverted ;
+    uint64_t longest = atomic_load_explicit(&shard->maxTicks, memory_order_relaxed) ;
+    if (longest > *maxTicks) *maxTicks = longest ;
+}
+
+// Merges the site's shards into counts, which has HSASM_SPI_BUCKETS entries, and its calls, ticks, shortest
+// and longest call into the totals; start minTicks at UINT64_MAX, and it's left there if nothing was recorded.
+static inline void hsasm_spi_collect(hsasm_spi_site *site, uint64_t *counts, uint64_t *calls, uint64_t *totalTicks,
+                                     uint64_t *minTicks, uint64_t *maxTicks) {
+    hsasm_spi_collectShard(&site->shared, counts, calls, totalTicks, minTicks, maxTicks) ;
+    if (atomic_load_explicit(&site->registered, memory_order_acquire) != kHSASMSPIRegistered || site->index >= HSASM_SPI_MAX_SITES) return ;
+    for (hsasm_spi_thread *block = atomic_load_explicit(&hsasm_spi_threads, memory_order_acquire) ; block ; block = block->next) {
+        hsasm_spi_shard *shard = atomic_load_explicit(&block->shards[site->index], memory_order_acquire) ;
+        if (shard) hsasm_spi_collectShard(shard, counts, calls, totalTicks, minTicks, maxTicks) ;
+    }
+}
+
+// the lower bound of the bucket holding the given quantile (0.0 - 1.0) of a histogram of calls values
+static inline uint64_t hsasm_spi_quantile(const uint64_t *counts, uint64_t calls, double quantile) {
+    uint64_t seen = 0 ;
+    for (size_t b = 0 ; b < HSASM_SPI_BUCKETS ; b++) {
+        seen += counts[b] ;
+        if (seen > 0 && (double)seen >= quantile * (double)calls) return hsasm_spi_bucketLowerBound(b) ;
+    }
+    return hsasm_spi_bucketLowerBound(HSASM_SPI_BUCKETS - 1) ;
+}
+
+// declares a site for a call which is made through a function pointer or from more than one place
+#define HSASM_SPI_SITE(label) { .name = (label) }
+
+// records a call whose result is not an error code
+#define HSASM_SPI_AT(site, call) HSASM_SPI_BEGIN_EXPRESSION ({                          \
+    uint64_t _hsasm_spi_start = hsasm_spi_now() ;                                       \
+    __typeof__(call) _hsasm_spi_result = (call) ;                                       \
+    hsasm_spi_record((site), hsasm_spi_now() - _hsasm_spi_start, 0) ;                   \
+    _hsasm_spi_result ;                                                                 \
+}) HSASM_SPI_END_EXPRESSION
+
+// records a call which returns a CGError, OSStatus or similar code where 0 indicates success
+#define HSASM_SPI_ERROR_AT(site, call) HSASM_SPI_BEGIN_EXPRESSION ({                    \
+    uint64_t _hsasm_spi_start = hsasm_spi_now() ;                                       \
+    __typeof__(call) _hsasm_spi_result = (call) ;                                       \
+    hsasm_spi_record((site), hsasm_spi_now() - _hsasm_spi_start,                        \
+                     (int32_t)_hsasm_spi_result) ;                                      \
+    _hsasm_spi_result ;                                                                 \
+}) HSASM_SPI_END_EXPRESSION
+
+// records a call which returns nothing
+#define HSASM_SPI_VOID_AT(site, call) do {                                              \
+    uint64_t _hsasm_spi_start = hsasm_spi_now() ;                                       \
+    (call) ;                                                                            \
+    hsasm_spi_record((site), hsasm_spi_now() - _hsasm_spi_start, 0) ;                   \
+} while (0)
+
+// the same, with a site declared at the point of the call
+#define HSASM_SPI(label, call) HSASM_SPI_BEGIN_EXPRESSION ({                            \
+    static hsasm_spi_site _hsasm_spi_site = HSASM_SPI_SITE(label) ;                     \
+    HSASM_SPI_AT(&_hsasm_spi_site, call) ;                                              \
+}) HSASM_SPI_END_EXPRESSION
+
+#define HSASM_SPI_ERROR(label, call) HSASM_SPI_BEGIN_EXPRESSION ({                      \
+    static hsasm_spi_site _hsasm_spi_site = HSASM_SPI_SITE(label) ;                     \
+    HSASM_SPI_ERROR_AT(&_hsasm_spi_site, call) ;                                        \
+}) HSASM_SPI_END_EXPRESSION
+
+#define HSASM_SPI_VOID(label, call) do {                                                \
+    static hsasm_spi_site _hsasm_spi_site = HSASM_SPI_SITE(label) ;                     \
+    HSASM_SPI_VOID_AT(&_hsasm_spi_site, call) ;                                         \
+} while (0)
+
+#ifdef __OBJC__
+
+// Sites with the same name (the same function called from more than one place) are combined. Error codes
+// are used as keys, so they are converted to strings when the result is going to be serialized as JSON.
+static NSDictionary *hsasm_spi_snapshot(BOOL stringKeys) {
+    NSMutableDictionary *histograms = [NSMutableDictionary dictionary] ;
+    NSMutableDictionary *results    = [NSMutableDictionary dictionary] ;
+
+    for (hsasm_spi_site *site = atomic_load_explicit(&hsasm_spi_sites, memory_order_acquire) ; site ; site = site->next) {
+        NSString            *name    = @(site->name) ;
+        NSMutableDictionary *entry   = results[name] ;
+        NSMutableData       *buckets = histograms[name] ;
+        if (!entry) {
+            entry = [@{ @"calls" : @(0), @"errors" : @(0), @"totalTicks" : @(0), @"minTicks" : @(UINT64_MAX),
+                        @"maxTicks" : @(0), @"errorCodes" : [NSMutableDictionary dictionary] } mutableCopy] ;
+            buckets = [NSMutableData dataWithLength:HSASM_SPI_BUCKETS * sizeof(uint64_t)] ;
+            results[name]    = entry ;
+            histograms[name] = buckets ;
+        }
+
+        uint64_t *counts     = buckets.mutableBytes ;
+        uint64_t calls       = [entry[@"calls"] unsignedLongLongValue] ;
+        uint64_t totalTicks  = [entry[@"totalTicks"] unsignedLongLongValue] ;
+        uint64_t minTicks    = [entry[@"minTicks"] unsignedLongLongValue] ;
+        uint64_t maxTicks    = [entry[@"maxTicks"] unsignedLongLongValue] ;
+        hsasm_spi_collect(site, counts, &calls, &totalTicks, &minTicks, &maxTicks) ;
+        entry[@"calls"]      = @(calls) ;
+        entry[@"totalTicks"] = @(totalTicks) ;
+        entry[@"minTicks"]   = @(minTicks) ;
+        entry[@"maxTicks"]   = @(maxTicks) ;
+        entry[@"errors"]     = @([entry[@"errors"] unsignedLongLongValue] + atomic_load_explicit(&site->errors, memory_order_relaxed)) ;
+
+        NSMutableDictionary *errorCodes = entry[@"errorCodes"] ;
+        for (size_t i = 0 ; i < HSASM_SPI_ERROR_CODES ; i++) {
+            int32_t  code  = atomic_load_explicit(&site->errorCodes[i].code, memory_order_relaxed) ;
+            uint32_t count = atomic_load_explicit(&site->errorCodes[i].count, memory_order_relaxed) ;
+            if (code == 0 || count == 0) continue ;
+            id key = stringKeys ? (id)[NSString stringWithFormat:@"%d", code] : (id)@(code) ;
+            errorCodes[key] = @([errorCodes[key] unsignedLongLongValue] + count) ;
+        }
+    }
+
+    NSMutableDictionary *stats = [NSMutableDictionary dictionary] ;
+    [results enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSDictionary *entry, __unused BOOL *stop) {
+        uint64_t calls = [entry[@"calls"] unsignedLongLongValue] ;
+        if (calls == 0) return ;
+
+        const uint64_t *counts     = ((NSData *)histograms[name]).bytes ;
+        const double   quantiles[] = { 0.5, 0.9, 0.99, 0.999 } ;
+        NSString       *labels[]   = { @"p50", @"p90", @"p99", @"p999" } ;
+
+        NSMutableDictionary *result = [NSMutableDictionary dictionary] ;
+        result[@"calls"]      = @(calls) ;
+        result[@"errors"]     = entry[@"errors"] ;
+        result[@"errorCodes"] = entry[@"errorCodes"] ;
+        result[@"totalNs"]    = @(hsasm_spi_ticksToNanoseconds([entry[@"totalTicks"] unsignedLongLongValue])) ;
+        result[@"meanNs"]     = @(hsasm_spi_ticksToNanoseconds([entry[@"totalTicks"] unsignedLongLongValue]) / (double)calls) ;
+        result[@"minNs"]      = @(hsasm_spi_ticksToNanoseconds([entry[@"minTicks"] unsignedLongLongValue])) ;
+        result[@"maxNs"]      = @(hsasm_spi_ticksToNanoseconds([entry[@"maxTicks"] unsignedLongLongValue])) ;
+        for (size_t i = 0 ; i < 4 ; i++) {
+            result[labels[i]] = @(hsasm_spi_ticksToNanoseconds(hsasm_spi_quantile(counts, calls, quantiles[i]))) ;
+        }
+        stats[name] = result ;
+    }] ;
+    return stats ;
+}
+
+// stats([json]) -> table | string
+static int hsasm_spi_pushStats(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TBOOLEAN | LS_TOPTIONAL, LS_TBREAK] ;
+    BOOL asJSON = (BOOL)lua_toboolean(L, 1) ;
+
+    NSDictionary *stats = hsasm_spi_snapshot(asJSON) ;
+    if (asJSON) {
+        NSError *error = nil ;
+        NSData  *data  = [NSJSONSerialization dataWithJSONObject:stats options:NSJSONWritingPrettyPrinted error:&error] ;
+        if (!data) return luaL_error(L, "unable to serialize statistics: %s", error.localizedDescription.UTF8String) ;
+        lua_pushlstring(L, data.bytes, data.length) ;
+    } else {
+        [skin pushNSObject:stats] ;
+    }
+    return 1 ;
+}
+
+// resetStats() -> None
+static int hsasm_spi_resetStats(lua_State *L) {
+    [[LuaSkin sharedWithState:L] checkArgs:LS_TBREAK] ;
+    hsasm_spi_reset() ;
+    return 0 ;
+}
+
+#endif
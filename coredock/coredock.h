@@ -60,5 +60,5 @@ extern void CoreDockSetMagnificationSize(float newSize);
 extern Boolean CoreDockGetWorkspacesEnabled(void);
 extern void CoreDockSetWorkspacesEnabled(Boolean); // This works, but wipes out all of the other spaces prefs. An alternative is to use the ScriptingBridge which works just fine.
 
-extern void CoreDockGetWorkspacesCount(int *rows, int *cols);
+extern void CoreDockGetWorkspacesCount(int *rows, int *cols) __attribute__((weak_import));
 extern void CoreDockSetWorkspacesCount(int rows, int cols);
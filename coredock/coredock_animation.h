@@ -0,0 +1,145 @@
+//
+// coredock_animation.h
+// The frame pacing behind coredock.animate, kept free of Foundation and Lua so it can be driven by a
+// virtual clock
+//
+// Animations of the tile and magnification sizes are driven by a single fixed rate timer. Each tick
+// computes the value for the current time rather than stepping from the previous value, so if the Dock
+// is slow to respond and ticks are missed, the skipped frames are simply dropped and counted. Since the
+// sets are synchronous, there is never more than one outstanding for a property.
+
+#pragma once
+
+#include "coredock_settings.h"
+
+#include <math.h>
+
+#define COREDOCK_ANIMATION_DEFAULT_RATE 30.0
+#define COREDOCK_ANIMATION_MAX_RATE     120.0
+
+typedef enum {
+    kCoreDockEasingLinear = 0,
+    kCoreDockEasingIn,
+    kCoreDockEasingOut,
+    kCoreDockEasingInOut,
+} CoreDockEasing ;
+
+static const char *const coredock_easingNames[] = { "linear", "easeIn", "easeOut", "easeInOut", NULL } ;
+
+static inline double coredock_ease(CoreDockEasing easing, double t) {
+    switch(easing) {
+        case kCoreDockEasingIn:    return t * t ;
+        case kCoreDockEasingOut:   return t * (2.0 - t) ;
+        case kCoreDockEasingInOut: return (t < 0.5) ? 2.0 * t * t : -1.0 + (4.0 - 2.0 * t) * t ;
+        case kCoreDockEasingLinear:
+        default:                   return t ;
+    }
+}
+
+typedef struct {
+    CoreDockField  field ;
+    float          fromValue ;
+    float          toValue ;
+    float          lastValue ;   // the last value actually set
+    double         startTime ;
+    double         duration ;
+    CoreDockEasing easing ;
+    int            callbackRef ; // owned by the caller; the core only carries it around
+    bool           active ;
+} coredock_animation ;
+
+static inline float coredock_animation_value(const coredock_animation *animation, double now) {
+    double t = (animation->duration > 0) ? (now - animation->startTime) / animation->duration : 1.0 ;
+    if (t >= 1.0) return animation->toValue ;
+    if (t < 0.0)  t = 0.0 ;
+    return animation->fromValue + (animation->toValue - animation->fromValue) * (float)coredock_ease(animation->easing, t) ;
+}
+
+static inline bool coredock_animation_finished(const coredock_animation *animation, double now) {
+    return (now - animation->startTime) >= animation->duration ;
+}
+
+// sets one frame; called synchronously so the next frame can't be issued until this one has landed
+typedef void (*coredock_animationApply)(void *context, CoreDockField field, float value) ;
+
+typedef struct {
+    coredock_animation tileSize ;
+    coredock_animation magnificationSize ;
+    double             lastTick ;
+    int64_t            framesApplied ;
+    int64_t            framesDropped ;
+} coredock_animator ;
+
+static inline coredock_animation *coredock_animator_slot(coredock_animator *animator, CoreDockField field) {
+    return (field == kCoreDockFieldTileSize) ? &animator->tileSize : &animator->magnificationSize ;
+}
+
+static inline bool coredock_animator_active(const coredock_animator *animator) {
+    return animator->tileSize.active || animator->magnificationSize.active ;
+}
+
+// removes the animation of field, returning it so the caller can report it as cancelled; the returned
+// animation isn't active if there was nothing to cancel
+static inline coredock_animation coredock_animator_cancel(coredock_animator *animator, CoreDockField field) {
+    coredock_animation *slot     = coredock_animator_slot(animator, field) ;
+    coredock_animation cancelled = *slot ;
+    slot->active = false ;
+    return cancelled ;
+}
+
+// starts an animation of field, replacing any earlier one which is returned as for coredock_animator_cancel.
+// The new animation is in place before the caller hears about the one it replaced, so anything the caller
+// does in response (such as starting yet another animation) sees a consistent animator.
+static inline coredock_animation coredock_animator_start(coredock_animator *animator, CoreDockField field, float fromValue, float toValue, double duration, CoreDockEasing easing, int callbackRef, double now) {
+    if (!coredock_animator_active(animator)) animator->lastTick = now ; // the timer is about to start
+    coredock_animation replaced = coredock_animator_cancel(animator, field) ;
+    *coredock_animator_slot(animator, field) = (coredock_animation){
+        .field       = field,
+        .fromValue   = fromValue,
+        .toValue     = toValue,
+        .lastValue   = fromValue,
+        .startTime   = now,
+        .duration    = duration,
+        .easing      = easing,
+        .callbackRef = callbackRef,
+        .active      = true,
+    } ;
+    return replaced ;
+}
+
+// Advances every active animation to `now`; interval is the period of the timer actually driving the
+// animator, which may differ from the current rate if it was changed after the timer started. Animations
+// which reach their target are removed and copied into finished, and the number of them is returned.
+static inline int coredock_animator_tick(coredock_animator *animator, double now, double interval, coredock_animationApply apply, void *context, coredock_animation finished[2]) {
+    double elapsed = now - animator->lastTick ;
+    animator->lastTick = now ;
+
+    // timers don't queue up missed firings, so account for them here; each animating property missed a
+    // frame. The firings are rounded to the nearest interval since timer jitter makes the gap slightly
+    // more or less than an exact multiple.
+    if (interval > 0 && elapsed > interval * 1.5) {
+        int64_t missed = (int64_t)(elapsed / interval + 0.5) - 1 ;
+        if (animator->tileSize.active)          animator->framesDropped += missed ;
+        if (animator->magnificationSize.active) animator->framesDropped += missed ;
+    }
+
+    int                count    = 0 ;
+    coredock_animation *slots[] = { &animator->tileSize, &animator->magnificationSize } ;
+    for (int i = 0 ; i < 2 ; i++) {
+        coredock_animation *animation = slots[i] ;
+        if (!animation->active) continue ;
+
+        bool  done  = coredock_animation_finished(animation, now) ;
+        float value = coredock_animation_value(animation, now) ;
+        if (done || fabsf(value - animation->lastValue) > COREDOCK_SIZE_EPSILON) {
+            apply(context, animation->field, value) ;
+            animation->lastValue = value ;
+            animator->framesApplied++ ;
+        }
+        if (done) {
+            finished[count++] = *animation ;
+            animation->active = false ;
+        }
+    }
+    return count ;
+}
@@ -0,0 +1,304 @@
+//
+// coredock_settings.h
+// Reading, diffing and applying Dock settings through a table of Dock functions
+//
+// The batch apply in internal.m reads the requested settings, compares them with what was asked for and
+// only makes the calls needed for the settings which differ, with orientation and pinning sharing a single
+// CoreDockSetOrientationAndPinning call. All of that goes through a coredock_backend, either the CoreDock
+// functions or the in-memory mock below, so it can be tested and benchmarked without a Dock (see
+// test/test_coredock_apply.c).
+
+#pragma once
+
+#include "hsasm_portable.h"
+#include "hsasm_spi.h"
+#include "hsasm_mock.h"
+#include "coredock.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Dock settings managed by this module; the bit values are used to track which fields were requested, changed, or need refreshing
+typedef enum {
+    kCoreDockFieldOrientation       = 1 << 0,
+    kCoreDockFieldPinning           = 1 << 1,
+    kCoreDockFieldTileSize          = 1 << 2,
+    kCoreDockFieldMagnificationSize = 1 << 3,
+    kCoreDockFieldMagnification     = 1 << 4,
+    kCoreDockFieldAnimationEffect   = 1 << 5,
+    kCoreDockFieldAutoHide          = 1 << 6,
+} CoreDockField ;
+
+static const struct {
+    const char    *name ;
+    CoreDockField field ;
+} coredock_fieldNames[] = {
+    { "orientation",       kCoreDockFieldOrientation },
+    { "pinning",           kCoreDockFieldPinning },
+    { "tileSize",          kCoreDockFieldTileSize },
+    { "magnificationSize", kCoreDockFieldMagnificationSize },
+    { "magnification",     kCoreDockFieldMagnification },
+    { "animationEffect",   kCoreDockFieldAnimationEffect },
+    { "autoHide",          kCoreDockFieldAutoHide },
+} ;
+
+#define COREDOCK_FIELD_COUNT (sizeof(coredock_fieldNames) / sizeof(coredock_fieldNames[0]))
+#define COREDOCK_ALL_FIELDS  0x7fU
+
+// the sizes are floats on the SPI side; anything closer than this is treated as unchanged
+#define COREDOCK_SIZE_EPSILON 0.0005f
+
+typedef struct {
+    CoreDockOrientation orientation ;
+    CoreDockPinning     pinning ;
+    float               tileSize ;
+    float               magnificationSize ;
+    Boolean             magnification ;
+    CoreDockEffect      animationEffect ;
+    Boolean             autoHide ;
+} coredock_settings ;
+
+// the Dock functions used by this module, so they can be replaced with an in-memory mock; see hsasm_mock.h
+typedef struct {
+    const char *name ;
+    void       (*getOrientationAndPinning)(CoreDockOrientation *outOrientation, CoreDockPinning *outPinning) ;
+    void       (*setOrientationAndPinning)(CoreDockOrientation orientation, CoreDockPinning pinning) ;
+    float      (*getTileSize)(void) ;
+    void       (*setTileSize)(float tileSize) ;
+    float      (*getMagnificationSize)(void) ;
+    void       (*setMagnificationSize)(float newSize) ;
+    Boolean    (*isMagnificationEnabled)(void) ;
+    void       (*setMagnificationEnabled)(Boolean flag) ;
+    void       (*getEffect)(CoreDockEffect *outEffect) ;
+    void       (*setEffect)(CoreDockEffect effect) ;
+    Boolean    (*getAutoHideEnabled)(void) ;
+    void       (*setAutoHideEnabled)(Boolean flag) ;
+    void       (*getWorkspacesCount)(int *rows, int *cols) ;
+} coredock_backend ;
+
+static inline const char *coredock_fieldName(CoreDockField field) {
+    for (size_t i = 0 ; i < COREDOCK_FIELD_COUNT ; i++) {
+        if (coredock_fieldNames[i].field == field) return coredock_fieldNames[i].name ;
+    }
+    return "unknown" ;
+}
+
+// the mock Dock starts out at the macOS defaults. Failed getters report zeros and failed setters do nothing.
+static hsasm_mock        coredock_mock      = HSASM_MOCK(0) ;
+static coredock_settings coredock_mockState = {
+    kCoreDockOrientationBottom, kCoreDockPinningMiddle, 0.5f, 0.75f, false, kCoreDockEffectGenie, false
+} ;
+
+static void coredock_mockGetOrientationAndPinning(CoreDockOrientation *outOrientation, CoreDockPinning *outPinning) {
+    bool failed = hsasm_mock_call(&coredock_mock) ;
+    *outOrientation = failed ? kCoreDockOrientationIgnore : coredock_mockState.orientation ;
+    *outPinning     = failed ? kCoreDockPinningIgnore     : coredock_mockState.pinning ;
+}
+
+static void coredock_mockSetOrientationAndPinning(CoreDockOrientation orientation, CoreDockPinning pinning) {
+    if (hsasm_mock_call(&coredock_mock)) return ;
+    if (orientation != kCoreDockOrientationIgnore) coredock_mockState.orientation = orientation ;
+    if (pinning != kCoreDockPinningIgnore)         coredock_mockState.pinning     = pinning ;
+}
+
+static float coredock_mockGetTileSize(void) {
+    return hsasm_mock_call(&coredock_mock) ? 0.0f : coredock_mockState.tileSize ;
+}
+
+static void coredock_mockSetTileSize(float tileSize) {
+    if (!hsasm_mock_call(&coredock_mock)) coredock_mockState.tileSize = tileSize ;
+}
+
+static float coredock_mockGetMagnificationSize(void) {
+    return hsasm_mock_call(&coredock_mock) ? 0.0f : coredock_mockState.magnificationSize ;
+}
+
+static void coredock_mockSetMagnificationSize(float newSize) {
+    if (!hsasm_mock_call(&coredock_mock)) coredock_mockState.magnificationSize = newSize ;
+}
+
+static Boolean coredock_mockIsMagnificationEnabled(void) {
+    return hsasm_mock_call(&coredock_mock) ? false : coredock_mockState.magnification ;
+}
+
+static void coredock_mockSetMagnificationEnabled(Boolean flag) {
+    if (!hsasm_mock_call(&coredock_mock)) coredock_mockState.magnification = flag ;
+}
+
+static void coredock_mockGetEffect(CoreDockEffect *outEffect) {
+    if (!hsasm_mock_call(&coredock_mock)) *outEffect = coredock_mockState.animationEffect ;
+}
+
+static void coredock_mockSetEffect(CoreDockEffect effect) {
+    if (!hsasm_mock_call(&coredock_mock)) coredock_mockState.animationEffect = effect ;
+}
+
+static Boolean coredock_mockGetAutoHideEnabled(void) {
+    return hsasm_mock_call(&coredock_mock) ? false : coredock_mockState.autoHide ;
+}
+
+static void coredock_mockSetAutoHideEnabled(Boolean flag) {
+    if (!hsasm_mock_call(&coredock_mock)) coredock_mockState.autoHide = flag ;
+}
+
+static void coredock_mockGetWorkspacesCount(int *rows, int *cols) {
+    if (hsasm_mock_call(&coredock_mock)) return ;
+    *rows = 1 ;
+    *cols = 1 ;
+}
+
+static const coredock_backend coredock_mockBackend = {
+    "mock",
+    coredock_mockGetOrientationAndPinning,
+    coredock_mockSetOrientationAndPinning,
+    coredock_mockGetTileSize,
+    coredock_mockSetTileSize,
+    coredock_mockGetMagnificationSize,
+    coredock_mockSetMagnificationSize,
+    coredock_mockIsMagnificationEnabled,
+    coredock_mockSetMagnificationEnabled,
+    coredock_mockGetEffect,
+    coredock_mockSetEffect,
+    coredock_mockGetAutoHideEnabled,
+    coredock_mockSetAutoHideEnabled,
+    coredock_mockGetWorkspacesCount
+} ;
+
+// reads the specified fields from the Dock into settings, leaving the others as they are
+static inline void coredock_readFields(const coredock_backend *dock, coredock_settings *settings, uint32_t fields) {
+    if (fields & (kCoreDockFieldOrientation | kCoreDockFieldPinning)) {
+        CoreDockOrientation orientation = settings->orientation ;
+        CoreDockPinning     pinning     = settings->pinning ;
+        HSASM_SPI_VOID("CoreDockGetOrientationAndPinning", dock->getOrientationAndPinning(&orientation, &pinning)) ;
+        if (fields & kCoreDockFieldOrientation) settings->orientation = orientation ;
+        if (fields & kCoreDockFieldPinning)     settings->pinning     = pinning ;
+    }
+    if (fields & kCoreDockFieldTileSize)          settings->tileSize          = HSASM_SPI("CoreDockGetTileSize", dock->getTileSize()) ;
+    if (fields & kCoreDockFieldMagnificationSize) settings->magnificationSize = HSASM_SPI("CoreDockGetMagnificationSize", dock->getMagnificationSize()) ;
+    if (fields & kCoreDockFieldMagnification)     settings->magnification     = HSASM_SPI("CoreDockIsMagnificationEnabled", dock->isMagnificationEnabled()) ;
+    if (fields & kCoreDockFieldAnimationEffect)   HSASM_SPI_VOID("CoreDockGetEffect", dock->getEffect(&settings->animationEffect)) ;
+    if (fields & kCoreDockFieldAutoHide)          settings->autoHide          = HSASM_SPI("CoreDockGetAutoHideEnabled", dock->getAutoHideEnabled()) ;
+}
+
+static inline void coredock_readSettings(const coredock_backend *dock, coredock_settings *settings) {
+    coredock_readFields(dock, settings, COREDOCK_ALL_FIELDS) ;
+}
+
+static inline void coredock_readWorkspaces(const coredock_backend *dock, int *rows, int *columns) {
+    *rows    = 0 ;
+    *columns = 0 ;
+    if (dock->getWorkspacesCount != NULL) HSASM_SPI_VOID("CoreDockGetWorkspacesCount", dock->getWorkspacesCount(rows, columns)) ;
+}
+
+// returns the subset of requested fields whose value differs from current
+static inline uint32_t coredock_diffSettings(const coredock_settings *current, const coredock_settings *requested, uint32_t requestedFields) {
+    uint32_t changed = 0 ;
+    if ((requestedFields & kCoreDockFieldOrientation) && requested->orientation != current->orientation)
+        changed |= kCoreDockFieldOrientation ;
+    if ((requestedFields & kCoreDockFieldPinning) && requested->pinning != current->pinning)
+        changed |= kCoreDockFieldPinning ;
+    if ((requestedFields & kCoreDockFieldTileSize) && fabsf(requested->tileSize - current->tileSize) > COREDOCK_SIZE_EPSILON)
+        changed |= kCoreDockFieldTileSize ;
+    if ((requestedFields & kCoreDockFieldMagnificationSize) && fabsf(requested->magnificationSize - current->magnificationSize) > COREDOCK_SIZE_EPSILON)
+        changed |= kCoreDockFieldMagnificationSize ;
+    if ((requestedFields & kCoreDockFieldMagnification) && !requested->magnification != !current->magnification)
+        changed |= kCoreDockFieldMagnification ;
+    if ((requestedFields & kCoreDockFieldAnimationEffect) && requested->animationEffect != current->animationEffect)
+        changed |= kCoreDockFieldAnimationEffect ;
+    if ((requestedFields & kCoreDockFieldAutoHide) && !requested->autoHide != !current->autoHide)
+        changed |= kCoreDockFieldAutoHide ;
+    return changed ;
+}
+
+// issues one SPI call per changed field, except orientation and pinning which share a single call; returns
+// the number of calls made
+static inline int coredock_applySettings(const coredock_backend *dock, const coredock_settings *requested, uint32_t changed) {
+    int calls = 0 ;
+    if (changed & (kCoreDockFieldOrientation | kCoreDockFieldPinning)) {
+        HSASM_SPI_VOID("CoreDockSetOrientationAndPinning", dock->setOrientationAndPinning(
+            (changed & kCoreDockFieldOrientation) ? requested->orientation : kCoreDockOrientationIgnore,
+            (changed & kCoreDockFieldPinning)     ? requested->pinning     : kCoreDockPinningIgnore
+        )) ;
+        calls++ ;
+    }
+    if (changed & kCoreDockFieldTileSize) {
+        HSASM_SPI_VOID("CoreDockSetTileSize", dock->setTileSize(requested->tileSize)) ;
+        calls++ ;
+    }
+    if (changed & kCoreDockFieldMagnificationSize) {
+        HSASM_SPI_VOID("CoreDockSetMagnificationSize", dock->setMagnificationSize(requested->magnificationSize)) ;
+        calls++ ;
+    }
+    if (changed & kCoreDockFieldMagnification) {
+        HSASM_SPI_VOID("CoreDockSetMagnificationEnabled", dock->setMagnificationEnabled(requested->magnification)) ;
+        calls++ ;
+    }
+    if (changed & kCoreDockFieldAnimationEffect) {
+        HSASM_SPI_VOID("CoreDockSetEffect", dock->setEffect(requested->animationEffect)) ;
+        calls++ ;
+    }
+    if (changed & kCoreDockFieldAutoHide) {
+        HSASM_SPI_VOID("CoreDockSetAutoHideEnabled", dock->setAutoHideEnabled(requested->autoHide)) ;
+        calls++ ;
+    }
+    return calls ;
+}
+
+// Reads the requested fields from the Dock, sets the ones which differ from the request and re-reads those.
+// Returns the fields which were changed; current is left holding the Dock's values for every requested
+// field. The comparison is always against the Dock itself, never the snapshot below, which may be stale.
+static inline uint32_t coredock_applyRequest(const coredock_backend *dock, const coredock_settings *requested, uint32_t fields, coredock_settings *current) {
+    *current = *requested ;
+    coredock_readFields(dock, current, fields) ;
+    uint32_t changed = coredock_diffSettings(current, requested, fields) ;
+    coredock_applySettings(dock, requested, changed) ;
+    coredock_readFields(dock, current, changed) ;
+    return changed ;
+}
+
+// Every getter used to make its own round trip to the Dock, and the orientation and pinning getters
+// both fetched the pair and discarded half of it. Instead we keep a snapshot of all of the Dock
+// properties which is filled in on first use after being invalidated and updated whenever a setter in
+// this module changes something. The generation is bumped each time the snapshot contents change.
+typedef struct {
+    coredock_settings settings ;
+    int               workspaceRows ;
+    int               workspaceColumns ;
+    int64_t           generation ;
+    bool              valid ;
+} coredock_snapshot ;
+
+// returns the snapshot's settings, reading everything from the Dock first if it has been invalidated
+static inline const coredock_settings *coredock_snapshot_settings(coredock_snapshot *snapshot, const coredock_backend *dock) {
+    if (!snapshot->valid) {
+        coredock_readSettings(dock, &snapshot->settings) ;
+        coredock_readWorkspaces(dock, &snapshot->workspaceRows, &snapshot->workspaceColumns) ;
+        snapshot->valid = true ;
+        snapshot->generation++ ;
+    }
+    return &snapshot->settings ;
+}
+
+// stores the specified fields of values in the snapshot; an invalidated snapshot is left for the next read
+// to fill in
+static inline void coredock_snapshot_update(coredock_snapshot *snapshot, const coredock_settings *values, uint32_t fields) {
+    if (!snapshot->valid || coredock_diffSettings(&snapshot->settings, values, fields) == 0) return ;
+    coredock_settings *settings = &snapshot->settings ;
+    if (fields & kCoreDockFieldOrientation)       settings->orientation       = values->orientation ;
+    if (fields & kCoreDockFieldPinning)           settings->pinning           = values->pinning ;
+    if (fields & kCoreDockFieldTileSize)          settings->tileSize          = values->tileSize ;
+    if (fields & kCoreDockFieldMagnificationSize) settings->magnificationSize = values->magnificationSize ;
+    if (fields & kCoreDockFieldMagnification)     settings->magnification     = values->magnification ;
+    if (fields & kCoreDockFieldAnimationEffect)   settings->animationEffect   = values->animationEffect ;
+    if (fields & kCoreDockFieldAutoHide)          settings->autoHide          = values->autoHide ;
+    snapshot->generation++ ;
+}
+
+// re-reads the specified fields after a set made through this module
+static inline void coredock_snapshot_refresh(coredock_snapshot *snapshot, const coredock_backend *dock, uint32_t fields) {
+    if (!snapshot->valid) return ; // the next read will fetch everything anyways
+    coredock_settings updated = snapshot->settings ;
+    coredock_readFields(dock, &updated, fields) ;
+    coredock_snapshot_update(snapshot, &updated, fields) ;
+}
@@ -9,6 +9,13 @@
 --- Note that the top orientation and dock pinning has not been supported even within the private APIs for some time and may disappear from here in a future release unless another solution can be found.  It is provided here for testing and to encourage suggestions if someone is aware of a solution that has not yet been tried.
 
 local USERDATA_TAG = "hs._asm.undocumented.coredock"
+
+-- when the combined library built by the Makefile at the top of this repository is installed, it provides the
+-- internal modules through package.preload
+if not package.preload["hs._asm.undocumented.coredock.internal"] and package.searchpath("hs._asm.undocumented.combined", package.cpath) then
+    require("hs._asm.undocumented.combined")
+end
+
 local module       = require(USERDATA_TAG..".internal")
 
 local basePath = package.searchpath(USERDATA_TAG, package.path)
@@ -25,7 +32,19 @@ end
 
 -- Public interface ------------------------------------------------------
 
-module.options = ls.makeConstantsTable(module.options)
+-- fields which are built or loaded the first time they are used rather than when this module is loaded
+local _lazyFields = {
+    options = function() return module._options() end,
+}
+
+getmetatable(module).__index = function(self, key)
+    local builder = _lazyFields[key]
+    if builder then
+        local value = builder()
+        rawset(self, key, value)
+        return value
+    end
+end
 
 --- hs._asm.undocumented.coredock.restartDock()
 --- Function
@@ -1,11 +1,112 @@
 @import Cocoa ;
 @import LuaSkin ;
-#import "coredock.h"
+#import "coredock_settings.h"
+#import "coredock_animation.h"
+#import "hsasm_executor.h"
+#import "hsasm_constants.h"
+#import "hsasm_checkargs.h"
 
-static const char *USERDATA_TAG = "hs._asm.undocumented.coredock" ;
+static const char *USERDATA_TAG  = "hs._asm.undocumented.coredock" ;
+static const char *CONSTANTS_TAG = "hs._asm.undocumented.coredock.constants" ;
 
 static LSRefTable refTable = LUA_NOREF ;
 
+static const coredock_backend coredock_nativeBackend = {
+    "native",
+    CoreDockGetOrientationAndPinning,
+    CoreDockSetOrientationAndPinning,
+    CoreDockGetTileSize,
+    CoreDockSetTileSize,
+    CoreDockGetMagnificationSize,
+    CoreDockSetMagnificationSize,
+    CoreDockIsMagnificationEnabled,
+    CoreDockSetMagnificationEnabled,
+    CoreDockGetEffect,
+    CoreDockSetEffect,
+    CoreDockGetAutoHideEnabled,
+    CoreDockSetAutoHideEnabled,
+    CoreDockGetWorkspacesCount   // weak import; may be NULL
+} ;
+
+static const coredock_backend *dock = &coredock_nativeBackend ;
+
+// validates the field at the top of the stack and stores it in settings; raises a lua error if it is invalid
+static void coredock_parseField(lua_State *L, CoreDockField field, const char *name, coredock_settings *settings) {
+    switch(field) {
+        case kCoreDockFieldOrientation: {
+            lua_Integer value = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : -1 ;
+            if (value < kCoreDockOrientationTop || value > kCoreDockOrientationRight) {
+                luaL_error(L, "%s must be an integer as specified in hs._asm.undocumented.coredock.options.orientation", name) ;
+            }
+            settings->orientation = (CoreDockOrientation)value ;
+        } break ;
+        case kCoreDockFieldPinning: {
+            lua_Integer value = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : -1 ;
+            if (value < kCoreDockPinningStart || value > kCoreDockPinningEnd) {
+                luaL_error(L, "%s must be an integer as specified in hs._asm.undocumented.coredock.options.pinning", name) ;
+            }
+            settings->pinning = (CoreDockPinning)value ;
+        } break ;
+        case kCoreDockFieldAnimationEffect: {
+            lua_Integer value = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : -1 ;
+            if (value < kCoreDockEffectGenie || value > kCoreDockEffectSuck) {
+                luaL_error(L, "%s must be an integer as specified in hs._asm.undocumented.coredock.options.effect", name) ;
+            }
+            settings->animationEffect = (CoreDockEffect)value ;
+        } break ;
+        case kCoreDockFieldTileSize:
+        case kCoreDockFieldMagnificationSize: {
+            if (lua_type(L, -1) != LUA_TNUMBER) luaL_error(L, "%s must be a number between 0.0 and 1.0", name) ;
+            float value = (float)lua_tonumber(L, -1) ;
+            if (value < 0 || value > 1) luaL_error(L, "%s must be a number between 0.0 and 1.0", name) ;
+            if (field == kCoreDockFieldTileSize) {
+                settings->tileSize = value ;
+            } else {
+                settings->magnificationSize = value ;
+            }
+        } break ;
+        case kCoreDockFieldMagnification:
+        case kCoreDockFieldAutoHide: {
+            if (lua_type(L, -1) != LUA_TBOOLEAN) luaL_error(L, "%s must be a boolean", name) ;
+            if (field == kCoreDockFieldMagnification) {
+                settings->magnification = (Boolean)lua_toboolean(L, -1) ;
+            } else {
+                settings->autoHide = (Boolean)lua_toboolean(L, -1) ;
+            }
+        } break ;
+    }
+}
+
+static coredock_snapshot dockState = { .valid = false, .generation = 0 } ;
+
+// changes requested with a callback are made on this lane so a slow Dock doesn't block the main thread;
+// everything else which talks to the Dock waits for the lane first so the changes stay in order
+static hsasm_lane dockLane = HSASM_LANE("hs._asm.undocumented.coredock", 16) ;
+
+// the snapshot is only read and updated on the main thread; the lane is drained first, including the
+// completions which copy background changes into it, so it reflects any changes still being made
+static const coredock_settings *coredock_currentSettings(void) {
+    hsasm_lane_barrier(&dockLane) ;
+    return coredock_snapshot_settings(&dockState, dock) ;
+}
+
+static void coredock_refreshFields(uint32_t fields) {
+    if (!dockState.valid) return ;
+    hsasm_lane_barrier(&dockLane) ;
+    coredock_snapshot_refresh(&dockState, dock, fields) ;
+}
+
+// pushes an array of the names of the fields set in `fields`
+static void coredock_pushFieldNames(lua_State *L, uint32_t fields) {
+    lua_newtable(L) ;
+    for (size_t i = 0 ; i < COREDOCK_FIELD_COUNT ; i++) {
+        if (fields & coredock_fieldNames[i].field) {
+            lua_pushstring(L, coredock_fieldNames[i].name) ;
+            lua_rawseti(L, -2, luaL_len(L, -2) + 1) ;
+        }
+    }
+}
+
 /// hs._asm.undocumented.coredock.tileSize([size]) -> float
 /// Function
 /// Get or set the Dock icon tile size as a number between 0.0 and 1.0.
@@ -16,17 +117,18 @@ static LSRefTable refTable = LUA_NOREF ;
 /// Returns:
 ///  * the (possibly changed) current value
 static int coredock_tilesize(lua_State* L) {
-    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
-    [skin checkArgs:LS_TNUMBER | LS_TOPTIONAL, LS_TBREAK] ;
+    HSASM_CHECKARGS(L, LS_TNUMBER | LS_TOPTIONAL, LS_TBREAK) ;
 
     if (!lua_isnone(L, 1)) {
         float tileSize = (float) luaL_checknumber(L, -1) ;
+        hsasm_lane_barrier(&dockLane) ;
         if (tileSize >= 0 && tileSize <= 1)
-            CoreDockSetTileSize(tileSize) ;
+            HSASM_SPI_VOID("CoreDockSetTileSize", dock->setTileSize(tileSize)) ;
         else
             return luaL_error(L,"tilesize must be a number between 0.0 and 1.0") ;
+        coredock_refreshFields(kCoreDockFieldTileSize) ;
     }
-    lua_pushnumber(L, (lua_Number)CoreDockGetTileSize()) ;
+    lua_pushnumber(L, (lua_Number)coredock_currentSettings()->tileSize) ;
     return 1 ;
 }
 
@@ -40,17 +142,18 @@ static int coredock_tilesize(lua_State* L) {
 /// Returns:
 ///  * the (possibly changed) current value
 static int coredock_magnification_size(lua_State* L) {
-    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
-    [skin checkArgs:LS_TNUMBER | LS_TOPTIONAL, LS_TBREAK] ;
+    HSASM_CHECKARGS(L, LS_TNUMBER | LS_TOPTIONAL, LS_TBREAK) ;
 
     if (!lua_isnone(L, 1)) {
         float magSize = (float) luaL_checknumber(L, -1) ;
+        hsasm_lane_barrier(&dockLane) ;
         if (magSize >= 0 && magSize <= 1)
-            CoreDockSetMagnificationSize(magSize) ;
+            HSASM_SPI_VOID("CoreDockSetMagnificationSize", dock->setMagnificationSize(magSize)) ;
         else
             return luaL_error(L,"magnification_size must be a number between 0.0 and 1.0") ;
+        coredock_refreshFields(kCoreDockFieldMagnificationSize) ;
     }
-    lua_pushnumber(L, (lua_Number)CoreDockGetMagnificationSize()) ;
+    lua_pushnumber(L, (lua_Number)coredock_currentSettings()->magnificationSize) ;
     return 1 ;
 }
 
@@ -78,18 +181,16 @@ static int coredock_magnification_size(lua_State* L) {
 /// Notes:
 ///  * the top orientation and dock pinning has not been supported even within the private APIs for some time and may disappear from here in a future release unless another solution can be found.  It is provided here for testing and to encourage suggestions if someone is aware of a solution that has not yet been tried.
 static int coredock_orientation(lua_State* L) {
-    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
-    [skin checkArgs:LS_TNUMBER | LS_TOPTIONAL, LS_TBREAK] ;
+    HSASM_CHECKARGS(L, LS_TNUMBER | LS_TOPTIONAL, LS_TBREAK) ;
 
     if (!lua_isnone(L, 1)) {
         CoreDockOrientation ourOrientation = (CoreDockOrientation)(luaL_checkinteger(L, -1)) ;
         CoreDockPinning ourPinning = kCoreDockPinningIgnore ;
-        CoreDockSetOrientationAndPinning(ourOrientation, ourPinning) ;
+        hsasm_lane_barrier(&dockLane) ;
+        HSASM_SPI_VOID("CoreDockSetOrientationAndPinning", dock->setOrientationAndPinning(ourOrientation, ourPinning)) ;
+        coredock_refreshFields(kCoreDockFieldOrientation | kCoreDockFieldPinning) ;
     }
-    CoreDockOrientation ourOrientation ;
-    CoreDockPinning     ourPinning ;
-    CoreDockGetOrientationAndPinning(&ourOrientation, &ourPinning) ;
-    lua_pushinteger(L, (int) ourOrientation) ;
+    lua_pushinteger(L, (int) coredock_currentSettings()->orientation) ;
     return 1 ;
 }
 
@@ -106,18 +207,16 @@ static int coredock_orientation(lua_State* L) {
 /// Notes:
 ///  * the top orientation and dock pinning has not been supported even within the private APIs for some time and may disappear from here in a future release unless another solution can be found.  It is provided here for testing and to encourage suggestions if someone is aware of a solution that has not yet been tried.
 static int coredock_pinning(lua_State* L) {
-    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
-    [skin checkArgs:LS_TNUMBER | LS_TOPTIONAL, LS_TBREAK] ;
+    HSASM_CHECKARGS(L, LS_TNUMBER | LS_TOPTIONAL, LS_TBREAK) ;
 
     if (!lua_isnone(L, 1)) {
         CoreDockOrientation ourOrientation = kCoreDockOrientationIgnore ;
         CoreDockPinning ourPinning = (CoreDockPinning)(luaL_checkinteger(L, -1)) ;
-        CoreDockSetOrientationAndPinning(ourOrientation, ourPinning) ;
+        hsasm_lane_barrier(&dockLane) ;
+        HSASM_SPI_VOID("CoreDockSetOrientationAndPinning", dock->setOrientationAndPinning(ourOrientation, ourPinning)) ;
+        coredock_refreshFields(kCoreDockFieldOrientation | kCoreDockFieldPinning) ;
     }
-    CoreDockOrientation ourOrientation ;
-    CoreDockPinning     ourPinning ;
-    CoreDockGetOrientationAndPinning(&ourOrientation, &ourPinning) ;
-    lua_pushinteger(L, (int) ourPinning) ;
+    lua_pushinteger(L, (int) coredock_currentSettings()->pinning) ;
     return 1 ;
 }
 
@@ -132,13 +231,14 @@ static int coredock_pinning(lua_State* L) {
 /// Returns:
 ///  * the (possibly changed) current value
 static int coredock_magnification(lua_State* L) {
-    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
-    [skin checkArgs:LS_TBOOLEAN | LS_TOPTIONAL, LS_TBREAK] ;
+    HSASM_CHECKARGS(L, LS_TBOOLEAN | LS_TOPTIONAL, LS_TBREAK) ;
 
     if (!lua_isnone(L, 1)) {
-        CoreDockSetMagnificationEnabled((Boolean) lua_toboolean(L, -1)) ;
+        hsasm_lane_barrier(&dockLane) ;
+        HSASM_SPI_VOID("CoreDockSetMagnificationEnabled", dock->setMagnificationEnabled((Boolean) lua_toboolean(L, -1))) ;
+        coredock_refreshFields(kCoreDockFieldMagnification) ;
     }
-    if (CoreDockIsMagnificationEnabled()) lua_pushboolean(L, YES) ; else lua_pushboolean(L, NO) ;
+    if (coredock_currentSettings()->magnification) lua_pushboolean(L, YES) ; else lua_pushboolean(L, NO) ;
     return 1 ;
 }
 
@@ -152,13 +252,14 @@ static int coredock_magnification(lua_State* L) {
 /// Returns:
 ///  * the (possibly changed) current value
 static int coredock_autohide(lua_State* L) {
-    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
-    [skin checkArgs:LS_TBOOLEAN | LS_TOPTIONAL, LS_TBREAK] ;
+    HSASM_CHECKARGS(L, LS_TBOOLEAN | LS_TOPTIONAL, LS_TBREAK) ;
 
     if (!lua_isnone(L, 1)) {
-        CoreDockSetAutoHideEnabled((Boolean) lua_toboolean(L, -1)) ;
+        hsasm_lane_barrier(&dockLane) ;
+        HSASM_SPI_VOID("CoreDockSetAutoHideEnabled", dock->setAutoHideEnabled((Boolean) lua_toboolean(L, -1))) ;
+        coredock_refreshFields(kCoreDockFieldAutoHide) ;
     }
-    if (CoreDockGetAutoHideEnabled()) lua_pushboolean(L, YES) ; else lua_pushboolean(L, NO) ;
+    if (coredock_currentSettings()->autoHide) lua_pushboolean(L, YES) ; else lua_pushboolean(L, NO) ;
     return 1 ;
 }
 
@@ -172,19 +273,491 @@ static int coredock_autohide(lua_State* L) {
 /// Returns:
 ///  * the (possibly changed) current value
 static int coredock_animationeffect(lua_State* L) {
-    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
-    [skin checkArgs:LS_TNUMBER | LS_TOPTIONAL, LS_TBREAK] ;
+    HSASM_CHECKARGS(L, LS_TNUMBER | LS_TOPTIONAL, LS_TBREAK) ;
 
     if (!lua_isnone(L, 1)) {
         CoreDockEffect ourEffect = (CoreDockEffect)(luaL_checkinteger(L, -1)) ;
-        CoreDockSetEffect(ourEffect) ;
+        hsasm_lane_barrier(&dockLane) ;
+        HSASM_SPI_VOID("CoreDockSetEffect", dock->setEffect(ourEffect)) ;
+        coredock_refreshFields(kCoreDockFieldAnimationEffect) ;
+    }
+    lua_pushinteger(L, (int) coredock_currentSettings()->animationEffect) ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.coredock.apply(settings, [fn]) -> table | boolean
+/// Function
+/// Change multiple Dock settings at once, only invoking the private API for the settings which actually differ from their current values.
+///
+/// Parameters:
+///  * settings - a table containing one or more of the following key-value pairs:
+///    * orientation       - an integer as specified in `hs._asm.undocumented.coredock.options.orientation`
+///    * pinning           - an integer as specified in `hs._asm.undocumented.coredock.options.pinning`
+///    * tileSize          - a number between 0.0 and 1.0
+///    * magnificationSize - a number between 0.0 and 1.0
+///    * magnification     - a boolean
+///    * animationEffect   - an integer as specified in `hs._asm.undocumented.coredock.options.effect`
+///    * autoHide          - a boolean
+///  * fn       - an optional function which, if provided, causes the changes to be made in the background. It will be invoked with an array containing the names of the settings which were changed once they have been applied.
+///
+/// Returns:
+///  * if `fn` is not provided, an array containing the names of the settings which were changed; settings which already matched the requested value are not included.
+///  * if `fn` is provided, true if the changes were queued or false if too many changes are already waiting to be applied; see [hs._asm.undocumented.coredock.executorStats](#executorStats).
+///
+/// Notes:
+///  * every value is validated before any change is made; if any key is unrecognized or any value is invalid, an error is generated and the Dock is left untouched.
+///  * each private API call causes the Dock to re-layout, so changing several settings with this function instead of the individual functions reduces the visible flicker. If both `orientation` and `pinning` change, they are set with a single call.
+///  * changes made in the background are applied in the order they were requested, and any other function in this module which reads or changes the Dock settings waits for them to finish first, so e.g. `coredock.tileSize()` returns the new size as soon as `apply` returns. The callbacks of those changes are invoked before the waiting function returns.
+static int coredock_apply(lua_State* L) {
+    HSASM_CHECKARGS(L, LS_TTABLE, LS_TFUNCTION | LS_TOPTIONAL, LS_TBREAK) ;
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+
+    coredock_settings requested = { kCoreDockOrientationIgnore, kCoreDockPinningIgnore, 0.0f, 0.0f, false, kCoreDockEffectGenie, false } ;
+    uint32_t          requestedFields = 0 ;
+
+    lua_pushnil(L) ;
+    while (lua_next(L, 1) != 0) {
+        const char *key = (lua_type(L, -2) == LUA_TSTRING) ? lua_tostring(L, -2) : NULL ;
+        BOOL       found = NO ;
+        if (key) {
+            for (size_t i = 0 ; i < COREDOCK_FIELD_COUNT ; i++) {
+                if (!strcmp(key, coredock_fieldNames[i].name)) {
+                    coredock_parseField(L, coredock_fieldNames[i].field, key, &requested) ;
+                    requestedFields |= coredock_fieldNames[i].field ;
+                    found = YES ;
+                    break ;
+                }
+            }
+        }
+        if (!found) {
+            lua_pushvalue(L, -2) ; // don't let luaL_tolstring change the key lua_next is using
+            return luaL_error(L, "unrecognized setting %s", luaL_tolstring(L, -1, NULL)) ;
+        }
+        lua_pop(L, 1) ;
+    }
+
+    if (lua_type(L, 2) == LUA_TFUNCTION) {
+        lua_pushvalue(L, 2) ;
+        int callbackRef = [skin luaRef:refTable] ;
+
+        // earlier background changes may still be pending, so the Dock is read on the lane rather than
+        // comparing against our snapshot
+        __block coredock_settings updated ;
+        __block uint32_t          changed ;
+        BOOL queued = hsasm_lane_async(&dockLane, ^{
+            changed = coredock_applyRequest(dock, &requested, requestedFields, &updated) ;
+        }, ^{
+            coredock_snapshot_update(&dockState, &updated, requestedFields) ;
+        }, ^{
+            hsasm_lane_callback(refTable, callbackRef, @"hs._asm.undocumented.coredock.apply callback", ^(lua_State *cbL) {
+                coredock_pushFieldNames(cbL, changed) ;
+                return 1 ;
+            }) ;
+        }) ;
+        if (!queued) [skin luaUnref:refTable ref:callbackRef] ;
+        lua_pushboolean(L, queued) ;
+        return 1 ;
+    }
+
+    // the snapshot may be stale if the settings were changed outside of this module, so the diff is
+    // against a fresh read of the requested fields, just as it is in the background
+    hsasm_lane_barrier(&dockLane) ;
+    coredock_settings updated ;
+    uint32_t          changed = coredock_applyRequest(dock, &requested, requestedFields, &updated) ;
+    coredock_snapshot_update(&dockState, &updated, requestedFields) ;
+
+    coredock_pushFieldNames(L, changed) ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.coredock.snapshot() -> table
+/// Function
+/// Returns a table containing the current values of all of the Dock properties this module tracks.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * a table containing the following keys:
+///    * orientation       - an integer as specified in `hs._asm.undocumented.coredock.options.orientation`
+///    * pinning           - an integer as specified in `hs._asm.undocumented.coredock.options.pinning`
+///    * tileSize          - a number between 0.0 and 1.0
+///    * magnificationSize - a number between 0.0 and 1.0
+///    * magnification     - a boolean
+///    * animationEffect   - an integer as specified in `hs._asm.undocumented.coredock.options.effect`
+///    * autoHide          - a boolean
+///    * workspaces        - a table with the keys `rows` and `columns`; both will be 0 if the private API for this is not available on your system
+///    * generation        - an integer which increases each time any of the values above change
+///
+/// Notes:
+///  * the values returned by this function and by the getters of this module come from a snapshot which is refreshed only when a setting is changed through this module or after [hs._asm.undocumented.coredock.invalidate](#invalidate) has been invoked. This makes repeated reads inexpensive, but changes made in System Preferences or with `defaults` will not be seen until the snapshot is invalidated.
+///  * comparing the `generation` value to one saved earlier is a quick way to determine if anything has changed since then.
+static int coredock_snapshot_table(lua_State* L) {
+    HSASM_CHECKARGS(L, LS_TBREAK) ;
+
+    const coredock_settings *settings = coredock_currentSettings() ;
+    lua_newtable(L) ;
+    lua_pushinteger(L, (int) settings->orientation) ;            lua_setfield(L, -2, "orientation") ;
+    lua_pushinteger(L, (int) settings->pinning) ;                lua_setfield(L, -2, "pinning") ;
+    lua_pushnumber(L, (lua_Number)settings->tileSize) ;          lua_setfield(L, -2, "tileSize") ;
+    lua_pushnumber(L, (lua_Number)settings->magnificationSize) ; lua_setfield(L, -2, "magnificationSize") ;
+    lua_pushboolean(L, settings->magnification) ;                lua_setfield(L, -2, "magnification") ;
+    lua_pushinteger(L, (int) settings->animationEffect) ;        lua_setfield(L, -2, "animationEffect") ;
+    lua_pushboolean(L, settings->autoHide) ;                     lua_setfield(L, -2, "autoHide") ;
+    lua_newtable(L) ;
+        lua_pushinteger(L, dockState.workspaceRows) ;    lua_setfield(L, -2, "rows") ;
+        lua_pushinteger(L, dockState.workspaceColumns) ; lua_setfield(L, -2, "columns") ;
+    lua_setfield(L, -2, "workspaces") ;
+    lua_pushinteger(L, dockState.generation) ;                   lua_setfield(L, -2, "generation") ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.coredock.invalidate() -> None
+/// Function
+/// Marks the snapshot of Dock properties as stale so that it will be refreshed from the Dock on next use.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * None
+///
+/// Notes:
+///  * use this when you know the Dock settings have been changed outside of this module, e.g. from System Preferences or another application.
+///  * the snapshot is not refreshed until the next time a value is requested, so calling this repeatedly is inexpensive.
+static int coredock_invalidate(lua_State* L) {
+    HSASM_CHECKARGS(L, LS_TBREAK) ;
+
+    dockState.valid = false ;
+    return 0 ;
+}
+
+// the animation state is only touched on the main thread
+static coredock_animator animator = {
+    .tileSize          = { .field = kCoreDockFieldTileSize,          .callbackRef = LUA_NOREF },
+    .magnificationSize = { .field = kCoreDockFieldMagnificationSize, .callbackRef = LUA_NOREF },
+} ;
+static NSTimer  *animationTimer ;
+static double   animationRate       = COREDOCK_ANIMATION_DEFAULT_RATE ;
+static uint32_t animationGeneration = 0 ; // deferred callbacks queued before the module was collected are skipped
+
+// applies a size during an animation; the snapshot is updated with the value we set rather than re-read
+// from the Dock each frame, and the real value is fetched once the animation completes.
+static void coredock_setAnimatedValue(__unused void *context, CoreDockField field, float value) {
+    hsasm_lane_barrier(&dockLane) ;
+    coredock_settings values = dockState.settings ;
+    if (field == kCoreDockFieldTileSize) {
+        HSASM_SPI_VOID("CoreDockSetTileSize", dock->setTileSize(value)) ;
+        values.tileSize = value ;
+    } else {
+        HSASM_SPI_VOID("CoreDockSetMagnificationSize", dock->setMagnificationSize(value)) ;
+        values.magnificationSize = value ;
+    }
+    coredock_snapshot_update(&dockState, &values, field) ;
+}
+
+static void coredock_finishAnimation(coredock_animation animation, BOOL completed) {
+    hsasm_lane_callback(refTable, animation.callbackRef, @"hs._asm.undocumented.coredock.animate callback", ^(lua_State *L) {
+        lua_pushstring(L, coredock_fieldName(animation.field)) ;
+        lua_pushboolean(L, completed) ;
+        return 2 ;
+    }) ;
+}
+
+// Reports a cancelled or replaced animation on the next pass through the run loop. Calling back into Lua
+// in the middle of coredock.animate or coredock.cancelAnimation would let the callback start another
+// animation of the same property while we are still changing it.
+static void coredock_finishAnimationLater(coredock_animation animation) {
+    if (!animation.active || animation.callbackRef == LUA_NOREF) return ;
+    uint32_t generation = animationGeneration ;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (generation == animationGeneration) coredock_finishAnimation(animation, NO) ;
+    }) ;
+}
+
+static void coredock_stopAnimationTimerIfIdle(void) {
+    if (!coredock_animator_active(&animator)) {
+        [animationTimer invalidate] ;
+        animationTimer = nil ;
+    }
+}
+
+static void coredock_animationTick(NSTimer *timer) {
+    coredock_animation finished[2] ;
+    int count = coredock_animator_tick(&animator, [NSProcessInfo processInfo].systemUptime, timer.timeInterval,
+                                       coredock_setAnimatedValue, NULL, finished) ;
+    for (int i = 0 ; i < count ; i++) coredock_refreshFields(finished[i].field) ;
+    // the animations are already removed, so a callback may start a new animation for its property
+    for (int i = 0 ; i < count ; i++) coredock_finishAnimation(finished[i], YES) ;
+    coredock_stopAnimationTimerIfIdle() ;
+}
+
+static void coredock_startAnimationTimer(void) {
+    if (animationTimer) return ;
+    animationTimer = [NSTimer scheduledTimerWithTimeInterval:(1.0 / animationRate)
+                                                     repeats:YES
+                                                       block:^(NSTimer *timer) {
+        coredock_animationTick(timer) ;
+    }] ;
+}
+
+static void coredock_cancelAnimation(CoreDockField field) {
+    coredock_animation cancelled = coredock_animator_cancel(&animator, field) ;
+    if (cancelled.active) {
+        coredock_refreshFields(field) ;
+        coredock_finishAnimationLater(cancelled) ;
+    }
+}
+
+/// hs._asm.undocumented.coredock.animate(property, target, duration, [easing], [fn]) -> None
+/// Function
+/// Smoothly change the Dock tile size or magnification size to a new value over time.
+///
+/// Parameters:
+///  * property - a string specifying the property to animate, either "tileSize" or "magnificationSize"
+///  * target   - a number between 0.0 and 1.0 specifying the final value for the property
+///  * duration - a number specifying the number of seconds the change should take
+///  * easing   - an optional string specifying the easing curve to use. Must be one of "linear", "easeIn", "easeOut", or "easeInOut". Defaults to "linear".
+///  * fn       - an optional callback function which will be invoked when the animation ends. The function should expect two arguments: the property name and a boolean which is true if the animation completed or false if it was cancelled or replaced.
+///
+/// Returns:
+///  * None
+///
+/// Notes:
+///  * frames are generated at the rate specified by [hs._asm.undocumented.coredock.animationRate](#animationRate). If the Dock cannot keep up, intermediate frames are dropped rather than queued so the animation still finishes on time; see [hs._asm.undocumented.coredock.animationStats](#animationStats).
+///  * starting a new animation for a property which is already being animated replaces the earlier animation, starting from the current value. The callback for the replaced animation is invoked after this function returns.
+///  * the tile size and magnification size may be animated at the same time.
+static int coredock_animate(lua_State* L) {
+    HSASM_CHECKARGS(L, LS_TSTRING, LS_TNUMBER, LS_TNUMBER, LS_TSTRING | LS_TFUNCTION | LS_TNIL | LS_TOPTIONAL, LS_TFUNCTION | LS_TNIL | LS_TOPTIONAL, LS_TBREAK) ;
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+
+    const char    *property = lua_tostring(L, 1) ;
+    float         target    = (float)lua_tonumber(L, 2) ;
+    lua_Number    duration  = lua_tonumber(L, 3) ;
+    CoreDockField field ;
+
+    if (!strcmp(property, "tileSize")) {
+        field = kCoreDockFieldTileSize ;
+    } else if (!strcmp(property, "magnificationSize")) {
+        field = kCoreDockFieldMagnificationSize ;
+    } else {
+        return luaL_argerror(L, 1, "property must be tileSize or magnificationSize") ;
+    }
+    if (target < 0 || target > 1) return luaL_argerror(L, 2, "target must be a number between 0.0 and 1.0") ;
+    if (duration < 0)             return luaL_argerror(L, 3, "duration cannot be negative") ;
+
+    int            fnIdx  = 5 ;
+    CoreDockEasing easing = kCoreDockEasingLinear ;
+    if (lua_type(L, 4) == LUA_TSTRING) {
+        easing = (CoreDockEasing)luaL_checkoption(L, 4, NULL, coredock_easingNames) ;
+    } else if (lua_type(L, 4) == LUA_TFUNCTION) {
+        if (lua_gettop(L) > 4) return luaL_argerror(L, 5, "callback must follow the easing name") ;
+        fnIdx = 4 ;
+    }
+
+    // a replaced animation is left wherever it stopped, so fetch the real value before starting from it
+    if (coredock_animator_slot(&animator, field)->active) coredock_refreshFields(field) ;
+    const coredock_settings *settings  = coredock_currentSettings() ;
+    float                   fromValue = (field == kCoreDockFieldTileSize) ? settings->tileSize : settings->magnificationSize ;
+
+    int callbackRef = LUA_NOREF ;
+    if (lua_type(L, fnIdx) == LUA_TFUNCTION) {
+        lua_pushvalue(L, fnIdx) ;
+        callbackRef = [skin luaRef:refTable] ;
+    }
+
+    coredock_animation replaced = coredock_animator_start(&animator, field, fromValue, target, duration, easing,
+                                                          callbackRef, [NSProcessInfo processInfo].systemUptime) ;
+    coredock_finishAnimationLater(replaced) ;
+    coredock_startAnimationTimer() ;
+    return 0 ;
+}
+
+/// hs._asm.undocumented.coredock.cancelAnimation(property) -> None
+/// Function
+/// Stops the animation of the specified property, leaving it at its current value.
+///
+/// Parameters:
+///  * property - a string specifying the property, either "tileSize" or "magnificationSize"
+///
+/// Returns:
+///  * None
+///
+/// Notes:
+///  * if a callback was provided to [hs._asm.undocumented.coredock.animate](#animate), it will be invoked with false as its second argument the next time the run loop is idle, so it may safely start a new animation.
+static int coredock_cancelAnimationFunction(lua_State* L) {
+    HSASM_CHECKARGS(L, LS_TSTRING, LS_TBREAK) ;
+
+    const char *property = lua_tostring(L, 1) ;
+    if (!strcmp(property, "tileSize")) {
+        coredock_cancelAnimation(kCoreDockFieldTileSize) ;
+    } else if (!strcmp(property, "magnificationSize")) {
+        coredock_cancelAnimation(kCoreDockFieldMagnificationSize) ;
+    } else {
+        return luaL_argerror(L, 1, "property must be tileSize or magnificationSize") ;
     }
-    CoreDockEffect  ourEffect ;
-    CoreDockGetEffect(&ourEffect) ;
-    lua_pushinteger(L, (int) ourEffect) ;
+    coredock_stopAnimationTimerIfIdle() ;
+    return 0 ;
+}
+
+/// hs._asm.undocumented.coredock.animationRate([fps]) -> number
+/// Function
+/// Get or set the number of frames per second used by [hs._asm.undocumented.coredock.animate](#animate).
+///
+/// Parameters:
+///  * fps - an optional number between 1 and 120 specifying the frame rate. Defaults to 30.
+///
+/// Returns:
+///  * the (possibly changed) current value
+///
+/// Notes:
+///  * a change takes effect the next time an animation is started while no other animation is active.
+static int coredock_animationRate(lua_State* L) {
+    HSASM_CHECKARGS(L, LS_TNUMBER | LS_TOPTIONAL, LS_TBREAK) ;
+
+    if (lua_gettop(L) == 1) {
+        lua_Number rate = lua_tonumber(L, 1) ;
+        if (rate < 1 || rate > COREDOCK_ANIMATION_MAX_RATE) return luaL_argerror(L, 1, "rate must be between 1 and 120") ;
+        animationRate = rate ;
+    }
+    lua_pushnumber(L, animationRate) ;
     return 1 ;
 }
 
+/// hs._asm.undocumented.coredock.animationStats([reset]) -> table
+/// Function
+/// Returns statistics about the frames generated by [hs._asm.undocumented.coredock.animate](#animate).
+///
+/// Parameters:
+///  * reset - an optional boolean, default false, specifying whether or not the counters should be reset to 0 after being returned.
+///
+/// Returns:
+///  * a table containing the following keys:
+///    * framesApplied - the number of times the tile size or magnification size was changed by an animation
+///    * framesDropped - the number of frames which were skipped because the timer fired late, usually because the Dock or Hammerspoon was busy
+///    * active        - an array of the properties currently being animated
+///    * rate          - the current frame rate
+static int coredock_animationStats(lua_State* L) {
+    HSASM_CHECKARGS(L, LS_TBOOLEAN | LS_TOPTIONAL, LS_TBREAK) ;
+
+    lua_newtable(L) ;
+    lua_pushinteger(L, animator.framesApplied) ; lua_setfield(L, -2, "framesApplied") ;
+    lua_pushinteger(L, animator.framesDropped) ; lua_setfield(L, -2, "framesDropped") ;
+    lua_newtable(L) ;
+    if (animator.tileSize.active) {
+        lua_pushstring(L, "tileSize") ; lua_rawseti(L, -2, luaL_len(L, -2) + 1) ;
+    }
+    if (animator.magnificationSize.active) {
+        lua_pushstring(L, "magnificationSize") ; lua_rawseti(L, -2, luaL_len(L, -2) + 1) ;
+    }
+    lua_setfield(L, -2, "active") ;
+    lua_pushnumber(L, animationRate) ; lua_setfield(L, -2, "rate") ;
+
+    if (lua_toboolean(L, 1)) {
+        animator.framesApplied = 0 ;
+        animator.framesDropped = 0 ;
+    }
+    return 1 ;
+}
+
+/// hs._asm.undocumented.coredock.stats([json]) -> table | string
+/// Function
+/// Returns call counts and timing for the private Dock functions used by this module.
+///
+/// Parameters:
+///  * json - an optional boolean, default false, specifying whether the statistics should be returned as a JSON string instead of a table.
+///
+/// Returns:
+///  * a table keyed by function name (e.g. `CoreDockSetTileSize`), each entry containing the following keys:
+///    * calls      - the number of times the function has been called
+///    * errors     - the number of calls which reported an error; the CoreDock functions don't return a status, so this will always be 0
+///    * errorCodes - a table of error code -> count
+///    * totalNs, meanNs, minNs, maxNs - the total, mean, shortest and longest time spent in the function in nanoseconds
+///    * p50, p90, p99, p999 - latency percentiles in nanoseconds, accurate to within 25%
+///
+/// Notes:
+///  * functions which have not been called since the statistics were last reset are not included.
+static int coredock_stats(lua_State* L) {
+    return hsasm_spi_pushStats(L) ;
+}
+
+/// hs._asm.undocumented.coredock.resetStats() -> None
+/// Function
+/// Clears the statistics returned by [hs._asm.undocumented.coredock.stats](#stats).
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * None
+static int coredock_resetStats(lua_State* L) {
+    return hsasm_spi_resetStats(L) ;
+}
+
+/// hs._asm.undocumented.coredock.executorStats() -> table
+/// Function
+/// Returns information about the background queue used by [hs._asm.undocumented.coredock.apply](#apply) when a callback is provided.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * a table containing the following keys:
+///    * name      - the name of the queue
+///    * limit     - the maximum number of changes which may be waiting at once
+///    * depth     - the number of changes currently waiting or being applied
+///    * peakDepth - the largest `depth` seen
+///    * submitted - the number of changes queued
+///    * completed - the number of changes which have finished
+///    * rejected  - the number of changes refused because `limit` was reached
+///    * barriers  - the number of times a function had to wait for queued changes before it could talk to the Dock
+///    * meanWait  - the average number of seconds a change waited before it started
+///    * meanRun   - the average number of seconds spent applying a change
+static int coredock_executorStats(lua_State* L) {
+    HSASM_CHECKARGS(L, LS_TBREAK) ;
+    hsasm_lane_pushStats(L, &dockLane) ;
+    return 1 ;
+}
+
+// _mockBackend([enable], [options]) -> table
+// switches between the Dock and an in-memory mock of it (see hsasm_mock.h) and returns a table describing
+// the backend in use and the mock's configuration and call counts
+static int coredock_selectBackend(lua_State* L) {
+    HSASM_CHECKARGS(L, LS_TBOOLEAN | LS_TOPTIONAL, LS_TTABLE | LS_TOPTIONAL, LS_TBREAK) ;
+
+    if (lua_isboolean(L, 1)) {
+        hsasm_lane_barrier(&dockLane) ;
+        dock            = lua_toboolean(L, 1) ? &coredock_mockBackend : &coredock_nativeBackend ;
+        dockState.valid = false ;
+        hsasm_mock_configure(L, 2, &coredock_mock) ;
+    }
+    hsasm_mock_pushStats(L, dock->name, &coredock_mock) ;
+    return 1 ;
+}
+
+static const hsasm_constant coredock_orientationNames[] = {
+    { "top",    kCoreDockOrientationTop },
+    { "bottom", kCoreDockOrientationBottom },
+    { "left",   kCoreDockOrientationLeft },
+    { "right",  kCoreDockOrientationRight },
+} ;
+
+static const hsasm_constant coredock_pinningNames[] = {
+    { "start",  kCoreDockPinningStart },
+    { "middle", kCoreDockPinningMiddle },
+    { "end",    kCoreDockPinningEnd },
+} ;
+
+static const hsasm_constant coredock_effectNames[] = {
+    { "genie",  kCoreDockEffectGenie },
+    { "scale",  kCoreDockEffectScale },
+    { "suck",   kCoreDockEffectSuck },
+} ;
+
+static hsasm_constants coredockOrientations = HSASM_CONSTANTS("orientation", coredock_orientationNames) ;
+static hsasm_constants coredockPinnings     = HSASM_CONSTANTS("pinning", coredock_pinningNames) ;
+static hsasm_constants coredockEffects      = HSASM_CONSTANTS("effect", coredock_effectNames) ;
+
 /// hs._asm.undocumented.coredock.options[]
 /// Variable
 /// Connivence array of all currently defined coredock options.
@@ -209,25 +782,15 @@ static int coredock_animationeffect(lua_State* L) {
 ///    * suck        -- use the suck animation
 ///
 /// Notes:
+///  * each of `orientation`, `pinning` and `effect` is a read-only table of constants: indexing it with a name returns the value, and indexing it with a value returns the name.
 ///  * the top orientation and dock pinning has not been supported even within the private APIs for some time and may disappear from here in a future release unless another solution can be found.  It is provided here for testing and to encourage suggestions if someone is aware of a solution that has not yet been tried.
-static void coredock_options (lua_State *L) {
+static int coredock_options (lua_State *L) {
     lua_newtable(L) ;
-        lua_newtable(L) ;
-            lua_pushinteger(L, kCoreDockOrientationTop) ;    lua_setfield(L, -2, "top") ;
-            lua_pushinteger(L, kCoreDockOrientationBottom) ; lua_setfield(L, -2, "bottom") ;
-            lua_pushinteger(L, kCoreDockOrientationLeft) ;   lua_setfield(L, -2, "left") ;
-            lua_pushinteger(L, kCoreDockOrientationRight) ;  lua_setfield(L, -2, "right") ;
-        lua_setfield(L, -2, "orientation") ;
-        lua_newtable(L) ;
-            lua_pushinteger(L, kCoreDockPinningStart) ;  lua_setfield(L, -2, "start") ;
-            lua_pushinteger(L, kCoreDockPinningMiddle) ; lua_setfield(L, -2, "middle") ;
-            lua_pushinteger(L, kCoreDockPinningEnd) ;    lua_setfield(L, -2, "end") ;
-        lua_setfield(L, -2, "pinning") ;
-        lua_newtable(L) ;
-            lua_pushinteger(L, kCoreDockEffectGenie) ;   lua_setfield(L, -2, "genie") ;
-            lua_pushinteger(L, kCoreDockEffectScale) ;   lua_setfield(L, -2, "scale") ;
-            lua_pushinteger(L, kCoreDockEffectSuck) ;    lua_setfield(L, -2, "suck") ;
-        lua_setfield(L, -2, "effect") ;
+        hsasm_constants_push(L, &coredockOrientations, CONSTANTS_TAG) ; lua_setfield(L, -2, "orientation") ;
+        hsasm_constants_push(L, &coredockPinnings, CONSTANTS_TAG) ;     lua_setfield(L, -2, "pinning") ;
+        hsasm_constants_push(L, &coredockEffects, CONSTANTS_TAG) ;      lua_setfield(L, -2, "effect") ;
+    hsasm_constants_freeze(L) ;
+    return 1 ;
 }
 
 static const luaL_Reg moduleLib[] = {
@@ -238,13 +801,43 @@ static const luaL_Reg moduleLib[] = {
     {"autoHide",            coredock_autohide},
     {"magnification",       coredock_magnification},
     {"magnificationSize",   coredock_magnification_size},
+    {"apply",               coredock_apply},
+    {"snapshot",            coredock_snapshot_table},
+    {"invalidate",          coredock_invalidate},
+    {"animate",             coredock_animate},
+    {"cancelAnimation",     coredock_cancelAnimationFunction},
+    {"animationRate",       coredock_animationRate},
+    {"animationStats",      coredock_animationStats},
+    {"stats",               coredock_stats},
+    {"resetStats",          coredock_resetStats},
+    {"executorStats",       coredock_executorStats},
+    {"_options",            coredock_options},
+    {"_mockBackend",        coredock_selectBackend},
     {NULL,                  NULL}
 } ;
 
+static int meta_gc(lua_State* __unused L) {
+    hsasm_lane_abandon(&dockLane) ;
+    [animationTimer invalidate] ;
+    animationTimer = nil ;
+
+    animationGeneration++ ;
+
+    LuaSkin *skin = [LuaSkin sharedWithState:NULL] ;
+    coredock_animation tileSize          = coredock_animator_cancel(&animator, kCoreDockFieldTileSize) ;
+    coredock_animation magnificationSize = coredock_animator_cancel(&animator, kCoreDockFieldMagnificationSize) ;
+    if (tileSize.active)          [skin luaUnref:refTable ref:tileSize.callbackRef] ;
+    if (magnificationSize.active) [skin luaUnref:refTable ref:magnificationSize.callbackRef] ;
+    return 0 ;
+}
+
+static const luaL_Reg module_metaLib[] = {
+    {"__gc", meta_gc},
+    {NULL,   NULL}
+} ;
+
 int luaopen_hs__asm_undocumented_coredock_internal(lua_State* L) {
     LuaSkin *skin = [LuaSkin sharedWithState:L] ;
-    refTable = [skin registerLibrary:USERDATA_TAG functions:moduleLib metaFunctions:nil] ;
-
-    coredock_options(L) ; lua_setfield(L, -2, "options") ;
+    refTable = [skin registerLibrary:USERDATA_TAG functions:moduleLib metaFunctions:module_metaLib] ;
     return 1 ;
 }
@@ -0,0 +1,816 @@
+@import Cocoa ;
+@import LuaSkin ;
+#import <os/lock.h>
+#import "CGSCursor.h"
+#import "cursor_backend.h"
+#import "cursor_cache.h"
+#import "cursor_pixels.h"
+#import "hsasm_spi.h"
+
+extern CGSConnectionID _CGSDefaultConnection(void) ;
+#define CGSDefaultConnection _CGSDefaultConnection()
+
+static const char * const USERDATA_TAG = "hs._asm.undocumented.cursor.capture" ;
+static LSRefTable refTable = LUA_NOREF;
+
+#define get_objectFromUserdata(objType, L, idx, tag) (objType*)*((void**)luaL_checkudata(L, idx, tag))
+
+#pragma mark - Support Functions and Classes
+
+// the image functions this module calls, or the mock in cursor_backend.h
+static const cursor_captureBackend cursor_nativeCaptureBackend = {
+    "native",
+    CGSCurrentCursorSeed,
+    CGSCursorNameForSystemCursor,
+    CGSGetGlobalCursorDataSize,
+    CGSGetGlobalCursorData,
+    CGSGetSystemDefinedCursorDataSize,
+    CGSGetSystemDefinedCursorData,
+    CGSCopyRegisteredCursorImages
+} ;
+
+// captures are made on the main thread, so this is only changed there
+static const cursor_captureBackend *cgs = &cursor_nativeCaptureBackend ;
+
+static void cursor_poolLock(void *context) {
+    os_unfair_lock_lock((os_unfair_lock *)context) ;
+}
+
+static void cursor_poolUnlock(void *context) {
+    os_unfair_lock_unlock((os_unfair_lock *)context) ;
+}
+
+// see cursor_pixels.h; the pool outlives reloads of the module, since images may still be released after it
+static os_unfair_lock poolLock   = OS_UNFAIR_LOCK_INIT ;
+static cursor_pool    bufferPool = {
+    .maxBuffers  = CURSOR_POOL_MAX_BUFFERS,
+    .lock        = cursor_poolLock,
+    .unlock      = cursor_poolUnlock,
+    .lockContext = &poolLock,
+} ;
+
+@interface HSASMCursorImage : NSObject
+@property            int           selfRefCount ;
+@property (readonly) cursor_buffer *buffer ;
+@property (readonly) size_t        length ;
+@property (readonly) size_t        rowBytes ;
+@property (readonly) size_t        pixelsWide ;
+@property (readonly) size_t        pixelsHigh ;
+@property (readonly) CGRect        rect ;
+@property (readonly) CGPoint       hotSpot ;
+@property (readonly) NSString      *source ;
+@property (readonly) NSTimeInterval conversionTime ;
+@end
+
+@implementation HSASMCursorImage
+
+- (instancetype)initWithBuffer:(cursor_buffer *)buffer
+                        length:(size_t)length
+                      rowBytes:(size_t)rowBytes
+                          rect:(CGRect)rect
+                       hotSpot:(CGPoint)hotSpot
+                        source:(NSString *)source {
+    self = [super init] ;
+    if (self) {
+        _selfRefCount = 0 ;
+        _buffer       = buffer ;
+        _length       = length ;
+        _rowBytes     = rowBytes ;
+        _rect         = rect ;
+        _hotSpot      = hotSpot ;
+        _source       = source ;
+        _pixelsHigh   = (rowBytes > 0) ? length / rowBytes : 0 ;
+        // the rect is in points; on a retina display there are more pixels than points
+        size_t wide = (rect.size.height > 0) ? (size_t)lround(rect.size.width * (CGFloat)_pixelsHigh / rect.size.height) : 0 ;
+        _pixelsWide   = MIN(wide, rowBytes / 4) ;
+
+        NSTimeInterval startTime = [NSProcessInfo processInfo].systemUptime ;
+        cursor_unpremultiplyImage(_buffer->bytes, _rowBytes, _pixelsWide, _pixelsHigh) ;
+        _conversionTime = [NSProcessInfo processInfo].systemUptime - startTime ;
+    }
+    return self ;
+}
+
+- (void)dealloc {
+    cursor_pool_release(&bufferPool, _buffer) ;
+}
+
+- (const uint8_t *)pixelAtX:(size_t)x y:(size_t)y {
+    return _buffer->bytes + y * _rowBytes + x * 4 ;
+}
+
+@end
+
+static void cursor_releaseImageData(void *info, __unused const void *data, __unused size_t size) {
+    CFBridgingRelease(info) ;
+}
+
+static BOOL cursor_validFormat(int depth, int components, int bitsPerComponent) {
+    return (depth == 32 && components == 4 && bitsPerComponent == 8) ;
+}
+
+static void cursor_releaseCachedImage(void *value, __unused void *context) {
+    CFBridgingRelease(value) ;
+}
+
+// see cursor_cache.h; like the pool, the budget and counters outlive reloads of the module
+static cursor_cache imageCache = {
+    .budget  = CURSOR_CACHE_BUDGET,
+    .release = cursor_releaseCachedImage,
+} ;
+
+static HSASMCursorImage *cursor_captureCurrent(NSString **error) {
+    CGSConnectionID cid  = CGSDefaultConnection ;
+    size_t          size = 0 ;
+    CGError         err  = HSASM_SPI_ERROR("CGSGetGlobalCursorDataSize", cgs->getGlobalCursorDataSize(cid, &size)) ;
+    if (err != kCGErrorSuccess || size == 0 || size > INT_MAX) {
+        *error = [NSString stringWithFormat:@"unable to get cursor data size: error %d", err] ;
+        return nil ;
+    }
+
+    cursor_buffer *buffer = cursor_pool_acquire(&bufferPool, size) ;
+    if (!buffer) {
+        *error = [NSString stringWithFormat:@"unable to allocate %zu bytes for the cursor image", size] ;
+        return nil ;
+    }
+
+    int     dataSize = (int)size, rowBytes = 0, depth = 0, components = 0, bitsPerComponent = 0 ;
+    CGRect  rect ;
+    CGPoint hotSpot ;
+    err = HSASM_SPI_ERROR("CGSGetGlobalCursorData",
+                          cgs->getGlobalCursorData(cid, buffer->bytes, &dataSize, &rowBytes, &rect, &hotSpot, &depth, &components, &bitsPerComponent)) ;
+    if (err != kCGErrorSuccess || !cursor_validFormat(depth, components, bitsPerComponent) || dataSize <= 0 || (size_t)dataSize > size) {
+        cursor_pool_release(&bufferPool, buffer) ;
+        *error = [NSString stringWithFormat:@"unable to get cursor data: error %d (depth %d, components %d, bits per component %d)", err, depth, components, bitsPerComponent] ;
+        return nil ;
+    }
+
+    return [[HSASMCursorImage alloc] initWithBuffer:buffer
+                                             length:(size_t)dataSize
+                                           rowBytes:(size_t)rowBytes
+                                               rect:rect
+                                            hotSpot:hotSpot
+                                             source:@"current"] ;
+}
+
+static HSASMCursorImage *cursor_captureSystem(CGSCursorID cursor, NSString *name, NSString **error) {
+    CGSConnectionID cid  = CGSDefaultConnection ;
+    size_t          size = 0 ;
+    CGError         err  = HSASM_SPI_ERROR("CGSGetSystemDefinedCursorDataSize", cgs->getSystemDefinedCursorDataSize(cid, cursor, &size)) ;
+    if (err != kCGErrorSuccess || size == 0) {
+        *error = [NSString stringWithFormat:@"unable to get cursor data size: error %d", err] ;
+        return nil ;
+    }
+
+    cursor_buffer *buffer = cursor_pool_acquire(&bufferPool, size) ;
+    if (!buffer) {
+        *error = [NSString stringWithFormat:@"unable to allocate %zu bytes for the cursor image", size] ;
+        return nil ;
+    }
+
+    int     rowBytes = 0, depth = 0, components = 0, bitsPerComponent = 0 ;
+    CGRect  rect ;
+    CGPoint hotSpot ;
+    err = HSASM_SPI_ERROR("CGSGetSystemDefinedCursorData",
+                          cgs->getSystemDefinedCursorData(cid, cursor, buffer->bytes, &rowBytes, &rect, &hotSpot, &depth, &components, &bitsPerComponent)) ;
+    if (err != kCGErrorSuccess || !cursor_validFormat(depth, components, bitsPerComponent) || rowBytes <= 0) {
+        cursor_pool_release(&bufferPool, buffer) ;
+        *error = [NSString stringWithFormat:@"unable to get cursor data: error %d (depth %d, components %d, bits per component %d)", err, depth, components, bitsPerComponent] ;
+        return nil ;
+    }
+
+    return [[HSASMCursorImage alloc] initWithBuffer:buffer
+                                             length:size
+                                           rowBytes:(size_t)rowBytes
+                                               rect:rect
+                                            hotSpot:hotSpot
+                                             source:name] ;
+}
+
+// registered cursors are returned as CGImages, so the first frame is drawn into a pooled buffer in the
+// same premultiplied ARGB layout the other captures receive from the WindowServer
+static HSASMCursorImage *cursor_captureRegistered(NSString *name, NSString **error) {
+    CGSize     imageSize ;
+    CGPoint    hotSpot ;
+    NSUInteger frameCount    = 0 ;
+    CGFloat    frameDuration = 0 ;
+    CFArrayRef images        = NULL ;
+    CGError    err           = HSASM_SPI_ERROR("CGSCopyRegisteredCursorImages",
+                                               cgs->copyRegisteredCursorImages(CGSDefaultConnection, name.UTF8String, &imageSize, &hotSpot,
+                                                                               &frameCount, &frameDuration, &images)) ;
+    if (err != kCGErrorSuccess || !images || CFArrayGetCount(images) == 0) {
+        if (images) CFRelease(images) ;
+        *error = [NSString stringWithFormat:@"unable to get images for registered cursor %@: error %d", name, err] ;
+        return nil ;
+    }
+
+    CGImageRef frame    = (CGImageRef)CFArrayGetValueAtIndex(images, 0) ;
+    size_t     wide     = CGImageGetWidth(frame) ;
+    size_t     high     = CGImageGetHeight(frame) ;
+    size_t     rowBytes = wide * 4 ;
+    cursor_buffer *buffer = cursor_pool_acquire(&bufferPool, rowBytes * high) ;
+    if (!buffer) {
+        CFRelease(images) ;
+        *error = [NSString stringWithFormat:@"unable to allocate %zu bytes for the cursor image", rowBytes * high] ;
+        return nil ;
+    }
+
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB) ;
+    CGContextRef    context    = CGBitmapContextCreate(buffer->bytes, wide, high, 8, rowBytes, colorSpace,
+                                                       kCGBitmapByteOrder32Big | (CGBitmapInfo)kCGImageAlphaPremultipliedFirst) ;
+    CGColorSpaceRelease(colorSpace) ;
+    if (!context) {
+        CFRelease(images) ;
+        cursor_pool_release(&bufferPool, buffer) ;
+        *error = @"unable to create a bitmap context for the cursor image" ;
+        return nil ;
+    }
+    CGContextClearRect(context, CGRectMake(0, 0, (CGFloat)wide, (CGFloat)high)) ;
+    CGContextDrawImage(context, CGRectMake(0, 0, (CGFloat)wide, (CGFloat)high), frame) ;
+    CGContextRelease(context) ;
+    CFRelease(images) ;
+
+    return [[HSASMCursorImage alloc] initWithBuffer:buffer
+                                             length:rowBytes * high
+                                           rowBytes:rowBytes
+                                               rect:CGRectMake(0, 0, imageSize.width, imageSize.height)
+                                            hotSpot:hotSpot
+                                             source:name] ;
+}
+
+// captures through the cache; leaves the image or nil and an error message on the stack
+static int cursor_pushCapture(lua_State *L, NSString *name, BOOL useCache, HSASMCursorImage *(^capture)(NSString **error)) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    BOOL    cache = (useCache && imageCache.budget > 0) ;
+    int     seed  = cache ? HSASM_SPI("CGSCurrentCursorSeed", cgs->currentCursorSeed()) : 0 ;
+    if (cache) {
+        void *cached = cursor_cache_lookup(&imageCache, seed, name.UTF8String) ;
+        if (cached) {
+            [skin pushNSObject:(__bridge HSASMCursorImage *)cached] ;
+            return 1 ;
+        }
+    }
+
+    NSString         *error = nil ;
+    HSASMCursorImage *image = capture(&error) ;
+    if (!image) {
+        lua_pushnil(L) ;
+        [skin pushNSObject:error] ;
+        return 2 ;
+    }
+    if (cache) {
+        void *value = (__bridge_retained void *)image ;
+        if (!cursor_cache_store(&imageCache, seed, name.UTF8String, value, image.buffer->capacity)) CFBridgingRelease(value) ;
+    }
+    [skin pushNSObject:image] ;
+    return 1 ;
+}
+
+#pragma mark - Module Functions
+
+/// hs._asm.undocumented.cursor.capture.current([useCache]) -> cursorImageObject | nil, errorMessage
+/// Constructor
+/// Captures the image of the cursor currently being displayed.
+///
+/// Parameters:
+///  * useCache - an optional boolean, default true, specifying whether a cached image may be returned if the cursor has not changed since it was captured.
+///
+/// Returns:
+///  * a cursorImageObject, or nil and an error message if the cursor could not be captured
+///
+/// Notes:
+///  * the pixel data is written by the WindowServer directly into a buffer taken from a pool of reusable buffers and converted in place from premultiplied ARGB to straight RGBA; the buffer is returned to the pool when the cursorImageObject is collected. See [hs._asm.undocumented.cursor.capture.poolStats](#poolStats).
+///  * captures are cached by the current cursor seed, so repeated calls while the cursor is unchanged return the same image without asking the WindowServer for it again. See [hs._asm.undocumented.cursor.capture.cacheStats](#cacheStats).
+static int capture_current(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TBOOLEAN | LS_TOPTIONAL, LS_TBREAK] ;
+    BOOL useCache = (lua_gettop(L) > 0) ? (BOOL)lua_toboolean(L, 1) : YES ;
+
+    return cursor_pushCapture(L, @"current", useCache, ^HSASMCursorImage *(NSString **error) {
+        return cursor_captureCurrent(error) ;
+    }) ;
+}
+
+/// hs._asm.undocumented.cursor.capture.system(cursor, [useCache]) -> cursorImageObject | nil, errorMessage
+/// Constructor
+/// Captures the image of one of the system defined cursors.
+///
+/// Parameters:
+///  * cursor   - an integer specifying the system cursor, as defined in `hs._asm.undocumented.cursor.systemCursors`
+///  * useCache - an optional boolean, default true, specifying whether a cached image may be returned if the cursor has not changed since it was captured.
+///
+/// Returns:
+///  * a cursorImageObject, or nil and an error message if the cursor could not be captured
+static int capture_system(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TNUMBER | LS_TINTEGER, LS_TBOOLEAN | LS_TOPTIONAL, LS_TBREAK] ;
+    CGSCursorID cursor   = (CGSCursorID)lua_tointeger(L, 1) ;
+    BOOL        useCache = (lua_gettop(L) > 1) ? (BOOL)lua_toboolean(L, 2) : YES ;
+
+    const char *cName = HSASM_SPI("CGSCursorNameForSystemCursor", cgs->cursorNameForSystemCursor(cursor)) ;
+    NSString   *name  = cName ? @(cName) : [NSString stringWithFormat:@"system %ld", (long)cursor] ;
+    return cursor_pushCapture(L, name, useCache, ^HSASMCursorImage *(NSString **error) {
+        return cursor_captureSystem(cursor, name, error) ;
+    }) ;
+}
+
+/// hs._asm.undocumented.cursor.capture.registered(name, [useCache]) -> cursorImageObject | nil, errorMessage
+/// Constructor
+/// Captures the image of a cursor registered with the WindowServer by name.
+///
+/// Parameters:
+///  * name     - the name the cursor is registered under, e.g. a name returned by `hs._asm.undocumented.cursor.systemCursorName`
+///  * useCache - an optional boolean, default true, specifying whether a cached image may be returned if the cursor has not changed since it was captured.
+///
+/// Returns:
+///  * a cursorImageObject, or nil and an error message if the cursor could not be captured
+///
+/// Notes:
+///  * for animated cursors, only the first frame is captured.
+static int capture_registered(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TSTRING, LS_TBOOLEAN | LS_TOPTIONAL, LS_TBREAK] ;
+    NSString *name     = [skin toNSObjectAtIndex:1] ;
+    BOOL     useCache  = (lua_gettop(L) > 1) ? (BOOL)lua_toboolean(L, 2) : YES ;
+
+    return cursor_pushCapture(L, name, useCache, ^HSASMCursorImage *(NSString **error) {
+        return cursor_captureRegistered(name, error) ;
+    }) ;
+}
+
+/// hs._asm.undocumented.cursor.capture.cacheBudget([bytes]) -> integer
+/// Function
+/// Get or set the maximum number of bytes of image buffers kept in the capture cache.
+///
+/// Parameters:
+///  * bytes - an optional integer specifying the new budget; the default is 4194304 (4MB). Setting this to 0 disables the cache.
+///
+/// Returns:
+///  * the current budget
+///
+/// Notes:
+///  * lowering the budget immediately evicts the least recently used images until the cache fits.
+static int capture_cacheBudget(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TNUMBER | LS_TINTEGER | LS_TOPTIONAL, LS_TBREAK] ;
+    if (lua_gettop(L) > 0) {
+        lua_Integer budget = lua_tointeger(L, 1) ;
+        if (budget < 0) return luaL_argerror(L, 1, "budget cannot be negative") ;
+        cursor_cache_setBudget(&imageCache, (size_t)budget) ;
+    }
+    lua_pushinteger(L, (lua_Integer)imageCache.budget) ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cursor.capture.cacheStats([reset]) -> table
+/// Function
+/// Returns information about the capture cache.
+///
+/// Parameters:
+///  * reset - an optional boolean, default false, specifying whether the hit, miss, and eviction counters should be reset to 0 after they are returned.
+///
+/// Returns:
+///  * a table containing the following keys:
+///    * entries   - the number of images in the cache
+///    * bytes     - the number of bytes of image buffers held by the cache
+///    * budget    - the maximum number of bytes the cache may hold
+///    * hits      - the number of captures returned from the cache
+///    * misses    - the number of captures which had to ask the WindowServer for the image
+///    * evictions - the number of images removed from the cache to stay within the budget
+static int capture_cacheStats(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TBOOLEAN | LS_TOPTIONAL, LS_TBREAK] ;
+    lua_newtable(L) ;
+    lua_pushinteger(L, (lua_Integer)imageCache.count) ;     lua_setfield(L, -2, "entries") ;
+    lua_pushinteger(L, (lua_Integer)imageCache.bytes) ;     lua_setfield(L, -2, "bytes") ;
+    lua_pushinteger(L, (lua_Integer)imageCache.budget) ;    lua_setfield(L, -2, "budget") ;
+    lua_pushinteger(L, (lua_Integer)imageCache.hits) ;      lua_setfield(L, -2, "hits") ;
+    lua_pushinteger(L, (lua_Integer)imageCache.misses) ;    lua_setfield(L, -2, "misses") ;
+    lua_pushinteger(L, (lua_Integer)imageCache.evictions) ; lua_setfield(L, -2, "evictions") ;
+    if (lua_toboolean(L, 1)) {
+        imageCache.hits      = 0 ;
+        imageCache.misses    = 0 ;
+        imageCache.evictions = 0 ;
+    }
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cursor.capture.flushCache() -> None
+/// Function
+/// Removes all images from the capture cache.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * None
+///
+/// Notes:
+///  * images which are still referenced from Lua remain valid; their buffers are returned to the pool when they are collected.
+static int capture_flushCache(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TBREAK] ;
+    cursor_cache_flush(&imageCache) ;
+    return 0 ;
+}
+
+/// hs._asm.undocumented.cursor.capture.unpremultiply(data) -> string
+/// Function
+/// Converts premultiplied ARGB pixel data into straight (non-premultiplied) RGBA.
+///
+/// Parameters:
+///  * data - a string of 32 bit premultiplied ARGB pixels; its length must be a multiple of 4
+///
+/// Returns:
+///  * a string of the same length containing the RGBA pixels
+///
+/// Notes:
+///  * this is the conversion applied to captured cursor images; it is provided so the conversion can be checked against known data.
+static int capture_unpremultiply(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TSTRING, LS_TBREAK] ;
+    size_t      length ;
+    const char *data = lua_tolstring(L, 1, &length) ;
+    if (length % 4 != 0) return luaL_argerror(L, 1, "length must be a multiple of 4") ;
+
+    luaL_Buffer b ;
+    uint8_t     *dst = (uint8_t *)luaL_buffinitsize(L, &b, length) ;
+    cursor_unpremultiply((const uint8_t *)data, dst, length / 4) ;
+    luaL_pushresultsize(&b, length) ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cursor.capture.poolStats() -> table
+/// Function
+/// Returns information about the pool of buffers used for captured cursor images.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * a table containing the following keys:
+///    * pooled    - the number of buffers currently waiting to be reused
+///    * maximum   - the maximum number of buffers kept for reuse
+///    * allocated - the number of captures which required a new buffer
+///    * reused    - the number of captures which used a buffer from the pool
+///    * discarded - the number of buffers freed because the pool was full
+static int capture_poolStats(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TBREAK] ;
+    cursor_pool_lock(&bufferPool) ;
+    cursor_pool pool = bufferPool ;
+    cursor_pool_unlock(&bufferPool) ;
+    lua_newtable(L) ;
+    lua_pushinteger(L, (lua_Integer)pool.pooled) ;     lua_setfield(L, -2, "pooled") ;
+    lua_pushinteger(L, (lua_Integer)pool.maxBuffers) ; lua_setfield(L, -2, "maximum") ;
+    lua_pushinteger(L, (lua_Integer)pool.allocated) ;  lua_setfield(L, -2, "allocated") ;
+    lua_pushinteger(L, (lua_Integer)pool.reused) ;     lua_setfield(L, -2, "reused") ;
+    lua_pushinteger(L, (lua_Integer)pool.discarded) ;  lua_setfield(L, -2, "discarded") ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cursor.capture.stats([json]) -> table | string
+/// Function
+/// Returns call counts and timing for the private CGS functions used by this module.
+///
+/// Parameters:
+///  * json - an optional boolean, default false, specifying whether the statistics should be returned as a JSON string instead of a table.
+///
+/// Returns:
+///  * a table keyed by function name (e.g. `CGSGetGlobalCursorData`), each entry containing the following keys:
+///    * calls      - the number of times the function has been called
+///    * errors     - the number of calls which returned an error
+///    * errorCodes - a table of error code -> count
+///    * totalNs, meanNs, minNs, maxNs - the total, mean, shortest and longest time spent in the function in nanoseconds
+///    * p50, p90, p99, p999 - latency percentiles in nanoseconds, accurate to within 25%
+///
+/// Notes:
+///  * functions which have not been called since the statistics were last reset are not included.
+///  * each of the cursor modules is built separately and keeps its own statistics; see also `hs._asm.undocumented.cursor.stats`.
+static int capture_spiStats(lua_State *L) {
+    return hsasm_spi_pushStats(L) ;
+}
+
+/// hs._asm.undocumented.cursor.capture.resetStats() -> None
+/// Function
+/// Clears the statistics returned by [hs._asm.undocumented.cursor.capture.stats](#stats).
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * None
+static int capture_spiResetStats(lua_State *L) {
+    return hsasm_spi_resetStats(L) ;
+}
+
+// _mockBackend([enable], [options]) -> table
+//   switches between the CGS image functions and the synthetic images in cursor_backend.h and returns a table
+//   describing the backend in use and the mock's configuration and call counts. The cache is flushed, since
+//   the seeds of the two backends are unrelated.
+static int capture_selectBackend(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TBOOLEAN | LS_TOPTIONAL, LS_TTABLE | LS_TOPTIONAL, LS_TBREAK] ;
+    if (lua_isboolean(L, 1)) {
+        cgs = lua_toboolean(L, 1) ? &cursor_mockCaptureBackend : &cursor_nativeCaptureBackend ;
+        cursor_cache_flush(&imageCache) ;
+        hsasm_mock_configure(L, 2, &cursorMock) ;
+    }
+    hsasm_mock_pushStats(L, cgs->name, &cursorMock) ;
+    return 1 ;
+}
+
+#pragma mark - Module Methods
+
+/// hs._asm.undocumented.cursor.capture:size() -> table
+/// Method
+/// Returns the size of the cursor image in points.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * a size table with `w` and `h` keys
+static int capture_size(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TBREAK] ;
+    HSASMCursorImage *image = [skin toNSObjectAtIndex:1] ;
+    [skin pushNSSize:image.rect.size] ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cursor.capture:pixelSize() -> table
+/// Method
+/// Returns the size of the cursor image in pixels.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * a size table with `w` and `h` keys
+static int capture_pixelSize(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TBREAK] ;
+    HSASMCursorImage *image = [skin toNSObjectAtIndex:1] ;
+    [skin pushNSSize:NSMakeSize((CGFloat)image.pixelsWide, (CGFloat)image.pixelsHigh)] ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cursor.capture:hotSpot() -> table
+/// Method
+/// Returns the cursor's hot spot -- the point within the image which corresponds to the mouse location.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * a point table with `x` and `y` keys
+static int capture_hotSpot(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TBREAK] ;
+    HSASMCursorImage *image = [skin toNSObjectAtIndex:1] ;
+    [skin pushNSPoint:image.hotSpot] ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cursor.capture:pixel(x, y) -> r, g, b, a
+/// Method
+/// Returns the color components of a single pixel of the cursor image.
+///
+/// Parameters:
+///  * x - the column of the pixel, starting at 0
+///  * y - the row of the pixel, starting at 0
+///
+/// Returns:
+///  * the red, green, blue, and alpha components as integers from 0 to 255
+static int capture_pixel(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TNUMBER | LS_TINTEGER, LS_TNUMBER | LS_TINTEGER, LS_TBREAK] ;
+    HSASMCursorImage *image = [skin toNSObjectAtIndex:1] ;
+    lua_Integer x = lua_tointeger(L, 2), y = lua_tointeger(L, 3) ;
+    if (x < 0 || (size_t)x >= image.pixelsWide) return luaL_argerror(L, 2, "x is outside of the image") ;
+    if (y < 0 || (size_t)y >= image.pixelsHigh) return luaL_argerror(L, 3, "y is outside of the image") ;
+    const uint8_t *pixel = [image pixelAtX:(size_t)x y:(size_t)y] ;
+    for (int i = 0 ; i < 4 ; i++) lua_pushinteger(L, pixel[i]) ;
+    return 4 ;
+}
+
+/// hs._asm.undocumented.cursor.capture:pixels() -> string
+/// Method
+/// Returns the pixel data of the cursor image.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * a string containing the straight (non-premultiplied) RGBA pixels of the image, row by row with no padding
+static int capture_pixels(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TBREAK] ;
+    HSASMCursorImage *image = [skin toNSObjectAtIndex:1] ;
+    size_t rowLength = image.pixelsWide * 4 ;
+    if (image.rowBytes == rowLength) {
+        lua_pushlstring(L, (const char *)image.buffer->bytes, rowLength * image.pixelsHigh) ;
+    } else {
+        luaL_Buffer b ;
+        char        *dst = luaL_buffinitsize(L, &b, rowLength * image.pixelsHigh) ;
+        for (size_t row = 0 ; row < image.pixelsHigh ; row++) {
+            memcpy(dst + row * rowLength, image.buffer->bytes + row * image.rowBytes, rowLength) ;
+        }
+        luaL_pushresultsize(&b, rowLength * image.pixelsHigh) ;
+    }
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cursor.capture:image() -> hs.image object
+/// Method
+/// Returns the cursor image as an `hs.image` object.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * an `hs.image` object, sized in points
+///
+/// Notes:
+///  * the `hs.image` object refers to the same pixel buffer rather than a copy of it; the buffer is not returned to the pool until both the cursorImageObject and the `hs.image` object have been collected.
+static int capture_image(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TBREAK] ;
+    HSASMCursorImage *image = [skin toNSObjectAtIndex:1] ;
+
+    CGDataProviderRef provider = CGDataProviderCreateWithData((__bridge_retained void *)image,
+                                                              image.buffer->bytes,
+                                                              image.rowBytes * image.pixelsHigh,
+                                                              cursor_releaseImageData) ;
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB) ;
+    CGImageRef      cgImage    = CGImageCreate(image.pixelsWide, image.pixelsHigh, 8, 32, image.rowBytes, colorSpace,
+                                               kCGBitmapByteOrderDefault | (CGBitmapInfo)kCGImageAlphaLast,
+                                               provider, NULL, false, kCGRenderingIntentDefault) ;
+    CGColorSpaceRelease(colorSpace) ;
+    CGDataProviderRelease(provider) ;
+    if (!cgImage) {
+        lua_pushnil(L) ;
+        return 1 ;
+    }
+    NSImage *result = [[NSImage alloc] initWithCGImage:cgImage size:image.rect.size] ;
+    CGImageRelease(cgImage) ;
+    [skin pushNSObject:result] ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cursor.capture:info() -> table
+/// Method
+/// Returns information about the captured cursor image.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * a table containing the following keys:
+///    * source         - "current" for the displayed cursor, or the name of the system or registered cursor
+///    * size           - the size of the image in points
+///    * pixelSize      - the size of the image in pixels
+///    * hotSpot        - the cursor's hot spot
+///    * rowBytes       - the number of bytes in each row of the pixel buffer
+///    * bufferSize     - the size of the pooled buffer backing the image
+///    * conversionTime - the number of seconds it took to convert the pixels to straight RGBA
+static int capture_info(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TUSERDATA, USERDATA_TAG, LS_TBREAK] ;
+    HSASMCursorImage *image = [skin toNSObjectAtIndex:1] ;
+    lua_newtable(L) ;
+    [skin pushNSObject:image.source] ;                                    lua_setfield(L, -2, "source") ;
+    [skin pushNSSize:image.rect.size] ;                                   lua_setfield(L, -2, "size") ;
+    [skin pushNSSize:NSMakeSize((CGFloat)image.pixelsWide, (CGFloat)image.pixelsHigh)] ;    lua_setfield(L, -2, "pixelSize") ;
+    [skin pushNSPoint:image.hotSpot] ;                                    lua_setfield(L, -2, "hotSpot") ;
+    lua_pushinteger(L, (lua_Integer)image.rowBytes) ;                     lua_setfield(L, -2, "rowBytes") ;
+    lua_pushinteger(L, (lua_Integer)image.buffer->capacity) ;             lua_setfield(L, -2, "bufferSize") ;
+    lua_pushnumber(L, image.conversionTime) ;                             lua_setfield(L, -2, "conversionTime") ;
+    return 1 ;
+}
+
+#pragma mark - Lua<->NSObject Conversion Functions
+// These must not throw a lua error to ensure LuaSkin can safely be used from Objective-C
+// delegates and blocks.
+
+static int pushHSASMCursorImage(lua_State *L, id obj) {
+    HSASMCursorImage *value = obj;
+    value.selfRefCount++ ;
+    void** valuePtr = lua_newuserdata(L, sizeof(HSASMCursorImage *));
+    *valuePtr = (__bridge_retained void *)value;
+    luaL_getmetatable(L, USERDATA_TAG);
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+static id toHSASMCursorImageFromLua(lua_State *L, int idx) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    HSASMCursorImage *value ;
+    if (luaL_testudata(L, idx, USERDATA_TAG)) {
+        value = get_objectFromUserdata(__bridge HSASMCursorImage, L, idx, USERDATA_TAG) ;
+    } else {
+        [skin logError:[NSString stringWithFormat:@"expected %s object, found %s", USERDATA_TAG,
+                                                   lua_typename(L, lua_type(L, idx))]] ;
+    }
+    return value ;
+}
+
+#pragma mark - Hammerspoon/Lua Infrastructure
+
+static int userdata_tostring(lua_State* L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    HSASMCursorImage *obj = [skin luaObjectAtIndex:1 toClass:"HSASMCursorImage"] ;
+    NSString *title = [NSString stringWithFormat:@"%@, %zux%zu", obj.source, obj.pixelsWide, obj.pixelsHigh] ;
+    [skin pushNSObject:[NSString stringWithFormat:@"%s: %@ (%p)", USERDATA_TAG, title, lua_topointer(L, 1)]] ;
+    return 1 ;
+}
+
+static int userdata_eq(lua_State* L) {
+// can't get here if at least one of us isn't a userdata type, and we only care if both types are ours,
+// so use luaL_testudata before the macro causes a lua error
+    if (luaL_testudata(L, 1, USERDATA_TAG) && luaL_testudata(L, 2, USERDATA_TAG)) {
+        LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+        HSASMCursorImage *obj1 = [skin luaObjectAtIndex:1 toClass:"HSASMCursorImage"] ;
+        HSASMCursorImage *obj2 = [skin luaObjectAtIndex:2 toClass:"HSASMCursorImage"] ;
+        lua_pushboolean(L, [obj1 isEqualTo:obj2]) ;
+    } else {
+        lua_pushboolean(L, NO) ;
+    }
+    return 1 ;
+}
+
+static int userdata_gc(lua_State* L) {
+    HSASMCursorImage *obj = get_objectFromUserdata(__bridge_transfer HSASMCursorImage, L, 1, USERDATA_TAG) ;
+    if (obj) {
+        obj.selfRefCount-- ;
+        if (obj.selfRefCount == 0) {
+            obj = nil ;
+        }
+    }
+
+    // Remove the Metatable so future use of the variable in Lua won't think its valid
+    lua_pushnil(L) ;
+    lua_setmetatable(L, 1) ;
+    return 0 ;
+}
+
+static int meta_gc(lua_State* __unused L) {
+    cursor_cache_free(&imageCache) ;
+    cursor_pool_drain(&bufferPool) ;
+    return 0 ;
+}
+
+// Metatable for userdata objects
+static const luaL_Reg userdata_metaLib[] = {
+    {"size",       capture_size},
+    {"pixelSize",  capture_pixelSize},
+    {"hotSpot",    capture_hotSpot},
+    {"pixel",      capture_pixel},
+    {"pixels",     capture_pixels},
+    {"image",      capture_image},
+    {"info",       capture_info},
+
+    {"__tostring", userdata_tostring},
+    {"__eq",       userdata_eq},
+    {"__gc",       userdata_gc},
+    {NULL,         NULL}
+};
+
+// Functions for returned object when module loads
+static luaL_Reg moduleLib[] = {
+    {"current",       capture_current},
+    {"system",        capture_system},
+    {"registered",    capture_registered},
+    {"cacheBudget",   capture_cacheBudget},
+    {"cacheStats",    capture_cacheStats},
+    {"flushCache",    capture_flushCache},
+    {"unpremultiply", capture_unpremultiply},
+    {"poolStats",     capture_poolStats},
+    {"stats",         capture_spiStats},
+    {"resetStats",    capture_spiResetStats},
+    {"_mockBackend",  capture_selectBackend},
+    {NULL,            NULL}
+};
+
+// Metatable for module, if needed
+static const luaL_Reg module_metaLib[] = {
+    {"__gc", meta_gc},
+    {NULL,   NULL}
+};
+
+int luaopen_hs__asm_undocumented_cursor_capture(lua_State* L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    refTable = [skin registerLibraryWithObject:USERDATA_TAG
+                                     functions:moduleLib
+                                 metaFunctions:module_metaLib
+                               objectFunctions:userdata_metaLib] ;
+
+    cursor_buildUnpremultiplyTable() ;
+
+    [skin registerPushNSHelper:pushHSASMCursorImage         forClass:"HSASMCursorImage"];
+    [skin registerLuaObjectHelper:toHSASMCursorImageFromLua forClass:"HSASMCursorImage"
+                                                 withUserdataMapping:USERDATA_TAG];
+
+    return 1;
+}
@@ -0,0 +1,395 @@
+@import Cocoa ;
+@import LuaSkin ;
+#import "CGSConnection.h"
+#import "cursor_backend.h"
+#import "cursor_connections.h"
+#import "hsasm_spi.h"
+
+static const char * const USERDATA_TAG = "hs._asm.undocumented.cursor.connections" ;
+static LSRefTable refTable = LUA_NOREF;
+
+// The tracker's tables are described in cursor_connections.h. CGSRegisterForNewConnectionNotification and
+// CGSRegisterForConnectionDeathNotification only report the connections belonging to this process, so the
+// connections of other applications are added and removed as NSWorkspace reports them launching and
+// terminating.
+
+// how many connections of one process are looked at or reported at a time
+#define CONN_BATCH 64
+
+static conn_tracker tracker ;
+
+static int      trackerCallbackRef = LUA_NOREF ;
+static BOOL     trackerRunning     = NO ;
+static NSArray  *workspaceObservers ;
+
+#pragma mark - Support Functions
+
+static CGError conn_nativeConnectionForPID(pid_t pid, CGSConnectionID *outCID) {
+    ProcessSerialNumber psn ;
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+    if (GetProcessForPID(pid, &psn) != noErr) return kCGErrorIllegalArgument ;
+#pragma clang diagnostic pop
+    return CGSGetConnectionIDForPSN(CGSMainConnectionID(), &psn, outCID) ;
+}
+
+// the connection functions this module calls, or the mock in cursor_backend.h
+static const cursor_connectionBackend conn_nativeBackend = {
+    "native",
+    CGSMainConnectionID,
+    CGSConnectionGetPID,
+    conn_nativeConnectionForPID,
+    CGSRegisterForNewConnectionNotification,
+    CGSRemoveNewConnectionNotification,
+    CGSRegisterForConnectionDeathNotification,
+    CGSRemoveConnectionDeathNotification
+} ;
+
+// only changed while the tracker is stopped
+static const cursor_connectionBackend *cgs = &conn_nativeBackend ;
+
+static void conn_notify(const char *event, CGSConnectionID cid, pid_t pid) {
+    if (trackerCallbackRef == LUA_NOREF) return ;
+    LuaSkin   *skin = [LuaSkin sharedWithState:NULL] ;
+    lua_State *L    = skin.L ;
+    _lua_stackguard_entry(L) ;
+    [skin pushLuaRef:refTable ref:trackerCallbackRef] ;
+    lua_pushstring(L, event) ;
+    lua_pushinteger(L, cid) ;
+    lua_pushinteger(L, pid) ;
+    [skin protectedCallAndError:@"hs._asm.undocumented.cursor.connections callback" nargs:3 nresults:0] ;
+    _lua_stackguard_exit(L) ;
+}
+
+static CGSConnectionID conn_connectionForPID(pid_t pid) {
+    CGSConnectionID cid = 0 ;
+    if (HSASM_SPI_ERROR("CGSGetConnectionIDForPSN", cgs->connectionForPID(pid, &cid)) != kCGErrorSuccess) return 0 ;
+    return cid ;
+}
+
+static void conn_addApplication(pid_t pid) {
+    CGSConnectionID cid = conn_connectionForPID(pid) ;
+    if (cid != 0 && conn_tracker_created(&tracker, cid, pid)) conn_notify("created", cid, pid) ;
+}
+
+static void conn_removeApplication(pid_t pid) {
+    int32_t removed[CONN_BATCH] ;
+    size_t  count ;
+    while (trackerRunning && (count = conn_tracker_terminated(&tracker, pid, removed, CONN_BATCH)) > 0) {
+        for (size_t i = 0 ; i < count ; i++) conn_notify("died", removed[i], pid) ;
+    }
+}
+
+// these are only told about this process's own connections
+static void conn_newConnectionProc(CGSConnectionID cid) {
+    dispatch_async(dispatch_get_main_queue(), ^{
+        pid_t pid = 0 ;
+        if (trackerRunning && HSASM_SPI_ERROR("CGSConnectionGetPID", cgs->connectionGetPID(cid, &pid)) == kCGErrorSuccess &&
+            conn_tracker_created(&tracker, cid, pid)) {
+            conn_notify("created", cid, pid) ;
+        }
+    }) ;
+}
+
+static void conn_connectionDeathProc(CGSConnectionID cid) {
+    dispatch_async(dispatch_get_main_queue(), ^{
+        pid_t pid = trackerRunning ? conn_tracker_died(&tracker, cid) : 0 ;
+        if (pid != 0) conn_notify("died", cid, pid) ;
+    }) ;
+}
+
+static void conn_stopTracker(void) {
+    if (!trackerRunning) return ;
+    trackerRunning = NO ;
+    (void)HSASM_SPI_ERROR("CGSRemoveNewConnectionNotification", cgs->removeNewConnectionNotification(conn_newConnectionProc)) ;
+    (void)HSASM_SPI_ERROR("CGSRemoveConnectionDeathNotification", cgs->removeConnectionDeathNotification(conn_connectionDeathProc)) ;
+    NSNotificationCenter *center = [NSWorkspace sharedWorkspace].notificationCenter ;
+    for (id observer in workspaceObservers) [center removeObserver:observer] ;
+    workspaceObservers = nil ;
+    conn_tracker_free(&tracker) ;
+}
+
+#pragma mark - Module Functions
+
+/// hs._asm.undocumented.cursor.connections.start([fn]) -> None
+/// Function
+/// Starts tracking the WindowServer connections of running applications.
+///
+/// Parameters:
+///  * fn - an optional function which will be invoked with three arguments when a connection is added or removed: the event ("created" or "died"), the connection id, and the pid which owns it.
+///
+/// Returns:
+///  * None
+///
+/// Notes:
+///  * the connections of the applications already running are added when the tracker starts, without invoking `fn`.
+///  * the WindowServer only reports the creation and destruction of this process's own connections, so the connections of other applications are tracked as they launch and terminate.
+static int connections_start(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TFUNCTION | LS_TNIL | LS_TOPTIONAL, LS_TBREAK] ;
+
+    conn_stopTracker() ;
+    trackerCallbackRef = [skin luaUnref:refTable ref:trackerCallbackRef] ;
+    if (!conn_tracker_init(&tracker)) return luaL_error(L, "unable to allocate connection tables") ;
+    trackerRunning = YES ;
+
+    for (NSRunningApplication *app in [NSWorkspace sharedWorkspace].runningApplications) {
+        conn_addApplication(app.processIdentifier) ;
+    }
+    pid_t ourPID = getpid() ;
+    conn_tracker_created(&tracker, HSASM_SPI("CGSMainConnectionID", cgs->mainConnectionID()), ourPID) ;
+    (void)HSASM_SPI_ERROR("CGSRegisterForNewConnectionNotification", cgs->registerForNewConnectionNotification(conn_newConnectionProc)) ;
+    (void)HSASM_SPI_ERROR("CGSRegisterForConnectionDeathNotification", cgs->registerForConnectionDeathNotification(conn_connectionDeathProc)) ;
+
+    NSNotificationCenter *center = [NSWorkspace sharedWorkspace].notificationCenter ;
+    workspaceObservers = @[
+        [center addObserverForName:NSWorkspaceDidLaunchApplicationNotification object:nil queue:[NSOperationQueue mainQueue]
+                        usingBlock:^(NSNotification *note) {
+            NSRunningApplication *app = note.userInfo[NSWorkspaceApplicationKey] ;
+            if (trackerRunning && app) conn_addApplication(app.processIdentifier) ;
+        }],
+        [center addObserverForName:NSWorkspaceDidTerminateApplicationNotification object:nil queue:[NSOperationQueue mainQueue]
+                        usingBlock:^(NSNotification *note) {
+            NSRunningApplication *app = note.userInfo[NSWorkspaceApplicationKey] ;
+            if (trackerRunning && app) conn_removeApplication(app.processIdentifier) ;
+        }],
+    ] ;
+
+    if (lua_type(L, 1) == LUA_TFUNCTION) {
+        lua_pushvalue(L, 1) ;
+        trackerCallbackRef = [skin luaRef:refTable] ;
+    }
+    return 0 ;
+}
+
+/// hs._asm.undocumented.cursor.connections.stop() -> None
+/// Function
+/// Stops tracking connections and discards the connection tables.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * None
+static int connections_stop(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TBREAK] ;
+    conn_stopTracker() ;
+    trackerCallbackRef = [skin luaUnref:refTable ref:trackerCallbackRef] ;
+    return 0 ;
+}
+
+/// hs._asm.undocumented.cursor.connections.pidForConnection(cid) -> integer | nil
+/// Function
+/// Returns the pid of the process which owns the specified WindowServer connection.
+///
+/// Parameters:
+///  * cid - the connection id
+///
+/// Returns:
+///  * the pid, or nil if the connection is not known to the WindowServer
+///
+/// Notes:
+///  * connections in the tracker's table are returned without querying the WindowServer; any other connection is looked up with `CGSConnectionGetPID` and, if the tracker is running, added to the table.
+static int connections_pidForConnection(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TNUMBER | LS_TINTEGER, LS_TBREAK] ;
+    CGSConnectionID cid = (CGSConnectionID)lua_tointeger(L, 1) ;
+
+    pid_t pid = conn_tracker_pidForConnection(&tracker, cid) ;
+    if (pid != 0) {
+        lua_pushinteger(L, pid) ;
+        return 1 ;
+    }
+    if (HSASM_SPI_ERROR("CGSConnectionGetPID", cgs->connectionGetPID(cid, &pid)) != kCGErrorSuccess || pid == 0) {
+        lua_pushnil(L) ;
+        return 1 ;
+    }
+    if (trackerRunning) conn_tracker_created(&tracker, cid, pid) ;
+    lua_pushinteger(L, pid) ;
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cursor.connections.connectionsForPID(pid) -> table
+/// Function
+/// Returns the WindowServer connections owned by the specified process.
+///
+/// Parameters:
+///  * pid - the process id
+///
+/// Returns:
+///  * an array of connection ids, which will be empty if the process has no known connections
+static int connections_connectionsForPID(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TNUMBER | LS_TINTEGER, LS_TBREAK] ;
+    pid_t pid = (pid_t)lua_tointeger(L, 1) ;
+
+    int32_t batch[CONN_BATCH] ;
+    int32_t *cids = batch ;
+    size_t  count = conn_tracker_connectionsForPID(&tracker, pid, batch, CONN_BATCH) ;
+    if (count > CONN_BATCH) {
+        cids = malloc(count * sizeof(int32_t)) ;
+        if (!cids) return luaL_error(L, "unable to allocate %d connection ids", (int)count) ;
+        conn_map_values(&tracker.pidToConnection, pid, cids, count) ;
+    }
+    lua_createtable(L, (int)count, 0) ;
+    for (size_t i = 0 ; i < count ; i++) {
+        lua_pushinteger(L, cids[i]) ;
+        lua_rawseti(L, -2, (lua_Integer)i + 1) ;
+    }
+    if (cids != batch) free(cids) ;
+
+    if (count == 0) {
+        CGSConnectionID cid = conn_connectionForPID(pid) ;
+        if (cid != 0) {
+            if (trackerRunning) conn_tracker_created(&tracker, cid, pid) ;
+            lua_pushinteger(L, cid) ;
+            lua_rawseti(L, -2, 1) ;
+        }
+    }
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cursor.connections.connections() -> table
+/// Function
+/// Returns all of the connections currently being tracked.
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * a table with connection ids as keys and the pids which own them as values
+static int connections_connections(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TBREAK] ;
+    const conn_map *map = &tracker.connectionToPID ;
+    lua_createtable(L, 0, (int)map->count) ;
+    for (size_t i = 0 ; i < map->capacity ; i++) {
+        if (map->slots[i].key == 0) continue ;
+        lua_pushinteger(L, map->slots[i].value) ;
+        lua_rawseti(L, -2, map->slots[i].key) ;
+    }
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cursor.connections.stats([reset]) -> table
+/// Function
+/// Returns information about the connection tracker.
+///
+/// Parameters:
+///  * reset - an optional boolean, default false, specifying whether the counters should be reset to 0 after they are returned.
+///
+/// Returns:
+///  * a table containing the following keys:
+///    * running     - whether the tracker is running
+///    * connections - the number of connections being tracked
+///    * capacity    - the number of slots in the connection table
+///    * hits        - the number of lookups answered from the tables
+///    * misses      - the number of lookups which had to query the WindowServer
+///    * created     - the number of connections added to the tables
+///    * died        - the number of connections removed from the tables
+static int connections_stats(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TBOOLEAN | LS_TOPTIONAL, LS_TBREAK] ;
+    lua_newtable(L) ;
+    lua_pushboolean(L, trackerRunning) ;                                lua_setfield(L, -2, "running") ;
+    lua_pushinteger(L, (lua_Integer)tracker.connectionToPID.count) ;    lua_setfield(L, -2, "connections") ;
+    lua_pushinteger(L, (lua_Integer)tracker.connectionToPID.capacity) ; lua_setfield(L, -2, "capacity") ;
+    lua_pushinteger(L, (lua_Integer)tracker.hits) ;                     lua_setfield(L, -2, "hits") ;
+    lua_pushinteger(L, (lua_Integer)tracker.misses) ;                   lua_setfield(L, -2, "misses") ;
+    lua_pushinteger(L, (lua_Integer)tracker.created) ;                  lua_setfield(L, -2, "created") ;
+    lua_pushinteger(L, (lua_Integer)tracker.died) ;                     lua_setfield(L, -2, "died") ;
+    if (lua_toboolean(L, 1)) {
+        tracker.hits    = 0 ;
+        tracker.misses  = 0 ;
+        tracker.created = 0 ;
+        tracker.died    = 0 ;
+    }
+    return 1 ;
+}
+
+/// hs._asm.undocumented.cursor.connections.spiStats([json]) -> table | string
+/// Function
+/// Returns call counts and timing for the private CGS functions used by this module.
+///
+/// Parameters:
+///  * json - an optional boolean, default false, specifying whether the statistics should be returned as a JSON string instead of a table.
+///
+/// Returns:
+///  * a table keyed by function name (e.g. `CGSConnectionGetPID`), each entry containing the following keys:
+///    * calls      - the number of times the function has been called
+///    * errors     - the number of calls which returned an error
+///    * errorCodes - a table of error code -> count
+///    * totalNs, meanNs, minNs, maxNs - the total, mean, shortest and longest time spent in the function in nanoseconds
+///    * p50, p90, p99, p999 - latency percentiles in nanoseconds, accurate to within 25%
+///
+/// Notes:
+///  * functions which have not been called since the statistics were last reset are not included.
+///  * each of the cursor modules is built separately and keeps its own statistics; see also `hs._asm.undocumented.cursor.stats`. The tracker's own counters are returned by [hs._asm.undocumented.cursor.connections.stats](#stats).
+static int connections_spiStats(lua_State *L) {
+    return hsasm_spi_pushStats(L) ;
+}
+
+/// hs._asm.undocumented.cursor.connections.resetSpiStats() -> None
+/// Function
+/// Clears the statistics returned by [hs._asm.undocumented.cursor.connections.spiStats](#spiStats).
+///
+/// Parameters:
+///  * None
+///
+/// Returns:
+///  * None
+static int connections_spiResetStats(lua_State *L) {
+    return hsasm_spi_resetStats(L) ;
+}
+
+// _mockBackend([enable], [options]) -> table
+//   switches between the CGS connection functions and the in-memory connections in cursor_backend.h and
+//   returns a table describing the backend in use and the mock's configuration and call counts. The tracker
+//   is stopped first, since its tables and notifications belong to the backend it was started with.
+static int connections_selectBackend(lua_State *L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    [skin checkArgs:LS_TBOOLEAN | LS_TOPTIONAL, LS_TTABLE | LS_TOPTIONAL, LS_TBREAK] ;
+    if (lua_isboolean(L, 1)) {
+        conn_stopTracker() ;
+        trackerCallbackRef = [skin luaUnref:refTable ref:trackerCallbackRef] ;
+        cgs = lua_toboolean(L, 1) ? &cursor_mockConnectionBackend : &conn_nativeBackend ;
+        hsasm_mock_configure(L, 2, &cursorMock) ;
+    }
+    hsasm_mock_pushStats(L, cgs->name, &cursorMock) ;
+    return 1 ;
+}
+
+#pragma mark - Hammerspoon/Lua Infrastructure
+
+static int meta_gc(lua_State* __unused L) {
+    conn_stopTracker() ;
+    trackerCallbackRef = [[LuaSkin sharedWithState:NULL] luaUnref:refTable ref:trackerCallbackRef] ;
+    return 0 ;
+}
+
+// Functions for returned object when module loads
+static luaL_Reg moduleLib[] = {
+    {"start",             connections_start},
+    {"stop",              connections_stop},
+    {"pidForConnection",  connections_pidForConnection},
+    {"connectionsForPID", connections_connectionsForPID},
+    {"connections",       connections_connections},
+    {"stats",             connections_stats},
+    {"spiStats",          connections_spiStats},
+    {"resetSpiStats",     connections_spiResetStats},
+    {"_mockBackend",      connections_selectBackend},
+    {NULL,                NULL}
+};
+
+// Metatable for module, if needed
+static const luaL_Reg module_metaLib[] = {
+    {"__gc", meta_gc},
+    {NULL,   NULL}
+};
+
+int luaopen_hs__asm_undocumented_cursor_connections(lua_State* L) {
+    LuaSkin *skin = [LuaSkin sharedWithState:L] ;
+    refTable = [skin registerLibrary:USERDATA_TAG functions:moduleLib metaFunctions:module_metaLib] ;
+    return 1;
+}
@@ -0,0 +1,546 @@
+//
+// cursor_backend.h
+// The WindowServer functions behind hs._asm.undocumented.cursor and its capture and connections submodules
+//
+// Each source file reaches the private API through a table of function pointers: cursor_backend for the
+// cursor itself (internal.m), cursor_captureBackend for its image (capture.m) and cursor_connectionBackend
+// for the connections of running processes (connections.m). The native tables are in those files; the
+// in-memory mocks below keep just enough state to answer the same calls (see hsasm_mock.h), and are plain C
+// so test/test_cursor_backend.c and bench/bench_cursor_backend.c drive them on Linux.
+//
+// The mock state is per source file, so in the per-module libraries the cursor seen by capture.m is not the
+// one hidden or moved by internal.m.
+
+#pragma once
+
+#include "hsasm_portable.h"
+#include "hsasm_mock.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include "CGSCursor.h"
+#else
+typedef int       CGSConnectionID ;
+typedef NSInteger CGSCursorID ;
+typedef void      (*CGSNewConnectionNotificationProc)(CGSConnectionID cid) ;
+typedef void      (*CGSConnectionDeathNotificationProc)(CGSConnectionID cid) ;
+#endif
+
+// the cursor functions used by internal.m, including the registered cursor sets. The notification
+// functions are always the native ones.
+typedef struct {
+    const char *name ;
+    CGError    (*showCursor)(CGSConnectionID cid) ;
+    CGError    (*hideCursor)(CGSConnectionID cid) ;
+    CGError    (*obscureCursor)(CGSConnectionID cid) ;
+    CGError    (*revealCursor)(CGSConnectionID cid) ;
+    CGError    (*forceWaitCursorActive)(CGSConnectionID cid, bool showWaitCursor) ;
+    int        (*currentCursorSeed)(void) ;
+    char       *(*cursorNameForSystemCursor)(CGSCursorID cursor) ;
+    CGError    (*setCursorScale)(CGSConnectionID cid, CGFloat scale) ;
+    CGError    (*getCursorScale)(CGSConnectionID cid, CGFloat *outScale) ;
+    CGError    (*getCurrentCursorLocation)(CGSConnectionID cid, CGPoint *outPos) ;
+    CGError    (*warpCursorPosition)(CGSConnectionID cid, CGFloat x, CGFloat y) ;
+    CGError    (*registerCursorWithImages)(CGSConnectionID cid, const char *cursorName, bool setGlobally, bool instantly,
+                                           NSUInteger frameCount, CFArrayRef imageArray, CGSize cursorSize, CGPoint hotspot,
+                                           int *seed, CGRect bounds, CGFloat frameDuration, NSInteger repeatCount) ;
+    CGError    (*setRegisteredCursor)(CGSConnectionID cid, const char *cursorName, int *cursorSeed) ;
+    CGError    (*getRegisteredCursorDataSize)(CGSConnectionID cid, const char *cursorName, size_t *outDataSize) ;
+    CGError    (*copyRegisteredCursorImages)(CGSConnectionID cid, const char *cursorName, CGSize *imageSize, CGPoint *hotSpot,
+                                             NSUInteger *frameCount, CGFloat *frameDuration, CFArrayRef *imageArray) ;
+} cursor_backend ;
+
+// the image functions used by capture.m
+typedef struct {
+    const char *name ;
+    int        (*currentCursorSeed)(void) ;
+    char       *(*cursorNameForSystemCursor)(CGSCursorID cursor) ;
+    CGError    (*getGlobalCursorDataSize)(CGSConnectionID cid, size_t *outDataSize) ;
+    CGError    (*getGlobalCursorData)(CGSConnectionID cid, void *outData, int *outDataSize, int *outRowBytes, CGRect *outRect,
+                                      CGPoint *outHotSpot, int *outDepth, int *outComponents, int *outBitsPerComponent) ;
+    CGError    (*getSystemDefinedCursorDataSize)(CGSConnectionID cid, CGSCursorID cursor, size_t *outDataSize) ;
+    CGError    (*getSystemDefinedCursorData)(CGSConnectionID cid, CGSCursorID cursor, void *outData, int *outRowBytes, CGRect *outRect,
+                                             CGPoint *outHotSpot, int *outDepth, int *outComponents, int *outBitsPerComponent) ;
+    CGError    (*copyRegisteredCursorImages)(CGSConnectionID cid, const char *cursorName, CGSize *imageSize, CGPoint *hotSpot,
+                                             NSUInteger *frameCount, CGFloat *frameDuration, CFArrayRef *imageArray) ;
+} cursor_captureBackend ;
+
+// the connection functions used by connections.m. connectionForPID stands for looking up the process serial
+// number of the pid and then its connection, which are two calls natively.
+typedef struct {
+    const char      *name ;
+    CGSConnectionID (*mainConnectionID)(void) ;
+    CGError         (*connectionGetPID)(CGSConnectionID cid, pid_t *outPID) ;
+    CGError         (*connectionForPID)(pid_t pid, CGSConnectionID *outCID) ;
+    CGError         (*registerForNewConnectionNotification)(CGSNewConnectionNotificationProc proc) ;
+    CGError         (*removeNewConnectionNotification)(CGSNewConnectionNotificationProc proc) ;
+    CGError         (*registerForConnectionDeathNotification)(CGSConnectionDeathNotificationProc proc) ;
+    CGError         (*removeConnectionDeathNotification)(CGSConnectionDeathNotificationProc proc) ;
+} cursor_connectionBackend ;
+
+// the mock cursor only keeps the values the native functions would report; it never changes the screen.
+// Failed calls return the configured failureCode and leave the state unchanged.
+static hsasm_mock       cursorMock         = HSASM_MOCK(kCGErrorFailure) ;
+static _Atomic int      cursorMockSeed     = 1 ;
+static _Atomic bool     cursorMockHidden   = false ;
+static _Atomic bool     cursorMockObscured = false ;
+static _Atomic bool     cursorMockWaiting  = false ;
+static CGFloat          cursorMockScale    = 1.0 ;
+static CGPoint          cursorMockLocation = { 0.0, 0.0 } ;
+static pthread_mutex_t  cursorMockLock     = PTHREAD_MUTEX_INITIALIZER ;
+
+static CGError cursor_mockSetFlag(_Atomic bool *flag, bool value) {
+    if (hsasm_mock_call(&cursorMock)) return cursorMock.failureCode ;
+    if (atomic_exchange(flag, value) != value) atomic_fetch_add(&cursorMockSeed, 1) ;
+    return kCGErrorSuccess ;
+}
+
+static CGError cursor_mockShowCursor(__attribute__((unused)) CGSConnectionID cid) {
+    return cursor_mockSetFlag(&cursorMockHidden, false) ;
+}
+
+static CGError cursor_mockHideCursor(__attribute__((unused)) CGSConnectionID cid) {
+    return cursor_mockSetFlag(&cursorMockHidden, true) ;
+}
+
+static CGError cursor_mockObscureCursor(__attribute__((unused)) CGSConnectionID cid) {
+    return cursor_mockSetFlag(&cursorMockObscured, true) ;
+}
+
+static CGError cursor_mockRevealCursor(__attribute__((unused)) CGSConnectionID cid) {
+    return cursor_mockSetFlag(&cursorMockObscured, false) ;
+}
+
+static CGError cursor_mockForceWaitCursorActive(__attribute__((unused)) CGSConnectionID cid, bool showWaitCursor) {
+    return cursor_mockSetFlag(&cursorMockWaiting, showWaitCursor) ;
+}
+
+static int cursor_mockCurrentCursorSeed(void) {
+    return hsasm_mock_call(&cursorMock) ? 0 : atomic_load(&cursorMockSeed) ;
+}
+
+static char *cursor_mockCursorNameForSystemCursor(CGSCursorID cursor) {
+    static _Thread_local char name[32] ;
+    if (hsasm_mock_call(&cursorMock)) return NULL ;
+    snprintf(name, sizeof(name), "mock.cursor.%d", (int)cursor) ;
+    return name ;
+}
+
+static CGError cursor_mockSetCursorScale(__attribute__((unused)) CGSConnectionID cid, CGFloat scale) {
+    if (hsasm_mock_call(&cursorMock)) return cursorMock.failureCode ;
+    pthread_mutex_lock(&cursorMockLock) ;
+    cursorMockScale = scale ;
+    pthread_mutex_unlock(&cursorMockLock) ;
+    return kCGErrorSuccess ;
+}
+
+static CGError cursor_mockGetCursorScale(__attribute__((unused)) CGSConnectionID cid, CGFloat *outScale) {
+    if (hsasm_mock_call(&cursorMock)) return cursorMock.failureCode ;
+    pthread_mutex_lock(&cursorMockLock) ;
+    *outScale = cursorMockScale ;
+    pthread_mutex_unlock(&cursorMockLock) ;
+    return kCGErrorSuccess ;
+}
+
+static CGError cursor_mockGetCurrentCursorLocation(__attribute__((unused)) CGSConnectionID cid, CGPoint *outPos) {
+    if (hsasm_mock_call(&cursorMock)) return cursorMock.failureCode ;
+    pthread_mutex_lock(&cursorMockLock) ;
+    *outPos = cursorMockLocation ;
+    pthread_mutex_unlock(&cursorMockLock) ;
+    return kCGErrorSuccess ;
+}
+
+static CGError cursor_mockWarpCursorPosition(__attribute__((unused)) CGSConnectionID cid, CGFloat x, CGFloat y) {
+    if (hsasm_mock_call(&cursorMock)) return cursorMock.failureCode ;
+    pthread_mutex_lock(&cursorMockLock) ;
+    cursorMockLocation = (CGPoint){ x, y } ;
+    pthread_mutex_unlock(&cursorMockLock) ;
+    return kCGErrorSuccess ;
+}
+
+// The mock keeps the registered cursor sets in a table of its own, holding on to the image array as the
+// WindowServer would. Registering makes the set the current cursor, and its data size is what the frames
+// would take as retina images with four bytes a pixel. cursor_mock_forgetRegisteredCursors stands for the
+// WindowServer being restarted.
+#define CURSOR_MOCK_SETS     64
+#define CURSOR_MOCK_SET_NAME 128
+
+#ifdef __APPLE__
+#define CURSOR_MOCK_RETAIN(array)  CFRetain(array)
+#define CURSOR_MOCK_RELEASE(array) CFRelease(array)
+#else
+#define CURSOR_MOCK_RETAIN(array)  (array)
+#define CURSOR_MOCK_RELEASE(array) ((void)(array))
+#endif
+
+typedef struct {
+    char       name[CURSOR_MOCK_SET_NAME] ;
+    int        seed ;
+    NSUInteger frameCount ;
+    CFArrayRef images ;
+    CGSize     size ;
+    CGPoint    hotSpot ;
+    CGFloat    frameDuration ;
+} cursor_mockSet ;
+
+static cursor_mockSet cursorMockSets[CURSOR_MOCK_SETS] ;
+static size_t         cursorMockSetCount = 0 ;
+
+// must be called with cursorMockLock held
+static inline cursor_mockSet *cursor_mockFindSet(const char *name) {
+    for (size_t i = 0 ; i < cursorMockSetCount ; i++) {
+        if (strcmp(cursorMockSets[i].name, name) == 0) return &cursorMockSets[i] ;
+    }
+    return NULL ;
+}
+
+static CGError cursor_mockRegisterCursorWithImages(__attribute__((unused)) CGSConnectionID cid, const char *cursorName,
+                                                   __attribute__((unused)) bool setGlobally, __attribute__((unused)) bool instantly,
+                                                   NSUInteger frameCount, CFArrayRef imageArray, CGSize cursorSize, CGPoint hotspot,
+                                                   int *seed, __attribute__((unused)) CGRect bounds, CGFloat frameDuration,
+                                                   __attribute__((unused)) NSInteger repeatCount) {
+    if (hsasm_mock_call(&cursorMock)) return cursorMock.failureCode ;
+    if (!cursorName || strlen(cursorName) >= CURSOR_MOCK_SET_NAME || frameCount == 0 || !imageArray) return kCGErrorIllegalArgument ;
+    pthread_mutex_lock(&cursorMockLock) ;
+    cursor_mockSet *set = cursor_mockFindSet(cursorName) ;
+    if (!set && cursorMockSetCount < CURSOR_MOCK_SETS) {
+        set = &cursorMockSets[cursorMockSetCount++] ;
+        strcpy(set->name, cursorName) ;
+        set->images = NULL ;
+    }
+    if (set) {
+        if (set->images) CURSOR_MOCK_RELEASE(set->images) ;
+        set->seed          = atomic_fetch_add(&cursorMockSeed, 1) + 1 ;
+        set->frameCount    = frameCount ;
+        set->images        = CURSOR_MOCK_RETAIN(imageArray) ;
+        set->size          = cursorSize ;
+        set->hotSpot       = hotspot ;
+        set->frameDuration = frameDuration ;
+        *seed              = set->seed ;
+    }
+    pthread_mutex_unlock(&cursorMockLock) ;
+    return set ? kCGErrorSuccess : kCGErrorCannotComplete ;
+}
+
+static CGError cursor_mockSetRegisteredCursor(__attribute__((unused)) CGSConnectionID cid, const char *cursorName, int *cursorSeed) {
+    if (hsasm_mock_call(&cursorMock)) return cursorMock.failureCode ;
+    pthread_mutex_lock(&cursorMockLock) ;
+    cursor_mockSet *set = cursor_mockFindSet(cursorName) ;
+    if (set) {
+        atomic_fetch_add(&cursorMockSeed, 1) ;
+        *cursorSeed = set->seed ;
+    }
+    pthread_mutex_unlock(&cursorMockLock) ;
+    return set ? kCGErrorSuccess : kCGErrorIllegalArgument ;
+}
+
+static CGError cursor_mockGetRegisteredCursorDataSize(__attribute__((unused)) CGSConnectionID cid, const char *cursorName, size_t *outDataSize) {
+    if (hsasm_mock_call(&cursorMock)) return cursorMock.failureCode ;
+    pthread_mutex_lock(&cursorMockLock) ;
+    cursor_mockSet *set = cursor_mockFindSet(cursorName) ;
+    if (set) *outDataSize = set->frameCount * (size_t)(set->size.width * 2) * (size_t)(set->size.height * 2) * 4 ;
+    pthread_mutex_unlock(&cursorMockLock) ;
+    return set ? kCGErrorSuccess : kCGErrorIllegalArgument ;
+}
+
+// like the native function, the array returned is the caller's to release
+static CGError cursor_mockCopyRegisteredCursorImages(__attribute__((unused)) CGSConnectionID cid, const char *cursorName, CGSize *imageSize,
+                                                     CGPoint *hotSpot, NSUInteger *frameCount, CGFloat *frameDuration, CFArrayRef *imageArray) {
+    if (hsasm_mock_call(&cursorMock)) return cursorMock.failureCode ;
+    pthread_mutex_lock(&cursorMockLock) ;
+    cursor_mockSet *set = cursor_mockFindSet(cursorName) ;
+    if (set) {
+        *imageSize     = set->size ;
+        *hotSpot       = set->hotSpot ;
+        *frameCount    = set->frameCount ;
+        *frameDuration = set->frameDuration ;
+        *imageArray    = CURSOR_MOCK_RETAIN(set->images) ;
+    } else {
+        *frameCount = 0 ;
+        *imageArray = NULL ;
+    }
+    pthread_mutex_unlock(&cursorMockLock) ;
+    return set ? kCGErrorSuccess : kCGErrorIllegalArgument ;
+}
+
+// forgets every registered set; this stands for what the WindowServer does, so it never fails
+static inline void cursor_mock_forgetRegisteredCursors(void) {
+    pthread_mutex_lock(&cursorMockLock) ;
+    for (size_t i = 0 ; i < cursorMockSetCount ; i++) CURSOR_MOCK_RELEASE(cursorMockSets[i].images) ;
+    cursorMockSetCount = 0 ;
+    pthread_mutex_unlock(&cursorMockLock) ;
+}
+
+static const cursor_backend cursor_mockBackend = {
+    "mock",
+    cursor_mockShowCursor,
+    cursor_mockHideCursor,
+    cursor_mockObscureCursor,
+    cursor_mockRevealCursor,
+    cursor_mockForceWaitCursorActive,
+    cursor_mockCurrentCursorSeed,
+    cursor_mockCursorNameForSystemCursor,
+    cursor_mockSetCursorScale,
+    cursor_mockGetCursorScale,
+    cursor_mockGetCurrentCursorLocation,
+    cursor_mockWarpCursorPosition,
+    cursor_mockRegisterCursorWithImages,
+    cursor_mockSetRegisteredCursor,
+    cursor_mockGetRegisteredCursorDataSize,
+    cursor_mockCopyRegisteredCursorImages
+} ;
+
+// Every mock cursor is a retina image of CURSOR_MOCK_PIXELS square for a cursor of half as many points: a
+// disc whose colour depends on the cursor and the seed, opaque in the middle, with a partly transparent
+// edge and transparent corners, premultiplied ARGB as the WindowServer returns it. The system cursors are
+// the nine CGSCursorIDs. The registered cursors are the sets registered through cursor_mockBackend, whose
+// images are whatever array was registered, so in capture.m, which has its own mock state, there are none.
+#define CURSOR_MOCK_PIXELS         32
+#define CURSOR_MOCK_ROW_BYTES      (CURSOR_MOCK_PIXELS * 4)
+#define CURSOR_MOCK_DATA_SIZE      (CURSOR_MOCK_ROW_BYTES * CURSOR_MOCK_PIXELS)
+#define CURSOR_MOCK_SYSTEM_CURSORS 9
+
+// the straight (not premultiplied) colour and the alpha of a mock pixel
+static inline void cursor_mockPixel(uint32_t variant, size_t x, size_t y, uint8_t rgba[4]) {
+    int32_t dx       = 2 * (int32_t)x + 1 - CURSOR_MOCK_PIXELS ;
+    int32_t dy       = 2 * (int32_t)y + 1 - CURSOR_MOCK_PIXELS ;
+    int32_t distance = dx * dx + dy * dy ;
+    int32_t inner    = (CURSOR_MOCK_PIXELS - 8) * (CURSOR_MOCK_PIXELS - 8) ;
+    int32_t outer    = CURSOR_MOCK_PIXELS * CURSOR_MOCK_PIXELS ;
+    rgba[0] = (uint8_t)(variant * 37 + x * 7) ;
+    rgba[1] = (uint8_t)(variant * 91 + y * 7) ;
+    rgba[2] = (uint8_t)(variant * 13 + (x ^ y) * 5) ;
+    rgba[3] = (distance <= inner) ? 255 : (distance >= outer) ? 0 : (uint8_t)(255 * (outer - distance) / (outer - inner)) ;
+}
+
+static inline void cursor_mockImage(uint32_t variant, uint8_t *bytes) {
+    for (size_t y = 0 ; y < CURSOR_MOCK_PIXELS ; y++) {
+        for (size_t x = 0 ; x < CURSOR_MOCK_PIXELS ; x++) {
+            uint8_t rgba[4], *pixel = bytes + y * CURSOR_MOCK_ROW_BYTES + x * 4 ;
+            cursor_mockPixel(variant, x, y, rgba) ;
+            pixel[0] = rgba[3] ;
+            for (int c = 0 ; c < 3 ; c++) pixel[c + 1] = (uint8_t)((rgba[c] * rgba[3] + 127) / 255) ;
+        }
+    }
+}
+
+static inline void cursor_mockImageFormat(int *outRowBytes, CGRect *outRect, CGPoint *outHotSpot, int *outDepth, int *outComponents, int *outBitsPerComponent) {
+    *outRowBytes         = CURSOR_MOCK_ROW_BYTES ;
+    *outRect             = (CGRect){ { 0.0, 0.0 }, { CURSOR_MOCK_PIXELS / 2, CURSOR_MOCK_PIXELS / 2 } } ;
+    *outHotSpot          = (CGPoint){ 4.0, 4.0 } ;
+    *outDepth            = 32 ;
+    *outComponents       = 4 ;
+    *outBitsPerComponent = 8 ;
+}
+
+static CGError cursor_mockGetGlobalCursorDataSize(__attribute__((unused)) CGSConnectionID cid, size_t *outDataSize) {
+    if (hsasm_mock_call(&cursorMock)) return cursorMock.failureCode ;
+    *outDataSize = CURSOR_MOCK_DATA_SIZE ;
+    return kCGErrorSuccess ;
+}
+
+// the current cursor looks different each time the seed changes
+static CGError cursor_mockGetGlobalCursorData(__attribute__((unused)) CGSConnectionID cid, void *outData, int *outDataSize, int *outRowBytes,
+                                              CGRect *outRect, CGPoint *outHotSpot, int *outDepth, int *outComponents, int *outBitsPerComponent) {
+    if (hsasm_mock_call(&cursorMock)) return cursorMock.failureCode ;
+    if (*outDataSize < CURSOR_MOCK_DATA_SIZE) return kCGErrorRangeCheck ;
+    cursor_mockImage((uint32_t)atomic_load(&cursorMockSeed), outData) ;
+    *outDataSize = CURSOR_MOCK_DATA_SIZE ;
+    cursor_mockImageFormat(outRowBytes, outRect, outHotSpot, outDepth, outComponents, outBitsPerComponent) ;
+    return kCGErrorSuccess ;
+}
+
+static CGError cursor_mockGetSystemDefinedCursorDataSize(__attribute__((unused)) CGSConnectionID cid, CGSCursorID cursor, size_t *outDataSize) {
+    if (hsasm_mock_call(&cursorMock)) return cursorMock.failureCode ;
+    if (cursor < 0 || cursor >= CURSOR_MOCK_SYSTEM_CURSORS) return kCGErrorIllegalArgument ;
+    *outDataSize = CURSOR_MOCK_DATA_SIZE ;
+    return kCGErrorSuccess ;
+}
+
+// like the native function, this trusts the buffer to be as large as the size reported for the cursor
+static CGError cursor_mockGetSystemDefinedCursorData(__attribute__((unused)) CGSConnectionID cid, CGSCursorID cursor, void *outData, int *outRowBytes,
+                                                     CGRect *outRect, CGPoint *outHotSpot, int *outDepth, int *outComponents, int *outBitsPerComponent) {
+    if (hsasm_mock_call(&cursorMock)) return cursorMock.failureCode ;
+    if (cursor < 0 || cursor >= CURSOR_MOCK_SYSTEM_CURSORS) return kCGErrorIllegalArgument ;
+    cursor_mockImage(1000 + (uint32_t)cursor, outData) ;
+    cursor_mockImageFormat(outRowBytes, outRect, outHotSpot, outDepth, outComponents, outBitsPerComponent) ;
+    return kCGErrorSuccess ;
+}
+
+static const cursor_captureBackend cursor_mockCaptureBackend = {
+    "mock",
+    cursor_mockCurrentCursorSeed,
+    cursor_mockCursorNameForSystemCursor,
+    cursor_mockGetGlobalCursorDataSize,
+    cursor_mockGetGlobalCursorData,
+    cursor_mockGetSystemDefinedCursorDataSize,
+    cursor_mockGetSystemDefinedCursorData,
+    cursor_mockCopyRegisteredCursorImages
+} ;
+
+// Every process has one mock connection, made the first time it is asked for; cursor_mock_connect and
+// cursor_mock_disconnect add and remove others, as the WindowServer would. Like the native notifications,
+// the mock's are only sent for this process's connections, and are sent on the calling thread.
+#define CURSOR_MOCK_CONNECTIONS   4096
+#define CURSOR_MOCK_FIRST_CID     0x10000
+
+static struct {
+    CGSConnectionID                    cids[CURSOR_MOCK_CONNECTIONS] ;
+    pid_t                              pids[CURSOR_MOCK_CONNECTIONS] ;
+    size_t                             count ;
+    CGSConnectionID                    nextCID ;
+    CGSNewConnectionNotificationProc   newProc ;
+    CGSConnectionDeathNotificationProc deathProc ;
+} cursorMockConnections = { .count = 0, .nextCID = CURSOR_MOCK_FIRST_CID } ;
+
+// must be called with cursorMockLock held; returns the connection or 0 if the table is full
+static inline CGSConnectionID cursor_mockAddConnection(pid_t pid) {
+    if (cursorMockConnections.count >= CURSOR_MOCK_CONNECTIONS) return 0 ;
+    CGSConnectionID cid = cursorMockConnections.nextCID++ ;
+    cursorMockConnections.cids[cursorMockConnections.count] = cid ;
+    cursorMockConnections.pids[cursorMockConnections.count] = pid ;
+    cursorMockConnections.count++ ;
+    return cid ;
+}
+
+// must be called with cursorMockLock held
+static inline pid_t cursor_mockOwner(CGSConnectionID cid) {
+    for (size_t i = 0 ; i < cursorMockConnections.count ; i++) {
+        if (cursorMockConnections.cids[i] == cid) return cursorMockConnections.pids[i] ;
+    }
+    return 0 ;
+}
+
+static CGError cursor_mockConnectionForPID(pid_t pid, CGSConnectionID *outCID) {
+    if (hsasm_mock_call(&cursorMock)) return cursorMock.failureCode ;
+    if (pid <= 0) return kCGErrorIllegalArgument ;
+    pthread_mutex_lock(&cursorMockLock) ;
+    CGSConnectionID cid = 0 ;
+    for (size_t i = 0 ; i < cursorMockConnections.count && cid == 0 ; i++) {
+        if (cursorMockConnections.pids[i] == pid) cid = cursorMockConnections.cids[i] ;
+    }
+    if (cid == 0) cid = cursor_mockAddConnection(pid) ;
+    pthread_mutex_unlock(&cursorMockLock) ;
+    *outCID = cid ;
+    return (cid != 0) ? kCGErrorSuccess : kCGErrorCannotComplete ;
+}
+
+// the main connection always exists, so this is not a call which can be made to fail
+static CGSConnectionID cursor_mockMainConnectionID(void) {
+    CGSConnectionID cid = 0 ;
+    pthread_mutex_lock(&cursorMockLock) ;
+    for (size_t i = 0 ; i < cursorMockConnections.count && cid == 0 ; i++) {
+        if (cursorMockConnections.pids[i] == getpid()) cid = cursorMockConnections.cids[i] ;
+    }
+    if (cid == 0) cid = cursor_mockAddConnection(getpid()) ;
+    pthread_mutex_unlock(&cursorMockLock) ;
+    return cid ;
+}
+
+static CGError cursor_mockConnectionGetPID(CGSConnectionID cid, pid_t *outPID) {
+    if (hsasm_mock_call(&cursorMock)) return cursorMock.failureCode ;
+    pthread_mutex_lock(&cursorMockLock) ;
+    pid_t pid = cursor_mockOwner(cid) ;
+    pthread_mutex_unlock(&cursorMockLock) ;
+    if (pid == 0) return kCGErrorIllegalArgument ;
+    *outPID = pid ;
+    return kCGErrorSuccess ;
+}
+
+static CGError cursor_mockRegisterForNewConnectionNotification(CGSNewConnectionNotificationProc proc) {
+    if (hsasm_mock_call(&cursorMock)) return cursorMock.failureCode ;
+    pthread_mutex_lock(&cursorMockLock) ;
+    cursorMockConnections.newProc = proc ;
+    pthread_mutex_unlock(&cursorMockLock) ;
+    return kCGErrorSuccess ;
+}
+
+static CGError cursor_mockRemoveNewConnectionNotification(CGSNewConnectionNotificationProc proc) {
+    if (hsasm_mock_call(&cursorMock)) return cursorMock.failureCode ;
+    pthread_mutex_lock(&cursorMockLock) ;
+    if (cursorMockConnections.newProc == proc) cursorMockConnections.newProc = NULL ;
+    pthread_mutex_unlock(&cursorMockLock) ;
+    return kCGErrorSuccess ;
+}
+
+static CGError cursor_mockRegisterForConnectionDeathNotification(CGSConnectionDeathNotificationProc proc) {
+    if (hsasm_mock_call(&cursorMock)) return cursorMock.failureCode ;
+    pthread_mutex_lock(&cursorMockLock) ;
+    cursorMockConnections.deathProc = proc ;
+    pthread_mutex_unlock(&cursorMockLock) ;
+    return kCGErrorSuccess ;
+}
+
+static CGError cursor_mockRemoveConnectionDeathNotification(CGSConnectionDeathNotificationProc proc) {
+    if (hsasm_mock_call(&cursorMock)) return cursorMock.failureCode ;
+    pthread_mutex_lock(&cursorMockLock) ;
+    if (cursorMockConnections.deathProc == proc) cursorMockConnections.deathProc = NULL ;
+    pthread_mutex_unlock(&cursorMockLock) ;
+    return kCGErrorSuccess ;
+}
+
+static const cursor_connectionBackend cursor_mockConnectionBackend = {
+    "mock",
+    cursor_mockMainConnectionID,
+    cursor_mockConnectionGetPID,
+    cursor_mockConnectionForPID,
+    cursor_mockRegisterForNewConnectionNotification,
+    cursor_mockRemoveNewConnectionNotification,
+    cursor_mockRegisterForConnectionDeathNotification,
+    cursor_mockRemoveConnectionDeathNotification
+} ;
+
+// Makes a new connection for pid, as an application opening another connection would, and returns it, or 0
+// if the mock's table is full. These stand for what other processes do, so they never fail.
+static inline CGSConnectionID cursor_mock_connect(pid_t pid) {
+    pthread_mutex_lock(&cursorMockLock) ;
+    CGSConnectionID                  cid  = cursor_mockAddConnection(pid) ;
+    CGSNewConnectionNotificationProc proc = (pid == getpid()) ? cursorMockConnections.newProc : NULL ;
+    pthread_mutex_unlock(&cursorMockLock) ;
+    if (cid != 0 && proc) proc(cid) ;
+    return cid ;
+}
+
+// removes a connection, returning the pid which owned it or 0 if there was no such connection
+static inline pid_t cursor_mock_disconnect(CGSConnectionID cid) {
+    pthread_mutex_lock(&cursorMockLock) ;
+    pid_t pid = 0 ;
+    for (size_t i = 0 ; i < cursorMockConnections.count ; i++) {
+        if (cursorMockConnections.cids[i] != cid) continue ;
+        pid = cursorMockConnections.pids[i] ;
+        cursorMockConnections.count-- ;
+        cursorMockConnections.cids[i] = cursorMockConnections.cids[cursorMockConnections.count] ;
+        cursorMockConnections.pids[i] = cursorMockConnections.pids[cursorMockConnections.count] ;
+        break ;
+    }
+    CGSConnectionDeathNotificationProc proc = (pid != 0 && pid == getpid()) ? cursorMockConnections.deathProc : NULL ;
+    pthread_mutex_unlock(&cursorMockLock) ;
+    if (proc) proc(cid) ;
+    return pid ;
+}
+
+// removes every connection of a process which has terminated and returns how many there were; as natively,
+// nothing is notified, since the connections weren't this process's
+static inline size_t cursor_mock_terminate(pid_t pid) {
+    pthread_mutex_lock(&cursorMockLock) ;
+    size_t removed = 0 ;
+    for (size_t i = 0 ; i < cursorMockConnections.count ; ) {
+        if (cursorMockConnections.pids[i] == pid) {
+            cursorMockConnections.count-- ;
+            cursorMockConnections.cids[i] = cursorMockConnections.cids[cursorMockConnections.count] ;
+            cursorMockConnections.pids[i] = cursorMockConnections.pids[cursorMockConnections.count] ;
+            removed++ ;
+        } else {
+            i++ ;
+        }
+    }
+    pthread_mutex_unlock(&cursorMockLock) ;
+    return removed ;
+}
@@ -0,0 +1,193 @@
+//
+// cursor_cache.h
+// The seed-keyed LRU behind the capture cache of hs._asm.undocumented.cursor.capture
+//
+// The image for a given cursor seed never changes, so captures are cached by the seed and the cursor's
+// name. A hit returns the image which has already been converted without calling the SPI again; entries
+// are evicted least recently used first once the buffers they hold exceed the byte budget.
+//
+// Entries are found through a hash table and kept in a doubly linked list in order of use, so a lookup, a
+// store and each eviction are O(1) however many images are cached. The cache doesn't know what it holds:
+// capture.m stores retained image objects and releases them through the release hook, and
+// test/test_cursor_cache.c and bench/bench_cursor_cache.c store plain pointers. It isn't locked; capture.m
+// only uses it from the main thread.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CURSOR_CACHE_BUDGET          (4 * 1024 * 1024)
+#define CURSOR_CACHE_INITIAL_BUCKETS 16
+
+typedef struct cursor_cacheEntry {
+    struct cursor_cacheEntry *older ;
+    struct cursor_cacheEntry *newer ;
+    struct cursor_cacheEntry *chain ;  // the next entry in the same hash bucket
+    uint64_t                 hash ;
+    int                      seed ;
+    size_t                   bytes ;
+    void                     *value ;
+    char                     name[] ;
+} cursor_cacheEntry ;
+
+typedef struct {
+    cursor_cacheEntry **buckets ;     // allocated by the first store
+    size_t            bucketCount ;   // always a power of two
+    size_t            count ;
+    cursor_cacheEntry *oldest ;
+    cursor_cacheEntry *newest ;
+    size_t            bytes ;
+    size_t            budget ;
+    uint64_t          hits ;
+    uint64_t          misses ;
+    uint64_t          evictions ;
+
+    void              (*release)(void *value, void *context) ;
+    void              *releaseContext ;
+} cursor_cache ;
+
+static inline void cursor_cache_init(cursor_cache *cache, size_t budget,
+                                     void (*release)(void *value, void *context), void *releaseContext) {
+    memset(cache, 0, sizeof(cursor_cache)) ;
+    cache->budget         = budget ;
+    cache->release        = release ;
+    cache->releaseContext = releaseContext ;
+}
+
+// FNV-1a over the seed and the name
+static inline uint64_t cursor_cache_hash(int seed, const char *name) {
+    uint64_t hash = 0xCBF29CE484222325ULL ;
+    uint32_t bits = (uint32_t)seed ;
+    for (int i = 0 ; i < 4 ; i++) {
+        hash = (hash ^ ((bits >> (i * 8)) & 0xFF)) * 0x100000001B3ULL ;
+    }
+    for (const unsigned char *p = (const unsigned char *)name ; *p ; p++) hash = (hash ^ *p) * 0x100000001B3ULL ;
+    return hash ;
+}
+
+static inline cursor_cacheEntry **cursor_cache_slot(cursor_cache *cache, uint64_t hash, int seed, const char *name) {
+    cursor_cacheEntry **link = &cache->buckets[hash & (cache->bucketCount - 1)] ;
+    while (*link && !((*link)->hash == hash && (*link)->seed == seed && strcmp((*link)->name, name) == 0)) {
+        link = &(*link)->chain ;
+    }
+    return link ;
+}
+
+static inline void cursor_cache_unlink(cursor_cache *cache, cursor_cacheEntry *entry) {
+    if (entry->older) entry->older->newer = entry->newer ; else cache->oldest = entry->newer ;
+    if (entry->newer) entry->newer->older = entry->older ; else cache->newest = entry->older ;
+    entry->older = entry->newer = NULL ;
+}
+
+static inline void cursor_cache_append(cursor_cache *cache, cursor_cacheEntry *entry) {
+    entry->older = cache->newest ;
+    entry->newer = NULL ;
+    if (cache->newest) cache->newest->newer = entry ; else cache->oldest = entry ;
+    cache->newest = entry ;
+}
+
+// takes the entry out of its bucket and the list, and releases what it holds
+static inline void cursor_cache_remove(cursor_cache *cache, cursor_cacheEntry *entry) {
+    cursor_cacheEntry **link = cursor_cache_slot(cache, entry->hash, entry->seed, entry->name) ;
+    *link = entry->chain ;
+    cursor_cache_unlink(cache, entry) ;
+    cache->count-- ;
+    cache->bytes -= entry->bytes ;
+    if (cache->release) cache->release(entry->value, cache->releaseContext) ;
+    free(entry) ;
+}
+
+// returns the value cached for the seed and name, making it the most recently used, or NULL
+static inline void *cursor_cache_lookup(cursor_cache *cache, int seed, const char *name) {
+    cursor_cacheEntry *entry = NULL ;
+    if (cache->count > 0) entry = *cursor_cache_slot(cache, cursor_cache_hash(seed, name), seed, name) ;
+    if (!entry) {
+        cache->misses++ ;
+        return NULL ;
+    }
+    cache->hits++ ;
+    if (entry != cache->newest) {
+        cursor_cache_unlink(cache, entry) ;
+        cursor_cache_append(cache, entry) ;
+    }
+    return entry->value ;
+}
+
+// evicts least recently used entries until the cache holds no more than budget bytes
+static inline void cursor_cache_evict(cursor_cache *cache, size_t budget) {
+    while (cache->bytes > budget && cache->oldest) {
+        cursor_cache_remove(cache, cache->oldest) ;
+        cache->evictions++ ;
+    }
+}
+
+static inline bool cursor_cache_grow(cursor_cache *cache) {
+    size_t            bucketCount = cache->bucketCount ? cache->bucketCount * 2 : CURSOR_CACHE_INITIAL_BUCKETS ;
+    cursor_cacheEntry **buckets   = calloc(bucketCount, sizeof(cursor_cacheEntry *)) ;
+    if (!buckets) return false ;
+    for (size_t i = 0 ; i < cache->bucketCount ; i++) {
+        cursor_cacheEntry *entry = cache->buckets[i] ;
+        while (entry) {
+            cursor_cacheEntry *next = entry->chain ;
+            entry->chain = buckets[entry->hash & (bucketCount - 1)] ;
+            buckets[entry->hash & (bucketCount - 1)] = entry ;
+            entry = next ;
+        }
+    }
+    free(cache->buckets) ;
+    cache->buckets     = buckets ;
+    cache->bucketCount = bucketCount ;
+    return true ;
+}
+
+// Caches value, which holds bytes bytes of image buffers, as the most recently used entry, replacing any
+// value already cached for the seed and name. On success the cache owns the value and releases it when it's
+// evicted; false means it wasn't cached -- because it's larger than the budget or memory ran out -- and the
+// caller still owns it.
+static inline bool cursor_cache_store(cursor_cache *cache, int seed, const char *name, void *value, size_t bytes) {
+    if (bytes > cache->budget) return false ;
+    if (cache->count >= cache->bucketCount && !cursor_cache_grow(cache) && cache->bucketCount == 0) return false ;
+
+    size_t            length = strlen(name) ;
+    cursor_cacheEntry *entry = malloc(sizeof(cursor_cacheEntry) + length + 1) ;
+    if (!entry) return false ;
+    entry->hash  = cursor_cache_hash(seed, name) ;
+    entry->seed  = seed ;
+    entry->bytes = bytes ;
+    entry->value = value ;
+    memcpy(entry->name, name, length + 1) ;
+
+    cursor_cacheEntry *existing = *cursor_cache_slot(cache, entry->hash, seed, name) ;
+    if (existing) cursor_cache_remove(cache, existing) ;
+    cursor_cache_evict(cache, cache->budget - bytes) ;
+
+    cursor_cacheEntry **bucket = &cache->buckets[entry->hash & (cache->bucketCount - 1)] ;
+    entry->chain = *bucket ;
+    *bucket      = entry ;
+    cursor_cache_append(cache, entry) ;
+    cache->count++ ;
+    cache->bytes += bytes ;
+    return true ;
+}
+
+// changes the budget, evicting entries until the cache fits
+static inline void cursor_cache_setBudget(cursor_cache *cache, size_t budget) {
+    cache->budget = budget ;
+    cursor_cache_evict(cache, budget) ;
+}
+
+// releases every entry; the budget and the counters are kept
+static inline void cursor_cache_flush(cursor_cache *cache) {
+    while (cache->oldest) cursor_cache_remove(cache, cache->oldest) ;
+}
+
+static inline void cursor_cache_free(cursor_cache *cache) {
+    cursor_cache_flush(cache) ;
+    free(cache->buckets) ;
+    cache->buckets     = NULL ;
+    cache->bucketCount = 0 ;
+}
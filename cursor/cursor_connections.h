@@ -0,0 +1,220 @@
+//
+// cursor_connections.h
+// The connection tables behind hs._asm.undocumented.cursor.connections
+//
+// The tracker keeps a map of live WindowServer connection ids to the pid which owns them, plus a reverse
+// index from pid to its connections, so lookups don't have to query the WindowServer each time. Both are
+// open addressing tables with linear probing; removals shift the following entries back rather than
+// leaving tombstones, so lookups never get slower as connections come and go.
+//
+// connections.m turns the WindowServer's notifications and NSWorkspace's launches and terminations into the
+// events applied here, and makes the Lua callbacks for whatever they change. Nothing here is locked; it's
+// only used from the main thread. test/test_cursor_connections.c and bench/bench_cursor_connections.c apply
+// synthetic events to it on Linux.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define CONN_MAP_INITIAL_CAPACITY 256
+
+typedef struct {
+    int32_t key ;   // 0 marks an empty slot; neither connection ids nor pids are 0
+    int32_t value ;
+} conn_slot ;
+
+typedef struct {
+    conn_slot *slots ;
+    size_t    capacity ; // a power of 2
+    size_t    count ;
+} conn_map ;
+
+static inline size_t conn_hash(int32_t key, size_t capacity) {
+    return (size_t)(((uint64_t)(uint32_t)key * 0x9E3779B97F4A7C15ULL) >> 32) & (capacity - 1) ;
+}
+
+static inline bool conn_map_init(conn_map *map, size_t capacity) {
+    conn_slot *slots = calloc(capacity, sizeof(conn_slot)) ;
+    if (!slots) return false ;
+    free(map->slots) ;
+    map->slots    = slots ;
+    map->capacity = capacity ;
+    map->count    = 0 ;
+    return true ;
+}
+
+static inline void conn_map_free(conn_map *map) {
+    free(map->slots) ;
+    *map = (conn_map){ NULL, 0, 0 } ;
+}
+
+static inline void conn_map_insert(conn_map *map, int32_t key, int32_t value, bool unique) ;
+
+static inline void conn_map_grow(conn_map *map) {
+    conn_map old = *map ;
+    *map = (conn_map){ NULL, 0, 0 } ;
+    if (!conn_map_init(map, old.capacity ? old.capacity * 2 : CONN_MAP_INITIAL_CAPACITY)) {
+        *map = old ;
+        return ;
+    }
+    for (size_t i = 0 ; i < old.capacity ; i++) {
+        if (old.slots[i].key != 0) conn_map_insert(map, old.slots[i].key, old.slots[i].value, false) ;
+    }
+    free(old.slots) ;
+}
+
+// with unique set, an existing entry for the key is replaced; otherwise only an identical key/value
+// pair is considered a duplicate
+static inline void conn_map_insert(conn_map *map, int32_t key, int32_t value, bool unique) {
+    if ((map->count + 1) * 4 > map->capacity * 3) conn_map_grow(map) ;
+    if (map->count + 1 >= map->capacity) return ; // couldn't grow, and probes need an empty slot to stop at
+    size_t mask = map->capacity - 1 ;
+    size_t i    = conn_hash(key, map->capacity) ;
+    while (map->slots[i].key != 0) {
+        if (map->slots[i].key == key && (unique || map->slots[i].value == value)) {
+            map->slots[i].value = value ;
+            return ;
+        }
+        i = (i + 1) & mask ;
+    }
+    map->slots[i] = (conn_slot){ key, value } ;
+    map->count++ ;
+}
+
+static inline conn_slot *conn_map_find(const conn_map *map, int32_t key) {
+    if (map->capacity == 0) return NULL ;
+    size_t mask = map->capacity - 1 ;
+    size_t i    = conn_hash(key, map->capacity) ;
+    while (map->slots[i].key != 0) {
+        if (map->slots[i].key == key) return &map->slots[i] ;
+        i = (i + 1) & mask ;
+    }
+    return NULL ;
+}
+
+static inline conn_slot *conn_map_findPair(const conn_map *map, int32_t key, int32_t value) {
+    if (map->capacity == 0) return NULL ;
+    size_t mask = map->capacity - 1 ;
+    size_t i    = conn_hash(key, map->capacity) ;
+    while (map->slots[i].key != 0) {
+        if (map->slots[i].key == key && map->slots[i].value == value) return &map->slots[i] ;
+        i = (i + 1) & mask ;
+    }
+    return NULL ;
+}
+
+// copies up to max of the values stored for key into values and returns how many there are in all
+static inline size_t conn_map_values(const conn_map *map, int32_t key, int32_t *values, size_t max) {
+    if (map->capacity == 0) return 0 ;
+    size_t mask  = map->capacity - 1 ;
+    size_t count = 0 ;
+    for (size_t i = conn_hash(key, map->capacity) ; map->slots[i].key != 0 ; i = (i + 1) & mask) {
+        if (map->slots[i].key != key) continue ;
+        if (count < max) values[count] = map->slots[i].value ;
+        count++ ;
+    }
+    return count ;
+}
+
+// backward shift deletion: move later entries of the probe sequence into the gap when their home slot
+// is at or before it
+static inline void conn_map_removeSlot(conn_map *map, conn_slot *slot) {
+    size_t mask = map->capacity - 1 ;
+    size_t gap  = (size_t)(slot - map->slots) ;
+    size_t next = gap ;
+    while (true) {
+        next = (next + 1) & mask ;
+        if (map->slots[next].key == 0) break ;
+        size_t home = conn_hash(map->slots[next].key, map->capacity) ;
+        bool   move = (gap <= next) ? (home <= gap || home > next) : (home <= gap && home > next) ;
+        if (move) {
+            map->slots[gap] = map->slots[next] ;
+            gap             = next ;
+        }
+    }
+    map->slots[gap] = (conn_slot){ 0, 0 } ;
+    map->count-- ;
+}
+
+typedef struct {
+    conn_map connectionToPID ;
+    conn_map pidToConnection ; // may hold more than one entry per pid
+    uint64_t hits ;
+    uint64_t misses ;
+    uint64_t created ;
+    uint64_t died ;
+} conn_tracker ;
+
+// the tracker must start zeroed; starting it again discards whatever the tables held
+static inline bool conn_tracker_init(conn_tracker *tracker) {
+    return conn_map_init(&tracker->connectionToPID, CONN_MAP_INITIAL_CAPACITY) &&
+           conn_map_init(&tracker->pidToConnection, CONN_MAP_INITIAL_CAPACITY) ;
+}
+
+// empties the tables; the counters are kept
+static inline void conn_tracker_free(conn_tracker *tracker) {
+    conn_map_free(&tracker->connectionToPID) ;
+    conn_map_free(&tracker->pidToConnection) ;
+}
+
+// returns true if the connection is new or has changed owners
+static inline bool conn_tracker_created(conn_tracker *tracker, int32_t cid, int32_t pid) {
+    if (cid == 0 || pid == 0) return false ;
+    conn_slot *slot = conn_map_find(&tracker->connectionToPID, cid) ;
+    if (slot) {
+        if (slot->value == pid) return false ;
+        conn_slot *reverse = conn_map_findPair(&tracker->pidToConnection, slot->value, cid) ;
+        if (reverse) conn_map_removeSlot(&tracker->pidToConnection, reverse) ;
+    }
+    conn_map_insert(&tracker->connectionToPID, cid, pid, true) ;
+    conn_map_insert(&tracker->pidToConnection, pid, cid, false) ;
+    tracker->created++ ;
+    return true ;
+}
+
+// returns the pid which owned the connection, or 0 if it wasn't known
+static inline int32_t conn_tracker_died(conn_tracker *tracker, int32_t cid) {
+    conn_slot *slot = conn_map_find(&tracker->connectionToPID, cid) ;
+    if (!slot) return 0 ;
+    int32_t pid = slot->value ;
+    conn_map_removeSlot(&tracker->connectionToPID, slot) ;
+    conn_slot *reverse = conn_map_findPair(&tracker->pidToConnection, pid, cid) ;
+    if (reverse) conn_map_removeSlot(&tracker->pidToConnection, reverse) ;
+    tracker->died++ ;
+    return pid ;
+}
+
+// Removes up to max of the connections owned by a process which has terminated, copying their ids into
+// removed, and returns how many were removed. Call it until it returns 0; the caller may report each batch
+// before asking for the next, even if that changes the tables.
+static inline size_t conn_tracker_terminated(conn_tracker *tracker, int32_t pid, int32_t *removed, size_t max) {
+    size_t count = conn_map_values(&tracker->pidToConnection, pid, removed, max) ;
+    if (count > max) count = max ;
+    for (size_t i = 0 ; i < count ; i++) {
+        conn_slot *slot = conn_map_find(&tracker->connectionToPID, removed[i]) ;
+        if (slot && slot->value == pid) {
+            conn_map_removeSlot(&tracker->connectionToPID, slot) ;
+            tracker->died++ ;
+        }
+        conn_slot *reverse = conn_map_findPair(&tracker->pidToConnection, pid, removed[i]) ;
+        if (reverse) conn_map_removeSlot(&tracker->pidToConnection, reverse) ;
+    }
+    return count ;
+}
+
+// returns the pid which owns the connection, or 0 if the tables don't know it
+static inline int32_t conn_tracker_pidForConnection(conn_tracker *tracker, int32_t cid) {
+    conn_slot *slot = conn_map_find(&tracker->connectionToPID, cid) ;
+    if (slot) tracker->hits++ ; else tracker->misses++ ;
+    return slot ? slot->value : 0 ;
+}
+
+// like conn_map_values, for the connections owned by pid
+static inline size_t conn_tracker_connectionsForPID(conn_tracker *tracker, int32_t pid, int32_t *cids, size_t max) {
+    size_t count = conn_map_values(&tracker->pidToConnection, pid, cids, max) ;
+    if (count > 0) tracker->hits++ ; else tracker->misses++ ;
+    return count ;
+}
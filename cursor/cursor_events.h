@@ -0,0 +1,116 @@
+//
+// cursor_events.h
+// The queue and batching behind hs._asm.undocumented.cursor's change watcher
+//
+// Whenever the watcher is told the cursor may have changed, it compares the cursor seed with the last one
+// it saw and queues an event if they differ. Events go onto a fixed size lock-free single producer/single
+// consumer queue and are drained to Lua in batches on the main run loop, so a burst of changes results in
+// one callback. When the queue is full, new events are dropped and counted rather than blocking the
+// producer. Only the first event queued after a drain starts asks for another one to be scheduled.
+//
+// In internal.m the WindowServer notifications arrive on the main thread, but the polling fallback runs
+// on a queue of its own, so the producer and the consumer are on different threads when polling.
+// test/test_cursor_events.c and bench/bench_cursor_events.c push from one thread and drain from another.
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CURSOR_EVENT_QUEUE_SIZE 256 // must be a power of 2
+
+typedef struct {
+    int    seed ;
+    int    previousSeed ;
+    int    notification ; // 0 if the change was found by polling
+    double timestamp ;    // seconds since 1970
+} cursor_event ;
+
+typedef struct {
+    _Atomic uint64_t head ; // only written by the producer
+    _Atomic uint64_t tail ; // only written by the consumer
+    cursor_event     events[CURSOR_EVENT_QUEUE_SIZE] ;
+} cursor_eventQueue ;
+
+typedef struct {
+    cursor_eventQueue queue ;
+    _Atomic int       lastSeed ;       // only written by the producer, once started
+    _Atomic bool      drainScheduled ;
+    _Atomic uint64_t  events ;         // changes queued
+    _Atomic uint64_t  dropped ;        // changes lost because the queue was full
+    _Atomic uint64_t  delivered ;      // changes drained
+    _Atomic uint64_t  batches ;        // drains which found something
+} cursor_watcher ;
+
+static inline bool cursor_eventQueue_push(cursor_eventQueue *queue, cursor_event event) {
+    uint64_t head = atomic_load_explicit(&queue->head, memory_order_relaxed) ;
+    uint64_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire) ;
+    if (head - tail == CURSOR_EVENT_QUEUE_SIZE) return false ;
+    queue->events[head & (CURSOR_EVENT_QUEUE_SIZE - 1)] = event ;
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release) ;
+    return true ;
+}
+
+static inline bool cursor_eventQueue_pop(cursor_eventQueue *queue, cursor_event *event) {
+    uint64_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed) ;
+    uint64_t head = atomic_load_explicit(&queue->head, memory_order_acquire) ;
+    if (head == tail) return false ;
+    *event = queue->events[tail & (CURSOR_EVENT_QUEUE_SIZE - 1)] ;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release) ;
+    return true ;
+}
+
+// called before the producer starts, with the seed to compare the first check against
+static inline void cursor_watcher_start(cursor_watcher *watcher, int seed) {
+    atomic_store(&watcher->lastSeed, seed) ;
+}
+
+// Queues an event if seed differs from the last one seen. Returns true when the caller should schedule a
+// drain; false if nothing changed or a drain is already scheduled.
+static inline bool cursor_watcher_check(cursor_watcher *watcher, int seed, int notification, double timestamp) {
+    int previous = atomic_exchange_explicit(&watcher->lastSeed, seed, memory_order_relaxed) ;
+    if (seed == previous) return false ;
+
+    cursor_event event = {
+        .seed         = seed,
+        .previousSeed = previous,
+        .notification = notification,
+        .timestamp    = timestamp,
+    } ;
+    if (cursor_eventQueue_push(&watcher->queue, event)) {
+        atomic_fetch_add_explicit(&watcher->events, 1, memory_order_relaxed) ;
+    } else {
+        atomic_fetch_add_explicit(&watcher->dropped, 1, memory_order_relaxed) ;
+    }
+    return !atomic_exchange(&watcher->drainScheduled, true) ;
+}
+
+// Moves up to max queued events into batch and returns how many. The scheduled flag is cleared first, so
+// an event queued while the batch is delivered schedules another drain rather than waiting for the next
+// change. With a max below CURSOR_EVENT_QUEUE_SIZE, a drain which returns max should be followed by another.
+static inline size_t cursor_watcher_drain(cursor_watcher *watcher, cursor_event *batch, size_t max) {
+    atomic_store(&watcher->drainScheduled, false) ;
+    size_t count = 0 ;
+    while (count < max && cursor_eventQueue_pop(&watcher->queue, &batch[count])) count++ ;
+    if (count > 0) {
+        atomic_fetch_add_explicit(&watcher->delivered, count, memory_order_relaxed) ;
+        atomic_fetch_add_explicit(&watcher->batches, 1, memory_order_relaxed) ;
+    }
+    return count ;
+}
+
+// drops everything queued, as when there is no callback to deliver it to
+static inline void cursor_watcher_discard(cursor_watcher *watcher) {
+    atomic_store(&watcher->drainScheduled, false) ;
+    cursor_event event ;
+    while (cursor_eventQueue_pop(&watcher->queue, &event)) ;
+}
+
+static inline void cursor_watcher_resetCounters(cursor_watcher *watcher) {
+    atomic_store(&watcher->events, 0) ;
+    atomic_store(&watcher->dropped, 0) ;
+    atomic_store(&watcher->delivered, 0) ;
+    atomic_store(&watcher->batches, 0) ;
+}
@@ -0,0 +1,197 @@
+//
+// cursor_pixels.h
+// The buffer pool and pixel conversion behind hs._asm.undocumented.cursor.capture
+//
+// Cursor images are captured into buffers which are reused rather than allocated for each capture; a
+// buffer is returned to the pool when the image backed by it is collected. The WindowServer writes
+// premultiplied ARGB, which is converted in place to straight RGBA so the buffer the SPI filled is the
+// same one the image object exposes.
+//
+// Neither part depends on the SPI: capture.m supplies an os_unfair_lock through the pool's lock hooks, and
+// test/test_cursor_pixels.c and bench/bench_cursor_pixels.c drive both with pthreads on Linux.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define CURSOR_POOL_MAX_BUFFERS 8
+#define CURSOR_BUFFER_ROUNDING  4096
+
+typedef struct cursor_buffer {
+    struct cursor_buffer *next ;
+    size_t               capacity ;
+    uint8_t              bytes[] ;
+} cursor_buffer ;
+
+// The pool may be used from any thread -- the last reference to an image may be held by a CGImage -- so
+// every change to it is made while holding the caller's lock, if the hooks are set.
+typedef struct {
+    cursor_buffer *buffers ;
+    size_t        pooled ;
+    size_t        maxBuffers ;
+    uint64_t      allocated ;
+    uint64_t      reused ;
+    uint64_t      discarded ;
+
+    void          (*lock)(void *context) ;
+    void          (*unlock)(void *context) ;
+    void          *lockContext ;
+} cursor_pool ;
+
+static inline void cursor_pool_init(cursor_pool *pool, size_t maxBuffers) {
+    pool->buffers     = NULL ;
+    pool->pooled      = 0 ;
+    pool->maxBuffers  = maxBuffers ;
+    pool->allocated   = 0 ;
+    pool->reused      = 0 ;
+    pool->discarded   = 0 ;
+    pool->lock        = NULL ;
+    pool->unlock      = NULL ;
+    pool->lockContext = NULL ;
+}
+
+static inline void cursor_pool_lock(cursor_pool *pool) {
+    if (pool->lock) pool->lock(pool->lockContext) ;
+}
+
+static inline void cursor_pool_unlock(cursor_pool *pool) {
+    if (pool->unlock) pool->unlock(pool->lockContext) ;
+}
+
+// returns the first pooled buffer large enough for length bytes, or a new one rounded up to a whole number
+// of pages; NULL only if the allocation fails
+static inline cursor_buffer *cursor_pool_acquire(cursor_pool *pool, size_t length) {
+    cursor_pool_lock(pool) ;
+    cursor_buffer **link = &pool->buffers ;
+    while (*link && (*link)->capacity < length) link = &(*link)->next ;
+    cursor_buffer *buffer = *link ;
+    if (buffer) {
+        *link = buffer->next ;
+        pool->pooled-- ;
+        pool->reused++ ;
+    } else {
+        pool->allocated++ ;
+    }
+    cursor_pool_unlock(pool) ;
+
+    if (!buffer) {
+        size_t capacity = (length + CURSOR_BUFFER_ROUNDING - 1) & ~(size_t)(CURSOR_BUFFER_ROUNDING - 1) ;
+        buffer = malloc(sizeof(cursor_buffer) + capacity) ;
+        if (buffer) buffer->capacity = capacity ;
+    }
+    if (buffer) buffer->next = NULL ;
+    return buffer ;
+}
+
+// keeps the buffer for reuse, or frees it if the pool is full
+static inline void cursor_pool_release(cursor_pool *pool, cursor_buffer *buffer) {
+    if (!buffer) return ;
+    cursor_pool_lock(pool) ;
+    bool keep = (pool->pooled < pool->maxBuffers) ;
+    if (keep) {
+        buffer->next  = pool->buffers ;
+        pool->buffers = buffer ;
+        pool->pooled++ ;
+    } else {
+        pool->discarded++ ;
+    }
+    cursor_pool_unlock(pool) ;
+    if (!keep) free(buffer) ;
+}
+
+static inline void cursor_pool_drain(cursor_pool *pool) {
+    cursor_pool_lock(pool) ;
+    cursor_buffer *buffer = pool->buffers ;
+    pool->buffers = NULL ;
+    pool->pooled  = 0 ;
+    cursor_pool_unlock(pool) ;
+    while (buffer) {
+        cursor_buffer *next = buffer->next ;
+        free(buffer) ;
+        buffer = next ;
+    }
+}
+
+// straight = premultiplied * 255 / alpha, computed as a multiply by a 16.16 reciprocal
+static uint32_t cursor_unpremultiplyTable[256] ;
+
+static inline void cursor_buildUnpremultiplyTable(void) {
+    cursor_unpremultiplyTable[0] = 0 ;
+    for (uint32_t alpha = 1 ; alpha < 256 ; alpha++) {
+        cursor_unpremultiplyTable[alpha] = (255U * 65536U + alpha / 2) / alpha ;
+    }
+}
+
+static inline void cursor_convertPixel(const uint8_t *src, uint8_t *dst) {
+    uint8_t  alpha = src[0] ;
+    uint32_t scale = cursor_unpremultiplyTable[alpha] ;
+    uint32_t red   = (src[1] * scale + 32768) >> 16 ;
+    uint32_t green = (src[2] * scale + 32768) >> 16 ;
+    uint32_t blue  = (src[3] * scale + 32768) >> 16 ;
+    dst[0] = (uint8_t)(red   > 255 ? 255 : red) ;
+    dst[1] = (uint8_t)(green > 255 ? 255 : green) ;
+    dst[2] = (uint8_t)(blue  > 255 ? 255 : blue) ;
+    dst[3] = alpha ;
+}
+
+static inline void cursor_convertScalar(const uint8_t *src, uint8_t *dst, size_t pixels) {
+    for (size_t i = 0 ; i < pixels ; i++) cursor_convertPixel(src + i * 4, dst + i * 4) ;
+}
+
+// Converts premultiplied ARGB to straight RGBA; src and dst may be the same buffer. Most of a cursor is
+// either fully opaque or fully transparent, so the vector paths handle blocks where every pixel is one or
+// the other with a single shuffle (or store of zeros) and only fall back to the per pixel divide for
+// blocks containing partially transparent pixels. cursor_buildUnpremultiplyTable must have been called.
+static inline void cursor_unpremultiply(const uint8_t *src, uint8_t *dst, size_t pixels) {
+    size_t i = 0 ;
+#if defined(__SSSE3__)
+    const __m128i alphaMask = _mm_set1_epi32((int)0x000000FF) ; // alpha is the first byte of each pixel
+    const __m128i toRGBA    = _mm_setr_epi8(1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12) ;
+    for ( ; i + 4 <= pixels ; i += 4) {
+        __m128i argb  = _mm_loadu_si128((const __m128i *)(const void *)(src + i * 4)) ;
+        __m128i alpha = _mm_and_si128(argb, alphaMask) ;
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(alpha, alphaMask)) == 0xFFFF) {
+            _mm_storeu_si128((__m128i *)(void *)(dst + i * 4), _mm_shuffle_epi8(argb, toRGBA)) ;
+        } else if (_mm_movemask_epi8(_mm_cmpeq_epi8(alpha, _mm_setzero_si128())) == 0xFFFF) {
+            _mm_storeu_si128((__m128i *)(void *)(dst + i * 4), _mm_setzero_si128()) ;
+        } else {
+            cursor_convertScalar(src + i * 4, dst + i * 4, 4) ;
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for ( ; i + 16 <= pixels ; i += 16) {
+        uint8x16x4_t argb = vld4q_u8(src + i * 4) ; // de-interleaves into alpha, red, green, blue planes
+        if (vminvq_u8(argb.val[0]) == 255) {
+            uint8x16x4_t rgba = { { argb.val[1], argb.val[2], argb.val[3], argb.val[0] } } ;
+            vst4q_u8(dst + i * 4, rgba) ;
+        } else if (vmaxvq_u8(argb.val[0]) == 0) {
+            uint8x16_t   zero = vdupq_n_u8(0) ;
+            uint8x16x4_t rgba = { { zero, zero, zero, zero } } ;
+            vst4q_u8(dst + i * 4, rgba) ;
+        } else {
+            cursor_convertScalar(src + i * 4, dst + i * 4, 16) ;
+        }
+    }
+#endif
+    cursor_convertScalar(src + i * 4, dst + i * 4, pixels - i) ;
+}
+
+// converts an image in place; rows may be padded beyond pixelsWide * 4 bytes
+static inline void cursor_unpremultiplyImage(uint8_t *bytes, size_t rowBytes, size_t pixelsWide, size_t pixelsHigh) {
+    if (rowBytes == pixelsWide * 4) {
+        cursor_unpremultiply(bytes, bytes, pixelsWide * pixelsHigh) ;
+    } else {
+        for (size_t row = 0 ; row < pixelsHigh ; row++) {
+            cursor_unpremultiply(bytes + row * rowBytes, bytes + row * rowBytes, pixelsWide) ;
+        }
+    }
+}
@@ -0,0 +1,189 @@
+//
+// cursor_playback.h
+// The path timing and tick loop behind hs._asm.undocumented.cursor.playPath
+//
+// A path is an array of line and cubic bezier segments with absolute start and end times. Each tick
+// computes where the cursor should be at that moment on the path -- rather than stepping by a fixed
+// amount -- so a late tick never slows the path down, and records how late it woke so the timing error can
+// be reported when the playback completes or is cancelled.
+//
+// The clock, the wait and the warp come from a cursor_playbackDriver, so internal.m plays paths on
+// mach_absolute_time with CGSWarpCursorPosition while test/test_cursor_playback.c plays them on a simulated
+// clock and records where the cursor was sent.
+
+#pragma once
+
+#include "hsasm_portable.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define CURSOR_PLAYBACK_RATE       120.0
+#define CURSOR_PLAYBACK_MAX_RATE   1000.0
+#define CURSOR_PLAYBACK_DURATION   1.0
+#define CURSOR_PLAYBACK_MAX_ERRORS 100000
+#define CURSOR_BEZIER_LENGTH_STEPS 16
+
+typedef struct {
+    CGPoint p0, c1, c2, p1 ;
+    bool    curve ;
+    double  start, end ; // seconds from the start of playback
+} cursor_pathSegment ;
+
+typedef struct {
+    // the clock in ticks of its own, and the conversion of a number of them to seconds
+    uint64_t (*now)(void *context) ;
+    double   (*seconds)(void *context, uint64_t ticks) ;
+    void     (*waitUntil)(void *context, uint64_t deadline) ;
+    void     (*warp)(void *context, CGPoint point) ;
+    void     *context ;
+} cursor_playbackDriver ;
+
+typedef struct {
+    _Atomic bool cancelled ;
+    double       *errors ;      // how late each tick woke, in seconds
+    size_t       errorCount ;
+    size_t       errorCapacity ;
+    uint64_t     ticks ;
+    double       elapsed ;
+} cursor_playback ;
+
+static inline CGPoint cursor_pointOnSegment(const cursor_pathSegment *segment, double t) {
+    if (!segment->curve) {
+        return (CGPoint){ segment->p0.x + (segment->p1.x - segment->p0.x) * t,
+                          segment->p0.y + (segment->p1.y - segment->p0.y) * t } ;
+    }
+    double u = 1 - t ;
+    double a = u * u * u, b = 3 * u * u * t, c = 3 * u * t * t, d = t * t * t ;
+    return (CGPoint){ a * segment->p0.x + b * segment->c1.x + c * segment->c2.x + d * segment->p1.x,
+                      a * segment->p0.y + b * segment->c1.y + c * segment->c2.y + d * segment->p1.y } ;
+}
+
+// curves are measured as CURSOR_BEZIER_LENGTH_STEPS chords
+static inline double cursor_segmentLength(const cursor_pathSegment *segment) {
+    int     steps    = segment->curve ? CURSOR_BEZIER_LENGTH_STEPS : 1 ;
+    double  length   = 0 ;
+    CGPoint previous = segment->p0 ;
+    for (int i = 1 ; i <= steps ; i++) {
+        CGPoint point = cursor_pointOnSegment(segment, (double)i / steps) ;
+        length  += hypot(point.x - previous.x, point.y - previous.y) ;
+        previous = point ;
+    }
+    return length ;
+}
+
+// Sets the start and end of each segment from durations, where a negative duration is a segment without
+// its own: the overall duration, less the time claimed by those with their own, is shared out between
+// them by length, or equally when they have no length at all. Returns the end of the last segment.
+static inline double cursor_path_assignTimes(cursor_pathSegment *segments, const double *durations, size_t count, double duration) {
+    double fixedTime = 0, sharedLength = 0 ;
+    size_t sharedCount = 0 ;
+    for (size_t i = 0 ; i < count ; i++) {
+        if (durations[i] >= 0) {
+            fixedTime += durations[i] ;
+        } else {
+            sharedLength += cursor_segmentLength(&segments[i]) ;
+            sharedCount++ ;
+        }
+    }
+    double remaining = (duration > fixedTime) ? duration - fixedTime : 0.0 ;
+    double time      = 0 ;
+    for (size_t i = 0 ; i < count ; i++) {
+        double span = durations[i] ;
+        if (span < 0) {
+            span = (sharedLength > 0) ? remaining * cursor_segmentLength(&segments[i]) / sharedLength
+                                      : remaining / (double)sharedCount ;
+        }
+        segments[i].start = time ;
+        time             += span ;
+        segments[i].end   = time ;
+    }
+    return time ;
+}
+
+// The point t seconds into the path. *index is the segment the previous call ended on; as playback only
+// moves forward, the search starts there. A segment without a span is passed straight to its end.
+static inline CGPoint cursor_path_pointAt(const cursor_pathSegment *segments, size_t count, double t, size_t *index) {
+    while (*index < count - 1 && t >= segments[*index].end) (*index)++ ;
+    const cursor_pathSegment *segment = &segments[*index] ;
+    double span     = segment->end - segment->start ;
+    double fraction = 1.0 ;
+    if (span > 0) fraction = fmin(fmax((t - segment->start) / span, 0.0), 1.0) ;
+    return cursor_pointOnSegment(segment, fraction) ;
+}
+
+// How many tick errors to keep for a path of duration seconds at rate ticks per second. The product is
+// clamped while it is still a double, since converting one beyond the range of size_t is undefined.
+static inline size_t cursor_playback_errorCapacity(double duration, double rate) {
+    double wanted = duration * rate + 2 ;
+    if (!(wanted < (double)CURSOR_PLAYBACK_MAX_ERRORS)) return CURSOR_PLAYBACK_MAX_ERRORS ;
+    return (size_t)wanted ;
+}
+
+static inline bool cursor_playback_init(cursor_playback *playback, double duration, double rate) {
+    *playback = (cursor_playback){ .errorCount = 0 } ;
+    atomic_init(&playback->cancelled, false) ;
+    playback->errorCapacity = cursor_playback_errorCapacity(duration, rate) ;
+    playback->errors        = malloc(playback->errorCapacity * sizeof(double)) ;
+    return playback->errors != NULL ;
+}
+
+static inline void cursor_playback_free(cursor_playback *playback) {
+    free(playback->errors) ;
+    playback->errors        = NULL ;
+    playback->errorCount    = 0 ;
+    playback->errorCapacity = 0 ;
+}
+
+// may be called from any thread; the loop stops before its next warp
+static inline void cursor_playback_cancel(cursor_playback *playback) {
+    atomic_store(&playback->cancelled, true) ;
+}
+
+// Plays the path every period ticks until it ends or is cancelled. A late tick is not repeated -- the next
+// one is scheduled on the original timeline.
+static inline void cursor_playback_run(cursor_playback *playback, const cursor_pathSegment *segments, size_t count,
+                                       uint64_t period, const cursor_playbackDriver *driver) {
+    double   duration = segments[count - 1].end ;
+    uint64_t start    = driver->now(driver->context) ;
+    uint64_t next     = start ;
+    size_t   index    = 0 ;
+
+    while (!atomic_load(&playback->cancelled)) {
+        driver->waitUntil(driver->context, next) ;
+        uint64_t now  = driver->now(driver->context) ;
+        double   late = (now > next) ? driver->seconds(driver->context, now - next) : 0.0 ;
+        if (playback->errors && playback->errorCount < playback->errorCapacity) playback->errors[playback->errorCount++] = late ;
+        playback->ticks++ ;
+
+        double t = driver->seconds(driver->context, now - start) ;
+        driver->warp(driver->context, cursor_path_pointAt(segments, count, t, &index)) ;
+
+        if (t >= duration) break ;
+        next += period ;
+        if (now > next) next += ((now - next) / period + 1) * period ;
+    }
+    playback->elapsed = driver->seconds(driver->context, driver->now(driver->context) - start) ;
+}
+
+static inline int cursor_compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b ;
+    return (x > y) - (x < y) ;
+}
+
+// the mean, 99th percentile and largest tick error in seconds; sorts the errors in place
+static inline void cursor_playback_errorStats(cursor_playback *playback, double *mean, double *p99, double *max) {
+    *mean = *p99 = *max = 0 ;
+    size_t count = playback->errorCount ;
+    if (count == 0) return ;
+    for (size_t i = 0 ; i < count ; i++) *mean += playback->errors[i] ;
+    *mean /= (double)count ;
+    qsort(playback->errors, count, sizeof(double), cursor_compareDoubles) ;
+    size_t rank = (size_t)((double)count * 0.99) ;
+    *p99 = playback->errors[(rank < count) ? rank : count - 1] ;
+    *max = playback->errors[count - 1] ;
+}
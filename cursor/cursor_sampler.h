@@ -0,0 +1,184 @@
+//
+// cursor_sampler.h
+// The ring, schedule and derivatives behind hs._asm.undocumented.cursor's position sampler
+//
+// A dedicated thread samples the position on a fixed schedule and writes timestamped samples into a
+// fixed capacity lock-free single producer/single consumer ring, which Lua drains all at once. If Lua
+// doesn't drain often enough, new samples are dropped and counted as overruns rather than blocking the
+// sampler thread; if the thread falls a full period behind, the missed ticks are skipped and counted
+// rather than sampled in a burst to catch up.
+//
+// The clock, the wait and the position come from a cursor_samplerSource, so internal.m samples
+// CGSGetCurrentCursorLocation on mach_absolute_time while test/test_cursor_sampler.c drives the same loop
+// with a simulated clock and a computed path.
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define CURSOR_SAMPLER_RATE         240.0
+#define CURSOR_SAMPLER_MAX_RATE     2000.0
+#define CURSOR_SAMPLER_CAPACITY     4096
+// a million samples is over an hour at the default rate, and 24MB
+#define CURSOR_SAMPLER_MAX_CAPACITY (1 << 20)
+
+typedef struct {
+    double timestamp ;
+    double x ;
+    double y ;
+} cursor_sample ;
+
+typedef struct {
+    _Atomic uint64_t head ;     // only written by the sampler thread
+    _Atomic uint64_t tail ;     // only written by the draining thread
+    size_t           capacity ; // a power of 2
+    cursor_sample    *samples ;
+} cursor_sampleRing ;
+
+typedef struct {
+    // the clock in ticks of its own, and their conversion to seconds for the timestamps
+    uint64_t (*now)(void *context) ;
+    double   (*seconds)(void *context, uint64_t ticks) ;
+    void     (*waitUntil)(void *context, uint64_t deadline) ;
+    // false when the position couldn't be read; the tick is then skipped
+    bool     (*position)(void *context, double *x, double *y) ;
+    void     *context ;
+} cursor_samplerSource ;
+
+typedef struct {
+    cursor_sampleRing ring ;
+    _Atomic bool      running ;
+    _Atomic uint64_t  taken ;
+    _Atomic uint64_t  overruns ;
+    _Atomic uint64_t  late ;     // ticks skipped because the thread fell behind
+} cursor_sampler ;
+
+// the most recent drained sample and velocity, so derivatives are continuous across drains
+typedef struct {
+    cursor_sample previous ;
+    double        vx, vy ;
+    bool          hasPrevious ;
+    bool          hasVelocity ;
+} cursor_derivatives ;
+
+// Sizes the ring for at least capacity samples, rounded up to a power of 2, and empties it. Returns the
+// size, or 0 when capacity is less than 2 or more than CURSOR_SAMPLER_MAX_CAPACITY or the samples can't be
+// allocated, in which case the ring is left as it was. Only call this while the sampler isn't running.
+static inline size_t cursor_sampleRing_reserve(cursor_sampleRing *ring, uint64_t capacity) {
+    if (capacity < 2 || capacity > CURSOR_SAMPLER_MAX_CAPACITY) return 0 ;
+    size_t size = 2 ;
+    while (size < capacity) size <<= 1 ;
+    if (size != ring->capacity) {
+        if (size > SIZE_MAX / sizeof(cursor_sample)) return 0 ;
+        cursor_sample *samples = realloc(ring->samples, size * sizeof(cursor_sample)) ;
+        if (!samples) return 0 ;
+        ring->samples  = samples ;
+        ring->capacity = size ;
+    }
+    atomic_store(&ring->head, 0) ;
+    atomic_store(&ring->tail, 0) ;
+    return size ;
+}
+
+static inline void cursor_sampleRing_free(cursor_sampleRing *ring) {
+    free(ring->samples) ;
+    ring->samples  = NULL ;
+    ring->capacity = 0 ;
+    atomic_store(&ring->head, 0) ;
+    atomic_store(&ring->tail, 0) ;
+}
+
+// called by the sampler thread only; false when the ring is full
+static inline bool cursor_sampleRing_push(cursor_sampleRing *ring, cursor_sample sample) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed) ;
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire) ;
+    if (head - tail >= ring->capacity) return false ;
+    ring->samples[head & (ring->capacity - 1)] = sample ;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release) ;
+    return true ;
+}
+
+// Draining is three steps so the caller can convert the samples in place: cursor_sampleRing_pending gives
+// the range [*tail, head) which is safe to read with cursor_sampleRing_at until cursor_sampleRing_release
+// hands it back to the sampler thread. Called by the draining thread only.
+static inline uint64_t cursor_sampleRing_pending(cursor_sampleRing *ring, uint64_t *tail) {
+    *tail = atomic_load_explicit(&ring->tail, memory_order_relaxed) ;
+    return atomic_load_explicit(&ring->head, memory_order_acquire) - *tail ;
+}
+
+static inline cursor_sample cursor_sampleRing_at(const cursor_sampleRing *ring, uint64_t index) {
+    return ring->samples[index & (ring->capacity - 1)] ;
+}
+
+static inline void cursor_sampleRing_release(cursor_sampleRing *ring, uint64_t head) {
+    atomic_store_explicit(&ring->tail, head, memory_order_release) ;
+}
+
+// Returns the deadline after next. If now is already past it, the thread has fallen at least a full period
+// behind: the missed ticks are added to *missed and the deadline moves to the first one still ahead, so the
+// samples stay on the original schedule.
+static inline uint64_t cursor_sampler_schedule(uint64_t next, uint64_t now, uint64_t period, uint64_t *missed) {
+    next += period ;
+    if (now > next) {
+        uint64_t skipped = (now - next) / period + 1 ;
+        *missed += skipped ;
+        next    += skipped * period ;
+    }
+    return next ;
+}
+
+// Samples once, then waits for the next tick; returns its deadline.
+static inline uint64_t cursor_sampler_tick(cursor_sampler *sampler, const cursor_samplerSource *source, uint64_t next, uint64_t period) {
+    double   x, y ;
+    uint64_t now = source->now(source->context) ;
+    if (source->position(source->context, &x, &y)) {
+        cursor_sample sample = { .timestamp = source->seconds(source->context, now), .x = x, .y = y } ;
+        if (cursor_sampleRing_push(&sampler->ring, sample)) {
+            atomic_fetch_add_explicit(&sampler->taken, 1, memory_order_relaxed) ;
+        } else {
+            atomic_fetch_add_explicit(&sampler->overruns, 1, memory_order_relaxed) ;
+        }
+    }
+    uint64_t missed = 0 ;
+    next = cursor_sampler_schedule(next, source->now(source->context), period, &missed) ;
+    if (missed) atomic_fetch_add_explicit(&sampler->late, missed, memory_order_relaxed) ;
+    source->waitUntil(source->context, next) ;
+    return next ;
+}
+
+// The sampler thread's loop: samples every period ticks until running is cleared.
+static inline void cursor_sampler_run(cursor_sampler *sampler, const cursor_samplerSource *source, uint64_t period) {
+    uint64_t next = source->now(source->context) ;
+    while (atomic_load_explicit(&sampler->running, memory_order_relaxed)) {
+        next = cursor_sampler_tick(sampler, source, next, period) ;
+    }
+}
+
+static inline void cursor_derivatives_reset(cursor_derivatives *state) {
+    *state = (cursor_derivatives){ .hasPrevious = false } ;
+}
+
+// Fills out with vx, vy, ax and ay for the next drained sample, from backward differences against the
+// samples before it. They are 0 until there are enough samples, and a sample with the same timestamp as
+// the one before it repeats no velocity and no acceleration.
+static inline void cursor_derivatives_next(cursor_derivatives *state, const cursor_sample *sample, double out[4]) {
+    out[0] = out[1] = out[2] = out[3] = 0 ;
+    double dt = state->hasPrevious ? sample->timestamp - state->previous.timestamp : 0 ;
+    if (dt > 0) {
+        out[0] = (sample->x - state->previous.x) / dt ;
+        out[1] = (sample->y - state->previous.y) / dt ;
+        if (state->hasVelocity) {
+            out[2] = (out[0] - state->vx) / dt ;
+            out[3] = (out[1] - state->vy) / dt ;
+        }
+        state->vx          = out[0] ;
+        state->vy          = out[1] ;
+        state->hasVelocity = true ;
+    }
+    state->previous    = *sample ;
+    state->hasPrevious = true ;
+}
@@ -0,0 +1,88 @@
+//
+// cursor_sets.h
+// The digest which decides whether hs._asm.undocumented.cursor.registerCursorSet can skip a registration
+//
+// Registering a set of frames with the WindowServer is slow, so registerCursorSet remembers what it
+// registered under each name and skips the call when the same frames and options are registered under that
+// name again. "The same" is decided by a digest of the options and of every frame's pixels, so changing any
+// frame, its size or an option such as the frame duration registers the set again without needing `force`.
+//
+// The pixels are hashed a word at a time rather than a byte at a time, since a set of animated retina frames
+// is tens of kilobytes. The digest isn't cryptographic; a collision would only mean a changed set is not
+// registered until it is forced. internal.m hashes the bitmaps of the CGImages it would register;
+// test/test_cursor_sets.c and bench/bench_cursor_sets.c hash the mock backend's generated images.
+
+#pragma once
+
+#include "hsasm_portable.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define CURSOR_SET_PRIME 0x100000001B3ULL
+
+typedef struct {
+    bool      global ;
+    double    frameDuration ;
+    NSInteger repeatCount ;
+    CGPoint   hotSpot ;
+    CGSize    size ;
+    size_t    frameCount ;
+} cursor_setOptions ;
+
+static inline uint64_t cursor_setDigest_word(uint64_t digest, uint64_t word) {
+    return (digest ^ word) * CURSOR_SET_PRIME ;
+}
+
+static inline uint64_t cursor_setDigest_double(uint64_t digest, double value) {
+    uint64_t bits ;
+    if (value == 0.0) value = 0.0 ; // -0.0 and 0.0 are the same option
+    memcpy(&bits, &value, sizeof(bits)) ;
+    return cursor_setDigest_word(digest, bits) ;
+}
+
+// the digest of the options, to which each frame is then added in order
+static inline uint64_t cursor_setDigest_begin(const cursor_setOptions *options) {
+    uint64_t digest = 0xCBF29CE484222325ULL ;
+    digest = cursor_setDigest_word(digest, options->global) ;
+    digest = cursor_setDigest_double(digest, options->frameDuration) ;
+    digest = cursor_setDigest_word(digest, (uint64_t)options->repeatCount) ;
+    digest = cursor_setDigest_double(digest, options->hotSpot.x) ;
+    digest = cursor_setDigest_double(digest, options->hotSpot.y) ;
+    digest = cursor_setDigest_double(digest, options->size.width) ;
+    digest = cursor_setDigest_double(digest, options->size.height) ;
+    return cursor_setDigest_word(digest, options->frameCount) ;
+}
+
+// Adds a frame of height rows of rowBytes each. Only the first width * bytesPerPixel bytes of a row are
+// pixels; the padding after them is left out, since two bitmaps of the same image may pad differently.
+static inline uint64_t cursor_setDigest_addFrame(uint64_t digest, const uint8_t *bytes, size_t width, size_t height,
+                                                 size_t rowBytes, size_t bytesPerPixel) {
+    size_t length = width * bytesPerPixel ;
+    digest = cursor_setDigest_word(digest, width) ;
+    digest = cursor_setDigest_word(digest, height) ;
+    for (size_t y = 0 ; y < height ; y++) {
+        const uint8_t *row = bytes + y * rowBytes ;
+        size_t        i    = 0 ;
+        for ( ; i + 8 <= length ; i += 8) {
+            uint64_t word ;
+            memcpy(&word, row + i, sizeof(word)) ;
+            digest = cursor_setDigest_word(digest, word) ;
+        }
+        if (i < length) {
+            uint64_t word = 0 ;
+            memcpy(&word, row + i, length - i) ;
+            digest = cursor_setDigest_word(digest, word) ;
+        }
+    }
+    return digest ;
+}
+
+// the final mix, so that digests which differ only in their last word differ in every bit
+static inline uint64_t cursor_setDigest_end(uint64_t digest) {
+    digest = (digest ^ (digest >> 30)) * 0xBF58476D1CE4E5B9ULL ;
+    digest = (digest ^ (digest >> 27)) * 0x94D049BB133111EBULL ;
+    return digest ^ (digest >> 31) ;
+}
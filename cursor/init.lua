@@ -5,12 +5,34 @@
 --- A description of module.
 
 
+-- when the combined library built by the Makefile at the top of this repository is installed, it provides the
+-- internal modules through package.preload
+if not package.preload["hs._asm.undocumented.cursor.internal"] and package.searchpath("hs._asm.undocumented.combined", package.cpath) then
+    require("hs._asm.undocumented.combined")
+end
+
 local module      = require("hs._asm.undocumented.cursor.internal")
 
 -- private variables and methods -----------------------------------------
 
 -- Public interface ------------------------------------------------------
 
+-- fields which are built or loaded the first time they are used rather than when this module is loaded
+local _lazyFields = {
+    systemCursors = function() return module._systemCursors() end,
+    capture       = function() return require("hs._asm.undocumented.cursor.capture") end,
+    connections   = function() return require("hs._asm.undocumented.cursor.connections") end,
+}
+
+getmetatable(module).__index = function(self, key)
+    local builder = _lazyFields[key]
+    if builder then
+        local value = builder()
+        rawset(self, key, value)
+        return value
+    end
+end
+
 -- Return Module Object --------------------------------------------------
 
 return module
@@ -1,90 +1,842 @@
 #import <Cocoa/Cocoa.h>
 #import <LuaSkin/LuaSkin.h>
+#import <stdatomic.h>
+#import <pthread.h>
+#import <mach/mach_time.h>
 #import "CGSCursor.h"
+#import "hsasm_spi.h"
+#import "hsasm_constants.h"
+#import "hsasm_mock.h"
+#import "hsasm_checkargs.h"
+#import "cursor_backend.h"
+#import "cursor_events.h"
+#import "cursor_playback.h"
+#import "cursor_sampler.h"
+#import "cursor_sets.h"
 
 extern CGSConnectionID _CGSDefaultConnection(void) ;
 #define CGSDefaultConnection _CGSDefaultConnection()
 
 // #define USERDATA_TAG        "hs.module"
-int refTable ;
+static int refTable = LUA_NOREF ;
 
 // #define get_objectFromUserdata(objType, L, idx) (objType*)*((void**)luaL_checkudata(L, idx, USERDATA_TAG))
 // #define get_structFromUserdata(objType, L, idx) ((objType *)luaL_checkudata(L, idx, USERDATA_TAG))
 
+// the cursor functions this module calls, or the mock in cursor_backend.h
+static const cursor_backend cursor_nativeBackend = {
+    "native",
+    CGSShowCursor,
+    CGSHideCursor,
+    CGSObscureCursor,
+    CGSRevealCursor,
+    CGSForceWaitCursorActive,
+    CGSCurrentCursorSeed,
+    CGSCursorNameForSystemCursor,
+    CGSSetCursorScale,
+    CGSGetCursorScale,
+    CGSGetCurrentCursorLocation,
+    CGSWarpCursorPosition,
+    CGSRegisterCursorWithImages,
+    CGSSetRegisteredCursor,
+    CGSGetRegisteredCursorDataSize,
+    CGSCopyRegisteredCursorImages
+} ;
+
+// only changed while the sampler, playback and watcher polling threads are stopped
+static const cursor_backend *cgs = &cursor_nativeBackend ;
+
 static int showCursor(lua_State *L) {
-    [[LuaSkin shared] checkArgs:LS_TBREAK] ;
-    CGError state = CGSShowCursor(CGSDefaultConnection) ;
+    HSASM_CHECKARGS(L, LS_TBREAK) ;
+    CGError state = HSASM_SPI_ERROR("CGSShowCursor", cgs->showCursor(CGSDefaultConnection)) ;
     if (state != kCGErrorSuccess) return luaL_error(L, "showCursor:error %d", state) ;
     return 0 ;
 }
 
 static int hideCursor(lua_State *L) {
-    [[LuaSkin shared] checkArgs:LS_TBREAK] ;
-    CGError state = CGSHideCursor(CGSDefaultConnection) ;
+    HSASM_CHECKARGS(L, LS_TBREAK) ;
+    CGError state = HSASM_SPI_ERROR("CGSHideCursor", cgs->hideCursor(CGSDefaultConnection)) ;
     if (state != kCGErrorSuccess) return luaL_error(L, "hideCursor:error %d", state) ;
     return 0 ;
 }
 
 static int obscureCursor(lua_State *L) {
-    [[LuaSkin shared] checkArgs:LS_TBREAK] ;
-    CGError state = CGSObscureCursor(CGSDefaultConnection) ;
+    HSASM_CHECKARGS(L, LS_TBREAK) ;
+    CGError state = HSASM_SPI_ERROR("CGSObscureCursor", cgs->obscureCursor(CGSDefaultConnection)) ;
     if (state != kCGErrorSuccess) return luaL_error(L, "obscureCursor:error %d", state) ;
     return 0 ;
 }
 
 static int revealCursor(lua_State *L) {
-    [[LuaSkin shared] checkArgs:LS_TBREAK] ;
-    CGError state = CGSRevealCursor(CGSDefaultConnection) ;
+    HSASM_CHECKARGS(L, LS_TBREAK) ;
+    CGError state = HSASM_SPI_ERROR("CGSRevealCursor", cgs->revealCursor(CGSDefaultConnection)) ;
     if (state != kCGErrorSuccess) return luaL_error(L, "revealCursor:error %d", state) ;
     return 0 ;
 }
 
 static int waitCursor(lua_State *L) {
-    [[LuaSkin shared] checkArgs:LS_TBOOLEAN, LS_TBREAK] ;
-    CGError state = CGSForceWaitCursorActive(CGSDefaultConnection, lua_toboolean(L, 1)) ;
+    HSASM_CHECKARGS(L, LS_TBOOLEAN, LS_TBREAK) ;
+    CGError state = HSASM_SPI_ERROR("CGSForceWaitCursorActive", cgs->forceWaitCursorActive(CGSDefaultConnection, lua_toboolean(L, 1))) ;
     if (state != kCGErrorSuccess) return luaL_error(L, "waitCursor:error %d", state) ;
     return 0 ;
 }
 
 static int cursorSeed(lua_State *L) {
-    [[LuaSkin shared] checkArgs:LS_TBREAK] ;
-    lua_pushinteger(L, CGSCurrentCursorSeed()) ;
+    HSASM_CHECKARGS(L, LS_TBREAK) ;
+    lua_pushinteger(L, HSASM_SPI("CGSCurrentCursorSeed", cgs->currentCursorSeed())) ;
     return 1 ;
 }
 
 static int systemCursorName(lua_State *L) {
-    [[LuaSkin shared] checkArgs:LS_TNUMBER, LS_TBREAK] ;
-    lua_pushstring(L, CGSCursorNameForSystemCursor(luaL_checkinteger(L, 1))) ;
+    HSASM_CHECKARGS(L, LS_TNUMBER, LS_TBREAK) ;
+    lua_pushstring(L, HSASM_SPI("CGSCursorNameForSystemCursor", cgs->cursorNameForSystemCursor((CGSCursorID)luaL_checkinteger(L, 1)))) ;
     return 1 ;
 }
 
 static int cursorScale(lua_State *L) {
-    [[LuaSkin shared] checkArgs:LS_TNUMBER | LS_TOPTIONAL, LS_TBREAK] ;
+    HSASM_CHECKARGS(L, LS_TNUMBER | LS_TOPTIONAL, LS_TBREAK) ;
     if (lua_type(L, 1) == LUA_TNUMBER) {
-        CGError state = CGSSetCursorScale(CGSDefaultConnection, lua_tonumber(L, 1)) ;
+        CGError state = HSASM_SPI_ERROR("CGSSetCursorScale", cgs->setCursorScale(CGSDefaultConnection, lua_tonumber(L, 1))) ;
         if (state != kCGErrorSuccess) return luaL_error(L, "cursorScale:set error %d", state) ;
     }
     CGFloat scale ;
-    CGError state = CGSGetCursorScale(CGSDefaultConnection, &scale) ;
+    CGError state = HSASM_SPI_ERROR("CGSGetCursorScale", cgs->getCursorScale(CGSDefaultConnection, &scale)) ;
     if (state != kCGErrorSuccess) return luaL_error(L, "cursorScale:get error %d", state) ;
     lua_pushnumber(L, scale) ;
     return 1 ;
 }
 
-static int pushSystemCursorTable(lua_State *L) {
+// Cursor change watcher
+//
+// The WindowServer doesn't post a notification specifically for cursor changes, but the cursor generally
+// only changes when the mouse moves or crosses a tracking region, so we register for those and compare the
+// cursor seed when they arrive. The queue and batching are described in cursor_events.h. If the
+// notifications can't be registered, the seed is polled by a timer on a queue of its own instead, which
+// keeps the polling off the main thread; either way only one producer is running at a time.
+
+#define CURSOR_FALLBACK_INTERVAL 0.1
+
+static const CGSNotificationType cursorNotifications[] = {
+    kCGSNotificationMouseMoved,
+    kCGSNotificationTrackingRegionEntered,
+    kCGSNotificationTrackingRegionExited,
+    kCGSNotificationWorkspaceChanged,
+} ;
+#define CURSOR_NOTIFICATION_COUNT (sizeof(cursorNotifications) / sizeof(cursorNotifications[0]))
+
+static cursor_watcher    watcher ;
+static int               watcherCallbackRef = LUA_NOREF ;
+static BOOL              watcherNotifying   = NO ;
+static dispatch_queue_t  watcherPollQueue   = nil ;
+static dispatch_source_t watcherPollTimer   = nil ;
+static _Atomic uint64_t  watcherNotifications ;
+
+static void cursor_drainEvents(void) {
+    if (watcherCallbackRef == LUA_NOREF) {
+        cursor_watcher_discard(&watcher) ;
+        return ;
+    }
+
+    cursor_event batch[CURSOR_EVENT_QUEUE_SIZE] ;
+    size_t       count = cursor_watcher_drain(&watcher, batch, CURSOR_EVENT_QUEUE_SIZE) ;
+    if (count == 0) return ;
+
+    LuaSkin   *skin = [LuaSkin shared] ;
+    lua_State *L    = skin.L ;
+    _lua_stackguard_entry(L) ;
+    [skin pushLuaRef:refTable ref:watcherCallbackRef] ;
+    lua_createtable(L, (int)count, 0) ;
+    for (size_t i = 0 ; i < count ; i++) {
+        lua_newtable(L) ;
+        lua_pushinteger(L, batch[i].seed) ;         lua_setfield(L, -2, "seed") ;
+        lua_pushinteger(L, batch[i].previousSeed) ; lua_setfield(L, -2, "previousSeed") ;
+        lua_pushnumber(L, batch[i].timestamp) ;     lua_setfield(L, -2, "timestamp") ;
+        if (batch[i].notification != 0) {
+            lua_pushinteger(L, batch[i].notification) ; lua_setfield(L, -2, "notification") ;
+        }
+        lua_rawseti(L, -2, (lua_Integer)i + 1) ;
+    }
+    [skin protectedCallAndError:@"hs._asm.undocumented.cursor watcher callback" nargs:1 nresults:0] ;
+    _lua_stackguard_exit(L) ;
+}
+
+// called on the main thread for notifications, or on watcherPollQueue when polling
+static void cursor_checkSeed(int notification) {
+    int seed = HSASM_SPI("CGSCurrentCursorSeed", cgs->currentCursorSeed()) ;
+    if (cursor_watcher_check(&watcher, seed, notification, [[NSDate date] timeIntervalSince1970])) {
+        CFRunLoopPerformBlock(CFRunLoopGetMain(), kCFRunLoopCommonModes, ^{ cursor_drainEvents() ; }) ;
+        CFRunLoopWakeUp(CFRunLoopGetMain()) ;
+    }
+}
+
+static void cursor_notifyProc(CGSNotificationType type, __unused void *data, __unused unsigned int dataLength, __unused void *userData) {
+    atomic_fetch_add(&watcherNotifications, 1) ;
+    cursor_checkSeed((int)type) ;
+}
+
+static void cursor_removeNotifications(size_t count) {
+    for (size_t i = 0 ; i < count ; i++) (void)HSASM_SPI_ERROR("CGSRemoveNotifyProc", CGSRemoveNotifyProc(cursor_notifyProc, cursorNotifications[i], NULL)) ;
+}
+
+static BOOL cursor_registerNotifications(void) {
+    for (size_t i = 0 ; i < CURSOR_NOTIFICATION_COUNT ; i++) {
+        if (HSASM_SPI_ERROR("CGSRegisterNotifyProc", CGSRegisterNotifyProc(cursor_notifyProc, cursorNotifications[i], NULL)) != kCGErrorSuccess) {
+            cursor_removeNotifications(i) ;
+            return NO ;
+        }
+    }
+    return YES ;
+}
+
+static void cursor_startPolling(NSTimeInterval interval) {
+    if (!watcherPollQueue) watcherPollQueue = dispatch_queue_create("hs._asm.undocumented.cursor.watcher", DISPATCH_QUEUE_SERIAL) ;
+    uint64_t period  = (uint64_t)(interval * NSEC_PER_SEC) ;
+    watcherPollTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, watcherPollQueue) ;
+    dispatch_source_set_timer(watcherPollTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)period), period, period / 10) ;
+    dispatch_source_set_event_handler(watcherPollTimer, ^{ cursor_checkSeed(0) ; }) ;
+    dispatch_resume(watcherPollTimer) ;
+}
+
+static void cursor_stopWatcher(void) {
+    if (watcherNotifying) cursor_removeNotifications(CURSOR_NOTIFICATION_COUNT) ;
+    watcherNotifying = NO ;
+    if (watcherPollTimer) {
+        dispatch_source_cancel(watcherPollTimer) ;
+        // cancelling doesn't interrupt a check already running; wait for it, so it is the only producer
+        dispatch_sync(watcherPollQueue, ^{}) ;
+        watcherPollTimer = nil ;
+    }
+    watcherCallbackRef = [[LuaSkin shared] luaUnref:refTable ref:watcherCallbackRef] ;
+}
+
+static int watcherStart(lua_State *L) {
+    HSASM_CHECKARGS(L, LS_TFUNCTION, LS_TNUMBER | LS_TOPTIONAL, LS_TBREAK) ;
+    LuaSkin *skin = [LuaSkin shared] ;
+    NSTimeInterval interval = (lua_gettop(L) > 1) ? lua_tonumber(L, 2) : CURSOR_FALLBACK_INTERVAL ;
+    if (interval <= 0) return luaL_argerror(L, 2, "interval must be greater than 0") ;
+
+    cursor_stopWatcher() ;
+    lua_pushvalue(L, 1) ;
+    watcherCallbackRef = [skin luaRef:refTable] ;
+    cursor_watcher_start(&watcher, HSASM_SPI("CGSCurrentCursorSeed", cgs->currentCursorSeed())) ;
+
+    watcherNotifying = cursor_registerNotifications() ;
+    if (!watcherNotifying) cursor_startPolling(interval) ;
+    lua_pushstring(L, watcherNotifying ? "notifications" : "polling") ;
+    return 1 ;
+}
+
+static int watcherStop(lua_State *L) {
+    HSASM_CHECKARGS(L, LS_TBREAK) ;
+    cursor_stopWatcher() ;
+    return 0 ;
+}
+
+static int watcherStats(lua_State *L) {
+    HSASM_CHECKARGS(L, LS_TBOOLEAN | LS_TOPTIONAL, LS_TBREAK) ;
+    BOOL running = (watcherCallbackRef != LUA_NOREF) ;
     lua_newtable(L) ;
-      lua_pushinteger(L, CGSCursorArrow) ;        lua_setfield(L, -2, "arrow") ;
-      lua_pushinteger(L, CGSCursorIBeam) ;        lua_setfield(L, -2, "iBeam") ;
-      lua_pushinteger(L, CGSCursorIBeamXOR) ;     lua_setfield(L, -2, "iBeamXOR") ;
-      lua_pushinteger(L, CGSCursorAlias) ;        lua_setfield(L, -2, "alias") ;
-      lua_pushinteger(L, CGSCursorCopy) ;         lua_setfield(L, -2, "copy") ;
-      lua_pushinteger(L, CGSCursorMove) ;         lua_setfield(L, -2, "move") ;
-      lua_pushinteger(L, CGSCursorArrowContext) ; lua_setfield(L, -2, "arrowContext") ;
-      lua_pushinteger(L, CGSCursorWait) ;         lua_setfield(L, -2, "wait") ;
-      lua_pushinteger(L, CGSCursorEmpty) ;        lua_setfield(L, -2, "empty") ;
+    lua_pushstring(L, running ? (watcherNotifying ? "notifications" : "polling") : "stopped") ;
+    lua_setfield(L, -2, "mode") ;
+    lua_pushinteger(L, (lua_Integer)atomic_load(&watcherNotifications)) ; lua_setfield(L, -2, "notifications") ;
+    lua_pushinteger(L, (lua_Integer)atomic_load(&watcher.events)) ;       lua_setfield(L, -2, "events") ;
+    lua_pushinteger(L, (lua_Integer)atomic_load(&watcher.dropped)) ;      lua_setfield(L, -2, "dropped") ;
+    lua_pushinteger(L, (lua_Integer)atomic_load(&watcher.delivered)) ;    lua_setfield(L, -2, "delivered") ;
+    lua_pushinteger(L, (lua_Integer)atomic_load(&watcher.batches)) ;      lua_setfield(L, -2, "batches") ;
+    if (lua_toboolean(L, 1)) {
+        atomic_store(&watcherNotifications, 0) ;
+        cursor_watcher_resetCounters(&watcher) ;
+    }
+    return 1 ;
+}
+
+// Numeric fields of an options table. luaL_checknumber on the value pushed by lua_getfield would report
+// "bad argument #-1", so the type is checked here and the error names the field instead.
+static lua_Number cursor_numberOption(lua_State *L, int idx, const char *key, lua_Number defaultValue) {
+    lua_Number value = defaultValue ;
+    if (lua_getfield(L, idx, key) != LUA_TNIL) {
+        if (lua_type(L, -1) != LUA_TNUMBER) luaL_error(L, "%s must be a number", key) ;
+        value = lua_tonumber(L, -1) ;
+    }
+    lua_pop(L, 1) ;
+    return value ;
+}
+
+static lua_Integer cursor_integerOption(lua_State *L, int idx, const char *key, lua_Integer defaultValue) {
+    lua_Integer value = defaultValue ;
+    if (lua_getfield(L, idx, key) != LUA_TNIL) {
+        if (!lua_isinteger(L, -1)) luaL_error(L, "%s must be an integer", key) ;
+        value = lua_tointeger(L, -1) ;
+    }
+    lua_pop(L, 1) ;
+    return value ;
+}
+
+// Registered cursor sets
+//
+// Building a cursor from images every time it's needed is slow, so a set of frames is registered with the
+// WindowServer once under a name and switched to with a single CGSSetRegisteredCursor call. The sets
+// registered by this module are remembered with the digest of their frames and options (cursor_sets.h), so
+// registering a name again is skipped when the frames and options are unchanged, unless it's forced or the
+// WindowServer no longer knows about the name (e.g. after it has been restarted).
+
+#define CURSOR_SET_FRAME_DURATION 0.1
+
+static NSMutableDictionary<NSString *, NSDictionary *> *registeredCursorSets ;
+static uint64_t cursorSetRegistrations = 0 ;
+static uint64_t cursorSetSkipped       = 0 ;
+static uint64_t cursorSetSwitches      = 0 ;
+
+static BOOL cursor_isRegistered(NSString *name, uint64_t digest) {
+    NSNumber *known = registeredCursorSets[name][@"digest"] ;
+    size_t   size   = 0 ;
+    return known && known.unsignedLongLongValue == digest &&
+           (HSASM_SPI_ERROR("CGSGetRegisteredCursorDataSize", cgs->getRegisteredCursorDataSize(CGSDefaultConnection, name.UTF8String, &size)) == kCGErrorSuccess) && (size > 0) ;
+}
+
+// adds the pixels of a frame to the digest; returns false if its bitmap can't be read
+static BOOL cursor_digestFrame(CGImageRef image, uint64_t *digest) {
+    CFDataRef data = CGDataProviderCopyData(CGImageGetDataProvider(image)) ;
+    if (!data) return NO ;
+    size_t height = CGImageGetHeight(image), rowBytes = CGImageGetBytesPerRow(image) ;
+    BOOL   valid  = (size_t)CFDataGetLength(data) >= height * rowBytes ;
+    if (valid) {
+        *digest = cursor_setDigest_addFrame(*digest, CFDataGetBytePtr(data), CGImageGetWidth(image), height, rowBytes,
+                                            (CGImageGetBitsPerPixel(image) + 7) / 8) ;
+    }
+    CFRelease(data) ;
+    return valid ;
+}
+
+// registerCursorSet(name, images, [options]) -> seed, registered
+//   options: force, global (default true), frameDuration (default 0.1), repeatCount, hotSpot, size
+//
+// The frames are always turned into bitmaps, since the digest needs their pixels, but only registered when
+// the digest differs from the one last registered under the name.
+static int registerCursorSet(lua_State *L) {
+    HSASM_CHECKARGS(L, LS_TSTRING, LS_TTABLE, LS_TTABLE | LS_TOPTIONAL, LS_TBREAK) ;
+    LuaSkin *skin = [LuaSkin shared] ;
+    NSString *name = [skin toNSObjectAtIndex:1] ;
+
+    BOOL       force         = NO ;
+    BOOL       global        = YES ;
+    CGFloat    frameDuration = CURSOR_SET_FRAME_DURATION ;
+    NSInteger  repeatCount   = 0 ;
+    CGPoint    hotSpot       = CGPointZero ;
+    NSSize     size          = NSZeroSize ;
+    if (lua_type(L, 3) == LUA_TTABLE) {
+        if (lua_getfield(L, 3, "force") != LUA_TNIL)     force   = (BOOL)lua_toboolean(L, -1) ;
+        if (lua_getfield(L, 3, "global") != LUA_TNIL)    global  = (BOOL)lua_toboolean(L, -1) ;
+        if (lua_getfield(L, 3, "hotSpot") == LUA_TTABLE) hotSpot = [skin tableToPointAtIndex:-1] ;
+        if (lua_getfield(L, 3, "size") == LUA_TTABLE)    size    = [skin tableToSizeAtIndex:-1] ;
+        lua_pop(L, 4) ;
+        frameDuration = cursor_numberOption(L, 3, "frameDuration", frameDuration) ;
+        repeatCount   = (NSInteger)cursor_integerOption(L, 3, "repeatCount", repeatCount) ;
+    }
+
+    NSMutableArray *frames = [NSMutableArray array] ;
+    lua_Integer    count   = luaL_len(L, 2) ;
+    for (lua_Integer i = 1 ; i <= count ; i++) {
+        lua_rawgeti(L, 2, i) ;
+        NSImage *image = [skin luaObjectAtIndex:-1 toClass:"NSImage"] ;
+        lua_pop(L, 1) ;
+        if (![image isKindOfClass:[NSImage class]]) return luaL_error(L, "frame %d is not an hs.image object", (int)i) ;
+        if (NSEqualSizes(size, NSZeroSize)) size = image.size ;
+        NSRect     rect    = NSMakeRect(0, 0, size.width, size.height) ;
+        CGImageRef cgImage = [image CGImageForProposedRect:&rect context:nil hints:nil] ;
+        if (!cgImage) return luaL_error(L, "unable to get bitmap for frame %d", (int)i) ;
+        [frames addObject:(__bridge id)cgImage] ;
+    }
+    if (frames.count == 0) return luaL_argerror(L, 2, "at least one frame is required") ;
+
+    cursor_setOptions options = {
+        .global        = global,
+        .frameDuration = frameDuration,
+        .repeatCount   = repeatCount,
+        .hotSpot       = hotSpot,
+        .size          = size,
+        .frameCount    = frames.count,
+    } ;
+    uint64_t digest = cursor_setDigest_begin(&options) ;
+    BOOL     hashed = YES ;
+    for (id frame in frames) hashed = hashed && cursor_digestFrame((__bridge CGImageRef)frame, &digest) ;
+    digest = cursor_setDigest_end(digest) ;
+
+    // a set whose pixels can't be read is never skipped
+    if (!force && hashed && cursor_isRegistered(name, digest)) {
+        cursorSetSkipped++ ;
+        lua_pushinteger(L, [registeredCursorSets[name][@"seed"] intValue]) ;
+        lua_pushboolean(L, NO) ;
+        return 2 ;
+    }
+
+    int     seed = 0 ;
+    CGError err  = HSASM_SPI_ERROR("CGSRegisterCursorWithImages",
+                       cgs->registerCursorWithImages(CGSDefaultConnection, name.UTF8String, global, true,
+                                                     frames.count, (__bridge CFArrayRef)frames,
+                                                     size, hotSpot, &seed,
+                                                     CGRectMake(0, 0, size.width, size.height), frameDuration, repeatCount)) ;
+    if (err != kCGErrorSuccess) return luaL_error(L, "registerCursorSet:error %d", err) ;
+
+    cursorSetRegistrations++ ;
+    NSMutableDictionary *entry = [@{
+        @"seed"          : @(seed),
+        @"frames"        : @(frames.count),
+        @"frameDuration" : @(frameDuration),
+        @"repeatCount"   : @(repeatCount),
+        @"global"        : @(global),
+    } mutableCopy] ;
+    if (hashed) entry[@"digest"] = @(digest) ;
+    registeredCursorSets[name] = entry ;
+    lua_pushinteger(L, seed) ;
+    lua_pushboolean(L, YES) ;
+    return 2 ;
+}
+
+static int setCursorSet(lua_State *L) {
+    HSASM_CHECKARGS(L, LS_TSTRING, LS_TBREAK) ;
+    LuaSkin *skin = [LuaSkin shared] ;
+    NSString     *name  = [skin toNSObjectAtIndex:1] ;
+    NSDictionary *entry = registeredCursorSets[name] ;
+    if (!entry) return luaL_argerror(L, 1, "no cursor set has been registered with this name") ;
+
+    int     seed = [entry[@"seed"] intValue] ;
+    CGError err  = HSASM_SPI_ERROR("CGSSetRegisteredCursor", cgs->setRegisteredCursor(CGSDefaultConnection, name.UTF8String, &seed)) ;
+    if (err != kCGErrorSuccess) return luaL_error(L, "setCursorSet:error %d", err) ;
+    cursorSetSwitches++ ;
+    lua_pushinteger(L, seed) ;
     return 1 ;
 }
 
+static int cursorSets(lua_State *L) {
+    HSASM_CHECKARGS(L, LS_TBREAK) ;
+    LuaSkin *skin = [LuaSkin shared] ;
+    [skin pushNSObject:registeredCursorSets] ;
+    lua_newtable(L) ;
+    lua_pushinteger(L, (lua_Integer)cursorSetRegistrations) ; lua_setfield(L, -2, "registrations") ;
+    lua_pushinteger(L, (lua_Integer)cursorSetSkipped) ;       lua_setfield(L, -2, "skipped") ;
+    lua_pushinteger(L, (lua_Integer)cursorSetSwitches) ;      lua_setfield(L, -2, "switches") ;
+    return 2 ;
+}
+
+static int cursorSetImages(lua_State *L) {
+    HSASM_CHECKARGS(L, LS_TSTRING, LS_TBREAK) ;
+    LuaSkin *skin = [LuaSkin shared] ;
+    const char *name = lua_tostring(L, 1) ;
+
+    CGSize     imageSize ;
+    CGPoint    hotSpot ;
+    NSUInteger frameCount    = 0 ;
+    CGFloat    frameDuration = 0 ;
+    CFArrayRef images        = NULL ;
+    CGError    err           = HSASM_SPI_ERROR("CGSCopyRegisteredCursorImages",
+                                   cgs->copyRegisteredCursorImages(CGSDefaultConnection, name, &imageSize, &hotSpot,
+                                                                   &frameCount, &frameDuration, &images)) ;
+    if (err != kCGErrorSuccess || !images) return luaL_error(L, "cursorSetImages:error %d", err) ;
+
+    lua_newtable(L) ;
+    for (CFIndex i = 0 ; i < CFArrayGetCount(images) ; i++) {
+        CGImageRef frame = (CGImageRef)CFArrayGetValueAtIndex(images, i) ;
+        [skin pushNSObject:[[NSImage alloc] initWithCGImage:frame size:imageSize]] ;
+        lua_rawseti(L, -2, (lua_Integer)i + 1) ;
+    }
+    CFRelease(images) ;
+    lua_newtable(L) ;
+    [skin pushNSSize:imageSize] ;                 lua_setfield(L, -2, "size") ;
+    [skin pushNSPoint:hotSpot] ;                  lua_setfield(L, -2, "hotSpot") ;
+    lua_pushinteger(L, (lua_Integer)frameCount) ; lua_setfield(L, -2, "frames") ;
+    lua_pushnumber(L, frameDuration) ;            lua_setfield(L, -2, "frameDuration") ;
+    return 2 ;
+}
+
+// Cursor position sampler
+//
+// Polling the position from Lua is limited by the timer resolution and jitters with whatever else Lua is
+// doing, so a dedicated thread samples the position on a mach_wait_until schedule. The ring, the schedule
+// and the derivatives are in cursor_sampler.h; this is the mach clock and the Lua side.
+
+static cursor_sampler     sampler         = { 0 } ;
+static pthread_t          samplerThread ;
+static double             samplerRate     = CURSOR_SAMPLER_RATE ;
+static uint64_t           samplerDrained  = 0 ;
+static cursor_derivatives samplerDerivatives ;
+
+static double cursor_machSeconds(uint64_t machTime) {
+    static mach_timebase_info_data_t timebase ;
+    if (timebase.denom == 0) mach_timebase_info(&timebase) ;
+    return (double)machTime * timebase.numer / timebase.denom / 1e9 ;
+}
+
+static uint64_t cursor_samplerNow(__unused void *context) {
+    return mach_absolute_time() ;
+}
+
+static double cursor_samplerSeconds(__unused void *context, uint64_t ticks) {
+    return cursor_machSeconds(ticks) ;
+}
+
+static void cursor_samplerWait(__unused void *context, uint64_t deadline) {
+    mach_wait_until(deadline) ;
+}
+
+static bool cursor_samplerPosition(__unused void *context, double *x, double *y) {
+    CGPoint location ;
+    if (HSASM_SPI_ERROR("CGSGetCurrentCursorLocation", cgs->getCurrentCursorLocation(CGSDefaultConnection, &location)) != kCGErrorSuccess) return false ;
+    *x = location.x ;
+    *y = location.y ;
+    return true ;
+}
+
+static const cursor_samplerSource cursor_machSamplerSource = {
+    .now       = cursor_samplerNow,
+    .seconds   = cursor_samplerSeconds,
+    .waitUntil = cursor_samplerWait,
+    .position  = cursor_samplerPosition,
+} ;
+
+static void *cursor_samplerMain(__unused void *arg) {
+    pthread_setname_np("hs._asm.undocumented.cursor sampler") ;
+    pthread_set_qos_class_self_np(QOS_CLASS_USER_INTERACTIVE, 0) ;
+
+    mach_timebase_info_data_t timebase ;
+    mach_timebase_info(&timebase) ;
+    uint64_t period = (uint64_t)(1e9 / samplerRate * timebase.denom / timebase.numer) ;
+    cursor_sampler_run(&sampler, &cursor_machSamplerSource, period) ;
+    return NULL ;
+}
+
+static void cursor_stopSampler(void) {
+    if (!atomic_exchange(&sampler.running, false)) return ;
+    pthread_join(samplerThread, NULL) ;
+}
+
+static int samplerStart(lua_State *L) {
+    HSASM_CHECKARGS(L, LS_TNUMBER | LS_TOPTIONAL, LS_TNUMBER | LS_TINTEGER | LS_TOPTIONAL, LS_TBREAK) ;
+    double      rate     = (lua_gettop(L) > 0) ? lua_tonumber(L, 1) : CURSOR_SAMPLER_RATE ;
+    lua_Integer capacity = (lua_gettop(L) > 1) ? lua_tointeger(L, 2) : CURSOR_SAMPLER_CAPACITY ;
+    if (rate <= 0 || rate > CURSOR_SAMPLER_MAX_RATE) return luaL_argerror(L, 1, "rate must be greater than 0 and no more than 2000") ;
+    if (capacity < 2 || capacity > CURSOR_SAMPLER_MAX_CAPACITY) return luaL_argerror(L, 2, "capacity must be at least 2 and no more than 1048576") ;
+
+    cursor_stopSampler() ;
+
+    size_t size = cursor_sampleRing_reserve(&sampler.ring, (uint64_t)capacity) ;
+    if (size == 0) return luaL_error(L, "samplerStart:unable to allocate %d samples", (int)capacity) ;
+    samplerRate = rate ;
+    cursor_derivatives_reset(&samplerDerivatives) ;
+
+    atomic_store(&sampler.running, true) ;
+    int err = pthread_create(&samplerThread, NULL, cursor_samplerMain, NULL) ;
+    if (err != 0) {
+        atomic_store(&sampler.running, false) ;
+        return luaL_error(L, "samplerStart:unable to create thread: error %d", err) ;
+    }
+    lua_pushinteger(L, (lua_Integer)size) ;
+    return 1 ;
+}
+
+static int samplerStop(lua_State *L) {
+    HSASM_CHECKARGS(L, LS_TBREAK) ;
+    cursor_stopSampler() ;
+    return 0 ;
+}
+
+// samplerDrain([derivatives]) -> array, count, stride
+//   the array holds timestamp, x, y for each sample (and vx, vy, ax, ay when derivatives is true)
+static int samplerDrain(lua_State *L) {
+    HSASM_CHECKARGS(L, LS_TBOOLEAN | LS_TOPTIONAL, LS_TBREAK) ;
+    BOOL derivatives = (BOOL)lua_toboolean(L, 1) ;
+    int  stride      = derivatives ? 7 : 3 ;
+
+    uint64_t tail ;
+    uint64_t count = cursor_sampleRing_pending(&sampler.ring, &tail) ;
+
+    lua_createtable(L, (int)(count * (uint64_t)stride), 0) ;
+    lua_Integer index = 0 ;
+    for (uint64_t i = tail ; i < tail + count ; i++) {
+        cursor_sample sample = cursor_sampleRing_at(&sampler.ring, i) ;
+        lua_pushnumber(L, sample.timestamp) ; lua_rawseti(L, -2, ++index) ;
+        lua_pushnumber(L, sample.x) ;         lua_rawseti(L, -2, ++index) ;
+        lua_pushnumber(L, sample.y) ;         lua_rawseti(L, -2, ++index) ;
+
+        double values[4] ;
+        cursor_derivatives_next(&samplerDerivatives, &sample, values) ;
+        if (derivatives) {
+            for (int v = 0 ; v < 4 ; v++) {
+                lua_pushnumber(L, values[v]) ; lua_rawseti(L, -2, ++index) ;
+            }
+        }
+    }
+    cursor_sampleRing_release(&sampler.ring, tail + count) ;
+    samplerDrained += count ;
+
+    lua_pushinteger(L, (lua_Integer)count) ;
+    lua_pushinteger(L, stride) ;
+    return 3 ;
+}
+
+static int samplerStats(lua_State *L) {
+    HSASM_CHECKARGS(L, LS_TBOOLEAN | LS_TOPTIONAL, LS_TBREAK) ;
+    uint64_t head = atomic_load(&sampler.ring.head) ;
+    uint64_t tail = atomic_load(&sampler.ring.tail) ;
+    lua_newtable(L) ;
+    lua_pushboolean(L, atomic_load(&sampler.running)) ;                 lua_setfield(L, -2, "running") ;
+    lua_pushnumber(L, samplerRate) ;                                    lua_setfield(L, -2, "rate") ;
+    lua_pushinteger(L, (lua_Integer)sampler.ring.capacity) ;            lua_setfield(L, -2, "capacity") ;
+    lua_pushinteger(L, (lua_Integer)(head - tail)) ;                    lua_setfield(L, -2, "pending") ;
+    lua_pushinteger(L, (lua_Integer)atomic_load(&sampler.taken)) ;      lua_setfield(L, -2, "samples") ;
+    lua_pushinteger(L, (lua_Integer)atomic_load(&sampler.overruns)) ;   lua_setfield(L, -2, "overruns") ;
+    lua_pushinteger(L, (lua_Integer)atomic_load(&sampler.late)) ;       lua_setfield(L, -2, "missedTicks") ;
+    lua_pushinteger(L, (lua_Integer)samplerDrained) ;                   lua_setfield(L, -2, "drained") ;
+    if (lua_toboolean(L, 1)) {
+        atomic_store(&sampler.taken, 0) ;
+        atomic_store(&sampler.overruns, 0) ;
+        atomic_store(&sampler.late, 0) ;
+        samplerDrained = 0 ;
+    }
+    return 1 ;
+}
+
+// Cursor path playback
+//
+// Moving the pointer along a path with Lua timers gives uneven timing, so the path is converted into an
+// array of line and cubic bezier segments with absolute start and end times, and played back on its own
+// thread. The timing and the tick loop are in cursor_playback.h; this is the mach clock, the warp, and
+// the Lua side.
+
+static uint64_t cursor_playbackNow(__unused void *context) {
+    return mach_absolute_time() ;
+}
+
+static double cursor_playbackSeconds(__unused void *context, uint64_t ticks) {
+    return cursor_machSeconds(ticks) ;
+}
+
+static void cursor_playbackWait(__unused void *context, uint64_t deadline) {
+    mach_wait_until(deadline) ;
+}
+
+static void cursor_playbackWarp(__unused void *context, CGPoint point) {
+    (void)HSASM_SPI_ERROR("CGSWarpCursorPosition", cgs->warpCursorPosition(CGSDefaultConnection, point.x, point.y)) ;
+}
+
+static const cursor_playbackDriver cursor_machPlaybackDriver = {
+    .now       = cursor_playbackNow,
+    .seconds   = cursor_playbackSeconds,
+    .waitUntil = cursor_playbackWait,
+    .warp      = cursor_playbackWarp,
+} ;
+
+@interface HSASMCursorPlayback : NSObject
+@property (readonly) NSData               *segments ;
+@property (readonly) double               rate ;
+@property            int                  callbackRef ;
+@property (readonly) dispatch_semaphore_t finished ;
+@end
+
+@implementation HSASMCursorPlayback {
+    cursor_playback state ;
+}
+
+- (instancetype)initWithSegments:(NSData *)segments rate:(double)rate {
+    self = [super init] ;
+    if (self) {
+        _segments    = segments ;
+        _rate        = rate ;
+        _callbackRef = LUA_NOREF ;
+        _finished    = dispatch_semaphore_create(0) ;
+        const cursor_pathSegment *path = segments.bytes ;
+        // without room for the errors the path still plays; only the error stats are lost
+        (void)cursor_playback_init(&state, path[segments.length / sizeof(cursor_pathSegment) - 1].end, rate) ;
+    }
+    return self ;
+}
+
+- (void)dealloc {
+    cursor_playback_free(&state) ;
+}
+
+- (void)cancel {
+    cursor_playback_cancel(&state) ;
+}
+
+- (void)play {
+    pthread_setname_np("hs._asm.undocumented.cursor playback") ;
+    pthread_set_qos_class_self_np(QOS_CLASS_USER_INTERACTIVE, 0) ;
+
+    mach_timebase_info_data_t timebase ;
+    mach_timebase_info(&timebase) ;
+    uint64_t period = (uint64_t)(1e9 / _rate * timebase.denom / timebase.numer) ;
+    cursor_playback_run(&state, _segments.bytes, _segments.length / sizeof(cursor_pathSegment), period, &cursor_machPlaybackDriver) ;
+
+    dispatch_semaphore_signal(_finished) ;
+    dispatch_async(dispatch_get_main_queue(), ^{ [self complete] ; }) ;
+}
+
+- (void)pushStats:(lua_State *)L {
+    double mean, p99, max ;
+    cursor_playback_errorStats(&state, &mean, &p99, &max) ;
+    lua_newtable(L) ;
+    lua_pushinteger(L, (lua_Integer)state.ticks) ; lua_setfield(L, -2, "ticks") ;
+    lua_pushnumber(L, state.elapsed) ;             lua_setfield(L, -2, "elapsed") ;
+    lua_pushnumber(L, mean) ;                      lua_setfield(L, -2, "meanError") ;
+    lua_pushnumber(L, p99) ;                       lua_setfield(L, -2, "p99Error") ;
+    lua_pushnumber(L, max) ;                       lua_setfield(L, -2, "maxError") ;
+}
+
+// on the main thread
+- (void)complete {
+    if (_callbackRef == LUA_NOREF) return ;
+    LuaSkin   *skin = [LuaSkin shared] ;
+    lua_State *L    = skin.L ;
+    _lua_stackguard_entry(L) ;
+    [skin pushLuaRef:refTable ref:_callbackRef] ;
+    lua_pushboolean(L, !atomic_load(&state.cancelled)) ;
+    [self pushStats:L] ;
+    [skin protectedCallAndError:@"hs._asm.undocumented.cursor playback callback" nargs:2 nresults:0] ;
+    _callbackRef = [skin luaUnref:refTable ref:_callbackRef] ;
+    _lua_stackguard_exit(L) ;
+}
+
+@end
+
+static HSASMCursorPlayback *currentPlayback = nil ;
+
+static void cursor_cancelPlayback(BOOL discardCallback) {
+    if (!currentPlayback) return ;
+    [currentPlayback cancel] ;
+    dispatch_semaphore_wait(currentPlayback.finished, DISPATCH_TIME_FOREVER) ;
+    if (discardCallback) currentPlayback.callbackRef = [[LuaSkin shared] luaUnref:refTable ref:currentPlayback.callbackRef] ;
+    currentPlayback = nil ;
+}
+
+static CGPoint cursor_pointFromField(lua_State *L, int idx, const char *field, CGPoint defaultPoint) {
+    CGPoint point = defaultPoint ;
+    if (lua_getfield(L, idx, field) == LUA_TTABLE) point = [[LuaSkin shared] tableToPointAtIndex:-1] ;
+    lua_pop(L, 1) ;
+    return point ;
+}
+
+// playPath(points, [options], [fn]) -> duration
+//   each point is a table with x and y, and optionally c1 and c2 (the control points of a cubic bezier
+//   from the previous point) and duration (the seconds to reach it from the previous point); options may
+//   contain duration (shared by length between the points without their own) and rate. The playback
+//   starts from the first point. fn(completed, stats) is invoked when the playback finishes or is
+//   cancelled, with stats containing ticks, elapsed, meanError, p99Error, and maxError (in seconds).
+static int playPath(lua_State *L) {
+    HSASM_CHECKARGS(L, LS_TTABLE, LS_TTABLE | LS_TFUNCTION | LS_TNIL | LS_TOPTIONAL, LS_TFUNCTION | LS_TOPTIONAL, LS_TBREAK) ;
+    LuaSkin *skin = [LuaSkin shared] ;
+
+    double rate     = CURSOR_PLAYBACK_RATE ;
+    double duration = CURSOR_PLAYBACK_DURATION ;
+    int    fnIdx    = (lua_type(L, 2) == LUA_TFUNCTION) ? 2 : 3 ;
+    if (lua_type(L, 2) == LUA_TTABLE) {
+        rate     = cursor_numberOption(L, 2, "rate", rate) ;
+        duration = cursor_numberOption(L, 2, "duration", duration) ;
+    }
+    if (rate <= 0 || rate > CURSOR_PLAYBACK_MAX_RATE) return luaL_argerror(L, 2, "rate must be greater than 0 and no more than 1000") ;
+    if (duration < 0) return luaL_argerror(L, 2, "duration cannot be negative") ;
+
+    lua_Integer count = luaL_len(L, 1) ;
+    if (count < 2) return luaL_argerror(L, 1, "a path requires at least 2 points") ;
+    size_t segmentCount = (size_t)count - 1 ;
+
+    NSMutableData      *data      = [NSMutableData dataWithLength:segmentCount * sizeof(cursor_pathSegment)] ;
+    NSMutableData      *times     = [NSMutableData dataWithLength:segmentCount * sizeof(double)] ;
+    cursor_pathSegment *segments  = data.mutableBytes ;
+    double             *durations = times.mutableBytes ;
+    CGPoint            previous   = CGPointZero ;
+
+    for (lua_Integer i = 1 ; i <= count ; i++) {
+        if (lua_rawgeti(L, 1, i) != LUA_TTABLE) return luaL_error(L, "point %d is not a table", (int)i) ;
+        CGPoint point = [skin tableToPointAtIndex:-1] ;
+        if (i > 1) {
+            cursor_pathSegment *segment = &segments[i - 2] ;
+            int c1Type = lua_getfield(L, -1, "c1") ; lua_pop(L, 1) ;
+            int c2Type = lua_getfield(L, -1, "c2") ; lua_pop(L, 1) ;
+            segment->p0    = previous ;
+            segment->p1    = point ;
+            segment->c1    = cursor_pointFromField(L, -1, "c1", previous) ;
+            segment->c2    = cursor_pointFromField(L, -1, "c2", point) ;
+            segment->curve = (c1Type == LUA_TTABLE || c2Type == LUA_TTABLE) ;
+
+            // a point without its own duration gets a share of the overall one
+            durations[i - 2] = -1 ;
+            if (lua_getfield(L, -1, "duration") != LUA_TNIL) {
+                if (!lua_isnumber(L, -1) || lua_tonumber(L, -1) < 0) return luaL_error(L, "duration of point %d must be a number of seconds", (int)i) ;
+                durations[i - 2] = lua_tonumber(L, -1) ;
+            }
+            lua_pop(L, 1) ;
+        }
+        previous = point ;
+        lua_pop(L, 1) ;
+    }
+    double time = cursor_path_assignTimes(segments, durations, segmentCount, duration) ;
+
+    cursor_cancelPlayback(NO) ;
+    HSASMCursorPlayback *playback = [[HSASMCursorPlayback alloc] initWithSegments:data rate:rate] ;
+    if (lua_type(L, fnIdx) == LUA_TFUNCTION) {
+        lua_pushvalue(L, fnIdx) ;
+        playback.callbackRef = [skin luaRef:refTable] ;
+    }
+    currentPlayback = playback ;
+    [NSThread detachNewThreadWithBlock:^{ [playback play] ; }] ;
+
+    lua_pushnumber(L, time) ;
+    return 1 ;
+}
+
+static int cancelPlayback(lua_State *L) {
+    HSASM_CHECKARGS(L, LS_TBREAK) ;
+    cursor_cancelPlayback(NO) ;
+    return 0 ;
+}
+
+// _mockBackend([enable], [options]) -> table
+//   switches between the CGS cursor functions and an in-memory cursor (see cursor_backend.h) and returns a table
+//   describing the backend in use and the mock's configuration and call counts. The watcher, the sampler and
+//   any path playback are stopped first, since they call the backend from their own threads, and the registered
+//   cursor sets are forgotten, since they were registered with the other backend.
+static int selectBackend(lua_State *L) {
+    HSASM_CHECKARGS(L, LS_TBOOLEAN | LS_TOPTIONAL, LS_TTABLE | LS_TOPTIONAL, LS_TBREAK) ;
+    if (lua_isboolean(L, 1)) {
+        cursor_stopWatcher() ;
+        cursor_stopSampler() ;
+        cursor_cancelPlayback(NO) ;
+        [registeredCursorSets removeAllObjects] ;
+        cgs = lua_toboolean(L, 1) ? &cursor_mockBackend : &cursor_nativeBackend ;
+        hsasm_mock_configure(L, 2, &cursorMock) ;
+    }
+    hsasm_mock_pushStats(L, cgs->name, &cursorMock) ;
+    return 1 ;
+}
+
+static const hsasm_constant systemCursorNames[] = {
+    { "arrow",        CGSCursorArrow },
+    { "iBeam",        CGSCursorIBeam },
+    { "iBeamXOR",     CGSCursorIBeamXOR },
+    { "alias",        CGSCursorAlias },
+    { "copy",         CGSCursorCopy },
+    { "move",         CGSCursorMove },
+    { "arrowContext", CGSCursorArrowContext },
+    { "wait",         CGSCursorWait },
+    { "empty",        CGSCursorEmpty },
+} ;
+
+static hsasm_constants systemCursors = HSASM_CONSTANTS("systemCursors", systemCursorNames) ;
+
+static int pushSystemCursorTable(lua_State *L) {
+    hsasm_constants_push(L, &systemCursors, "hs._asm.undocumented.cursor.constants") ;
+    return 1 ;
+}
+
+static int spiStats(lua_State *L) {
+    return hsasm_spi_pushStats(L) ;
+}
+
+static int spiResetStats(lua_State *L) {
+    return hsasm_spi_resetStats(L) ;
+}
+
 // static int userdata_tostring(lua_State* L) {
 // }
 
@@ -95,9 +847,12 @@ static int pushSystemCursorTable(lua_State *L) {
 //     return 0 ;
 // }
 
-// static int meta_gc(lua_State* __unused L) {
-//     return 0 ;
-// }
+static int meta_gc(lua_State* __unused L) {
+    cursor_stopWatcher() ;
+    cursor_stopSampler() ;
+    cursor_cancelPlayback(YES) ;
+    return 0 ;
+}
 
 // Metatable for userdata objects
 // static const luaL_Reg userdata_metaLib[] = {
@@ -109,34 +864,51 @@ static int pushSystemCursorTable(lua_State *L) {
 
 // Functions for returned object when module loads
 static luaL_Reg moduleLib[] = {
-    {"showCursor",       showCursor},
-    {"hideCursor",       hideCursor},
-    {"obscureCursor",    obscureCursor},
-    {"revealCursor",     revealCursor},
-    {"waitCursor",       waitCursor},
-    {"cursorSeed",       cursorSeed},
-    {"systemCursorName", systemCursorName},
-    {"cursorScale",      cursorScale},
+    {"showCursor",        showCursor},
+    {"hideCursor",        hideCursor},
+    {"obscureCursor",     obscureCursor},
+    {"revealCursor",      revealCursor},
+    {"waitCursor",        waitCursor},
+    {"cursorSeed",        cursorSeed},
+    {"systemCursorName",  systemCursorName},
+    {"cursorScale",       cursorScale},
+    {"watcherStart",      watcherStart},
+    {"watcherStop",       watcherStop},
+    {"watcherStats",      watcherStats},
+    {"registerCursorSet", registerCursorSet},
+    {"setCursorSet",      setCursorSet},
+    {"cursorSets",        cursorSets},
+    {"cursorSetImages",   cursorSetImages},
+    {"samplerStart",      samplerStart},
+    {"samplerStop",       samplerStop},
+    {"samplerDrain",      samplerDrain},
+    {"samplerStats",      samplerStats},
+    {"playPath",          playPath},
+    {"cancelPlayback",    cancelPlayback},
+    {"stats",             spiStats},
+    {"resetStats",        spiResetStats},
+    {"_systemCursors",    pushSystemCursorTable},
+    {"_mockBackend",      selectBackend},
 
     {NULL, NULL}
 };
 
-// // Metatable for module, if needed
-// static const luaL_Reg module_metaLib[] = {
-//     {"__gc", meta_gc},
-//     {NULL,   NULL}
-// };
+// Metatable for module, if needed
+static const luaL_Reg module_metaLib[] = {
+    {"__gc", meta_gc},
+    {NULL,   NULL}
+};
 
 // NOTE: ** Make sure to change luaopen_..._internal **
 int luaopen_hs__asm_undocumented_cursor_internal(lua_State* __unused L) {
 // Use this if your module doesn't have a module specific object that it returns.
-   refTable = [[LuaSkin shared] registerLibrary:moduleLib metaFunctions:nil] ; // or module_metaLib
+   refTable = [[LuaSkin shared] registerLibrary:moduleLib metaFunctions:module_metaLib] ;
 // Use this some of your functions return or act on a specific object unique to this module
 //     refTable = [[LuaSkin shared] registerLibraryWithObject:USERDATA_TAG
 //                                                  functions:moduleLib
 //                                              metaFunctions:nil    // or module_metaLib
 //                                            objectFunctions:userdata_metaLib];
 
-    pushSystemCursorTable(L) ; lua_setfield(L, -2, "systemCursors") ;
+    registeredCursorSets = [NSMutableDictionary dictionary] ;
     return 1;
 }
@@ -0,0 +1,107 @@
+//
+// lua.h
+// A stand-in for the parts of the Lua API and LuaSkin used by the plain C cores
+//
+// The stack holds only the type of each argument and whether a number is an integer, which is all the
+// argument checks in hsasm_checkargs.h look at. The constants have the values of Lua 5.4 and LuaSkin, and
+// the accessors are kept out of line, as calls into the Lua library are in the modules.
+//
+// lua_stub_checkArgs walks its variadic masks the way LuaSkin's checkArgs does, returning false where
+// checkArgs would raise an error; it is the reference the fast check is tested and timed against.
+
+#pragma once
+
+#include <stdarg.h>
+#include <stdbool.h>
+
+#define LUA_TNONE          (-1)
+#define LUA_TNIL           0
+#define LUA_TBOOLEAN       1
+#define LUA_TLIGHTUSERDATA 2
+#define LUA_TNUMBER        3
+#define LUA_TSTRING        4
+#define LUA_TTABLE         5
+#define LUA_TFUNCTION      6
+#define LUA_TUSERDATA      7
+#define LUA_TTHREAD        8
+
+#define LS_TBREAK          (1 << 0)
+#define LS_TOPTIONAL       (1 << 1)
+#define LS_TNIL            (1 << 2)
+#define LS_TBOOLEAN        (1 << 3)
+#define LS_TNUMBER         (1 << 4)
+#define LS_TSTRING         (1 << 5)
+#define LS_TTABLE          (1 << 6)
+#define LS_TFUNCTION       (1 << 7)
+#define LS_TUSERDATA       (1 << 8)
+#define LS_TNONE           (1 << 9)
+#define LS_TANY            (1 << 10)
+#define LS_TINTEGER        (1 << 11)
+#define LS_TVARARG         (1 << 12)
+#define LS_TWRAPPEDOBJECT  (1 << 13)
+
+#define LUA_STUB_SLOTS 32
+
+typedef struct lua_State {
+    int  top ;
+    int  types[LUA_STUB_SLOTS] ;
+    bool integers[LUA_STUB_SLOTS] ;
+} lua_State ;
+
+// pushes an argument of the given type; isInteger only matters for LUA_TNUMBER
+static inline void lua_stub_push(lua_State *L, int type, bool isInteger) {
+    if (L->top >= LUA_STUB_SLOTS) return ;
+    L->types[L->top]    = type ;
+    L->integers[L->top] = (type == LUA_TNUMBER) && isInteger ;
+    L->top++ ;
+}
+
+__attribute__((noinline, unused)) static int lua_gettop(lua_State *L) {
+    return L->top ;
+}
+
+__attribute__((noinline, unused)) static int lua_type(lua_State *L, int idx) {
+    if (idx < 0) idx = L->top + idx + 1 ;
+    return (idx >= 1 && idx <= L->top) ? L->types[idx - 1] : LUA_TNONE ;
+}
+
+__attribute__((noinline, unused)) static int lua_isinteger(lua_State *L, int idx) {
+    return lua_type(L, idx) == LUA_TNUMBER && L->integers[(idx < 0 ? L->top + idx + 1 : idx) - 1] ;
+}
+
+static inline bool lua_stub_checkArgsList(lua_State *L, va_list masks) {
+    int idx  = 1 ;
+    int mask = va_arg(masks, int) ;
+    for ( ; !(mask & LS_TBREAK) ; mask = va_arg(masks, int), idx++) {
+        int type = lua_type(L, idx) ;
+        if (mask & LS_TUSERDATA) (void)va_arg(masks, const char *) ;
+        if (type == LUA_TNONE) {
+            if (mask & (LS_TNONE | LS_TOPTIONAL)) continue ;
+            return false ;
+        }
+        if (mask & LS_TANY) continue ;
+        int typeMask = 0 ;
+        switch (type) {
+            case LUA_TNIL:      typeMask = LS_TNIL ;      break ;
+            case LUA_TBOOLEAN:  typeMask = LS_TBOOLEAN ;  break ;
+            case LUA_TNUMBER:   typeMask = LS_TNUMBER ;   break ;
+            case LUA_TSTRING:   typeMask = LS_TSTRING ;   break ;
+            case LUA_TTABLE:    typeMask = LS_TTABLE ;    break ;
+            case LUA_TFUNCTION: typeMask = LS_TFUNCTION ; break ;
+            case LUA_TUSERDATA: typeMask = LS_TUSERDATA ; break ;
+            default:            break ;
+        }
+        if (!(mask & typeMask)) return false ;
+        if (type == LUA_TNUMBER && (mask & LS_TINTEGER) && !lua_isinteger(L, idx)) return false ;
+    }
+    // LS_TVARARG with the break allows any number of further arguments
+    return (mask & LS_TVARARG) || idx > lua_gettop(L) ;
+}
+
+__attribute__((noinline, unused)) static bool lua_stub_checkArgs(lua_State *L, ...) {
+    va_list masks ;
+    va_start(masks, L) ;
+    bool ok = lua_stub_checkArgsList(L, masks) ;
+    va_end(masks) ;
+    return ok ;
+}
@@ -0,0 +1,119 @@
+//
+// test.h
+// A minimal harness for the tests of the plain C cores
+//
+// Each test_*.c file is a separate program which defines its cases with TEST, runs them from main with
+// RUN_TEST and returns test_finish(). A failed check is reported with its location and the test keeps
+// going, so one run shows every failure.
+
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int test_checks   = 0 ;
+static int test_failures = 0 ;
+
+#define TEST(name) static void name(void)
+
+#define RUN_TEST(name) do {                                                                            \
+    int _test_before = test_failures ;                                                                 \
+    name() ;                                                                                           \
+    printf("%s %s\n", (test_failures == _test_before) ? "  ok  " : "  FAIL", #name) ;                  \
+} while (0)
+
+#define CHECK(cond) do {                                                                               \
+    test_checks++ ;                                                                                    \
+    if (!(cond)) {                                                                                     \
+        test_failures++ ;                                                                              \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond) ;                      \
+    }                                                                                                  \
+} while (0)
+
+#define CHECK_INT(actual, expected) do {                                                               \
+    long long _test_a = (long long)(actual), _test_e = (long long)(expected) ;                         \
+    test_checks++ ;                                                                                    \
+    if (_test_a != _test_e) {                                                                          \
+        test_failures++ ;                                                                              \
+        fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual,            \
+                _test_a, _test_e) ;                                                                    \
+    }                                                                                                  \
+} while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance) do {                                                   \
+    double _test_a = (double)(actual), _test_e = (double)(expected) ;                                  \
+    test_checks++ ;                                                                                    \
+    if (!(_test_a >= _test_e - (tolerance) && _test_a <= _test_e + (tolerance))) {                     \
+        test_failures++ ;                                                                              \
+        fprintf(stderr, "%s:%d: %s is %g, expected %g +/- %g\n", __FILE__, __LINE__, #actual,          \
+                _test_a, _test_e, (double)(tolerance)) ;                                               \
+    }                                                                                                  \
+} while (0)
+
+#define CHECK_STR(actual, expected) do {                                                               \
+    const char *_test_a = (actual), *_test_e = (expected) ;                                            \
+    test_checks++ ;                                                                                    \
+    if (!_test_a || !_test_e || strcmp(_test_a, _test_e) != 0) {                                       \
+        test_failures++ ;                                                                              \
+        fprintf(stderr, "%s:%d: %s is \"%s\", expected \"%s\"\n", __FILE__, __LINE__, #actual,         \
+                _test_a ? _test_a : "(null)", _test_e ? _test_e : "(null)") ;                          \
+    }                                                                                                  \
+} while (0)
+
+// a deterministic generator so failures can be reproduced
+static uint64_t test_randomState = 0x9E3779B97F4A7C15ULL ;
+
+static inline void test_seed(uint64_t seed) {
+    test_randomState = seed ? seed : 0x9E3779B97F4A7C15ULL ;
+}
+
+static inline uint32_t test_random(void) {
+    test_randomState ^= test_randomState << 13 ;
+    test_randomState ^= test_randomState >> 7 ;
+    test_randomState ^= test_randomState << 17 ;
+    return (uint32_t)(test_randomState >> 32) ;
+}
+
+// a uniformly distributed value in [0, 1)
+static inline double test_uniform(void) {
+    return (double)test_random() / 4294967296.0 ;
+}
+
+// fixtures live in test/fixtures; the benchmarks, which run from bench/, point this at ../test/fixtures
+#ifndef TEST_FIXTURES
+#define TEST_FIXTURES "fixtures"
+#endif
+
+// reads a whole fixture into a NUL terminated buffer which the caller frees, or returns NULL
+static inline char *test_readFixture(const char *name, size_t *length) {
+    char path[512] ;
+    snprintf(path, sizeof(path), "%s/%s", TEST_FIXTURES, name) ;
+    FILE *file = fopen(path, "rb") ;
+    if (!file) {
+        fprintf(stderr, "unable to open fixture %s\n", path) ;
+        return NULL ;
+    }
+    fseek(file, 0, SEEK_END) ;
+    long size = ftell(file) ;
+    fseek(file, 0, SEEK_SET) ;
+    char *bytes = (size >= 0) ? malloc((size_t)size + 1) : NULL ;
+    if (bytes && fread(bytes, 1, (size_t)size, file) != (size_t)size) {
+        free(bytes) ;
+        bytes = NULL ;
+    }
+    fclose(file) ;
+    if (bytes) {
+        bytes[size] = 0 ;
+        *length     = (size_t)size ;
+    }
+    return bytes ;
+}
+
+static inline int test_finish(const char *suite) {
+    printf("%s: %d checks, %d failed\n", suite, test_checks, test_failures) ;
+    return test_failures ? EXIT_FAILURE : EXIT_SUCCESS ;
+}
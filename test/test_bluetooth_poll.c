@@ -0,0 +1,123 @@
+//
+// test_bluetooth_poll.c
+// bt_state_wait against a fake controller which takes a while to reach the state it was set to
+
+#include "test.h"
+#include "bluetooth/bt_state.h"
+
+typedef struct {
+    double now ;        // the virtual clock
+    int    state ;      // what the getter reports
+    int    pending ;    // the state being moved to, or -1
+    double settleAt ;   // when pending becomes state
+    int    queries ;
+} fakeController ;
+
+static void fake_set(fakeController *fake, int state, double delay) {
+    fake->pending  = state ;
+    fake->settleAt = fake->now + delay ;
+}
+
+static int fake_get(void *context) {
+    fakeController *fake = context ;
+    fake->queries++ ;
+    if (fake->pending >= 0 && fake->now >= fake->settleAt) {
+        fake->state   = fake->pending ;
+        fake->pending = -1 ;
+    }
+    return fake->state ;
+}
+
+static double fake_now(void *context) {
+    return ((fakeController *)context)->now ;
+}
+
+static void fake_sleep(void *context, double seconds) {
+    ((fakeController *)context)->now += seconds ;
+}
+
+static bt_controller fake_controller(fakeController *fake) {
+    *fake = (fakeController){ .now = 100.0, .state = 0, .pending = -1 } ;
+    return (bt_controller){ fake_get, fake_now, fake_sleep, fake } ;
+}
+
+TEST(backoffGrowsToTheMaximum) {
+    bt_poll poll ;
+    bt_poll_start(&poll, 0.0, BT_SYNC_TIMEOUT) ;
+    CHECK_NEAR(bt_poll_next(&poll), 0.05,   1e-9) ;
+    CHECK_NEAR(bt_poll_next(&poll), 0.075,  1e-9) ;
+    CHECK_NEAR(bt_poll_next(&poll), 0.1125, 1e-9) ;
+    for (int i = 0 ; i < 20 ; i++) bt_poll_next(&poll) ;
+    CHECK_NEAR(bt_poll_next(&poll), BT_POLL_MAX_INTERVAL, 1e-9) ;
+    CHECK(!bt_poll_expired(&poll, 0.999)) ;
+    CHECK(bt_poll_expired(&poll, 1.0)) ;
+}
+
+TEST(returnsOnceTheStateSettles) {
+    fakeController fake ;
+    bt_controller  controller = fake_controller(&fake) ;
+    fake_set(&fake, 1, 0.3) ;
+
+    double start = fake.now ;
+    CHECK_INT(bt_state_wait(&controller, 1, BT_SYNC_TIMEOUT), 1) ;
+    double elapsed = fake.now - start ;
+    // queries at 0.05, 0.125, 0.2375, 0.40625
+    CHECK_NEAR(elapsed, 0.40625, 1e-9) ;
+    CHECK_INT(fake.queries, 4) ;
+}
+
+TEST(returnsAfterOneQueryWhenAlreadyThere) {
+    fakeController fake ;
+    bt_controller  controller = fake_controller(&fake) ;
+    fake.state = 1 ;
+
+    double start = fake.now ;
+    CHECK_INT(bt_state_wait(&controller, 1, BT_SYNC_TIMEOUT), 1) ;
+    CHECK_NEAR(fake.now - start, BT_POLL_INITIAL_INTERVAL, 1e-9) ;
+    CHECK_INT(fake.queries, 1) ;
+}
+
+TEST(givesUpAtTheTimeout) {
+    fakeController fake ;
+    bt_controller  controller = fake_controller(&fake) ;
+    fake_set(&fake, 1, 60.0) ;
+
+    double start = fake.now ;
+    CHECK_INT(bt_state_wait(&controller, 1, BT_SYNC_TIMEOUT), 0) ;
+    double elapsed = fake.now - start ;
+    CHECK(elapsed >= BT_SYNC_TIMEOUT) ;
+    CHECK(elapsed < BT_SYNC_TIMEOUT + BT_POLL_MAX_INTERVAL) ;
+}
+
+// over a range of settle delays the change is seen within one (bounded) backoff interval of happening, and
+// with far fewer queries than fixed 50ms polling would need
+TEST(detectionLatencyIsBounded) {
+    double worstLateness = 0.0, totalLateness = 0.0 ;
+    int    totalQueries  = 0, runs = 0 ;
+    for (double delay = 0.0 ; delay < 5.0 ; delay += 0.01, runs++) {
+        fakeController fake ;
+        bt_controller  controller = fake_controller(&fake) ;
+        fake_set(&fake, 1, delay) ;
+
+        double start = fake.now ;
+        CHECK_INT(bt_state_wait(&controller, 1, BT_ASYNC_TIMEOUT), 1) ;
+        double lateness = (fake.now - start) - delay ;
+        CHECK(lateness >= -1e-9) ;
+        CHECK(lateness <= fmin(delay * (BT_POLL_BACKOFF - 1.0) + BT_POLL_INITIAL_INTERVAL, BT_POLL_MAX_INTERVAL) + 1e-9) ;
+        CHECK(fake.queries <= (int)(delay / BT_POLL_MAX_INTERVAL) + 8) ;
+        if (lateness > worstLateness) worstLateness = lateness ;
+        totalLateness += lateness ;
+        totalQueries  += fake.queries ;
+    }
+    printf("        settle delays 0-5s: mean lateness %.1f ms, worst %.1f ms, mean %.1f queries\n",
+           totalLateness / runs * 1000.0, worstLateness * 1000.0, (double)totalQueries / runs) ;
+}
+
+int main(void) {
+    RUN_TEST(backoffGrowsToTheMaximum) ;
+    RUN_TEST(returnsOnceTheStateSettles) ;
+    RUN_TEST(returnsAfterOneQueryWhenAlreadyThere) ;
+    RUN_TEST(givesUpAtTheTimeout) ;
+    RUN_TEST(detectionLatencyIsBounded) ;
+    return test_finish("bluetooth poll") ;
+}
@@ -0,0 +1,248 @@
+//
+// test_bluetooth_queue.c
+// The bt_queue coalescing state machine against a fake controller whose sets are queued, like the sets
+// issued on the bluetooth lane, and take a while to be reported by the getter
+
+#include "test.h"
+#include "bluetooth/bt_state.h"
+
+#define FAKE_MAX_PENDING 64
+
+typedef struct {
+    double now ;
+    int    state ;
+    struct { double at ; int state ; } pending[FAKE_MAX_PENDING] ;
+    size_t pendingHead ;
+    size_t pendingCount ;
+    double lastEffect ;
+    int    sets ;
+} fakeController ;
+
+static void fake_settle(fakeController *fake) {
+    while (fake->pendingCount > 0 && fake->pending[fake->pendingHead].at <= fake->now) {
+        fake->state       = fake->pending[fake->pendingHead].state ;
+        fake->pendingHead = (fake->pendingHead + 1) % FAKE_MAX_PENDING ;
+        fake->pendingCount-- ;
+    }
+}
+
+// sets take effect in the order they were made, delay seconds from now but never before an earlier set
+static void fake_set(fakeController *fake, int state, double delay) {
+    fake_settle(fake) ;
+    double at = fmax(fake->now + delay, fake->lastEffect) ;
+    size_t slot = (fake->pendingHead + fake->pendingCount) % FAKE_MAX_PENDING ;
+    fake->pending[slot].at    = at ;
+    fake->pending[slot].state = state ;
+    fake->pendingCount++ ;
+    fake->lastEffect = at ;
+    fake->sets++ ;
+}
+
+static int fake_get(void *context) {
+    fakeController *fake = context ;
+    fake_settle(fake) ;
+    return fake->state ;
+}
+
+static double fake_now(void *context) {
+    return ((fakeController *)context)->now ;
+}
+
+static void fake_sleep(void *context, double seconds) {
+    ((fakeController *)context)->now += seconds ;
+}
+
+static bt_controller fake_controller(fakeController *fake, int state) {
+    *fake = (fakeController){ .now = 10.0, .state = state } ;
+    return (bt_controller){ fake_get, fake_now, fake_sleep, fake } ;
+}
+
+// the case the queue used to get wrong: the getter still reports the state from before the first set when
+// the first poll runs, which happens to be the state requested second
+TEST(waitsForTheInFlightSetToLand) {
+    fakeController fake ;
+    bt_controller  controller = fake_controller(&fake, 0) ;
+    bt_queue       queue      = BT_QUEUE_INIT ;
+
+    CHECK_INT(bt_queue_request(&queue, &controller, 1), BT_QUEUE_APPLY) ;
+    fake_set(&fake, queue.inFlight, 0.3) ;
+    CHECK_INT(bt_queue_request(&queue, &controller, 0), BT_QUEUE_COALESCED) ;
+
+    fake.now += bt_poll_next(&queue.poll) ;
+    CHECK_INT(bt_queue_poll(&queue, &controller), BT_QUEUE_WAIT) ;
+    CHECK_INT(queue.inFlight, 1) ;
+
+    fake.now += 0.3 ;
+    CHECK_INT(bt_queue_poll(&queue, &controller), BT_QUEUE_APPLY) ;
+    CHECK_INT(queue.inFlight, 0) ;
+    fake_set(&fake, queue.inFlight, 0.1) ;
+
+    fake.now += bt_poll_next(&queue.poll) ;
+    CHECK_INT(bt_queue_poll(&queue, &controller), BT_QUEUE_WAIT) ;
+    fake.now += 0.1 ;
+    CHECK_INT(bt_queue_poll(&queue, &controller), BT_QUEUE_SETTLED) ;
+    CHECK_INT(queue.observed, 0) ;
+    CHECK_INT(fake.pendingCount, 0) ;
+    CHECK_INT(queue.received, 2) ;
+    CHECK_INT(queue.coalesced, 1) ;
+    CHECK_INT(queue.applied, 2) ;
+}
+
+TEST(cancellingBurstAppliesOnce) {
+    fakeController fake ;
+    bt_controller  controller = fake_controller(&fake, 0) ;
+    bt_queue       queue      = BT_QUEUE_INIT ;
+
+    CHECK_INT(bt_queue_request(&queue, &controller, 1), BT_QUEUE_APPLY) ;
+    fake_set(&fake, queue.inFlight, 0.2) ;
+    CHECK_INT(bt_queue_request(&queue, &controller, 0), BT_QUEUE_COALESCED) ;
+    CHECK_INT(bt_queue_request(&queue, &controller, 1), BT_QUEUE_COALESCED) ;
+
+    bt_queue_action action ;
+    do {
+        fake.now += bt_poll_next(&queue.poll) ;
+        action = bt_queue_poll(&queue, &controller) ;
+    } while (action == BT_QUEUE_WAIT) ;
+    CHECK_INT(action, BT_QUEUE_SETTLED) ;
+    CHECK_INT(queue.observed, 1) ;
+    CHECK_INT(fake.sets, 1) ;
+    CHECK_INT(queue.applied, 1) ;
+    CHECK_INT(queue.coalesced, 2) ;
+}
+
+TEST(alreadyThereResolvesOnThePoll) {
+    fakeController fake ;
+    bt_controller  controller = fake_controller(&fake, 1) ;
+    bt_queue       queue      = BT_QUEUE_INIT ;
+
+    CHECK_INT(bt_queue_request(&queue, &controller, 1), BT_QUEUE_WAIT) ;
+    fake.now += bt_poll_next(&queue.poll) ;
+    CHECK_INT(bt_queue_poll(&queue, &controller), BT_QUEUE_SETTLED) ;
+    CHECK_INT(fake.sets, 0) ;
+    CHECK(!queue.busy) ;
+}
+
+TEST(setWhichNeverLandsTimesOut) {
+    fakeController fake ;
+    bt_controller  controller = fake_controller(&fake, 0) ;
+    bt_queue       queue      = BT_QUEUE_INIT ;
+
+    CHECK_INT(bt_queue_request(&queue, &controller, 1), BT_QUEUE_APPLY) ;
+    // the set is lost
+    bt_queue_action action ;
+    int             polls = 0 ;
+    do {
+        fake.now += bt_poll_next(&queue.poll) ;
+        action = bt_queue_poll(&queue, &controller) ;
+        polls++ ;
+    } while (action == BT_QUEUE_WAIT) ;
+    CHECK_INT(action, BT_QUEUE_TIMEDOUT) ;
+    CHECK_INT(queue.observed, 0) ;
+    CHECK(!queue.busy) ;
+    CHECK_INT(queue.inFlight, -1) ;
+    CHECK(polls < 40) ;
+}
+
+TEST(waitingRequestTakesOverTheInFlightSet) {
+    fakeController fake ;
+    bt_controller  controller = fake_controller(&fake, 0) ;
+    bt_queue       queue      = BT_QUEUE_INIT ;
+
+    CHECK_INT(bt_queue_request(&queue, &controller, 1), BT_QUEUE_APPLY) ;
+    fake_set(&fake, queue.inFlight, 0.2) ;
+    CHECK(bt_queue_requestNow(&queue, &controller, 0)) ;
+    fake_set(&fake, 0, 0.1) ;
+    CHECK_INT(bt_state_wait(&controller, 0, BT_SYNC_TIMEOUT), 0) ;
+
+    fake.now += bt_poll_next(&queue.poll) ;
+    CHECK_INT(bt_queue_poll(&queue, &controller), BT_QUEUE_SETTLED) ;
+    CHECK_INT(queue.observed, 0) ;
+    CHECK_INT(fake.sets, 2) ;
+
+    CHECK(!bt_queue_requestNow(&queue, &controller, 0)) ;
+}
+
+// Thousands of interleaved requests at random times, with sets that take a random time to be issued on the
+// lane and to settle. Every time the callbacks are resolved as settled, the controller has no set left to
+// apply and is in the most recently requested state, so the state passed to the callbacks is final.
+TEST(stressInterleavedToggles) {
+    const int requests = 20000 ;
+    test_seed(2002) ;
+
+    fakeController fake ;
+    bt_controller  controller = fake_controller(&fake, 0) ;
+    bt_queue       queue      = BT_QUEUE_INIT ;
+
+    double nextRequest   = fake.now ;
+    double nextPoll      = INFINITY ;
+    int    made          = 0 ;
+    int    waiting       = 0 ;   // callbacks not resolved yet
+    int    resolved      = 0 ;
+    int    settled       = 0 ;
+    int    timedOut      = 0 ;
+    int    lastRequested = 0 ;
+
+    while (made < requests || nextPoll < INFINITY) {
+        if (made < requests && nextRequest <= nextPoll) {
+            fake.now      = nextRequest ;
+            lastRequested = (int)(test_random() & 1) ;
+            made++ ;
+            waiting++ ;
+            bt_queue_action action = bt_queue_request(&queue, &controller, lastRequested) ;
+            if (action == BT_QUEUE_APPLY) fake_set(&fake, queue.inFlight, test_uniform() * 0.5) ;
+            if (action == BT_QUEUE_APPLY || action == BT_QUEUE_WAIT) nextPoll = fake.now + bt_poll_next(&queue.poll) ;
+            // bursts of requests a few milliseconds apart, separated by quiet periods
+            nextRequest = fake.now + ((test_random() % 8) ? test_uniform() * 0.01 : test_uniform() * 2.0) ;
+        } else {
+            fake.now = nextPoll ;
+            nextPoll = INFINITY ;
+            bt_queue_action action = bt_queue_poll(&queue, &controller) ;
+            switch (action) {
+                case BT_QUEUE_APPLY:
+                    fake_set(&fake, queue.inFlight, test_uniform() * 0.5) ;
+                    nextPoll = fake.now + bt_poll_next(&queue.poll) ;
+                    break ;
+                case BT_QUEUE_WAIT:
+                    nextPoll = fake.now + bt_poll_next(&queue.poll) ;
+                    break ;
+                case BT_QUEUE_SETTLED:
+                    CHECK_INT(queue.observed, lastRequested) ;
+                    CHECK_INT(fake.pendingCount, 0) ;
+                    resolved += waiting ;
+                    waiting   = 0 ;
+                    settled++ ;
+                    break ;
+                case BT_QUEUE_TIMEDOUT:
+                    resolved += waiting ;
+                    waiting   = 0 ;
+                    timedOut++ ;
+                    break ;
+                case BT_QUEUE_COALESCED:
+                    CHECK(false) ;
+                    break ;
+            }
+        }
+    }
+
+    CHECK_INT(waiting, 0) ;
+    CHECK_INT(resolved, requests) ;
+    CHECK_INT(timedOut, 0) ;
+    CHECK(!queue.busy) ;
+    CHECK_INT(fake_get(&fake), lastRequested) ;
+    CHECK_INT(fake.pendingCount, 0) ;
+    CHECK_INT(queue.received, requests) ;
+    CHECK_INT(queue.applied, fake.sets) ;
+    CHECK(queue.applied < (uint64_t)requests / 2) ;
+    printf("        %d requests: %d resolutions, %" PRIu64 " coalesced, %" PRIu64 " applied\n",
+           requests, settled, queue.coalesced, queue.applied) ;
+}
+
+int main(void) {
+    RUN_TEST(waitsForTheInFlightSetToLand) ;
+    RUN_TEST(cancellingBurstAppliesOnce) ;
+    RUN_TEST(alreadyThereResolvesOnThePoll) ;
+    RUN_TEST(setWhichNeverLandsTimesOut) ;
+    RUN_TEST(waitingRequestTakesOverTheInFlightSet) ;
+    RUN_TEST(stressInterleavedToggles) ;
+    return test_finish("bluetooth queue") ;
+}
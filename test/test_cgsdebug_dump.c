@@ -0,0 +1,475 @@
+//
+// test_cgsdebug_dump.c
+// Indexing and parsing the WindowServer dump files, using the recorded layouts in test/fixtures
+
+#include "test.h"
+#include "cgsdebug/cgsdebug_dump.h"
+
+static dump_index index_of(const char *bytes, size_t length) {
+    dump_index index = { NULL, 0, 0 } ;
+    CHECK(dump_index_build(&index, bytes, length)) ;
+    return index ;
+}
+
+static void header_of(const char *bytes, dump_record record, char *header, size_t size) {
+    dump_cursor cursor = dump_cursor_make(bytes + record.offset, record.length) ;
+    dump_line   line ;
+    header[0] = 0 ;
+    if (dump_cursor_next(&cursor, &line) && line.kind == kDumpLineHeader) {
+        snprintf(header, size, "%.*s", (int)line.valueLength, line.value) ;
+    }
+}
+
+// counts the lines of each kind in a record, and finds the value of one key
+static void count_lines(const char *bytes, dump_record record, int counts[3], const char *key, char *value, size_t size) {
+    dump_cursor cursor = dump_cursor_make(bytes + record.offset, record.length) ;
+    dump_line   line ;
+    counts[0] = counts[1] = counts[2] = 0 ;
+    if (value) value[0] = 0 ;
+    while (dump_cursor_next(&cursor, &line)) {
+        counts[line.kind]++ ;
+        if (value && line.kind == kDumpLineField && line.keyLength == strlen(key) && !memcmp(line.key, key, line.keyLength))
+            snprintf(value, size, "%.*s", (int)line.valueLength, line.value) ;
+    }
+}
+
+typedef struct {
+    uint64_t ids[3][64] ;
+    size_t   counts[3] ;
+} diff_result ;
+
+static void diff_collect(void *context, dump_change change, uint64_t windowID) {
+    diff_result *result = context ;
+    if (result->counts[change] < 64) result->ids[change][result->counts[change]] = windowID ;
+    result->counts[change]++ ;
+}
+
+static int compare_ids(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b ;
+    return (x > y) - (x < y) ;
+}
+
+static void diff_sort(diff_result *result) {
+    for (int c = 0 ; c < 3 ; c++) {
+        size_t count = result->counts[c] < 64 ? result->counts[c] : 64 ;
+        qsort(result->ids[c], count, sizeof(uint64_t), compare_ids) ;
+    }
+}
+
+TEST(windowListFixture) {
+    size_t length ;
+    char   *bytes = test_readFixture("WindowServer.winfo.out", &length) ;
+    CHECK(bytes != NULL) ;
+    if (!bytes) return ;
+
+    dump_index index = index_of(bytes, length) ;
+    char       header[128], value[128] ;
+    int        counts[3] ;
+    CHECK_INT(index.count, 41) ;
+    header_of(bytes, index.records[0], header, sizeof(header)) ;
+    CHECK_STR(header, "Window List") ;
+    header_of(bytes, index.records[1], header, sizeof(header)) ;
+    CHECK_STR(header, "Window 0x64 (100)") ;
+    header_of(bytes, index.records[40], header, sizeof(header)) ;
+    CHECK_STR(header, "Window 0x175 (373)") ;
+
+    count_lines(bytes, index.records[1], counts, "bounds", value, sizeof(value)) ;
+    CHECK_INT(counts[kDumpLineHeader], 1) ;
+    CHECK_INT(counts[kDumpLineField], 13) ;
+    CHECK_STR(value, "{{308, 429}, {298, 174}}") ;
+
+    // every window has a wid field which is an integer, and an alpha which is a number
+    for (size_t i = 1 ; i < index.count ; i++) {
+        long long integer = 0 ;
+        double    number  = 0 ;
+        count_lines(bytes, index.records[i], counts, "wid", value, sizeof(value)) ;
+        CHECK_INT(dump_parseValue(value, strlen(value), &integer, &number), kDumpValueInteger) ;
+        CHECK_INT(integer, 100 + (long long)(i - 1) * 7) ;
+        count_lines(bytes, index.records[i], counts, "alpha", value, sizeof(value)) ;
+        CHECK_INT(dump_parseValue(value, strlen(value), &integer, &number), kDumpValueNumber) ;
+        CHECK_NEAR(number, 1.0, 1e-9) ;
+        // the last character of an entry is never a newline, and entries never overlap
+        CHECK(bytes[index.records[i].offset + index.records[i].length - 1] != '\n') ;
+        CHECK(index.records[i].offset > index.records[i - 1].offset + index.records[i - 1].length) ;
+    }
+
+    dump_index_free(&index) ;
+    free(bytes) ;
+}
+
+TEST(otherDumpFixtures) {
+    static const struct {
+        const char *name ;
+        size_t     count ;
+        const char *firstHeader ;
+        int        fields ;   // in the second entry
+        int        text ;
+    } fixtures[] = {
+        { "WindowServer.cinfo.out",  11, "Connection List",                 6, 0 },
+        { "WindowServer.shinfo.out", 13, "Shadow List",                     5, 0 },
+        { "WindowServer.sinfo.out",  16, "Surface 0x5000 for window 100",   4, 1 },
+    } ;
+    for (size_t f = 0 ; f < sizeof(fixtures) / sizeof(fixtures[0]) ; f++) {
+        size_t length ;
+        char   *bytes = test_readFixture(fixtures[f].name, &length) ;
+        CHECK(bytes != NULL) ;
+        if (!bytes) continue ;
+
+        dump_index index = index_of(bytes, length) ;
+        char       header[128] ;
+        int        counts[3] ;
+        CHECK_INT(index.count, fixtures[f].count) ;
+        header_of(bytes, index.records[0], header, sizeof(header)) ;
+        CHECK_STR(header, fixtures[f].firstHeader) ;
+        count_lines(bytes, index.records[1], counts, "", NULL, 0) ;
+        CHECK_INT(counts[kDumpLineField], fixtures[f].fields) ;
+        CHECK_INT(counts[kDumpLineText], fixtures[f].text) ;
+        dump_index_free(&index) ;
+        free(bytes) ;
+    }
+}
+
+TEST(edgeCases) {
+    dump_index index = index_of("", 0) ;
+    CHECK_INT(index.count, 0) ;
+    dump_index_free(&index) ;
+
+    index = index_of("\n\n   \n\t\n", 8) ;
+    CHECK_INT(index.count, 0) ;
+    dump_index_free(&index) ;
+
+    // no trailing newline, CRLF line endings, a header with no body, and an indented line with no header
+    const char *text = "  orphan: 1\r\nA\r\n  key = value \r\nB\n\nC 12\n  x: 0x1f\n  y: -3.5e2\n  free text\n  : no key" ;
+    index = index_of(text, strlen(text)) ;
+    CHECK_INT(index.count, 4) ;
+
+    char header[64], value[64] ;
+    int  counts[3] ;
+    header_of(text, index.records[0], header, sizeof(header)) ;
+    CHECK_STR(header, "orphan: 1") ;
+    CHECK_INT(index.records[1].length, strlen("A\r\n  key = value \r")) ;
+    count_lines(text, index.records[1], counts, "key", value, sizeof(value)) ;
+    CHECK_STR(value, "value") ;
+    header_of(text, index.records[2], header, sizeof(header)) ;
+    CHECK_STR(header, "B") ;
+    count_lines(text, index.records[3], counts, "x", value, sizeof(value)) ;
+    CHECK_INT(counts[kDumpLineField], 2) ;
+    CHECK_INT(counts[kDumpLineText], 2) ;
+
+    long long integer = 0 ;
+    double    number  = 0 ;
+    CHECK_INT(dump_parseValue("0x1f", 4, &integer, &number), kDumpValueInteger) ;
+    CHECK_INT(integer, 31) ;
+    CHECK_INT(dump_parseValue("-3.5e2", 6, &integer, &number), kDumpValueNumber) ;
+    CHECK_NEAR(number, -350.0, 1e-9) ;
+    CHECK_INT(dump_parseValue("12 windows", 10, &integer, &number), kDumpValueString) ;
+    CHECK_INT(dump_parseValue("", 0, &integer, &number), kDumpValueString) ;
+    dump_index_free(&index) ;
+}
+
+// values which strtoll and strtod would read with a guessed base or as special numbers
+TEST(valueFixture) {
+    static const struct {
+        const char     *key ;
+        dump_valueKind kind ;
+        long long      integer ;
+        double         number ;
+    } expected[] = {
+        { "id",            kDumpValueInteger, 69,  0 },
+        { "unit",          kDumpValueInteger, 8,   0 },
+        { "serial",        kDumpValueInteger, 0,   0 },
+        { "depth",         kDumpValueInteger, -10, 0 },
+        { "refresh",       kDumpValueNumber,  0,   59.94 },
+        { "scale",         kDumpValueNumber,  0,   2.0 },
+        { "gamma",         kDumpValueNumber,  0,   0.45 },
+        { "brightness",    kDumpValueNumber,  0,   0.01 },
+        { "offset",        kDumpValueInteger, 7,   0 },
+        { "flags",         kDumpValueInteger, 16,  0 },
+        { "mask",          kDumpValueInteger, 255, 0 },
+        { "options",       kDumpValueInteger, -1,  0 },
+        { "frames",        kDumpValueNumber,  0,   18446744073709551616.0 },
+        { "hdr",           kDumpValueString,  0,   0 },
+        { "headroom",      kDumpValueString,  0,   0 },
+        { "max luminance", kDumpValueString,  0,   0 },
+        { "min luminance", kDumpValueString,  0,   0 },
+        { "transfer",      kDumpValueString,  0,   0 },
+        { "profile",       kDumpValueString,  0,   0 },
+        { "mode",          kDumpValueString,  0,   0 },
+        { "position",      kDumpValueString,  0,   0 },
+        { "label",         kDumpValueString,  0,   0 },
+    } ;
+    size_t length ;
+    char   *bytes = test_readFixture("WindowServer.values.out", &length) ;
+    CHECK(bytes != NULL) ;
+    if (!bytes) return ;
+
+    dump_index index = index_of(bytes, length) ;
+    CHECK_INT(index.count, 2) ;
+    dump_cursor cursor = dump_cursor_make(bytes + index.records[1].offset, index.records[1].length) ;
+    dump_line   line ;
+    size_t      fields = 0 ;
+    while (dump_cursor_next(&cursor, &line)) {
+        if (line.kind != kDumpLineField) continue ;
+        size_t i = fields++ ;
+        if (i >= sizeof(expected) / sizeof(expected[0])) break ;
+        CHECK(line.keyLength == strlen(expected[i].key) && memcmp(line.key, expected[i].key, line.keyLength) == 0) ;
+        long long integer = 0 ;
+        double    number  = 0 ;
+        dump_valueKind kind = dump_parseValue(line.value, line.valueLength, &integer, &number) ;
+        CHECK_INT(kind, expected[i].kind) ;
+        if (kind == kDumpValueInteger) CHECK_INT(integer, expected[i].integer) ;
+        if (kind == kDumpValueNumber) CHECK_NEAR(number, expected[i].number, 1e-9 * (1 + expected[i].number)) ;
+    }
+    CHECK_INT(fields, sizeof(expected) / sizeof(expected[0])) ;
+
+    // window ids in headers are read the same way
+    uint64_t windowID = 0 ;
+    CHECK(dump_windowIDForRecord("Window 010", 10, &windowID)) ;
+    CHECK_INT(windowID, 10) ;
+    CHECK(dump_windowIDForRecord("Window 0x1A\n  wid: 0x20", 23, &windowID)) ;
+    CHECK_INT(windowID, 32) ;
+    CHECK(dump_windowIDForRecord("Window 08", 9, &windowID)) ;
+    CHECK_INT(windowID, 8) ;
+    CHECK(!dump_windowIDForRecord("Window 0x", 9, &windowID)) ;
+    CHECK(!dump_windowIDForRecord("Window 99999999999999999999", 27, &windowID)) ;
+
+    dump_index_free(&index) ;
+    free(bytes) ;
+}
+
+// random dumps with a known layout come back as the same entries
+TEST(randomDumpsRoundTrip) {
+    test_seed(7007) ;
+    char   *text    = malloc(1 << 20) ;
+    size_t headers[512] ;
+    int    fields[512] ;
+    for (int round = 0 ; round < 200 ; round++) {
+        size_t length  = 0 ;
+        int    entries = 1 + (int)(test_random() % 500) ;
+        for (int e = 0 ; e < entries ; e++) {
+            headers[e] = length ;
+            fields[e]  = (int)(test_random() % 6) ;
+            length += (size_t)sprintf(text + length, "Entry %d", e) ;
+            for (int k = 0 ; k < fields[e] ; k++) {
+                length += (size_t)sprintf(text + length, "\n%s%s%d %s %u", (test_random() & 1) ? "\t" : "    ",
+                                          "key", k, (test_random() & 1) ? ":" : "=", test_random()) ;
+            }
+            switch (test_random() % 3) {
+                case 0: text[length++] = '\n' ; break ;
+                case 1: length += (size_t)sprintf(text + length, "\n\n") ; break ;
+                case 2: length += (size_t)sprintf(text + length, "\n   \n") ; break ;
+            }
+        }
+
+        dump_index index = index_of(text, length) ;
+        CHECK_INT(index.count, entries) ;
+        for (size_t e = 0 ; e < index.count && e < (size_t)entries ; e++) {
+            int counts[3] ;
+            CHECK_INT(index.records[e].offset, headers[e]) ;
+            count_lines(text, index.records[e], counts, "", NULL, 0) ;
+            CHECK_INT(counts[kDumpLineField], fields[e]) ;
+        }
+        dump_index_free(&index) ;
+    }
+    free(text) ;
+}
+
+// the after fixture drops window 135, changes 177, 247 and 338, adds 999 and moves the blank lines between
+// entries around, which must not count as a change
+TEST(windowListDiffFixture) {
+    size_t beforeLength, afterLength ;
+    char   *beforeBytes = test_readFixture("WindowServer.winfo.out", &beforeLength) ;
+    char   *afterBytes  = test_readFixture("WindowServer.winfo.after.out", &afterLength) ;
+    CHECK(beforeBytes != NULL && afterBytes != NULL) ;
+    if (!beforeBytes || !afterBytes) return ;
+
+    dump_index   beforeIndex = index_of(beforeBytes, beforeLength) ;
+    dump_index   afterIndex  = index_of(afterBytes, afterLength) ;
+    dump_windows before, after ;
+    CHECK(dump_windows_build(&before, beforeBytes, &beforeIndex)) ;
+    CHECK(dump_windows_build(&after, afterBytes, &afterIndex)) ;
+    CHECK_INT(before.count, 40) ; // the "Window List" preamble has no window id
+    CHECK_INT(after.count, 40) ;
+
+    const dump_windowSlot *slot = dump_windows_find(&before, 135) ;
+    CHECK(slot != NULL) ;
+    if (slot) CHECK_INT(slot->record, 6) ;
+    CHECK(dump_windows_find(&before, 999) == NULL) ;
+    CHECK(dump_windows_find(&after, 135) == NULL) ;
+
+    diff_result result = { 0 } ;
+    CHECK_INT(dump_windows_diff(&before, &after, diff_collect, &result), 5) ;
+    diff_sort(&result) ;
+    CHECK_INT(result.counts[kDumpWindowAdded], 1) ;
+    CHECK_INT(result.ids[kDumpWindowAdded][0], 999) ;
+    CHECK_INT(result.counts[kDumpWindowRemoved], 1) ;
+    CHECK_INT(result.ids[kDumpWindowRemoved][0], 135) ;
+    CHECK_INT(result.counts[kDumpWindowChanged], 3) ;
+    CHECK_INT(result.ids[kDumpWindowChanged][0], 177) ;
+    CHECK_INT(result.ids[kDumpWindowChanged][1], 247) ;
+    CHECK_INT(result.ids[kDumpWindowChanged][2], 338) ;
+
+    // a dump compared with itself has no differences
+    memset(&result, 0, sizeof(result)) ;
+    CHECK_INT(dump_windows_diff(&after, &after, diff_collect, &result), 0) ;
+
+    dump_windows_free(&before) ;
+    dump_windows_free(&after) ;
+    dump_index_free(&beforeIndex) ;
+    dump_index_free(&afterIndex) ;
+    free(beforeBytes) ;
+    free(afterBytes) ;
+}
+
+TEST(windowIDs) {
+    uint64_t windowID = 0 ;
+    const char *wid = "Window 0x10 (16)\n    owner: x\n    wid = 0x2a" ;
+    CHECK(dump_windowIDForRecord(wid, strlen(wid), &windowID)) ;
+    CHECK_INT(windowID, 42) ;
+    // "wid" inside another word isn't a key, so the header's first number is used
+    const char *header = "Window 77 (0x4d)\n    widget: 5\n    owidth: 3" ;
+    CHECK(dump_windowIDForRecord(header, strlen(header), &windowID)) ;
+    CHECK_INT(windowID, 77) ;
+    const char *none = "Window List\n    count: 40" ;
+    CHECK(!dump_windowIDForRecord(none, strlen(none), &windowID)) ;
+
+    // when an id appears twice, the later entry wins
+    const char *twice = "Window 1\n  a: 1\nWindow 2\nWindow 1\n  a: 2" ;
+    dump_index   index   = index_of(twice, strlen(twice)) ;
+    dump_windows windows ;
+    CHECK(dump_windows_build(&windows, twice, &index)) ;
+    CHECK_INT(windows.count, 2) ;
+    const dump_windowSlot *slot = dump_windows_find(&windows, 1) ;
+    CHECK(slot != NULL) ;
+    if (slot) CHECK_INT(slot->record, 2) ;
+    dump_windows_free(&windows) ;
+    dump_index_free(&index) ;
+
+    dump_windows empty = { 0 } ;
+    CHECK(dump_windows_find(&empty, 1) == NULL) ;
+}
+
+// a large list, reordered with a few edits: the digest tree is consistent, and the edits are all that's reported
+TEST(largeWindowListDiffs) {
+    enum { kWindows = 20000 } ;
+    char   *beforeText = malloc(kWindows * 48), *afterText = malloc(kWindows * 48) ;
+    size_t beforeLength = 0, afterLength = 0 ;
+    for (int w = 0 ; w < kWindows ; w++) {
+        beforeLength += (size_t)sprintf(beforeText + beforeLength, "Window %d\n    level: 0\n", w) ;
+    }
+    // reversed, with 7 and 19000 changed, 5 and 12345 removed, and 20000 added
+    for (int w = kWindows - 1 ; w >= 0 ; w--) {
+        if (w == 5 || w == 12345) continue ;
+        afterLength += (size_t)sprintf(afterText + afterLength, "Window %d\n    level: %d\n", w, (w == 7 || w == 19000)) ;
+    }
+    afterLength += (size_t)sprintf(afterText + afterLength, "Window %d\n", kWindows) ;
+
+    dump_index   beforeIndex = index_of(beforeText, beforeLength) ;
+    dump_index   afterIndex  = index_of(afterText, afterLength) ;
+    dump_windows before, after ;
+    CHECK(dump_windows_build(&before, beforeText, &beforeIndex)) ;
+    CHECK(dump_windows_build(&after, afterText, &afterIndex)) ;
+
+    size_t   leaves = (size_t)1 << before.depth ;
+    uint64_t sum    = 0 ;
+    CHECK(((size_t)DUMP_WINDOWS_LEAF_SIZE << before.depth) >= kWindows) ;
+    CHECK_INT(before.leafStart[leaves], kWindows) ;
+    for (size_t leaf = 0 ; leaf < leaves ; leaf++) {
+        CHECK(before.leafStart[leaf] <= before.leafStart[leaf + 1]) ;
+        for (uint32_t i = before.leafStart[leaf] ; i < before.leafStart[leaf + 1] ; i++) {
+            uint64_t key = dump_windowKey(before.ordered[i].windowID) ;
+            CHECK_INT(dump_keyPrefix(key, before.depth), leaf) ;
+            if (i > 0) CHECK(dump_windowKey(before.ordered[i - 1].windowID) < key) ;
+            sum += dump_windowDigest(&before.ordered[i]) ;
+        }
+    }
+    CHECK(sum == before.digests[0]) ;
+
+    diff_result result = { 0 } ;
+    CHECK_INT(dump_windows_diff(&before, &after, diff_collect, &result), 5) ;
+    diff_sort(&result) ;
+    CHECK_INT(result.counts[kDumpWindowAdded], 1) ;
+    CHECK_INT(result.ids[kDumpWindowAdded][0], kWindows) ;
+    CHECK_INT(result.counts[kDumpWindowRemoved], 2) ;
+    CHECK_INT(result.ids[kDumpWindowRemoved][0], 5) ;
+    CHECK_INT(result.ids[kDumpWindowRemoved][1], 12345) ;
+    CHECK_INT(result.counts[kDumpWindowChanged], 2) ;
+    CHECK_INT(result.ids[kDumpWindowChanged][0], 7) ;
+    CHECK_INT(result.ids[kDumpWindowChanged][1], 19000) ;
+
+    // against an index which was never built, everything is added or removed
+    dump_windows empty = { 0 } ;
+    memset(&result, 0, sizeof(result)) ;
+    CHECK_INT(dump_windows_diff(&empty, &before, diff_collect, &result), kWindows) ;
+    CHECK_INT(result.counts[kDumpWindowAdded], kWindows) ;
+    memset(&result, 0, sizeof(result)) ;
+    CHECK_INT(dump_windows_diff(&before, &empty, diff_collect, &result), kWindows) ;
+    CHECK_INT(result.counts[kDumpWindowRemoved], kWindows) ;
+
+    dump_windows_free(&before) ;
+    dump_windows_free(&after) ;
+    dump_index_free(&beforeIndex) ;
+    dump_index_free(&afterIndex) ;
+    free(beforeText) ;
+    free(afterText) ;
+}
+
+// random edits to a random window list are reported exactly
+TEST(randomWindowListDiffs) {
+    test_seed(8008) ;
+    enum { kWindows = 300 } ;
+    char    *beforeText = malloc(1 << 16), *afterText = malloc(1 << 16) ;
+    for (int round = 0 ; round < 200 ; round++) {
+        int    state[kWindows] ; // 0 unchanged, 1 removed, 2 changed
+        size_t beforeLength = 0, afterLength = 0, expected[3] = { 0 } ;
+        int    windows = 1 + (int)(test_random() % kWindows) ;
+        int    added   = (int)(test_random() % 5) ;
+        for (int w = 0 ; w < windows ; w++) {
+            state[w] = (test_random() % 10 == 0) ? 1 + (int)(test_random() % 2) : 0 ;
+            if (state[w] == 1) expected[kDumpWindowRemoved]++ ;
+            if (state[w] == 2) expected[kDumpWindowChanged]++ ;
+            beforeLength += (size_t)sprintf(beforeText + beforeLength, "Window %d\n    wid: %d\n    level: 0\n\n", w, 1000 + w) ;
+            if (state[w] != 1) {
+                afterLength += (size_t)sprintf(afterText + afterLength, "Window %d\n    wid: %d\n    level: %d\n", w, 1000 + w, state[w] == 2) ;
+            }
+        }
+        for (int a = 0 ; a < added ; a++) {
+            afterLength += (size_t)sprintf(afterText + afterLength, "Window %d\n    wid: %d\n", windows + a, 1000 + windows + a) ;
+        }
+        expected[kDumpWindowAdded] = (size_t)added ;
+
+        dump_index   beforeIndex = index_of(beforeText, beforeLength) ;
+        dump_index   afterIndex  = index_of(afterText, afterLength) ;
+        dump_windows before, after ;
+        CHECK(dump_windows_build(&before, beforeText, &beforeIndex)) ;
+        CHECK(dump_windows_build(&after, afterText, &afterIndex)) ;
+        diff_result result = { 0 } ;
+        dump_windows_diff(&before, &after, diff_collect, &result) ;
+        for (int c = 0 ; c < 3 ; c++) CHECK_INT(result.counts[c], expected[c]) ;
+        for (size_t i = 0 ; i < result.counts[kDumpWindowRemoved] && i < 64 ; i++) {
+            CHECK_INT(state[result.ids[kDumpWindowRemoved][i] - 1000], 1) ;
+        }
+        for (size_t i = 0 ; i < result.counts[kDumpWindowChanged] && i < 64 ; i++) {
+            CHECK_INT(state[result.ids[kDumpWindowChanged][i] - 1000], 2) ;
+        }
+        dump_windows_free(&before) ;
+        dump_windows_free(&after) ;
+        dump_index_free(&beforeIndex) ;
+        dump_index_free(&afterIndex) ;
+    }
+    free(beforeText) ;
+    free(afterText) ;
+}
+
+int main(void) {
+    RUN_TEST(windowListFixture) ;
+    RUN_TEST(otherDumpFixtures) ;
+    RUN_TEST(edgeCases) ;
+    RUN_TEST(valueFixture) ;
+    RUN_TEST(randomDumpsRoundTrip) ;
+    RUN_TEST(windowListDiffFixture) ;
+    RUN_TEST(windowIDs) ;
+    RUN_TEST(largeWindowListDiffs) ;
+    RUN_TEST(randomWindowListDiffs) ;
+    return test_finish("cgsdebug dump") ;
+}
@@ -0,0 +1,258 @@
+//
+// test_cgsdebug_plan.c
+// Planning and applying cgsdebug.setMask and cgsdebug.update against a recording WindowServer stub
+
+#include "test.h"
+#include "cgsdebug/cgsdebug_plan.h"
+
+// the stub WindowServer: every call is logged, and `intruder` lets another "process" change the options
+// when the stub is read for the nth time
+static uint32_t stubOptions ;
+static char     stubLog[512] ;
+static int      stubGets ;
+static int      failGet ;       // fail this get (1 based), 0 for never
+static bool     failSet ;
+static void     (*intruder)(int get) ;
+
+static void stub_log(const char *format, uint32_t value) {
+    char call[32] ;
+    snprintf(call, sizeof(call), format, value) ;
+    strncat(stubLog, call, sizeof(stubLog) - strlen(stubLog) - 1) ;
+}
+
+static CGError stubGet(CGSDebugOption *out) {
+    stubGets++ ;
+    if (stubGets == failGet) {
+        stub_log("get! ", 0) ;
+        return kCGErrorCannotComplete ;
+    }
+    if (intruder) intruder(stubGets) ;
+    stub_log("get ", 0) ;
+    *out = (CGSDebugOption)stubOptions ;
+    return kCGErrorSuccess ;
+}
+
+static CGError stubSet(CGSDebugOption options) {
+    if (failSet && !cgsdebug_isCommand((uint32_t)options)) {
+        stub_log("set! ", 0) ;
+        return kCGErrorIllegalArgument ;
+    }
+    if (cgsdebug_isCommand((uint32_t)options)) {
+        stub_log("cmd:%x ", (uint32_t)options & ~CGSDEBUG_COMMAND_BIT) ;
+    } else {
+        stub_log("set:%x ", (uint32_t)options) ;
+        stubOptions = (uint32_t)options ;
+    }
+    return kCGErrorSuccess ;
+}
+
+static const cgsdebug_backend stubBackend = { "stub", stubGet, stubSet } ;
+
+static void stub_reset(uint32_t options) {
+    stubOptions = options ;
+    stubLog[0]  = '\0' ;
+    stubGets    = 0 ;
+    failGet     = 0 ;
+    failSet     = false ;
+    intruder    = NULL ;
+}
+
+TEST(readsThenCommandsThenWrites) {
+    stub_reset(kCGSDebugOptionNoShadows) ;
+    cgsdebug_plan plan = { 0 } ;
+    cgsdebug_plan_add(&plan, kCGSDebugOptionFlashScreenUpdates, true) ;
+    cgsdebug_plan_add(&plan, kCGSDebugOptionDumpWindowListToFile, true) ;
+    cgsdebug_plan_add(&plan, kCGSDebugOptionNoShadows, false) ;
+    cgsdebug_plan_add(&plan, kCGSDebugOptionDumpShadowListToFile, true) ;
+
+    uint32_t mask ;
+    bool     verified ;
+    CHECK_INT(cgsdebug_applyPlan(&stubBackend, &plan, 0, &mask, &verified), kCGErrorSuccess) ;
+    CHECK_STR(stubLog, "get cmd:1 cmd:14 set:4 ") ;
+    CHECK_INT(mask, kCGSDebugOptionFlashScreenUpdates) ;
+    CHECK(!verified) ;
+}
+
+// the WindowServer replaces its options when given a command, so they are restored even if unchanged
+TEST(commandsAreFollowedByTheMask) {
+    stub_reset(kCGSDebugOptionNoShadows) ;
+    cgsdebug_plan plan = { 0 } ;
+    cgsdebug_plan_add(&plan, kCGSDebugOptionDumpSurfaceInfo, true) ;
+    cgsdebug_plan_add(&plan, kCGSDebugOptionDumpSurfaceInfo, true) ;
+    cgsdebug_plan_add(&plan, kCGSDebugOptionDumpConnectionListToFile, false) ;
+    cgsdebug_plan_add(&plan, kCGSDebugOptionNoShadows, true) ;
+
+    uint32_t mask ;
+    bool     verified ;
+    CHECK_INT(cgsdebug_applyPlan(&stubBackend, &plan, 0, &mask, &verified), kCGErrorSuccess) ;
+    CHECK_STR(stubLog, "get cmd:10 set:4000 ") ;
+    CHECK_INT(mask, kCGSDebugOptionNoShadows) ;
+    CHECK_INT(plan.setBits & CGSDEBUG_COMMAND_BIT, 0) ;
+}
+
+TEST(laterValuesReplaceEarlierOnes) {
+    cgsdebug_plan plan = { 0 } ;
+    cgsdebug_plan_add(&plan, kCGSDebugOptionNoShadows, true) ;
+    cgsdebug_plan_add(&plan, kCGSDebugOptionNoShadows, false) ;
+    cgsdebug_plan_add(&plan, kCGSDebugOptionAutoflushDrawing, false) ;
+    cgsdebug_plan_add(&plan, kCGSDebugOptionAutoflushDrawing, true) ;
+    CHECK_INT(plan.setBits, kCGSDebugOptionAutoflushDrawing) ;
+    CHECK_INT(plan.clearBits, kCGSDebugOptionNoShadows) ;
+    CHECK_INT(cgsdebug_plan_target(&plan, 0xffff), (0xffff | kCGSDebugOptionAutoflushDrawing) & ~(uint32_t)kCGSDebugOptionNoShadows) ;
+}
+
+// a failed read must not be followed by a write of a mask computed from nothing
+TEST(failedReadWritesNothing) {
+    stub_reset(kCGSDebugOptionNoShadows | kCGSDebugOptionFlashIdenticalUpdates) ;
+    failGet = 1 ;
+    cgsdebug_plan plan = { 0 } ;
+    cgsdebug_plan_add(&plan, kCGSDebugOptionFlashScreenUpdates, true) ;
+    cgsdebug_plan_add(&plan, kCGSDebugOptionDumpWindowListToFile, true) ;
+
+    uint32_t mask ;
+    bool     verified ;
+    CHECK_INT(cgsdebug_applyPlan(&stubBackend, &plan, 2, &mask, &verified), kCGErrorCannotComplete) ;
+    CHECK_STR(stubLog, "get! ") ;
+    CHECK_INT(stubOptions, kCGSDebugOptionNoShadows | kCGSDebugOptionFlashIdenticalUpdates) ;
+    CHECK(!verified) ;
+
+    // and the same for the read before the write, which comes before the commands
+    stub_reset(kCGSDebugOptionNoShadows) ;
+    failGet = 2 ;
+    CHECK_INT(cgsdebug_applyPlan(&stubBackend, &plan, 2, &mask, &verified), kCGErrorCannotComplete) ;
+    CHECK_STR(stubLog, "get get! ") ;
+    CHECK_INT(stubOptions, kCGSDebugOptionNoShadows) ;
+}
+
+TEST(failedWriteIsReported) {
+    stub_reset(0) ;
+    failSet = true ;
+    cgsdebug_plan plan = { 0 } ;
+    cgsdebug_plan_add(&plan, kCGSDebugOptionNoShadows, true) ;
+    uint32_t mask ;
+    bool     verified ;
+    CHECK_INT(cgsdebug_applyPlan(&stubBackend, &plan, 1, &mask, &verified), kCGErrorIllegalArgument) ;
+    CHECK(!verified) ;
+    CHECK_INT(mask, 0) ;
+}
+
+// with retries the options are read again right before the write, and compared with the value the
+// target came from, not with the target
+static void intrudeOnSecondRead(int get) {
+    if (get == 2) stubOptions |= kCGSDebugOptionColorByAccelleration ;
+}
+
+TEST(retryRereadsBeforeTheWrite) {
+    stub_reset(0) ;
+    cgsdebug_plan plan = { 0 } ;
+    cgsdebug_plan_add(&plan, kCGSDebugOptionNoShadows, true) ;
+    uint32_t mask ;
+    bool     verified ;
+    CHECK_INT(cgsdebug_applyPlan(&stubBackend, &plan, 1, &mask, &verified), kCGErrorSuccess) ;
+    CHECK_STR(stubLog, "get get set:4000 ") ;
+    CHECK(verified) ;
+
+    // another process sets a flag between our first read and the write: its flag survives
+    stub_reset(0) ;
+    intruder = intrudeOnSecondRead ;
+    CHECK_INT(cgsdebug_applyPlan(&stubBackend, &plan, 2, &mask, &verified), kCGErrorSuccess) ;
+    CHECK_STR(stubLog, "get get get set:4020 ") ;
+    CHECK_INT(mask, kCGSDebugOptionNoShadows | kCGSDebugOptionColorByAccelleration) ;
+    CHECK_INT(stubOptions, mask) ;
+    CHECK(verified) ;
+
+    // out of retries: the write is still made from the latest read, but isn't verified
+    stub_reset(0) ;
+    intruder = intrudeOnSecondRead ;
+    CHECK_INT(cgsdebug_applyPlan(&stubBackend, &plan, 1, &mask, &verified), kCGErrorSuccess) ;
+    CHECK_STR(stubLog, "get get set:4020 ") ;
+    CHECK(!verified) ;
+}
+
+// a plan whose target is already in place is verified without writing anything
+TEST(nothingToWriteIsStillVerified) {
+    stub_reset(kCGSDebugOptionNoShadows) ;
+    cgsdebug_plan plan = { 0 } ;
+    cgsdebug_plan_add(&plan, kCGSDebugOptionNoShadows, true) ;
+    uint32_t mask ;
+    bool     verified ;
+    CHECK_INT(cgsdebug_applyPlan(&stubBackend, &plan, 3, &mask, &verified), kCGErrorSuccess) ;
+    CHECK_STR(stubLog, "get get ") ;
+    CHECK(verified) ;
+}
+
+// random plans against random concurrent writers: the bits we asked for are always right afterwards, the
+// other writer's bits are kept, and commands never end up in the mask
+static uint32_t intruderBits ;
+static int      intruderAt ;
+
+static void randomIntruder(int get) {
+    if (get == intruderAt) stubOptions ^= intruderBits ;
+}
+
+TEST(randomPlansWithConcurrentWriters) {
+    static const uint32_t flags[]    = { 0x4, 0x20, 0x4000, 0x20000, 0x40000, 0x100000, 0x4000000 } ;
+    static const uint32_t commands[] = { 0x80000001, 0x80000002, 0x80000010, 0x80000014 } ;
+    test_seed(6006) ;
+    for (int i = 0 ; i < 20000 ; i++) {
+        stub_reset(0) ;
+        for (int f = 0 ; f < 7 ; f++) if (test_random() & 1) stubOptions |= flags[f] ;
+
+        cgsdebug_plan plan = { 0 } ;
+        int           adds = (int)(test_random() % 8) ;
+        for (int a = 0 ; a < adds ; a++) {
+            uint32_t option = (test_random() % 4 == 0) ? commands[test_random() % 4] : flags[test_random() % 7] ;
+            cgsdebug_plan_add(&plan, option, test_random() & 1) ;
+        }
+        uint32_t before = stubOptions ;
+        intruder     = randomIntruder ;
+        intruderAt   = (int)(test_random() % 4) ;
+        intruderBits = flags[test_random() % 7] & ~(plan.setBits | plan.clearBits) ;
+        int retries  = (int)(test_random() % 3) ;
+
+        uint32_t mask ;
+        bool     verified ;
+        CHECK_INT(cgsdebug_applyPlan(&stubBackend, &plan, retries, &mask, &verified), kCGErrorSuccess) ;
+        CHECK_INT(stubOptions & plan.setBits, plan.setBits) ;
+        CHECK_INT(stubOptions & plan.clearBits, 0) ;
+        CHECK_INT(stubOptions & CGSDEBUG_COMMAND_BIT, 0) ;
+        CHECK_INT(mask, stubOptions) ;
+        // every read happens before our write, so the other writer's change is never lost
+        bool intruded = intruderAt >= 1 && intruderAt <= stubGets ;
+        CHECK_INT(stubOptions & intruderBits, (intruded ? before ^ intruderBits : before) & intruderBits) ;
+        // and the write is only unverified when the change showed up in the last read we were allowed
+        CHECK(verified == (retries > 0 && !(intruded && intruderBits && intruderAt >= 2 && intruderAt == retries + 1))) ;
+    }
+}
+
+// the mock drops the flags when given a command, so this also checks that they are put back
+TEST(mockForgetsCommands) {
+    hsasm_mock_reset(&cgsdebug_mock) ;
+    atomic_store(&cgsdebug_mockOptions, 0) ;
+    cgsdebug_plan plan = { 0 } ;
+    cgsdebug_plan_add(&plan, kCGSDebugOptionNoShadows, true) ;
+    cgsdebug_plan_add(&plan, kCGSDebugOptionDumpWindowListToPlist, true) ;
+    uint32_t mask ;
+    bool     verified ;
+    CHECK_INT(cgsdebug_applyPlan(&cgsdebug_mockBackend, &plan, 1, &mask, &verified), kCGErrorSuccess) ;
+    CHECK_INT(atomic_load(&cgsdebug_mockOptions), kCGSDebugOptionNoShadows) ;
+    CHECK(verified) ;
+    CHECK_INT(atomic_load(&cgsdebug_mock.calls), 4) ; // get, get, command, set
+
+    cgsdebug_mock.failureRate = 1.0 ;
+    CHECK_INT(cgsdebug_applyPlan(&cgsdebug_mockBackend, &plan, 0, &mask, &verified), kCGErrorFailure) ;
+    hsasm_mock_reset(&cgsdebug_mock) ;
+}
+
+int main(void) {
+    RUN_TEST(readsThenCommandsThenWrites) ;
+    RUN_TEST(commandsAreFollowedByTheMask) ;
+    RUN_TEST(laterValuesReplaceEarlierOnes) ;
+    RUN_TEST(failedReadWritesNothing) ;
+    RUN_TEST(failedWriteIsReported) ;
+    RUN_TEST(retryRereadsBeforeTheWrite) ;
+    RUN_TEST(nothingToWriteIsStillVerified) ;
+    RUN_TEST(randomPlansWithConcurrentWriters) ;
+    RUN_TEST(mockForgetsCommands) ;
+    return test_finish("cgsdebug plan") ;
+}
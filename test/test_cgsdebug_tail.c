@@ -0,0 +1,504 @@
+//
+// test_cgsdebug_tail.c
+// The tailer's byte ring and line framing, following a file through truncation and rotation, and a load test
+// with a writer, a reader woken by cgsdebug_tailWatch.h and a consumer each on their own thread
+
+#include "test.h"
+#include "cgsdebug/cgsdebug_tail.h"
+#include "cgsdebug/cgsdebug_tailWatch.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+// copies text into the ring as if it had been read from a file, in reads of at most chunk bytes
+static void feed(tail_ring *ring, const char *text, size_t chunk) {
+    size_t length = strlen(text) ;
+    while (length > 0) {
+        size_t index ;
+        size_t span  = tail_ring_reserve(ring, &index) ;
+        size_t count = length < span ? length : span ;
+        if (count > chunk) count = chunk ;
+        memcpy(ring->bytes + index, text, count) ;
+        tail_ring_commit(ring, count) ;
+        text   += count ;
+        length -= count ;
+    }
+}
+
+static const char *line_text(const tail_ring *ring, size_t i, char *buffer, size_t size) {
+    tail_line  line   = tail_ring_line(ring, i) ;
+    const char *first ;
+    size_t     length = tail_ring_lineBytes(ring, line, &first) ;
+    if (line.length >= size) return "(too long)" ;
+    memcpy(buffer, first, length) ;
+    memcpy(buffer + length, ring->bytes, line.length - length) ;
+    buffer[line.length] = 0 ;
+    return buffer ;
+}
+
+TEST(linesSplitAcrossReads) {
+    tail_ring ring ;
+    char      buffer[64] ;
+    CHECK(tail_ring_init(&ring, 4096, 16)) ;
+    tail_ring_reset(&ring, 100) ;
+
+    feed(&ring, "abc\nde", 3) ;
+    CHECK_INT(tail_ring_pending(&ring), 1) ;
+    feed(&ring, "f\n\ng", 1) ;
+    CHECK_INT(tail_ring_pending(&ring), 3) ;
+    CHECK_STR(line_text(&ring, 0, buffer, sizeof(buffer)), "abc") ;
+    CHECK_STR(line_text(&ring, 1, buffer, sizeof(buffer)), "def") ;
+    CHECK_STR(line_text(&ring, 2, buffer, sizeof(buffer)), "") ;
+    CHECK_INT(tail_ring_line(&ring, 1).fileEnd, 108) ;
+
+    tail_ring_consume(&ring, 2) ;
+    CHECK_INT(ring.deliveredOffset, 108) ;
+    CHECK_INT(ring.linesDelivered, 2) ;
+    // the partial "g" is still needed, so the ring can't release it
+    CHECK_INT(ring.head - ring.tail, 2) ;
+    tail_ring_consume(&ring, 1) ;
+    CHECK_INT(ring.head - ring.tail, 1) ;
+    tail_ring_free(&ring) ;
+}
+
+TEST(linesWrapAroundTheRing) {
+    tail_ring ring ;
+    char      buffer[64], expected[64] ;
+    CHECK(tail_ring_init(&ring, 64, 8)) ;
+    tail_ring_reset(&ring, 0) ;
+    size_t wrapped = 0 ;
+    for (int i = 0 ; i < 1000 ; i++) {
+        snprintf(expected, sizeof(expected), "line %d", i) ;
+        char text[72] ;
+        snprintf(text, sizeof(text), "%s\n", expected) ;
+        feed(&ring, text, 5) ;
+        CHECK_INT(tail_ring_pending(&ring), 1) ;
+        const char *first ;
+        if (tail_ring_lineBytes(&ring, tail_ring_line(&ring, 0), &first) < tail_ring_line(&ring, 0).length) wrapped++ ;
+        CHECK_STR(line_text(&ring, 0, buffer, sizeof(buffer)), expected) ;
+        tail_ring_consume(&ring, 1) ;
+    }
+    CHECK(wrapped > 0) ;
+    CHECK_INT(ring.linesDropped, 0) ;
+    tail_ring_free(&ring) ;
+}
+
+TEST(slowConsumerLosesTheOldestLines) {
+    tail_ring ring ;
+    char      buffer[64] ;
+    CHECK(tail_ring_init(&ring, 4096, 4)) ;
+    tail_ring_reset(&ring, 0) ;
+    feed(&ring, "0\n1\n2\n3\n4\n5\n6\n7\n8\n9\n", 4096) ;
+    CHECK_INT(tail_ring_pending(&ring), 4) ;
+    CHECK_INT(ring.linesDropped, 6) ;
+    CHECK_STR(line_text(&ring, 0, buffer, sizeof(buffer)), "6") ;
+    CHECK_STR(line_text(&ring, 3, buffer, sizeof(buffer)), "9") ;
+
+    // when the bytes run out rather than the descriptors, enough lines go to make room for a read
+    tail_ring small ;
+    CHECK(tail_ring_init(&small, 64, 64)) ;
+    tail_ring_reset(&small, 0) ;
+    feed(&small, "aaaaaaaaa\nbbbbbbbbb\nccccccccc\nddddddddd\neeeeeeeee\nfffffffff\nggggggggg\n", 64) ;
+    CHECK(small.linesDropped > 0) ;
+    CHECK_INT(small.linesRead, 7) ;
+    CHECK_INT(tail_ring_pending(&small) + small.linesDropped, 7) ;
+    CHECK_STR(line_text(&small, tail_ring_pending(&small) - 1, buffer, sizeof(buffer)), "ggggggggg") ;
+    tail_ring_free(&small) ;
+    tail_ring_free(&ring) ;
+}
+
+TEST(lineLongerThanTheRingIsDropped) {
+    tail_ring ring ;
+    char      buffer[64], longLine[300] ;
+    CHECK(tail_ring_init(&ring, 64, 8)) ;
+    tail_ring_reset(&ring, 0) ;
+    memset(longLine, 'x', 200) ;
+    strcpy(longLine + 200, "\nok\n") ;
+    feed(&ring, longLine, 7) ;
+    CHECK_INT(tail_ring_pending(&ring), 1) ;
+    CHECK_INT(ring.linesDropped, 1) ;
+    CHECK_STR(line_text(&ring, 0, buffer, sizeof(buffer)), "ok") ;
+    CHECK_INT(tail_ring_line(&ring, 0).fileEnd, 204) ;
+    tail_ring_free(&ring) ;
+}
+
+TEST(resetKeepsCompleteLines) {
+    tail_ring ring ;
+    char      buffer[64] ;
+    CHECK(tail_ring_init(&ring, 4096, 8)) ;
+    tail_ring_reset(&ring, 0) ;
+    feed(&ring, "kept\npartial", 4096) ;
+    tail_ring_reset(&ring, 0) ;
+    feed(&ring, "new\n", 4096) ;
+    CHECK_INT(tail_ring_pending(&ring), 2) ;
+    CHECK_STR(line_text(&ring, 0, buffer, sizeof(buffer)), "kept") ;
+    CHECK_STR(line_text(&ring, 1, buffer, sizeof(buffer)), "new") ;
+    CHECK_INT(tail_ring_line(&ring, 1).fileEnd, 4) ;
+    tail_ring_consume(&ring, 2) ;
+    CHECK_INT(ring.deliveredOffset, 4) ;
+    tail_ring_free(&ring) ;
+}
+
+// following files
+
+static char directory[64] ;
+
+static void path_in(char *path, size_t size, const char *name) {
+    snprintf(path, size, "%s/%s", directory, name) ;
+}
+
+static void append(const char *path, const char *text) {
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644) ;
+    CHECK(fd >= 0) ;
+    if (fd < 0) return ;
+    CHECK_INT(write(fd, text, strlen(text)), strlen(text)) ;
+    close(fd) ;
+}
+
+static void drain(tail_ring *ring, char lines[][64], size_t *count) {
+    char buffer[64] ;
+    *count = tail_ring_pending(ring) ;
+    for (size_t i = 0 ; i < *count ; i++) strcpy(lines[i], line_text(ring, i, buffer, sizeof(buffer))) ;
+    tail_ring_consume(ring, *count) ;
+}
+
+TEST(startsAtTheEndOrTheSavedOffset) {
+    char      path[128], lines[16][64] ;
+    size_t    count ;
+    tail_ring ring ;
+    tail_file file ;
+    path_in(path, sizeof(path), "offset.log") ;
+    append(path, "a\nb\n") ;
+
+    CHECK(tail_ring_init(&ring, 4096, 16)) ;
+    tail_file_init(&file, path, -1, &ring) ;
+    CHECK_INT(tail_file_check(&file), kTailFileOpened) ;
+    CHECK_INT(tail_ring_pending(&ring), 0) ;
+    append(path, "c\n") ;
+    CHECK_INT(tail_file_check(&file), kTailFileRead) ;
+    drain(&ring, lines, &count) ;
+    CHECK_INT(count, 1) ;
+    CHECK_STR(lines[0], "c") ;
+
+    // stopping remembers the position; starting again continues from it
+    tail_file_suspend(&file) ;
+    CHECK_INT(file.fd, -1) ;
+    append(path, "d\n") ;
+    CHECK_INT(tail_file_check(&file), kTailFileOpened) ;
+    drain(&ring, lines, &count) ;
+    CHECK_INT(count, 1) ;
+    CHECK_STR(lines[0], "d") ;
+    tail_file_close(&file) ;
+    tail_ring_free(&ring) ;
+
+    // a new tailer given the offset of line b sees b, c and d
+    CHECK(tail_ring_init(&ring, 4096, 16)) ;
+    tail_file_init(&file, path, 2, &ring) ;
+    tail_file_check(&file) ;
+    drain(&ring, lines, &count) ;
+    CHECK_INT(count, 3) ;
+    CHECK_STR(lines[0], "b") ;
+    CHECK_INT(ring.deliveredOffset, 8) ;
+    tail_file_close(&file) ;
+    tail_ring_free(&ring) ;
+    unlink(path) ;
+}
+
+TEST(truncationStartsAgain) {
+    char      path[128], lines[16][64] ;
+    size_t    count ;
+    tail_ring ring ;
+    tail_file file ;
+    path_in(path, sizeof(path), "truncate.log") ;
+    append(path, "one\ntwo\n") ;
+
+    CHECK(tail_ring_init(&ring, 4096, 16)) ;
+    tail_file_init(&file, path, 0, &ring) ;
+    tail_file_check(&file) ;
+    drain(&ring, lines, &count) ;
+    CHECK_INT(count, 2) ;
+
+    CHECK_INT(truncate(path, 0), 0) ;
+    append(path, "x\n") ;
+    CHECK_INT(tail_file_check(&file), kTailFileRead) ;
+    drain(&ring, lines, &count) ;
+    CHECK_INT(file.truncations, 1) ;
+    CHECK_INT(count, 1) ;
+    CHECK_STR(lines[0], "x") ;
+    CHECK_INT(ring.deliveredOffset, 2) ;
+    tail_file_close(&file) ;
+    tail_ring_free(&ring) ;
+    unlink(path) ;
+}
+
+TEST(rotationFinishesTheOldFileFirst) {
+    char      path[128], rotated[128], lines[16][64] ;
+    size_t    count ;
+    tail_ring ring ;
+    tail_file file ;
+    path_in(path, sizeof(path), "rotate.log") ;
+    path_in(rotated, sizeof(rotated), "rotate.log.1") ;
+    append(path, "start\n") ;
+
+    CHECK(tail_ring_init(&ring, 4096, 16)) ;
+    tail_file_init(&file, path, -1, &ring) ;
+    tail_file_check(&file) ;
+    append(path, "old\n") ;
+    CHECK_INT(rename(path, rotated), 0) ;
+    append(rotated, "late\n") ;
+
+    // replaced by nothing yet: the old file is finished and the tailer waits for a new one
+    CHECK_INT(tail_file_check(&file), kTailFileMissing) ;
+    CHECK_INT(file.rotations, 1) ;
+    append(path, "new\n") ;
+    CHECK_INT(tail_file_check(&file), kTailFileOpened) ;
+    drain(&ring, lines, &count) ;
+    CHECK_INT(count, 3) ;
+    CHECK_STR(lines[0], "old") ;
+    CHECK_STR(lines[1], "late") ;
+    CHECK_STR(lines[2], "new") ;
+
+    // replaced by another file in one step
+    CHECK_INT(rename(path, rotated), 0) ;
+    append(path, "newer\n") ;
+    CHECK_INT(tail_file_check(&file), kTailFileOpened) ;
+    CHECK_INT(file.rotations, 2) ;
+    drain(&ring, lines, &count) ;
+    CHECK_INT(count, 1) ;
+    CHECK_STR(lines[0], "newer") ;
+    tail_file_close(&file) ;
+    tail_ring_free(&ring) ;
+    unlink(path) ;
+    unlink(rotated) ;
+}
+
+TEST(missingFileIsReadFromItsBeginning) {
+    char      path[128], lines[16][64] ;
+    size_t    count ;
+    tail_ring ring ;
+    tail_file file ;
+    path_in(path, sizeof(path), "later.log") ;
+
+    CHECK(tail_ring_init(&ring, 4096, 16)) ;
+    tail_file_init(&file, path, -1, &ring) ;
+    CHECK_INT(tail_file_check(&file), kTailFileMissing) ;
+    append(path, "first\n") ;
+    CHECK_INT(tail_file_check(&file), kTailFileOpened) ;
+    drain(&ring, lines, &count) ;
+    CHECK_INT(count, 1) ;
+    CHECK_STR(lines[0], "first") ;
+    tail_file_close(&file) ;
+    tail_ring_free(&ring) ;
+    unlink(path) ;
+}
+
+TEST(watchWakesForItsFileOnly) {
+    char       path[128], other[128] ;
+    tail_watch watch ;
+    path_in(path, sizeof(path), "watched.log") ;
+    path_in(other, sizeof(other), "other.log") ;
+    tail_watch_open(&watch, path, 10, true) ;
+#ifdef __linux__
+    CHECK_STR(watch.name, "inotify") ;
+    CHECK(!tail_watch_wait(&watch, 0)) ;
+    append(other, "x\n") ;
+    CHECK(!tail_watch_wait(&watch, 50)) ;
+    append(path, "x\n") ;
+    CHECK(tail_watch_wait(&watch, 1000)) ;
+    CHECK(!tail_watch_wait(&watch, 0)) ;
+    CHECK_INT(rename(path, other), 0) ;
+    CHECK(tail_watch_wait(&watch, 1000)) ;
+#endif
+    tail_watch_close(&watch) ;
+
+    tail_watch_open(&watch, path, 10, false) ;
+    CHECK_STR(watch.name, "poll") ;
+    CHECK(tail_watch_wait(&watch, 1000)) ;
+    tail_watch_close(&watch) ;
+    unlink(path) ;
+    unlink(other) ;
+}
+
+// load
+
+typedef struct {
+    char             path[128] ;
+    char             rotated[128] ;
+    unsigned         lines ;
+    unsigned         rotateEvery ;
+    bool             useInotify ;
+    int              consumerPauseUs ; // between batches, to make the consumer fall behind
+
+    pthread_mutex_t  mutex ;
+    tail_ring        ring ;
+    tail_file        file ;
+    _Atomic bool     writerDone ;
+    _Atomic bool     readerDone ;
+    _Atomic uint64_t rotationsSeen ;
+} load_test ;
+
+static void load_lock(void *context) {
+    pthread_mutex_lock(context) ;
+}
+
+static void load_unlock(void *context) {
+    pthread_mutex_unlock(context) ;
+}
+
+static void *load_writer(void *context) {
+    load_test *test = context ;
+    int       fd    = open(test->path, O_WRONLY | O_APPEND | O_CREAT, 0644) ;
+    char      chunk[8192] ;
+    size_t    used  = 0 ;
+    for (unsigned i = 0 ; i < test->lines ; i++) {
+        used += (size_t)snprintf(chunk + used, sizeof(chunk) - used, "%010u CGXLog verbose line with some text %u\n", i, i * 7) ;
+        bool rotate = test->rotateEvery && (i + 1) % test->rotateEvery == 0 && i + 1 < test->lines ;
+        if (used > sizeof(chunk) - 128 || rotate || i + 1 == test->lines) {
+            if (write(fd, chunk, used) != (ssize_t)used) abort() ;
+            used = 0 ;
+        }
+        if (rotate) {
+            // each rotation waits until the reader has noticed it; a second rotation before then would
+            // take a whole file out of reach, which no tailer can recover
+            uint64_t seen = atomic_load(&test->rotationsSeen) ;
+            close(fd) ;
+            rename(test->path, test->rotated) ;
+            fd = open(test->path, O_WRONLY | O_APPEND | O_CREAT, 0644) ;
+            while (atomic_load(&test->rotationsSeen) == seen) usleep(100) ;
+        }
+    }
+    close(fd) ;
+    atomic_store(&test->writerDone, true) ;
+    return NULL ;
+}
+
+static void *load_reader(void *context) {
+    load_test  *test = context ;
+    tail_watch watch ;
+    tail_watch_open(&watch, test->path, 5, test->useInotify) ;
+    bool finished = false ;
+    while (!finished) {
+        finished = atomic_load(&test->writerDone) ; // one last check after the writer is done
+        tail_watch_wait(&watch, finished ? 0 : 20) ;
+        tail_file_check(&test->file) ;
+        pthread_mutex_lock(&test->mutex) ;
+        atomic_store(&test->rotationsSeen, test->file.rotations) ;
+        pthread_mutex_unlock(&test->mutex) ;
+    }
+    tail_watch_close(&watch) ;
+    atomic_store(&test->readerDone, true) ;
+    return NULL ;
+}
+
+// runs a writer and a reader thread while this thread consumes the lines; returns the number delivered
+static uint64_t run_load(load_test *test, size_t bufferSize, size_t maxLines) {
+    pthread_mutex_init(&test->mutex, NULL) ;
+    CHECK(tail_ring_init(&test->ring, bufferSize, maxLines)) ;
+    tail_file_init(&test->file, test->path, 0, &test->ring) ;
+    test->file.lock        = load_lock ;
+    test->file.unlock      = load_unlock ;
+    test->file.lockContext = &test->mutex ;
+    atomic_store(&test->writerDone, false) ;
+    atomic_store(&test->readerDone, false) ;
+    atomic_store(&test->rotationsSeen, 0) ;
+
+    pthread_t writer, reader ;
+    pthread_create(&reader, NULL, load_reader, test) ;
+    pthread_create(&writer, NULL, load_writer, test) ;
+
+    int64_t  last      = -1 ;
+    uint64_t delivered = 0 ;
+    bool     ordered   = true ;
+    while (true) {
+        bool   done = atomic_load(&test->readerDone) ;
+        char   buffer[128] ;
+        pthread_mutex_lock(&test->mutex) ;
+        size_t count = tail_ring_pending(&test->ring) ;
+        if (count > 512) count = 512 ;
+        for (size_t i = 0 ; i < count ; i++) {
+            int64_t sequence = atoll(line_text(&test->ring, i, buffer, sizeof(buffer))) ;
+            if (sequence <= last) ordered = false ;
+            last = sequence ;
+        }
+        tail_ring_consume(&test->ring, count) ;
+        pthread_mutex_unlock(&test->mutex) ;
+        delivered += count ;
+        if (count == 0) {
+            if (done) break ;
+            usleep(200) ;
+        } else if (test->consumerPauseUs) {
+            usleep((useconds_t)test->consumerPauseUs) ;
+        }
+    }
+    pthread_join(writer, NULL) ;
+    pthread_join(reader, NULL) ;
+
+    CHECK(ordered) ;
+    CHECK_INT(last, test->lines - 1) ; // the last line is never the one dropped
+    CHECK_INT(test->ring.linesRead, test->lines) ;
+    CHECK_INT(delivered, test->ring.linesDelivered) ;
+    CHECK_INT(delivered + test->ring.linesDropped, test->lines) ;
+    if (test->rotateEvery) CHECK_INT(test->file.rotations, (test->lines - 1) / test->rotateEvery) ;
+
+    tail_file_close(&test->file) ;
+    tail_ring_free(&test->ring) ;
+    pthread_mutex_destroy(&test->mutex) ;
+    unlink(test->path) ;
+    unlink(test->rotated) ;
+    return delivered ;
+}
+
+TEST(loadWithRotationsLosesNothing) {
+    static load_test test ;
+    path_in(test.path, sizeof(test.path), "load.log") ;
+    path_in(test.rotated, sizeof(test.rotated), "load.log.1") ;
+    test.lines       = 200000 ;
+    test.rotateEvery = 50000 ;
+
+    // rings big enough for everything, so every line must arrive, in order, across the rotations
+    for (int useInotify = 1 ; useInotify >= 0 ; useInotify--) {
+        test.useInotify      = useInotify ;
+        test.consumerPauseUs = 0 ;
+        CHECK_INT(run_load(&test, 64 << 20, test.lines), test.lines) ;
+        CHECK_INT(test.ring.linesDropped, 0) ;
+    }
+}
+
+TEST(loadWithSlowConsumerStaysBounded) {
+    static load_test test ;
+    path_in(test.path, sizeof(test.path), "slow.log") ;
+    path_in(test.rotated, sizeof(test.rotated), "slow.log.1") ;
+    test.lines           = 200000 ;
+    test.rotateEvery     = 0 ;
+    test.useInotify      = true ;
+    test.consumerPauseUs = 5000 ;
+
+    // small rings and a consumer which sleeps between batches: lines are dropped, but whatever arrives is
+    // in order and every line is either delivered or counted as dropped
+    uint64_t delivered = run_load(&test, 64 * 1024, 1024) ;
+    CHECK(delivered < test.lines) ;
+    printf("        slow consumer: %" PRIu64 " of %u lines delivered\n", delivered, test.lines) ;
+}
+
+int main(void) {
+    RUN_TEST(linesSplitAcrossReads) ;
+    RUN_TEST(linesWrapAroundTheRing) ;
+    RUN_TEST(slowConsumerLosesTheOldestLines) ;
+    RUN_TEST(lineLongerThanTheRingIsDropped) ;
+    RUN_TEST(resetKeepsCompleteLines) ;
+
+    strcpy(directory, "/tmp/hsasm_tail_XXXXXX") ;
+    if (!mkdtemp(directory)) {
+        perror("mkdtemp") ;
+        return 1 ;
+    }
+    RUN_TEST(startsAtTheEndOrTheSavedOffset) ;
+    RUN_TEST(truncationStartsAgain) ;
+    RUN_TEST(rotationFinishesTheOldFileFirst) ;
+    RUN_TEST(missingFileIsReadFromItsBeginning) ;
+    RUN_TEST(watchWakesForItsFileOnly) ;
+    RUN_TEST(loadWithRotationsLosesNothing) ;
+    RUN_TEST(loadWithSlowConsumerStaysBounded) ;
+    rmdir(directory) ;
+    return test_finish("cgsdebug tail") ;
+}
@@ -0,0 +1,190 @@
+//
+// test_combined.c
+// The combined library links every submodule's source into one library, so this checks what that depends
+// on: the preload list combined.m is built from, combined_modules.h, which the Makefile at the top of the
+// repository generates from the luaopen functions, gives every module the function require would find for
+// it in its own library and covers every module the init.lua files require; each init.lua loads the
+// combined library before its internal modules; and nothing but the luaopen functions is visible outside its
+// own file, where it could collide with a symbol from another submodule.
+//
+// The list is loaded here the way combined.m loads it, with a stand-in for each luaopen function which
+// records which one was called.
+
+#include "test.h"
+#include "stubs/lua.h"
+
+#include <ctype.h>
+#include <glob.h>
+
+static char *read_source(const char *path) {
+    FILE *file = fopen(path, "rb") ;
+    if (!file) return NULL ;
+    fseek(file, 0, SEEK_END) ;
+    long length = ftell(file) ;
+    fseek(file, 0, SEEK_SET) ;
+    char *contents = malloc((size_t)length + 1) ;
+    if (contents && fread(contents, 1, (size_t)length, file) != (size_t)length) {
+        free(contents) ;
+        contents = NULL ;
+    }
+    if (contents) contents[length] = '\0' ;
+    fclose(file) ;
+    return contents ;
+}
+
+// returns the line starting at *cursor, or NULL at the end, and moves *cursor to the next one
+static const char *next_line(const char **cursor, size_t *length) {
+    const char *line = *cursor ;
+    if (!*line) return NULL ;
+    const char *end = strchr(line, '\n') ;
+    *length = end ? (size_t)(end - line) : strlen(line) ;
+    *cursor = line + *length + (end ? 1 : 0) ;
+    return line ;
+}
+
+static bool starts_with(const char *line, size_t length, const char *prefix) {
+    size_t prefixLength = strlen(prefix) ;
+    return length >= prefixLength && memcmp(line, prefix, prefixLength) == 0 ;
+}
+
+// the module name a luaopen function is for, e.g. hs._asm.undocumented.cursor.capture for
+// luaopen_hs__asm_undocumented_cursor_capture; Lua maps each '.' in a module name to '_'
+static void module_name(const char *function, char *name, size_t size) {
+    size_t out = 0, length = strlen(function) ;
+    for (size_t i = strlen("luaopen_") ; i < length && out + 1 < size ; i++) {
+        if (function[i] == '_' && i + 1 < length && function[i + 1] == '_') {
+            name[out++] = '.' ;
+            if (out + 1 < size) name[out++] = '_' ;
+            i++ ;
+        } else {
+            name[out++] = (function[i] == '_') ? '.' : function[i] ;
+        }
+    }
+    name[out] = '\0' ;
+}
+
+static const char *calledLuaopen ;
+
+#define COMBINED_MODULE(name, luaopen) \
+    static int luaopen(__attribute__((unused)) lua_State *L) { calledLuaopen = #luaopen ; return 1 ; }
+#include "combined_modules.h"
+#undef COMBINED_MODULE
+
+// combined.m's combinedModules, with the stand-ins
+static const struct {
+    const char *name ;
+    int        (*func)(lua_State *L) ;
+} preload[] = {
+#define COMBINED_MODULE(name, luaopen) {name, luaopen},
+#include "combined_modules.h"
+#undef COMBINED_MODULE
+} ;
+enum { preloadCount = sizeof(preload) / sizeof(preload[0]) } ;
+
+// require through the preload table: the luaopen function called, or NULL if the module isn't there
+static const char *require_preloaded(const char *module) {
+    for (size_t i = 0 ; i < preloadCount ; i++) {
+        if (strcmp(preload[i].name, module) != 0) continue ;
+        lua_State L     = { .top = 0 } ;
+        calledLuaopen   = NULL ;
+        (void)preload[i].func(&L) ;
+        return calledLuaopen ;
+    }
+    return NULL ;
+}
+
+TEST(everyModuleIsPreloaded) {
+    CHECK_INT(preloadCount, 8) ;
+    for (size_t i = 0 ; i < preloadCount ; i++) {
+        // requiring the module calls the function require would find for it in its own library
+        const char *luaopen = require_preloaded(preload[i].name) ;
+        CHECK(luaopen != NULL) ;
+        if (!luaopen) continue ;
+        char name[128] ;
+        module_name(luaopen, name, sizeof(name)) ;
+        CHECK_STR(name, preload[i].name) ;
+        for (size_t j = 0 ; j < i ; j++) CHECK(strcmp(preload[i].name, preload[j].name) != 0) ;
+    }
+}
+
+// every hs._asm.undocumented.<submodule>.<module> named in an init.lua -- the internal module each checks
+// package.preload for and the secondary modules it requires -- is in the preload table
+TEST(everyRequiredModuleIsPreloaded) {
+    const char *prefix = "\"hs._asm.undocumented." ;
+    glob_t     inits ;
+    size_t     required = 0 ;
+    CHECK_INT(glob("../*/init.lua", 0, NULL, &inits), 0) ;
+    for (size_t i = 0 ; i < inits.gl_pathc ; i++) {
+        char *init = read_source(inits.gl_pathv[i]) ;
+        CHECK(init != NULL) ;
+        if (!init) continue ;
+        for (const char *quote = strstr(init, prefix) ; quote ; quote = strstr(quote + 1, prefix)) {
+            const char *module = quote + 1 ;
+            size_t     length  = strcspn(module, "\"\n") ;
+            size_t     dots    = 0 ;
+            for (size_t c = 0 ; c < length ; c++) dots += (module[c] == '.') ;
+            if (module[length] != '"' || dots != 4) continue ;
+            char name[128] ;
+            snprintf(name, sizeof(name), "%.*s", (int)length, module) ;
+            CHECK(require_preloaded(name) != NULL) ;
+            if (!require_preloaded(name)) fprintf(stderr, "    %s requires %s, which isn't preloaded\n", inits.gl_pathv[i], name) ;
+            required++ ;
+        }
+        free(init) ;
+    }
+    globfree(&inits) ;
+    CHECK(required >= 8) ;
+}
+
+TEST(everySubmoduleLoadsTheCombinedLibrary) {
+    const char *submodules[] = { "bluetooth", "cgsdebug", "coredock", "cursor" } ;
+    for (size_t i = 0 ; i < sizeof(submodules) / sizeof(submodules[0]) ; i++) {
+        char path[64], guard[128] ;
+        snprintf(path, sizeof(path), "../%s/init.lua", submodules[i]) ;
+        snprintf(guard, sizeof(guard), "package.preload[\"hs._asm.undocumented.%s.internal\"]", submodules[i]) ;
+        char *init = read_source(path) ;
+        CHECK(init != NULL) ;
+        if (!init) continue ;
+        const char *load     = strstr(init, "require(\"hs._asm.undocumented.combined\")") ;
+        const char *internal = strstr(init, "require(\"hs._asm.undocumented.") ;
+        CHECK(strstr(init, guard) != NULL) ;
+        CHECK(load != NULL) ;
+        // the first module required is the combined library
+        CHECK(load == internal) ;
+        free(init) ;
+    }
+}
+
+// a top level line in a submodule's source which starts with an identifier declares or defines something
+// with external linkage unless it is static, extern or a typedef
+TEST(onlyTheLuaopenFunctionsAreExported) {
+    glob_t sources ;
+    CHECK_INT(glob("../*/*.m", 0, NULL, &sources), 0) ;
+    for (size_t i = 0 ; i < sources.gl_pathc ; i++) {
+        const char *path   = sources.gl_pathv[i] ;
+        char       *source = read_source(path) ;
+        CHECK(source != NULL) ;
+        if (!source) continue ;
+        const char *cursor = source, *line ;
+        size_t     length, number = 0 ;
+        while ((line = next_line(&cursor, &length))) {
+            number++ ;
+            if (length == 0 || !(isalpha((unsigned char)line[0]) || line[0] == '_')) continue ;
+            const char *allowed[] = { "static ", "extern ", "typedef ", "int luaopen_" } ;
+            bool        ok        = false ;
+            for (size_t a = 0 ; a < sizeof(allowed) / sizeof(allowed[0]) ; a++) ok = ok || starts_with(line, length, allowed[a]) ;
+            CHECK(ok) ;
+            if (!ok) fprintf(stderr, "    %s:%zu: %.*s\n", path, number, (int)length, line) ;
+        }
+        free(source) ;
+    }
+    globfree(&sources) ;
+}
+
+int main(void) {
+    RUN_TEST(everyModuleIsPreloaded) ;
+    RUN_TEST(everyRequiredModuleIsPreloaded) ;
+    RUN_TEST(everySubmoduleLoadsTheCombinedLibrary) ;
+    RUN_TEST(onlyTheLuaopenFunctionsAreExported) ;
+    return test_finish("combined library") ;
+}
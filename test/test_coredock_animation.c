@@ -0,0 +1,192 @@
+//
+// test_coredock_animation.c
+// The coredock animator driven by a virtual clock, with a fake Dock which can be made slow so frames are dropped
+
+#include "test.h"
+#include "coredock/coredock_animation.h"
+
+// the Dock: every set takes `latency` seconds of virtual time
+typedef struct {
+    double now ;
+    double latency ;
+    int    sets[2] ;
+    float  values[2] ;
+    bool   monotonic ;
+} fake_dock ;
+
+static void fake_apply(void *context, CoreDockField field, float value) {
+    fake_dock *dock  = context ;
+    int       index  = (field == kCoreDockFieldTileSize) ? 0 : 1 ;
+    if (dock->sets[index] > 0 && value < dock->values[index]) dock->monotonic = false ;
+    dock->sets[index]++ ;
+    dock->values[index] = value ;
+    dock->now += dock->latency ;
+}
+
+static coredock_animator animator_new(void) {
+    return (coredock_animator){
+        .tileSize          = { .field = kCoreDockFieldTileSize,          .callbackRef = -1 },
+        .magnificationSize = { .field = kCoreDockFieldMagnificationSize, .callbackRef = -1 },
+    } ;
+}
+
+// Drives the animator like a repeating NSTimer: it fires on multiples of interval after it was started,
+// and a firing which is missed because the previous tick ran long is skipped rather than queued. Returns
+// the number of animations which finished.
+static int run(coredock_animator *animator, fake_dock *dock, double interval, double rateAtTick) {
+    double next     = dock->now + interval ;
+    int    finished = 0 ;
+    while (coredock_animator_active(animator)) {
+        if (dock->now < next) dock->now = next ;
+        coredock_animation done[2] ;
+        finished += coredock_animator_tick(animator, dock->now, rateAtTick > 0 ? 1.0 / rateAtTick : interval,
+                                           fake_apply, dock, done) ;
+        while (next <= dock->now) next += interval ;
+    }
+    return finished ;
+}
+
+TEST(linearAnimationAppliesEveryFrame) {
+    coredock_animator animator = animator_new() ;
+    fake_dock         dock     = { .now = 100.0, .monotonic = true } ;
+    coredock_animator_start(&animator, kCoreDockFieldTileSize, 0.25f, 0.75f, 1.0, kCoreDockEasingLinear, 7, dock.now) ;
+
+    CHECK_INT(run(&animator, &dock, 1.0 / 30.0, 0), 1) ;
+    CHECK_NEAR(dock.values[0], 0.75, 1e-6) ;
+    CHECK(dock.sets[0] >= 29 && dock.sets[0] <= 31) ;
+    CHECK_INT(animator.framesApplied, dock.sets[0]) ;
+    CHECK_INT(animator.framesDropped, 0) ;
+    CHECK_INT(dock.sets[1], 0) ;
+    CHECK(dock.monotonic) ;
+}
+
+// a Dock which takes three frames to answer: the animation still ends on time, with two of every three
+// frames dropped, and there is never a second set issued while one is outstanding
+TEST(slowDockDropsFramesAndFinishesOnTime) {
+    coredock_animator animator = animator_new() ;
+    double            interval = 1.0 / 30.0 ;
+    fake_dock         dock     = { .now = 0.0, .latency = interval * 2.5, .monotonic = true } ;
+    coredock_animator_start(&animator, kCoreDockFieldMagnificationSize, 0.0f, 1.0f, 1.0, kCoreDockEasingInOut, -1, dock.now) ;
+
+    CHECK_INT(run(&animator, &dock, interval, 0), 1) ;
+    CHECK_NEAR(dock.values[1], 1.0, 1e-6) ;
+    CHECK(dock.now < 1.0 + 4 * interval) ;
+    CHECK(dock.sets[1] >= 9 && dock.sets[1] <= 12) ;
+    CHECK(animator.framesDropped >= 2 * (dock.sets[1] - 2)) ;
+    CHECK(animator.framesApplied + animator.framesDropped >= 29) ;
+    CHECK(dock.monotonic) ;
+}
+
+// animationRate can change while the timer runs; the drop count must use the period of the timer that's
+// actually firing, or every tick of a 30fps timer is counted as a missed 60fps frame
+TEST(dropsAreCountedAgainstTheRunningTimer) {
+    coredock_animator animator = animator_new() ;
+    fake_dock         dock     = { .now = 0.0, .monotonic = true } ;
+    coredock_animator_start(&animator, kCoreDockFieldTileSize, 0.0f, 1.0f, 1.0, kCoreDockEasingLinear, -1, dock.now) ;
+    run(&animator, &dock, 1.0 / 30.0, 0) ;
+    CHECK_INT(animator.framesDropped, 0) ;
+
+    animator = animator_new() ;
+    dock     = (fake_dock){ .now = 0.0, .monotonic = true } ;
+    coredock_animator_start(&animator, kCoreDockFieldTileSize, 0.0f, 1.0f, 1.0, kCoreDockEasingLinear, -1, dock.now) ;
+    run(&animator, &dock, 1.0 / 30.0, 60.0) ;
+    CHECK(animator.framesDropped >= 29) ;
+}
+
+TEST(bothPropertiesAnimateTogether) {
+    coredock_animator animator = animator_new() ;
+    fake_dock         dock     = { .now = 5.0, .monotonic = true } ;
+    coredock_animator_start(&animator, kCoreDockFieldTileSize, 0.2f, 0.4f, 0.5, kCoreDockEasingIn, 1, dock.now) ;
+    coredock_animator_start(&animator, kCoreDockFieldMagnificationSize, 0.5f, 0.9f, 1.0, kCoreDockEasingOut, 2, dock.now) ;
+    CHECK_INT(run(&animator, &dock, 1.0 / 60.0, 0), 2) ;
+    CHECK_NEAR(dock.values[0], 0.4, 1e-6) ;
+    CHECK_NEAR(dock.values[1], 0.9, 1e-6) ;
+    CHECK(dock.sets[1] > dock.sets[0]) ;
+}
+
+TEST(zeroDurationSetsTheTargetOnce) {
+    coredock_animator animator = animator_new() ;
+    fake_dock         dock     = { .now = 1.0, .monotonic = true } ;
+    coredock_animator_start(&animator, kCoreDockFieldTileSize, 0.2f, 0.6f, 0.0, kCoreDockEasingLinear, -1, dock.now) ;
+    CHECK_INT(run(&animator, &dock, 1.0 / 30.0, 0), 1) ;
+    CHECK_INT(dock.sets[0], 1) ;
+    CHECK_NEAR(dock.values[0], 0.6, 1e-6) ;
+}
+
+TEST(easingCurvesStartAndEndInPlace) {
+    for (CoreDockEasing easing = kCoreDockEasingLinear ; easing <= kCoreDockEasingInOut ; easing++) {
+        CHECK_NEAR(coredock_ease(easing, 0.0), 0.0, 1e-12) ;
+        CHECK_NEAR(coredock_ease(easing, 1.0), 1.0, 1e-12) ;
+        CHECK_NEAR(coredock_ease(easing, 0.5) + coredock_ease(easing, 0.5), (easing == kCoreDockEasingIn)  ? 0.5 :
+                                                                           (easing == kCoreDockEasingOut) ? 1.5 : 1.0, 1e-12) ;
+        double previous = 0 ;
+        for (int i = 1 ; i <= 100 ; i++) {
+            double value = coredock_ease(easing, i / 100.0) ;
+            CHECK(value >= previous) ;
+            previous = value ;
+        }
+    }
+}
+
+// Every callback reference handed to the animator has to come back out exactly once, whether the
+// animation finished, was cancelled or was replaced, or the Lua function it refers to is leaked. The
+// handlers here start new animations from inside the "callbacks", which is what used to lose references
+// when coredock.animate called the replaced animation's callback before storing the new one.
+static int reported[4096] ;
+static int nextRef ;
+
+static void report(coredock_animation animation) {
+    if (animation.active && animation.callbackRef >= 0) reported[animation.callbackRef]++ ;
+}
+
+static void startFromCallback(coredock_animator *animator, double now) {
+    CoreDockField field = (test_random() & 1) ? kCoreDockFieldTileSize : kCoreDockFieldMagnificationSize ;
+    report(coredock_animator_start(animator, field, 0.5f, (float)test_uniform(), test_uniform() * 0.2,
+                                   kCoreDockEasingLinear, nextRef++, now)) ;
+}
+
+TEST(everyCallbackIsReportedOnce) {
+    test_seed(5005) ;
+    coredock_animator animator = animator_new() ;
+    fake_dock         dock     = { .now = 0.0, .monotonic = true } ;
+    memset(reported, 0, sizeof(reported)) ;
+    nextRef = 0 ;
+
+    while (nextRef < 4000) {
+        dock.now += test_uniform() * 0.05 ;
+        switch (test_random() % 4) {
+            case 0:
+            case 1: startFromCallback(&animator, dock.now) ; break ;
+            case 2: {
+                coredock_animation cancelled = coredock_animator_cancel(&animator, (test_random() & 1) ? kCoreDockFieldTileSize : kCoreDockFieldMagnificationSize) ;
+                report(cancelled) ;
+                if (cancelled.active && (test_random() & 1)) startFromCallback(&animator, dock.now) ;
+            } break ;
+            case 3: {
+                coredock_animation finished[2] ;
+                int count = coredock_animator_tick(&animator, dock.now, 1.0 / 30.0, fake_apply, &dock, finished) ;
+                for (int i = 0 ; i < count ; i++) {
+                    report(finished[i]) ;
+                    if (test_random() & 1) startFromCallback(&animator, dock.now) ;
+                }
+            } break ;
+        }
+    }
+    report(coredock_animator_cancel(&animator, kCoreDockFieldTileSize)) ;
+    report(coredock_animator_cancel(&animator, kCoreDockFieldMagnificationSize)) ;
+
+    int wrong = 0 ;
+    for (int i = 0 ; i < nextRef ; i++) if (reported[i] != 1) wrong++ ;
+    CHECK_INT(wrong, 0) ;
+}
+
+int main(void) {
+    RUN_TEST(linearAnimationAppliesEveryFrame) ;
+    RUN_TEST(slowDockDropsFramesAndFinishesOnTime) ;
+    RUN_TEST(dropsAreCountedAgainstTheRunningTimer) ;
+    RUN_TEST(bothPropertiesAnimateTogether) ;
+    RUN_TEST(zeroDurationSetsTheTargetOnce) ;
+    RUN_TEST(easingCurvesStartAndEndInPlace) ;
+    RUN_TEST(everyCallbackIsReportedOnce) ;
+    return test_finish("coredock animation") ;
+}
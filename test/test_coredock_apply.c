@@ -0,0 +1,266 @@
+//
+// test_coredock_apply.c
+// The diff and apply steps behind coredock.apply against a stub Dock which records every call
+
+#include "test.h"
+#include "coredock/coredock_settings.h"
+
+static coredock_settings stubState ;
+static int               stubGets ;
+static int               stubSets ;
+static char              stubLog[256] ;
+
+static void stub_log(const char *call) {
+    stubSets++ ;
+    strncat(stubLog, call, sizeof(stubLog) - strlen(stubLog) - 1) ;
+    strncat(stubLog, " ", sizeof(stubLog) - strlen(stubLog) - 1) ;
+}
+
+static void stubGetOrientationAndPinning(CoreDockOrientation *o, CoreDockPinning *p) { stubGets++ ; *o = stubState.orientation ; *p = stubState.pinning ; }
+static float stubGetTileSize(void)                { stubGets++ ; return stubState.tileSize ; }
+static float stubGetMagnificationSize(void)       { stubGets++ ; return stubState.magnificationSize ; }
+static Boolean stubIsMagnificationEnabled(void)   { stubGets++ ; return stubState.magnification ; }
+static void stubGetEffect(CoreDockEffect *e)      { stubGets++ ; *e = stubState.animationEffect ; }
+static Boolean stubGetAutoHideEnabled(void)       { stubGets++ ; return stubState.autoHide ; }
+
+static void stubSetOrientationAndPinning(CoreDockOrientation o, CoreDockPinning p) {
+    char call[64] ;
+    snprintf(call, sizeof(call), "orientationAndPinning(%d,%d)", (int)o, (int)p) ;
+    stub_log(call) ;
+    if (o != kCoreDockOrientationIgnore) stubState.orientation = o ;
+    if (p != kCoreDockPinningIgnore)     stubState.pinning     = p ;
+}
+static void stubSetTileSize(float v)              { stub_log("tileSize") ;          stubState.tileSize = v ; }
+static void stubSetMagnificationSize(float v)     { stub_log("magnificationSize") ; stubState.magnificationSize = v ; }
+static void stubSetMagnificationEnabled(Boolean v){ stub_log("magnification") ;     stubState.magnification = v ; }
+static void stubSetEffect(CoreDockEffect v)       { stub_log("effect") ;            stubState.animationEffect = v ; }
+static void stubSetAutoHideEnabled(Boolean v)     { stub_log("autoHide") ;          stubState.autoHide = v ; }
+
+static const coredock_backend stubBackend = {
+    "stub",
+    stubGetOrientationAndPinning, stubSetOrientationAndPinning,
+    stubGetTileSize,              stubSetTileSize,
+    stubGetMagnificationSize,     stubSetMagnificationSize,
+    stubIsMagnificationEnabled,   stubSetMagnificationEnabled,
+    stubGetEffect,                stubSetEffect,
+    stubGetAutoHideEnabled,       stubSetAutoHideEnabled,
+    NULL
+} ;
+
+static const coredock_settings defaults = {
+    kCoreDockOrientationBottom, kCoreDockPinningMiddle, 0.5f, 0.75f, false, kCoreDockEffectGenie, false
+} ;
+
+static void stub_reset(void) {
+    stubState  = defaults ;
+    stubGets   = 0 ;
+    stubSets   = 0 ;
+    stubLog[0] = '\0' ;
+}
+
+// what coredock.apply does: read what was requested, diff, apply and re-read what changed
+static uint32_t apply(const coredock_settings *requested, uint32_t fields, int *calls) {
+    coredock_settings current ;
+    int               sets    = stubSets ;
+    uint32_t          changed = coredock_applyRequest(&stubBackend, requested, fields, &current) ;
+    *calls = stubSets - sets ;
+    CHECK_INT(coredock_diffSettings(&current, &stubState, fields), 0) ;
+    return changed ;
+}
+
+TEST(unchangedFieldsAreSkipped) {
+    stub_reset() ;
+    int calls ;
+    CHECK_INT(apply(&defaults, COREDOCK_ALL_FIELDS, &calls), 0) ;
+    CHECK_INT(calls, 0) ;
+    CHECK_INT(stubSets, 0) ;
+}
+
+TEST(profileSwitchMakesOneCallPerChangedSetting) {
+    stub_reset() ;
+    coredock_settings profile = defaults ;
+    profile.orientation       = kCoreDockOrientationLeft ;
+    profile.pinning           = kCoreDockPinningStart ;
+    profile.tileSize          = 0.25f ;
+    profile.magnification     = true ;
+    profile.autoHide          = true ;
+
+    int      calls ;
+    uint32_t changed = apply(&profile, COREDOCK_ALL_FIELDS, &calls) ;
+    CHECK_INT(changed, kCoreDockFieldOrientation | kCoreDockFieldPinning | kCoreDockFieldTileSize |
+                       kCoreDockFieldMagnification | kCoreDockFieldAutoHide) ;
+    CHECK_INT(calls, 4) ;
+    CHECK_STR(stubLog, "orientationAndPinning(3,1) tileSize magnification autoHide ") ;
+    CHECK(coredock_diffSettings(&stubState, &profile, COREDOCK_ALL_FIELDS) == 0) ;
+
+    // applying the same profile again does nothing
+    stub_reset() ;
+    stubState = profile ;
+    CHECK_INT(apply(&profile, COREDOCK_ALL_FIELDS, &calls), 0) ;
+    CHECK_INT(stubSets, 0) ;
+}
+
+TEST(orientationAloneLeavesPinningAlone) {
+    stub_reset() ;
+    coredock_settings requested = defaults ;
+    requested.orientation = kCoreDockOrientationRight ;
+    requested.pinning     = kCoreDockPinningEnd ;
+
+    int calls ;
+    CHECK_INT(apply(&requested, kCoreDockFieldOrientation, &calls), kCoreDockFieldOrientation) ;
+    CHECK_STR(stubLog, "orientationAndPinning(4,0) ") ;
+    CHECK_INT(stubState.pinning, kCoreDockPinningMiddle) ;
+
+    stub_reset() ;
+    CHECK_INT(apply(&requested, kCoreDockFieldOrientation | kCoreDockFieldPinning, &calls),
+              kCoreDockFieldOrientation | kCoreDockFieldPinning) ;
+    CHECK_INT(calls, 1) ;
+    CHECK_STR(stubLog, "orientationAndPinning(4,3) ") ;
+}
+
+TEST(fieldsNotRequestedAreNeitherReadNorCompared) {
+    stub_reset() ;
+    coredock_settings requested = { 0 } ;
+    requested.tileSize = 0.9f ;
+
+    int calls ;
+    CHECK_INT(apply(&requested, kCoreDockFieldTileSize, &calls), kCoreDockFieldTileSize) ;
+    CHECK_INT(stubGets, 2) ; // the comparison and the re-read after the set
+    CHECK_STR(stubLog, "tileSize ") ;
+    CHECK_INT(stubState.orientation, kCoreDockOrientationBottom) ;
+}
+
+TEST(sizesWithinEpsilonAreUnchanged) {
+    coredock_settings a = defaults, b = defaults ;
+    b.tileSize          = a.tileSize + COREDOCK_SIZE_EPSILON / 2 ;
+    b.magnificationSize = a.magnificationSize - COREDOCK_SIZE_EPSILON / 2 ;
+    CHECK_INT(coredock_diffSettings(&a, &b, COREDOCK_ALL_FIELDS), 0) ;
+    b.tileSize = a.tileSize + COREDOCK_SIZE_EPSILON * 2 ;
+    CHECK_INT(coredock_diffSettings(&a, &b, COREDOCK_ALL_FIELDS), kCoreDockFieldTileSize) ;
+}
+
+TEST(booleansCompareByTruth) {
+    coredock_settings a = defaults, b = defaults ;
+    a.magnification = 1 ;
+    b.magnification = 2 ;
+    CHECK_INT(coredock_diffSettings(&a, &b, COREDOCK_ALL_FIELDS), 0) ;
+    b.autoHide = 1 ;
+    CHECK_INT(coredock_diffSettings(&a, &b, COREDOCK_ALL_FIELDS), kCoreDockFieldAutoHide) ;
+}
+
+// every combination of requested fields and values: the calls made are exactly the changed settings, with
+// orientation and pinning counted once, and afterwards the Dock matches the request
+TEST(randomRequestsMakeTheMinimumCalls) {
+    test_seed(3003) ;
+    for (int i = 0 ; i < 20000 ; i++) {
+        stub_reset() ;
+        stubState.orientation       = (CoreDockOrientation)(1 + test_random() % 4) ;
+        stubState.pinning           = (CoreDockPinning)(1 + test_random() % 3) ;
+        stubState.tileSize          = (float)(test_random() % 4) / 4.0f ;
+        stubState.animationEffect   = (CoreDockEffect)(1 + test_random() % 3) ;
+        stubState.autoHide          = (Boolean)(test_random() & 1) ;
+
+        coredock_settings requested = stubState ;
+        uint32_t          fields    = test_random() & COREDOCK_ALL_FIELDS ;
+        if (test_random() & 1) requested.orientation     = (CoreDockOrientation)(1 + test_random() % 4) ;
+        if (test_random() & 1) requested.pinning         = (CoreDockPinning)(1 + test_random() % 3) ;
+        if (test_random() & 1) requested.tileSize        = (float)(test_random() % 4) / 4.0f ;
+        if (test_random() & 1) requested.animationEffect = (CoreDockEffect)(1 + test_random() % 3) ;
+        if (test_random() & 1) requested.autoHide        = !requested.autoHide ;
+
+        int      calls ;
+        uint32_t changed  = apply(&requested, fields, &calls) ;
+        int      expected = __builtin_popcount(changed & ~(kCoreDockFieldOrientation | kCoreDockFieldPinning)) +
+                            ((changed & (kCoreDockFieldOrientation | kCoreDockFieldPinning)) ? 1 : 0) ;
+        CHECK_INT(changed & ~fields, 0) ;
+        CHECK_INT(calls, expected) ;
+        CHECK_INT(stubSets, expected) ;
+        CHECK_INT(coredock_diffSettings(&stubState, &requested, fields), 0) ;
+    }
+}
+
+TEST(mockBackendKeepsItsState) {
+    hsasm_mock_reset(&coredock_mock) ;
+    coredock_settings current = { 0 } ;
+    coredock_readSettings(&coredock_mockBackend, &current) ;
+    CHECK_INT(coredock_diffSettings(&current, &coredock_mockState, COREDOCK_ALL_FIELDS), 0) ;
+
+    coredock_settings requested = current ;
+    requested.tileSize = 0.3f ;
+    requested.pinning  = kCoreDockPinningEnd ;
+    uint32_t changed = coredock_diffSettings(&current, &requested, COREDOCK_ALL_FIELDS) ;
+    CHECK_INT(coredock_applySettings(&coredock_mockBackend, &requested, changed), 2) ;
+    coredock_readSettings(&coredock_mockBackend, &current) ;
+    CHECK_NEAR(current.tileSize, 0.3, 1e-6) ;
+    CHECK_INT(current.pinning, kCoreDockPinningEnd) ;
+    CHECK_INT(current.orientation, kCoreDockOrientationBottom) ;
+    // two full reads of six getters (orientation and pinning share one) and two sets
+    CHECK_INT(atomic_load(&coredock_mock.calls), 6 + 2 + 6) ;
+}
+
+TEST(snapshotFillsOnFirstReadAndCountsChanges) {
+    stub_reset() ;
+    coredock_snapshot snapshot = { .valid = false } ;
+    CHECK_INT(coredock_snapshot_settings(&snapshot, &stubBackend)->orientation, kCoreDockOrientationBottom) ;
+    int gets = stubGets ;
+    CHECK_INT(snapshot.generation, 1) ;
+    CHECK_NEAR(coredock_snapshot_settings(&snapshot, &stubBackend)->tileSize, 0.5, 1e-6) ;
+    CHECK_INT(stubGets, gets) ;
+
+    coredock_settings values = defaults ;
+    coredock_snapshot_update(&snapshot, &values, COREDOCK_ALL_FIELDS) ;
+    CHECK_INT(snapshot.generation, 1) ;
+    values.tileSize = 0.25f ;
+    values.autoHide = true ;
+    coredock_snapshot_update(&snapshot, &values, kCoreDockFieldTileSize) ;
+    CHECK_INT(snapshot.generation, 2) ;
+    CHECK_NEAR(snapshot.settings.tileSize, 0.25, 1e-6) ;
+    CHECK(!snapshot.settings.autoHide) ;
+
+    // an invalidated snapshot ignores updates and is filled in by the next read
+    snapshot.valid = false ;
+    coredock_snapshot_update(&snapshot, &values, COREDOCK_ALL_FIELDS) ;
+    CHECK_INT(snapshot.generation, 2) ;
+    CHECK_NEAR(coredock_snapshot_settings(&snapshot, &stubBackend)->tileSize, 0.5, 1e-6) ;
+    CHECK_INT(snapshot.generation, 3) ;
+}
+
+// the Dock was changed behind our back (System Settings, `defaults write`, another process) so the
+// snapshot is stale; asking for the value the snapshot still holds must still reach the Dock
+TEST(staleSnapshotDoesNotSuppressTheSet) {
+    stub_reset() ;
+    coredock_snapshot snapshot = { .valid = false } ;
+    coredock_snapshot_settings(&snapshot, &stubBackend) ;
+    stubState.tileSize = 0.3f ;
+
+    coredock_settings requested = defaults, updated ;
+    CHECK_INT(coredock_diffSettings(&snapshot.settings, &requested, kCoreDockFieldTileSize), 0) ;
+    uint32_t changed = coredock_applyRequest(&stubBackend, &requested, kCoreDockFieldTileSize, &updated) ;
+    coredock_snapshot_update(&snapshot, &updated, kCoreDockFieldTileSize) ;
+    CHECK_INT(changed, kCoreDockFieldTileSize) ;
+    CHECK_STR(stubLog, "tileSize ") ;
+    CHECK_NEAR(stubState.tileSize, 0.5, 1e-6) ;
+    CHECK_NEAR(snapshot.settings.tileSize, 0.5, 1e-6) ;
+
+    // and the other way around: the snapshot is refreshed with what the Dock reports even when nothing
+    // had to be set
+    stubState.autoHide = true ;
+    requested.autoHide = true ;
+    CHECK_INT(coredock_applyRequest(&stubBackend, &requested, kCoreDockFieldAutoHide, &updated), 0) ;
+    coredock_snapshot_update(&snapshot, &updated, kCoreDockFieldAutoHide) ;
+    CHECK(snapshot.settings.autoHide) ;
+}
+
+int main(void) {
+    RUN_TEST(unchangedFieldsAreSkipped) ;
+    RUN_TEST(profileSwitchMakesOneCallPerChangedSetting) ;
+    RUN_TEST(orientationAloneLeavesPinningAlone) ;
+    RUN_TEST(fieldsNotRequestedAreNeitherReadNorCompared) ;
+    RUN_TEST(sizesWithinEpsilonAreUnchanged) ;
+    RUN_TEST(booleansCompareByTruth) ;
+    RUN_TEST(randomRequestsMakeTheMinimumCalls) ;
+    RUN_TEST(mockBackendKeepsItsState) ;
+    RUN_TEST(snapshotFillsOnFirstReadAndCountsChanges) ;
+    RUN_TEST(staleSnapshotDoesNotSuppressTheSet) ;
+    return test_finish("coredock apply") ;
+}
@@ -0,0 +1,319 @@
+//
+// test_cursor_backend.c
+// The cursor module's mock backends: the cursor state and its seed, the registered cursor sets, the
+// generated images read back through the capture path's unpremultiply, and the mock connections driving the
+// connection tracker the way the WindowServer's notifications drive it in connections.m
+
+#include "test.h"
+#include "cursor/cursor_backend.h"
+#include "cursor/cursor_connections.h"
+#include "cursor/cursor_pixels.h"
+
+static const cursor_backend           *cgs     = &cursor_mockBackend ;
+static const cursor_captureBackend    *capture = &cursor_mockCaptureBackend ;
+static const cursor_connectionBackend *conns   = &cursor_mockConnectionBackend ;
+
+static void mock_configure(double failureRate) {
+    cursorMock.failureRate = failureRate ;
+    hsasm_mock_reset(&cursorMock) ;
+}
+
+TEST(cursorStateChangesTheSeed) {
+    mock_configure(0.0) ;
+    int seed = cgs->currentCursorSeed() ;
+    CHECK(seed != 0) ;
+
+    CHECK_INT(cgs->hideCursor(1), kCGErrorSuccess) ;
+    CHECK_INT(cgs->currentCursorSeed(), seed + 1) ;
+    // hiding a hidden cursor changes nothing
+    CHECK_INT(cgs->hideCursor(1), kCGErrorSuccess) ;
+    CHECK_INT(cgs->currentCursorSeed(), seed + 1) ;
+    CHECK_INT(cgs->showCursor(1), kCGErrorSuccess) ;
+    CHECK_INT(cgs->obscureCursor(1), kCGErrorSuccess) ;
+    CHECK_INT(cgs->revealCursor(1), kCGErrorSuccess) ;
+    CHECK_INT(cgs->forceWaitCursorActive(1, true), kCGErrorSuccess) ;
+    CHECK_INT(cgs->forceWaitCursorActive(1, false), kCGErrorSuccess) ;
+    CHECK_INT(cgs->currentCursorSeed(), seed + 6) ;
+
+    CGFloat scale = 0 ;
+    CHECK_INT(cgs->setCursorScale(1, 2.5), kCGErrorSuccess) ;
+    CHECK_INT(cgs->getCursorScale(1, &scale), kCGErrorSuccess) ;
+    CHECK_NEAR(scale, 2.5, 0.0) ;
+
+    CGPoint location = { -1, -1 } ;
+    CHECK_INT(cgs->warpCursorPosition(1, 100.5, 200.25), kCGErrorSuccess) ;
+    CHECK_INT(cgs->getCurrentCursorLocation(1, &location), kCGErrorSuccess) ;
+    CHECK_NEAR(location.x, 100.5, 0.0) ;
+    CHECK_NEAR(location.y, 200.25, 0.0) ;
+
+    CHECK_STR(cgs->cursorNameForSystemCursor(3), "mock.cursor.3") ;
+    CHECK_INT(atomic_load(&cursorMock.calls), 16) ;
+    CHECK_INT(atomic_load(&cursorMock.failures), 0) ;
+}
+
+TEST(failedCallsLeaveTheStateUnchanged) {
+    mock_configure(0.0) ;
+    CHECK_INT(cgs->showCursor(1), kCGErrorSuccess) ;
+    CHECK_INT(cgs->warpCursorPosition(1, 10, 20), kCGErrorSuccess) ;
+    int seed = cgs->currentCursorSeed() ;
+
+    mock_configure(1.0) ;
+    cursorMock.failureCode = kCGErrorCannotComplete ;
+    CGPoint location = { 0, 0 } ;
+    size_t  size     = 0 ;
+    CHECK_INT(cgs->hideCursor(1), kCGErrorCannotComplete) ;
+    CHECK_INT(cgs->warpCursorPosition(1, 30, 40), kCGErrorCannotComplete) ;
+    CHECK_INT(cgs->getCurrentCursorLocation(1, &location), kCGErrorCannotComplete) ;
+    CHECK_INT(cgs->currentCursorSeed(), 0) ;
+    CHECK(cgs->cursorNameForSystemCursor(0) == NULL) ;
+    CHECK_INT(capture->getGlobalCursorDataSize(1, &size), kCGErrorCannotComplete) ;
+    CHECK_INT(size, 0) ;
+    CHECK_INT(atomic_load(&cursorMock.failures), 6) ;
+
+    mock_configure(0.0) ;
+    cursorMock.failureCode = kCGErrorFailure ;
+    CHECK_INT(cgs->currentCursorSeed(), seed) ;
+    CHECK_INT(cgs->getCurrentCursorLocation(1, &location), kCGErrorSuccess) ;
+    CHECK_NEAR(location.x, 10, 0.0) ;
+    CHECK_NEAR(location.y, 20, 0.0) ;
+
+    // a partial failure rate fails about that share of the calls
+    mock_configure(0.25) ;
+    for (int i = 0 ; i < 100000 ; i++) (void)cgs->currentCursorSeed() ;
+    CHECK_NEAR((double)atomic_load(&cursorMock.failures) / 100000.0, 0.25, 0.01) ;
+    mock_configure(0.0) ;
+}
+
+// sets registered through the mock can be switched to and read back until the WindowServer forgets them
+TEST(registeredSets) {
+    mock_configure(0.0) ;
+    static const char frames[3] = { 0 } ;
+    CFArrayRef images  = (CFArrayRef)frames ;
+    CGSize     size    = { 16, 16 } ;
+    CGPoint    hotSpot = { 3, 4 } ;
+    int        seed    = 0, first = 0 ;
+    int        current = cgs->currentCursorSeed() ;
+
+    CHECK_INT(cgs->registerCursorWithImages(1, "test.spinner", true, true, 3, images, size, hotSpot, &first,
+                                            (CGRect){ { 0, 0 }, size }, 0.1, 0), kCGErrorSuccess) ;
+    CHECK(first > current) ;
+    CHECK_INT(cgs->registerCursorWithImages(1, "test.spinner", true, true, 0, images, size, hotSpot, &seed,
+                                            (CGRect){ { 0, 0 }, size }, 0.1, 0), kCGErrorIllegalArgument) ;
+
+    size_t dataSize = 0 ;
+    CHECK_INT(cgs->getRegisteredCursorDataSize(1, "test.spinner", &dataSize), kCGErrorSuccess) ;
+    CHECK_INT(dataSize, 3 * 32 * 32 * 4) ;
+    CHECK_INT(cgs->getRegisteredCursorDataSize(1, "test.unknown", &dataSize), kCGErrorIllegalArgument) ;
+
+    current = cgs->currentCursorSeed() ;
+    CHECK_INT(cgs->setRegisteredCursor(1, "test.spinner", &seed), kCGErrorSuccess) ;
+    CHECK_INT(seed, first) ;
+    CHECK_INT(cgs->currentCursorSeed(), current + 1) ;
+    CHECK_INT(cgs->setRegisteredCursor(1, "test.unknown", &seed), kCGErrorIllegalArgument) ;
+
+    CGSize     imageSize     = { 0, 0 } ;
+    NSUInteger frameCount    = 0 ;
+    CGFloat    frameDuration = 0 ;
+    CFArrayRef copied        = NULL ;
+    CHECK_INT(cgs->copyRegisteredCursorImages(1, "test.spinner", &imageSize, &hotSpot, &frameCount, &frameDuration, &copied), kCGErrorSuccess) ;
+    CHECK(copied == images) ;
+    CHECK_INT(frameCount, 3) ;
+    CHECK_NEAR(imageSize.width, 16, 0.0) ;
+    CHECK_NEAR(hotSpot.y, 4, 0.0) ;
+    CHECK_NEAR(frameDuration, 0.1, 0.0) ;
+
+    // registering the name again replaces the set and gives it a new seed
+    CHECK_INT(cgs->registerCursorWithImages(1, "test.spinner", true, true, 1, images, size, hotSpot, &seed,
+                                            (CGRect){ { 0, 0 }, size }, 0.2, 0), kCGErrorSuccess) ;
+    CHECK(seed > first) ;
+    CHECK_INT(cgs->getRegisteredCursorDataSize(1, "test.spinner", &dataSize), kCGErrorSuccess) ;
+    CHECK_INT(dataSize, 32 * 32 * 4) ;
+
+    mock_configure(1.0) ;
+    CHECK_INT(cgs->setRegisteredCursor(1, "test.spinner", &seed), kCGErrorFailure) ;
+    mock_configure(0.0) ;
+
+    cursor_mock_forgetRegisteredCursors() ;
+    CHECK_INT(cgs->getRegisteredCursorDataSize(1, "test.spinner", &dataSize), kCGErrorIllegalArgument) ;
+    CHECK_INT(cgs->copyRegisteredCursorImages(1, "test.spinner", &imageSize, &hotSpot, &frameCount, &frameDuration, &copied), kCGErrorIllegalArgument) ;
+    CHECK(copied == NULL) ;
+}
+
+// captures the current cursor the way capture.m does: ask for the size, fill a pooled buffer, check the
+// format and convert it in place
+static cursor_buffer *capture_current(cursor_pool *pool, int *rowBytes, CGRect *rect, CGPoint *hotSpot) {
+    size_t size = 0 ;
+    if (capture->getGlobalCursorDataSize(1, &size) != kCGErrorSuccess) return NULL ;
+    cursor_buffer *buffer = cursor_pool_acquire(pool, size) ;
+    if (!buffer) return NULL ;
+    int dataSize = (int)size, depth = 0, components = 0, bitsPerComponent = 0 ;
+    if (capture->getGlobalCursorData(1, buffer->bytes, &dataSize, rowBytes, rect, hotSpot, &depth, &components, &bitsPerComponent) != kCGErrorSuccess ||
+        depth != 32 || components != 4 || bitsPerComponent != 8 || (size_t)dataSize != size) {
+        cursor_pool_release(pool, buffer) ;
+        return NULL ;
+    }
+    cursor_unpremultiplyImage(buffer->bytes, (size_t)*rowBytes, (size_t)*rowBytes / 4, size / (size_t)*rowBytes) ;
+    return buffer ;
+}
+
+TEST(capturedImagesRoundTrip) {
+    mock_configure(0.0) ;
+    cursor_buildUnpremultiplyTable() ;
+    cursor_pool pool ;
+    cursor_pool_init(&pool, 2) ;
+
+    int            rowBytes = 0 ;
+    CGRect         rect ;
+    CGPoint        hotSpot ;
+    cursor_buffer *buffer = capture_current(&pool, &rowBytes, &rect, &hotSpot) ;
+    CHECK(buffer != NULL) ;
+    if (!buffer) return ;
+    CHECK_INT(rowBytes, CURSOR_MOCK_ROW_BYTES) ;
+    CHECK_NEAR(rect.size.width, CURSOR_MOCK_PIXELS / 2, 0.0) ;
+    CHECK_NEAR(hotSpot.x, 4.0, 0.0) ;
+
+    // opaque pixels come back exactly; translucent ones within the rounding of premultiplying
+    uint32_t variant = (uint32_t)cgs->currentCursorSeed() ;
+    size_t   opaque = 0, clear = 0 ;
+    for (size_t y = 0 ; y < CURSOR_MOCK_PIXELS ; y++) {
+        for (size_t x = 0 ; x < CURSOR_MOCK_PIXELS ; x++) {
+            uint8_t       expected[4] ;
+            const uint8_t *pixel = buffer->bytes + y * CURSOR_MOCK_ROW_BYTES + x * 4 ;
+            cursor_mockPixel(variant, x, y, expected) ;
+            CHECK_INT(pixel[3], expected[3]) ;
+            if (expected[3] == 0) {
+                clear++ ;
+                continue ;
+            }
+            if (expected[3] == 255) opaque++ ;
+            int tolerance = (expected[3] == 255) ? 0 : 255 / expected[3] + 1 ;
+            for (int c = 0 ; c < 3 ; c++) CHECK(abs(pixel[c] - expected[c]) <= tolerance) ;
+        }
+    }
+    CHECK(opaque > 0 && clear > 0 && opaque + clear < CURSOR_MOCK_PIXELS * CURSOR_MOCK_PIXELS) ;
+
+    // a different seed is a different image
+    uint8_t first[CURSOR_MOCK_DATA_SIZE] ;
+    memcpy(first, buffer->bytes, sizeof(first)) ;
+    cursor_pool_release(&pool, buffer) ;
+    CHECK_INT(cgs->obscureCursor(1), kCGErrorSuccess) ;
+    CHECK_INT(cgs->revealCursor(1), kCGErrorSuccess) ;
+    buffer = capture_current(&pool, &rowBytes, &rect, &hotSpot) ;
+    CHECK(buffer != NULL) ;
+    if (buffer) CHECK(memcmp(first, buffer->bytes, sizeof(first)) != 0) ;
+    cursor_pool_release(&pool, buffer) ;
+    CHECK_INT(pool.reused, 1) ;
+    cursor_pool_drain(&pool) ;
+}
+
+TEST(captureErrors) {
+    mock_configure(0.0) ;
+    uint8_t bytes[CURSOR_MOCK_DATA_SIZE] ;
+    int     dataSize = CURSOR_MOCK_DATA_SIZE - 1, rowBytes = 0, depth = 0, components = 0, bitsPerComponent = 0 ;
+    CGRect  rect ;
+    CGPoint hotSpot ;
+    CHECK_INT(capture->getGlobalCursorData(1, bytes, &dataSize, &rowBytes, &rect, &hotSpot, &depth, &components, &bitsPerComponent), kCGErrorRangeCheck) ;
+
+    size_t size = 0 ;
+    CHECK_INT(capture->getSystemDefinedCursorDataSize(1, 0, &size), kCGErrorSuccess) ;
+    CHECK_INT(size, CURSOR_MOCK_DATA_SIZE) ;
+    CHECK_INT(capture->getSystemDefinedCursorData(1, CURSOR_MOCK_SYSTEM_CURSORS - 1, bytes, &rowBytes, &rect, &hotSpot, &depth, &components, &bitsPerComponent), kCGErrorSuccess) ;
+    CHECK_INT(depth, 32) ;
+    CHECK_INT(capture->getSystemDefinedCursorDataSize(1, CURSOR_MOCK_SYSTEM_CURSORS, &size), kCGErrorIllegalArgument) ;
+    CHECK_INT(capture->getSystemDefinedCursorData(1, -1, bytes, &rowBytes, &rect, &hotSpot, &depth, &components, &bitsPerComponent), kCGErrorIllegalArgument) ;
+
+    CGSize     imageSize ;
+    NSUInteger frameCount = 1 ;
+    CGFloat    frameDuration ;
+    CFArrayRef images = (CFArrayRef)bytes ;
+    CHECK_INT(capture->copyRegisteredCursorImages(1, "com.apple.coregraphics.Arrow", &imageSize, &hotSpot, &frameCount, &frameDuration, &images), kCGErrorIllegalArgument) ;
+    CHECK(images == NULL) ;
+    CHECK_INT(frameCount, 0) ;
+}
+
+// the connection tracker as connections.m runs it, with the notifications applied directly rather than
+// on the main queue
+static conn_tracker tracker ;
+static int          created, died ;
+
+static void new_connection(CGSConnectionID cid) {
+    pid_t pid = 0 ;
+    if (conns->connectionGetPID(cid, &pid) == kCGErrorSuccess && conn_tracker_created(&tracker, cid, pid)) created++ ;
+}
+
+static void connection_death(CGSConnectionID cid) {
+    if (conn_tracker_died(&tracker, cid) != 0) died++ ;
+}
+
+TEST(connectionsDriveTheTracker) {
+    mock_configure(0.0) ;
+    CHECK(conn_tracker_init(&tracker)) ;
+    pid_t           ourPID = getpid() ;
+    CGSConnectionID main   = conns->mainConnectionID() ;
+    CHECK(main != 0) ;
+    CHECK_INT(conns->mainConnectionID(), main) ;
+    conn_tracker_created(&tracker, main, ourPID) ;
+    CHECK_INT(conns->registerForNewConnectionNotification(new_connection), kCGErrorSuccess) ;
+    CHECK_INT(conns->registerForConnectionDeathNotification(connection_death), kCGErrorSuccess) ;
+
+    // applications already running; asking twice gives the same connection
+    for (pid_t pid = 100 ; pid < 110 ; pid++) {
+        CGSConnectionID cid = 0 ;
+        CHECK_INT(conns->connectionForPID(pid, &cid), kCGErrorSuccess) ;
+        CHECK(conn_tracker_created(&tracker, cid, pid)) ;
+        CGSConnectionID again = 0 ;
+        CHECK_INT(conns->connectionForPID(pid, &again), kCGErrorSuccess) ;
+        CHECK_INT(again, cid) ;
+        pid_t owner = 0 ;
+        CHECK_INT(conns->connectionGetPID(cid, &owner), kCGErrorSuccess) ;
+        CHECK_INT(owner, pid) ;
+    }
+    CGSConnectionID none = 0 ;
+    CHECK_INT(conns->connectionForPID(0, &none), kCGErrorIllegalArgument) ;
+    CHECK_INT(tracker.connectionToPID.count, 11) ;
+
+    // only this process's connections are notified
+    CGSConnectionID ours   = cursor_mock_connect(ourPID) ;
+    CGSConnectionID theirs = cursor_mock_connect(105) ;
+    CHECK(ours != 0 && theirs != 0) ;
+    CHECK_INT(created, 1) ;
+    CHECK_INT(conn_tracker_pidForConnection(&tracker, ours), ourPID) ;
+    CHECK_INT(cursor_mock_disconnect(ours), ourPID) ;
+    CHECK_INT(cursor_mock_disconnect(ours), 0) ;
+    CHECK_INT(died, 1) ;
+    CHECK_INT(conn_tracker_pidForConnection(&tracker, ours), 0) ;
+
+    // a terminated application's connections are gone from the WindowServer and are removed from the
+    // tracker as NSWorkspace reports it
+    CHECK_INT(cursor_mock_terminate(105), 2) ;
+    pid_t owner = 0 ;
+    CHECK_INT(conns->connectionGetPID(theirs, &owner), kCGErrorIllegalArgument) ;
+    int32_t removed[8] ;
+    CHECK_INT(conn_tracker_terminated(&tracker, 105, removed, 8), 1) ;
+    CHECK_INT(tracker.connectionToPID.count, 10) ;
+
+    // after removing the procs nothing more is delivered
+    CHECK_INT(conns->removeNewConnectionNotification(new_connection), kCGErrorSuccess) ;
+    CHECK_INT(conns->removeConnectionDeathNotification(connection_death), kCGErrorSuccess) ;
+    cursor_mock_disconnect(cursor_mock_connect(ourPID)) ;
+    CHECK_INT(created, 1) ;
+    CHECK_INT(died, 1) ;
+
+    // a failed registration leaves nothing registered
+    mock_configure(1.0) ;
+    CHECK_INT(conns->registerForNewConnectionNotification(new_connection), kCGErrorFailure) ;
+    mock_configure(0.0) ;
+    cursor_mock_connect(ourPID) ;
+    CHECK_INT(created, 1) ;
+    conn_tracker_free(&tracker) ;
+}
+
+int main(void) {
+    RUN_TEST(cursorStateChangesTheSeed) ;
+    RUN_TEST(failedCallsLeaveTheStateUnchanged) ;
+    RUN_TEST(registeredSets) ;
+    RUN_TEST(capturedImagesRoundTrip) ;
+    RUN_TEST(captureErrors) ;
+    RUN_TEST(connectionsDriveTheTracker) ;
+    return test_finish("cursor backend") ;
+}
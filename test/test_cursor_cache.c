@@ -0,0 +1,211 @@
+//
+// test_cursor_cache.c
+// The seed-keyed capture cache: hits and misses, eviction in order of use against the byte budget, and a
+// random sequence of captures checked against a simple model of the same cache
+
+#include "test.h"
+#include "cursor/cursor_cache.h"
+
+// the values stored are indexes into this, so releases can be counted
+static int released[4096] ;
+
+static void release_value(void *value, void *context) {
+    (void)context ;
+    released[(uintptr_t)value]++ ;
+}
+
+static void *value(uintptr_t index) {
+    return (void *)index ;
+}
+
+static void new_cache(cursor_cache *cache, size_t budget) {
+    memset(released, 0, sizeof(released)) ;
+    cursor_cache_init(cache, budget, release_value, NULL) ;
+}
+
+TEST(hitsAndMisses) {
+    cursor_cache cache ;
+    new_cache(&cache, 1000) ;
+    CHECK(cursor_cache_lookup(&cache, 1, "current") == NULL) ;
+    CHECK(cursor_cache_store(&cache, 1, "current", value(1), 100)) ;
+    CHECK(cursor_cache_lookup(&cache, 1, "current") == value(1)) ;
+    // a new seed is a new image, and so is a different cursor with the same seed
+    CHECK(cursor_cache_lookup(&cache, 2, "current") == NULL) ;
+    CHECK(cursor_cache_lookup(&cache, 1, "Arrow") == NULL) ;
+    CHECK_INT(cache.hits, 1) ;
+    CHECK_INT(cache.misses, 3) ;
+    CHECK_INT(cache.count, 1) ;
+    CHECK_INT(cache.bytes, 100) ;
+    cursor_cache_free(&cache) ;
+    CHECK_INT(released[1], 1) ;
+}
+
+TEST(leastRecentlyUsedIsEvictedFirst) {
+    cursor_cache cache ;
+    new_cache(&cache, 300) ;
+    cursor_cache_store(&cache, 1, "a", value(1), 100) ;
+    cursor_cache_store(&cache, 1, "b", value(2), 100) ;
+    cursor_cache_store(&cache, 1, "c", value(3), 100) ;
+    CHECK(cursor_cache_lookup(&cache, 1, "a") == value(1)) ;
+
+    // b is now the oldest, and a fourth image doesn't fit alongside it
+    cursor_cache_store(&cache, 1, "d", value(4), 100) ;
+    CHECK_INT(released[2], 1) ;
+    CHECK_INT(cache.evictions, 1) ;
+    CHECK(cursor_cache_lookup(&cache, 1, "b") == NULL) ;
+    CHECK(cursor_cache_lookup(&cache, 1, "a") == value(1)) ;
+
+    // a larger image evicts as many as it needs to
+    cursor_cache_store(&cache, 1, "e", value(5), 250) ;
+    CHECK_INT(released[3] + released[4] + released[1], 3) ;
+    CHECK_INT(cache.count, 1) ;
+    CHECK_INT(cache.bytes, 250) ;
+    cursor_cache_free(&cache) ;
+}
+
+TEST(imagesLargerThanTheBudgetAreNotCached) {
+    cursor_cache cache ;
+    new_cache(&cache, 300) ;
+    cursor_cache_store(&cache, 1, "a", value(1), 100) ;
+    CHECK(!cursor_cache_store(&cache, 1, "big", value(2), 301)) ;
+    // nothing was evicted to make room for it, and the caller still owns it
+    CHECK_INT(cache.count, 1) ;
+    CHECK_INT(released[1] + released[2], 0) ;
+
+    cursor_cache_setBudget(&cache, 0) ;
+    CHECK(!cursor_cache_store(&cache, 1, "a", value(3), 1)) ;
+    CHECK_INT(cache.count, 0) ;
+    CHECK_INT(released[1], 1) ;
+    cursor_cache_free(&cache) ;
+}
+
+TEST(loweringTheBudgetEvicts) {
+    cursor_cache cache ;
+    new_cache(&cache, 1000) ;
+    for (uintptr_t i = 1 ; i <= 10 ; i++) cursor_cache_store(&cache, (int)i, "current", value(i), 100) ;
+    cursor_cache_setBudget(&cache, 450) ;
+    CHECK_INT(cache.count, 4) ;
+    CHECK_INT(cache.bytes, 400) ;
+    for (uintptr_t i = 1 ; i <= 6 ; i++) CHECK_INT(released[i], 1) ;
+    for (uintptr_t i = 7 ; i <= 10 ; i++) CHECK_INT(released[i], 0) ;
+    cursor_cache_free(&cache) ;
+}
+
+TEST(storingAgainReplaces) {
+    cursor_cache cache ;
+    new_cache(&cache, 1000) ;
+    cursor_cache_store(&cache, 7, "current", value(1), 100) ;
+    cursor_cache_store(&cache, 7, "current", value(2), 200) ;
+    CHECK_INT(released[1], 1) ;
+    CHECK_INT(cache.count, 1) ;
+    CHECK_INT(cache.bytes, 200) ;
+    CHECK(cursor_cache_lookup(&cache, 7, "current") == value(2)) ;
+    CHECK_INT(cache.evictions, 0) ;
+    cursor_cache_free(&cache) ;
+}
+
+TEST(flushReleasesEverythingAndKeepsTheCounters) {
+    cursor_cache cache ;
+    new_cache(&cache, 1000000) ;
+    for (uintptr_t i = 0 ; i < 1000 ; i++) cursor_cache_store(&cache, (int)i, "current", value(i), 10) ;
+    CHECK(cache.bucketCount >= 1000) ;
+    CHECK(cursor_cache_lookup(&cache, 500, "current") == value(500)) ;
+    cursor_cache_flush(&cache) ;
+    CHECK_INT(cache.count, 0) ;
+    CHECK_INT(cache.bytes, 0) ;
+    CHECK(cache.oldest == NULL && cache.newest == NULL) ;
+    int total = 0 ;
+    for (int i = 0 ; i < 1000 ; i++) total += released[i] ;
+    CHECK_INT(total, 1000) ;
+    CHECK_INT(cache.hits, 1) ;
+    CHECK(cursor_cache_lookup(&cache, 500, "current") == NULL) ;
+    cursor_cache_free(&cache) ;
+}
+
+// The model keeps the entries in an array from least to most recently used, as the NSMutableOrderedSet
+// the cache replaced did, and is checked against the cache after every operation.
+typedef struct {
+    int    seed ;
+    int    name ;
+    size_t bytes ;
+    void   *value ;
+} model_entry ;
+
+static model_entry model[4096] ;
+static size_t      modelCount ;
+static size_t      modelBytes ;
+
+static void model_remove(size_t i) {
+    modelBytes -= model[i].bytes ;
+    memmove(model + i, model + i + 1, (modelCount - i - 1) * sizeof(model_entry)) ;
+    modelCount-- ;
+}
+
+static long model_find(int seed, int name) {
+    for (size_t i = 0 ; i < modelCount ; i++) if (model[i].seed == seed && model[i].name == name) return (long)i ;
+    return -1 ;
+}
+
+TEST(randomCapturesMatchTheModel) {
+    static const char *const names[] = { "current", "Arrow", "IBeam", "Wait", "Busy", "ResizeLeftRight" } ;
+    cursor_cache cache ;
+    new_cache(&cache, 64 * 1024) ;
+    modelCount = modelBytes = 0 ;
+    test_seed(12) ;
+
+    uintptr_t next = 1 ;
+    for (int step = 0 ; step < 200000 ; step++) {
+        int seed = (int)(test_random() % 40), name = (int)(test_random() % 6) ;
+        if (test_random() % 500 == 0) {
+            size_t budget = 1024 * (test_random() % 96) ;
+            cursor_cache_setBudget(&cache, budget) ;
+            while (modelBytes > budget) model_remove(0) ;
+            continue ;
+        }
+
+        void *found = cursor_cache_lookup(&cache, seed, names[name]) ;
+        long i      = model_find(seed, name) ;
+        CHECK(found == ((i >= 0) ? model[i].value : NULL)) ;
+        if (i >= 0) {
+            model_entry entry = model[i] ;
+            model_remove((size_t)i) ;
+            model[modelCount++] = entry ;
+            modelBytes += entry.bytes ;
+            continue ;
+        }
+
+        // a miss is captured and stored
+        size_t bytes = 4096 * (1 + test_random() % 4) ;
+        void   *v    = value(next) ;
+        next = (next % 4095) + 1 ;
+        bool stored = cursor_cache_store(&cache, seed, names[name], v, bytes) ;
+        CHECK(stored == (bytes <= cache.budget)) ;
+        if (stored) {
+            while (modelBytes + bytes > cache.budget) model_remove(0) ;
+            model[modelCount++] = (model_entry){ seed, name, bytes, v } ;
+            modelBytes += bytes ;
+        }
+        CHECK_INT(cache.count, modelCount) ;
+        CHECK_INT(cache.bytes, modelBytes) ;
+        CHECK(cache.bytes <= cache.budget) ;
+    }
+
+    // and the list runs oldest to newest in the same order as the model
+    size_t i = 0 ;
+    for (cursor_cacheEntry *entry = cache.oldest ; entry ; entry = entry->newer, i++) {
+        CHECK(i < modelCount && entry->value == model[i].value) ;
+    }
+    CHECK_INT(i, modelCount) ;
+    cursor_cache_free(&cache) ;
+}
+
+int main(void) {
+    RUN_TEST(hitsAndMisses) ;
+    RUN_TEST(leastRecentlyUsedIsEvictedFirst) ;
+    RUN_TEST(imagesLargerThanTheBudgetAreNotCached) ;
+    RUN_TEST(loweringTheBudgetEvicts) ;
+    RUN_TEST(storingAgainReplaces) ;
+    RUN_TEST(flushReleasesEverythingAndKeepsTheCounters) ;
+    RUN_TEST(randomCapturesMatchTheModel) ;
+    return test_finish("cursor cache") ;
+}
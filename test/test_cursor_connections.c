@@ -0,0 +1,236 @@
+//
+// test_cursor_connections.c
+// The connection tracker's open addressing tables and the events applied to them, including a million
+// random creations, deaths and terminations checked against plain arrays
+
+#include "test.h"
+#include "cursor/cursor_connections.h"
+
+// how far an entry is from its home slot; a table which left tombstones behind would see this creep up
+static size_t probe_distance(const conn_map *map, size_t i) {
+    return (i - conn_hash(map->slots[i].key, map->capacity)) & (map->capacity - 1) ;
+}
+
+// every entry can be found from its home slot without crossing an empty one
+static bool map_is_consistent(const conn_map *map) {
+    size_t count = 0 ;
+    for (size_t i = 0 ; i < map->capacity ; i++) {
+        if (map->slots[i].key == 0) continue ;
+        count++ ;
+        if (conn_map_findPair(map, map->slots[i].key, map->slots[i].value) != &map->slots[i]) return false ;
+    }
+    return count == map->count ;
+}
+
+TEST(insertFindAndRemove) {
+    conn_map map = { NULL, 0, 0 } ;
+    CHECK(conn_map_find(&map, 1) == NULL) ;
+    CHECK(conn_map_init(&map, 16)) ;
+    conn_map_insert(&map, 100, 1, true) ;
+    conn_map_insert(&map, 200, 2, true) ;
+    conn_map_insert(&map, 100, 3, true) ;
+    CHECK_INT(map.count, 2) ;
+    CHECK_INT(conn_map_find(&map, 100)->value, 3) ;
+
+    // without unique, a key may have several values but each pair is only stored once
+    conn_map_insert(&map, 300, 1, false) ;
+    conn_map_insert(&map, 300, 2, false) ;
+    conn_map_insert(&map, 300, 2, false) ;
+    CHECK_INT(map.count, 4) ;
+    int32_t values[4] ;
+    CHECK_INT(conn_map_values(&map, 300, values, 4), 2) ;
+    CHECK_INT(values[0] + values[1], 3) ;
+    CHECK_INT(conn_map_values(&map, 300, values, 1), 2) ;
+
+    conn_map_removeSlot(&map, conn_map_findPair(&map, 300, 1)) ;
+    CHECK(conn_map_findPair(&map, 300, 1) == NULL) ;
+    CHECK(conn_map_findPair(&map, 300, 2) != NULL) ;
+    CHECK_INT(map.count, 3) ;
+    CHECK(map_is_consistent(&map)) ;
+    conn_map_free(&map) ;
+    CHECK(map.slots == NULL && map.capacity == 0) ;
+}
+
+// keys which share a home slot, removed from the front, middle and end of their run, including runs which
+// wrap around the end of the table
+TEST(removalClosesTheGap) {
+    enum { capacity = 16 } ;
+    int32_t sameHome[capacity] ;
+    size_t  found = 0 ;
+    for (int32_t key = 1 ; found < 6 ; key++) {
+        if (conn_hash(key, capacity) == capacity - 2) sameHome[found++] = key ;
+    }
+    for (size_t victim = 0 ; victim < 6 ; victim++) {
+        conn_map map = { NULL, 0, 0 } ;
+        conn_map_init(&map, capacity) ;
+        for (size_t i = 0 ; i < 6 ; i++) conn_map_insert(&map, sameHome[i], (int32_t)i + 1, true) ;
+        conn_map_removeSlot(&map, conn_map_find(&map, sameHome[victim])) ;
+        CHECK(map_is_consistent(&map)) ;
+        for (size_t i = 0 ; i < 6 ; i++) {
+            conn_slot *slot = conn_map_find(&map, sameHome[i]) ;
+            if (i == victim) {
+                CHECK(slot == NULL) ;
+            } else {
+                CHECK(slot && slot->value == (int32_t)i + 1) ;
+            }
+        }
+        conn_map_free(&map) ;
+    }
+}
+
+TEST(tablesGrowAndKeepTheirEntries) {
+    conn_map map = { NULL, 0, 0 } ;
+    conn_map_init(&map, 4) ;
+    for (int32_t key = 1 ; key <= 10000 ; key++) conn_map_insert(&map, key, -key, true) ;
+    CHECK_INT(map.count, 10000) ;
+    CHECK(map.capacity >= 10000 * 4 / 3) ;
+    for (int32_t key = 1 ; key <= 10000 ; key++) CHECK_INT(conn_map_find(&map, key)->value, -key) ;
+    conn_map_free(&map) ;
+
+    // a table which was never allocated grows from the initial capacity
+    conn_map_insert(&map, 5, 6, true) ;
+    CHECK_INT(map.capacity, CONN_MAP_INITIAL_CAPACITY) ;
+    conn_map_free(&map) ;
+}
+
+TEST(createdAndDied) {
+    conn_tracker tracker = { 0 } ;
+    CHECK(conn_tracker_init(&tracker)) ;
+    CHECK(conn_tracker_created(&tracker, 1001, 50)) ;
+    CHECK(conn_tracker_created(&tracker, 1002, 50)) ;
+    CHECK(!conn_tracker_created(&tracker, 1001, 50)) ; // already known
+    CHECK(!conn_tracker_created(&tracker, 0, 50)) ;
+    CHECK(!conn_tracker_created(&tracker, 1003, 0)) ;
+    CHECK_INT(tracker.created, 2) ;
+
+    CHECK_INT(conn_tracker_pidForConnection(&tracker, 1002), 50) ;
+    CHECK_INT(conn_tracker_pidForConnection(&tracker, 1003), 0) ;
+    int32_t cids[4] ;
+    CHECK_INT(conn_tracker_connectionsForPID(&tracker, 50, cids, 4), 2) ;
+    CHECK_INT(conn_tracker_connectionsForPID(&tracker, 51, cids, 4), 0) ;
+    CHECK_INT(tracker.hits, 2) ;
+    CHECK_INT(tracker.misses, 2) ;
+
+    // a connection id reused by another process moves to its new owner
+    CHECK(conn_tracker_created(&tracker, 1002, 60)) ;
+    CHECK_INT(conn_tracker_connectionsForPID(&tracker, 50, cids, 4), 1) ;
+    CHECK_INT(cids[0], 1001) ;
+    CHECK_INT(conn_tracker_connectionsForPID(&tracker, 60, cids, 4), 1) ;
+
+    CHECK_INT(conn_tracker_died(&tracker, 1002), 60) ;
+    CHECK_INT(conn_tracker_died(&tracker, 1002), 0) ;
+    CHECK_INT(conn_tracker_connectionsForPID(&tracker, 60, cids, 4), 0) ;
+    CHECK_INT(tracker.died, 1) ;
+    conn_tracker_free(&tracker) ;
+
+    // a stopped tracker knows nothing and keeps its counters
+    CHECK_INT(conn_tracker_pidForConnection(&tracker, 1001), 0) ;
+    CHECK_INT(conn_tracker_died(&tracker, 1001), 0) ;
+    CHECK_INT(tracker.created, 3) ;
+}
+
+TEST(terminationRemovesEveryConnectionInBatches) {
+    conn_tracker tracker = { 0 } ;
+    conn_tracker_init(&tracker) ;
+    for (int32_t cid = 1 ; cid <= 150 ; cid++) conn_tracker_created(&tracker, cid, 77) ;
+    conn_tracker_created(&tracker, 500, 78) ;
+
+    int32_t removed[64] ;
+    bool    seen[151] = { false } ;
+    size_t  batches   = 0, total = 0, count ;
+    while ((count = conn_tracker_terminated(&tracker, 77, removed, 64)) > 0) {
+        batches++ ;
+        total += count ;
+        for (size_t i = 0 ; i < count ; i++) {
+            CHECK(removed[i] >= 1 && removed[i] <= 150 && !seen[removed[i]]) ;
+            if (removed[i] >= 1 && removed[i] <= 150) seen[removed[i]] = true ;
+        }
+        // a callback may change the tables between batches
+        if (batches == 1) conn_tracker_died(&tracker, removed[0] == 150 ? 149 : 150) ;
+    }
+    CHECK_INT(batches, 3) ;
+    CHECK_INT(total, 149) ;
+    CHECK_INT(tracker.died, 150) ;
+    CHECK_INT(tracker.connectionToPID.count, 1) ;
+    CHECK_INT(tracker.pidToConnection.count, 1) ;
+    CHECK_INT(conn_tracker_pidForConnection(&tracker, 500), 78) ;
+    conn_tracker_free(&tracker) ;
+}
+
+// The model is an owner per connection id; the tracker's tables are compared with it after every event.
+enum { modelConnections = 4096, modelPIDs = 97 } ;
+static int32_t owner[modelConnections] ;
+
+static size_t model_connectionsFor(int32_t pid) {
+    size_t count = 0 ;
+    for (size_t cid = 1 ; cid < modelConnections ; cid++) count += (owner[cid] == pid) ;
+    return count ;
+}
+
+TEST(randomEventsMatchTheModel) {
+    conn_tracker tracker = { 0 } ;
+    conn_tracker_init(&tracker) ;
+    memset(owner, 0, sizeof(owner)) ;
+    test_seed(16) ;
+
+    size_t live = 0 ;
+    for (int step = 0 ; step < 1000000 ; step++) {
+        int32_t  cid  = (int32_t)(1 + test_random() % (modelConnections - 1)) ;
+        int32_t  pid  = (int32_t)(1 + test_random() % modelPIDs) ;
+        uint32_t kind = test_random() % 100 ;
+        if (kind < 50) {
+            bool changed = conn_tracker_created(&tracker, cid, pid) ;
+            CHECK(changed == (owner[cid] != pid)) ;
+            if (owner[cid] == 0) live++ ;
+            owner[cid] = pid ;
+        } else if (kind < 99) {
+            CHECK_INT(conn_tracker_died(&tracker, cid), owner[cid]) ;
+            if (owner[cid] != 0) live-- ;
+            owner[cid] = 0 ;
+        } else {
+            int32_t removed[8] ;
+            size_t  count, total = 0, expected = model_connectionsFor(pid) ;
+            while ((count = conn_tracker_terminated(&tracker, pid, removed, 8)) > 0) {
+                for (size_t i = 0 ; i < count ; i++) {
+                    CHECK_INT(owner[removed[i]], pid) ;
+                    owner[removed[i]] = 0 ;
+                }
+                total += count ;
+            }
+            CHECK_INT(total, expected) ;
+            live -= total ;
+        }
+        CHECK_INT(conn_tracker_pidForConnection(&tracker, cid), owner[cid]) ;
+        CHECK_INT(tracker.connectionToPID.count, live) ;
+        CHECK_INT(tracker.pidToConnection.count, live) ;
+    }
+
+    CHECK(map_is_consistent(&tracker.connectionToPID)) ;
+    CHECK(map_is_consistent(&tracker.pidToConnection)) ;
+    for (int32_t pid = 1 ; pid <= modelPIDs ; pid++) {
+        int32_t cids[modelConnections] ;
+        size_t  count = conn_tracker_connectionsForPID(&tracker, pid, cids, modelConnections) ;
+        CHECK_INT(count, model_connectionsFor(pid)) ;
+        for (size_t i = 0 ; i < count ; i++) CHECK_INT(owner[cids[i]], pid) ;
+    }
+
+    // after a million events the connections are still close to their home slots
+    size_t longest = 0 ;
+    for (size_t i = 0 ; i < tracker.connectionToPID.capacity ; i++) {
+        if (tracker.connectionToPID.slots[i].key == 0) continue ;
+        size_t distance = probe_distance(&tracker.connectionToPID, i) ;
+        if (distance > longest) longest = distance ;
+    }
+    CHECK(longest < 64) ;
+    conn_tracker_free(&tracker) ;
+}
+
+int main(void) {
+    RUN_TEST(insertFindAndRemove) ;
+    RUN_TEST(removalClosesTheGap) ;
+    RUN_TEST(tablesGrowAndKeepTheirEntries) ;
+    RUN_TEST(createdAndDied) ;
+    RUN_TEST(terminationRemovesEveryConnectionInBatches) ;
+    RUN_TEST(randomEventsMatchTheModel) ;
+    return test_finish("cursor connections") ;
+}
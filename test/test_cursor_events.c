@@ -0,0 +1,144 @@
+//
+// test_cursor_events.c
+// The change watcher's queue and batching: drops when nothing drains, one drain scheduled per batch, and a
+// real producer thread checking seeds while another thread drains
+
+#include "test.h"
+#include "cursor/cursor_events.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+TEST(unchangedSeedsQueueNothing) {
+    static cursor_watcher watcher ;
+    cursor_watcher_start(&watcher, 7) ;
+    CHECK(!cursor_watcher_check(&watcher, 7, 1, 0.0)) ;
+    CHECK_INT(atomic_load(&watcher.events), 0) ;
+
+    CHECK(cursor_watcher_check(&watcher, 8, 1, 1.0)) ;
+    cursor_event batch[4] ;
+    CHECK_INT(cursor_watcher_drain(&watcher, batch, 4), 1) ;
+    CHECK_INT(batch[0].seed, 8) ;
+    CHECK_INT(batch[0].previousSeed, 7) ;
+    CHECK_INT(batch[0].notification, 1) ;
+    CHECK_NEAR(batch[0].timestamp, 1.0, 1e-12) ;
+}
+
+// only the first change after a drain asks for one to be scheduled
+TEST(oneDrainScheduledPerBatch) {
+    static cursor_watcher watcher ;
+    cursor_watcher_start(&watcher, 0) ;
+    CHECK(cursor_watcher_check(&watcher, 1, 0, 0.0)) ;
+    CHECK(!cursor_watcher_check(&watcher, 2, 0, 0.0)) ;
+    CHECK(!cursor_watcher_check(&watcher, 3, 0, 0.0)) ;
+
+    cursor_event batch[CURSOR_EVENT_QUEUE_SIZE] ;
+    CHECK_INT(cursor_watcher_drain(&watcher, batch, CURSOR_EVENT_QUEUE_SIZE), 3) ;
+    CHECK_INT(atomic_load(&watcher.batches), 1) ;
+    CHECK(cursor_watcher_check(&watcher, 4, 0, 0.0)) ;
+
+    // a drain which finds nothing isn't a batch, and discarding clears the schedule
+    cursor_watcher_discard(&watcher) ;
+    CHECK_INT(cursor_watcher_drain(&watcher, batch, CURSOR_EVENT_QUEUE_SIZE), 0) ;
+    CHECK_INT(atomic_load(&watcher.batches), 1) ;
+    CHECK(cursor_watcher_check(&watcher, 5, 0, 0.0)) ;
+}
+
+// when nothing drains, the queue holds CURSOR_EVENT_QUEUE_SIZE changes, later ones are counted as
+// dropped, and the queue takes changes again once drained
+TEST(changesAreDroppedWhenTheQueueIsFull) {
+    static cursor_watcher watcher ;
+    enum { extra = 37 } ;
+    cursor_watcher_start(&watcher, 0) ;
+    for (int seed = 1 ; seed <= CURSOR_EVENT_QUEUE_SIZE + extra ; seed++) (void)cursor_watcher_check(&watcher, seed, 0, seed) ;
+    CHECK_INT(atomic_load(&watcher.events), CURSOR_EVENT_QUEUE_SIZE) ;
+    CHECK_INT(atomic_load(&watcher.dropped), extra) ;
+
+    // the oldest are kept, in order, in batches of whatever size the consumer asks for
+    cursor_event batch[CURSOR_EVENT_QUEUE_SIZE] ;
+    size_t       total = 0 ;
+    for (size_t count ; (count = cursor_watcher_drain(&watcher, batch, 100)) > 0 ; total += count) {
+        for (size_t i = 0 ; i < count ; i++) CHECK_INT(batch[i].seed, (int)(total + i + 1)) ;
+    }
+    CHECK_INT(total, CURSOR_EVENT_QUEUE_SIZE) ;
+    CHECK_INT(atomic_load(&watcher.delivered), CURSOR_EVENT_QUEUE_SIZE) ;
+    CHECK_INT(atomic_load(&watcher.batches), 3) ;
+
+    // the first change after the drops records the seed it actually followed
+    (void)cursor_watcher_check(&watcher, 1000, 0, 0.0) ;
+    CHECK_INT(cursor_watcher_drain(&watcher, batch, CURSOR_EVENT_QUEUE_SIZE), 1) ;
+    CHECK_INT(batch[0].previousSeed, CURSOR_EVENT_QUEUE_SIZE + extra) ;
+
+    cursor_watcher_resetCounters(&watcher) ;
+    CHECK_INT(atomic_load(&watcher.dropped), 0) ;
+}
+
+// A producer thread checks an increasing seed, pausing now and then; the consumer drains whenever a drain
+// is scheduled, as the main run loop would. Every change is either delivered or counted as dropped, the
+// delivered ones arrive in order without duplicates, and each one's previousSeed matches what the
+// producer had seen.
+enum { kChanges = 2000000 } ;
+
+typedef struct {
+    cursor_watcher *watcher ;
+    _Atomic bool   scheduled ;
+    _Atomic bool   done ;
+} crossThread ;
+
+static void *produce(void *context) {
+    crossThread *state = context ;
+    for (int seed = 1 ; seed <= kChanges ; seed++) {
+        if (cursor_watcher_check(state->watcher, seed, seed & 3, (double)seed)) atomic_store(&state->scheduled, true) ;
+        if (seed % 64 == 0) sched_yield() ;
+    }
+    atomic_store(&state->done, true) ;
+    return NULL ;
+}
+
+TEST(producerAndConsumerOnDifferentThreads) {
+    static cursor_watcher watcher ;
+    static cursor_event   batch[CURSOR_EVENT_QUEUE_SIZE] ;
+    crossThread state = { .watcher = &watcher } ;
+    cursor_watcher_start(&watcher, 0) ;
+
+    pthread_t producer ;
+    pthread_create(&producer, NULL, produce, &state) ;
+    int      lastSeed  = 0 ;
+    uint64_t delivered = 0, gaps = 0, mismatches = 0, wrongFields = 0 ;
+    for (bool finished = false ; !finished ; ) {
+        finished = atomic_load(&state.done) ;
+        if (!finished && !atomic_exchange(&state.scheduled, false)) {
+            sched_yield() ;
+            continue ;
+        }
+        size_t count ;
+        while ((count = cursor_watcher_drain(&watcher, batch, CURSOR_EVENT_QUEUE_SIZE)) > 0) {
+            for (size_t i = 0 ; i < count ; i++) {
+                if (batch[i].seed <= lastSeed) mismatches++ ;
+                if (batch[i].seed != lastSeed + 1) gaps++ ;
+                if (batch[i].previousSeed != batch[i].seed - 1) mismatches++ ;
+                if (batch[i].notification != (batch[i].seed & 3) || batch[i].timestamp != (double)batch[i].seed) wrongFields++ ;
+                lastSeed = batch[i].seed ;
+            }
+            delivered += count ;
+        }
+    }
+    pthread_join(producer, NULL) ;
+
+    CHECK_INT(mismatches, 0) ;
+    CHECK_INT(wrongFields, 0) ;
+    CHECK_INT(delivered, atomic_load(&watcher.events)) ;
+    CHECK_INT(atomic_load(&watcher.events) + atomic_load(&watcher.dropped), kChanges) ;
+    CHECK_INT(atomic_load(&watcher.delivered), delivered) ;
+    // drops only ever leave gaps between delivered changes
+    CHECK(gaps <= atomic_load(&watcher.dropped)) ;
+    CHECK_INT(lastSeed > 0, 1) ;
+}
+
+int main(void) {
+    RUN_TEST(unchangedSeedsQueueNothing) ;
+    RUN_TEST(oneDrainScheduledPerBatch) ;
+    RUN_TEST(changesAreDroppedWhenTheQueueIsFull) ;
+    RUN_TEST(producerAndConsumerOnDifferentThreads) ;
+    return test_finish("cursor events") ;
+}
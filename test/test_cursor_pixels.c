@@ -0,0 +1,208 @@
+//
+// test_cursor_pixels.c
+// The capture buffer pool, including from several threads at once, and the premultiplied ARGB to straight
+// RGBA conversion; the vector path (SSSE3 or NEON, see the Makefile) is checked against the scalar one
+
+#include "test.h"
+#include "cursor/cursor_pixels.h"
+
+#include <math.h>
+#include <pthread.h>
+
+// a premultiplied ARGB pixel which is mostly opaque or transparent, like the pixels of a real cursor
+static void random_pixel(uint8_t *pixel) {
+    uint32_t kind  = test_random() % 8 ;
+    uint8_t  alpha = (kind < 4) ? 255 : (kind < 7) ? 0 : (uint8_t)test_random() ;
+    pixel[0] = alpha ;
+    for (int i = 1 ; i < 4 ; i++) pixel[i] = alpha ? (uint8_t)(test_random() % ((uint32_t)alpha + 1)) : 0 ;
+}
+
+TEST(unpremultiplyIsWithinOneOfTheExactValue) {
+    uint8_t src[4], dst[4] ;
+    for (uint32_t alpha = 0 ; alpha < 256 ; alpha++) {
+        for (uint32_t value = 0 ; value <= alpha ; value++) {
+            src[0] = (uint8_t)alpha ;
+            src[1] = src[2] = src[3] = (uint8_t)value ;
+            cursor_unpremultiply(src, dst, 1) ;
+            long exact = alpha ? lround(value * 255.0 / alpha) : 0 ;
+            CHECK(labs((long)dst[0] - exact) <= 1) ;
+            CHECK_INT(dst[3], alpha) ;
+        }
+    }
+    // full intensity is always 255, and a transparent pixel is always zero whatever its color bytes hold
+    for (uint32_t alpha = 1 ; alpha < 256 ; alpha++) {
+        uint8_t pixel[4] = { (uint8_t)alpha, (uint8_t)alpha, (uint8_t)alpha, (uint8_t)alpha } ;
+        cursor_unpremultiply(pixel, dst, 1) ;
+        CHECK_INT(dst[0], 255) ;
+    }
+    uint8_t garbage[4] = { 0, 12, 34, 56 } ;
+    cursor_unpremultiply(garbage, dst, 1) ;
+    CHECK_INT(dst[0] | dst[1] | dst[2] | dst[3], 0) ;
+}
+
+TEST(opaquePixelsAreOnlyReordered) {
+    uint8_t src[64 * 4], dst[64 * 4] ;
+    for (size_t i = 0 ; i < 64 ; i++) {
+        src[i * 4]     = 255 ;
+        src[i * 4 + 1] = (uint8_t)i ;
+        src[i * 4 + 2] = (uint8_t)(i * 2) ;
+        src[i * 4 + 3] = (uint8_t)(i * 3) ;
+    }
+    cursor_unpremultiply(src, dst, 64) ;
+    for (size_t i = 0 ; i < 64 ; i++) {
+        CHECK_INT(dst[i * 4],     i) ;
+        CHECK_INT(dst[i * 4 + 1], i * 2) ;
+        CHECK_INT(dst[i * 4 + 2], i * 3) ;
+        CHECK_INT(dst[i * 4 + 3], 255) ;
+    }
+}
+
+// every length and alignment around the vector block sizes, in place and not
+TEST(vectorPathMatchesScalar) {
+    test_seed(11) ;
+    uint8_t src[80 * 4 + 16], expected[80 * 4], dst[80 * 4 + 16] ;
+    for (int round = 0 ; round < 200 ; round++) {
+        for (size_t i = 0 ; i < sizeof(src) / 4 ; i++) random_pixel(src + i * 4) ;
+        for (size_t pixels = 0 ; pixels <= 80 ; pixels++) {
+            for (size_t offset = 0 ; offset < 16 ; offset += 5) {
+                cursor_convertScalar(src + offset, expected, pixels) ;
+                cursor_unpremultiply(src + offset, dst + offset, pixels) ;
+                CHECK(memcmp(dst + offset, expected, pixels * 4) == 0) ;
+
+                memcpy(dst, src, sizeof(src)) ;
+                cursor_unpremultiply(dst + offset, dst + offset, pixels) ;
+                CHECK(memcmp(dst + offset, expected, pixels * 4) == 0) ;
+            }
+        }
+    }
+}
+
+TEST(paddedRowsLeaveThePaddingAlone) {
+    test_seed(12) ;
+    enum { wide = 19, high = 7, rowBytes = 96 } ;
+    uint8_t image[rowBytes * high], original[rowBytes * high], expected[wide * 4] ;
+    for (size_t i = 0 ; i < sizeof(image) ; i += 4) random_pixel(image + i) ;
+    memcpy(original, image, sizeof(image)) ;
+    cursor_unpremultiplyImage(image, rowBytes, wide, high) ;
+    for (size_t row = 0 ; row < high ; row++) {
+        cursor_convertScalar(original + row * rowBytes, expected, wide) ;
+        CHECK(memcmp(image + row * rowBytes, expected, wide * 4) == 0) ;
+        CHECK(memcmp(image + row * rowBytes + wide * 4, original + row * rowBytes + wide * 4,
+                     rowBytes - wide * 4) == 0) ;
+    }
+}
+
+TEST(poolReusesReleasedBuffers) {
+    cursor_pool pool ;
+    cursor_pool_init(&pool, 2) ;
+
+    cursor_buffer *a = cursor_pool_acquire(&pool, 100) ;
+    CHECK_INT(a->capacity, CURSOR_BUFFER_ROUNDING) ;
+    cursor_buffer *b = cursor_pool_acquire(&pool, 3 * CURSOR_BUFFER_ROUNDING + 1) ;
+    CHECK_INT(b->capacity, 4 * CURSOR_BUFFER_ROUNDING) ;
+    CHECK_INT(pool.allocated, 2) ;
+
+    cursor_pool_release(&pool, a) ;
+    cursor_pool_release(&pool, b) ;
+    CHECK_INT(pool.pooled, 2) ;
+
+    // the first buffer large enough is used, even when a smaller one would do
+    cursor_buffer *c = cursor_pool_acquire(&pool, 2 * CURSOR_BUFFER_ROUNDING) ;
+    CHECK(c == b) ;
+    cursor_buffer *d = cursor_pool_acquire(&pool, 10) ;
+    CHECK(d == a) ;
+    cursor_buffer *e = cursor_pool_acquire(&pool, 10) ;
+    CHECK(e != a && e != b) ;
+    CHECK_INT(pool.reused, 2) ;
+    CHECK_INT(pool.allocated, 3) ;
+    CHECK_INT(pool.pooled, 0) ;
+
+    // a full pool frees what's released to it
+    cursor_pool_release(&pool, c) ;
+    cursor_pool_release(&pool, d) ;
+    cursor_pool_release(&pool, e) ;
+    CHECK_INT(pool.pooled, 2) ;
+    CHECK_INT(pool.discarded, 1) ;
+
+    cursor_pool_release(&pool, NULL) ;
+    CHECK_INT(pool.discarded, 1) ;
+
+    cursor_pool_drain(&pool) ;
+    CHECK_INT(pool.pooled, 0) ;
+    CHECK(pool.buffers == NULL) ;
+}
+
+typedef struct {
+    cursor_pool     *pool ;
+    uint32_t        seed ;
+    int             collisions ;
+} pool_worker ;
+
+static void pool_lock(void *context) {
+    pthread_mutex_lock(context) ;
+}
+
+static void pool_unlock(void *context) {
+    pthread_mutex_unlock(context) ;
+}
+
+// captures from several threads while images are collected on others; a buffer handed to two captures at
+// once would show up as a pattern overwritten by another thread
+static void *pool_work(void *context) {
+    pool_worker   *worker = context ;
+    cursor_buffer *held[4] = { NULL, NULL, NULL, NULL } ;
+    uint32_t      state   = worker->seed ;
+    for (int i = 0 ; i < 50000 ; i++) {
+        state = state * 1664525U + 1013904223U ;
+        size_t slot = (state >> 8) % 4 ;
+        if (held[slot]) {
+            for (size_t j = 0 ; j < 64 ; j++) if (held[slot]->bytes[j] != (uint8_t)worker->seed) worker->collisions++ ;
+            cursor_pool_release(worker->pool, held[slot]) ;
+            held[slot] = NULL ;
+        } else {
+            held[slot] = cursor_pool_acquire(worker->pool, 1024 + (state >> 16) % (3 * CURSOR_BUFFER_ROUNDING)) ;
+            memset(held[slot]->bytes, (uint8_t)worker->seed, 64) ;
+        }
+    }
+    for (size_t slot = 0 ; slot < 4 ; slot++) cursor_pool_release(worker->pool, held[slot]) ;
+    return NULL ;
+}
+
+TEST(poolIsSafeAcrossThreads) {
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER ;
+    cursor_pool     pool ;
+    cursor_pool_init(&pool, CURSOR_POOL_MAX_BUFFERS) ;
+    pool.lock        = pool_lock ;
+    pool.unlock      = pool_unlock ;
+    pool.lockContext = &mutex ;
+
+    enum { threads = 8 } ;
+    pthread_t   thread[threads] ;
+    pool_worker worker[threads] ;
+    for (int i = 0 ; i < threads ; i++) {
+        worker[i] = (pool_worker){ .pool = &pool, .seed = (uint32_t)i + 1 } ;
+        pthread_create(&thread[i], NULL, pool_work, &worker[i]) ;
+    }
+    int collisions = 0 ;
+    for (int i = 0 ; i < threads ; i++) {
+        pthread_join(thread[i], NULL) ;
+        collisions += worker[i].collisions ;
+    }
+    CHECK_INT(collisions, 0) ;
+    CHECK(pool.pooled <= CURSOR_POOL_MAX_BUFFERS) ;
+    // each of the 8 threads holds at most 4 buffers, so the pool saves all but a few allocations
+    CHECK(pool.reused > 10 * pool.allocated) ;
+    CHECK_INT(pool.allocated - pool.discarded, pool.pooled) ;
+    cursor_pool_drain(&pool) ;
+}
+
+int main(void) {
+    cursor_buildUnpremultiplyTable() ;
+    RUN_TEST(unpremultiplyIsWithinOneOfTheExactValue) ;
+    RUN_TEST(opaquePixelsAreOnlyReordered) ;
+    RUN_TEST(vectorPathMatchesScalar) ;
+    RUN_TEST(paddedRowsLeaveThePaddingAlone) ;
+    RUN_TEST(poolReusesReleasedBuffers) ;
+    RUN_TEST(poolIsSafeAcrossThreads) ;
+    return test_finish("cursor pixels") ;
+}
@@ -0,0 +1,235 @@
+//
+// test_cursor_playback.c
+// Path playback on a simulated clock: where the cursor is sent and how late each tick is reported, ticks
+// which wake late and are caught up without slowing the path, cancellation from the warp, zero-length and
+// zero-duration segments, and the error capacity of a huge duration
+
+#include "test.h"
+#include "cursor/cursor_playback.h"
+
+#define PERIOD 1000000ULL // nanoseconds, so 1000 ticks a second
+
+// a clock in nanoseconds; each wait wakes `lateness` after its deadline, and wait number `lateAt` (from 1)
+// wakes `lateBy` after it instead
+typedef struct {
+    uint64_t        now ;
+    uint64_t        lateness ;
+    size_t          waits ;
+    size_t          lateAt ;
+    uint64_t        lateBy ;
+    CGPoint         warps[4096] ;
+    double          times[4096] ;
+    size_t          count ;
+    size_t          cancelAfter ;
+    cursor_playback *playback ;
+} simulation ;
+
+static uint64_t simulatedNow(void *context) {
+    return ((simulation *)context)->now ;
+}
+
+static double simulatedSeconds(__attribute__((unused)) void *context, uint64_t ticks) {
+    return (double)ticks / 1e9 ;
+}
+
+static void simulatedWait(void *context, uint64_t deadline) {
+    simulation *sim = context ;
+    if (deadline > sim->now) sim->now = deadline ;
+    sim->now += (++sim->waits == sim->lateAt) ? sim->lateBy : sim->lateness ;
+}
+
+static void simulatedWarp(void *context, CGPoint point) {
+    simulation *sim = context ;
+    if (sim->count < 4096) {
+        sim->warps[sim->count] = point ;
+        sim->times[sim->count] = (double)sim->now / 1e9 ;
+    }
+    if (++sim->count == sim->cancelAfter) cursor_playback_cancel(sim->playback) ;
+}
+
+static void play(simulation *sim, cursor_playback *playback, cursor_pathSegment *segments, size_t count) {
+    cursor_playbackDriver driver = {
+        .now = simulatedNow, .seconds = simulatedSeconds, .waitUntil = simulatedWait, .warp = simulatedWarp, .context = sim,
+    } ;
+    CHECK(cursor_playback_init(playback, segments[count - 1].end, 1e9 / PERIOD)) ;
+    sim->playback = playback ;
+    cursor_playback_run(playback, segments, count, PERIOD, &driver) ;
+}
+
+static cursor_pathSegment line(double x0, double y0, double x1, double y1) {
+    return (cursor_pathSegment){ .p0 = { x0, y0 }, .p1 = { x1, y1 }, .c1 = { x0, y0 }, .c2 = { x1, y1 } } ;
+}
+
+TEST(segmentsAndTiming) {
+    cursor_pathSegment segment = line(0, 0, 30, 40) ;
+    CHECK_NEAR(cursor_segmentLength(&segment), 50, 1e-12) ;
+    CHECK_NEAR(cursor_pointOnSegment(&segment, 0.5).x, 15, 1e-12) ;
+
+    // a quarter circle as a bezier is a little longer than the chord and close to pi/2
+    cursor_pathSegment curve = { .p0 = { 1, 0 }, .c1 = { 1, 0.5523 }, .c2 = { 0.5523, 1 }, .p1 = { 0, 1 }, .curve = true } ;
+    CHECK_NEAR(cursor_segmentLength(&curve), 1.5708, 2e-3) ;
+    CHECK_NEAR(cursor_pointOnSegment(&curve, 1).y, 1, 1e-12) ;
+
+    // 1 second fixed, and the 3 remaining shared 1:2 by length
+    cursor_pathSegment path[3] = { line(0, 0, 10, 0), line(10, 0, 10, 20), line(10, 20, 0, 20) } ;
+    double             durations[3] = { -1, -1, 1 } ;
+    CHECK_NEAR(cursor_path_assignTimes(path, durations, 3, 4), 4, 1e-12) ;
+    CHECK_NEAR(path[0].end, 1, 1e-12) ;
+    CHECK_NEAR(path[1].end, 3, 1e-12) ;
+    CHECK_NEAR(path[2].start, 3, 1e-12) ;
+
+    // fixed durations beyond the overall one leave nothing to share
+    double fixed[3] = { 2, -1, 3 } ;
+    CHECK_NEAR(cursor_path_assignTimes(path, fixed, 3, 4), 5, 1e-12) ;
+    CHECK_NEAR(path[1].end - path[1].start, 0, 1e-12) ;
+}
+
+TEST(timingError) {
+    cursor_pathSegment path[1] = { line(0, 0, 1000, 0) } ;
+    CHECK_NEAR(cursor_path_assignTimes(path, (double[]){ -1 }, 1, 0.1), 0.1, 1e-12) ;
+
+    // on time: a tick every millisecond from 0 to 100, each on the path at its own time
+    simulation      sim = { .now = 5000 } ;
+    cursor_playback playback ;
+    play(&sim, &playback, path, 1) ;
+    CHECK_INT(playback.ticks, 101) ;
+    CHECK_INT(sim.count, 101) ;
+    CHECK_NEAR(sim.warps[50].x, 500, 1e-6) ;
+    CHECK_NEAR(sim.warps[100].x, 1000, 1e-9) ;
+    CHECK_NEAR(playback.elapsed, 0.1, 1e-12) ;
+    double mean, p99, max ;
+    cursor_playback_errorStats(&playback, &mean, &p99, &max) ;
+    CHECK(mean == 0 && p99 == 0 && max == 0) ;
+    cursor_playback_free(&playback) ;
+
+    // 200us late every tick: that is the error, and the cursor is where the path is at the later time
+    sim = (simulation){ .now = 0, .lateness = 200000 } ;
+    play(&sim, &playback, path, 1) ;
+    bool onPath = true ;
+    for (size_t i = 0 ; i < sim.count - 1 ; i++) {
+        if (fabs(sim.warps[i].x - sim.times[i] * 10000) > 1e-6) onPath = false ;
+    }
+    CHECK(onPath) ;
+    CHECK_NEAR(sim.warps[sim.count - 1].x, 1000, 1e-9) ;
+    cursor_playback_errorStats(&playback, &mean, &p99, &max) ;
+    CHECK_NEAR(mean, 0.0002, 1e-9) ;
+    CHECK_NEAR(p99, 0.0002, 1e-9) ;
+    CHECK_NEAR(max, 0.0002, 1e-9) ;
+    cursor_playback_free(&playback) ;
+}
+
+TEST(lateTicksAreCaughtUp) {
+    cursor_pathSegment path[1] = { line(0, 0, 100, 0) } ;
+    (void)cursor_path_assignTimes(path, (double[]){ -1 }, 1, 0.1) ;
+    simulation      sim = { .now = 0 } ;
+    cursor_playback playback ;
+    play(&sim, &playback, path, 1) ;
+    size_t onTime = sim.count ;
+    cursor_playback_free(&playback) ;
+
+    // the sixth wake is 3.5ms late: the three ticks it slept through are skipped rather than played in a
+    // burst, the cursor is where the path is at the late time, and the path still ends on time
+    sim = (simulation){ .now = 0, .lateAt = 6, .lateBy = 3500000 } ;
+    play(&sim, &playback, path, 1) ;
+    CHECK_INT(sim.count, onTime - 3) ;
+    CHECK_NEAR(sim.times[4], 0.004, 1e-12) ;
+    CHECK_NEAR(sim.times[5], 0.0085, 1e-12) ;
+    CHECK_NEAR(sim.warps[5].x, 8.5, 1e-9) ;
+    CHECK_NEAR(sim.times[6], 0.009, 1e-12) ;
+    CHECK_NEAR(sim.warps[6].x, 9, 1e-9) ;
+    CHECK_NEAR(sim.times[sim.count - 1], 0.1, 1e-12) ;
+    CHECK_NEAR(sim.warps[sim.count - 1].x, 100, 1e-9) ;
+    double mean, p99, max ;
+    cursor_playback_errorStats(&playback, &mean, &p99, &max) ;
+    CHECK_NEAR(max, 0.0035, 1e-12) ;
+    CHECK_NEAR(mean, 0.0035 / (double)sim.count, 1e-12) ;
+    CHECK_NEAR(playback.elapsed, 0.1, 1e-12) ;
+    cursor_playback_free(&playback) ;
+}
+
+TEST(cancellation) {
+    cursor_pathSegment path[1] = { line(0, 0, 100, 0) } ;
+    (void)cursor_path_assignTimes(path, (double[]){ -1 }, 1, 10) ;
+    simulation      sim = { .now = 0, .cancelAfter = 25 } ;
+    cursor_playback playback ;
+    play(&sim, &playback, path, 1) ;
+    CHECK(atomic_load(&playback.cancelled)) ;
+    CHECK_INT(playback.ticks, 25) ;
+    CHECK_INT(sim.count, 25) ;
+    CHECK_NEAR(sim.warps[24].x, 0.24, 1e-9) ;
+    CHECK_NEAR(playback.elapsed, 0.024, 1e-12) ;
+    cursor_playback_free(&playback) ;
+
+    // cancelled before it starts, nothing is warped
+    sim = (simulation){ .now = 0 } ;
+    CHECK(cursor_playback_init(&playback, 10, 1000)) ;
+    cursor_playback_cancel(&playback) ;
+    cursor_playbackDriver driver = {
+        .now = simulatedNow, .seconds = simulatedSeconds, .waitUntil = simulatedWait, .warp = simulatedWarp, .context = &sim,
+    } ;
+    cursor_playback_run(&playback, path, 1, PERIOD, &driver) ;
+    CHECK_INT(sim.count, 0) ;
+    CHECK_INT(playback.ticks, 0) ;
+    cursor_playback_free(&playback) ;
+}
+
+TEST(zeroLengthSegments) {
+    // the same point three times: no length to share by, so the time is shared equally
+    cursor_pathSegment still[2] = { line(5, 5, 5, 5), line(5, 5, 5, 5) } ;
+    CHECK_NEAR(cursor_path_assignTimes(still, (double[]){ -1, -1 }, 2, 0.01), 0.01, 1e-12) ;
+    CHECK_NEAR(still[0].end, 0.005, 1e-12) ;
+
+    // a jump with no duration is passed straight to its end
+    cursor_pathSegment jump[3] = { line(0, 0, 10, 0), line(10, 0, 50, 50), line(50, 50, 60, 50) } ;
+    CHECK_NEAR(cursor_path_assignTimes(jump, (double[]){ 0.01, 0, 0.01 }, 3, 1), 0.02, 1e-12) ;
+    size_t index = 0 ;
+    CHECK_NEAR(cursor_path_pointAt(jump, 3, 0.005, &index).x, 5, 1e-9) ;
+    CHECK_NEAR(cursor_path_pointAt(jump, 3, 0.01, &index).x, 50, 1e-9) ;
+    CHECK_INT(index, 2) ;
+    CHECK_NEAR(cursor_path_pointAt(jump, 3, 0.015, &index).x, 55, 1e-9) ;
+
+    // a path with no duration at all is one tick at its end
+    cursor_pathSegment instant[1] = { line(0, 0, 7, 9) } ;
+    CHECK_NEAR(cursor_path_assignTimes(instant, (double[]){ -1 }, 1, 0), 0, 1e-12) ;
+    simulation      sim = { .now = 0 } ;
+    cursor_playback playback ;
+    play(&sim, &playback, instant, 1) ;
+    CHECK_INT(sim.count, 1) ;
+    CHECK_NEAR(sim.warps[0].x, 7, 1e-12) ;
+    CHECK_NEAR(sim.warps[0].y, 9, 1e-12) ;
+    cursor_playback_free(&playback) ;
+}
+
+TEST(errorCapacityIsClamped) {
+    CHECK_INT(cursor_playback_errorCapacity(1, 120), 122) ;
+    CHECK_INT(cursor_playback_errorCapacity(0, 1000), 2) ;
+    CHECK_INT(cursor_playback_errorCapacity(1e300, 1000), CURSOR_PLAYBACK_MAX_ERRORS) ;
+    CHECK_INT(cursor_playback_errorCapacity(HUGE_VAL, 1), CURSOR_PLAYBACK_MAX_ERRORS) ;
+    CHECK_INT(cursor_playback_errorCapacity(NAN, 1), CURSOR_PLAYBACK_MAX_ERRORS) ;
+    CHECK_INT(cursor_playback_errorCapacity(1e15, 1000), CURSOR_PLAYBACK_MAX_ERRORS) ;
+
+    // the errors beyond the capacity are dropped, the ticks still counted
+    cursor_pathSegment path[1] = { line(0, 0, 1, 1) } ;
+    (void)cursor_path_assignTimes(path, (double[]){ -1 }, 1, 0.05) ;
+    simulation      sim = { .now = 0 } ;
+    cursor_playback playback ;
+    CHECK(cursor_playback_init(&playback, 0.01, 1000)) ;
+    sim.playback = &playback ;
+    cursor_playbackDriver driver = {
+        .now = simulatedNow, .seconds = simulatedSeconds, .waitUntil = simulatedWait, .warp = simulatedWarp, .context = &sim,
+    } ;
+    cursor_playback_run(&playback, path, 1, PERIOD, &driver) ;
+    CHECK_INT(playback.ticks, 51) ;
+    CHECK_INT(playback.errorCount, 12) ;
+    cursor_playback_free(&playback) ;
+}
+
+int main(void) {
+    RUN_TEST(segmentsAndTiming) ;
+    RUN_TEST(timingError) ;
+    RUN_TEST(lateTicksAreCaughtUp) ;
+    RUN_TEST(cancellation) ;
+    RUN_TEST(zeroLengthSegments) ;
+    RUN_TEST(errorCapacityIsClamped) ;
+    return test_finish("cursor playback") ;
+}
@@ -0,0 +1,289 @@
+//
+// test_cursor_sampler.c
+// The position sampler's ring, schedule and derivatives: overruns when nothing drains, ticks skipped when
+// the thread falls behind, the ring wrapping many times over, the derivatives of a known path, and a real
+// sampler thread drained from another one
+
+#include "test.h"
+#include "cursor/cursor_sampler.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+
+// a simulated clock in nanoseconds; the position is a function of it, and lateness can be injected
+typedef struct {
+    cursor_sampler *sampler ;
+    uint64_t       now ;
+    uint64_t       delay ;      // added to the clock by the next position read, as if the read were slow
+    uint64_t       ticks ;
+    uint64_t       stopAfter ;
+    double         acceleration ;
+    bool           fail ;
+} simulation ;
+
+static uint64_t simulatedNow(void *context) {
+    return ((simulation *)context)->now ;
+}
+
+static double simulatedSeconds(__attribute__((unused)) void *context, uint64_t ticks) {
+    return (double)ticks / 1e9 ;
+}
+
+static void simulatedWait(void *context, uint64_t deadline) {
+    simulation *sim = context ;
+    if (deadline > sim->now) sim->now = deadline ;
+}
+
+// x moves with constant acceleration from rest, y with constant velocity
+static bool simulatedPosition(void *context, double *x, double *y) {
+    simulation *sim = context ;
+    double      t   = (double)sim->now / 1e9 ;
+    *x = sim->acceleration * t * t / 2 ;
+    *y = 100 * t ;
+    sim->now += sim->delay ;
+    sim->delay = 0 ;
+    if (++sim->ticks >= sim->stopAfter) atomic_store(&sim->sampler->running, false) ;
+    return !sim->fail ;
+}
+
+static const cursor_samplerSource simulatedSource = {
+    .now       = simulatedNow,
+    .seconds   = simulatedSeconds,
+    .waitUntil = simulatedWait,
+    .position  = simulatedPosition,
+} ;
+
+static void run(cursor_sampler *sampler, simulation *sim, uint64_t ticks, uint64_t period) {
+    cursor_samplerSource source = simulatedSource ;
+    source.context = sim ;
+    sim->sampler   = sampler ;
+    sim->ticks     = 0 ;
+    sim->stopAfter = ticks ;
+    atomic_store(&sampler->running, true) ;
+    cursor_sampler_run(sampler, &source, period) ;
+}
+
+static uint64_t drain(cursor_sampler *sampler, cursor_sample *into, uint64_t room) {
+    uint64_t tail ;
+    uint64_t count = cursor_sampleRing_pending(&sampler->ring, &tail) ;
+    for (uint64_t i = 0 ; i < count && i < room ; i++) into[i] = cursor_sampleRing_at(&sampler->ring, tail + i) ;
+    cursor_sampleRing_release(&sampler->ring, tail + count) ;
+    return count ;
+}
+
+TEST(capacityIsBounded) {
+    cursor_sampleRing ring = { 0 } ;
+    CHECK_INT(cursor_sampleRing_reserve(&ring, 0), 0) ;
+    CHECK_INT(cursor_sampleRing_reserve(&ring, 1), 0) ;
+    CHECK_INT(cursor_sampleRing_reserve(&ring, (uint64_t)INT64_MAX), 0) ;
+    CHECK_INT(cursor_sampleRing_reserve(&ring, CURSOR_SAMPLER_MAX_CAPACITY + 1), 0) ;
+    CHECK(ring.samples == NULL) ;
+    CHECK_INT(cursor_sampleRing_reserve(&ring, 2), 2) ;
+    CHECK_INT(cursor_sampleRing_reserve(&ring, 1000), 1024) ;
+    CHECK_INT(cursor_sampleRing_reserve(&ring, CURSOR_SAMPLER_MAX_CAPACITY), CURSOR_SAMPLER_MAX_CAPACITY) ;
+    // a rejected size leaves the ring as it was
+    CHECK_INT(cursor_sampleRing_reserve(&ring, CURSOR_SAMPLER_MAX_CAPACITY * 2ULL), 0) ;
+    CHECK_INT(ring.capacity, CURSOR_SAMPLER_MAX_CAPACITY) ;
+    cursor_sampleRing_free(&ring) ;
+}
+
+TEST(overrunsWhenNothingDrains) {
+    cursor_sampler sampler = { 0 } ;
+    simulation     sim     = { .now = 1000 } ;
+    CHECK_INT(cursor_sampleRing_reserve(&sampler.ring, 4), 4) ;
+    run(&sampler, &sim, 10, 1000000) ;
+    CHECK_INT(atomic_load(&sampler.taken), 4) ;
+    CHECK_INT(atomic_load(&sampler.overruns), 6) ;
+    CHECK_INT(atomic_load(&sampler.late), 0) ;
+
+    // the ring keeps the oldest samples, and has room again once drained
+    cursor_sample samples[4] ;
+    CHECK_INT(drain(&sampler, samples, 4), 4) ;
+    CHECK_NEAR(samples[0].timestamp, 1000 / 1e9, 1e-12) ;
+    CHECK_NEAR(samples[3].timestamp, (1000 + 3 * 1000000) / 1e9, 1e-12) ;
+    run(&sampler, &sim, 2, 1000000) ;
+    CHECK_INT(atomic_load(&sampler.taken), 6) ;
+    CHECK_INT(atomic_load(&sampler.overruns), 6) ;
+
+    // a failed read is neither a sample nor an overrun
+    sim.fail = true ;
+    run(&sampler, &sim, 3, 1000000) ;
+    CHECK_INT(atomic_load(&sampler.taken), 6) ;
+    CHECK_INT(atomic_load(&sampler.overruns), 6) ;
+    cursor_sampleRing_free(&sampler.ring) ;
+}
+
+TEST(missedTicksAreSkipped) {
+    uint64_t missed = 0 ;
+    // on time, a little late, and exactly on the next deadline
+    CHECK_INT(cursor_sampler_schedule(0, 50, 100, &missed), 100) ;
+    CHECK_INT(cursor_sampler_schedule(0, 100, 100, &missed), 100) ;
+    CHECK_INT(missed, 0) ;
+    CHECK_INT(cursor_sampler_schedule(0, 101, 100, &missed), 200) ;
+    CHECK_INT(missed, 1) ;
+    CHECK_INT(cursor_sampler_schedule(0, 350, 100, &missed), 400) ;
+    CHECK_INT(missed, 4) ;
+
+    // a read which takes three and a half periods skips three ticks, and the rest stay on the schedule
+    cursor_sampler sampler = { 0 } ;
+    simulation     sim     = { .now = 0 } ;
+    CHECK_INT(cursor_sampleRing_reserve(&sampler.ring, 64), 64) ;
+    cursor_samplerSource source = simulatedSource ;
+    source.context = &sim ;
+    sim.sampler    = &sampler ;
+    sim.stopAfter  = UINT64_MAX ;
+    uint64_t next  = 0 ;
+    for (int i = 0 ; i < 4 ; i++) next = cursor_sampler_tick(&sampler, &source, next, 1000) ;
+    sim.delay = 3500 ;
+    for (int i = 0 ; i < 4 ; i++) next = cursor_sampler_tick(&sampler, &source, next, 1000) ;
+    CHECK_INT(atomic_load(&sampler.late), 3) ;
+    CHECK_INT(atomic_load(&sampler.taken), 8) ;
+
+    cursor_sample samples[8] ;
+    CHECK_INT(drain(&sampler, samples, 8), 8) ;
+    static const double expected[] = { 0, 1, 2, 3, 4, 8, 9, 10 } ;
+    for (int i = 0 ; i < 8 ; i++) CHECK_NEAR(samples[i].timestamp * 1e6, expected[i], 1e-9) ;
+    cursor_sampleRing_free(&sampler.ring) ;
+}
+
+TEST(ringWrapsAround) {
+    cursor_sampler sampler = { 0 } ;
+    simulation     sim     = { .now = 0 } ;
+    CHECK_INT(cursor_sampleRing_reserve(&sampler.ring, 8), 8) ;
+    test_seed(14) ;
+    cursor_sample samples[8] ;
+    uint64_t      expected = 0, drained = 0 ;
+    bool          ordered  = true ;
+    // many times around the ring, in runs shorter than it so nothing is dropped
+    for (int round = 0 ; round < 2000 ; round++) {
+        run(&sampler, &sim, 1 + test_random() % 8, 1000) ;
+        uint64_t count = drain(&sampler, samples, 8) ;
+        for (uint64_t i = 0 ; i < count ; i++) {
+            if (fabs(samples[i].timestamp * 1e9 - (double)(expected * 1000)) > 1e-3) ordered = false ;
+            expected++ ;
+        }
+        drained += count ;
+    }
+    CHECK(ordered) ;
+    CHECK(drained > 8 * 1000) ;
+    CHECK_INT(atomic_load(&sampler.ring.head), drained) ;
+    CHECK_INT(atomic_load(&sampler.overruns), 0) ;
+    cursor_sampleRing_free(&sampler.ring) ;
+}
+
+TEST(derivativesOfAKnownPath) {
+    cursor_sampler sampler = { 0 } ;
+    simulation     sim     = { .now = 0, .acceleration = 400 } ;
+    CHECK_INT(cursor_sampleRing_reserve(&sampler.ring, 64), 64) ;
+    cursor_derivatives state ;
+    cursor_derivatives_reset(&state) ;
+
+    // drained in two batches, the derivatives carry on across them
+    cursor_sample samples[64] ;
+    double        values[4] ;
+    double        period   = 1.0 / 240 ;
+    double        previous = 0 ;
+    int           index    = 0 ;
+    for (int batch = 0 ; batch < 2 ; batch++) {
+        run(&sampler, &sim, 20, (uint64_t)(period * 1e9)) ;
+        uint64_t count = drain(&sampler, samples, 64) ;
+        CHECK_INT(count, 20) ;
+        for (uint64_t i = 0 ; i < count ; i++, index++) {
+            cursor_derivatives_next(&state, &samples[i], values) ;
+            double midpoint = (samples[i].timestamp + previous) / 2 ;
+            previous        = samples[i].timestamp ;
+            if (index == 0) {
+                CHECK(values[0] == 0 && values[1] == 0 && values[2] == 0 && values[3] == 0) ;
+                continue ;
+            }
+            // a backward difference of a quadratic is its slope at the midpoint
+            CHECK_NEAR(values[0], 400 * midpoint, 1e-3) ;
+            CHECK_NEAR(values[1], 100, 1e-6) ;
+            if (index > 1) {
+                CHECK_NEAR(values[2], 400, 1e-2) ;
+                CHECK_NEAR(values[3], 0, 1e-2) ;
+            } else {
+                CHECK(values[2] == 0 && values[3] == 0) ;
+            }
+        }
+    }
+
+    // a repeated timestamp gives no derivatives rather than a division by zero
+    cursor_sample repeat = state.previous ;
+    cursor_derivatives_next(&state, &repeat, values) ;
+    CHECK(values[0] == 0 && values[1] == 0 && values[2] == 0 && values[3] == 0) ;
+    cursor_sampleRing_free(&sampler.ring) ;
+}
+
+// a real sampler thread on the monotonic clock, drained from this one while it runs
+static uint64_t monotonicNow(__attribute__((unused)) void *context) {
+    struct timespec now ;
+    clock_gettime(CLOCK_MONOTONIC, &now) ;
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec ;
+}
+
+static void monotonicWait(__attribute__((unused)) void *context, uint64_t deadline) {
+    struct timespec until = { .tv_sec = (time_t)(deadline / 1000000000ULL), .tv_nsec = (long)(deadline % 1000000000ULL) } ;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) != 0) ;
+}
+
+static bool countingPosition(void *context, double *x, double *y) {
+    uint64_t *count = context ;
+    *x = (double)(*count)++ ;
+    *y = 0 ;
+    return true ;
+}
+
+static cursor_sampler threadedSampler = { 0 } ;
+
+static void *threadedMain(void *context) {
+    cursor_samplerSource source = {
+        .now = monotonicNow, .seconds = simulatedSeconds, .waitUntil = monotonicWait, .position = countingPosition, .context = context,
+    } ;
+    cursor_sampler_run(&threadedSampler, &source, 50000) ;
+    return NULL ;
+}
+
+TEST(drainedFromAnotherThread) {
+    CHECK_INT(cursor_sampleRing_reserve(&threadedSampler.ring, 16), 16) ;
+    uint64_t  reads = 0 ;
+    pthread_t thread ;
+    atomic_store(&threadedSampler.running, true) ;
+    CHECK_INT(pthread_create(&thread, NULL, threadedMain, &reads), 0) ;
+
+    cursor_sample samples[16] ;
+    uint64_t      drained = 0 ;
+    double        lastX = -1, lastTimestamp = 0 ;
+    bool          ordered = true ;
+    for (uint64_t start = monotonicNow(NULL) ; monotonicNow(NULL) - start < 200000000 ; ) {
+        uint64_t count = drain(&threadedSampler, samples, 16) ;
+        for (uint64_t i = 0 ; i < count ; i++) {
+            if (samples[i].x <= lastX || samples[i].timestamp <= lastTimestamp) ordered = false ;
+            lastX         = samples[i].x ;
+            lastTimestamp = samples[i].timestamp ;
+        }
+        drained += count ;
+        monotonicWait(NULL, monotonicNow(NULL) + 300000) ;
+    }
+    atomic_store(&threadedSampler.running, false) ;
+    pthread_join(thread, NULL) ;
+    drained += drain(&threadedSampler, samples, 16) ;
+
+    // every read was either drained or counted as an overrun, and in order
+    CHECK(ordered) ;
+    CHECK(drained > 100) ;
+    CHECK_INT(drained, atomic_load(&threadedSampler.taken)) ;
+    CHECK_INT(drained + atomic_load(&threadedSampler.overruns), reads) ;
+    cursor_sampleRing_free(&threadedSampler.ring) ;
+}
+
+int main(void) {
+    RUN_TEST(capacityIsBounded) ;
+    RUN_TEST(overrunsWhenNothingDrains) ;
+    RUN_TEST(missedTicksAreSkipped) ;
+    RUN_TEST(ringWrapsAround) ;
+    RUN_TEST(derivativesOfAKnownPath) ;
+    RUN_TEST(drainedFromAnotherThread) ;
+    return test_finish("cursor sampler") ;
+}
@@ -0,0 +1,108 @@
+//
+// test_cursor_sets.c
+// The digest registerCursorSet skips registrations with: unchanged frames and options give the same
+// digest, and changing any pixel, the row padding, the frame order or any option does or doesn't change it
+// as it should
+
+#include "test.h"
+#include "cursor/cursor_backend.h"
+#include "cursor/cursor_sets.h"
+
+enum { kFrames = 4 } ;
+
+static uint8_t frames[kFrames][CURSOR_MOCK_DATA_SIZE] ;
+
+static cursor_setOptions defaultOptions(void) {
+    return (cursor_setOptions){
+        .global        = true,
+        .frameDuration = 0.1,
+        .repeatCount   = 0,
+        .hotSpot       = { 4, 4 },
+        .size          = { CURSOR_MOCK_PIXELS / 2, CURSOR_MOCK_PIXELS / 2 },
+        .frameCount    = kFrames,
+    } ;
+}
+
+static uint64_t digestOf(const cursor_setOptions *options, uint8_t images[][CURSOR_MOCK_DATA_SIZE], const int *order) {
+    uint64_t digest = cursor_setDigest_begin(options) ;
+    for (size_t i = 0 ; i < options->frameCount ; i++) {
+        digest = cursor_setDigest_addFrame(digest, images[order ? order[i] : (int)i], CURSOR_MOCK_PIXELS, CURSOR_MOCK_PIXELS,
+                                           CURSOR_MOCK_ROW_BYTES, 4) ;
+    }
+    return cursor_setDigest_end(digest) ;
+}
+
+static void makeFrames(void) {
+    for (int i = 0 ; i < kFrames ; i++) cursor_mockImage(2000 + (uint32_t)i, frames[i]) ;
+}
+
+TEST(unchangedSetsHaveTheSameDigest) {
+    makeFrames() ;
+    cursor_setOptions options = defaultOptions() ;
+    uint64_t          digest  = digestOf(&options, frames, NULL) ;
+    CHECK(digest != 0) ;
+
+    // rebuilt from scratch, as a second registerCursorSet call would
+    makeFrames() ;
+    CHECK(digestOf(&options, frames, NULL) == digest) ;
+
+    // -0.0 is the same frame duration as 0.0
+    options.frameDuration = 0.0 ;
+    uint64_t zero = digestOf(&options, frames, NULL) ;
+    options.frameDuration = -0.0 ;
+    CHECK(digestOf(&options, frames, NULL) == zero) ;
+}
+
+TEST(anyChangeChangesTheDigest) {
+    makeFrames() ;
+    cursor_setOptions options = defaultOptions() ;
+    uint64_t          digest  = digestOf(&options, frames, NULL) ;
+
+    // every pixel byte of every frame counts
+    size_t changed = 0 ;
+    for (int f = 0 ; f < kFrames ; f++) {
+        for (size_t i = 0 ; i < CURSOR_MOCK_DATA_SIZE ; i += 61) {
+            frames[f][i] ^= 1 ;
+            if (digestOf(&options, frames, NULL) != digest) changed++ ;
+            frames[f][i] ^= 1 ;
+        }
+    }
+    CHECK_INT(changed, kFrames * ((CURSOR_MOCK_DATA_SIZE + 60) / 61)) ;
+    CHECK(digestOf(&options, frames, NULL) == digest) ;
+
+    static const int swapped[kFrames] = { 1, 0, 2, 3 } ;
+    CHECK(digestOf(&options, frames, swapped) != digest) ;
+
+    cursor_setOptions other = options ; other.global = false ;          CHECK(digestOf(&other, frames, NULL) != digest) ;
+    other = options ; other.frameDuration = 0.2 ;                       CHECK(digestOf(&other, frames, NULL) != digest) ;
+    other = options ; other.repeatCount = 3 ;                           CHECK(digestOf(&other, frames, NULL) != digest) ;
+    other = options ; other.hotSpot.x = 5 ;                             CHECK(digestOf(&other, frames, NULL) != digest) ;
+    other = options ; other.size.height = 32 ;                          CHECK(digestOf(&other, frames, NULL) != digest) ;
+    other = options ; other.frameCount = kFrames - 1 ;                  CHECK(digestOf(&other, frames, NULL) != digest) ;
+}
+
+// the padding at the end of each row isn't part of the image, and rows which aren't a whole number of words
+// are hashed to their last byte
+TEST(rowPaddingIsIgnored) {
+    enum { width = 5, height = 3, padded = 32 } ;
+    uint8_t tight[width * 3 * height], loose[padded * height] ;
+    memset(loose, 0xAA, sizeof(loose)) ;
+    for (size_t i = 0 ; i < sizeof(tight) ; i++) tight[i] = (uint8_t)(i * 7 + 1) ;
+    for (size_t y = 0 ; y < height ; y++) memcpy(loose + y * padded, tight + y * width * 3, width * 3) ;
+
+    uint64_t a = cursor_setDigest_addFrame(1, tight, width, height, width * 3, 3) ;
+    uint64_t b = cursor_setDigest_addFrame(1, loose, width, height, padded, 3) ;
+    CHECK(a == b) ;
+    loose[padded + width * 3 - 1] ^= 0x80 ;
+    CHECK(cursor_setDigest_addFrame(1, loose, width, height, padded, 3) != a) ;
+    loose[padded + width * 3 - 1] ^= 0x80 ;
+    loose[padded + width * 3] ^= 0x80 ;
+    CHECK(cursor_setDigest_addFrame(1, loose, width, height, padded, 3) == a) ;
+}
+
+int main(void) {
+    RUN_TEST(unchangedSetsHaveTheSameDigest) ;
+    RUN_TEST(anyChangeChangesTheDigest) ;
+    RUN_TEST(rowPaddingIsIgnored) ;
+    return test_finish("cursor sets") ;
+}
@@ -0,0 +1,119 @@
+//
+// test_hsasm_checkargs.c
+// The fast argument check against a model of LuaSkin's checkArgs: it must never accept arguments checkArgs
+// would reject, and for signatures made only of the masks it understands it must accept everything
+// checkArgs does, so the slow path is only taken for calls which are about to raise an error
+
+#include "test.h"
+#include "stubs/lua.h"
+#include "hsasm_checkargs.h"
+
+#define MATCH(L, ...) ({                                                                               \
+    static const int signature[] = { __VA_ARGS__ } ;                                                    \
+    hsasm_checkargs_match((L), signature, sizeof(signature) / sizeof(int)) ;                           \
+})
+
+static lua_State stack(int count, const int *types, const bool *integers) {
+    lua_State L = { .top = 0 } ;
+    for (int i = 0 ; i < count ; i++) lua_stub_push(&L, types[i], integers ? integers[i] : false) ;
+    return L ;
+}
+
+TEST(signaturesFromTheModules) {
+    lua_State none = { .top = 0 } ;
+    CHECK(MATCH(&none, LS_TBREAK)) ;
+    CHECK(MATCH(&none, LS_TBOOLEAN | LS_TOPTIONAL, LS_TTABLE | LS_TOPTIONAL, LS_TBREAK)) ;
+    CHECK(!MATCH(&none, LS_TNUMBER, LS_TBREAK)) ;
+
+    lua_State number = stack(1, (int[]){ LUA_TNUMBER }, (bool[]){ false }) ;
+    CHECK(MATCH(&number, LS_TNUMBER, LS_TBREAK)) ;
+    CHECK(!MATCH(&number, LS_TNUMBER | LS_TINTEGER, LS_TBREAK)) ;
+    CHECK(!MATCH(&number, LS_TBREAK)) ;
+    CHECK(MATCH(&number, LS_TANY, LS_TBREAK)) ;
+    CHECK(!MATCH(&number, LS_TSTRING | LS_TOPTIONAL, LS_TBREAK)) ;
+
+    lua_State integer = stack(2, (int[]){ LUA_TNUMBER, LUA_TFUNCTION }, (bool[]){ true, false }) ;
+    CHECK(MATCH(&integer, LS_TNUMBER | LS_TINTEGER, LS_TFUNCTION | LS_TNIL | LS_TOPTIONAL, LS_TBREAK)) ;
+    CHECK(!MATCH(&integer, LS_TNUMBER | LS_TINTEGER, LS_TBREAK)) ;
+
+    // nil is a value, not a missing argument
+    lua_State nil = stack(1, (int[]){ LUA_TNIL }, NULL) ;
+    CHECK(!MATCH(&nil, LS_TTABLE | LS_TOPTIONAL, LS_TBREAK)) ;
+    CHECK(MATCH(&nil, LS_TTABLE | LS_TNIL, LS_TBREAK)) ;
+}
+
+// these are always left to checkArgs, whether or not the arguments match
+TEST(unknownMasksAreLeftToCheckArgs) {
+    lua_State userdata = stack(1, (int[]){ LUA_TUSERDATA }, NULL) ;
+    static const int withUserdata[] = { LS_TUSERDATA, LS_TBREAK } ;
+    CHECK(!hsasm_checkargs_match(&userdata, withUserdata, 2)) ;
+    CHECK(lua_stub_checkArgs(&userdata, LS_TUSERDATA, "hs._asm.example", LS_TBREAK)) ;
+
+    lua_State two = stack(2, (int[]){ LUA_TSTRING, LUA_TSTRING }, NULL) ;
+    CHECK(!MATCH(&two, LS_TSTRING, LS_TBREAK | LS_TVARARG)) ;
+    CHECK(lua_stub_checkArgs(&two, LS_TSTRING, LS_TBREAK | LS_TVARARG)) ;
+
+    // and a signature without a break is a mistake checkArgs should report
+    static const int unterminated[] = { LS_TSTRING, LS_TSTRING } ;
+    CHECK(!hsasm_checkargs_match(&two, unterminated, 2)) ;
+
+    lua_State thread = stack(1, (int[]){ LUA_TTHREAD }, NULL) ;
+    CHECK(!MATCH(&thread, LS_TTABLE | LS_TFUNCTION, LS_TBREAK)) ;
+    CHECK(MATCH(&thread, LS_TANY, LS_TBREAK)) ;
+}
+
+static const int knownMasks[] = {
+    LS_TNIL, LS_TBOOLEAN, LS_TNUMBER, LS_TINTEGER, LS_TSTRING, LS_TTABLE, LS_TFUNCTION, LS_TOPTIONAL, LS_TNONE, LS_TANY
+} ;
+
+static const int luaTypes[] = {
+    LUA_TNIL, LUA_TBOOLEAN, LUA_TNUMBER, LUA_TSTRING, LUA_TTABLE, LUA_TFUNCTION, LUA_TUSERDATA, LUA_TLIGHTUSERDATA
+} ;
+
+#define COUNT(array) (sizeof(array) / sizeof(array[0]))
+
+TEST(randomSignaturesAgreeWithCheckArgs) {
+    test_seed(22) ;
+    size_t accepted = 0, fallbacks = 0 ;
+    for (int iteration = 0 ; iteration < 500000 ; iteration++) {
+        int  signature[6] = { 0 } ;
+        int  arguments = (int)(test_random() % 5) ;
+        bool known     = true ;
+        for (int i = 0 ; i < arguments ; i++) {
+            // one to three masks, usually of the types the arguments will be drawn from
+            signature[i] = 0 ;
+            for (uint32_t m = 0, count = 1 + test_random() % 3 ; m < count ; m++) {
+                int mask = knownMasks[test_random() % COUNT(knownMasks)] ;
+                if (mask == LS_TANY && test_random() % 4 != 0) mask = LS_TNUMBER ;
+                signature[i] |= mask ;
+            }
+        }
+        signature[arguments] = LS_TBREAK ;
+        if (test_random() % 50 == 0) {
+            signature[arguments] |= LS_TVARARG ;
+            known = false ;
+        }
+
+        // about as many, or one more or fewer, arguments of random types
+        int       depth = arguments + (int)(test_random() % 3) - 1 ;
+        lua_State L     = { .top = 0 } ;
+        for (int i = 0 ; i < depth ; i++) lua_stub_push(&L, luaTypes[test_random() % COUNT(luaTypes)], test_random() % 2) ;
+
+        bool fast = hsasm_checkargs_match(&L, signature, (size_t)arguments + 1) ;
+        bool full = lua_stub_checkArgs(&L, signature[0], signature[1], signature[2], signature[3], signature[4], signature[5]) ;
+        if (fast) CHECK(full) ;
+        if (known && full) CHECK(fast) ;
+        if (full) accepted++ ;
+        if (full && !fast) fallbacks++ ;
+    }
+    // the draw should exercise both outcomes
+    CHECK(accepted > 50000 && accepted < 450000) ;
+    CHECK(fallbacks > 0) ;
+}
+
+int main(void) {
+    RUN_TEST(signaturesFromTheModules) ;
+    RUN_TEST(unknownMasksAreLeftToCheckArgs) ;
+    RUN_TEST(randomSignaturesAgreeWithCheckArgs) ;
+    return test_finish("hsasm checkargs") ;
+}
@@ -0,0 +1,149 @@
+//
+// test_hsasm_constants.c
+// The constant tables' lookups in both directions, their iteration order and their rendering, checked
+// against linear scans of the same arrays, including tables with repeated and negative values
+
+#include "test.h"
+#include "hsasm_constants.h"
+
+static const hsasm_constant effectNames[] = {
+    { "genie",  0 },
+    { "scale",  1 },
+    { "suck",   2 },
+} ;
+
+// several names for one value, as the Dock's pinning constants have
+static const hsasm_constant pinningNames[] = {
+    { "middle", 2 },
+    { "start",  1 },
+    { "end",    3 },
+    { "top",    1 },
+    { "bottom", 3 },
+    { "none",   -1 },
+} ;
+
+TEST(lookupsInBothDirections) {
+    hsasm_constants effects = HSASM_CONSTANTS("effect", effectNames) ;
+    CHECK_INT(effects.count, 3) ;
+    CHECK_INT(hsasm_constants_indexOfName(&effects, "scale"), 1) ;
+    CHECK_INT(hsasm_constants_indexOfName(&effects, "Scale"), -1) ;
+    CHECK_INT(hsasm_constants_indexOfName(&effects, ""), -1) ;
+    CHECK_INT(hsasm_constants_indexOfValue(&effects, 2), 2) ;
+    CHECK_INT(hsasm_constants_indexOfValue(&effects, 3), -1) ;
+    CHECK_INT(hsasm_constants_indexOfValue(&effects, -1), -1) ;
+    CHECK(effects.sorted) ;
+}
+
+TEST(repeatedValuesFindTheFirstNameInOrder) {
+    hsasm_constants pinnings = HSASM_CONSTANTS("pinning", pinningNames) ;
+    CHECK_STR(pinningNames[hsasm_constants_indexOfValue(&pinnings, 1)].name, "start") ;
+    CHECK_STR(pinningNames[hsasm_constants_indexOfValue(&pinnings, 3)].name, "bottom") ;
+    CHECK_STR(pinningNames[hsasm_constants_indexOfValue(&pinnings, -1)].name, "none") ;
+    CHECK_INT(hsasm_constants_indexOfValue(&pinnings, 0), -1) ;
+    CHECK_INT(hsasm_constants_indexOfName(&pinnings, "top"), 3) ;
+}
+
+TEST(iterationIsInNameOrder) {
+    hsasm_constants pinnings = HSASM_CONSTANTS("pinning", pinningNames) ;
+    const char      *expected[] = { "bottom", "end", "middle", "none", "start", "top" } ;
+    const char      *name       = NULL ;
+    size_t          visited     = 0 ;
+    int             idx ;
+    while ((idx = hsasm_constants_following(&pinnings, name)) >= 0) {
+        CHECK(visited < 6) ;
+        if (visited >= 6) break ;
+        CHECK_STR(pinningNames[idx].name, expected[visited]) ;
+        name = pinningNames[idx].name ;
+        visited++ ;
+    }
+    CHECK_INT(idx, -1) ;
+    CHECK_INT(visited, 6) ;
+    CHECK_INT(hsasm_constants_following(&pinnings, "left"), -2) ;
+
+    hsasm_constants empty = { .name = "empty", .entries = NULL, .count = 0 } ;
+    CHECK_INT(hsasm_constants_following(&empty, NULL), -1) ;
+    CHECK_INT(hsasm_constants_indexOfName(&empty, "anything"), -1) ;
+    CHECK_INT(hsasm_constants_indexOfValue(&empty, 0), -1) ;
+}
+
+TEST(renderingIsAlignedAndTruncatesLikeSnprintf) {
+    hsasm_constants pinnings = HSASM_CONSTANTS("pinning", pinningNames) ;
+    const char      *expected = "bottom 3\nend    3\nmiddle 2\nnone   -1\nstart  1\ntop    1\n" ;
+    char            rendering[128] ;
+    size_t          length = hsasm_constants_render(&pinnings, rendering, sizeof(rendering)) ;
+    CHECK_INT(length, strlen(expected)) ;
+    CHECK_STR(rendering, expected) ;
+
+    CHECK_INT(hsasm_constants_render(&pinnings, NULL, 0), strlen(expected)) ;
+    char small[12] ;
+    CHECK_INT(hsasm_constants_render(&pinnings, small, sizeof(small)), strlen(expected)) ;
+    CHECK_STR(small, "bottom 3\nen") ;
+}
+
+TEST(tablesWhichAreTooLargeFindNothing) {
+    static hsasm_constant many[HSASM_CONSTANTS_MAX + 1] ;
+    static char           names[HSASM_CONSTANTS_MAX + 1][8] ;
+    for (size_t i = 0 ; i < HSASM_CONSTANTS_MAX + 1 ; i++) {
+        snprintf(names[i], sizeof(names[i]), "c%zu", i) ;
+        many[i] = (hsasm_constant){ names[i], (int64_t)i } ;
+    }
+    hsasm_constants constants = HSASM_CONSTANTS("many", many) ;
+    CHECK_INT(hsasm_constants_indexOfName(&constants, "c1"), -1) ;
+    CHECK_INT(hsasm_constants_indexOfValue(&constants, 1), -1) ;
+    CHECK_INT(hsasm_constants_render(&constants, NULL, 0), 0) ;
+    CHECK(!constants.sorted) ;
+
+    constants.count = HSASM_CONSTANTS_MAX ;
+    CHECK_INT(hsasm_constants_indexOfName(&constants, "c63"), 63) ;
+    CHECK_INT(hsasm_constants_indexOfValue(&constants, 63), 63) ;
+}
+
+// the linear scans the tables replaced: the first name in sorted order with the value
+static int linear_indexOfValue(const hsasm_constant *entries, size_t count, int64_t value) {
+    int found = -1 ;
+    for (size_t i = 0 ; i < count ; i++) {
+        if (entries[i].value == value && (found < 0 || strcmp(entries[i].name, entries[found].name) < 0)) found = (int)i ;
+    }
+    return found ;
+}
+
+TEST(randomTablesMatchLinearScans) {
+    static hsasm_constant entries[HSASM_CONSTANTS_MAX] ;
+    static char           names[HSASM_CONSTANTS_MAX][12] ;
+    test_seed(20) ;
+    for (int round = 0 ; round < 2000 ; round++) {
+        size_t count = 1 + test_random() % HSASM_CONSTANTS_MAX ;
+        for (size_t i = 0 ; i < count ; i++) {
+            // names are unique; values repeat often, except in every other round, where they are all distinct
+            snprintf(names[i], sizeof(names[i]), "%c%zu", 'a' + (int)(test_random() % 26), i) ;
+            int64_t value = (round & 1) ? (int64_t)(count - i) * 3 - 20 : (int64_t)(test_random() % 40) - 20 ;
+            entries[i] = (hsasm_constant){ names[i], value } ;
+        }
+        hsasm_constants constants = { .name = "random", .entries = entries, .count = count } ;
+        for (size_t i = 0 ; i < count ; i++) CHECK_INT(hsasm_constants_indexOfName(&constants, names[i]), i) ;
+        CHECK_INT(hsasm_constants_indexOfName(&constants, "zz"), -1) ;
+        for (int64_t value = -22 ; value < 3 * HSASM_CONSTANTS_MAX - 18 ; value++) {
+            CHECK_INT(hsasm_constants_indexOfValue(&constants, value), linear_indexOfValue(entries, count, value)) ;
+        }
+        if (round & 1) CHECK(constants.distinctValues) ;
+
+        size_t     visited  = 0 ;
+        const char *previous = NULL ;
+        for (int idx = hsasm_constants_following(&constants, NULL) ; idx >= 0 ; idx = hsasm_constants_following(&constants, entries[idx].name)) {
+            if (previous) CHECK(strcmp(previous, entries[idx].name) < 0) ;
+            previous = entries[idx].name ;
+            visited++ ;
+        }
+        CHECK_INT(visited, count) ;
+    }
+}
+
+int main(void) {
+    RUN_TEST(lookupsInBothDirections) ;
+    RUN_TEST(repeatedValuesFindTheFirstNameInOrder) ;
+    RUN_TEST(iterationIsInNameOrder) ;
+    RUN_TEST(renderingIsAlignedAndTruncatesLikeSnprintf) ;
+    RUN_TEST(tablesWhichAreTooLargeFindNothing) ;
+    RUN_TEST(randomTablesMatchLinearScans) ;
+    return test_finish("hsasm constants") ;
+}
@@ -0,0 +1,369 @@
+//
+// test_hsasm_executor.c
+// The lane bookkeeping with a pthread standing in for the serial dispatch queue: completions and
+// notifications in submission order, the depth limit under a stalled lane, barriers which complete but
+// never notify, re-entrant completions and notifications, and abandoning queued work
+
+#include "test.h"
+#include "hsasm_executor.h"
+
+#include <unistd.h>
+
+// the serial "dispatch queue": runs each submission's work in order, then finishes it on the lane
+typedef struct submission {
+    struct submission *next ;
+    hsasm_laneItem    *item ;
+    unsigned          spin ;
+} submission ;
+
+typedef struct {
+    hsasm_lane      *lane ;
+    pthread_t       thread ;
+    pthread_mutex_t lock ;
+    pthread_cond_t  wake ;
+    submission      *head, *tail ;
+    bool            gated ;    // while set, queued work doesn't start
+    bool            stopping ;
+} worker ;
+
+static void *workerMain(void *context) {
+    worker *w = context ;
+    pthread_mutex_lock(&w->lock) ;
+    while (true) {
+        while (!w->stopping && (w->gated || !w->head)) pthread_cond_wait(&w->wake, &w->lock) ;
+        if (!w->head) break ;
+        submission *next = w->head ;
+        w->head = next->next ;
+        if (!w->head) w->tail = NULL ;
+        pthread_mutex_unlock(&w->lock) ;
+        for (volatile unsigned i = 0 ; i < next->spin ; i++) ;
+        hsasm_lane_finish(w->lane, next->item) ;
+        free(next) ;
+        pthread_mutex_lock(&w->lock) ;
+    }
+    pthread_mutex_unlock(&w->lock) ;
+    return NULL ;
+}
+
+static void workerStart(worker *w, hsasm_lane *lane) {
+    *w = (worker){ .lane = lane } ;
+    pthread_mutex_init(&w->lock, NULL) ;
+    pthread_cond_init(&w->wake, NULL) ;
+    pthread_create(&w->thread, NULL, workerMain, w) ;
+}
+
+static void workerGate(worker *w, bool gated) {
+    pthread_mutex_lock(&w->lock) ;
+    w->gated = gated ;
+    pthread_cond_signal(&w->wake) ;
+    pthread_mutex_unlock(&w->lock) ;
+}
+
+static void workerStop(worker *w) {
+    pthread_mutex_lock(&w->lock) ;
+    w->stopping = true ;
+    w->gated    = false ;
+    pthread_cond_signal(&w->wake) ;
+    pthread_mutex_unlock(&w->lock) ;
+    pthread_join(w->thread, NULL) ;
+    pthread_mutex_destroy(&w->lock) ;
+    pthread_cond_destroy(&w->wake) ;
+}
+
+// what each item did, in the order it happened; only the main thread runs items
+typedef enum { COMPLETED, NOTIFIED, RELEASED } event ;
+
+#define LOG_SIZE 200000
+
+static struct {
+    int   id[LOG_SIZE] ;
+    event what[LOG_SIZE] ;
+    int   count ;
+} logged ;
+
+typedef struct {
+    hsasm_laneItem item ;
+    int            id ;
+    void           (*onComplete)(int id) ;
+    void           (*onNotify)(int id) ;
+} testItem ;
+
+static void runTestItem(hsasm_laneItem *item, hsasm_lanePhase phase) {
+    testItem *test = (testItem *)item ;
+    if (logged.count < LOG_SIZE) {
+        logged.id[logged.count]   = test->id ;
+        logged.what[logged.count] = (phase == HSASM_LANE_COMPLETE) ? COMPLETED : (phase == HSASM_LANE_NOTIFY) ? NOTIFIED : RELEASED ;
+        logged.count++ ;
+    }
+    if (phase == HSASM_LANE_COMPLETE && test->onComplete) test->onComplete(test->id) ;
+    if (phase == HSASM_LANE_NOTIFY && test->onNotify) test->onNotify(test->id) ;
+    if (phase == HSASM_LANE_RELEASE) free(test) ;
+}
+
+static worker *currentWorker ;
+
+static bool submit(hsasm_lane *lane, int id, bool notifies, unsigned spin) {
+    testItem *item = calloc(1, sizeof(testItem)) ;
+    if (!hsasm_lane_reserve(lane, &item->item)) {
+        free(item) ;
+        return false ;
+    }
+    item->id            = id ;
+    item->item.run      = runTestItem ;
+    item->item.notifies = notifies ;
+    submission *next = calloc(1, sizeof(submission)) ;
+    next->item = &item->item ;
+    next->spin = spin ;
+    pthread_mutex_lock(&currentWorker->lock) ;
+    if (currentWorker->tail) {
+        currentWorker->tail->next = next ;
+    } else {
+        currentWorker->head = next ;
+    }
+    currentWorker->tail = next ;
+    pthread_cond_signal(&currentWorker->wake) ;
+    pthread_mutex_unlock(&currentWorker->lock) ;
+    return true ;
+}
+
+// a turn of the run loop posted by the lane
+static void deliver(hsasm_lane *lane) {
+    (void)hsasm_lane_drain(lane) ;
+    hsasm_lane_notify(lane) ;
+}
+
+static int countOf(event what) {
+    int count = 0 ;
+    for (int i = 0 ; i < logged.count ; i++) count += (logged.what[i] == what) ;
+    return count ;
+}
+
+// true if the ids logged for `what` are strictly increasing
+static bool inOrder(event what) {
+    int last = -1 ;
+    for (int i = 0 ; i < logged.count ; i++) {
+        if (logged.what[i] != what) continue ;
+        if (logged.id[i] <= last) return false ;
+        last = logged.id[i] ;
+    }
+    return true ;
+}
+
+TEST(idleLaneDoesNotWait) {
+    hsasm_lane lane = HSASM_LANE("idle", 4) ;
+    CHECK(!hsasm_lane_wait(&lane)) ;
+    CHECK(!hsasm_lane_settle(&lane)) ;
+    CHECK_INT(atomic_load(&lane.barriers), 0) ;
+}
+
+TEST(completionsAndNotificationsInOrder) {
+    hsasm_lane lane = HSASM_LANE("order", 1000) ;
+    worker     w ;
+    workerStart(&w, &lane) ;
+    currentWorker = &w ;
+    logged.count  = 0 ;
+    test_seed(18) ;
+    for (int id = 0 ; id < 500 ; id++) {
+        CHECK(submit(&lane, id, id % 3 != 0, test_random() % 20000)) ;
+        if (test_random() % 8 == 0) deliver(&lane) ;
+    }
+    CHECK(hsasm_lane_settle(&lane)) ;
+    hsasm_lane_notify(&lane) ;
+    CHECK(inOrder(COMPLETED)) ;
+    CHECK(inOrder(NOTIFIED)) ;
+    CHECK_INT(countOf(COMPLETED), 500) ;
+    CHECK_INT(countOf(NOTIFIED), 333) ;
+    CHECK_INT(countOf(RELEASED), 500) ;
+    CHECK_INT(atomic_load(&lane.depth), 0) ;
+    CHECK_INT(atomic_load(&lane.completed), 500) ;
+    workerStop(&w) ;
+}
+
+TEST(depthLimitUnderAStalledLane) {
+    hsasm_lane lane = HSASM_LANE("backpressure", 4) ;
+    worker     w ;
+    workerStart(&w, &lane) ;
+    currentWorker = &w ;
+    logged.count  = 0 ;
+    workerGate(&w, true) ;
+    int accepted = 0 ;
+    for (int id = 0 ; id < 10 ; id++) accepted += submit(&lane, id, false, 0) ;
+    CHECK_INT(accepted, 4) ;
+    CHECK_INT(atomic_load(&lane.rejected), 6) ;
+    CHECK_INT(atomic_load(&lane.depth), 4) ;
+    CHECK_INT(atomic_load(&lane.peakDepth), 4) ;
+
+    // finished but not yet completed work still counts against the limit
+    workerGate(&w, false) ;
+    while (true) {
+        pthread_mutex_lock(&lane.lock) ;
+        bool done = (lane.workDone == 4) ;
+        pthread_mutex_unlock(&lane.lock) ;
+        if (done) break ;
+        usleep(100) ;
+    }
+    CHECK(!submit(&lane, 10, false, 0)) ;
+    deliver(&lane) ;
+    CHECK_INT(atomic_load(&lane.depth), 0) ;
+    CHECK(submit(&lane, 11, false, 0)) ;
+    (void)hsasm_lane_settle(&lane) ;
+    CHECK_INT(countOf(COMPLETED), 5) ;
+    CHECK_INT(atomic_load(&lane.submitted), 5) ;
+    CHECK_INT(atomic_load(&lane.rejected), 7) ;
+    workerStop(&w) ;
+}
+
+static hsasm_lane *reentrantLane ;
+static int        reentrantCalls ;
+
+// a completion which waits on the lane again, as a getter called from one would
+static void settleFromCompletion(int id) {
+    (void)id ;
+    reentrantCalls++ ;
+    (void)hsasm_lane_settle(reentrantLane) ;
+}
+
+// a notification which reads through the lane and queues more work, as a Lua callback might
+static void submitFromNotification(int id) {
+    reentrantCalls++ ;
+    (void)hsasm_lane_settle(reentrantLane) ;
+    if (id < 1000) CHECK(submit(reentrantLane, id + 1000, true, 0)) ;
+}
+
+TEST(barriersCompleteButNeverNotify) {
+    hsasm_lane lane = HSASM_LANE("barrier", 64) ;
+    worker     w ;
+    workerStart(&w, &lane) ;
+    currentWorker = &w ;
+    reentrantLane = &lane ;
+    logged.count  = 0 ;
+    for (int id = 0 ; id < 10 ; id++) CHECK(submit(&lane, id, true, 1000)) ;
+
+    // the barrier leaves every completion done and every notification pending
+    CHECK(hsasm_lane_settle(&lane)) ;
+    CHECK_INT(countOf(COMPLETED), 10) ;
+    CHECK_INT(countOf(NOTIFIED), 0) ;
+    CHECK_INT(atomic_load(&lane.barriers), 1) ;
+
+    // a second barrier with nothing new queued doesn't wait, and the notifications are still pending
+    CHECK(!hsasm_lane_settle(&lane)) ;
+    CHECK(lane.pending != NULL) ;
+    hsasm_lane_notify(&lane) ;
+    CHECK_INT(countOf(NOTIFIED), 10) ;
+    CHECK(inOrder(NOTIFIED)) ;
+    CHECK_INT(countOf(RELEASED), 10) ;
+
+    // completions and notifications which call back into the lane
+    logged.count   = 0 ;
+    reentrantCalls = 0 ;
+    for (int id = 0 ; id < 6 ; id++) CHECK(submit(&lane, id, true, 1000)) ;
+    // the hooks are installed once the work has run, while the items wait on the finished list
+    CHECK(hsasm_lane_wait(&lane)) ;
+    for (hsasm_laneItem *item = lane.finished ; item ; item = item->next) {
+        ((testItem *)item)->onComplete = settleFromCompletion ;
+        ((testItem *)item)->onNotify   = submitFromNotification ;
+    }
+    CHECK(hsasm_lane_drain(&lane)) ;
+    CHECK_INT(countOf(COMPLETED), 6) ;
+    CHECK_INT(countOf(NOTIFIED), 0) ;
+    CHECK_INT(reentrantCalls, 6) ;
+    // each notification queues one more, which the next notification's barrier completes and the same
+    // loop then notifies; only the last one queued is left on the lane
+    hsasm_lane_notify(&lane) ;
+    CHECK_INT(countOf(COMPLETED), 11) ;
+    CHECK_INT(countOf(NOTIFIED), 11) ;
+    CHECK(hsasm_lane_settle(&lane)) ;
+    hsasm_lane_notify(&lane) ;
+    CHECK_INT(countOf(COMPLETED), 12) ;
+    CHECK_INT(countOf(NOTIFIED), 12) ;
+    CHECK_INT(countOf(RELEASED), 12) ;
+    CHECK(inOrder(COMPLETED)) ;
+    CHECK(inOrder(NOTIFIED)) ;
+    CHECK_INT(atomic_load(&lane.depth), 0) ;
+    workerStop(&w) ;
+}
+
+TEST(abandonReleasesWithoutRunning) {
+    hsasm_lane lane = HSASM_LANE("abandon", 64) ;
+    worker     w ;
+    workerStart(&w, &lane) ;
+    currentWorker = &w ;
+    logged.count  = 0 ;
+
+    // three completed with notifications pending, and five more stalled on the lane
+    for (int id = 0 ; id < 3 ; id++) CHECK(submit(&lane, id, true, 0)) ;
+    CHECK(hsasm_lane_settle(&lane)) ;
+    workerGate(&w, true) ;
+    for (int id = 3 ; id < 8 ; id++) CHECK(submit(&lane, id, true, 0)) ;
+    workerGate(&w, false) ;
+    hsasm_lane_abandon(&lane) ;
+
+    CHECK_INT(countOf(COMPLETED), 3) ;
+    CHECK_INT(countOf(NOTIFIED), 0) ;
+    CHECK_INT(countOf(RELEASED), 8) ;
+    CHECK_INT(atomic_load(&lane.depth), 0) ;
+    CHECK(lane.pending == NULL) ;
+
+    // and the lane is usable afterwards
+    CHECK(submit(&lane, 8, true, 0)) ;
+    CHECK(hsasm_lane_settle(&lane)) ;
+    hsasm_lane_notify(&lane) ;
+    CHECK_INT(countOf(COMPLETED), 4) ;
+    CHECK_INT(countOf(NOTIFIED), 1) ;
+    CHECK_INT(countOf(RELEASED), 9) ;
+    workerStop(&w) ;
+}
+
+TEST(randomMixOfOperations) {
+    hsasm_lane lane = HSASM_LANE("stress", 8) ;
+    worker     w ;
+    workerStart(&w, &lane) ;
+    currentWorker = &w ;
+    logged.count  = 0 ;
+    test_seed(1018) ;
+    int  attempts = 0, accepted = 0, abandoned = 0 ;
+    bool bounded  = true ;
+    for (int step = 0 ; step < 30000 ; step++) {
+        uint32_t choice = test_random() % 16 ;
+        if (choice < 10) {
+            attempts++ ;
+            accepted += submit(&lane, attempts, test_random() % 2, test_random() % 3000) ;
+        } else if (choice < 13) {
+            deliver(&lane) ;
+        } else if (choice < 15) {
+            (void)hsasm_lane_settle(&lane) ;
+        } else if (test_random() % 50 == 0) {
+            hsasm_lane_abandon(&lane) ;
+            abandoned++ ;
+        } else {
+            hsasm_lane_notify(&lane) ;
+        }
+        if (atomic_load(&lane.depth) > lane.limit) bounded = false ;
+    }
+    (void)hsasm_lane_settle(&lane) ;
+    hsasm_lane_notify(&lane) ;
+
+    CHECK(bounded) ;
+    CHECK(abandoned > 0) ;
+    CHECK(accepted > 1000 && accepted < attempts) ;
+    CHECK_INT(atomic_load(&lane.submitted), accepted) ;
+    CHECK_INT(atomic_load(&lane.rejected), attempts - accepted) ;
+    CHECK_INT(atomic_load(&lane.completed), accepted) ;
+    CHECK_INT(countOf(RELEASED), accepted) ;
+    CHECK(countOf(COMPLETED) <= accepted) ;
+    CHECK(countOf(NOTIFIED) <= countOf(COMPLETED)) ;
+    CHECK(inOrder(COMPLETED)) ;
+    CHECK(inOrder(NOTIFIED)) ;
+    CHECK_INT(atomic_load(&lane.depth), 0) ;
+    workerStop(&w) ;
+}
+
+int main(void) {
+    RUN_TEST(idleLaneDoesNotWait) ;
+    RUN_TEST(completionsAndNotificationsInOrder) ;
+    RUN_TEST(depthLimitUnderAStalledLane) ;
+    RUN_TEST(barriersCompleteButNeverNotify) ;
+    RUN_TEST(abandonReleasesWithoutRunning) ;
+    RUN_TEST(randomMixOfOperations) ;
+    return test_finish("hsasm executor") ;
+}
@@ -0,0 +1,253 @@
+//
+// test_hsasm_spi.c
+// The private API call instrumentation: the log-linear histogram's buckets and quantiles, what a site
+// records, the wrapping macros, and several threads recording to the same site
+
+#include "test.h"
+#include "hsasm_spi.h"
+
+#include <pthread.h>
+
+TEST(bucketsCoverEveryValueInOrder) {
+    CHECK_INT(hsasm_spi_bucketLowerBound(0), 0) ;
+    for (size_t b = 0 ; b < HSASM_SPI_BUCKETS ; b++) {
+        uint64_t lower = hsasm_spi_bucketLowerBound(b) ;
+        CHECK_INT(hsasm_spi_bucketForTicks(lower), b) ;
+        if (b + 1 < HSASM_SPI_BUCKETS) {
+            uint64_t next = hsasm_spi_bucketLowerBound(b + 1) ;
+            CHECK(next > lower) ;
+            CHECK_INT(hsasm_spi_bucketForTicks(next - 1), b) ;
+        }
+    }
+    // everything from 2^43 ticks up lands in the last bucket
+    CHECK_INT(hsasm_spi_bucketForTicks(1ULL << 43), HSASM_SPI_BUCKETS - 1) ;
+    CHECK_INT(hsasm_spi_bucketForTicks(UINT64_MAX), HSASM_SPI_BUCKETS - 1) ;
+}
+
+TEST(bucketsAreWithinAQuarterOfTheirValues) {
+    test_seed(17) ;
+    for (int i = 0 ; i < 1000000 ; i++) {
+        uint64_t ticks = ((uint64_t)test_random() << 32 | test_random()) >> (21 + test_random() % 43) ;
+        uint64_t lower = hsasm_spi_bucketLowerBound(hsasm_spi_bucketForTicks(ticks)) ;
+        CHECK(lower <= ticks) ;
+        CHECK((double)(ticks - lower) <= 0.25 * (double)lower + 1) ;
+    }
+}
+
+static int compare_ticks(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b ;
+    return (x > y) - (x < y) ;
+}
+
+// the reported quantiles are the lower bounds of the buckets holding the exact quantiles
+TEST(quantilesMatchTheSortedValues) {
+    enum { count = 100000 } ;
+    static uint64_t values[count] ;
+    uint64_t        counts[HSASM_SPI_BUCKETS] = { 0 } ;
+    test_seed(170) ;
+    for (size_t i = 0 ; i < count ; i++) {
+        // mostly fast calls with a slow tail, like a WindowServer round trip
+        double ms = (test_random() % 100 < 95) ? 0.02 + test_uniform() * 0.05 : 1.0 + test_uniform() * 40.0 ;
+        values[i] = (uint64_t)(ms * 1e6) ;
+        counts[hsasm_spi_bucketForTicks(values[i])]++ ;
+    }
+    qsort(values, count, sizeof(uint64_t), compare_ticks) ;
+    const double quantiles[] = { 0.0, 0.5, 0.9, 0.99, 0.999, 1.0 } ;
+    for (size_t q = 0 ; q < sizeof(quantiles) / sizeof(double) ; q++) {
+        size_t   index  = (quantiles[q] == 0.0) ? 0 : (size_t)(quantiles[q] * count + 0.999999) - 1 ;
+        uint64_t exact  = values[index] ;
+        CHECK_INT(hsasm_spi_quantile(counts, count, quantiles[q]), hsasm_spi_bucketLowerBound(hsasm_spi_bucketForTicks(exact))) ;
+    }
+}
+
+TEST(siteRecordsCallsTicksAndErrors) {
+    static hsasm_spi_site site = HSASM_SPI_SITE("test.record") ;
+    hsasm_spi_record(&site, 100, 0) ;
+    hsasm_spi_record(&site, 5, 1001) ;
+    hsasm_spi_record(&site, 3000, 1001) ;
+    CHECK_INT(atomic_load(&site.registered), kHSASMSPIRegistered) ;
+    CHECK_INT(atomic_load(&site.errors), 2) ;
+
+    uint64_t counts[HSASM_SPI_BUCKETS] = { 0 }, calls = 0, totalTicks = 0, minTicks = UINT64_MAX, maxTicks = 0 ;
+    hsasm_spi_collect(&site, counts, &calls, &totalTicks, &minTicks, &maxTicks) ;
+    CHECK_INT(calls, 3) ;
+    CHECK_INT(totalTicks, 3105) ;
+    CHECK_INT(counts[5], 1) ;
+    CHECK_INT(minTicks, 5) ;
+    CHECK_INT(maxTicks, 3000) ;
+
+    // the first HSASM_SPI_ERROR_CODES distinct codes get their own counts; the rest are only errors
+    for (int32_t code = 1 ; code <= HSASM_SPI_ERROR_CODES + 3 ; code++) hsasm_spi_record(&site, 1, 2000 + code) ;
+    CHECK_INT(atomic_load(&site.errors), 2 + HSASM_SPI_ERROR_CODES + 3) ;
+    CHECK_INT(atomic_load(&site.errorCodes[0].code), 1001) ;
+    CHECK_INT(atomic_load(&site.errorCodes[0].count), 2) ;
+    CHECK_INT(atomic_load(&site.errorCodes[HSASM_SPI_ERROR_CODES - 1].code), 2000 + HSASM_SPI_ERROR_CODES - 1) ;
+
+    hsasm_spi_reset() ;
+    calls = totalTicks = maxTicks = 0 ;
+    minTicks = UINT64_MAX ;
+    hsasm_spi_collect(&site, counts, &calls, &totalTicks, &minTicks, &maxTicks) ;
+    CHECK_INT(calls, 0) ;
+    CHECK_INT(atomic_load(&site.errors), 0) ;
+    CHECK_INT(atomic_load(&site.errorCodes[0].code), 0) ;
+    CHECK(minTicks == UINT64_MAX) ;
+    CHECK_INT(maxTicks, 0) ;
+}
+
+static int calls = 0 ;
+
+static int32_t fake_call(int32_t result) {
+    calls++ ;
+    return result ;
+}
+
+static void fake_void(void) {
+    calls++ ;
+}
+
+static uint64_t site_calls(const char *name) {
+    uint64_t total = 0 ;
+    for (hsasm_spi_site *site = atomic_load(&hsasm_spi_sites) ; site ; site = site->next) {
+        if (strcmp(site->name, name) != 0) continue ;
+        uint64_t counts[HSASM_SPI_BUCKETS] = { 0 }, ticks = 0, minTicks = UINT64_MAX, maxTicks = 0 ;
+        hsasm_spi_collect(site, counts, &total, &ticks, &minTicks, &maxTicks) ;
+    }
+    return total ;
+}
+
+static uint64_t site_errors(const char *name) {
+    uint64_t total = 0 ;
+    for (hsasm_spi_site *site = atomic_load(&hsasm_spi_sites) ; site ; site = site->next) {
+        if (strcmp(site->name, name) == 0) total += atomic_load(&site->errors) ;
+    }
+    return total ;
+}
+
+TEST(macrosEvaluateTheCallOnceAndRecordIt) {
+    calls = 0 ;
+    int32_t value = HSASM_SPI("test.value", fake_call(42)) ;
+    CHECK_INT(value, 42) ;
+    CHECK_INT(calls, 1) ;
+    for (int i = 0 ; i < 3 ; i++) (void)HSASM_SPI_ERROR("test.error", fake_call(i == 1 ? 1004 : 0)) ;
+    HSASM_SPI_VOID("test.void", fake_void()) ;
+    CHECK_INT(calls, 5) ;
+    CHECK_INT(site_calls("test.value"), 1) ;
+    CHECK_INT(site_calls("test.error"), 3) ;
+    CHECK_INT(site_errors("test.error"), 1) ;
+    CHECK_INT(site_calls("test.void"), 1) ;
+
+    // two places calling the same function are separate sites with the same name
+    (void)HSASM_SPI_ERROR("test.error", fake_call(1004)) ;
+    CHECK_INT(site_calls("test.error"), 4) ;
+    CHECK_INT(site_errors("test.error"), 2) ;
+
+    static hsasm_spi_site pointerSite = HSASM_SPI_SITE("test.pointer") ;
+    int32_t (*call)(int32_t) = fake_call ;
+    CHECK_INT(HSASM_SPI_ERROR_AT(&pointerSite, call(7)), 7) ;
+    HSASM_SPI_VOID_AT(&pointerSite, fake_void()) ;
+    CHECK_INT(site_calls("test.pointer"), 2) ;
+}
+
+static hsasm_spi_site sharedSite = HSASM_SPI_SITE("test.shared") ;
+
+static void *record_many(void *context) {
+    uint64_t base = (uint64_t)(uintptr_t)context ;
+    for (uint64_t i = 0 ; i < 100000 ; i++) hsasm_spi_record(&sharedSite, base + i % 1000, (i % 100 == 0) ? -1 : 0) ;
+    return NULL ;
+}
+
+static size_t thread_blocks(size_t *withShard, const hsasm_spi_site *site) {
+    size_t count = 0 ;
+    *withShard   = 0 ;
+    for (hsasm_spi_thread *block = atomic_load(&hsasm_spi_threads) ; block ; block = block->next) {
+        count++ ;
+        if (atomic_load(&block->shards[site->index])) (*withShard)++ ;
+    }
+    return count ;
+}
+
+TEST(threadsRecordingToOneSiteLoseNothing) {
+    enum { threads = 8 } ;
+    pthread_t thread[threads] ;
+    for (uintptr_t i = 0 ; i < threads ; i++) pthread_create(&thread[i], NULL, record_many, (void *)(i * 10)) ;
+    for (int i = 0 ; i < threads ; i++) pthread_join(thread[i], NULL) ;
+
+    uint64_t counts[HSASM_SPI_BUCKETS] = { 0 }, calls = 0, totalTicks = 0, minTicks = UINT64_MAX, maxTicks = 0 ;
+    hsasm_spi_collect(&sharedSite, counts, &calls, &totalTicks, &minTicks, &maxTicks) ;
+    CHECK_INT(calls, threads * 100000) ;
+    // each thread records base + 0..999 a hundred times over
+    uint64_t expected = 0 ;
+    for (uint64_t t = 0 ; t < threads ; t++) expected += 100 * (1000 * t * 10 + 999 * 1000 / 2) ;
+    CHECK_INT(totalTicks, expected) ;
+    CHECK_INT(atomic_load(&sharedSite.errors), threads * 1000) ;
+    CHECK_INT(atomic_load(&sharedSite.errorCodes[0].count), threads * 1000) ;
+    CHECK_INT(minTicks, 0) ;
+    CHECK_INT(maxTicks, (threads - 1) * 10 + 999) ;
+
+    // every thread which was running at once had a shard of its own, and none went to the shared counters
+    uint64_t sharedCalls = 0, sharedTicks = 0, sharedMin = UINT64_MAX, sharedMax = 0 ;
+    uint64_t sharedCounts[HSASM_SPI_BUCKETS] = { 0 } ;
+    hsasm_spi_collectShard(&sharedSite.shared, sharedCounts, &sharedCalls, &sharedTicks, &sharedMin, &sharedMax) ;
+    CHECK_INT(sharedCalls, 0) ;
+    size_t withShard ;
+    CHECK(thread_blocks(&withShard, &sharedSite) >= withShard) ;
+    CHECK(withShard >= 1 && withShard <= threads) ;
+}
+
+// one thread after another reuses the same block, and the counts of the first are kept
+TEST(exitedThreadsHandTheirShardsOn) {
+    static hsasm_spi_site site = HSASM_SPI_SITE("test.sequential") ;
+    size_t withShard ;
+    pthread_t thread ;
+    pthread_create(&thread, NULL, record_many, (void *)0) ;
+    pthread_join(thread, NULL) ;
+    hsasm_spi_record(&site, 1, 0) ; // registers the site from this thread
+    size_t blocks = thread_blocks(&withShard, &site) ;
+
+    for (int i = 0 ; i < 20 ; i++) {
+        pthread_create(&thread, NULL, record_many, (void *)0) ;
+        pthread_join(thread, NULL) ;
+    }
+    CHECK_INT(thread_blocks(&withShard, &site), blocks) ;
+
+    uint64_t counts[HSASM_SPI_BUCKETS] = { 0 }, calls = 0, totalTicks = 0, minTicks = UINT64_MAX, maxTicks = 0 ;
+    hsasm_spi_collect(&sharedSite, counts, &calls, &totalTicks, &minTicks, &maxTicks) ;
+    CHECK_INT(calls, (8 + 21) * 100000) ;
+}
+
+// sites past HSASM_SPI_MAX_SITES, or recorded to while another thread registers them, use the shared counters
+TEST(sitesWithoutAThreadShardShareCounters) {
+    static hsasm_spi_site site = HSASM_SPI_SITE("test.overflow") ;
+    site.index      = HSASM_SPI_MAX_SITES ;
+    atomic_store(&site.registered, kHSASMSPIRegistered) ;
+    hsasm_spi_record(&site, 10, 0) ;
+    hsasm_spi_record(&site, 20, 5) ;
+
+    static hsasm_spi_site registering = HSASM_SPI_SITE("test.registering") ;
+    atomic_store(&registering.registered, kHSASMSPIRegistering) ;
+    hsasm_spi_record(&registering, 30, 0) ;
+
+    uint64_t counts[HSASM_SPI_BUCKETS] = { 0 }, calls = 0, totalTicks = 0, minTicks = UINT64_MAX, maxTicks = 0 ;
+    hsasm_spi_collect(&site, counts, &calls, &totalTicks, &minTicks, &maxTicks) ;
+    CHECK_INT(calls, 2) ;
+    CHECK_INT(totalTicks, 30) ;
+    CHECK_INT(minTicks, 10) ;
+    CHECK_INT(maxTicks, 20) ;
+    CHECK_INT(atomic_load(&site.errors), 1) ;
+    calls = totalTicks = 0 ;
+    hsasm_spi_collect(&registering, counts, &calls, &totalTicks, &minTicks, &maxTicks) ;
+    CHECK_INT(calls, 1) ;
+    CHECK_INT(totalTicks, 30) ;
+}
+
+int main(void) {
+    RUN_TEST(bucketsCoverEveryValueInOrder) ;
+    RUN_TEST(bucketsAreWithinAQuarterOfTheirValues) ;
+    RUN_TEST(quantilesMatchTheSortedValues) ;
+    RUN_TEST(siteRecordsCallsTicksAndErrors) ;
+    RUN_TEST(macrosEvaluateTheCallOnceAndRecordIt) ;
+    RUN_TEST(threadsRecordingToOneSiteLoseNothing) ;
+    RUN_TEST(exitedThreadsHandTheirShardsOn) ;
+    RUN_TEST(sitesWithoutAThreadShardShareCounters) ;
+    return test_finish("hsasm spi") ;
+}